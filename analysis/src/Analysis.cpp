@@ -32,6 +32,7 @@
 
 #include "Analysis.hpp"
 #include <sirikata/core/trace/Trace.hpp>
+#include <sirikata/core/trace/TraceFormat.hpp>
 #include <sirikata/core/options/CommonOptions.hpp>
 #include <sirikata/core/util/MotionPath.hpp>
 #include "AnalysisEvents.hpp"
@@ -47,6 +48,19 @@ bool read_record(std::istream& is, uint16* type_hint_out, std::string* payload_o
     is.read( (char*)&record_size, sizeof(record_size) );
     if (!is) return false;
 
+    // Chunked traces interleave chunk headers with records. Sequential
+    // readers don't need the index, so just skip over them.
+    while (record_size == TRACE_CHUNK_MAGIC) {
+        Trace::ChunkHeader header;
+        header.magic = record_size;
+        is.read( ((char*)&header) + sizeof(uint32), sizeof(header) - sizeof(uint32) );
+        if (!is) return false;
+        is.ignore( header.num_types * sizeof(Trace::ChunkTypeCount) + header.num_index * sizeof(uint32) );
+
+        is.read( (char*)&record_size, sizeof(record_size) );
+        if (!is) return false;
+    }
+
     is.read( (char*)type_hint_out, sizeof(uint16) );
     if (!is) return false;
 
@@ -2217,7 +2231,10 @@ void ProximityDumpAnalysis(const char* opt_name, const uint32 nservers, const St
 
 
 OSegCumulativeTraceAnalysis::OSegCumulativeTraceAnalysis(const char* opt_name, const uint32 nservers, uint64 time_after)
-  : mInitialTime(0)
+  : mInitialTime(0),
+    mLookupBatches(0),
+    mBatchedLookups(0),
+    mNegativeCacheHits(0)
 {
   for(uint32 server_id = 1; server_id <= nservers; server_id++)
   {
@@ -2234,6 +2251,12 @@ OSegCumulativeTraceAnalysis::OSegCumulativeTraceAnalysis(const char* opt_name, c
         break;
 
       OSegCumulativeResponseEvent* oseg_cum_evt = dynamic_cast<OSegCumulativeResponseEvent*> (evt);
+      if (oseg_cum_evt != NULL && oseg_cum_evt->data.latency_bucket_count_size() > 0)
+      {
+        addLatencySummary(oseg_cum_evt);
+        delete evt;
+        continue;
+      }
       if (oseg_cum_evt != NULL)
       {
         if (allTraces.size() == 0)
@@ -2254,6 +2277,16 @@ OSegCumulativeTraceAnalysis::OSegCumulativeTraceAnalysis(const char* opt_name, c
 }
 
 
+void OSegCumulativeTraceAnalysis::addLatencySummary(const OSegCumulativeResponseEvent* evt)
+{
+  for (int s = 0; s < evt->data.latency_bucket_count_size() && s < evt->data.latency_bucket_bound_size(); ++s)
+    mLatencyHistogram[evt->data.latency_bucket_bound(s)] += evt->data.latency_bucket_count(s);
+
+  mLookupBatches += evt->data.lookup_batches();
+  mBatchedLookups += evt->data.batched_lookups();
+  mNegativeCacheHits += evt->data.negative_cache_hits();
+}
+
 void OSegCumulativeTraceAnalysis::generateAllData()
 {
   for (int s=0; s <(int) allTraces.size();  ++s)
@@ -2314,6 +2347,8 @@ void OSegCumulativeTraceAnalysis::printDataHuman(std::ostream &fileOut)
   for (int s=0; s < untilVariable; ++s)
     fileOut  << mCumData[s]->cacheTime << ",";
 
+  fileOut << "\n\nLookup Latency Histogram\n";
+  printLatencyHistogram(fileOut);
   fileOut << "\n\nCraq Lookup Post Times\n";
   for (int s=0; s < untilVariable; ++s)
     fileOut  << mCumData[s]->craqLookupPostTime << ",";
@@ -2384,6 +2419,18 @@ void OSegCumulativeTraceAnalysis::printDataHuman(std::ostream &fileOut)
 }
 
 
+void OSegCumulativeTraceAnalysis::printLatencyHistogram(std::ostream &fileOut)
+{
+  // One line per bucket, upper bound in microseconds and count. The final
+  // bucket's bound is the max uint64.
+  for (std::map<uint64, uint64>::const_iterator it = mLatencyHistogram.begin(); it != mLatencyHistogram.end(); ++it)
+    fileOut << it->first << "," << it->second << "\n";
+
+  fileOut << "batches," << mLookupBatches << "\n";
+  fileOut << "batched_lookups," << mBatchedLookups << "\n";
+  fileOut << "negative_cache_hits," << mNegativeCacheHits << "\n";
+}
+
 void OSegCumulativeTraceAnalysis::printData(std::ostream &fileOut)
 {
   int untilVariable = mCumData.size();
@@ -346,11 +346,20 @@ public:
     std::vector<CumulativeTraceData*> mCumData;
     void sortByCompleteLookupTime( );
 
+    // Summed lookup latency histograms from the lookup queues' periodic
+    // summaries, bucket upper bound (us) -> count
+    std::map<uint64, uint64> mLatencyHistogram;
+    uint64 mLookupBatches;
+    uint64 mBatchedLookups;
+    uint64 mNegativeCacheHits;
+    void addLatencySummary(const OSegCumulativeResponseEvent* evt);
+
   public:
     OSegCumulativeTraceAnalysis(const char* opt_name, const uint32 nservers, uint64 time_after_seconds =  0);
     ~OSegCumulativeTraceAnalysis();
     void printData(std::ostream &fileOut);
     void printDataHuman(std::ostream &fileOut);
+    void printLatencyHistogram(std::ostream &fileOut);
   };
 
 
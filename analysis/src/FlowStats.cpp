@@ -32,6 +32,8 @@
 
 #include "AnalysisEvents.hpp"
 #include "FlowStats.hpp"
+#include "TraceReader.hpp"
+#include "Options.hpp"
 #include <sirikata/core/options/CommonOptions.hpp>
 #include <sirikata/core/util/RegionWeightCalculator.hpp>
 #include "Protocol_ObjectTrace.pbj.hpp"
@@ -44,96 +46,100 @@ typedef PBJEvent<Trace::Object::GeneratedLoc> GeneratedLocationEvent;
 typedef PBJEvent<Trace::Ping::HitPoint> HitPointEvent;
 
 
-FlowStatsAnalysis::FlowStatsAnalysis(const char* opt_name, const uint32 nservers) {
-    RegionWeightCalculator* swc =
-        RegionWeightCalculatorFactory::getSingleton().getConstructor(GetOptionValue<String>(OPT_REGION_WEIGHT))(GetOptionValue<String>(OPT_REGION_WEIGHT_ARGS))
-;
-    Time smallestHitPointTime(Time::epoch());
-    bool firstHitPointSample=true;
-    for(uint32 server_id = 1; server_id <= nservers; server_id++) {
-        String loc_file = GetPerServerFile(opt_name, server_id);
-        std::ifstream is(loc_file.c_str(), std::ios::in);
-
-        while(is) {
-            uint16 type_hint;
-            std::string raw_evt;
-            if (!read_record(is, &type_hint, &raw_evt)) break;
-            if (!is) break;
-            Event* evt = Event::parse(type_hint, raw_evt, server_id);
-            if (evt == NULL)
-                break;
-
-            {
-                ObjectConnectedEvent* conn_evt = dynamic_cast<ObjectConnectedEvent*>(evt);
-                if (conn_evt != NULL) {
-                    mObjectMap[conn_evt->data.source()].server = conn_evt->data.server();
-                }
-            }
-            {
-                GeneratedLocationEvent* gen_loc_evt = dynamic_cast<GeneratedLocationEvent*>(evt);
-                if (gen_loc_evt != NULL) {
-                    mObjectMap[gen_loc_evt->data.source()].path.add(gen_loc_evt);
-                    mObjectMap[gen_loc_evt->data.source()].bounds = gen_loc_evt->data.bounds();
-                }
-            }
-            {
-                PingCreatedEvent* ping_evt = dynamic_cast<PingCreatedEvent*>(evt);
-                if (ping_evt != NULL) {
-                    mFlowMap[ ObjectPair(ping_evt->data.sender(),ping_evt->data.receiver()) ].sent_count++;
-                    mFlowMap[ ObjectPair(ping_evt->data.sender(),ping_evt->data.receiver()) ].sent_bytes += ping_evt->data.size();
-                }
-            }
-            {
-                PingEvent* ping_evt = dynamic_cast<PingEvent*>(evt);
-                if (ping_evt != NULL) {
-                    mFlowMap[ ObjectPair(ping_evt->data.sender(),ping_evt->data.receiver()) ].recv_count++;
-                    mFlowMap[ ObjectPair(ping_evt->data.sender(),ping_evt->data.receiver()) ].recv_bytes += ping_evt->data.size();
-                }
-            }
+void FlowStatsAnalysis::handleEvent(Event* evt) {
+    {
+        ObjectConnectedEvent* conn_evt = dynamic_cast<ObjectConnectedEvent*>(evt);
+        if (conn_evt != NULL) {
+            mObjectMap[conn_evt->data.source()].server = conn_evt->data.server();
+        }
+    }
+    {
+        GeneratedLocationEvent* gen_loc_evt = dynamic_cast<GeneratedLocationEvent*>(evt);
+        if (gen_loc_evt != NULL) {
+            mObjectMap[gen_loc_evt->data.source()].path.add(gen_loc_evt);
+            mObjectMap[gen_loc_evt->data.source()].bounds = gen_loc_evt->data.bounds();
+        }
+    }
+    {
+        PingCreatedEvent* ping_evt = dynamic_cast<PingCreatedEvent*>(evt);
+        if (ping_evt != NULL) {
+            mFlowMap[ ObjectPair(ping_evt->data.sender(),ping_evt->data.receiver()) ].sent_count++;
+            mFlowMap[ ObjectPair(ping_evt->data.sender(),ping_evt->data.receiver()) ].sent_bytes += ping_evt->data.size();
+        }
+    }
+    {
+        PingEvent* ping_evt = dynamic_cast<PingEvent*>(evt);
+        if (ping_evt != NULL) {
+            mFlowMap[ ObjectPair(ping_evt->data.sender(),ping_evt->data.receiver()) ].recv_count++;
+            mFlowMap[ ObjectPair(ping_evt->data.sender(),ping_evt->data.receiver()) ].recv_bytes += ping_evt->data.size();
+        }
+    }
 
-            {
-                HitPointEvent* ping_evt = dynamic_cast<HitPointEvent*>(evt);
-                if (ping_evt != NULL) {
-                    HitPointInfo * hpi=NULL;
-                    ObjectPair pair(ping_evt->data.sender(),ping_evt->data.receiver());
-                    if (mHitPointMap.find(pair)==mHitPointMap.end()) {
-                        
-                        ObjectMap::iterator source_it = mObjectMap.find(ping_evt->data.sender());
-                        ObjectMap::iterator dest_it = mObjectMap.find(ping_evt->data.receiver());
-                        if (source_it!=mObjectMap.end()&&dest_it!=mObjectMap.end()) {
-                            hpi=&mHitPointMap[pair];
-                            hpi->distance=ping_evt->data.distance();
-                            TimedMotionVector3f start1 = source_it->second.path.initial();
-                            TimedMotionVector3f start2 = dest_it->second.path.initial();
-                            
-                            BoundingBox3f world_bounds1 = BoundingBox3f(source_it->second.bounds.center() + start1.position(), source_it->second.bounds.radius());
-                            BoundingBox3f world_bounds2 = BoundingBox3f(dest_it->second.bounds.center() + start2.position(), dest_it->second.bounds.radius());
-                            double priority = swc->weight(world_bounds1, world_bounds2);
-
-
-                            hpi->weight=priority;
-                        }else {
-                            SILOG(analysis,error, "Unable to find "<<ping_evt->data.sender().toString()<<" and/or "<<ping_evt->data.receiver().toString());
-                        }
-                    }else {
-                        hpi=&mHitPointMap[pair];
-                    }
-                    hpi->samples.push_back(HitPointInfo::Sample(ping_evt->data.t(),ping_evt->data.received()));
-                    
-                    hpi->samples.back().starthp=ping_evt->data.sent_hp();
-                    hpi->samples.back().endhp=ping_evt->data.actual_hp();
-                    if(firstHitPointSample) 
-                        smallestHitPointTime=ping_evt->data.t();
-                    else if (smallestHitPointTime>ping_evt->data.t()) {
-                        smallestHitPointTime=ping_evt->data.t();
-                    }
-                    firstHitPointSample=false;
+    {
+        HitPointEvent* ping_evt = dynamic_cast<HitPointEvent*>(evt);
+        if (ping_evt != NULL) {
+            HitPointInfo * hpi=NULL;
+            ObjectPair pair(ping_evt->data.sender(),ping_evt->data.receiver());
+            if (mHitPointMap.find(pair)==mHitPointMap.end()) {
+                
+                ObjectMap::iterator source_it = mObjectMap.find(ping_evt->data.sender());
+                ObjectMap::iterator dest_it = mObjectMap.find(ping_evt->data.receiver());
+                if (source_it!=mObjectMap.end()&&dest_it!=mObjectMap.end()) {
+                    hpi=&mHitPointMap[pair];
+                    hpi->distance=ping_evt->data.distance();
+                    TimedMotionVector3f start1 = source_it->second.path.initial();
+                    TimedMotionVector3f start2 = dest_it->second.path.initial();
                     
+                    BoundingBox3f world_bounds1 = BoundingBox3f(source_it->second.bounds.center() + start1.position(), source_it->second.bounds.radius());
+                    BoundingBox3f world_bounds2 = BoundingBox3f(dest_it->second.bounds.center() + start2.position(), dest_it->second.bounds.radius());
+                    double priority = mWeightCalculator->weight(world_bounds1, world_bounds2);
+
+
+                    hpi->weight=priority;
+                }else {
+                    SILOG(analysis,error, "Unable to find "<<ping_evt->data.sender().toString()<<" and/or "<<ping_evt->data.receiver().toString());
                 }
+            }else {
+                hpi=&mHitPointMap[pair];
             }
-            delete evt;
+            hpi->samples.push_back(HitPointInfo::Sample(ping_evt->data.t(),ping_evt->data.received()));
+            
+            hpi->samples.back().starthp=ping_evt->data.sent_hp();
+            hpi->samples.back().endhp=ping_evt->data.actual_hp();
+            if(mFirstHitPointSample) 
+                mSmallestHitPointTime=ping_evt->data.t();
+            else if (mSmallestHitPointTime>ping_evt->data.t()) {
+                mSmallestHitPointTime=ping_evt->data.t();
+            }
+            mFirstHitPointSample=false;
+            
         }
     }
+    delete evt;
+}
+
+FlowStatsAnalysis::FlowStatsAnalysis(const char* opt_name, const uint32 nservers)
+ : mSmallestHitPointTime(Time::epoch()),
+   mFirstHitPointSample(true)
+{
+    RegionWeightCalculator* swc =
+        RegionWeightCalculatorFactory::getSingleton().getConstructor(GetOptionValue<String>(OPT_REGION_WEIGHT))(GetOptionValue<String>(OPT_REGION_WEIGHT_ARGS))
+;
+    mWeightCalculator = swc;
+
+    // Only the record types used below need to be decoded
+    TraceFilter filter;
+    filter.type(ObjectConnectedTag).type(ObjectGeneratedLocationTag)
+        .type(ObjectPingCreatedTag).type(ObjectPingTag).type(ObjectHitPointTag);
+    WindowFromOptions(filter);
+    uint32 nthreads = GetOptionValue<uint32>(ANALYSIS_THREADS);
+
+    for(uint32 server_id = 1; server_id <= nservers; server_id++) {
+        String loc_file = GetPerServerFile(opt_name, server_id);
+        TraceReader reader(loc_file, server_id);
+        reader.read(filter, nthreads, std::tr1::bind(&FlowStatsAnalysis::handleEvent, this, std::tr1::placeholders::_1));
+    }
+    Time smallestHitPointTime = mSmallestHitPointTime;
     if (mHitPointMap.size()) {
         FILE * fp = fopen("hitpointstats.txt","w");
         if (fp )  {
@@ -38,6 +38,9 @@
 
 namespace Sirikata {
 
+class RegionWeightCalculator;
+struct Event;
+
 /** Generates summary statistics on a per flow basis.  A flow is data between an
  *  ordered pair of objects (source, dest).  Summary information includes
  *  weights, sent bytes, received bytes.
@@ -47,6 +50,12 @@ public:
     FlowStatsAnalysis(const char* opt_name, const uint32 nservers);
 
 private:
+    void handleEvent(Event* evt);
+
+    RegionWeightCalculator* mWeightCalculator;
+    Time mSmallestHitPointTime;
+    bool mFirstHitPointSample;
+
     struct ObjectInfo {
         ServerID server;
         RecordedMotionPath path;
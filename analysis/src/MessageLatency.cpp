@@ -32,6 +32,8 @@
 
 #include "AnalysisEvents.hpp"
 #include "MessageLatency.hpp"
+#include "TraceReader.hpp"
+#include "Options.hpp"
 #include <sirikata/core/options/CommonOptions.hpp>
 
 #define INFO_LOG(msg) SILOG(msg_lat_anls,insane,msg)
@@ -811,6 +813,55 @@ void reportStats(PathPair pp, PathAverageMap* pam) {
           );
 }
 
+typedef std::tr1::unordered_map<uint64,PacketData> PacketMap;
+typedef std::priority_queue<uint64> PacketIDPriority;
+
+// Collects the timestamps for one round of MessageLatencyAnalysis. Only
+// packets with IDs above round_base_id are considered, and at most
+// round_max_packets of the smallest such IDs are retained.
+void collectPacketEvent(PacketMap* flow, PacketIDPriority* priorities, uint64 round_base_id, uint32 round_max_packets, uint32 server_id, Event* evt) {
+    MessageTimestampEvent* tevt = dynamic_cast<MessageTimestampEvent*>(evt);
+    if (tevt != NULL) {
+        uint64 pid = tevt->uid;
+
+        // Figure out if we need to / can add this packet
+        bool should_insert = false;
+        if (flow->find(pid) != flow->end()) {
+            should_insert = true;
+        }
+        else {
+            if (pid > round_base_id) {
+                // Either we fit in now problem
+                if (priorities->size() < round_max_packets) {
+                    priorities->push(pid);
+                    should_insert = true;
+                }
+                else {
+                    // Or we need to evict, or are ignored
+                    uint64 top_pid = priorities->top();
+                    if (top_pid > pid) {
+                        priorities->pop();
+                        flow->erase(top_pid);
+                        priorities->push(pid);
+                        should_insert = true;
+                    }
+                }
+            }
+        }
+
+        if (should_insert) {
+            PacketData* pd = &(*flow)[tevt->uid];
+            pd->stamps[server_id].push_back(PacketSample(tevt->time, server_id, tevt->path));
+            MessageCreationTimestampEvent* cevt = dynamic_cast<MessageCreationTimestampEvent*>(evt);
+            if (cevt != NULL) {
+                if (cevt->srcport!=0) pd->source_port = cevt->srcport;
+                if (cevt->dstport!=0) pd->dest_port = cevt->dstport;
+            }
+        }
+    }
+    delete evt;
+}
+
 } // namespace
 
 MessageLatencyFilters::MessageLatencyFilters(ObjectMessagePort *destPort, const uint32*filterByCreationServer,const uint32 *filterByDestructionServer, const uint32*filterByForwardingServer, const uint32 *filterByDeliveryServer) {
@@ -890,8 +941,16 @@ void MessageLatencyAnalysis(const char* opt_name, const uint32 nservers, Message
     // then the largest packet ID from the current round.  For the first round,
     // the base packet ID will obviously be 0.
 
-    typedef std::tr1::unordered_map<uint64,PacketData> PacketMap;
-    typedef std::priority_queue<uint64> PacketIDPriority;
+    // Traces are mapped once and rescanned every round. Only timestamp
+    // records are decoded.
+    TraceFilter trace_filter;
+    trace_filter.type(MessageTimestampTag).type(MessageCreationTimestampTag);
+    WindowFromOptions(trace_filter);
+    uint32 nthreads = GetOptionValue<uint32>(ANALYSIS_THREADS);
+
+    std::vector<TraceReader*> readers;
+    for(uint32 server_id = 1; server_id <= nservers; server_id++)
+        readers.push_back(new TraceReader(GetPerServerFile(opt_name, server_id), server_id));
 
     // Prepare output data structures
     std::ofstream* stage_dump_file = NULL;
@@ -916,60 +975,10 @@ void MessageLatencyAnalysis(const char* opt_name, const uint32 nservers, Message
 
         // Read in data for this round
         for(uint32 server_id = 1; server_id <= nservers; server_id++) {
-            String loc_file = GetPerServerFile(opt_name, server_id);
-            std::ifstream is(loc_file.c_str(), std::ios::in);
-
-            while(is) {
-                uint16 type_hint;
-                std::string raw_evt;
-                if (!read_record(is, &type_hint, &raw_evt)) break;
-                Event* evt = Event::parse(type_hint, raw_evt, server_id);
-                if (evt == NULL)
-                    break;
-
-                {
-                    MessageTimestampEvent* tevt = dynamic_cast<MessageTimestampEvent*>(evt);
-                    if (tevt != NULL) {
-                        uint64 pid = tevt->uid;
-
-                        // Figure out if we need to / can add this packet
-                        bool should_insert = false;
-                        if (packetFlow.find(pid) != packetFlow.end()) {
-                            should_insert = true;
-                        }
-                        else {
-                            if (pid > round_base_id) {
-                                // Either we fit in now problem
-                                if (packetPriorities.size() < round_max_packets) {
-                                    packetPriorities.push(pid);
-                                    should_insert = true;
-                                }
-                                else {
-                                    // Or we need to evict, or are ignored
-                                    uint64 top_pid = packetPriorities.top();
-                                    if (top_pid > pid) {
-                                        packetPriorities.pop();
-                                        packetFlow.erase(top_pid);
-                                        packetPriorities.push(pid);
-                                        should_insert = true;
-                                    }
-                                }
-                            }
-                        }
-
-                        if (should_insert) {
-                            PacketData* pd = &packetFlow[tevt->uid];
-                            pd->stamps[server_id].push_back(PacketSample(tevt->time, server_id, tevt->path));
-                            MessageCreationTimestampEvent* cevt = dynamic_cast<MessageCreationTimestampEvent*>(evt);
-                            if (cevt != NULL) {
-                                if (cevt->srcport!=0) pd->source_port = cevt->srcport;
-                                if (cevt->dstport!=0) pd->dest_port = cevt->dstport;
-                            }
-                        }
-                    }
-                }
-                delete evt;
-            }
+            readers[server_id-1]->read(
+                trace_filter, nthreads,
+                std::tr1::bind(&collectPacketEvent, &packetFlow, &packetPriorities, round_base_id, round_max_packets, server_id, _1)
+            );
         }
 
         // Perform a stable sort for each packet's server timestamp lists, then try
@@ -1002,6 +1011,9 @@ void MessageLatencyAnalysis(const char* opt_name, const uint32 nservers, Message
             break;
     }
 
+    for(uint32 i = 0; i < readers.size(); i++)
+        delete readers[i];
+
     if (stage_dump_file) {
         stage_dump_file->close();
         delete stage_dump_file;
@@ -61,6 +61,10 @@ void InitAnalysisOptions() {
 
 
         .addOption(new OptionValue(ANALYSIS_TOTAL_NUM_ALL_SERVERS ,"0",Sirikata::OptionValueType<uint32>(),"Number of all servers/trace files to go through."))
+
+        .addOption(new OptionValue(ANALYSIS_THREADS, "0", Sirikata::OptionValueType<uint32>(), "Number of threads used to decode trace files, 0 to use one per core."))
+        .addOption(new OptionValue(ANALYSIS_WINDOW_START, "0s", Sirikata::OptionValueType<Duration>(), "Ignore trace records before this time, for analyses which support time windows"))
+        .addOption(new OptionValue(ANALYSIS_WINDOW_END, "0s", Sirikata::OptionValueType<Duration>(), "Ignore trace records after this time, 0 for no limit, for analyses which support time windows"))
         
 
         
@@ -52,6 +52,10 @@
 
 #define ANALYSIS_TOTAL_NUM_ALL_SERVERS "analysis.total.num.all.servers"
 
+#define ANALYSIS_THREADS "analysis.threads"
+#define ANALYSIS_WINDOW_START "analysis.window.start"
+#define ANALYSIS_WINDOW_END "analysis.window.end"
+
 #define OSEG_ANALYZE_AFTER         "oseg_analyze_after"
 
 
@@ -0,0 +1,325 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "TraceReader.hpp"
+#include "Options.hpp"
+#include <sirikata/core/options/CommonOptions.hpp>
+#include <sirikata/core/util/Thread.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
+#include <sirikata/core/network/IOServicePool.hpp>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+// Maximum number of pieces decoded, per thread, before delivering events
+#define PIECES_PER_THREAD_ROUND 8
+// Chunks are split at index points into pieces of about this many bytes
+#define PIECE_SIZE 16384
+
+namespace Sirikata {
+
+TraceFilter::TraceFilter()
+ : start(Time::null()),
+   end(Time((uint64)-1))
+{
+}
+
+TraceFilter& TraceFilter::type(uint16 type_hint) {
+    types.insert(type_hint);
+    return *this;
+}
+
+TraceFilter& TraceFilter::window(const Time& _start, const Time& _end) {
+    start = _start;
+    end = _end;
+    return *this;
+}
+
+bool TraceFilter::matchesType(uint16 type_hint) const {
+    return (types.empty() || types.find(type_hint) != types.end());
+}
+
+bool TraceFilter::matchesTime(const Time& t) const {
+    return (t >= start && t <= end);
+}
+
+bool TraceFilter::matchesChunk(const Trace::ChunkHeader& header, const Trace::ChunkTypeCount* chunk_types) const {
+    if (header.num_records == 0)
+        return false;
+    if (Time(header.max_time) < start || Time(header.min_time) > end)
+        return false;
+    if (types.empty())
+        return true;
+
+    for(uint16 i = 0; i < header.num_types; i++) {
+        uint16 type_hint = chunk_types[i].type_hint;
+        // The last bucket counts all large type hints, so we can't tell
+        // whether it holds the ones we want
+        if (type_hint == TRACE_CHUNK_MAX_TYPE_HINT-1)
+            return true;
+        if (types.find(type_hint) != types.end())
+            return true;
+    }
+    return false;
+}
+
+TraceFilter& WindowFromOptions(TraceFilter& filter) {
+    Duration start = GetOptionValue<Duration>(ANALYSIS_WINDOW_START);
+    Duration end = GetOptionValue<Duration>(ANALYSIS_WINDOW_END);
+    filter.start = Time::epoch() + start;
+    if (end > Duration::zero())
+        filter.end = Time::epoch() + end;
+    return filter;
+}
+
+
+TraceReader::TraceReader(const String& filename, const ServerID& trace_server_id)
+ : mServerID(trace_server_id),
+   mFile(NULL),
+   mRegion(NULL),
+   mData(NULL),
+   mSize(0),
+   mChunked(false)
+{
+    try {
+        mFile = new boost::interprocess::file_mapping(filename.c_str(), boost::interprocess::read_only);
+        mRegion = new boost::interprocess::mapped_region(*mFile, boost::interprocess::read_only);
+        mData = (const uint8*)mRegion->get_address();
+        mSize = mRegion->get_size();
+    }
+    catch(boost::interprocess::interprocess_exception& e) {
+        SILOG(analysis,error,"Couldn't map trace file " << filename << ": " << e.what());
+        delete mRegion; mRegion = NULL;
+        delete mFile; mFile = NULL;
+        mData = NULL;
+        mSize = 0;
+        return;
+    }
+
+    if (mSize >= sizeof(uint32) && *(const uint32*)mData == TRACE_CHUNK_MAGIC) {
+        mChunked = true;
+        indexChunks();
+    }
+}
+
+TraceReader::~TraceReader() {
+    delete mRegion;
+    delete mFile;
+}
+
+bool TraceReader::valid() const {
+    return (mData != NULL);
+}
+
+uint32 TraceReader::numChunks() const {
+    return mChunks.size();
+}
+
+void TraceReader::indexChunks() {
+    // Walk the chunk headers, jumping over payloads. This only touches one
+    // page per chunk, so it's cheap even for very large traces.
+    size_t offset = 0;
+    while(offset + sizeof(Trace::ChunkHeader) <= mSize) {
+        const Trace::ChunkHeader* header = (const Trace::ChunkHeader*)(mData + offset);
+        if (header->magic != TRACE_CHUNK_MAGIC || header->version != TRACE_CHUNK_VERSION) {
+            SILOG(analysis,error,"Invalid trace chunk header at offset " << offset << ", ignoring rest of file");
+            break;
+        }
+
+        size_t types_size = header->num_types * sizeof(Trace::ChunkTypeCount);
+        size_t tables_size = types_size + header->num_index * sizeof(uint32);
+        size_t chunk_size = sizeof(Trace::ChunkHeader) + tables_size + header->payload_size;
+        if (offset + chunk_size > mSize) {
+            SILOG(analysis,error,"Truncated trace chunk at offset " << offset << ", ignoring rest of file");
+            break;
+        }
+
+        Chunk chunk;
+        chunk.header = header;
+        chunk.types = (const Trace::ChunkTypeCount*)(mData + offset + sizeof(Trace::ChunkHeader));
+        chunk.index = (const uint32*)(mData + offset + sizeof(Trace::ChunkHeader) + types_size);
+        chunk.payload = mData + offset + sizeof(Trace::ChunkHeader) + tables_size;
+
+        // The index is only used to split chunks up, so a bad one just means
+        // decoding the chunk in one piece
+        bool index_valid = (header->num_index > 0 && chunk.index[0] == 0);
+        for(uint32 i = 1; index_valid && i < header->num_index; i++)
+            index_valid = (chunk.index[i] > chunk.index[i-1] && chunk.index[i] < header->payload_size);
+        if (!index_valid) {
+            if (header->num_index > 0)
+                SILOG(analysis,warn,"Invalid record index in trace chunk at offset " << offset);
+            chunk.index = NULL;
+        }
+
+        mChunks.push_back(chunk);
+
+        offset += chunk_size;
+    }
+}
+
+void TraceReader::decodeRecords(const uint8* begin, const uint8* end, const TraceFilter& filter, EventList* out) {
+    const uint8* cur = begin;
+    while(cur + TRACE_RECORD_HEADER_SIZE <= end) {
+        uint32 record_size;
+        uint16 type_hint;
+        memcpy(&record_size, cur, sizeof(record_size));
+        memcpy(&type_hint, cur + sizeof(uint32), sizeof(type_hint));
+        cur += TRACE_RECORD_HEADER_SIZE;
+        if (cur + record_size > end) break;
+
+        if (filter.matchesType(type_hint)) {
+            std::string raw_evt((const char*)cur, record_size);
+            Event* evt = Event::parse(type_hint, raw_evt, mServerID);
+            if (evt == NULL)
+                break;
+            if (filter.matchesTime(evt->time))
+                out->push_back(evt);
+            else
+                delete evt;
+        }
+        cur += record_size;
+    }
+}
+
+void TraceReader::splitChunk(const Chunk* chunk, std::vector<Piece>* out) {
+    Piece piece;
+    piece.chunk = chunk;
+    piece.begin = 0;
+    if (chunk->index != NULL) {
+        for(uint32 i = 1; i < chunk->header->num_index; i++) {
+            uint32 offset = chunk->index[i];
+            if (offset - piece.begin < PIECE_SIZE) continue;
+            piece.end = offset;
+            out->push_back(piece);
+            piece.begin = offset;
+        }
+    }
+    piece.end = chunk->header->payload_size;
+    out->push_back(piece);
+}
+
+void TraceReader::decodePiece(const Piece* piece, const TraceFilter* filter, EventList* out) {
+    const uint8* payload = piece->chunk->payload;
+    decodeRecords(payload + piece->begin, payload + piece->end, *filter, out);
+}
+
+// A round of pieces being decoded by the calling thread and the workers.
+// Pieces are handed out one at a time, so threads that get small ones pick up
+// more of them.
+struct TraceReader::DecodeRound {
+    const std::vector<Piece>* pieces;
+    uint32 begin;
+    uint32 end;
+    const TraceFilter* filter;
+    std::vector<EventList>* results;
+    AtomicValue<uint32> next;
+
+    boost::mutex mutex;
+    boost::condition_variable finished;
+    uint32 done;
+};
+
+namespace {
+// Decoding threads shared by all TraceReaders, since analyses often have a
+// reader open for each server's trace. The pool is created by the first read
+// that wants more than one thread and reused for every read after it.
+boost::mutex sDecodePoolMutex;
+Network::IOServicePool* sDecodePool = NULL;
+uint32 sDecodePoolThreads = 0;
+
+Network::IOServicePool* decodePool(uint32 nworkers, uint32* nworkers_out) {
+    boost::lock_guard<boost::mutex> lck(sDecodePoolMutex);
+    if (sDecodePool == NULL) {
+        sDecodePool = new Network::IOServicePool("TraceReader Decoding", nworkers);
+        sDecodePool->startWork();
+        sDecodePool->run();
+        sDecodePoolThreads = nworkers;
+    }
+    *nworkers_out = std::min(nworkers, sDecodePoolThreads);
+    return sDecodePool;
+}
+}
+
+void TraceReader::read(const TraceFilter& filter, uint32 nthreads, const EventCallback& cb) {
+    if (!valid()) return;
+
+    if (!mChunked) {
+        EventList events;
+        decodeRecords(mData, mData + mSize, filter, &events);
+        for(EventList::iterator it = events.begin(); it != events.end(); it++)
+            cb(*it);
+        return;
+    }
+
+    if (nthreads == 0)
+        nthreads = std::max((uint32)Thread::hardware_concurrency(), (uint32)1);
+
+    uint32 nmatching = 0;
+    std::vector<Piece> pieces;
+    for(std::vector<Chunk>::const_iterator it = mChunks.begin(); it != mChunks.end(); it++) {
+        if (!filter.matchesChunk(*(it->header), it->types)) continue;
+        nmatching++;
+        splitChunk(&(*it), &pieces);
+    }
+
+    // The calling thread always decodes too, so the pool only needs the rest
+    Network::IOServicePool* pool = NULL;
+    uint32 nworkers = 0;
+    if (nthreads > 1 && pieces.size() > 1)
+        pool = decodePool(nthreads - 1, &nworkers);
+    SILOG(analysis,detailed,"Decoding " << nmatching << " of " << mChunks.size() << " trace chunks, in " << pieces.size() << " pieces, with " << (nworkers+1) << " threads");
+
+    // Decode rounds of pieces in parallel, then deliver each round's events
+    // in order.
+    uint32 round_size = (nworkers+1) * PIECES_PER_THREAD_ROUND;
+    for(uint32 round_start = 0; round_start < pieces.size(); round_start += round_size) {
+        uint32 round_end = std::min(round_start + round_size, (uint32)pieces.size());
+        std::vector<EventList> results(round_end - round_start);
+
+        DecodeRoundPtr round(new DecodeRound());
+        round->pieces = &pieces;
+        round->begin = round_start;
+        round->end = round_end;
+        round->filter = &filter;
+        round->results = &results;
+        round->next = round_start;
+        round->done = 0;
+
+        for(uint32 t = 0; t < nworkers && round_start + t + 1 < round_end; t++)
+            pool->service()->post(std::tr1::bind(&TraceReader::decodeRound, this, round), "TraceReader::decodeRound");
+        decodeRound(round);
+
+        {
+            boost::unique_lock<boost::mutex> lck(round->mutex);
+            while(round->done < round_end - round_start)
+                round->finished.wait(lck);
+        }
+
+        for(uint32 ri = 0; ri < results.size(); ri++) {
+            for(EventList::iterator it = results[ri].begin(); it != results[ri].end(); it++)
+                cb(*it);
+        }
+    }
+}
+
+void TraceReader::decodeRound(DecodeRoundPtr round) {
+    // Workers that start after every piece has been handed out return without
+    // touching the caller's piece list or results, which may be gone by then.
+    uint32 ndecoded = 0;
+    while(true) {
+        uint32 pi = (uint32)(round->next++);
+        if (pi >= round->end) break;
+        decodePiece(&(*round->pieces)[pi], round->filter, &(*round->results)[pi - round->begin]);
+        ndecoded++;
+    }
+    if (ndecoded == 0) return;
+
+    boost::lock_guard<boost::mutex> lck(round->mutex);
+    round->done += ndecoded;
+    if (round->done == round->end - round->begin)
+        round->finished.notify_all();
+}
+
+} // namespace Sirikata
@@ -0,0 +1,113 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_ANALYSIS_TRACE_READER_HPP_
+#define _SIRIKATA_ANALYSIS_TRACE_READER_HPP_
+
+#include "AnalysisEvents.hpp"
+#include <sirikata/core/trace/TraceFormat.hpp>
+
+namespace boost {
+namespace interprocess {
+class file_mapping;
+class mapped_region;
+}
+}
+
+namespace Sirikata {
+
+/** Selects which records a TraceReader should return. By default all records
+ *  match.
+ */
+struct TraceFilter {
+    TraceFilter();
+
+    /// Only return records with this type hint. Can be called multiple times.
+    TraceFilter& type(uint16 type_hint);
+    /// Only return records with times in [start, end]
+    TraceFilter& window(const Time& start, const Time& end);
+
+    bool matchesType(uint16 type_hint) const;
+    bool matchesTime(const Time& t) const;
+    /// Checks whether any record in the chunk could match
+    bool matchesChunk(const Trace::ChunkHeader& header, const Trace::ChunkTypeCount* types) const;
+
+    std::set<uint16> types;
+    Time start;
+    Time end;
+};
+
+/** Fill a filter's time window from the analysis.window.* options. */
+TraceFilter& WindowFromOptions(TraceFilter& filter);
+
+/** TraceReader memory maps a trace file and decodes its records, in parallel
+ *  where possible. Chunked traces (see TraceFormat.hpp) are split into chunks
+ *  which are decoded on a pool of threads, skipping chunks whose type
+ *  histogram or time range can't match the filter. Large chunks are split
+ *  further at the record offsets in their index. The decoding threads are
+ *  created once and shared by all TraceReaders. Events are still
+ *  delivered in file order, on the calling thread, so analyses can
+ *  accumulate results without any locking. Older, unchunked traces are read
+ *  sequentially.
+ */
+class TraceReader {
+public:
+    typedef std::tr1::function<void(Event*)> EventCallback;
+
+    TraceReader(const String& filename, const ServerID& trace_server_id);
+    ~TraceReader();
+
+    /// Returns true if the file was opened successfully
+    bool valid() const;
+    /// Number of chunks in the file, or 0 for unchunked traces
+    uint32 numChunks() const;
+
+    /** Decode all records matching filter, using nthreads threads (0 uses
+     *  one per core), invoking cb for each resulting Event in file order. The
+     *  callback takes ownership of the Event. The shared decoding threads are
+     *  sized by the first read, so later reads use at most that many.
+     */
+    void read(const TraceFilter& filter, uint32 nthreads, const EventCallback& cb);
+
+private:
+    struct Chunk {
+        const Trace::ChunkHeader* header;
+        const Trace::ChunkTypeCount* types;
+        // Payload offsets of every index_stride'th record, or NULL if the
+        // chunk's index is unusable
+        const uint32* index;
+        const uint8* payload;
+    };
+    // A range of a chunk's payload, starting at a record boundary, which can
+    // be decoded independently of the rest of the chunk
+    struct Piece {
+        const Chunk* chunk;
+        uint32 begin;
+        uint32 end;
+    };
+    typedef std::vector<Event*> EventList;
+    struct DecodeRound;
+    typedef std::tr1::shared_ptr<DecodeRound> DecodeRoundPtr;
+
+    void indexChunks();
+    // Split a chunk into pieces at its index points, appending them to out
+    void splitChunk(const Chunk* chunk, std::vector<Piece>* out);
+    void decodePiece(const Piece* piece, const TraceFilter* filter, EventList* out);
+    // Decodes pieces from the round until none are left. Run by the calling
+    // thread and the decoding pool's workers.
+    void decodeRound(DecodeRoundPtr round);
+    void decodeRecords(const uint8* begin, const uint8* end, const TraceFilter& filter, EventList* out);
+
+    ServerID mServerID;
+    boost::interprocess::file_mapping* mFile;
+    boost::interprocess::mapped_region* mRegion;
+    const uint8* mData;
+    size_t mSize;
+    bool mChunked;
+    std::vector<Chunk> mChunks;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_ANALYSIS_TRACE_READER_HPP_
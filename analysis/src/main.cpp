@@ -283,6 +283,13 @@ int main(int argc, char** argv) {
         oseg_cumulative_stream_csv.flush();
         oseg_cumulative_stream_csv.close();
 
+        String oseg_latency_histogram_filename_csv = "oseg_lookup_latency_histogram_file";
+        oseg_latency_histogram_filename_csv += ".csv";
+        std::ofstream oseg_latency_histogram_stream_csv(oseg_latency_histogram_filename_csv.c_str());
+        cumulativeOsegAnalysis.printLatencyHistogram(oseg_latency_histogram_stream_csv);
+        oseg_latency_histogram_stream_csv.flush();
+        oseg_latency_histogram_stream_csv.close();
+
 
         //completed round trip migrate times
         String migration_round_trip_times_filename = "oseg_migration_round_trip_times_file";
@@ -0,0 +1,159 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "DiskCacheBenchmark.hpp"
+#include <sirikata/core/transfer/DiskCacheLayer.hpp>
+#include <sirikata/core/transfer/SlabCacheLayer.hpp>
+#include <sirikata/core/transfer/LRUPolicy.hpp>
+#include <sirikata/core/util/Paths.hpp>
+#include <sirikata/core/util/Timer.hpp>
+#include <sirikata/core/util/Random.hpp>
+#include <sirikata/core/util/UUID.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+
+#define CHUNK_SIZE (16*1024)
+#define NUM_SLAB_READERS 4
+
+namespace Sirikata {
+
+using namespace Transfer;
+
+DiskCacheBenchmark::DiskCacheBenchmark(const FinishedCallback& finished_cb, const String& param)
+        : Benchmark(finished_cb),
+          mForceStop(false),
+          mNumChunks(2000),
+          mPolicy(NULL),
+          mOutstanding(0),
+          mHits(0)
+{
+    if (!param.empty())
+        mNumChunks = boost::lexical_cast<uint32>(param);
+}
+
+String DiskCacheBenchmark::name() {
+    return "disk-cache";
+}
+
+CacheLayer* DiskCacheBenchmark::createLayer(bool slab, const String& dir) {
+    // Leave some room so nothing gets evicted
+    cache_usize_type capacity = (cache_usize_type)mNumChunks * CHUNK_SIZE * 2;
+    if (slab)
+        return new SlabCacheLayer(mPolicy, dir, capacity, NUM_SLAB_READERS, NULL);
+    return new DiskCacheLayer(mPolicy, dir, NULL);
+}
+
+void DiskCacheBenchmark::handleResult(const SparseData* data) {
+    boost::unique_lock<boost::mutex> lck(mMutex);
+    if (data != NULL)
+        mHits++;
+    mOutstanding--;
+    if (mOutstanding == 0)
+        mDoneCV.notify_one();
+}
+
+uint32 DiskCacheBenchmark::requestAll(CacheLayer* layer) {
+    using std::tr1::placeholders::_1;
+
+    {
+        boost::unique_lock<boost::mutex> lck(mMutex);
+        mOutstanding = mFingerprints.size();
+        mHits = 0;
+    }
+    for(uint32 i = 0; i < mFingerprints.size(); i++) {
+        layer->getData(
+            mFingerprints[i], Range(true),
+            std::tr1::bind(&DiskCacheBenchmark::handleResult, this, _1)
+        );
+    }
+
+    boost::unique_lock<boost::mutex> lck(mMutex);
+    while(mOutstanding > 0)
+        mDoneCV.wait(lck);
+    return mHits;
+}
+
+void DiskCacheBenchmark::run(bool slab) {
+    String label = slab ? "slab" : "files";
+    String dir = "disk-cache-benchmark-" + label + "-" + UUID::random().toString();
+    mPolicy = new LRUPolicy((cache_usize_type)mNumChunks * CHUNK_SIZE * 2);
+
+    mFingerprints.clear();
+    std::vector<DenseDataPtr> chunks;
+    for(uint32 i = 0; i < mNumChunks; i++) {
+        MutableDenseDataPtr chunk(new DenseData(Range(0, CHUNK_SIZE, LENGTH, true)));
+        unsigned char* out = chunk->writableData();
+        // Contents just need to be unique per chunk
+        uint32 seed = randInt<uint32>(0, 0xFFFFFFFF);
+        for(uint32 b = 0; b < CHUNK_SIZE; b++)
+            out[b] = (unsigned char)((seed >> ((b % 4) * 8)) + b + i);
+        mFingerprints.push_back(SHA256::computeDigest(out, CHUNK_SIZE));
+        chunks.push_back(chunk);
+    }
+
+    CacheLayer* layer = createLayer(slab, dir);
+
+    Time start_time = Timer::now();
+    for(uint32 i = 0; i < chunks.size(); i++)
+        layer->addToCache(mFingerprints[i], chunks[i]);
+    // Writes are asynchronous, wait until they're all readable
+    while(!mForceStop && requestAll(layer) < mNumChunks)
+        Timer::sleep(Duration::milliseconds(10));
+    Duration fill_dur = Timer::now() - start_time;
+
+    start_time = Timer::now();
+    uint32 hits = requestAll(layer);
+    Duration hit_dur = Timer::now() - start_time;
+
+    delete layer;
+
+    start_time = Timer::now();
+    layer = createLayer(slab, dir);
+    Duration startup_dur = Timer::now() - start_time;
+
+    start_time = Timer::now();
+    uint32 restart_hits = requestAll(layer);
+    Duration restart_hit_dur = Timer::now() - start_time;
+
+    delete layer;
+    delete mPolicy;
+    mPolicy = NULL;
+
+    try {
+        boost::filesystem::remove_all(Path::Get(Path::DIR_TEMP, dir));
+    } catch (boost::filesystem::filesystem_error) {
+    }
+
+    if (mForceStop) return;
+
+    float64 mb = (float64)mNumChunks * CHUNK_SIZE / (1024*1024);
+    SILOG(benchmark,info, label << ": filled in " << fill_dur);
+    SILOG(benchmark,info,
+        label << ": " << hits << " hits, " << (hit_dur.toMicroseconds() / (float64)mNumChunks) << "us/hit, "
+        << (mb / hit_dur.toSeconds()) << "MB/s");
+    SILOG(benchmark,info,
+        label << ": restarted in " << startup_dur << ", then " << restart_hits << " hits, "
+        << (restart_hit_dur.toMicroseconds() / (float64)mNumChunks) << "us/hit");
+}
+
+void DiskCacheBenchmark::start() {
+    mForceStop = false;
+
+    SILOG(benchmark,info, mNumChunks << " chunks of " << CHUNK_SIZE << " bytes");
+
+    run(false);
+    if (!mForceStop)
+        run(true);
+
+    if (mForceStop)
+        return;
+
+    notifyFinished();
+}
+
+void DiskCacheBenchmark::stop() {
+    mForceStop = true;
+}
+
+} // namespace Sirikata
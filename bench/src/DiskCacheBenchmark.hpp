@@ -0,0 +1,58 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_DISK_CACHE_BENCHMARK_HPP_
+#define _SIRIKATA_DISK_CACHE_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+#include <sirikata/core/transfer/CacheLayer.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace Sirikata {
+
+/** Compares cache hits in DiskCacheLayer (one file per entry) and
+ *  SlabCacheLayer (a single preallocated file). Each layer is filled with
+ *  chunks, then all of them are requested at once. The layer is then
+ *  destroyed and recreated on the same directory to measure startup, and all
+ *  chunks are requested again. The parameter sets the number of chunks
+ *  (default 2000, 16KB each).
+ */
+class DiskCacheBenchmark : public Benchmark {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& param) {
+        return new DiskCacheBenchmark(finished_cb, param);
+    }
+
+    DiskCacheBenchmark(const FinishedCallback& finished_cb, const String& param);
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+  private:
+    Transfer::CacheLayer* createLayer(bool slab, const String& dir);
+    void run(bool slab);
+    // Request every chunk and wait for all the results. Returns the number of
+    // hits.
+    uint32 requestAll(Transfer::CacheLayer* layer);
+    void handleResult(const Transfer::SparseData* data);
+
+    volatile bool mForceStop;
+    uint32 mNumChunks;
+    Transfer::CachePolicy* mPolicy;
+    std::vector<Transfer::Fingerprint> mFingerprints;
+
+    boost::mutex mMutex;
+    boost::condition_variable mDoneCV;
+    uint32 mOutstanding;
+    uint32 mHits;
+}; // class DiskCacheBenchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_DISK_CACHE_BENCHMARK_HPP_
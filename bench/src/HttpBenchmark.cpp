@@ -0,0 +1,241 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "HttpBenchmark.hpp"
+#include <sirikata/core/util/Timer.hpp>
+#include <boost/lexical_cast.hpp>
+
+#define RANGE_SIZE (16*1024)
+// Time the server waits before answering each batch of requests it reads
+#define SERVER_LATENCY Duration::milliseconds((int64)5)
+#define COALESCE_WINDOW Duration::milliseconds((int64)2)
+
+namespace Sirikata {
+
+using namespace Transfer;
+
+HttpBenchmark::HttpBenchmark(const FinishedCallback& finished_cb, const String& param)
+        : Benchmark(finished_cb),
+          mForceStop(false),
+          mNumRanges(500),
+          mServerPool(NULL),
+          mListener(NULL),
+          mOutstanding(0),
+          mFailures(0)
+{
+    if (!param.empty())
+        mNumRanges = boost::lexical_cast<uint32>(param);
+}
+
+String HttpBenchmark::name() {
+    return "http";
+}
+
+void HttpBenchmark::startServer() {
+    mServerPool = new Network::IOServicePool("HttpBenchmark Server", 1);
+    mListener = new Network::TCPListener(
+        mServerPool->service(),
+        boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0)
+    );
+    mPort = boost::lexical_cast<String>(mListener->local_endpoint().port());
+    acceptNext();
+
+    mServerPool->startWork();
+    mServerPool->run();
+}
+
+void HttpBenchmark::stopServer() {
+    mServerPool->service()->post(
+        std::tr1::bind(&HttpBenchmark::closeServer, this),
+        "HttpBenchmark::closeServer"
+    );
+    mServerPool->stopWork();
+    mServerPool->join();
+
+    mConnections.clear();
+    delete mListener;
+    mListener = NULL;
+    delete mServerPool;
+    mServerPool = NULL;
+}
+
+void HttpBenchmark::closeServer() {
+    // Cancels everything outstanding so the server thread can exit
+    boost::system::error_code ec;
+    mListener->close(ec);
+    for(uint32 i = 0; i < mConnections.size(); i++)
+        mConnections[i]->socket.close(ec);
+}
+
+void HttpBenchmark::acceptNext() {
+    using std::tr1::placeholders::_1;
+
+    ServerConnectionPtr conn(new ServerConnection(mServerPool->service()));
+    mListener->async_accept(
+        conn->socket,
+        std::tr1::bind(&HttpBenchmark::handleAccept, this, conn, _1)
+    );
+}
+
+void HttpBenchmark::handleAccept(ServerConnectionPtr conn, const boost::system::error_code& err) {
+    if (err) return;
+
+    mConnections.push_back(conn);
+    readNext(conn);
+    acceptNext();
+}
+
+void HttpBenchmark::readNext(ServerConnectionPtr conn) {
+    using std::tr1::placeholders::_1;
+    using std::tr1::placeholders::_2;
+
+    conn->socket.async_read_some(
+        boost::asio::buffer(conn->readBuffer, sizeof(conn->readBuffer)),
+        std::tr1::bind(&HttpBenchmark::handleRead, this, conn, _1, _2)
+    );
+}
+
+void HttpBenchmark::handleRead(ServerConnectionPtr conn, const boost::system::error_code& err, std::size_t bytes_transferred) {
+    if (err) return;
+
+    conn->received.append(conn->readBuffer, bytes_transferred);
+
+    // Answer every complete request in what we've read. We only need to
+    // understand the ranged GETs the benchmark makes.
+    std::tr1::shared_ptr<String> responses(new String());
+    String::size_type header_end;
+    while((header_end = conn->received.find("\r\n\r\n")) != String::npos) {
+        String request = conn->received.substr(0, header_end);
+        conn->received.erase(0, header_end + 4);
+
+        uint64 start = 0, end = RANGE_SIZE - 1;
+        String::size_type range_pos = request.find("Range: bytes=");
+        if (range_pos != String::npos) {
+            std::istringstream range_stream(request.substr(range_pos + 13));
+            char dash;
+            range_stream >> start >> dash >> end;
+        }
+        uint64 length = end - start + 1;
+
+        std::ostringstream response;
+        response << "HTTP/1.1 200 OK\r\n"
+                 << "Content-Length: " << length << "\r\n"
+                 << "Content-Range: bytes " << start << "-" << end << "/*\r\n"
+                 << "\r\n";
+        responses->append(response.str());
+        responses->append((std::size_t)length, 'x');
+    }
+
+    if (!responses->empty()) {
+        // Everything read together shares one simulated round trip
+        mServerPool->service()->post(
+            SERVER_LATENCY,
+            std::tr1::bind(&HttpBenchmark::sendResponses, this, conn, responses),
+            "HttpBenchmark::sendResponses"
+        );
+    }
+
+    readNext(conn);
+}
+
+void HttpBenchmark::sendResponses(ServerConnectionPtr conn, std::tr1::shared_ptr<String> responses) {
+    // Blocking keeps responses in order and this is the only thing the
+    // server thread is doing
+    boost::system::error_code ec;
+    boost::asio::write(conn->socket, boost::asio::buffer(*responses), ec);
+}
+
+void HttpBenchmark::handleResponse(std::tr1::shared_ptr<HttpManager::HttpResponse> response,
+    HttpManager::ERR_TYPE error, const boost::system::error_code& boost_error)
+{
+    boost::unique_lock<boost::mutex> lck(mMutex);
+    if (error != HttpManager::SUCCESS || !response->getData() ||
+        response->getData()->length() != RANGE_SIZE)
+        mFailures++;
+    mOutstanding--;
+    if (mOutstanding == 0)
+        mDoneCV.notify_one();
+}
+
+void HttpBenchmark::run(const String& label, uint32 pipeline_depth, const Duration& coalesce_window) {
+    using std::tr1::placeholders::_1;
+    using std::tr1::placeholders::_2;
+    using std::tr1::placeholders::_3;
+
+    HttpManager& http = HttpManager::getSingleton();
+    const HttpManager::Stats& stats = http.stats();
+    uint32 default_depth = http.pipelineDepth();
+    http.setPipelineDepth(pipeline_depth);
+
+    Network::Address addr("127.0.0.1", mPort);
+    HttpManager::Headers headers;
+    headers["Host"] = "127.0.0.1";
+    // Each run gets its own resource so runs don't reuse each other's batches
+    String path = "/" + label;
+
+    {
+        boost::unique_lock<boost::mutex> lck(mMutex);
+        mOutstanding = mNumRanges;
+        mFailures = 0;
+    }
+
+    uint32 requests_before = stats.requests.read();
+    uint32 connections_before = stats.connections.read();
+    uint32 pipelined_before = stats.pipelined.read();
+    uint32 coalesced_into_before = stats.coalescedInto.read();
+
+    Time start_time = Timer::now();
+    for(uint32 i = 0; i < mNumRanges; i++) {
+        http.getRange(
+            addr, path, Range((uint64)i * RANGE_SIZE, RANGE_SIZE, LENGTH, false),
+            std::tr1::bind(&HttpBenchmark::handleResponse, this, _1, _2, _3),
+            headers, coalesce_window
+        );
+    }
+    {
+        boost::unique_lock<boost::mutex> lck(mMutex);
+        while(mOutstanding > 0)
+            mDoneCV.wait(lck);
+    }
+    Duration dur = Timer::now() - start_time;
+
+    http.setPipelineDepth(default_depth);
+
+    SILOG(benchmark,info,
+        label << ": " << mNumRanges << " ranges in " << dur << ", "
+        << (dur.toMicroseconds() / (float64)mNumRanges) << "us/range, "
+        << mFailures << " failed");
+    SILOG(benchmark,info,
+        label << ": " << (stats.requests.read() - requests_before) << " requests sent, "
+        << (stats.connections.read() - connections_before) << " connections opened, "
+        << (stats.pipelined.read() - pipelined_before) << " pipelined, "
+        << (stats.coalescedInto.read() - coalesced_into_before) << " coalesced requests");
+}
+
+void HttpBenchmark::start() {
+    mForceStop = false;
+
+    SILOG(benchmark,info, mNumRanges << " ranges of " << RANGE_SIZE << " bytes, server latency " << SERVER_LATENCY);
+
+    startServer();
+
+    run("unpipelined", 1, Duration::zero());
+    if (!mForceStop)
+        run("pipelined", HttpManager::getSingleton().pipelineDepth(), Duration::zero());
+    if (!mForceStop)
+        run("coalesced", HttpManager::getSingleton().pipelineDepth(), COALESCE_WINDOW);
+
+    stopServer();
+
+    if (mForceStop)
+        return;
+
+    notifyFinished();
+}
+
+void HttpBenchmark::stop() {
+    mForceStop = true;
+}
+
+} // namespace Sirikata
@@ -0,0 +1,84 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_HTTP_BENCHMARK_HPP_
+#define _SIRIKATA_HTTP_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+#include <sirikata/core/transfer/HttpManager.hpp>
+#include <sirikata/core/network/IOServicePool.hpp>
+#include <sirikata/core/network/Asio.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace Sirikata {
+
+/** Measures HttpManager fetching many ranges of one resource, as the
+ *  MeerkatChunkHandler does when loading a large file. A local server stands
+ *  in for the CDN and delays every batch of requests it reads by a fixed
+ *  latency, so requests that share a round trip finish sooner. The ranges are
+ *  fetched without pipelining, with the default pipeline depth, and with
+ *  coalescing of adjacent ranges. The parameter sets the number of ranges
+ *  (default 500, 16KB each).
+ */
+class HttpBenchmark : public Benchmark {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& param) {
+        return new HttpBenchmark(finished_cb, param);
+    }
+
+    HttpBenchmark(const FinishedCallback& finished_cb, const String& param);
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+  private:
+    struct ServerConnection {
+        ServerConnection(Network::IOService* ios)
+         : socket(ios)
+        {}
+
+        Network::TCPSocket socket;
+        // Data read that doesn't make up a complete request yet
+        String received;
+        char readBuffer[4096];
+    };
+    typedef std::tr1::shared_ptr<ServerConnection> ServerConnectionPtr;
+
+    // Server side, all run on mServerPool's thread
+    void startServer();
+    void stopServer();
+    void acceptNext();
+    void handleAccept(ServerConnectionPtr conn, const boost::system::error_code& err);
+    void readNext(ServerConnectionPtr conn);
+    void handleRead(ServerConnectionPtr conn, const boost::system::error_code& err, std::size_t bytes_transferred);
+    void sendResponses(ServerConnectionPtr conn, std::tr1::shared_ptr<String> responses);
+    void closeServer();
+
+    // Client side
+    void run(const String& label, uint32 pipeline_depth, const Duration& coalesce_window);
+    void handleResponse(std::tr1::shared_ptr<Transfer::HttpManager::HttpResponse> response,
+        Transfer::HttpManager::ERR_TYPE error, const boost::system::error_code& boost_error);
+
+    volatile bool mForceStop;
+    uint32 mNumRanges;
+
+    Network::IOServicePool* mServerPool;
+    Network::TCPListener* mListener;
+    std::vector<ServerConnectionPtr> mConnections;
+    String mPort;
+
+    boost::mutex mMutex;
+    boost::condition_variable mDoneCV;
+    uint32 mOutstanding;
+    uint32 mFailures;
+}; // class HttpBenchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_HTTP_BENCHMARK_HPP_
@@ -0,0 +1,208 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "LocationEncodingBenchmark.hpp"
+#include "../../simoh/src/RandomMotionPath.hpp"
+#include <sirikata/core/util/Random.hpp>
+#include <sirikata/pintoloc/ProtocolLocUpdate.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "Protocol_Loc.pbj.hpp"
+
+#define SIMULATION_SECONDS 60
+// Matches the space server's loc service poll rate
+#define TICK_MS 100
+// Objects pick a new direction this often, with each one's changes offset
+#define MOTION_UPDATE_SECONDS 2
+#define MAX_PER_RESULT 5
+#define REGION_SIZE 1000.f
+
+namespace Sirikata {
+
+namespace {
+typedef LocationSubscriptionIndex<UUID, LocationEncodingBenchmark, LocationEncodingBenchmark, UUID::Hasher> BenchmarkIndex;
+}
+
+LocationEncodingBenchmark::LocationEncodingBenchmark(const FinishedCallback& finished_cb, const String& param)
+        : Benchmark(finished_cb),
+          mForceStop(false),
+          mNumObjects(1000),
+          mMesh("meerkat:///benchmark/models/mesh.dae/optimized/0/mesh.dae"),
+          mMaxPositionError(0),
+          mMaxVelocityError(0)
+{
+    if (!param.empty())
+        mNumObjects = boost::lexical_cast<uint32>(param);
+}
+
+LocationEncodingBenchmark::~LocationEncodingBenchmark() {
+    clearPaths();
+}
+
+String LocationEncodingBenchmark::name() {
+    return "loc-encoding";
+}
+
+void LocationEncodingBenchmark::clearPaths() {
+    for(uint32 i = 0; i < mPaths.size(); i++)
+        delete mPaths[i];
+    mPaths.clear();
+}
+
+void LocationEncodingBenchmark::start() {
+    mForceStop = false;
+    mFullStats = EncodingStats();
+    mCompactStats = EncodingStats();
+    mMaxPositionError = 0;
+    mMaxVelocityError = 0;
+
+    Time start_time = Time::null();
+    Time end_time = start_time + Duration::seconds((int64)SIMULATION_SECONDS);
+    BoundingBox3f region(Vector3f(-REGION_SIZE, -REGION_SIZE, -REGION_SIZE/10), Vector3f(REGION_SIZE, REGION_SIZE, REGION_SIZE/10));
+
+    clearPaths();
+    mObjects.clear();
+    mLocations.clear();
+    for(uint32 i = 0; i < mNumObjects; i++) {
+        mObjects.push_back(UUID::random());
+        Vector3f startpos(
+            randFloat(-REGION_SIZE, REGION_SIZE),
+            randFloat(-REGION_SIZE, REGION_SIZE),
+            randFloat(-REGION_SIZE/10, REGION_SIZE/10)
+        );
+        mPaths.push_back(
+            new RandomMotionPath(
+                start_time, end_time, startpos, randFloat(1.f, 5.f),
+                Duration::seconds((int64)MOTION_UPDATE_SECONDS), region, 0.1f
+            )
+        );
+        mLocations[mObjects.back()] = mPaths.back()->initial();
+    }
+
+    AtomicValue<uint32> full_sent(0), compact_sent(0);
+    BenchmarkIndex full_index(this, /*include_all_data=*/false, full_sent);
+    BenchmarkIndex compact_index(this, /*include_all_data=*/false, compact_sent);
+    mFullSubscriber = UUID::random();
+    mCompactSubscriber = UUID::random();
+    compact_index.setEncoding(mCompactSubscriber, LocUpdateEncodingCompact);
+
+    SeqNoPtr full_seqno(new SeqNo(0)), compact_seqno(new SeqNo(0));
+    for(uint32 i = 0; i < mNumObjects; i++) {
+        full_index.subscribe(mFullSubscriber, mObjects[i], this, full_seqno);
+        compact_index.subscribe(mCompactSubscriber, mObjects[i], this, compact_seqno);
+    }
+
+    // Replay the motion, sending whatever changed each tick
+    std::vector<Time> last_update(mNumObjects, start_time);
+    for(Time t = start_time; t <= end_time && !mForceStop; t += Duration::milliseconds((int64)TICK_MS)) {
+        for(uint32 i = 0; i < mNumObjects; i++) {
+            const TimedMotionVector3f* next = mPaths[i]->nextUpdate(last_update[i]);
+            if (next == NULL || next->updateTime() > t) continue;
+            last_update[i] = next->updateTime();
+            mLocations[mObjects[i]] = *next;
+            full_index.locationUpdated(mObjects[i], *next, this);
+            compact_index.locationUpdated(mObjects[i], *next, this);
+        }
+
+        // service() includes parsing in trySend, which is timed separately
+        Duration full_parsed = mFullStats.parse, compact_parsed = mCompactStats.parse;
+        Time full_start = Timer::now();
+        full_index.service(MAX_PER_RESULT, NULL);
+        Time compact_start = Timer::now();
+        compact_index.service(MAX_PER_RESULT, NULL);
+        Time compact_end = Timer::now();
+        mFullStats.build += (compact_start - full_start) - (mFullStats.parse - full_parsed);
+        mCompactStats.build += (compact_end - compact_start) - (mCompactStats.parse - compact_parsed);
+    }
+
+    if (mForceStop)
+        return;
+
+    report("full", mFullStats);
+    report("compact", mCompactStats);
+    SILOG(benchmark,info,
+        "compact/full bytes " << ((float64)mCompactStats.bytes / mFullStats.bytes)
+        << ", max position error " << mMaxPositionError
+        << ", max velocity error " << mMaxVelocityError);
+
+    notifyFinished();
+}
+
+void LocationEncodingBenchmark::report(const String& label, const EncodingStats& stats) {
+    SILOG(benchmark,info,
+        label << ": " << mNumObjects << " objects, " << stats.updates << " updates in "
+        << stats.messages << " messages, " << stats.bytes << " bytes ("
+        << ((float64)stats.bytes / stats.updates) << " per update), "
+        << "build " << stats.build << ", parse " << stats.parse);
+}
+
+void LocationEncodingBenchmark::stop() {
+    mForceStop = true;
+}
+
+bool LocationEncodingBenchmark::trySend(const UUID& sub, const String& serialized_blu, const LocationSubscriberInfoPtr& sub_info) {
+    // Parse each message as the subscriber would, checking the compact
+    // encoding's error against the true locations
+    if (sub == mFullSubscriber) {
+        Time parse_start = Timer::now();
+        Sirikata::Protocol::Loc::BulkLocationUpdate bulk;
+        bulk.ParseFromString(serialized_blu);
+        Duration parse_dur = Timer::now() - parse_start;
+
+        mFullStats.parse += parse_dur;
+        mFullStats.messages++;
+        mFullStats.bytes += serialized_blu.size();
+        mFullStats.updates += bulk.update_size();
+        return true;
+    }
+
+    Time parse_start = Timer::now();
+    CompactBulkLocationUpdate bulk;
+    bool parsed = bulk.ParseFromString(serialized_blu);
+    Duration parse_dur = Timer::now() - parse_start;
+    if (!parsed) {
+        SILOG(benchmark,error,"Failed to parse compact location update");
+        return true;
+    }
+
+    mCompactStats.parse += parse_dur;
+    mCompactStats.messages++;
+    mCompactStats.bytes += serialized_blu.size();
+    mCompactStats.updates += bulk.update_size();
+
+    for(int32 i = 0; i < bulk.update_size(); i++) {
+        const CompactLocationUpdate& update = bulk.update(i);
+        if ((update.fields & CompactLocationUpdate::Location) == 0) continue;
+        const TimedMotionVector3f& truth = mLocations[update.object];
+        mMaxPositionError = std::max(mMaxPositionError, (float64)(update.location.position() - truth.position()).length());
+        mMaxVelocityError = std::max(mMaxVelocityError, (float64)(update.location.velocity() - truth.velocity()).length());
+    }
+    return true;
+}
+
+TimedMotionVector3f LocationEncodingBenchmark::location(const UUID& uuid) {
+    return mLocations[uuid];
+}
+
+TimedMotionQuaternion LocationEncodingBenchmark::orientation(const UUID& uuid) {
+    return TimedMotionQuaternion(Time::null(), MotionQuaternion(Quaternion::identity(), Quaternion::identity()));
+}
+
+AggregateBoundingInfo LocationEncodingBenchmark::bounds(const UUID& uuid) {
+    return AggregateBoundingInfo(Vector3f(0, 0, 0), 0.f, 1.f);
+}
+
+const String& LocationEncodingBenchmark::mesh(const UUID& uuid) {
+    return mMesh;
+}
+
+const String& LocationEncodingBenchmark::physics(const UUID& uuid) {
+    return mEmpty;
+}
+
+const String& LocationEncodingBenchmark::queryData(const UUID& uuid) {
+    return mEmpty;
+}
+
+} // namespace Sirikata
@@ -0,0 +1,87 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_LOCATION_ENCODING_BENCHMARK_HPP_
+#define _SIRIKATA_LOCATION_ENCODING_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+#include <sirikata/space/LocationSubscriptionIndex.hpp>
+
+namespace Sirikata {
+
+class RandomMotionPath;
+
+/** Compares the full and compact location update encodings by replaying
+ *  random motion for a set of objects through two LocationSubscriptionIndexes,
+ *  one per encoding, each with a subscriber observing every object. Reports
+ *  bytes sent, time to build and parse messages, and the largest position
+ *  and velocity error introduced by quantization. The parameter sets the
+ *  number of objects (default 1000).
+ */
+class LocationEncodingBenchmark : public Benchmark {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& param) {
+        return new LocationEncodingBenchmark(finished_cb, param);
+    }
+
+    LocationEncodingBenchmark(const FinishedCallback& finished_cb, const String& param);
+    ~LocationEncodingBenchmark();
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+    // Interface used by the indexes
+    bool validSubscriber(const UUID& sub) { return true; }
+    bool isSelfSubscriber(const UUID& sub, const UUID& observed) { return false; }
+    bool trySend(const UUID& sub, const String& serialized_blu, const LocationSubscriberInfoPtr& sub_info);
+
+    uint64 epoch(const UUID& uuid) { return 0; }
+    TimedMotionVector3f location(const UUID& uuid);
+    TimedMotionQuaternion orientation(const UUID& uuid);
+    AggregateBoundingInfo bounds(const UUID& uuid);
+    const String& mesh(const UUID& uuid);
+    const String& physics(const UUID& uuid);
+    const String& queryData(const UUID& uuid);
+
+  private:
+    struct EncodingStats {
+        EncodingStats()
+         : messages(0), bytes(0), updates(0),
+           build(Duration::zero()), parse(Duration::zero())
+        {}
+        uint64 messages;
+        uint64 bytes;
+        uint64 updates;
+        Duration build;
+        Duration parse;
+    };
+
+    void clearPaths();
+    void report(const String& label, const EncodingStats& stats);
+
+    volatile bool mForceStop;
+    uint32 mNumObjects;
+
+    std::vector<UUID> mObjects;
+    std::vector<RandomMotionPath*> mPaths;
+    typedef std::tr1::unordered_map<UUID, TimedMotionVector3f, UUID::Hasher> LocationMap;
+    LocationMap mLocations;
+    String mMesh;
+    String mEmpty;
+
+    UUID mFullSubscriber;
+    UUID mCompactSubscriber;
+    EncodingStats mFullStats;
+    EncodingStats mCompactStats;
+    float64 mMaxPositionError;
+    float64 mMaxVelocityError;
+}; // class LocationEncodingBenchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_LOCATION_ENCODING_BENCHMARK_HPP_
@@ -0,0 +1,159 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "LocationSubscriptionBenchmark.hpp"
+#include <sirikata/core/network/IOServicePool.hpp>
+#include <boost/lexical_cast.hpp>
+
+#define NUM_OBJECTS 100000
+#define NUM_SUBSCRIBERS 64
+// Each subscriber observes every SUBSCRIPTION_STRIDE'th object, offset by
+// its own index, so every object has NUM_SUBSCRIBERS/SUBSCRIPTION_STRIDE
+// subscribers
+#define SUBSCRIPTION_STRIDE 8
+#define UPDATE_ROUNDS 20
+// Fraction of objects which move between each service()
+#define UPDATE_FRACTION 10
+#define MAX_PER_RESULT 5
+
+namespace Sirikata {
+
+namespace {
+typedef LocationSubscriptionIndex<UUID, LocationSubscriptionBenchmark, LocationSubscriptionBenchmark, UUID::Hasher> BenchmarkIndex;
+}
+
+LocationSubscriptionBenchmark::LocationSubscriptionBenchmark(const FinishedCallback& finished_cb, const String& param)
+        : Benchmark(finished_cb),
+          mForceStop(false),
+          mThreads(4),
+          mMesh("meerkat:///benchmark/models/mesh.dae/optimized/0/mesh.dae"),
+          mMessages(0),
+          mBytes(0)
+{
+    if (!param.empty())
+        mThreads = boost::lexical_cast<uint32>(param);
+}
+
+String LocationSubscriptionBenchmark::name() {
+    return "loc-subscriptions";
+}
+
+void LocationSubscriptionBenchmark::start() {
+    mForceStop = false;
+
+    mObjects.clear();
+    for(uint32 i = 0; i < NUM_OBJECTS; i++)
+        mObjects.push_back(UUID::random());
+    mSubscribers.clear();
+    for(uint32 i = 0; i < NUM_SUBSCRIBERS; i++)
+        mSubscribers.push_back(UUID::random());
+
+    run(0);
+    if (mThreads > 0 && !mForceStop)
+        run(mThreads);
+
+    if (mForceStop)
+        return;
+
+    notifyFinished();
+}
+
+void LocationSubscriptionBenchmark::stop() {
+    mForceStop = true;
+}
+
+void LocationSubscriptionBenchmark::run(uint32 nthreads) {
+    AtomicValue<uint32> sent_count(0);
+    BenchmarkIndex index(this, /*include_all_data=*/true, sent_count);
+    // Stands in for the space's IOService, which normally runs the workers'
+    // jobs
+    Network::IOServicePool* pool = NULL;
+    if (nthreads > 0) {
+        pool = new Network::IOServicePool("LocationSubscriptionBenchmark", nthreads);
+        pool->startWork();
+        pool->run();
+    }
+    LocationSubscriptionWorkers workers(pool != NULL ? pool->service() : NULL, nthreads);
+    SeqNoPtr seqno(new SeqNo(0));
+    mMessages = 0;
+    mBytes = 0;
+
+    Time start_time = Timer::now();
+    uint32 nsubscriptions = 0;
+    for(uint32 s = 0; s < NUM_SUBSCRIBERS && !mForceStop; s++) {
+        for(uint32 o = s % SUBSCRIPTION_STRIDE; o < NUM_OBJECTS; o += SUBSCRIPTION_STRIDE) {
+            index.subscribe(mSubscribers[s], mObjects[o], this, seqno);
+            nsubscriptions++;
+        }
+    }
+    Duration subscribe_dur = Timer::now() - start_time;
+    // Flush the initial updates forced by subscribing
+    index.service(MAX_PER_RESULT, &workers);
+
+    TimedMotionVector3f loc(Time::null(), MotionVector3f(Vector3f(1, 2, 3), Vector3f(0, 0, 1)));
+    Duration update_dur = Duration::zero(), service_dur = Duration::zero();
+    uint32 nupdates = 0;
+    uint64 messages_before = mMessages, bytes_before = mBytes;
+    for(uint32 round = 0; round < UPDATE_ROUNDS && !mForceStop; round++) {
+        Time round_start = Timer::now();
+        for(uint32 o = round % UPDATE_FRACTION; o < NUM_OBJECTS; o += UPDATE_FRACTION) {
+            index.locationUpdated(mObjects[o], loc, this);
+            nupdates++;
+        }
+        Time service_start = Timer::now();
+        index.service(MAX_PER_RESULT, &workers);
+        Time round_end = Timer::now();
+
+        update_dur += service_start - round_start;
+        service_dur += round_end - service_start;
+    }
+
+    if (pool != NULL) {
+        pool->join();
+        delete pool;
+    }
+
+    if (mForceStop)
+        return;
+
+    SILOG(benchmark,info,
+        nthreads << " worker threads: "
+        << nsubscriptions << " subscriptions in " << subscribe_dur << " ("
+        << (nsubscriptions / subscribe_dur.toSeconds()) << "/s), "
+        << nupdates << " updates (" << (nupdates * NUM_SUBSCRIBERS / SUBSCRIPTION_STRIDE) << " queued) in " << update_dur << ", "
+        << "service " << (service_dur / (float64)UPDATE_ROUNDS) << " per round, "
+        << (mMessages - messages_before) << " messages, " << (mBytes - bytes_before) << " bytes");
+}
+
+bool LocationSubscriptionBenchmark::trySend(const UUID& sub, const String& serialized_blu, const LocationSubscriberInfoPtr& sub_info) {
+    mMessages++;
+    mBytes += serialized_blu.size();
+    return true;
+}
+
+TimedMotionVector3f LocationSubscriptionBenchmark::location(const UUID& uuid) {
+    return TimedMotionVector3f(Time::null(), MotionVector3f(Vector3f(0, 0, 0), Vector3f(0, 0, 0)));
+}
+
+TimedMotionQuaternion LocationSubscriptionBenchmark::orientation(const UUID& uuid) {
+    return TimedMotionQuaternion(Time::null(), MotionQuaternion(Quaternion::identity(), Quaternion::identity()));
+}
+
+AggregateBoundingInfo LocationSubscriptionBenchmark::bounds(const UUID& uuid) {
+    return AggregateBoundingInfo(Vector3f(0, 0, 0), 0.f, 1.f);
+}
+
+const String& LocationSubscriptionBenchmark::mesh(const UUID& uuid) {
+    return mMesh;
+}
+
+const String& LocationSubscriptionBenchmark::physics(const UUID& uuid) {
+    return mEmpty;
+}
+
+const String& LocationSubscriptionBenchmark::queryData(const UUID& uuid) {
+    return mEmpty;
+}
+
+} // namespace Sirikata
@@ -0,0 +1,64 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_LOCATION_SUBSCRIPTION_BENCHMARK_HPP_
+#define _SIRIKATA_LOCATION_SUBSCRIPTION_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+#include <sirikata/space/LocationSubscriptionIndex.hpp>
+
+namespace Sirikata {
+
+/** Drives the LocationSubscriptionIndex used by AlwaysLocationUpdatePolicy
+ *  at scale: many subscribers each observing a slice of a large object set,
+ *  then rounds of location updates followed by service(). Reports subscribe
+ *  throughput, update fan-out throughput and service() time, with 0 and N
+ *  worker threads. The parameter sets N (default 4).
+ */
+class LocationSubscriptionBenchmark : public Benchmark {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& param) {
+        return new LocationSubscriptionBenchmark(finished_cb, param);
+    }
+
+    LocationSubscriptionBenchmark(const FinishedCallback& finished_cb, const String& param);
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+    // Interface used by the index
+    bool validSubscriber(const UUID& sub) { return true; }
+    bool isSelfSubscriber(const UUID& sub, const UUID& observed) { return sub == observed; }
+    bool trySend(const UUID& sub, const String& serialized_blu, const LocationSubscriberInfoPtr& sub_info);
+
+    uint64 epoch(const UUID& uuid) { return 0; }
+    TimedMotionVector3f location(const UUID& uuid);
+    TimedMotionQuaternion orientation(const UUID& uuid);
+    AggregateBoundingInfo bounds(const UUID& uuid);
+    const String& mesh(const UUID& uuid);
+    const String& physics(const UUID& uuid);
+    const String& queryData(const UUID& uuid);
+
+  private:
+    void run(uint32 nthreads);
+
+    volatile bool mForceStop;
+    uint32 mThreads;
+
+    std::vector<UUID> mObjects;
+    std::vector<UUID> mSubscribers;
+    String mMesh;
+    String mEmpty;
+
+    uint64 mMessages;
+    uint64 mBytes;
+}; // class LocationSubscriptionBenchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_LOCATION_SUBSCRIPTION_BENCHMARK_HPP_
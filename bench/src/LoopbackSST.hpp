@@ -0,0 +1,259 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_BENCH_LOOPBACK_SST_HPP_
+#define _SIRIKATA_BENCH_LOOPBACK_SST_HPP_
+
+// An in-process SST datagram layer for benchmarks, like the mock used by the
+// unit tests. Datagrams are delivered through the Context's main strand
+// after a configurable delay, and can be dropped at random to emulate a
+// lossy link.
+
+#include <sirikata/core/network/SSTImpl.hpp>
+#include <sirikata/core/service/Context.hpp>
+#include <sirikata/core/util/Random.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
+
+namespace Sirikata {
+
+namespace Loopback {
+
+class ID {
+public:
+    ID()
+     : mID()
+    {}
+    ID(const String& s)
+     : mID(s)
+    {}
+
+    const String& toString() const { return mID; }
+
+    bool operator<(const ID& rhs) const { return mID < rhs.mID; }
+    bool operator==(const ID& rhs) const { return mID == rhs.mID; }
+    bool operator!=(const ID& rhs) const { return mID != rhs.mID; }
+    class Hasher {
+    public:
+        size_t operator()(const ID& objr) const {
+            return std::tr1::hash<std::string>()(objr.mID);
+        }
+    };
+
+private:
+    String mID;
+};
+
+typedef Sirikata::SST::EndPoint<ID> Endpoint;
+typedef Sirikata::SST::BaseDatagramLayer<ID> BaseDatagramLayer;
+typedef Sirikata::SST::Connection<ID> Connection;
+typedef Sirikata::SST::Stream<ID> Stream;
+typedef Sirikata::SST::ConnectionManager<ID> ConnectionManager;
+
+class Service {
+public:
+    Service(Context* ctx, const Duration& delay, float32 drop_rate)
+     : mContext(ctx),
+       mDelay(delay),
+       mDropRate(drop_rate),
+       mSent(0),
+       mDropped(0)
+    {}
+
+    // src, src port, dst, dst port, data*, data size
+    typedef std::tr1::function<void(const ID&, const ObjectMessagePort, const ID, const ObjectMessagePort, void* , uint32)> DatagramCallback;
+
+    void listen(const ID& ep, ObjectMessagePort port, DatagramCallback cb) {
+        mHandlers[ep][port] = cb;
+    }
+    void unlisten(const ID& ep, ObjectMessagePort port) {
+        mHandlers[ep].erase(port);
+    }
+
+    void send(const ID& src, const ObjectMessagePort src_port, const ID dst, const ObjectMessagePort dst_port, void* payload, uint32 payload_size) {
+        ++mSent;
+        if (mDropRate > 0 && randFloat() < mDropRate) {
+            ++mDropped;
+            return;
+        }
+
+        mContext->mainStrand->post(
+            mDelay,
+            std::tr1::bind(&Service::deliver, this,
+                src, src_port,
+                dst, dst_port,
+                String((char*)payload, payload_size)
+            )
+        );
+    }
+
+    ObjectMessagePort unused(const ID& ep) {
+        PortHandlerMap& handlers = mHandlers[ep];
+        ObjectMessagePort idx = 1;
+        while(handlers.find(idx) != handlers.end())
+            idx++;
+        return (ObjectMessagePort)idx;
+    }
+
+    uint64 sent() const { return mSent.read(); }
+    uint64 dropped() const { return mDropped.read(); }
+
+private:
+    void deliver(const ID& src, const ObjectMessagePort src_port, const ID dst, const ObjectMessagePort dst_port, String payload) {
+        EndpointMap::iterator ep_it = mHandlers.find(dst);
+        if (ep_it == mHandlers.end()) return;
+        PortHandlerMap::iterator port_it = ep_it->second.find(dst_port);
+        if (port_it == ep_it->second.end()) return;
+        port_it->second(src, src_port, dst, dst_port, (void*)payload.c_str(), payload.size());
+    }
+
+    Context *mContext;
+
+    typedef std::map<ObjectMessagePort, DatagramCallback> PortHandlerMap;
+    typedef std::map<ID, PortHandlerMap> EndpointMap;
+    EndpointMap mHandlers;
+
+    Duration mDelay;
+    float32 mDropRate;
+    AtomicValue<uint64> mSent;
+    AtomicValue<uint64> mDropped;
+};
+
+} // namespace Loopback
+
+namespace SST {
+
+template <>
+class BaseDatagramLayer<Loopback::ID>
+{
+  private:
+    typedef Loopback::ID EndPointType;
+
+  public:
+    typedef std::tr1::shared_ptr<BaseDatagramLayer<EndPointType> > Ptr;
+    typedef Ptr BaseDatagramLayerPtr;
+
+    typedef std::tr1::function<void(void*, int)> DataCallback;
+
+    static BaseDatagramLayerPtr getDatagramLayer(ConnectionVariables<EndPointType>* sstConnVars,
+                                                 EndPointType endPoint)
+    {
+        return sstConnVars->getDatagramLayer(endPoint);
+    }
+
+    static BaseDatagramLayerPtr createDatagramLayer(
+        ConnectionVariables<EndPointType>* sstConnVars,
+        EndPointType endPoint,
+        const Context* ctx,
+        Loopback::Service* service)
+    {
+        BaseDatagramLayerPtr datagramLayer = getDatagramLayer(sstConnVars, endPoint);
+        if (datagramLayer) return datagramLayer;
+
+        datagramLayer = BaseDatagramLayerPtr(
+            new BaseDatagramLayer(sstConnVars, ctx, service, endPoint)
+        );
+        sstConnVars->addDatagramLayer(endPoint, datagramLayer);
+
+        return datagramLayer;
+    }
+
+    static void stopListening(ConnectionVariables<EndPointType>* sstConnVars, EndPoint<EndPointType>& listeningEndPoint) {
+        EndPointType endPointID = listeningEndPoint.endPoint;
+
+        BaseDatagramLayerPtr bdl = sstConnVars->getDatagramLayer(endPointID);
+        if (!bdl) return;
+        sstConnVars->removeDatagramLayer(endPointID, true);
+        bdl->unlisten(listeningEndPoint);
+    }
+
+    void listenOn(EndPoint<EndPointType>& listeningEndPoint, DataCallback cb) {
+        mService->listen(
+            listeningEndPoint.endPoint, listeningEndPoint.port,
+            std::tr1::bind(
+                &BaseDatagramLayer::receiveMessageToCallback, this,
+                std::tr1::placeholders::_1,
+                std::tr1::placeholders::_2,
+                std::tr1::placeholders::_3,
+                std::tr1::placeholders::_4,
+                std::tr1::placeholders::_5,
+                std::tr1::placeholders::_6,
+                cb
+            )
+        );
+    }
+
+    void listenOn(const EndPoint<EndPointType>& listeningEndPoint) {
+        mService->listen(
+            listeningEndPoint.endPoint, listeningEndPoint.port,
+            std::tr1::bind(
+                &BaseDatagramLayer::receiveMessage, this,
+                std::tr1::placeholders::_1,
+                std::tr1::placeholders::_2,
+                std::tr1::placeholders::_3,
+                std::tr1::placeholders::_4,
+                std::tr1::placeholders::_5,
+                std::tr1::placeholders::_6
+            )
+        );
+    }
+
+    void unlisten(EndPoint<EndPointType>& ep) {
+        mService->unlisten(ep.endPoint, ep.port);
+    }
+
+    void send(EndPoint<EndPointType>* src, EndPoint<EndPointType>* dest, void* data, int len) {
+        mService->send(
+            src->endPoint, src->port,
+            dest->endPoint, dest->port,
+            data, len
+        );
+    }
+
+    const Context* context() {
+        return mContext;
+    }
+
+    uint32 getUnusedPort(const EndPointType& ep) {
+        return mService->unused(ep);
+    }
+
+    void invalidate() {
+        mService = NULL;
+        mSSTConnVars->removeDatagramLayer(mEndpoint, true);
+    }
+
+  private:
+    BaseDatagramLayer(ConnectionVariables<EndPointType>* sstConnVars, const Context* ctx, Loopback::Service* service, const EndPointType&ep)
+        : mContext(ctx),
+          mService(service),
+          mSSTConnVars(sstConnVars),
+          mEndpoint(ep)
+        {
+        }
+
+    void receiveMessage(const Loopback::ID& src, const ObjectMessagePort src_port, const Loopback::ID dst, const ObjectMessagePort dst_port, void* payload, uint32 payload_size) {
+        Connection<EndPointType>::handleReceive(
+            mSSTConnVars,
+            EndPoint<EndPointType> (src, src_port),
+            EndPoint<EndPointType> (dst, dst_port),
+            payload, payload_size
+        );
+    }
+
+    void receiveMessageToCallback(const Loopback::ID& src, const ObjectMessagePort src_port, const Loopback::ID dst, const ObjectMessagePort dst_port, void* payload, uint32 payload_size, DataCallback cb) {
+        cb(payload, payload_size );
+    }
+
+    const Context* mContext;
+    Loopback::Service* mService;
+
+    ConnectionVariables<EndPointType>* mSSTConnVars;
+    EndPointType mEndpoint;
+};
+
+} // namespace SST
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_BENCH_LOOPBACK_SST_HPP_
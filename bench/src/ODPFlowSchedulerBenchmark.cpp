@@ -0,0 +1,362 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "ODPFlowSchedulerBenchmark.hpp"
+#include "../../space/src/RegionODPFlowScheduler.hpp"
+#include "../../space/src/CSFQODPFlowScheduler.hpp"
+#include "../../space/src/DRRODPFlowScheduler.hpp"
+#include <sirikata/space/CoordinateSegmentation.hpp>
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/ObjectMessage.hpp>
+#include <sirikata/core/options/CommonOptions.hpp>
+#include <sirikata/core/util/PluginManager.hpp>
+#include <sirikata/core/util/Random.hpp>
+#include <sirikata/core/trace/Trace.hpp>
+#include <boost/lexical_cast.hpp>
+
+#define LOCAL_SERVER 1
+#define REMOTE_SERVER 2
+#define SERVER_SIDE_METERS 1000.f
+#define ODP_SERVICE 0
+// Matches the forwarder's default send queue size
+#define QUEUE_BYTES 65536
+#define PAYLOAD_BYTES 100
+
+#define CPU_MESSAGES 2000000
+#define CPU_BATCH 256
+
+// Bytes per second the simulated link drains
+#define LINK_RATE 1000000.0
+// Total offered load as a multiple of LINK_RATE
+#define OFFERED_LOAD 2.0
+#define FAIRNESS_WARMUP (Duration::seconds((int64)1))
+#define FAIRNESS_DURATION (Duration::seconds((int64)4))
+#define STATS_INTERVAL (Duration::milliseconds((int64)100))
+
+namespace Sirikata {
+
+namespace {
+
+// Two servers side by side, the only thing the schedulers need from the
+// segmentation is each server's region for weight computation
+class BenchmarkCoordinateSegmentation : public CoordinateSegmentation {
+public:
+    BenchmarkCoordinateSegmentation(SpaceContext* ctx)
+     : CoordinateSegmentation(ctx)
+    {}
+
+    virtual ServerID lookup(const Vector3f& pos) {
+        return (pos.x < SERVER_SIDE_METERS) ? LOCAL_SERVER : REMOTE_SERVER;
+    }
+    virtual BoundingBoxList serverRegion(const ServerID& server) {
+        BoundingBoxList result;
+        float32 xmin = (server - 1) * SERVER_SIDE_METERS;
+        result.push_back(BoundingBox3f(Vector3f(xmin, 0, 0), Vector3f(xmin + SERVER_SIDE_METERS, SERVER_SIDE_METERS, SERVER_SIDE_METERS)));
+        return result;
+    }
+    virtual BoundingBox3f region() {
+        return BoundingBox3f(Vector3f(0, 0, 0), Vector3f(2 * SERVER_SIDE_METERS, SERVER_SIDE_METERS, SERVER_SIDE_METERS));
+    }
+    virtual uint32 numServers() {
+        return 2;
+    }
+    virtual std::vector<ServerID> lookupBoundingBox(const BoundingBox3f& bbox) {
+        std::vector<ServerID> result;
+        if (bbox.min().x < SERVER_SIDE_METERS) result.push_back(LOCAL_SERVER);
+        if (bbox.max().x >= SERVER_SIDE_METERS) result.push_back(REMOTE_SERVER);
+        return result;
+    }
+    virtual void receiveMessage(Message* msg) {
+        delete msg;
+    }
+private:
+    virtual void service() {}
+};
+
+double jainIndex(const std::vector<double>& x) {
+    double sum = 0, sum_sq = 0;
+    for(uint32 i = 0; i < x.size(); i++) {
+        sum += x[i];
+        sum_sq += x[i] * x[i];
+    }
+    if (sum_sq == 0) return 0;
+    return (sum * sum) / (x.size() * sum_sq);
+}
+
+// Weighted max-min fair allocation of capacity between flows with the given
+// demands
+std::vector<double> fairShares(const std::vector<double>& demand, const std::vector<double>& weight, double capacity) {
+    std::vector<double> result(demand.size(), 0);
+    std::vector<bool> done(demand.size(), false);
+    uint32 remaining = demand.size();
+    while(remaining > 0 && capacity > 0) {
+        double total_weight = 0;
+        for(uint32 i = 0; i < demand.size(); i++)
+            if (!done[i]) total_weight += weight[i];
+        double per_weight = capacity / total_weight;
+
+        bool satisfied_any = false;
+        for(uint32 i = 0; i < demand.size(); i++) {
+            if (done[i] || demand[i] > per_weight * weight[i]) continue;
+            result[i] = demand[i];
+            capacity -= demand[i];
+            done[i] = true;
+            remaining--;
+            satisfied_any = true;
+        }
+        if (satisfied_any) continue;
+
+        for(uint32 i = 0; i < demand.size(); i++)
+            if (!done[i]) result[i] = per_weight * weight[i];
+        break;
+    }
+    return result;
+}
+
+} // namespace
+
+ODPFlowSchedulerBenchmark::ODPFlowSchedulerBenchmark(const FinishedCallback& finished_cb, const String& param)
+        : Benchmark(finished_cb),
+          mForceStop(false),
+          mNumFlows(64),
+          mIOService(NULL),
+          mStrand(NULL),
+          mContext(NULL),
+          mQueue(NULL),
+          mScheduler(NULL)
+{
+    if (!param.empty())
+        mNumFlows = boost::lexical_cast<uint32>(param);
+}
+
+String ODPFlowSchedulerBenchmark::name() {
+    return "odp-flow";
+}
+
+AbstractQueue<Message*>* ODPFlowSchedulerBenchmark::createScheduler(ServerID sid, uint32 max_size) {
+    // No LocationService, so weights use the server region approximation
+    if (mSchedulerType == "region")
+        mScheduler = new RegionODPFlowScheduler(mContext, mQueue, sid, ODP_SERVICE, max_size);
+    else if (mSchedulerType == "csfq")
+        mScheduler = new CSFQODPFlowScheduler(mContext, mQueue, sid, ODP_SERVICE, max_size, NULL);
+    else
+        mScheduler = new DRRODPFlowScheduler(mContext, mQueue, sid, ODP_SERVICE, max_size, NULL);
+    return mScheduler;
+}
+
+void ODPFlowSchedulerBenchmark::createQueue(const String& type) {
+    using std::tr1::placeholders::_1;
+    using std::tr1::placeholders::_2;
+
+    mSchedulerType = type;
+    mQueue = new ForwarderServiceQueue(LOCAL_SERVER, QUEUE_BYTES, this);
+    mQueue->addService(
+        ODP_SERVICE,
+        std::tr1::bind(&ODPFlowSchedulerBenchmark::createScheduler, this, _1, _2)
+    );
+    // Forces allocation of the queues for the remote server
+    mQueue->empty(REMOTE_SERVER);
+    assert(mScheduler != NULL);
+}
+
+void ODPFlowSchedulerBenchmark::destroyQueue() {
+    while(Message* msg = mQueue->pop(REMOTE_SERVER))
+        delete msg;
+    delete mQueue;
+    mQueue = NULL;
+    mScheduler = NULL;
+}
+
+void ODPFlowSchedulerBenchmark::generateFlows() {
+    cleanupFlows();
+    for(uint32 i = 0; i < mNumFlows; i++) {
+        Sirikata::Protocol::Object::ObjectMessage* msg =
+            createObjectMessage(LOCAL_SERVER, UUID::random(), 1, UUID::random(), 1, String(PAYLOAD_BYTES, 'x'));
+        mFlowMessages.push_back(msg);
+        mFlowsByPayload[msg->unique()] = i;
+        mSourceRadius.push_back(randFloat(1.f, 20.f));
+        mDestRadius.push_back(randFloat(1.f, 20.f));
+        // A few heavy senders, more light ones
+        mFlowDemand.push_back(1.0 + 3.0 * (i % 4));
+    }
+}
+
+void ODPFlowSchedulerBenchmark::cleanupFlows() {
+    for(uint32 i = 0; i < mFlowMessages.size(); i++)
+        delete mFlowMessages[i];
+    mFlowMessages.clear();
+    mFlowsByPayload.clear();
+    mSourceRadius.clear();
+    mDestRadius.clear();
+    mFlowDemand.clear();
+}
+
+double ODPFlowSchedulerBenchmark::flowWeight(RegionWeightCalculator* calc, uint32 flow) {
+    // Same approximation the schedulers use without exact locations
+    CoordinateSegmentation* cseg = mContext->cseg();
+    BoundingBox3f source_bbox(cseg->serverRegion(LOCAL_SERVER)[0].center(), mSourceRadius[flow]);
+    BoundingBox3f dest_bbox(cseg->serverRegion(REMOTE_SERVER)[0].center(), mDestRadius[flow]);
+    return calc->weight(source_bbox, dest_bbox);
+}
+
+void ODPFlowSchedulerBenchmark::measureCPU(const String& type) {
+    createQueue(type);
+    // Plenty of capacity downstream so CSFQ doesn't drop
+    mScheduler->updateSenderStats(mScheduler->totalActiveWeight(), LINK_RATE * 1000);
+    mScheduler->updateReceiverStats(mScheduler->totalActiveWeight(), LINK_RATE * 1000);
+
+    uint64 pushed = 0, accepted = 0;
+    Time start_time = Timer::now();
+    while(pushed < CPU_MESSAGES && !mForceStop) {
+        mContext->simTime(); // Keeps recentSimTime moving for rate estimates
+        for(uint32 i = 0; i < CPU_BATCH; i++, pushed++) {
+            uint32 flow = pushed % mNumFlows;
+            if (mScheduler->push(mFlowMessages[flow], OSegEntry(LOCAL_SERVER, mSourceRadius[flow]), OSegEntry(REMOTE_SERVER, mDestRadius[flow])))
+                accepted++;
+        }
+        while(Message* msg = mQueue->pop(REMOTE_SERVER))
+            delete msg;
+    }
+    Duration dur = Timer::now() - start_time;
+    destroyQueue();
+
+    if (mForceStop) return;
+    SILOG(benchmark,info,
+        type << " cpu: " << pushed << " messages over " << mNumFlows << " flows, "
+        << accepted << " accepted, "
+        << (dur.toMicroseconds() * 1000.0 / pushed) << "ns/message");
+}
+
+void ODPFlowSchedulerBenchmark::measureFairness(const String& type) {
+    createQueue(type);
+
+    RegionWeightCalculator* calc =
+        RegionWeightCalculatorFactory::getSingleton().getConstructor(GetOptionValue<String>(OPT_REGION_WEIGHT))(GetOptionValue<String>(OPT_REGION_WEIGHT_ARGS));
+    std::vector<double> weights, offered;
+    double total_demand = 0;
+    for(uint32 i = 0; i < mNumFlows; i++)
+        total_demand += mFlowDemand[i];
+    for(uint32 i = 0; i < mNumFlows; i++) {
+        weights.push_back(flowWeight(calc, i));
+        offered.push_back(OFFERED_LOAD * LINK_RATE * mFlowDemand[i] / total_demand);
+    }
+    delete calc;
+    std::vector<double> ideal = fairShares(offered, weights, LINK_RATE);
+
+    std::vector<double> send_credit(mNumFlows, 0);
+    std::vector<uint64> delivered(mNumFlows, 0);
+    double link_credit = 0;
+    uint64 dropped = 0;
+
+    Time start_time = Timer::now();
+    Time measure_start = start_time + FAIRNESS_WARMUP;
+    Time end_time = measure_start + FAIRNESS_DURATION;
+    Time last_time = start_time;
+    Time last_stats = Time::null();
+    while(!mForceStop) {
+        Time now = Timer::now();
+        if (now >= end_time) break;
+        double dt = (now - last_time).toSeconds();
+        last_time = now;
+        mContext->simTime();
+
+        if (now - last_stats > STATS_INTERVAL) {
+            // We're the only traffic on this link, so everything used downstream is ours
+            mScheduler->updateSenderStats(mScheduler->totalSenderUsedWeight(), LINK_RATE);
+            mScheduler->updateReceiverStats(mScheduler->totalReceiverUsedWeight(), LINK_RATE);
+            last_stats = now;
+        }
+
+        for(uint32 i = 0; i < mNumFlows; i++) {
+            send_credit[i] += offered[i] * dt;
+            int32 msg_size = mFlowMessages[i]->ByteSize();
+            while(send_credit[i] >= msg_size) {
+                send_credit[i] -= msg_size;
+                if (!mScheduler->push(mFlowMessages[i], OSegEntry(LOCAL_SERVER, mSourceRadius[i]), OSegEntry(REMOTE_SERVER, mDestRadius[i])))
+                    dropped++;
+            }
+        }
+
+        link_credit += LINK_RATE * dt;
+        while(link_credit > 0) {
+            Message* msg = mQueue->pop(REMOTE_SERVER);
+            if (msg == NULL) {
+                // Idle link time doesn't carry over
+                link_credit = 0;
+                break;
+            }
+            link_credit -= msg->size();
+            if (now >= measure_start)
+                delivered[mFlowsByPayload[msg->payload_id()]] += msg->size();
+            delete msg;
+        }
+
+        Timer::sleep(Duration::milliseconds((int64)1));
+    }
+    destroyQueue();
+
+    if (mForceStop) return;
+
+    std::vector<double> relative;
+    double total_delivered = 0;
+    for(uint32 i = 0; i < mNumFlows; i++) {
+        double rate = delivered[i] / FAIRNESS_DURATION.toSeconds();
+        total_delivered += rate;
+        relative.push_back(ideal[i] > 0 ? rate / ideal[i] : 0);
+    }
+    SILOG(benchmark,info,
+        type << " fairness: jain index " << jainIndex(relative)
+        << ", throughput " << (total_delivered / LINK_RATE) << " of link, "
+        << dropped << " dropped");
+}
+
+void ODPFlowSchedulerBenchmark::start() {
+    mForceStop = false;
+
+    static bool initialized = false;
+    if (!initialized) {
+        InitOptions();
+        FakeParseOptions();
+        static PluginManager plugins;
+        plugins.load("weight-sqr");
+        initialized = true;
+    }
+
+    Trace::Trace* trace = new Trace::Trace("odp-flow.trace");
+    mIOService = new Network::IOService("ODPFlowSchedulerBenchmark");
+    mStrand = mIOService->createStrand("ODPFlowSchedulerBenchmark");
+    mContext = new SpaceContext("odp-flow-benchmark", LOCAL_SERVER, NULL, NULL, mIOService, mStrand, Timer::now(), trace);
+    BenchmarkCoordinateSegmentation* cseg = new BenchmarkCoordinateSegmentation(mContext);
+
+    generateFlows();
+
+    const char* types[] = { "region", "csfq", "drr" };
+    for(uint32 i = 0; i < 3 && !mForceStop; i++)
+        measureCPU(types[i]);
+    for(uint32 i = 0; i < 3 && !mForceStop; i++)
+        measureFairness(types[i]);
+
+    cleanupFlows();
+    delete cseg;
+    delete mContext;
+    mContext = NULL;
+    delete mStrand;
+    mStrand = NULL;
+    delete mIOService;
+    mIOService = NULL;
+    trace->prepareShutdown();
+    trace->shutdown();
+    delete trace;
+
+    if (mForceStop)
+        return;
+
+    notifyFinished();
+}
+
+void ODPFlowSchedulerBenchmark::stop() {
+    mForceStop = true;
+}
+
+} // namespace Sirikata
@@ -0,0 +1,87 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_ODP_FLOW_SCHEDULER_BENCHMARK_HPP_
+#define _SIRIKATA_ODP_FLOW_SCHEDULER_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+#include <sirikata/space/SpaceContext.hpp>
+#include <sirikata/core/util/RegionWeightCalculator.hpp>
+#include "../../space/src/ForwarderServiceQueue.hpp"
+
+namespace Sirikata {
+
+class ODPFlowScheduler;
+
+/** Compares the ODPFlowSchedulers the forwarder can use for traffic to one
+ *  remote server. Flows go between objects of different sizes on two
+ *  neighboring servers, so their region weights differ. Two measurements for
+ *  each scheduler:
+ *   - CPU cost: batches of messages pushed into the scheduler and popped back
+ *     out through the ForwarderServiceQueue, reported as ns/message.
+ *   - Fairness: flows offering different rates, together twice what a
+ *     simulated link drains, run in real time. Reports Jain's fairness index
+ *     of each flow's delivered rate relative to its weighted max-min fair
+ *     share, so 1.0 is perfectly fair.
+ *  The parameter sets the number of flows (default 64).
+ */
+class ODPFlowSchedulerBenchmark : public Benchmark, ForwarderServiceQueue::Listener {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& param) {
+        return new ODPFlowSchedulerBenchmark(finished_cb, param);
+    }
+
+    ODPFlowSchedulerBenchmark(const FinishedCallback& finished_cb, const String& param);
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+  private:
+    // ForwarderServiceQueue::Listener
+    virtual void forwarderServiceMessageReady(ServerID dest_server) {}
+
+    // Creator for ForwarderServiceQueue, builds a scheduler of mSchedulerType
+    AbstractQueue<Message*>* createScheduler(ServerID sid, uint32 max_size);
+
+    void generateFlows();
+    void cleanupFlows();
+    double flowWeight(RegionWeightCalculator* calc, uint32 flow);
+
+    // Sets up mQueue with a scheduler of the given type
+    void createQueue(const String& type);
+    void destroyQueue();
+
+    void measureCPU(const String& type);
+    void measureFairness(const String& type);
+
+    volatile bool mForceStop;
+    uint32 mNumFlows;
+
+    Network::IOService* mIOService;
+    Network::IOStrand* mStrand;
+    SpaceContext* mContext;
+
+    // Queue and scheduler currently being measured. The queue owns the
+    // scheduler.
+    String mSchedulerType;
+    ForwarderServiceQueue* mQueue;
+    ODPFlowScheduler* mScheduler;
+
+    // One message per flow, reused for every send. Since they keep the same
+    // unique ID, the payload ID of a dequeued message identifies its flow.
+    std::vector<Sirikata::Protocol::Object::ObjectMessage*> mFlowMessages;
+    std::tr1::unordered_map<UniqueMessageID, uint32> mFlowsByPayload;
+    std::vector<float> mSourceRadius;
+    std::vector<float> mDestRadius;
+    // Relative offered load of each flow
+    std::vector<double> mFlowDemand;
+}; // class ODPFlowSchedulerBenchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_ODP_FLOW_SCHEDULER_BENCHMARK_HPP_
@@ -0,0 +1,237 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "OSegCacheBenchmark.hpp"
+#include "../../space/src/caches/CacheLRUOriginal.hpp"
+#include "../../space/src/caches/ClockCache.hpp"
+#include "../../space/src/caches/FCache.hpp"
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/util/Random.hpp>
+#include <sirikata/core/util/Thread.hpp>
+#include <boost/lexical_cast.hpp>
+
+#define SERVERS_PER_SIDE 4
+#define SERVER_SIDE_METERS 1000.f
+#define OBJECTS_PER_SERVER 500
+// The server whose cache we're simulating, one of the interior ones
+#define LOCAL_SERVER_X 1
+#define LOCAL_SERVER_Y 1
+#define NUM_LOOKUPS 2000000
+#define FRACTION_UNIFORM 0.1f
+#define LOOKUPS_PER_MIGRATION 1000
+#define NUM_THREADS 4
+#define CACHE_SHARDS 16
+
+namespace Sirikata {
+
+namespace {
+double popularityScore(const FCacheRecord* rec) {
+    return rec->popAvg;
+}
+double popularityScorePrint(const FCacheRecord* rec, bool toPrint) {
+    return rec->popAvg;
+}
+}
+
+OSegCacheBenchmark::OSegCacheBenchmark(const FinishedCallback& finished_cb, const String& param)
+        : Benchmark(finished_cb),
+          mForceStop(false),
+          mCacheSize(1000),
+          mIOService(NULL),
+          mStrand(NULL),
+          mContext(NULL)
+{
+    if (!param.empty())
+        mCacheSize = boost::lexical_cast<uint32>(param);
+}
+
+String OSegCacheBenchmark::name() {
+    return "oseg-cache";
+}
+
+void OSegCacheBenchmark::generateTrace() {
+    mObjects.clear();
+    mObjectServers.clear();
+    mObjectDistances.clear();
+    mTrace.clear();
+
+    Vector3f local_center(
+        (LOCAL_SERVER_X + .5f) * SERVER_SIDE_METERS,
+        (LOCAL_SERVER_Y + .5f) * SERVER_SIDE_METERS,
+        0
+    );
+
+    // Objects on every other server, with the flow weight we'd see from the
+    // local server
+    std::vector<double> cdf;
+    double total_weight = 0;
+    for(uint32 sx = 0; sx < SERVERS_PER_SIDE; sx++) {
+        for(uint32 sy = 0; sy < SERVERS_PER_SIDE; sy++) {
+            if (sx == LOCAL_SERVER_X && sy == LOCAL_SERVER_Y) continue;
+            ServerID sid = sy * SERVERS_PER_SIDE + sx + 1;
+            for(uint32 i = 0; i < OBJECTS_PER_SERVER; i++) {
+                Vector3f pos(
+                    randFloat(sx * SERVER_SIDE_METERS, (sx+1) * SERVER_SIDE_METERS),
+                    randFloat(sy * SERVER_SIDE_METERS, (sy+1) * SERVER_SIDE_METERS),
+                    0
+                );
+                float dist = (pos - local_center).length();
+                mObjects.push_back(UUID::random());
+                mObjectServers.push_back(sid);
+                mObjectDistances.push_back(dist);
+                total_weight += 1.0 / (1.0 + (double)dist * dist);
+                cdf.push_back(total_weight);
+            }
+        }
+    }
+
+    for(uint32 i = 0; i < NUM_LOOKUPS; i++) {
+        if (i > 0 && i % LOOKUPS_PER_MIGRATION == 0)
+            mTrace.push_back(-(int32)randInt<uint32>(0, mObjects.size()-1) - 1);
+
+        uint32 idx;
+        if (randFloat() < FRACTION_UNIFORM) {
+            idx = randInt<uint32>(0, mObjects.size()-1);
+        }
+        else {
+            double which = randFloat() * total_weight;
+            idx = std::lower_bound(cdf.begin(), cdf.end(), which) - cdf.begin();
+            if (idx >= mObjects.size()) idx = mObjects.size()-1;
+        }
+        mTrace.push_back((int32)idx);
+    }
+}
+
+void OSegCacheBenchmark::replay(OSegCache* cache, uint32 begin, uint32 end, ReplayStats* stats) {
+    Time start_time = Timer::now();
+    for(uint32 i = begin; i < end && !mForceStop; i++) {
+        int32 val = mTrace[i];
+        if (val < 0) {
+            cache->remove(mObjects[-(val+1)]);
+            continue;
+        }
+
+        stats->lookups++;
+        const UUID& obj = mObjects[val];
+        if (cache->get(obj).notNull())
+            stats->hits++;
+        else
+            cache->insert(obj, OSegEntry(mObjectServers[val], 1.f));
+    }
+    stats->dur = Timer::now() - start_time;
+}
+
+void OSegCacheBenchmark::replayFCache(FCache* cache, ReplayStats* stats) {
+    Time start_time = Timer::now();
+    for(uint32 i = 0; i < mTrace.size() && !mForceStop; i++) {
+        int32 val = mTrace[i];
+        if (val < 0) {
+            cache->remove(mObjects[-(val+1)]);
+            continue;
+        }
+
+        stats->lookups++;
+        const UUID& obj = mObjects[val];
+        if (cache->lookup(obj).notNull()) {
+            stats->hits++;
+        }
+        else {
+            float dist = mObjectDistances[val];
+            double weight = 1.0 / (1.0 + (double)dist * dist);
+            cache->insert(obj, mObjectServers[val], (mContext->simTime() - Time::null()).toMilliseconds(), 0, weight, dist, 1, weight, 1);
+        }
+    }
+    stats->dur = Timer::now() - start_time;
+}
+
+void OSegCacheBenchmark::report(const String& label, const ReplayStats& stats) {
+    SILOG(benchmark,info,
+        label << ": " << stats.lookups << " lookups, hit rate "
+        << ((float64)stats.hits / stats.lookups) << ", "
+        << (stats.dur.toMicroseconds() * 1000.0 / stats.lookups) << "ns/lookup");
+}
+
+void OSegCacheBenchmark::start() {
+    mForceStop = false;
+
+    mIOService = new Network::IOService("OSegCacheBenchmark");
+    mStrand = mIOService->createStrand("OSegCacheBenchmark");
+    mContext = new SpaceContext("oseg-cache-benchmark", LOCAL_SERVER_Y * SERVERS_PER_SIDE + LOCAL_SERVER_X + 1, NULL, NULL, mIOService, mStrand, Timer::now(), NULL);
+
+    generateTrace();
+    SILOG(benchmark,info,
+        mObjects.size() << " remote objects, cache size " << mCacheSize);
+
+    // Long enough lifetimes that entries never expire during the replay
+    Duration lifetime = Duration::seconds((int64)3600);
+
+    {
+        CacheLRUOriginal lru(mContext, mCacheSize, std::max(mCacheSize/8, (uint32)1), lifetime);
+        ReplayStats stats;
+        replay(&lru, 0, mTrace.size(), &stats);
+        if (!mForceStop) report("lru-original", stats);
+    }
+
+    if (!mForceStop) {
+        FCache fcache(.2, "FCache", &popularityScore, &popularityScorePrint, mContext, mCacheSize);
+        ReplayStats stats;
+        replayFCache(&fcache, &stats);
+        if (!mForceStop) report("fcache", stats);
+    }
+
+    if (!mForceStop) {
+        ClockCache clock(mContext, mCacheSize, CACHE_SHARDS, lifetime);
+        ReplayStats stats;
+        replay(&clock, 0, mTrace.size(), &stats);
+        if (!mForceStop) report("clock", stats);
+    }
+
+    // Same cache, with the trace split between threads hitting it at once
+    if (!mForceStop) {
+        ClockCache clock(mContext, mCacheSize, CACHE_SHARDS, lifetime);
+        std::vector<ReplayStats> thread_stats(NUM_THREADS);
+        std::vector<Thread*> threads;
+        uint32 per_thread = mTrace.size() / NUM_THREADS;
+        Time start_time = Timer::now();
+        for(uint32 i = 0; i < NUM_THREADS; i++) {
+            uint32 end = (i == NUM_THREADS-1) ? mTrace.size() : (i+1)*per_thread;
+            threads.push_back(
+                new Thread(
+                    "OSegCacheBenchmark Replay",
+                    std::tr1::bind(&OSegCacheBenchmark::replay, this, &clock, i*per_thread, end, &thread_stats[i])
+                )
+            );
+        }
+        for(uint32 i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+
+        ReplayStats stats;
+        for(uint32 i = 0; i < thread_stats.size(); i++) {
+            stats.lookups += thread_stats[i].lookups;
+            stats.hits += thread_stats[i].hits;
+        }
+        stats.dur = Timer::now() - start_time;
+        if (!mForceStop) report("clock-" + boost::lexical_cast<String>(NUM_THREADS) + "-threads (wall clock)", stats);
+    }
+
+    delete mContext;
+    mContext = NULL;
+    delete mStrand;
+    mStrand = NULL;
+    delete mIOService;
+    mIOService = NULL;
+
+    if (mForceStop)
+        return;
+
+    notifyFinished();
+}
+
+void OSegCacheBenchmark::stop() {
+    mForceStop = true;
+}
+
+} // namespace Sirikata
@@ -0,0 +1,75 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_OSEG_CACHE_BENCHMARK_HPP_
+#define _SIRIKATA_OSEG_CACHE_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+#include <sirikata/space/SpaceContext.hpp>
+
+namespace Sirikata {
+
+class OSegCache;
+class FCache;
+
+/** Compares OSeg caches by replaying the lookups a space server sees under
+ *  the osegflood scenario: objects spread over a grid of servers, messages
+ *  from one server to the others' objects picked with an inverse square
+ *  distance falloff, plus a fraction sent uniformly. Each lookup that misses
+ *  inserts the object, as the OSeg would once the lookup completes, and a
+ *  trickle of migrations removes entries. Reports hit rate and ns/lookup for
+ *  the original LRU cache, FCache, and ClockCache, the last both from one
+ *  thread and from several at once. The parameter sets the cache size
+ *  (default 1000 entries, for 7500 remote objects).
+ */
+class OSegCacheBenchmark : public Benchmark {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& param) {
+        return new OSegCacheBenchmark(finished_cb, param);
+    }
+
+    OSegCacheBenchmark(const FinishedCallback& finished_cb, const String& param);
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+  private:
+    struct ReplayStats {
+        ReplayStats()
+         : lookups(0), hits(0), dur(Duration::zero())
+        {}
+        uint64 lookups;
+        uint64 hits;
+        Duration dur;
+    };
+
+    void generateTrace();
+
+    // Replay trace entries [begin,end) against the cache
+    void replay(OSegCache* cache, uint32 begin, uint32 end, ReplayStats* stats);
+    void replayFCache(FCache* cache, ReplayStats* stats);
+    void report(const String& label, const ReplayStats& stats);
+
+    volatile bool mForceStop;
+    uint32 mCacheSize;
+
+    Network::IOService* mIOService;
+    Network::IOStrand* mStrand;
+    SpaceContext* mContext;
+
+    std::vector<UUID> mObjects;
+    std::vector<ServerID> mObjectServers;
+    std::vector<float> mObjectDistances;
+    // Index into mObjects for each lookup. Negative values are migrations,
+    // removing object -(value+1) from the cache.
+    std::vector<int32> mTrace;
+}; // class OSegCacheBenchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_OSEG_CACHE_BENCHMARK_HPP_
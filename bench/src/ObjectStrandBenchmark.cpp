@@ -0,0 +1,206 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "ObjectStrandBenchmark.hpp"
+#include <sirikata/oh/ObjectHost.hpp>
+#include <sirikata/oh/ObjectHostContext.hpp>
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <sirikata/core/network/ObjectMessage.hpp>
+#include <sirikata/core/trace/Trace.hpp>
+#include <sirikata/core/util/Thread.hpp>
+#include <sirikata/core/util/Timer.hpp>
+#include <boost/lexical_cast.hpp>
+
+#define NUM_OBJECTS 1000
+#define MESSAGES_PER_OBJECT 200
+// Messages the main strand delivers before yielding, like a batch of
+// messages read off a space server connection
+#define DISPATCH_BATCH 256
+// Iterations of the per message "script" work
+#define WORK_PER_MESSAGE 2000
+#define BENCH_PORT 20
+
+namespace Sirikata {
+
+using std::tr1::placeholders::_1;
+using std::tr1::placeholders::_2;
+using std::tr1::placeholders::_3;
+
+// ObjectHost without scripts. The benchmark is a friend of ObjectHost so it
+// can deliver messages as if they came from a space.
+class ObjectStrandBenchmark::BenchObjectHost : public ObjectHost {
+public:
+    BenchObjectHost(ObjectHostContext* ctx, uint32 num_strands)
+     : ObjectHost(ctx, ctx->ioService, "--objectStrands=" + boost::lexical_cast<String>(num_strands))
+    {}
+
+    virtual const String& defaultScriptType() const { return mEmpty; }
+    virtual const String& defaultScriptOptions() const { return mEmpty; }
+    virtual const String& defaultScriptContents() const { return mEmpty; }
+
+private:
+    String mEmpty;
+};
+
+ObjectStrandBenchmark::ObjectStrandBenchmark(const FinishedCallback& finished_cb, const String& param)
+        : Benchmark(finished_cb),
+          mForceStop(false),
+          mNumObjects(NUM_OBJECTS),
+          mNumStrands(4),
+          mNumMessages(0),
+          mTrace(NULL),
+          mIOService(NULL),
+          mMainStrand(NULL),
+          mContext(NULL),
+          mObjectHost(NULL)
+{
+    if (!param.empty())
+        mNumStrands = boost::lexical_cast<uint32>(param);
+}
+
+String ObjectStrandBenchmark::name() {
+    return "object-strands";
+}
+
+void ObjectStrandBenchmark::handleMessage(Object* obj, const ODP::Endpoint& src, const ODP::Endpoint& dst, MemoryReference payload) {
+    // Stand in for a script handling the message: enough work to dominate
+    // the cost of delivering it
+    uint64 x = obj->state ^ (payload.size() + 1);
+    for(uint32 i = 0; i < WORK_PER_MESSAGE; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    obj->state = x;
+    obj->received++;
+}
+
+void ObjectStrandBenchmark::dispatch(uint64 first) {
+    if (mForceStop) return;
+
+    String payload("object strand benchmark");
+    uint64 end = std::min(first + DISPATCH_BATCH, mNumMessages);
+    for(uint64 msg = first; msg < end; msg++) {
+        const Object& src = mObjects[(msg * 7) % mObjects.size()];
+        const Object& dst = mObjects[msg % mObjects.size()];
+        mObjectHost->handleObjectMessage(
+            dst.sporef, dst.sporef.space(),
+            createObjectMessage(0, src.sporef.object().getAsUUID(), BENCH_PORT, dst.sporef.object().getAsUUID(), BENCH_PORT, payload)
+        );
+    }
+
+    if (end < mNumMessages)
+        mMainStrand->post(
+            std::tr1::bind(&ObjectStrandBenchmark::dispatch, this, end),
+            "ObjectStrandBenchmark::dispatch"
+        );
+}
+
+void ObjectStrandBenchmark::start() {
+    mForceStop = false;
+    mNumMessages = (uint64)mNumObjects * MESSAGES_PER_OBJECT;
+
+    mTrace = new Trace::Trace("object-strands.trace");
+    mIOService = new Network::IOService("ObjectStrandBenchmark");
+    mMainStrand = mIOService->createStrand("ObjectStrandBenchmark Main");
+    mContext = new ObjectHostContext("ObjectStrandBenchmark", ObjectHostID(1), NULL, NULL, mIOService, mMainStrand, mTrace, Timer::now());
+    mObjectHost = new BenchObjectHost(mContext, mNumStrands);
+
+    // Objects are registered under a presence in a made up space, and
+    // listen on a port there
+    SpaceID space(UUID::random());
+    Time create_start = Timer::now();
+    mObjects.resize(mNumObjects);
+    for(uint32 i = 0; i < mNumObjects; i++) {
+        Object& obj = mObjects[i];
+        UUID id = UUID::random();
+        obj.ho = mObjectHost->createObject(id, "", "", "");
+        obj.sporef = SpaceObjectReference(space, ObjectReference(id));
+        mObjectHost->registerHostedObject(obj.sporef, obj.ho);
+        obj.port = obj.ho->bindODPPort(obj.sporef, BENCH_PORT);
+        obj.port->receive(std::tr1::bind(&ObjectStrandBenchmark::handleMessage, this, &obj, _1, _2, _3));
+    }
+    Duration create_dur = Timer::now() - create_start;
+
+    SILOG(benchmark,info,
+        mNumObjects << " objects on " <<
+        (mNumStrands == 0 ? String("the main strand") : (boost::lexical_cast<String>(mNumStrands) + " object strands")) <<
+        ", created in " << create_dur << ", " << mNumMessages << " messages");
+
+    // Everything is queued before the threads start, so they only run out of
+    // work once every message has been handled
+    mMainStrand->post(
+        std::tr1::bind(&ObjectStrandBenchmark::dispatch, this, 0),
+        "ObjectStrandBenchmark::dispatch"
+    );
+
+    Time start_time = Timer::now();
+    std::vector<Thread*> threads;
+    for(uint32 i = 0; i < 1 + mNumStrands; i++)
+        threads.push_back(
+            new Thread(
+                "ObjectStrandBenchmark",
+                std::tr1::bind(&Network::IOService::runNoReturn, mIOService)
+            )
+        );
+    for(uint32 i = 0; i < threads.size(); i++) {
+        threads[i]->join();
+        delete threads[i];
+    }
+    Duration dur = Timer::now() - start_time;
+
+    uint64 received = 0;
+    for(uint32 i = 0; i < mObjects.size(); i++)
+        received += mObjects[i].received;
+
+    if (!mForceStop) {
+        if (received != mNumMessages)
+            SILOG(benchmark,error,"Objects received " << received << " messages, expected " << mNumMessages);
+
+        float64 secs = dur.toSeconds();
+        SILOG(benchmark,info,
+            (mNumMessages / secs) << " messages/s, "
+            << (dur.toMicroseconds() * 1000.0 / mNumMessages) << "ns/message");
+    }
+
+    cleanup();
+
+    if (mForceStop)
+        return;
+
+    notifyFinished();
+}
+
+void ObjectStrandBenchmark::cleanup() {
+    for(uint32 i = 0; i < mObjects.size(); i++) {
+        Object& obj = mObjects[i];
+        delete obj.port;
+        mObjectHost->unregisterHostedObject(obj.sporef, obj.ho.get());
+        obj.ho->destroy();
+    }
+    // Releasing the last references tells the ObjectHost they're gone
+    mObjects.clear();
+
+    delete mObjectHost;
+    mObjectHost = NULL;
+
+    mTrace->prepareShutdown();
+    delete mContext;
+    mContext = NULL;
+    mTrace->shutdown();
+    delete mTrace;
+    mTrace = NULL;
+
+    delete mMainStrand;
+    mMainStrand = NULL;
+    delete mIOService;
+    mIOService = NULL;
+}
+
+void ObjectStrandBenchmark::stop() {
+    mForceStop = true;
+}
+
+} // namespace Sirikata
@@ -0,0 +1,80 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_OBJECT_STRAND_BENCHMARK_HPP_
+#define _SIRIKATA_OBJECT_STRAND_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+#include <sirikata/oh/HostedObject.hpp>
+
+namespace Sirikata {
+
+class ObjectHostContext;
+namespace Trace {
+class Trace;
+}
+
+/** Measures how fast an ObjectHost's objects handle messages with a given
+ *  objectStrands setting. Creates 1000 HostedObjects, each listening on an
+ *  ODP port, and delivers messages to them from the main strand the same way
+ *  the SessionManagers do. Each object does a fixed amount of work per
+ *  message, standing in for a script. Reports messages handled per second.
+ *
+ *  The parameter is the number of object strands (default 4, 0 runs every
+ *  object on the main strand), and the ObjectHost is run with one thread per
+ *  strand. An ObjectHost registers itself with global services, so only one
+ *  can be created per process. Run the benchmark once per setting to compare
+ *  them.
+ */
+class ObjectStrandBenchmark : public Benchmark {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& param) {
+        return new ObjectStrandBenchmark(finished_cb, param);
+    }
+
+    ObjectStrandBenchmark(const FinishedCallback& finished_cb, const String& param);
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+  private:
+    class BenchObjectHost;
+
+    struct Object {
+        Object()
+         : port(NULL), received(0), state(0)
+        {}
+        HostedObjectPtr ho;
+        SpaceObjectReference sporef;
+        ODP::Port* port;
+        // Only touched from the object's strand
+        uint64 received;
+        uint64 state;
+    };
+
+    // Delivers messages [first, first+count) from the main strand
+    void dispatch(uint64 first);
+    void handleMessage(Object* obj, const ODP::Endpoint& src, const ODP::Endpoint& dst, MemoryReference payload);
+    void cleanup();
+
+    volatile bool mForceStop;
+    uint32 mNumObjects;
+    uint32 mNumStrands;
+    uint64 mNumMessages;
+
+    Trace::Trace* mTrace;
+    Network::IOService* mIOService;
+    Network::IOStrand* mMainStrand;
+    ObjectHostContext* mContext;
+    BenchObjectHost* mObjectHost;
+    std::vector<Object> mObjects;
+}; // class ObjectStrandBenchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_OBJECT_STRAND_BENCHMARK_HPP_
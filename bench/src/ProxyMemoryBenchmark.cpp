@@ -0,0 +1,144 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "ProxyMemoryBenchmark.hpp"
+#include <sirikata/core/util/SpaceObjectReference.hpp>
+#include <sirikata/proxyobject/ProxyManager.hpp>
+#include <sirikata/proxyobject/ProxyObject.hpp>
+#include <sirikata/proxyobject/ProxyStateStore.hpp>
+#include <sirikata/core/util/Timer.hpp>
+#include <sirikata/core/util/Random.hpp>
+#include <boost/lexical_cast.hpp>
+
+#if SIRIKATA_PLATFORM == SIRIKATA_PLATFORM_LINUX
+#include <malloc.h>
+#endif
+
+#define NUM_OBJECTS 2000
+// Every Nth object has a physics description
+#define PHYSICS_EVERY 4
+
+namespace Sirikata {
+
+namespace {
+// Bytes currently allocated from the heap, or -1 if we can't tell
+int64 heapInUse() {
+#if SIRIKATA_PLATFORM == SIRIKATA_PLATFORM_LINUX
+    struct mallinfo mi = mallinfo();
+    // uordblks is an int, so it wraps past 2GB. Callers only look at
+    // differences, which are fine as long as they stay below 4GB.
+    return (int64)(uint32)mi.uordblks + (int64)(uint32)mi.hblkhd;
+#else
+    return -1;
+#endif
+}
+}
+
+ProxyMemoryBenchmark::ProxyMemoryBenchmark(const FinishedCallback& finished_cb, const String& param)
+        : Benchmark(finished_cb),
+          mForceStop(false),
+          mNumPresences(200)
+{
+    if (!param.empty())
+        mNumPresences = boost::lexical_cast<uint32>(param);
+}
+
+String ProxyMemoryBenchmark::name() {
+    return "proxy-memory";
+}
+
+void ProxyMemoryBenchmark::run(bool shared) {
+    SpaceID space(UUID::random());
+
+    // Objects and their properties, as they'd arrive in proximity results
+    std::vector<SpaceObjectReference> objects;
+    std::vector<Transfer::URI> meshes;
+    std::vector<String> physics;
+    for(uint32 i = 0; i < NUM_OBJECTS; i++) {
+        objects.push_back(SpaceObjectReference(space, ObjectReference(UUID::random())));
+        String name = "object" + boost::lexical_cast<String>(i);
+        meshes.push_back(Transfer::URI("meerkat:///benchmark/models/" + name + ".dae/optimized/0/" + name + ".dae"));
+        physics.push_back(
+            (i % PHYSICS_EVERY == 0) ?
+            String("{\"treatment\":\"dynamic\",\"bounds\":\"sphere\",\"mass\":1.0}") :
+            String()
+        );
+    }
+
+    int64 heap_before = heapInUse();
+    Time start_time = Timer::now();
+
+    ProxyStateStorePtr store;
+    if (shared)
+        store = ProxyStateStorePtr(new ProxyStateStore());
+    std::vector<ProxyManagerPtr> managers;
+    for(uint32 p = 0; p < mNumPresences && !mForceStop; p++) {
+        ProxyManagerPtr pm = ProxyManager::construct(VWObjectPtr(), SpaceObjectReference(space, ObjectReference(UUID::random())), store);
+        for(uint32 i = 0; i < objects.size(); i++) {
+            TimedMotionVector3f loc(Time::null(), MotionVector3f(Vector3f(randFloat(), randFloat(), randFloat()), Vector3f::zero()));
+            TimedMotionQuaternion orient(Time::null(), MotionQuaternion(Quaternion::identity(), Quaternion::identity()));
+            AggregateBoundingInfo bnds(Vector3f::zero(), 1.f);
+            pm->createObject(objects[i], loc, orient, bnds, meshes[i], physics[i], false, 1);
+        }
+        managers.push_back(pm);
+    }
+    Duration create_dur = Timer::now() - start_time;
+    int64 heap_after = heapInUse();
+
+    // One location update per object for each presence
+    start_time = Timer::now();
+    for(uint32 p = 0; p < managers.size() && !mForceStop; p++) {
+        for(uint32 i = 0; i < objects.size(); i++) {
+            ProxyObjectPtr proxy = managers[p]->getProxyObject(objects[i]);
+            TimedMotionVector3f loc(Time::null() + Duration::seconds(1.f), MotionVector3f(Vector3f(randFloat(), randFloat(), randFloat()), Vector3f::zero()));
+            proxy->setLocation(loc, 2);
+        }
+    }
+    Duration update_dur = Timer::now() - start_time;
+
+    if (!mForceStop) {
+        uint64 num_proxies = (uint64)managers.size() * objects.size();
+        String label = shared ? "shared store" : "store per presence";
+        if (heap_before >= 0) {
+            SILOG(benchmark,info,
+                label << ": " << ((heap_after - heap_before) / (float64)num_proxies) << " bytes/proxy, "
+                << ((heap_after - heap_before) / (1024*1024)) << "MB for " << num_proxies << " proxies");
+        }
+        else {
+            SILOG(benchmark,info, label << ": can't measure heap usage on this platform");
+        }
+        if (store)
+            SILOG(benchmark,info,
+                label << ": " << store->size() << " objects in store, " << store->references() << " references");
+        SILOG(benchmark,info,
+            label << ": " << (create_dur.toMicroseconds() * 1000.0 / num_proxies) << "ns/proxy to create, "
+            << (update_dur.toMicroseconds() * 1000.0 / num_proxies) << "ns/update");
+    }
+
+    for(uint32 p = 0; p < managers.size(); p++)
+        managers[p]->destroy();
+    managers.clear();
+}
+
+void ProxyMemoryBenchmark::start() {
+    mForceStop = false;
+
+    SILOG(benchmark,info,
+        mNumPresences << " presences, each seeing " << NUM_OBJECTS << " objects");
+
+    run(false);
+    if (!mForceStop)
+        run(true);
+
+    if (mForceStop)
+        return;
+
+    notifyFinished();
+}
+
+void ProxyMemoryBenchmark::stop() {
+    mForceStop = true;
+}
+
+} // namespace Sirikata
@@ -0,0 +1,48 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_PROXY_MEMORY_BENCHMARK_HPP_
+#define _SIRIKATA_PROXY_MEMORY_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+#include <sirikata/proxyobject/Defs.hpp>
+
+namespace Sirikata {
+
+/** Measures the memory used by proxies when many presences on one object host
+ *  see the same objects, as with a crowd of avatars in one place. Each
+ *  presence gets a ProxyManager with a proxy for every object, filled in the
+ *  way proximity results do, then every presence receives one location update
+ *  for every object. This is done once with a ProxyStateStore per presence,
+ *  which is how proxies were stored before the store was shared, and once with
+ *  a single store for the whole object host. Reports heap bytes per proxy
+ *  (where the platform lets us measure it), and the time to create and update
+ *  the proxies. The parameter sets the number of presences (default 200, each
+ *  seeing 2000 objects).
+ */
+class ProxyMemoryBenchmark : public Benchmark {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& param) {
+        return new ProxyMemoryBenchmark(finished_cb, param);
+    }
+
+    ProxyMemoryBenchmark(const FinishedCallback& finished_cb, const String& param);
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+  private:
+    void run(bool shared);
+
+    volatile bool mForceStop;
+    uint32 mNumPresences;
+}; // class ProxyMemoryBenchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_PROXY_MEMORY_BENCHMARK_HPP_
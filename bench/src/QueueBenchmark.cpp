@@ -0,0 +1,115 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "QueueBenchmark.hpp"
+#include <sirikata/core/util/Thread.hpp>
+#include <sirikata/core/queue/ThreadSafeQueue.hpp>
+#include <sirikata/core/queue/LockFreeQueue.hpp>
+#include <sirikata/core/queue/BoundedLockFreeQueue.hpp>
+
+#define ITERATIONS 1000000
+#define MAX_THREADS 16
+
+namespace Sirikata {
+
+namespace {
+
+// Stand-in for the Message* which are handed off between strands
+typedef void* Item;
+
+// BoundedLockFreeQueue can fill up, so it needs to be retried like pop. The
+// unbounded queues always succeed.
+template<typename QueueType>
+bool benchPush(QueueType* queue, const Item& item) {
+    queue->push(item);
+    return true;
+}
+bool benchPush(BoundedLockFreeQueue<Item>* queue, const Item& item) {
+    return queue->tryPush(item);
+}
+
+} // namespace
+
+QueueBenchmark::QueueBenchmark(const FinishedCallback& finished_cb)
+        : Benchmark(finished_cb),
+          mForceStop(false)
+{
+}
+
+String QueueBenchmark::name() {
+    return "queue";
+}
+
+template<typename QueueType>
+void QueueBenchmark::produce(QueueType* queue, uint32 count) {
+    for(uint32 ii = 0; ii < count && !mForceStop; ii++) {
+        Item item = reinterpret_cast<Item>((uintptr_t)ii + 1);
+        while(!benchPush(queue, item) && !mForceStop)
+            Thread::yield();
+    }
+}
+
+template<typename QueueType>
+void QueueBenchmark::consume(QueueType* queue, uint32 count) {
+    Item item;
+    for(uint32 ii = 0; ii < count && !mForceStop; ii++) {
+        while(!queue->pop(item) && !mForceStop)
+            Thread::yield();
+    }
+}
+
+template<typename QueueType>
+void QueueBenchmark::runQueue(const String& queue_name) {
+    for(uint32 nthreads = 1; nthreads <= MAX_THREADS && !mForceStop; nthreads *= 2) {
+        QueueType queue;
+        uint32 per_thread = ITERATIONS / nthreads;
+
+        Time start_time = Timer::now();
+
+        std::vector<Thread*> threads;
+        for(uint32 ti = 0; ti < nthreads; ti++) {
+            threads.push_back(new Thread("QueueBenchmark Producer",
+                    std::tr1::bind(&QueueBenchmark::produce<QueueType>, this, &queue, per_thread)));
+            threads.push_back(new Thread("QueueBenchmark Consumer",
+                    std::tr1::bind(&QueueBenchmark::consume<QueueType>, this, &queue, per_thread)));
+        }
+        for(uint32 ti = 0; ti < threads.size(); ti++) {
+            threads[ti]->join();
+            delete threads[ti];
+        }
+
+        if (mForceStop)
+            return;
+
+        Time end_time = Timer::now();
+        Duration dur = end_time - start_time;
+        uint32 total = per_thread * nthreads;
+
+        SILOG(benchmark,info,
+              queue_name << ", " << nthreads << " producers/consumers, "
+              << total << " items, " << dur << ": "
+              << (dur.toMicroseconds()*1000/float(total)) << "ns/item, "
+              << float(total)/dur.toSeconds() << " items/s");
+    }
+}
+
+void QueueBenchmark::start() {
+    mForceStop = false;
+
+    runQueue< ThreadSafeQueue<Item> >("ThreadSafeQueue");
+    runQueue< LockFreeQueue<Item> >("LockFreeQueue");
+    runQueue< BoundedLockFreeQueue<Item> >("BoundedLockFreeQueue");
+
+    if (mForceStop)
+        return;
+
+    notifyFinished();
+}
+
+void QueueBenchmark::stop() {
+    mForceStop = true;
+}
+
+
+} // namespace Sirikata
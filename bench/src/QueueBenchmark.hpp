@@ -0,0 +1,45 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_QUEUE_BENCHMARK_HPP_
+#define _SIRIKATA_QUEUE_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+
+namespace Sirikata {
+
+/** Compare the throughput of the thread-safe queues (ThreadSafeQueue,
+ *  LockFreeQueue and BoundedLockFreeQueue) with 1 to 16 producer and consumer
+ *  threads each passing pointers through a single shared queue.
+ */
+class QueueBenchmark : public Benchmark {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& _param) {
+        return new QueueBenchmark(finished_cb);
+    }
+
+    QueueBenchmark(const FinishedCallback& finished_cb);
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+  private:
+    template<typename QueueType>
+    void runQueue(const String& queue_name);
+
+    template<typename QueueType>
+    void produce(QueueType* queue, uint32 count);
+    template<typename QueueType>
+    void consume(QueueType* queue, uint32 count);
+
+    volatile bool mForceStop;
+}; // class QueueBenchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_QUEUE_BENCHMARK_HPP_
@@ -0,0 +1,224 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "SSTCongestionBenchmark.hpp"
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <sirikata/core/network/IOWork.hpp>
+#include <sirikata/core/trace/Trace.hpp>
+
+// Bytes sent one way in each run
+#define TRANSFER_SIZE (1024*1024)
+// Each chunk starts with the time it was written, for latency measurements.
+// Chunks fit in a single stream buffer.
+#define CHUNK_SIZE 1000
+// Limit on bytes written but not yet received so latency measures the
+// network path rather than an ever growing send queue
+#define MAX_OUTSTANDING (128*1024)
+#define LINK_DELAY Duration::milliseconds(5)
+// Runs which haven't finished by this point report partial results
+#define RUN_TIMEOUT Duration::seconds(3)
+
+namespace Sirikata {
+
+SSTCongestionBenchmark::SSTCongestionBenchmark(const FinishedCallback& finished_cb, const String& param)
+        : Benchmark(finished_cb),
+          mForceStop(false),
+          mContext(NULL),
+          mRunDone(false),
+          mBytesWritten(0),
+          mBytesReceived(0)
+{
+    if (!param.empty()) {
+        mAlgorithms.push_back(param);
+    }
+    else {
+        mAlgorithms.push_back("legacy");
+        mAlgorithms.push_back("cubic");
+        mAlgorithms.push_back("bbr");
+    }
+}
+
+String SSTCongestionBenchmark::name() {
+    return "sst-cc";
+}
+
+void SSTCongestionBenchmark::start() {
+    const float32 loss_rates[] = { 0.f, 0.01f, 0.05f };
+    const uint32 num_loss_rates = sizeof(loss_rates)/sizeof(loss_rates[0]);
+
+    for(uint32 ai = 0; ai < mAlgorithms.size() && !mForceStop; ai++) {
+        for(uint32 li = 0; li < num_loss_rates && !mForceStop; li++)
+            runTransfer(mAlgorithms[ai], loss_rates[li]);
+    }
+
+    if (mForceStop)
+        return;
+
+    notifyFinished();
+}
+
+void SSTCongestionBenchmark::stop() {
+    mForceStop = true;
+}
+
+void SSTCongestionBenchmark::runTransfer(const String& algorithm, float32 loss_rate) {
+    using std::tr1::placeholders::_1;
+    using std::tr1::placeholders::_2;
+
+    std::deque<String> empty_events;
+    mEvents.swap(empty_events);
+    mRunDone = false;
+    mBytesWritten = 0;
+    mBytesReceived = 0;
+    mPartialChunk.clear();
+    mLatencies.clear();
+
+    Trace::Trace* trace = new Trace::Trace("sst-cc.trace");
+    Network::IOService* ios = new Network::IOService("SSTCongestionBenchmark Service");
+    Network::IOStrand* main_strand = ios->createStrand("SSTCongestionBenchmark Main Strand");
+    Network::IOWork* work = new Network::IOWork(*ios, "SSTCongestionBenchmark IOWork");
+    mContext = new Context("sst-cc", ios, main_strand, trace, Timer::now());
+
+    Loopback::Service* link = new Loopback::Service(mContext, LINK_DELAY, loss_rate);
+    Loopback::ConnectionManager* conn_mgr = new Loopback::ConnectionManager();
+    conn_mgr->mSSTConnVars.setCongestionControl(algorithm);
+
+    mContext->add(mContext);
+    mContext->add(conn_mgr);
+
+    Loopback::ID sender("sender"), receiver("receiver");
+    conn_mgr->createDatagramLayer(sender, mContext, link);
+    conn_mgr->createDatagramLayer(receiver, mContext, link);
+
+    mContext->run(2, Context::AllNew);
+
+    conn_mgr->listen(
+        std::tr1::bind(&SSTCongestionBenchmark::onReceiverConnected, this, _1, _2),
+        Loopback::Endpoint(receiver, 1)
+    );
+    Time start_time = Timer::now();
+    conn_mgr->connectStream(
+        Loopback::Endpoint(sender, 1),
+        Loopback::Endpoint(receiver, 1),
+        std::tr1::bind(&SSTCongestionBenchmark::onSenderConnected, this, _1, _2)
+    );
+
+    bool completed = false;
+    while(!mForceStop && !completed && (Timer::now() - start_time) < RUN_TIMEOUT) {
+        String evt;
+        if (mEvents.blockingPop(evt, Duration::milliseconds(100)))
+            completed = (evt == "done");
+    }
+    mRunDone = true;
+    Duration elapsed = Timer::now() - start_time;
+
+    if (!mForceStop) {
+        std::vector<Duration> latencies;
+        {
+            boost::mutex::scoped_lock lock(mLatencyMutex);
+            latencies.swap(mLatencies);
+        }
+        std::sort(latencies.begin(), latencies.end());
+        Duration mean_latency = Duration::zero();
+        Duration p99_latency = Duration::zero();
+        if (!latencies.empty()) {
+            for(uint32 i = 0; i < latencies.size(); i++)
+                mean_latency += latencies[i];
+            mean_latency = mean_latency / (uint64)latencies.size();
+            p99_latency = latencies[(latencies.size() * 99) / 100];
+        }
+        uint64 received = mBytesReceived.read();
+
+        SILOG(benchmark,info,
+            algorithm << ", " << (loss_rate*100) << "% loss: "
+            << received << " bytes in " << elapsed
+            << (completed ? "" : " (timed out)") << ", "
+            << (received / elapsed.toSeconds() / 1024) << " KB/s, "
+            << "latency mean " << mean_latency << " p99 " << p99_latency << ", "
+            << link->dropped() << " of " << link->sent() << " datagrams dropped");
+    }
+
+    delete work;
+    mContext->shutdown();
+    trace->prepareShutdown();
+    delete mContext;
+    mContext = NULL;
+    trace->shutdown();
+    delete trace;
+    delete main_strand;
+    delete ios;
+    // As in the SST tests, these must outlive the IOService since queued
+    // handlers still reference them.
+    delete conn_mgr;
+    delete link;
+}
+
+void SSTCongestionBenchmark::onReceiverConnected(int err, Loopback::Stream::Ptr s) {
+    using std::tr1::placeholders::_1;
+    using std::tr1::placeholders::_2;
+
+    if (err != SST_IMPL_SUCCESS) {
+        mEvents.push("failed");
+        return;
+    }
+    s->registerReadCallback(
+        std::tr1::bind(&SSTCongestionBenchmark::onRead, this, _1, _2)
+    );
+}
+
+void SSTCongestionBenchmark::onSenderConnected(int err, Loopback::Stream::Ptr s) {
+    if (err != SST_IMPL_SUCCESS) {
+        mEvents.push("failed");
+        return;
+    }
+    writeChunks(s);
+}
+
+void SSTCongestionBenchmark::writeChunks(Loopback::Stream::Ptr s) {
+    if (mRunDone) return;
+
+    uint8 chunk[CHUNK_SIZE];
+    memset(chunk, 0, CHUNK_SIZE);
+    while(mBytesWritten < TRANSFER_SIZE &&
+        mBytesWritten - mBytesReceived.read() < MAX_OUTSTANDING)
+    {
+        uint64 sent_time = Timer::now().raw();
+        memcpy(chunk, &sent_time, sizeof(sent_time));
+        int written = s->write(chunk, CHUNK_SIZE);
+        if (written <= 0)
+            break;
+        mBytesWritten += written;
+    }
+
+    if (mBytesWritten < TRANSFER_SIZE) {
+        mContext->mainStrand->post(
+            Duration::milliseconds(1),
+            std::tr1::bind(&SSTCongestionBenchmark::writeChunks, this, s)
+        );
+    }
+}
+
+void SSTCongestionBenchmark::onRead(uint8* data, int size) {
+    if (mRunDone) return;
+
+    Time now = Timer::now();
+    {
+        boost::mutex::scoped_lock lock(mLatencyMutex);
+        mPartialChunk.append((const char*)data, size);
+        uint32 offset = 0;
+        for(; offset + CHUNK_SIZE <= mPartialChunk.size(); offset += CHUNK_SIZE) {
+            uint64 sent_time;
+            memcpy(&sent_time, mPartialChunk.data() + offset, sizeof(sent_time));
+            mLatencies.push_back(now - Time(sent_time));
+        }
+        mPartialChunk.erase(0, offset);
+    }
+
+    mBytesReceived += (uint64)size;
+    if (mBytesReceived.read() >= TRANSFER_SIZE)
+        mEvents.push("done");
+}
+
+} // namespace Sirikata
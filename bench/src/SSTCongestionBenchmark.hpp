@@ -0,0 +1,59 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_SST_CONGESTION_BENCHMARK_HPP_
+#define _SIRIKATA_SST_CONGESTION_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+#include "LoopbackSST.hpp"
+#include <sirikata/core/queue/ThreadSafeQueue.hpp>
+
+namespace Sirikata {
+
+/** Compares SST congestion control algorithms by streaming data one way over
+ *  an in-process link with a fixed delay and random loss, reporting goodput
+ *  and per-chunk latency for each algorithm and loss rate. The parameter
+ *  optionally restricts the run to a single algorithm, e.g. "sst-cc bbr".
+ */
+class SSTCongestionBenchmark : public Benchmark {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& param) {
+        return new SSTCongestionBenchmark(finished_cb, param);
+    }
+
+    SSTCongestionBenchmark(const FinishedCallback& finished_cb, const String& param);
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+  private:
+    void runTransfer(const String& algorithm, float32 loss_rate);
+
+    void onReceiverConnected(int err, Loopback::Stream::Ptr s);
+    void onSenderConnected(int err, Loopback::Stream::Ptr s);
+    void onRead(uint8* data, int size);
+    void writeChunks(Loopback::Stream::Ptr s);
+
+    volatile bool mForceStop;
+    std::vector<String> mAlgorithms;
+
+    // Per-run state
+    Context* mContext;
+    ThreadSafeQueue<String> mEvents;
+    volatile bool mRunDone;
+    uint64 mBytesWritten;
+    AtomicValue<uint64> mBytesReceived;
+    // Receive side reassembly of chunks split across reads
+    boost::mutex mLatencyMutex;
+    String mPartialChunk;
+    std::vector<Duration> mLatencies;
+}; // class SSTCongestionBenchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_SST_CONGESTION_BENCHMARK_HPP_
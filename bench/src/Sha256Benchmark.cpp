@@ -0,0 +1,112 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "Sha256Benchmark.hpp"
+#include <sirikata/core/util/Sha256.hpp>
+#include <sirikata/core/util/Timer.hpp>
+#include <boost/lexical_cast.hpp>
+
+// The buffer is reused until the total has been hashed so the data stays in
+// roughly the same place in the cache hierarchy as a chunk that just arrived
+#define BUFFER_SIZE (16*1024*1024)
+
+namespace Sirikata {
+
+Sha256Benchmark::Sha256Benchmark(const FinishedCallback& finished_cb, const String& param)
+        : Benchmark(finished_cb),
+          mForceStop(false),
+          mTotalBytes(256*1024*1024)
+{
+    if (!param.empty())
+        mTotalBytes = boost::lexical_cast<size_t>(param) * 1024 * 1024;
+}
+
+String Sha256Benchmark::name() {
+    return "sha256";
+}
+
+void Sha256Benchmark::report(const String& label, size_t bytes, const Duration& dur) {
+    SILOG(benchmark,info,
+          label << ": " << bytes << " bytes in " << dur << ", "
+          << (bytes / dur.toSeconds() / (1024.0*1024.0*1024.0)) << " GB/s");
+}
+
+void Sha256Benchmark::runSingle(const String& label, size_t chunk_size) {
+    SHA256 digest;
+    size_t hashed = 0;
+
+    Time start_time = Timer::now();
+    while(hashed < mTotalBytes && !mForceStop) {
+        for(size_t offset = 0; offset + chunk_size <= mData.size() && hashed < mTotalBytes; offset += chunk_size) {
+            digest = SHA256::computeDigest(&mData[offset], chunk_size);
+            hashed += chunk_size;
+        }
+    }
+    Duration dur = Timer::now() - start_time;
+
+    if (mForceStop) return;
+    report(label + " " + boost::lexical_cast<String>(chunk_size) + "B chunks", hashed, dur);
+}
+
+void Sha256Benchmark::runBatch(size_t chunk_size) {
+    std::vector<const void*> chunks;
+    std::vector<size_t> lengths;
+    for(size_t offset = 0; offset + chunk_size <= mData.size(); offset += chunk_size) {
+        chunks.push_back(&mData[offset]);
+        lengths.push_back(chunk_size);
+    }
+    std::vector<SHA256> digests(chunks.size());
+    size_t batch_bytes = chunks.size() * chunk_size;
+    size_t hashed = 0;
+
+    Time start_time = Timer::now();
+    while(hashed < mTotalBytes && !mForceStop) {
+        SHA256::computeDigests(&chunks[0], &lengths[0], chunks.size(), &digests[0]);
+        hashed += batch_bytes;
+    }
+    Duration dur = Timer::now() - start_time;
+
+    if (mForceStop) return;
+    report(String(SHA256::implementation()) + " batch of " + boost::lexical_cast<String>(chunks.size()) + " " +
+        boost::lexical_cast<String>(chunk_size) + "B chunks", hashed, dur);
+}
+
+void Sha256Benchmark::start() {
+    mForceStop = false;
+
+    mData.resize(BUFFER_SIZE);
+    for(size_t i = 0; i < mData.size(); i++)
+        mData[i] = (unsigned char)(i * 131 + 7);
+
+    SILOG(benchmark,info, "SHA256 implementation: " << SHA256::implementation());
+
+    const size_t chunk_sizes[] = { 4*1024, 64*1024, BUFFER_SIZE };
+    const size_t num_chunk_sizes = sizeof(chunk_sizes)/sizeof(chunk_sizes[0]);
+
+    SHA256::useScalarImplementation(true);
+    for(size_t i = 0; i < num_chunk_sizes && !mForceStop; i++)
+        runSingle(SHA256::implementation(), chunk_sizes[i]);
+    SHA256::useScalarImplementation(false);
+
+    if (String(SHA256::implementation()) != "scalar") {
+        for(size_t i = 0; i < num_chunk_sizes && !mForceStop; i++)
+            runSingle(SHA256::implementation(), chunk_sizes[i]);
+    }
+
+    if (!mForceStop)
+        runBatch(64*1024);
+
+    mData.clear();
+
+    if (mForceStop)
+        return;
+
+    notifyFinished();
+}
+
+void Sha256Benchmark::stop() {
+    mForceStop = true;
+}
+
+} // namespace Sirikata
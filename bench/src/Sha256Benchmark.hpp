@@ -0,0 +1,46 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_SHA256_BENCHMARK_HPP_
+#define _SIRIKATA_SHA256_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+
+namespace Sirikata {
+
+/** Measures SHA256 throughput, as used to fingerprint uploads and verify
+ *  cached chunks. Single buffers are hashed with the portable and, if the CPU
+ *  supports it, the accelerated implementation, then a batch of chunks is
+ *  hashed with SHA256::computeDigests. The parameter sets the total number of
+ *  megabytes hashed by each run (default 256).
+ */
+class Sha256Benchmark : public Benchmark {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& param) {
+        return new Sha256Benchmark(finished_cb, param);
+    }
+
+    Sha256Benchmark(const FinishedCallback& finished_cb, const String& param);
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+  private:
+    // Hashes the buffer in pieces of chunk_size bytes, one digest each
+    void runSingle(const String& label, size_t chunk_size);
+    void runBatch(size_t chunk_size);
+    void report(const String& label, size_t bytes, const Duration& dur);
+
+    volatile bool mForceStop;
+    size_t mTotalBytes;
+    std::vector<unsigned char> mData;
+}; // class Sha256Benchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_SHA256_BENCHMARK_HPP_
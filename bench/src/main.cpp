@@ -36,7 +36,18 @@
 #include "TimerJitterBenchmark.hpp"
 #include "TimerMonotonicityBenchmark.hpp"
 #include "TCPSSTBenchmark.hpp"
+#include "SSTCongestionBenchmark.hpp"
 #include "UUIDSpeedBenchmark.hpp"
+#include "Sha256Benchmark.hpp"
+#include "QueueBenchmark.hpp"
+#include "LocationSubscriptionBenchmark.hpp"
+#include "LocationEncodingBenchmark.hpp"
+#include "OSegCacheBenchmark.hpp"
+#include "ODPFlowSchedulerBenchmark.hpp"
+#include "ObjectStrandBenchmark.hpp"
+#include "ProxyMemoryBenchmark.hpp"
+#include "DiskCacheBenchmark.hpp"
+#include "HttpBenchmark.hpp"
 
 #include <sirikata/core/util/DynamicLibrary.hpp>
 
@@ -68,8 +79,24 @@ int main(int argc, char** argv) {
     ADD_BENCHMARK(timer-monotonicity, TimerMonotonicityBenchmark::create);
 
     ADD_BENCHMARK(ping, SSTBenchmark::create);
+    ADD_BENCHMARK(sst-cc, SSTCongestionBenchmark::create);
 
     ADD_BENCHMARK(uuid-create, UUIDSpeedBenchmark::create);
+    ADD_BENCHMARK(sha256, Sha256Benchmark::create);
+
+    ADD_BENCHMARK(queue, QueueBenchmark::create);
+
+    ADD_BENCHMARK(loc-subscriptions, LocationSubscriptionBenchmark::create);
+    ADD_BENCHMARK(loc-encoding, LocationEncodingBenchmark::create);
+
+    ADD_BENCHMARK(oseg-cache, OSegCacheBenchmark::create);
+    ADD_BENCHMARK(odp-flow, ODPFlowSchedulerBenchmark::create);
+
+    ADD_BENCHMARK(object-strands, ObjectStrandBenchmark::create);
+    ADD_BENCHMARK(proxy-memory, ProxyMemoryBenchmark::create);
+
+    ADD_BENCHMARK(disk-cache, DiskCacheBenchmark::create);
+    ADD_BENCHMARK(http, HttpBenchmark::create);
 
     BenchmarkRunner runner(factory, Duration::seconds(30.f));
 
@@ -66,6 +66,7 @@
 #include <sirikata/oh/ObjectScriptManagerFactory.hpp>
 
 #include <sirikata/core/transfer/TransferMediator.hpp>
+#include <sirikata/core/transfer/TransferHandlers.hpp>
 #include <sirikata/core/command/Commander.hpp>
 
 #ifdef __GNUC__
@@ -159,6 +160,7 @@ int main (int argc, char** argv) {
         commander = Command::CommanderFactory::getSingleton().getConstructor(commander_type)(ctx, commander_options);
 
     Transfer::TransferMediator::getSingleton().registerContext(ctx);
+    Transfer::SharedChunkCache::getSingleton().registerContext(ctx);
 
 
     SpaceID mainSpace(GetOptionValue<UUID>(OPT_MAIN_SPACE));
@@ -218,7 +220,9 @@ int main (int argc, char** argv) {
     }
 
 
-    ctx->run(1);
+    // One extra thread per object strand so objects can actually run in
+    // parallel
+    ctx->run(1 + oh->numObjectStrands());
 
     ctx->cleanup();
 
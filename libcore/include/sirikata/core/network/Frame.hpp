@@ -52,6 +52,20 @@ struct SIRIKATA_EXPORT Frame {
      *  and does nothing to the argument if it does not have a whole packet.
      */
     static std::string parse(std::string& data);
+
+    /** Appends a frame header for len bytes of data to output, followed by
+     *  len bytes of space, and returns a pointer to that space so the caller
+     *  can fill it in place. Any previous contents of output are kept, so
+     *  frames can be packed one after another into one buffer.
+     */
+    static uint8* append(std::vector<uint8>* output, uint32 len);
+
+    /** Parses the frame starting at offset in data without copying it. If a
+     *  whole frame is available, points payload at its contents, sets
+     *  payload_len, advances offset past it and returns true. Otherwise returns
+     *  false and leaves offset unchanged.
+     */
+    static bool parse(const uint8* data, uint32 size, uint32* offset, const uint8** payload, uint32* payload_len);
 };
 
 } // namespace Network
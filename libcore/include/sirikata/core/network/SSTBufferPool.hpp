@@ -0,0 +1,142 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_LIBCORE_NETWORK_SST_BUFFER_POOL_HPP_
+#define _SIRIKATA_LIBCORE_NETWORK_SST_BUFFER_POOL_HPP_
+
+#include <sirikata/core/util/Platform.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
+#include <sirikata/core/util/MemoryReference.hpp>
+#include <boost/intrusive_ptr.hpp>
+
+namespace Sirikata {
+namespace SST {
+
+/** Free lists of fixed size blocks backing SST's stream buffers, channel
+ *  segments and serialized packets. Nearly every SST allocation is one of a
+ *  few sizes (a small object, or a payload of at most one datagram), so
+ *  requests are rounded up to one of a handful of size classes and blocks are
+ *  recycled through lock-free free lists instead of going back to the heap.
+ *  Requests larger than the biggest class go straight to the heap.
+ *
+ *  The pool also keeps process wide counters so the cost of the send path can
+ *  be measured as heap allocations and copied bytes per byte delivered to the
+ *  application.
+ */
+class SIRIKATA_EXPORT SegmentBufferPool {
+public:
+    struct Stats {
+        Stats();
+
+        /// Total number of blocks requested from the pool
+        uint64 requests;
+        /// Number of requests which had to go to the heap
+        uint64 allocations;
+        /// Bytes memcpy'd into SST buffers on the send path
+        uint64 bytes_copied;
+        /// Bytes handed to stream read callbacks
+        uint64 bytes_delivered;
+
+        double allocationsPerDeliveredByte() const;
+        double copiesPerDeliveredByte() const;
+    };
+
+    /** Get a block of at least nbytes. Must be returned with release, with
+     *  the same nbytes.
+     */
+    static void* allocate(size_t nbytes);
+    static void release(void* block, size_t nbytes);
+
+    static void recordCopy(size_t nbytes) {
+        sBytesCopied += (uint64)nbytes;
+    }
+    static void recordDelivered(size_t nbytes) {
+        sBytesDelivered += (uint64)nbytes;
+    }
+
+    static Stats stats();
+    static void resetStats();
+
+private:
+    friend class SegmentBuffer;
+
+    static AtomicValue<uint64> sRequests;
+    static AtomicValue<uint64> sAllocations;
+    static AtomicValue<uint64> sBytesCopied;
+    static AtomicValue<uint64> sBytesDelivered;
+};
+
+/** Reference counted byte buffer allocated from SegmentBufferPool. The
+ *  header and data share a single block, and the reference count is
+ *  intrusive, so creating a buffer and sharing it between a Stream's
+ *  retransmit state and a Connection's outgoing queue costs a single pooled
+ *  block rather than a data allocation plus a shared_ptr control block.
+ */
+class SIRIKATA_EXPORT SegmentBuffer {
+public:
+    /// Allocate an uninitialized buffer holding size bytes
+    static SegmentBuffer* create(uint32 size);
+    /// Allocate a buffer holding a copy of data
+    static SegmentBuffer* create(const void* data, uint32 size);
+    /// Allocate a buffer holding the concatenation of the pieces
+    static SegmentBuffer* gather(const MemoryReference* pieces, uint32 npieces);
+
+    uint8* data() {
+        return reinterpret_cast<uint8*>(this) + HeaderSize;
+    }
+    const uint8* data() const {
+        return reinterpret_cast<const uint8*>(this) + HeaderSize;
+    }
+    uint32 size() const {
+        return mSize;
+    }
+    uint32 capacity() const {
+        return mCapacity;
+    }
+    /// Shrink or grow the used portion of the buffer, up to its capacity
+    void resize(uint32 size) {
+        assert(size <= mCapacity);
+        mSize = size;
+    }
+
+    friend void intrusive_ptr_add_ref(SegmentBuffer* buf) {
+        ++buf->mRefCount;
+    }
+    friend void intrusive_ptr_release(SegmentBuffer* buf) {
+        if (--buf->mRefCount == 0)
+            destroy(buf);
+    }
+
+private:
+    // Data starts at the next 16 byte boundary after the header
+    enum {
+        HeaderSize = 16
+    };
+
+    SegmentBuffer(uint32 capacity);
+    SegmentBuffer(const SegmentBuffer&);
+    SegmentBuffer& operator=(const SegmentBuffer&);
+
+    static void destroy(SegmentBuffer* buf);
+
+    AtomicValue<uint32> mRefCount;
+    uint32 mSize;
+    uint32 mCapacity;
+};
+
+typedef boost::intrusive_ptr<SegmentBuffer> SegmentBufferPtr;
+
+/** Routes a class's operator new/delete through SegmentBufferPool. */
+#define SIRIKATA_SST_POOLED_ALLOCATION(ClassName)                       \
+    static void* operator new(size_t nbytes) {                          \
+        return Sirikata::SST::SegmentBufferPool::allocate(nbytes);      \
+    }                                                                   \
+    static void operator delete(void* block, size_t nbytes) {           \
+        Sirikata::SST::SegmentBufferPool::release(block, nbytes);       \
+    }
+
+} // namespace SST
+} // namespace Sirikata
+
+#endif //_SIRIKATA_LIBCORE_NETWORK_SST_BUFFER_POOL_HPP_
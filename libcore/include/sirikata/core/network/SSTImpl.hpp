@@ -40,9 +40,13 @@
 #include <sirikata/core/util/Timer.hpp>
 #include <sirikata/core/service/Context.hpp>
 #include <sirikata/core/network/IOTimer.hpp>
+#include <sirikata/core/network/TimerWheel.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <sirikata/core/network/IOService.hpp>
 
 #include <sirikata/core/network/Message.hpp>
 #include <sirikata/core/network/ObjectMessage.hpp>
+#include <sirikata/core/network/SSTBufferPool.hpp>
 #include "Protocol_SSTHeader.pbj.hpp"
 
 #include <boost/lexical_cast.hpp>
@@ -52,6 +56,9 @@
 
 #define SST_LOG(lvl,msg) SILOG(sst,lvl,msg);
 
+// Number of independently locked shards connection state is split into
+#define SST_CONNECTION_SHARDS 16
+
 namespace Sirikata {
 namespace SST {
 
@@ -137,6 +144,15 @@ typedef uint32 LSID;
 template <class EndPointType>
 class ConnectionVariables {
 public:
+    ConnectionVariables()
+     : mCongestionControl(),
+       mStrandsCreated(false)
+    {}
+
+    ~ConnectionVariables() {
+        for(uint32 i = 0; i < mStrands.size(); i++)
+            delete mStrands[i];
+    }
 
     typedef std::tr1::shared_ptr<BaseDatagramLayer<EndPointType> > BaseDatagramLayerPtr;
     typedef CallbackTypes<EndPointType> CBTypes;
@@ -195,14 +211,92 @@ public:
     StreamReturnCallbackMap mStreamReturnCallbackMap;
 
     typedef std::tr1::unordered_map<EndPoint<EndPointType>, std::tr1::shared_ptr<Connection<EndPointType> >, typename EndPoint<EndPointType>::Hasher >  ConnectionMap;
-    ConnectionMap sConnectionMap;
-
     typedef std::tr1::unordered_map<EndPoint<EndPointType>, ConnectionReturnCallbackFunction, typename EndPoint<EndPointType>::Hasher>  ConnectionReturnCallbackMap;
-    ConnectionReturnCallbackMap sConnectionReturnCallbackMap;
 
+    /** Connections and pending connection callbacks, for the subset of local
+     *  endpoints which hash to this shard. Connection setup and teardown only
+     *  lock the shards for the endpoints involved, so unrelated connections
+     *  don't contend with each other.
+     */
+    struct ConnectionShard {
+        Mutex lock;
+        ConnectionMap connections;
+        ConnectionReturnCallbackMap returnCallbacks;
+    };
+    ConnectionShard& shardFor(const EndPoint<EndPointType>& ep) {
+        return sConnectionShards[typename EndPoint<EndPointType>::Hasher()(ep) % SST_CONNECTION_SHARDS];
+    }
+    ConnectionShard sConnectionShards[SST_CONNECTION_SHARDS];
+
+    // Guards sListeningConnectionsCallbackMap
     StreamReturnCallbackMap  sListeningConnectionsCallbackMap;
     Mutex sStaticMembersLock;
 
+    /** Get the strand a connection with the given local endpoint, and its
+     *  streams, should be serviced on. With sst.connection-strands set to 0
+     *  everything runs on the Context's main strand. Otherwise connections
+     *  are spread over that many strands by endpoint hash, so servicing runs
+     *  in parallel across the Context's threads. Callbacks into user code
+     *  are then also made from those strands.
+     *
+     *  Strands are owned by the ConnectionVariables, so it must be destroyed
+     *  before the Context's IOService is.
+     */
+    Network::IOStrand* strandFor(const EndPoint<EndPointType>& ep, const Context* ctx) {
+        boost::mutex::scoped_lock lock(mStrandsLock.getMutex());
+        if (!mStrandsCreated) {
+            mStrandsCreated = true;
+            uint32 nstrands = GetOptionValue<uint32>(OPT_SST_CONNECTION_STRANDS);
+            for(uint32 i = 0; i < nstrands; i++)
+                mStrands.push_back(ctx->ioService->createStrand("SST Connection Strand " + boost::lexical_cast<String>(i)));
+        }
+        if (mStrands.empty())
+            return ctx->mainStrand;
+        return mStrands[typename EndPoint<EndPointType>::Hasher()(ep) % mStrands.size()];
+    }
+    /** Whether connections run on their own strands rather than the main
+     *  strand. Only meaningful once a connection has been created.
+     */
+    bool usesConnectionStrands() {
+        boost::mutex::scoped_lock lock(mStrandsLock.getMutex());
+        return !mStrands.empty();
+    }
+
+    /** Get the TimerWheel for a strand returned by strandFor(). Connections
+     *  and streams arm and cancel their timers constantly, so they share one
+     *  wheel per strand instead of each holding separate IOTimers.
+     */
+    Network::TimerWheelPtr timerWheelFor(Network::IOStrand* strand) {
+        boost::mutex::scoped_lock lock(mStrandsLock.getMutex());
+        typename TimerWheelMap::iterator it = mTimerWheels.find(strand);
+        if (it != mTimerWheels.end())
+            return it->second;
+        Network::TimerWheelPtr wheel = Network::TimerWheel::create(
+            strand, GetOptionValue<Duration>(OPT_SST_TIMER_GRANULARITY)
+        );
+        mTimerWheels[strand] = wheel;
+        return wheel;
+    }
+
+    /** Name of the CongestionControl new Connections should use. Defaults
+     *  to the sst.congestion-control option.
+     */
+    const String& congestionControl() {
+        if (mCongestionControl.empty())
+            mCongestionControl = GetOptionValue<String>(OPT_SST_CONGESTION_CONTROL);
+        return mCongestionControl;
+    }
+    void setCongestionControl(const String& name) {
+        mCongestionControl = name;
+    }
+private:
+    String mCongestionControl;
+
+    Mutex mStrandsLock;
+    bool mStrandsCreated;
+    std::vector<Network::IOStrand*> mStrands;
+    typedef std::map<Network::IOStrand*, Network::TimerWheelPtr> TimerWheelMap;
+    TimerWheelMap mTimerWheels;
 };
 
 // This is just a template definition. The real implementation of BaseDatagramLayer
@@ -299,9 +393,135 @@ class SIRIKATA_EXPORT BaseDatagramLayer
 #define SST_IMPL_SUCCESS 0
 #define SST_IMPL_FAILURE -1
 
+// Bounds and clock granularity for retransmission timeouts
+#define SST_MIN_RTO_US 10000
+#define SST_MAX_RTO_US 20000000
+#define SST_RTO_GRANULARITY_US 1000
+
+// Maximum number of iovec pieces gathered into a single StreamBuffer
+#define SST_WRITEV_MAX_PIECES 32
+
+// Number of acks for later packets after which an unacked packet is
+// considered lost and retransmitted, without waiting for a timeout
+#define SST_FAST_RETRANSMIT_THRESHOLD 3
+
+/** Estimates round trip time and the retransmission timeout from RTT samples,
+ *  following RFC 6298: a smoothed RTT and RTT variance, with the timeout set
+ *  to SRTT + 4*RTTVAR and doubled on each expiry until a new sample arrives.
+ */
+class RTTEstimator {
+public:
+    RTTEstimator()
+     : mSRTT(Duration::zero()),
+       mRTTVar(Duration::zero()),
+       mMinRTT(Duration::zero()),
+       mRTO(Duration::seconds(1)),
+       mHasSample(false)
+    {}
+
+    void sample(const Duration& rtt) {
+        if (rtt < Duration::zero()) return;
+
+        if (!mHasSample) {
+            mSRTT = rtt;
+            mRTTVar = rtt / 2;
+            mMinRTT = rtt;
+            mHasSample = true;
+        }
+        else {
+            Duration err = (mSRTT > rtt) ? (mSRTT - rtt) : (rtt - mSRTT);
+            // beta = 1/4, alpha = 1/8
+            mRTTVar = (mRTTVar * 3 + err) / 4;
+            mSRTT = (mSRTT * 7 + rtt) / 8;
+            if (rtt < mMinRTT) mMinRTT = rtt;
+        }
+
+        mRTO = mSRTT + std::max(Duration::microseconds(SST_RTO_GRANULARITY_US), mRTTVar * 4);
+        if (mRTO < Duration::microseconds(SST_MIN_RTO_US))
+            mRTO = Duration::microseconds(SST_MIN_RTO_US);
+        if (mRTO > Duration::microseconds(SST_MAX_RTO_US))
+            mRTO = Duration::microseconds(SST_MAX_RTO_US);
+    }
+
+    /// Double the timeout after it expires
+    void backoff() {
+        mRTO = mRTO * 2;
+        if (mRTO > Duration::microseconds(SST_MAX_RTO_US))
+            mRTO = Duration::microseconds(SST_MAX_RTO_US);
+    }
+
+    bool hasSample() const { return mHasSample; }
+    const Duration& srtt() const { return mSRTT; }
+    const Duration& rttvar() const { return mRTTVar; }
+    const Duration& minRTT() const { return mMinRTT; }
+    const Duration& rto() const { return mRTO; }
+
+private:
+    Duration mSRTT;
+    Duration mRTTVar;
+    Duration mMinRTT;
+    Duration mRTO;
+    bool mHasSample;
+};
+
+/** Congestion control strategy for an SST Connection. The Connection reports
+ *  acks, detected losses and timeouts and asks for the number of channel
+ *  segments it may have outstanding. Implementations are selected by name,
+ *  see CongestionControl::create and the sst.congestion-control option.
+ */
+class SIRIKATA_EXPORT CongestionControl {
+public:
+    struct AckSample {
+        Time now;
+        // Round trip time of the acked segment
+        Duration rtt;
+        // Smallest RTT seen on the connection
+        Duration min_rtt;
+        // Segments per second delivered between sending this segment and
+        // receiving its ack. Zero if there isn't a valid sample.
+        double delivery_rate;
+        // Segments still outstanding after this ack
+        uint32 in_flight;
+    };
+
+    /** Create a CongestionControl by name ("cubic", "bbr" or "legacy").
+     *  Unknown names log an error and fall back to legacy.
+     */
+    static CongestionControl* create(const String& name);
+
+    virtual ~CongestionControl() {}
+
+    virtual String name() const = 0;
+    /// Maximum number of outstanding segments, at least 1
+    virtual uint32 window() const = 0;
+    /// Whether another segment may be sent with in_flight outstanding. The
+    /// window can shrink below in_flight, e.g. on a loss.
+    bool hasRoom(uint32 in_flight) const { return in_flight < window(); }
+
+    virtual void onAck(const AckSample& sample) = 0;
+    /// A segment was detected as lost via later acks. Reported at most once
+    /// per window of data.
+    virtual void onLoss(const Time& now) = 0;
+    /// The retransmission timer expired with segments outstanding.
+    virtual void onTimeout(const Time& now) = 0;
+};
+
+/** Serialize a PBJ message directly into a pooled SegmentBuffer. */
+template<typename PBJMessageType>
+SegmentBufferPtr serializeToSegment(const PBJMessageType& msg) {
+    uint32 size = msg.ByteSize();
+    SegmentBufferPtr buf(SegmentBuffer::create(size));
+    bool serialized_success = msg.SerializeToArray(buf->data(), size);
+    assert(serialized_success);
+    return buf;
+}
+
 class ChannelSegment {
 public:
+  SIRIKATA_SST_POOLED_ALLOCATION(ChannelSegment)
 
+  // Shared with the Stream which generated the packet, mBuffer points into it
+  SegmentBufferPtr mData;
   uint8* mBuffer;
   uint16 mBufferLength;
   uint64 mChannelSequenceNumber;
@@ -310,18 +530,24 @@ public:
   Time mTransmitTime;
   Time mAckTime;
 
-  ChannelSegment( const void* data, int len, uint64 channelSeqNum, uint64 ackSequenceNum) :
-                                               mBufferLength(len),
+  // Delivery state of the connection when this segment was sent, used to
+  // compute delivery rate samples when it is acked
+  uint64 mDeliveredAtSend;
+  Time mDeliveredTimeAtSend;
+  // Number of acks received for segments sent after this one
+  uint16 mLaterAcks;
+
+  ChannelSegment( const SegmentBufferPtr& data, uint64 channelSeqNum, uint64 ackSequenceNum) :
+                                              mData(data),
+                                              mBuffer(data->data()),
+                                              mBufferLength(data->size()),
 					      mChannelSequenceNumber(channelSeqNum),
 					      mAckSequenceNumber(ackSequenceNum),
-					      mTransmitTime(Time::null()), mAckTime(Time::null())
+					      mTransmitTime(Time::null()), mAckTime(Time::null()),
+                                              mDeliveredAtSend(0),
+                                              mDeliveredTimeAtSend(Time::null()),
+                                              mLaterAcks(0)
   {
-    mBuffer = new uint8[len];
-    memcpy( mBuffer, (const uint8*) data, len);
-  }
-
-  ~ChannelSegment() {
-    delete [] mBuffer;
   }
 
   void setAckTime(Time& ackTime) {
@@ -359,6 +585,8 @@ private:
 
   ConnectionVariables<EndPointType>* mSSTConnVars;
   BaseDatagramLayerPtr mDatagramLayer;
+  // Strand this connection and its streams are serviced on
+  Network::IOStrand* mStrand;
 
   int mState;
   uint32 mRemoteChannelID;
@@ -383,16 +611,21 @@ private:
   std::deque< std::tr1::shared_ptr<ChannelSegment> > mOutstandingSegments;
   boost::mutex mOutstandingSegmentsMutex;
 
-  uint16 mCwnd;
-  int64 mRTOMicroseconds; // RTO in microseconds
-  bool mFirstRTO;
+  CongestionControl* mCongestion;
+  RTTEstimator mRTT;
+  // Total segments acked, and when the last one was, for delivery rate
+  // estimation
+  uint64 mDelivered;
+  Time mDeliveredTime;
+  // Losses of segments sent before this sequence number belong to an
+  // already-reported loss event
+  uint64 mRecoveryPoint;
 
   boost::mutex mQueueMutex;
 
   uint16 MAX_DATAGRAM_SIZE;
   uint16 MAX_PAYLOAD_SIZE;
   uint32 MAX_QUEUED_SEGMENTS;
-  float  CC_ALPHA;
   Time mLastTransmitTime;
 
   std::tr1::weak_ptr<Connection<EndPointType> > mWeakThis;
@@ -405,7 +638,7 @@ private:
 
   // We check periodically if all streams have been removed and clean
   // up the connection if they have.
-  Network::IOTimerPtr mCheckAliveTimer;
+  Network::WheelTimerPtr mCheckAliveTimer;
 
   // We can schedule servicing from multiple threads, so we need to
   // lock protect this data.
@@ -414,7 +647,7 @@ private:
   // time. Scheduling servicing only does something if nothing is scheduled yet
   // or if the time it's scheduled for is too late, in which case we update the
   // timer.
-  Network::IOTimerPtr mServiceTimer;
+  Network::WheelTimerPtr mServiceTimer;
   // Sometimes we do servicing directly, i.e. just a post. We need to
   // track this to make sure we don't double-schedule because the
   // timer expiry won't be meaningful in that case
@@ -436,8 +669,8 @@ private:
       }
       else if(!mIsAsyncServicing && mServiceTimer->expiresFromNow() > after) {
           needs_scheduling = true;
-          // No need to check success because we're using a strand and we can
-          // only get here if timer->expiresFromNow() is positive.
+          // No need to check success because we can only get here if the
+          // timer is still armed, i.e. timer->expiresFromNow() is positive.
           mServiceTimer->cancel();
       }
 
@@ -446,7 +679,7 @@ private:
           assert(mServiceStrongRef);
           if (after == Duration::zero()) {
               mIsAsyncServicing = true;
-              getContext()->mainStrand->post(
+              mStrand->post(
                   std::tr1::bind(&Connection<EndPointType>::serviceConnectionNoReturn, this),
                   "Connection<EndPointType>::serviceConnectionNoReturn"
               );
@@ -482,24 +715,25 @@ private:
     : mLocalEndPoint(localEndPoint), mRemoteEndPoint(remoteEndPoint),
       mSSTConnVars(sstConnVars),
       mDatagramLayer(sstConnVars->getDatagramLayer(localEndPoint.endPoint)),
+      mStrand(sstConnVars->strandFor(localEndPoint, getContext())),
       mState(CONNECTION_DISCONNECTED),
       mRemoteChannelID(0), mLocalChannelID(1), mTransmitSequenceNumber(1),
       mLastReceivedSequenceNumber(1),
-      mNumStreams(0), mCwnd(1), mRTOMicroseconds(2000000),
-      mFirstRTO(true),  MAX_DATAGRAM_SIZE(1000), MAX_PAYLOAD_SIZE(1300),
+      mNumStreams(0),
+      mCongestion(CongestionControl::create(sstConnVars->congestionControl())),
+      mDelivered(0), mDeliveredTime(Time::null()), mRecoveryPoint(0),
+      MAX_DATAGRAM_SIZE(1000), MAX_PAYLOAD_SIZE(1300),
       MAX_QUEUED_SEGMENTS(3000),
-      CC_ALPHA(0.8), mLastTransmitTime(Time::null()),
+      mLastTransmitTime(Time::null()),
       mNumInitialRetransmissionAttempts(0),
       mInSendingMode(true),
       mCheckAliveTimer(
-          Network::IOTimer::create(
-              getContext()->mainStrand
+          sstConnVars->timerWheelFor(mStrand)->createTimer(
               // Don't set callback yet, we need the shared_ptr to ourselves
           )
       ),
       mServiceTimer(
-          Network::IOTimer::create(
-              getContext()->mainStrand,
+          sstConnVars->timerWheelFor(mStrand)->createTimer(
               std::tr1::bind(&Connection<EndPointType>::serviceConnectionNoReturn, this)
           )
       ),
@@ -529,15 +763,19 @@ private:
   void sendSSTChannelPacket(Sirikata::Protocol::SST::SSTChannelHeader& sstMsg) {
     if (mState == CONNECTION_DISCONNECTED) return;
 
-    std::string buffer = serializePBJMessage(sstMsg);
-    mDatagramLayer->send(&mLocalEndPoint, &mRemoteEndPoint, (void*) buffer.data(),
-				       buffer.size());
+    SegmentBufferPtr buffer = serializeToSegment(sstMsg);
+    mDatagramLayer->send(&mLocalEndPoint, &mRemoteEndPoint, (void*) buffer->data(),
+				       buffer->size());
   }
 
   const Context* getContext() {
     return mDatagramLayer->context();
   }
 
+  Network::IOStrand* getStrand() {
+    return mStrand;
+  }
+
   void serviceConnectionNoReturn() {
       serviceConnection();
   }
@@ -601,9 +839,19 @@ private:
       // data. The correctness of the servicing depends on this since
       // you need to pass through the loop below at least once to
       // adjust some properties (e.g. sending mode).
-      assert( !mQueuedSegments.empty() && mOutstandingSegments.size() <= mCwnd);
+      assert( !mQueuedSegments.empty() );
+
+      // The window can shrink between scheduling servicing and getting
+      // here, e.g. when a later ack reports a loss. Then we're really
+      // waiting for acks, so leave sending mode and fall back to the
+      // retransmission timeout like we would after filling the window.
+      if (!mCongestion->hasRoom(mOutstandingSegments.size())) {
+          mInSendingMode = false;
+          scheduleConnectionService(mRTT.rto());
+          return true;
+      }
 
-      for (int i = 0; (!mQueuedSegments.empty()) && mOutstandingSegments.size() <= mCwnd; i++) {
+      for (int i = 0; (!mQueuedSegments.empty()) && mCongestion->hasRoom(mOutstandingSegments.size()); i++) {
 	  std::tr1::shared_ptr<ChannelSegment> segment = mQueuedSegments.front();
 
 	  Sirikata::Protocol::SST::SSTChannelHeader sstMsg;
@@ -621,6 +869,9 @@ private:
 	  sendSSTChannelPacket(sstMsg);
 
 	  segment->mTransmitTime = curTime;
+	  segment->mDeliveredAtSend = mDelivered;
+	  segment->mDeliveredTimeAtSend = (mDeliveredTime == Time::null()) ? curTime : mDeliveredTime;
+	  segment->mLaterAcks = 0;
 	  mOutstandingSegments.push_back(segment);
 
 	  mLastTransmitTime = curTime;
@@ -674,12 +925,12 @@ private:
           // Use numattempts - 1 because we've already incremented
           // here. This way we start out with a factor of 2^0 = 1
           // instead of a factor of 2^1 = 2.
-          scheduleConnectionService(Duration::microseconds(mRTOMicroseconds*pow(2.0,(mNumInitialRetransmissionAttempts-1))));
+          scheduleConnectionService(mRTT.rto() * pow(2.0,(mNumInitialRetransmissionAttempts-1)));
       }
       else {
-          // Otherwise, just wait the expected RTT time, plus more to
-          // account for jitter.
-          scheduleConnectionService(Duration::microseconds(mRTOMicroseconds*2));
+          // Otherwise, wait for the retransmission timeout, which
+          // accounts for RTT variance.
+          scheduleConnectionService(mRTT.rto());
       }
     }
     else {
@@ -702,9 +953,9 @@ private:
         // Otherwise, adjust the congestion window if we have
         // oustanding packets left.
         if (mOutstandingSegments.size() > 0) {
-            mCwnd /= 2;
-            if (mCwnd < 1)
-                mCwnd = 1;
+            mCongestion->onTimeout(curTime);
+            mRTT.backoff();
+            mRecoveryPoint = mTransmitSequenceNumber;
 
             mOutstandingSegments.clear();
         }
@@ -771,11 +1022,12 @@ private:
 			       StreamReturnCallbackFunction scb)
 
   {
-    boost::mutex::scoped_lock lock(sstConnVars->sStaticMembersLock.getMutex());
+    typename ConnectionVariables<EndPointType>::ConnectionShard& shard = sstConnVars->shardFor(localEndPoint);
+    boost::mutex::scoped_lock lock(shard.lock.getMutex());
 
-    ConnectionMap& connectionMap = sstConnVars->sConnectionMap;
+    ConnectionMap& connectionMap = shard.connections;
     if (connectionMap.find(localEndPoint) != connectionMap.end()) {
-      SST_LOG(warn, "sConnectionMap.find failed for " << localEndPoint.endPoint.toString() << "\n");
+      SST_LOG(warn, "connection map lookup failed for " << localEndPoint.endPoint.toString() << "\n");
 
       return false;
     }
@@ -789,7 +1041,7 @@ private:
                        new Connection(sstConnVars, localEndPoint, remoteEndPoint));
 
     connectionMap[localEndPoint] = conn;
-    sstConnVars->sConnectionReturnCallbackMap[localEndPoint] = cb;
+    shard.returnCallbacks[localEndPoint] = cb;
 
     lock.unlock();
 
@@ -891,11 +1143,22 @@ private:
   uint64 sendDataWithAutoAck(const void* data, uint32 length, bool isAck) {
       return sendData(data, length, isAck, mLastReceivedSequenceNumber);
   }
+  uint64 sendDataWithAutoAck(const SegmentBufferPtr& data, bool isAck) {
+      return sendData(data, isAck, mLastReceivedSequenceNumber);
+  }
 
   // Explicit version, used when acking direct response to a packet
   uint64 sendData(const void* data, uint32 length, bool isAck, uint64 ack_seqno) {
+      return sendData(SegmentBufferPtr(SegmentBuffer::create(data, length)), isAck, ack_seqno);
+  }
+
+  // Queues the serialized stream packet for transmission. The buffer is
+  // referenced, not copied, by the queued ChannelSegment.
+  uint64 sendData(const SegmentBufferPtr& segment_data, bool isAck, uint64 ack_seqno) {
     boost::mutex::scoped_lock lock(mQueueMutex);
 
+    const void* data = segment_data->data();
+    uint32 length = segment_data->size();
     assert(length <= MAX_PAYLOAD_SIZE);
 
     uint64 transmitSequenceNumber =  mTransmitSequenceNumber;
@@ -914,13 +1177,13 @@ private:
     else {
       if (mQueuedSegments.size() < MAX_QUEUED_SEGMENTS) {
         mQueuedSegments.push_back( std::tr1::shared_ptr<ChannelSegment>(
-                                   new ChannelSegment(data, length, mTransmitSequenceNumber, ack_seqno) ) );
+                                   new ChannelSegment(segment_data, mTransmitSequenceNumber, ack_seqno) ) );
         // Only service if we're going to be able to send
         // immediately. Otherwise, we must already have outstanding
         // packets waiting for a timeout, in which case this new
         // packet will be dealt with as the existing servicing cycle
         // completes.
-        if (mOutstandingSegments.size() <= mCwnd) {
+        if (mCongestion->hasRoom(mOutstandingSegments.size())) {
             mInSendingMode = true;
             scheduleConnectionService();
         }
@@ -968,43 +1231,68 @@ private:
   void markAcknowledgedPacket(uint64 receivedAckNum) {
     boost::mutex::scoped_lock lock(mOutstandingSegmentsMutex);
 
-    for (std::deque< std::tr1::shared_ptr<ChannelSegment> >::iterator it = mOutstandingSegments.begin();
-         it != mOutstandingSegments.end(); it++)
-    {
-        std::tr1::shared_ptr<ChannelSegment> segment = *it;
+    // Segments are outstanding in the order they were sent, so everything
+    // before the acked segment was sent earlier. Each ack is selective, so
+    // an earlier segment which has seen enough later acks has almost
+    // certainly been lost and shouldn't hold up the window until a timeout.
+    typedef std::deque< std::tr1::shared_ptr<ChannelSegment> > SegmentDeque;
+    uint32 acked_idx = 0;
+    while(acked_idx < mOutstandingSegments.size()) {
+        const std::tr1::shared_ptr<ChannelSegment>& seg = mOutstandingSegments[acked_idx];
+        if (seg && seg->mChannelSequenceNumber == receivedAckNum)
+            break;
+        acked_idx++;
+    }
+    if (acked_idx == mOutstandingSegments.size())
+        return;
 
-        if (!segment) {
-          mOutstandingSegments.erase(it);
-          it = mOutstandingSegments.begin();
-          continue;
+    std::tr1::shared_ptr<ChannelSegment> segment = mOutstandingSegments[acked_idx];
+    const Time curTime = Timer::now();
+    segment->mAckTime = curTime;
+    mRTT.sample(segment->mAckTime - segment->mTransmitTime);
+
+    // Rebuild the outstanding list without the acked segment and any
+    // segments now considered lost.
+    bool lost_segment = false;
+    SegmentDeque remaining;
+    for (uint32 i = 0; i < mOutstandingSegments.size(); i++) {
+        const std::tr1::shared_ptr<ChannelSegment>& seg = mOutstandingSegments[i];
+        if (i == acked_idx || !seg) continue;
+        if (i < acked_idx && ++(seg->mLaterAcks) >= SST_FAST_RETRANSMIT_THRESHOLD) {
+            if (seg->mChannelSequenceNumber >= mRecoveryPoint)
+                lost_segment = true;
+            continue;
         }
+        remaining.push_back(seg);
+    }
+    mOutstandingSegments.swap(remaining);
 
-        if (segment->mChannelSequenceNumber == receivedAckNum) {
-          segment->mAckTime = Timer::now();
-
-          if (mFirstRTO ) {
-	         mRTOMicroseconds = ((segment->mAckTime - segment->mTransmitTime).toMicroseconds()) ;
-	         mFirstRTO = false;
-          }
-          else {
-            mRTOMicroseconds = CC_ALPHA * mRTOMicroseconds +
-              (1.0-CC_ALPHA) * (segment->mAckTime - segment->mTransmitTime).toMicroseconds();
-          }
-
-          mOutstandingSegments.erase(it);
+    mDelivered++;
+    mDeliveredTime = curTime;
 
-          if (rand() % mCwnd == 0)
-            mCwnd += 1;
+    if (lost_segment) {
+        mCongestion->onLoss(curTime);
+        mRecoveryPoint = mTransmitSequenceNumber;
+    }
 
-          // We freed up some space in the window. If we have
-          // something left to send, trigger servicing.
-          if (!mQueuedSegments.empty()) {
-              mInSendingMode = true;
-              scheduleConnectionService();
-          }
+    CongestionControl::AckSample sample;
+    sample.now = curTime;
+    sample.rtt = segment->mAckTime - segment->mTransmitTime;
+    sample.min_rtt = mRTT.minRTT();
+    sample.delivery_rate = 0;
+    Duration delivery_interval = curTime - segment->mDeliveredTimeAtSend;
+    if (delivery_interval > Duration::zero())
+        sample.delivery_rate = (mDelivered - segment->mDeliveredAtSend) / delivery_interval.toSeconds();
+    sample.in_flight = mOutstandingSegments.size();
+    mCongestion->onAck(sample);
 
-          break;
-        }
+    // If that freed up space in the window and we have something left
+    // to send, trigger servicing. A loss can leave the window smaller
+    // than what's still outstanding, in which case later acks or the
+    // retransmission timeout will get us sending again.
+    if (!mQueuedSegments.empty() && mCongestion->hasRoom(mOutstandingSegments.size())) {
+        mInSendingMode = true;
+        scheduleConnectionService();
     }
   }
 
@@ -1222,6 +1510,23 @@ private:
     Sirikata::Protocol::SST::SSTChannelHeader* received_msg =
                        new Sirikata::Protocol::SST::SSTChannelHeader();
     bool parsed = parsePBJMessage(received_msg, MemoryReference(recv_buff, len));
+
+    // Packets arrive on whatever thread the datagram layer uses, but all
+    // processing for this connection happens on its strand. This runs
+    // immediately if we're already there. Hold a reference so we survive
+    // until the message is handled.
+    ConnectionPtr conn = mWeakThis.lock();
+    if (!conn) {
+        receiveMessage(received_msg);
+        delete received_msg;
+        return;
+    }
+    mStrand->dispatch(
+        std::tr1::bind(&Connection<EndPointType>::receiveOwnedMessage, this, conn, received_msg),
+        "Connection<EndPointType>::receiveOwnedMessage"
+    );
+  }
+  void receiveOwnedMessage(ConnectionPtr conn, Sirikata::Protocol::SST::SSTChannelHeader* received_msg) {
     receiveMessage(received_msg);
     delete received_msg;
   }
@@ -1247,10 +1552,11 @@ private:
 
       sendData(received_payload, 0, false, ack_seqno);
 
-      boost::mutex::scoped_lock lock(mSSTConnVars->sStaticMembersLock.getMutex());
+      typename ConnectionVariables<EndPointType>::ConnectionShard& shard = mSSTConnVars->shardFor(mLocalEndPoint);
+      boost::mutex::scoped_lock lock(shard.lock.getMutex());
 
-      ConnectionReturnCallbackMap& connectionReturnCallbackMap = mSSTConnVars->sConnectionReturnCallbackMap;
-      ConnectionMap& connectionMap = mSSTConnVars->sConnectionMap;
+      ConnectionReturnCallbackMap& connectionReturnCallbackMap = shard.returnCallbacks;
+      ConnectionMap& connectionMap = shard.connections;
 
       if (connectionReturnCallbackMap.find(mLocalEndPoint) != connectionReturnCallbackMap.end())
       {
@@ -1283,7 +1589,7 @@ private:
   }
 
   uint64 getRTOMicroseconds() {
-    return mRTOMicroseconds;
+    return mRTT.rto().toMicroseconds();
   }
 
   void eraseDisconnectedStream(Stream<EndPointType>* s) {
@@ -1312,10 +1618,11 @@ private:
       //This is in contrast to the case where the connection got connected, but
       //the connection's root stream was unable to do so.
 
-       boost::mutex::scoped_lock lock(conn->mSSTConnVars->sStaticMembersLock.getMutex());
+       typename ConnectionVariables<EndPointType>::ConnectionShard& shard = conn->mSSTConnVars->shardFor(conn->localEndPoint());
+       boost::mutex::scoped_lock lock(shard.lock.getMutex());
        ConnectionReturnCallbackFunction cb = NULL;
 
-       ConnectionReturnCallbackMap& connectionReturnCallbackMap = conn->mSSTConnVars->sConnectionReturnCallbackMap;
+       ConnectionReturnCallbackMap& connectionReturnCallbackMap = shard.returnCallbacks;
        if (connectionReturnCallbackMap.find(conn->localEndPoint()) != connectionReturnCallbackMap.end()) {
          cb = connectionReturnCallbackMap[conn->localEndPoint()];
        }
@@ -1323,7 +1630,7 @@ private:
        std::tr1::shared_ptr<Connection>  failed_conn = conn;
 
        connectionReturnCallbackMap.erase(conn->localEndPoint());
-       conn->mSSTConnVars->sConnectionMap.erase(conn->localEndPoint());
+       shard.connections.erase(conn->localEndPoint());
 
        lock.unlock();
 
@@ -1338,7 +1645,7 @@ private:
 
    // This version should only be called by the destructor!
    void finalCleanup() {
-     boost::mutex::scoped_lock lock(mSSTConnVars->sStaticMembersLock.getMutex());
+     boost::mutex::scoped_lock lock(mSSTConnVars->shardFor(mLocalEndPoint).lock.getMutex());
 
      mDatagramLayer->unlisten(mLocalEndPoint);
 
@@ -1352,39 +1659,46 @@ private:
 
    static void stopConnections(ConnectionVariables<EndPointType>* sstConnVars) {
        // This just passes stop calls along to all the connections
-       boost::mutex::scoped_lock lock(sstConnVars->sStaticMembersLock.getMutex());
-       for(typename ConnectionMap::iterator it = sstConnVars->sConnectionMap.begin(); it != sstConnVars->sConnectionMap.end(); it++)
-           it->second->stop();
+       for(uint32 i = 0; i < SST_CONNECTION_SHARDS; i++) {
+           typename ConnectionVariables<EndPointType>::ConnectionShard& shard = sstConnVars->sConnectionShards[i];
+           boost::mutex::scoped_lock lock(shard.lock.getMutex());
+           for(typename ConnectionMap::iterator it = shard.connections.begin(); it != shard.connections.end(); it++)
+               it->second->stop();
+       }
    }
 
    static void closeConnections(ConnectionVariables<EndPointType>* sstConnVars) {
        // We have to be careful with this function. Because it is going to free
        // the connections, we have to make sure not to let them get freed where
-       // the deleter will modify sConnectionMap while we're still modifying it.
+       // the deleter will modify the connection maps while we're still
+       // modifying them.
        //
        // Our approach is to just pick out the first connection, make a copy of
        // its shared_ptr to make sure it doesn't get freed until we want it to,
-       // remove it from sConnectionMap, and then get rid of the shared_ptr to
+       // remove it from its shard's map, and then get rid of the shared_ptr to
        // allow the connection to be freed.
        //
        // Note the careful locking. Connection::~Connection will acquire the
-       // sStaticMembersLock, so to avoid deadlocking we grab the shared_ptr,
+       // shard's lock, so to avoid deadlocking we grab the shared_ptr,
        // remove it from the list and then only allow the Connection to be
        // destroyed after we've unlocked.
-       while(true) {
-           ConnectionPtr saved;
-           {
-               boost::mutex::scoped_lock lock(sstConnVars->sStaticMembersLock.getMutex());
-               if (sstConnVars->sConnectionMap.empty()) break;
-               ConnectionMap& connectionMap = sstConnVars->sConnectionMap;
-
-               saved = connectionMap.begin()->second;
-               connectionMap.erase(connectionMap.begin());
+       for(uint32 i = 0; i < SST_CONNECTION_SHARDS; i++) {
+           typename ConnectionVariables<EndPointType>::ConnectionShard& shard = sstConnVars->sConnectionShards[i];
+           while(true) {
+               ConnectionPtr saved;
+               {
+                   boost::mutex::scoped_lock lock(shard.lock.getMutex());
+                   if (shard.connections.empty()) break;
+                   ConnectionMap& connectionMap = shard.connections;
+
+                   saved = connectionMap.begin()->second;
+                   connectionMap.erase(connectionMap.begin());
+               }
+               // Calling close makes sure we kill the check alive timer,
+               // which holds a shared_ptr.
+               saved->close(false);
+               saved.reset();
            }
-           // Calling close makes sure we kill the check alive timer,
-           // which holds a shared_ptr.
-           saved->close(false);
-           saved.reset();
        }
    }
 
@@ -1397,27 +1711,55 @@ private:
 
      uint8 channelID = received_msg->channel_id();
 
-     boost::mutex::scoped_lock lock(sstConnVars->sStaticMembersLock.getMutex());
+     typename ConnectionVariables<EndPointType>::ConnectionShard& shard = sstConnVars->shardFor(localEndPoint);
+     boost::mutex::scoped_lock lock(shard.lock.getMutex());
 
-     ConnectionMap& connectionMap = sstConnVars->sConnectionMap;
+     ConnectionMap& connectionMap = shard.connections;
      if (connectionMap.find(localEndPoint) != connectionMap.end()) {
        if (channelID == 0) {
  	/*Someone's already connected at this port. Either don't reply or
  	  send back a request rejected message. */
 
         SST_LOG(info, "Someone's already connected at this port on object " << localEndPoint.endPoint.toString() << "\n");
+        delete received_msg;
  	return;
        }
        std::tr1::shared_ptr<Connection<EndPointType> > conn = connectionMap[localEndPoint];
 
+       if (sstConnVars->usesConnectionStrands()) {
+         // The connection may be busy on its own strand, so the message has
+         // to be handled there. It takes ownership of received_msg.
+         lock.unlock();
+         conn->mStrand->dispatch(
+             std::tr1::bind(&Connection<EndPointType>::receiveOwnedMessage, conn.get(), conn, received_msg),
+             "Connection<EndPointType>::receiveOwnedMessage"
+         );
+         return;
+       }
+
        conn->receiveMessage(received_msg);
      }
      else if (channelID == 0) {
        /* it's a new channel request negotiation protocol
  	        packet ; allocate a new channel.*/
 
-       StreamReturnCallbackMap& listeningConnectionsCallbackMap = sstConnVars->sListeningConnectionsCallbackMap;
-       if (listeningConnectionsCallbackMap.find(localEndPoint) != listeningConnectionsCallbackMap.end()) {
+       // The new connection lives in a different shard, and the listener
+       // map has its own lock, so we don't need this shard anymore.
+       lock.unlock();
+
+       StreamReturnCallbackFunction listeningCallback;
+       bool listening = false;
+       {
+         boost::mutex::scoped_lock listen_lock(sstConnVars->sStaticMembersLock.getMutex());
+         StreamReturnCallbackMap& listeningConnectionsCallbackMap = sstConnVars->sListeningConnectionsCallbackMap;
+         typename StreamReturnCallbackMap::iterator listen_it = listeningConnectionsCallbackMap.find(localEndPoint);
+         if (listen_it != listeningConnectionsCallbackMap.end()) {
+           listening = true;
+           listeningCallback = listen_it->second;
+         }
+       }
+
+       if (listening) {
          uint32* received_payload = (uint32*) received_msg->payload().data();
 
          uint32 payload[2];
@@ -1435,9 +1777,12 @@ private:
                          new Connection(sstConnVars, newLocalEndPoint, remoteEndPoint));
 
 
-         conn->listenStream(newLocalEndPoint.port, listeningConnectionsCallbackMap[localEndPoint]);
+         conn->listenStream(newLocalEndPoint.port, listeningCallback);
          conn->setWeakThis(conn);
-         connectionMap[newLocalEndPoint] = conn;
+         {
+           boost::mutex::scoped_lock new_lock(sstConnVars->shardFor(newLocalEndPoint).lock.getMutex());
+           sstConnVars->shardFor(newLocalEndPoint).connections[newLocalEndPoint] = conn;
+         }
 
          conn->setLocalChannelID(availableChannel);
          if (received_msg->payload().size()>=sizeof(uint32)) {
@@ -1460,6 +1805,7 @@ private:
    virtual ~Connection() {
        // Make sure we've fully cleaned up
        finalCleanup();
+       delete mCongestion;
    }
 
 
@@ -1535,16 +1881,14 @@ private:
 
             sstMsg.set_payload( ((uint8*)data)+currOffset, buffLen);
 
-            std::string buffer = serializePBJMessage(sstMsg);
-
-            // If we're not within the payload size, we need to
-            // increase our buffer space and try again
-            if (buffer.size() > MAX_PAYLOAD_SIZE) {
+            // Check the size before serializing so oversized attempts
+            // don't cost a buffer
+            if ((uint32)sstMsg.ByteSize() > MAX_PAYLOAD_SIZE) {
                 header_buffer += 10;
                 continue;
             }
 
-            sendDataWithAutoAck(  buffer.data(), buffer.size(), false );
+            sendDataWithAutoAck( serializeToSegment(sstMsg), false );
 
             currOffset += buffLen;
             // If we got to the send, we can break out of the loop
@@ -1622,12 +1966,12 @@ private:
              remote end point.
   */
   virtual void close(bool force) {
-      boost::mutex::scoped_lock lock(mSSTConnVars->sStaticMembersLock.getMutex());
+      boost::mutex::scoped_lock lock(mSSTConnVars->shardFor(mLocalEndPoint).lock.getMutex());
       iClose(force);
   }
 
   /* Internal, non-locking implementation of close().
-     Lock mSSTConnVars->sStaticMembersLock before calling this function */
+     Lock this connection's shard in mSSTConnVars before calling this function */
   virtual void iClose(bool force) {
       // We kill the checkAlive timer in cleanup() and in close()
       // because both paths appear to be possible to hit alone
@@ -1637,7 +1981,7 @@ private:
     /* (mState != CONNECTION_DISCONNECTED) implies close() wasnt called
        through the destructor. */
     if (force && mState != CONNECTION_DISCONNECTED) {
-      mSSTConnVars->sConnectionMap.erase(mLocalEndPoint);
+      mSSTConnVars->shardFor(mLocalEndPoint).connections.erase(mLocalEndPoint);
     }
 
     if (force) {
@@ -1673,29 +2017,36 @@ private:
 
 class StreamBuffer{
 public:
+  SIRIKATA_SST_POOLED_ALLOCATION(StreamBuffer)
 
+  SegmentBufferPtr mData;
   uint8* mBuffer;
   uint32 mBufferLength;
   uint64 mOffset;
 
   Time mTransmitTime;
   Time mAckTime;
+  // Number of acks received for buffers sent after this one
+  uint16 mLaterAcks;
 
   StreamBuffer(const uint8* data, uint32 len, uint64 offset) :
-    mTransmitTime(Time::null()), mAckTime(Time::null())
+    mData(SegmentBuffer::create(data, len)),
+    mBuffer(mData->data()),
+    mBufferLength(len),
+    mOffset(offset),
+    mTransmitTime(Time::null()), mAckTime(Time::null()),
+    mLaterAcks(0)
   {
-    mBuffer = new uint8[len+1];
-
-    if (len > 0) {
-      memcpy(mBuffer,data,len);
-    }
-
-    mBufferLength = len;
-    mOffset = offset;
   }
 
-  ~StreamBuffer() {
-      delete []mBuffer;
+  StreamBuffer(const SegmentBufferPtr& data, uint64 offset) :
+    mData(data),
+    mBuffer(mData->data()),
+    mBufferLength(mData->size()),
+    mOffset(offset),
+    mTransmitTime(Time::null()), mAckTime(Time::null()),
+    mLaterAcks(0)
+  {
   }
 
     // This doesn't check the data, just that the StreamBuffers
@@ -2047,20 +2398,50 @@ public:
              occurred
   */
   virtual int writev(const struct iovec* vec, int count) {
-    int totalBytesWritten = 0;
-
-    for (int i=0; i < count; i++) {
-      int numWritten = write( (const uint8*) vec[i].iov_base, vec[i].iov_len);
+    if (mState == DISCONNECTED || mState == PENDING_DISCONNECT) {
+      return -1;
+    }
 
-      if (numWritten < 0) return -1;
+    boost::mutex::scoped_lock lock(mQueueMutex);
+    bool was_empty = mQueuedBuffers.empty();
 
-      totalBytesWritten += numWritten;
+    // Pack the iovecs into as few MAX_PAYLOAD_SIZE buffers as
+    // possible, copying each byte once, instead of queuing (at least)
+    // one buffer per iovec.
+    MemoryReference pieces[SST_WRITEV_MAX_PIECES];
+    int totalBytesWritten = 0;
+    int vec_idx = 0;
+    uint32 vec_offset = 0;
+    while(vec_idx < count) {
+      uint32 buffLen = 0;
+      uint32 npieces = 0;
+      while(vec_idx < count && buffLen < MAX_PAYLOAD_SIZE && npieces < SST_WRITEV_MAX_PIECES) {
+        uint32 avail = vec[vec_idx].iov_len - vec_offset;
+        uint32 take = std::min(avail, (uint32)MAX_PAYLOAD_SIZE - buffLen);
+        pieces[npieces++] = MemoryReference((const uint8*)vec[vec_idx].iov_base + vec_offset, take);
+        buffLen += take;
+        vec_offset += take;
+        if (vec_offset == vec[vec_idx].iov_len) {
+          vec_idx++;
+          vec_offset = 0;
+        }
+      }
 
-      if (numWritten == 0) {
-	return totalBytesWritten;
+      if (buffLen == 0) continue;
+      if (mCurrentQueueLength + buffLen > MAX_QUEUE_LENGTH) {
+        break;
       }
+
+      SegmentBufferPtr data(SegmentBuffer::gather(pieces, npieces));
+      mQueuedBuffers.push_back( std::tr1::shared_ptr<StreamBuffer>(new StreamBuffer(data, mNumBytesSent)) );
+      mCurrentQueueLength += buffLen;
+      mNumBytesSent += buffLen;
+      totalBytesWritten += buffLen;
     }
 
+    if (was_empty && totalBytesWritten > 0)
+      scheduleStreamService();
+
     return totalBytesWritten;
   }
 #endif
@@ -2234,9 +2615,6 @@ private:
     MAX_PAYLOAD_SIZE(1000),
     MAX_QUEUE_LENGTH(4000000),
     MAX_RECEIVE_WINDOW(GetOptionValue<uint32>(OPT_SST_DEFAULT_WINDOW_SIZE)),
-    mFirstRTO(true),
-    mStreamRTOMicroseconds(2000000),
-    FL_ALPHA(0.8),
     mTransmitWindowSize(MAX_RECEIVE_WINDOW),
     mReceiveWindowSize(MAX_RECEIVE_WINDOW),
     mNumOutstandingBytes(0),
@@ -2248,15 +2626,14 @@ private:
     mConnected (false),
     MAX_INIT_RETRANSMISSIONS(5),
     mSSTConnVars(sstConnVars),
+    mStrand(conn.lock()->getStrand()),
       mKeepAliveTimer(
-          Network::IOTimer::create(
-              getContext()->mainStrand
+          sstConnVars->timerWheelFor(mStrand)->createTimer(
               // Can't create callback yet because we need mWeathThis
           )
       ),
       mServiceTimer(
-          Network::IOTimer::create(
-              getContext()->mainStrand,
+          sstConnVars->timerWheelFor(mStrand)->createTimer(
               std::tr1::bind(&Stream<EndPointType>::serviceStreamNoReturn, this)
           )
       ),
@@ -2452,14 +2829,14 @@ private:
       }
     }
     else {
-        //if the stream has been waiting for an ACK for > 2*mStreamRTOMicroseconds,
+        //if the stream has been waiting for an ACK for longer than the RTO,
         //resend the unacked packets. We don't actually check if we
         //have anything to ack here, that happens in resendUnackedPackets. Also,
         //'resending' really just means sticking them back at the front of
         //mQueuedBuffers, so the code that follows and actually sends data will
         //ensure that we trigger a re-servicing sometime in the future.
         if ( mLastSendTime != Time::null()
-             && (curTime - mLastSendTime).toMicroseconds() > 2*mStreamRTOMicroseconds)
+             && (curTime - mLastSendTime) > mRTT.rto())
         {
             resendUnackedPackets();
             mLastSendTime = curTime;
@@ -2506,6 +2883,7 @@ private:
 					    buffer->mOffset
 					    );
           buffer->mTransmitTime = curTime;
+          buffer->mLaterAcks = 0;
           sentSomething = true;
 
           // On the first send (or during a resend where we get a new
@@ -2532,8 +2910,8 @@ private:
             // started, make sure we target the exact time, adjusting
             // for already elapsed time since the last received
             // packet.
-            assert(Duration::microseconds(2*mStreamRTOMicroseconds) >= (curTime - mLastSendTime));
-            Duration timeout = Duration::microseconds(2*mStreamRTOMicroseconds) - (curTime - mLastSendTime);
+            assert(mRTT.rto() >= (curTime - mLastSendTime));
+            Duration timeout = mRTT.rto() - (curTime - mLastSendTime);
             scheduleStreamService(timeout);
         }
     }
@@ -2570,9 +2948,7 @@ private:
     // If we're failing to get acks, we might be estimating the RTT
     // too low. To make sure it eventually updates, increase it.
     if (!mWaitingForAcks.empty()) {
-      if (mStreamRTOMicroseconds < 20000000) {
-        mStreamRTOMicroseconds *= 2;
-      }
+      mRTT.backoff();
       // Also clear out the list of buffers waiting for acks since
       // they've timed out. They've been saved to the graveyard in
       // case we eventually get an ack back.
@@ -2595,6 +2971,7 @@ private:
 
       uint8* recv_buf = receiveBuffer();
       mReadCallback(recv_buf, readyBufferSize);
+      SegmentBufferPool::recordDelivered(readyBufferSize);
 
       //now move the window forward...
       mLastContiguousByteReceived = mLastContiguousByteReceived + readyBufferSize;
@@ -2774,7 +3151,10 @@ private:
         // graveyard, we'd end up never clearing these bytes because
         // the newer channel ID becomes unackable (no more reference
         // to them).
-        mNumOutstandingBytes -= acked_buffer->mBufferLength;
+        if (mNumOutstandingBytes >= acked_buffer->mBufferLength)
+            mNumOutstandingBytes -= acked_buffer->mBufferLength;
+        else
+            mNumOutstandingBytes = 0;
 
         // These operations only work during a normal ack because the
         // info is either inaccurate (transmit and ack times from
@@ -2783,6 +3163,10 @@ private:
         if (normal_ack) {
             updateRTO(acked_buffer->mTransmitTime, acked_buffer->mAckTime);
 
+            // Before working out the window, so bytes given up as lost
+            // don't count as outstanding
+            fastRetransmit(channelSegmentID);
+
             if ( (int) (pow(2.0, streamMsg->window()) - mNumOutstandingBytes) > 0 ) {
                 assert( pow(2.0, streamMsg->window()) - mNumOutstandingBytes > 0);
                 mTransmitWindowSize = pow(2.0, streamMsg->window()) - mNumOutstandingBytes;
@@ -2830,16 +3214,41 @@ private:
       return;
     }
 
-    if (mFirstRTO) {
-      mStreamRTOMicroseconds = (sampleEndTime - sampleStartTime).toMicroseconds() ;
-      mFirstRTO = false;
-    }
-    else {
+    mRTT.sample(sampleEndTime - sampleStartTime);
+  }
 
-      mStreamRTOMicroseconds = FL_ALPHA * mStreamRTOMicroseconds +
-	(1.0-FL_ALPHA) * (sampleEndTime - sampleStartTime).toMicroseconds();
+  /* Acks are selective, so when a buffer is acked, any buffer sent before it
+     which is still waiting has been passed over. Once a buffer has been
+     passed over by enough acks it is almost certainly lost, so requeue it
+     immediately instead of waiting for the whole window to time out.
+     mQueueMutex must be locked before calling this function. */
+  void fastRetransmit(uint64 ackedChannelSegmentID) {
+    std::vector<uint64> lostChannelIDs;
+    for(typename ChannelToBufferMap::iterator it = mWaitingForAcks.begin();
+        it != mWaitingForAcks.end() && it->first < ackedChannelSegmentID; it++)
+    {
+        it->second->mLaterAcks++;
+        if (it->second->mLaterAcks == SST_FAST_RETRANSMIT_THRESHOLD)
+            lostChannelIDs.push_back(it->first);
     }
+    if (lostChannelIDs.empty()) return;
+
+    // Requeue in their original order, ahead of new data
+    for(std::vector<uint64>::reverse_iterator it = lostChannelIDs.rbegin(); it != lostChannelIDs.rend(); it++) {
+        StreamBufferPtr buffer = mWaitingForAcks[*it];
+        mWaitingForAcks.erase(*it);
+        // Keep the old channel ID in case the original does get acked
+        mUnackedGraveyard[*it] = buffer;
 
+        mQueuedBuffers.push_front(buffer);
+        mCurrentQueueLength += buffer->mBufferLength;
+        if (mNumOutstandingBytes >= buffer->mBufferLength)
+            mNumOutstandingBytes -= buffer->mBufferLength;
+        else
+            mNumOutstandingBytes = 0;
+    }
+    // The window is left alone: the retransmits go out when the receiver
+    // has room for them, like any other data
   }
 
   void sendInitPacket(void* data, uint32 len) {
@@ -2857,16 +3266,16 @@ private:
 
     sstMsg.set_payload(data, len);
 
-    std::string buffer = serializePBJMessage(sstMsg);
+    SegmentBufferPtr buffer = serializeToSegment(sstMsg);
 
 
     std::tr1::shared_ptr<Connection<EndPointType> > conn = mConnection.lock();
 
     if (!conn) return;
 
-    conn->sendDataWithAutoAck( buffer.data(), buffer.size(), false );
+    conn->sendDataWithAutoAck( buffer, false );
 
-    scheduleStreamService(Duration::microseconds(pow(2.0,mNumInitRetransmissions)*mStreamRTOMicroseconds));
+    scheduleStreamService(mRTT.rto() * pow(2.0,mNumInitRetransmissions));
   }
 
   void sendAckPacket(uint64 ack_seqno) {
@@ -2877,13 +3286,13 @@ private:
     sstMsg.set_window( log((double)mReceiveWindowSize)/log(2.0)  );
     sstMsg.set_src_port(mLocalPort);
     sstMsg.set_dest_port(mRemotePort);
-    std::string buffer = serializePBJMessage(sstMsg);
+    SegmentBufferPtr buffer = serializeToSegment(sstMsg);
 
     //printf("Sending Ack packet with window %d\n", (int)sstMsg.window());
 
     std::tr1::shared_ptr<Connection<EndPointType> > conn = mConnection.lock();
     assert(conn);
-    conn->sendData(buffer.data(), buffer.size(), true, ack_seqno);
+    conn->sendData(buffer, true, ack_seqno);
   }
 
   uint64 sendDataPacket(const void* data, uint32 len, uint64 offset) {
@@ -2899,11 +3308,11 @@ private:
 
     sstMsg.set_payload(data, len);
 
-    std::string buffer = serializePBJMessage(sstMsg);
+    SegmentBufferPtr buffer = serializeToSegment(sstMsg);
 
     std::tr1::shared_ptr<Connection<EndPointType> > conn = mConnection.lock();
     assert(conn);
-    return conn->sendDataWithAutoAck(  buffer.data(), buffer.size(), false);
+    return conn->sendDataWithAutoAck( buffer, false);
   }
 
   // Reply packets should be in repsonse to other side initiating connection, so
@@ -2921,11 +3330,11 @@ private:
     sstMsg.set_bsn(0);
 
     sstMsg.set_payload(data, len);
-    std::string buffer = serializePBJMessage(sstMsg);
+    SegmentBufferPtr buffer = serializeToSegment(sstMsg);
 
     std::tr1::shared_ptr<Connection<EndPointType> > conn = mConnection.lock();
     assert(conn);
-    conn->sendData(  buffer.data(), buffer.size(), false, ack_seqno);
+    conn->sendData( buffer, false, ack_seqno);
   }
 
   uint8 mState;
@@ -2978,9 +3387,7 @@ private:
 
   boost::mutex mQueueMutex;
 
-  bool mFirstRTO;
-  int64 mStreamRTOMicroseconds;
-  float FL_ALPHA;
+  RTTEstimator mRTT;
 
 
   uint32 mTransmitWindowSize;
@@ -3017,10 +3424,13 @@ private:
   EndPoint <EndPointType> mLocalEndPoint;
   EndPoint <EndPointType> mRemoteEndPoint;
 
+  // Streams are serviced on their Connection's strand
+  Network::IOStrand* mStrand;
+
   // We need to transmit keep alives so the stream stays open even if
   // we don't transmit for a long time. It can still be closed by the
   // underlying connection being removed.
-  Network::IOTimerPtr mKeepAliveTimer;
+  Network::WheelTimerPtr mKeepAliveTimer;
 
   // We can schedule servicing from multiple threads, so we need to
   // lock protect this data.
@@ -3029,7 +3439,7 @@ private:
   // time. Scheduling servicing only does something if nothing is scheduled yet
   // or if the time it's scheduled for is too late, in which case we update the
   // timer.
-  Network::IOTimerPtr mServiceTimer;
+  Network::WheelTimerPtr mServiceTimer;
   // Sometimes we do servicing directly, i.e. just a post. We need to
   // track this to make sure we don't double-schedule because the
   // timer expiry won't be meaningful in that case
@@ -3055,8 +3465,8 @@ private:
       }
       else if(!mIsAsyncServicing && mServiceTimer->expiresFromNow() > after) {
           needs_scheduling = true;
-          // No need to check success because we're using a strand and we can
-          // only get here if timer->expiresFromNow() is positive.
+          // No need to check success because we can only get here if the
+          // timer is still armed, i.e. timer->expiresFromNow() is positive.
           mServiceTimer->cancel();
       }
 
@@ -3066,7 +3476,7 @@ private:
           mServiceStrongConnRef = conn;
           if (after == Duration::zero()) {
               mIsAsyncServicing = true;
-              getContext()->mainStrand->post(
+              mStrand->post(
                   std::tr1::bind(&Stream<EndPointType>::serviceStreamNoReturn, this),
                   "Stream<EndPointType>::serviceStreamNoReturn"
               );
@@ -3127,6 +3537,9 @@ public:
 
   ~ConnectionManager() {
     Connection<EndPointType>::closeConnections(&mSSTConnVars);
+
+    SegmentBufferPool::Stats pool_stats = SegmentBufferPool::stats();
+    SST_LOG(info, "Buffer pool: " << pool_stats.requests << " requests, " << pool_stats.allocations << " heap allocations, " << pool_stats.allocationsPerDeliveredByte() << " allocations and " << pool_stats.copiesPerDeliveredByte() << " copied bytes per delivered byte");
   }
 
   bool connectStream(EndPoint <EndPointType> localEndPoint,
@@ -0,0 +1,147 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_LIBCORE_NETWORK_TIMER_WHEEL_HPP_
+#define _SIRIKATA_LIBCORE_NETWORK_TIMER_WHEEL_HPP_
+
+#include <sirikata/core/util/Platform.hpp>
+#include <sirikata/core/network/IODefs.hpp>
+#include <sirikata/core/network/IOTimer.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
+#include <sirikata/core/util/Noncopyable.hpp>
+#include <sirikata/core/task/Time.hpp>
+#include <boost/thread/mutex.hpp>
+
+// Each level of the wheel has 2^TIMER_WHEEL_LEVEL_BITS slots
+#define TIMER_WHEEL_LEVEL_BITS 8
+#define TIMER_WHEEL_LEVELS 4
+
+namespace Sirikata {
+namespace Network {
+
+class TimerWheel;
+typedef std::tr1::shared_ptr<TimerWheel> TimerWheelPtr;
+class WheelTimer;
+typedef std::tr1::shared_ptr<WheelTimer> WheelTimerPtr;
+typedef std::tr1::weak_ptr<WheelTimer> WheelTimerWPtr;
+
+/** A hierarchical timing wheel. It replaces many independent IOTimers, each
+ *  of which costs an entry in asio's timer heap and a heap operation per
+ *  rearm, with a single IOTimer ticking at a fixed granularity. Timers are
+ *  kept in intrusive lists bucketed by expiry tick, so arming and cancelling
+ *  are O(1), and all timers expiring in the same tick are handled together.
+ *  The tradeoff is precision: timers fire up to one granularity late.
+ *
+ *  Timers can be armed and cancelled from any thread. Their callbacks run on
+ *  the wheel's strand. The wheel only ticks while it has timers armed.
+ */
+class SIRIKATA_EXPORT TimerWheel : public std::tr1::enable_shared_from_this<TimerWheel>, Noncopyable {
+public:
+    static TimerWheelPtr create(IOStrand* strand, const Duration& granularity);
+    ~TimerWheel();
+
+    /** Create a timer serviced by this wheel. The timer keeps the wheel
+     *  alive.
+     */
+    WheelTimerPtr createTimer();
+    WheelTimerPtr createTimer(const IOCallback& cb);
+
+    IOStrand* strand() const { return mStrand; }
+    const Duration& granularity() const { return mGranularity; }
+    /// Number of timers currently armed
+    uint32 size();
+
+private:
+    friend class WheelTimer;
+
+    enum {
+        SlotsPerLevel = 1 << TIMER_WHEEL_LEVEL_BITS,
+        SlotMask = SlotsPerLevel - 1
+    };
+
+    TimerWheel(IOStrand* strand, const Duration& granularity);
+
+    // Index of the tick at t. Expiries round up so timers never fire early,
+    // processing rounds down so ticks are never handled before they start.
+    uint64 tickAt(const Time& t, bool round_up) const;
+    Time timeOf(uint64 tick) const;
+
+    // Both invalidate any expiry of the timer which is pending, and return
+    // whether the timer was armed
+    bool arm(WheelTimer* timer, const Duration& after);
+    bool disarm(WheelTimer* timer);
+
+    // Must hold mMutex for these
+    void insert(WheelTimer* timer);
+    void unlink(WheelTimer* timer);
+    void cascade(uint32 level, uint32 slot);
+    void scheduleTick(uint64 wake_tick);
+
+    static void handleTick(const std::tr1::weak_ptr<TimerWheel>& wwheel);
+    void tick();
+
+    IOStrand* mStrand;
+    Duration mGranularity;
+    Time mEpoch;
+
+    boost::mutex mMutex;
+    // Next tick to be processed
+    uint64 mCurrentTick;
+    uint32 mCount;
+    // Whether mTicker is pending, and for which tick
+    bool mTicking;
+    uint64 mWakeTick;
+    IOTimerPtr mTicker;
+    // Heads of the intrusive timer lists, one per slot per level
+    WheelTimer* mSlots[TIMER_WHEEL_LEVELS][SlotsPerLevel];
+};
+
+/** A timer in a TimerWheel, with the same interface as IOTimer so it can be
+ *  used in its place.
+ */
+class SIRIKATA_EXPORT WheelTimer : Noncopyable {
+public:
+    ~WheelTimer();
+
+    void setCallback(const IOCallback& cb);
+
+    /** Arm the timer to fire after waitFor, replacing any pending expiry.
+     *  \returns 1 if a pending expiry was replaced, 0 otherwise
+     */
+    uint32 wait(const Duration& waitFor);
+    uint32 wait(const Duration& waitFor, const IOCallback& cb);
+    /** Cancel the pending expiry, if any. A callback which has already been
+     *  pulled off the wheel but not yet run will be suppressed.
+     *  \returns 1 if the timer was armed, 0 otherwise
+     */
+    uint32 cancel();
+    /// Time until the timer fires, or zero if it isn't armed
+    Duration expiresFromNow();
+
+private:
+    friend class TimerWheel;
+
+    WheelTimer(const TimerWheelPtr& wheel, const IOCallback& cb);
+
+    TimerWheelPtr mWheel;
+    WheelTimerWPtr mWeakThis;
+    IOCallback mFunc;
+
+    // Wheel state, protected by the wheel's mutex
+    uint64 mExpiry;
+    bool mArmed;
+    uint8 mLevel;
+    uint16 mSlot;
+    WheelTimer* mPrev;
+    WheelTimer* mNext;
+
+    // Incremented under the wheel's mutex on each wait() and cancel() so
+    // expiries which raced with them are ignored
+    AtomicValue<uint32> mGeneration;
+};
+
+} // namespace Network
+} // namespace Sirikata
+
+#endif //_SIRIKATA_LIBCORE_NETWORK_TIMER_WHEEL_HPP_
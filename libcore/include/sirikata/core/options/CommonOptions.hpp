@@ -46,6 +46,9 @@
 #define OPT_PID_FILE                    "pid-file"
 
 #define OPT_SST_DEFAULT_WINDOW_SIZE  "sst.default-window-size"
+#define OPT_SST_CONGESTION_CONTROL   "sst.congestion-control"
+#define OPT_SST_CONNECTION_STRANDS   "sst.connection-strands"
+#define OPT_SST_TIMER_GRANULARITY    "sst.timer-granularity"
 
 #define STATS_TRACE_FILE     "stats.trace-filename"
 #define PROFILE                    "profile"
@@ -59,6 +62,13 @@
 #define OPT_CDN_DOWNLOAD_URI_PREFIX     "cdn.download.prefix"
 #define OPT_CDN_UPLOAD_URI_PREFIX   "cdn.upload.prefix"
 #define OPT_CDN_UPLOAD_STATUS_URI_PREFIX   "cdn.upload.status.prefix"
+#define OPT_CDN_DISK_CACHE               "cdn.disk-cache"
+#define OPT_CDN_DISK_CACHE_READERS       "cdn.disk-cache-readers"
+#define OPT_CDN_RANGE_COALESCE_WINDOW    "cdn.range-coalesce-window"
+
+#define OPT_TRANSFER_MAX_OUTSTANDING          "transfer.max-outstanding"
+#define OPT_TRANSFER_MAX_OUTSTANDING_PER_HOST "transfer.max-outstanding-per-host"
+#define OPT_TRANSFER_THREADS                  "transfer.threads"
 
 #define OPT_TRACE_TIMESERIES           "trace.timeseries"
 #define OPT_TRACE_TIMESERIES_OPTIONS   "trace.timeseries-options"
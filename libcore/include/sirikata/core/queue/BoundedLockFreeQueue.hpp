@@ -0,0 +1,220 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_BOUNDED_LOCK_FREE_QUEUE_HPP_
+#define _SIRIKATA_BOUNDED_LOCK_FREE_QUEUE_HPP_
+
+#include <sirikata/core/util/AtomicTypes.hpp>
+#include <boost/thread/thread.hpp>
+
+#ifndef SIRIKATA_CACHE_LINE_SIZE
+#define SIRIKATA_CACHE_LINE_SIZE 64
+#endif
+
+namespace Sirikata {
+
+/** A bounded, multi-producer/multi-consumer queue with thread-safe push() and
+ *  pop(). Unlike LockFreeQueue, no allocation is performed after construction:
+ *  elements live in a fixed ring of cells, each tagged with a sequence number
+ *  that tells producers and consumers whether the cell is ready for them (see
+ *  Dmitry Vyukov's bounded MPMC queue). The producer and consumer positions
+ *  are each kept on their own cache line so pushing and popping threads don't
+ *  false-share.
+ *
+ *  The capacity is rounded up to a power of two. tryPush() fails when the queue
+ *  is full; push() yields until space is available.
+ */
+template <typename T> class BoundedLockFreeQueue {
+private:
+    typedef size_t Sequence;
+    typedef SizedAtomicValue<sizeof(Sequence)> SequenceOps;
+
+    struct Cell {
+        volatile Sequence mSequence;
+        T mContent;
+    };
+
+    // Noncopyable
+    BoundedLockFreeQueue(const BoundedLockFreeQueue& other);
+    void operator=(const BoundedLockFreeQueue& other);
+
+    static Sequence roundUpPowerOfTwo(Sequence val) {
+        Sequence result = 2;
+        while(result < val)
+            result <<= 1;
+        return result;
+    }
+
+    char mPad0[SIRIKATA_CACHE_LINE_SIZE];
+    Cell* mBuffer;
+    Sequence mMask;
+    char mPad1[SIRIKATA_CACHE_LINE_SIZE - sizeof(Cell*) - sizeof(Sequence)];
+    volatile Sequence mEnqueuePos;
+    char mPad2[SIRIKATA_CACHE_LINE_SIZE - sizeof(Sequence)];
+    volatile Sequence mDequeuePos;
+    char mPad3[SIRIKATA_CACHE_LINE_SIZE - sizeof(Sequence)];
+
+public:
+    /** Drains the elements which were in the queue when the iterator was
+     *  created, one at a time. Elements pushed concurrently with iteration are
+     *  left in the queue for the next iterator.
+     */
+    class NodeIterator {
+    private:
+        // Noncopyable
+        NodeIterator(const NodeIterator &other);
+        void operator=(const NodeIterator &other);
+
+        BoundedLockFreeQueue<T>* mQueue;
+        Sequence mRemaining;
+        T mCurrent;
+
+    public:
+        NodeIterator(BoundedLockFreeQueue<T> &queue)
+         : mQueue(&queue),
+           mRemaining(queue.size()),
+           mCurrent()
+        {
+        }
+
+        T *next() {
+            if (mRemaining == 0 || !mQueue->pop(mCurrent)) {
+                mRemaining = 0;
+                return NULL;
+            }
+            mRemaining--;
+            return &mCurrent;
+        }
+    };
+
+    explicit BoundedLockFreeQueue(size_t capacity = 1024)
+     : mBuffer(NULL),
+       mMask(roundUpPowerOfTwo(capacity) - 1),
+       mEnqueuePos(0),
+       mDequeuePos(0)
+    {
+        mBuffer = aligned_malloc<Cell>(sizeof(Cell) * (mMask + 1), SIRIKATA_CACHE_LINE_SIZE);
+        for(Sequence i = 0; i <= mMask; i++) {
+            new (&mBuffer[i]) Cell();
+            mBuffer[i].mSequence = i;
+        }
+    }
+
+    ~BoundedLockFreeQueue() {
+        for(Sequence i = 0; i <= mMask; i++)
+            mBuffer[i].~Cell();
+        aligned_free(mBuffer);
+    }
+
+    /// The maximum number of elements the queue can hold.
+    size_t capacity() const {
+        return mMask + 1;
+    }
+
+    /**
+     * Pushes value onto the queue if there is space for it.
+     *
+     * @param value  Will be copied and placed onto the end of the queue.
+     * @returns      false if the queue was full and value was not pushed.
+     */
+    bool tryPush(const T &value) {
+        Cell* cell;
+        Sequence pos = mEnqueuePos;
+        while(true) {
+            cell = &mBuffer[pos & mMask];
+            Sequence seq = cell->mSequence;
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0) {
+                if (SequenceOps::cas(&mEnqueuePos, pos, pos + 1))
+                    break;
+            }
+            else if (dif < 0) {
+                return false;
+            }
+            pos = mEnqueuePos;
+        }
+        cell->mContent = value;
+        // Publish: the atomic add is a full barrier, so the content write is
+        // visible before consumers see the new sequence number.
+        SequenceOps::add(&cell->mSequence, (Sequence)1);
+        return true;
+    }
+
+    /**
+     * Pushes value onto the queue, yielding until space is available if the
+     * queue is full.
+     *
+     * @param value  Will be copied and placed onto the end of the queue.
+     */
+    void push(const T &value) {
+        while(!tryPush(value))
+            boost::this_thread::yield();
+    }
+
+    /**
+     * Pops the front value from the queue and places it in value.
+     *
+     * @param value  Will have the T at the front of the queue copied into it.
+     * @returns      whether value was changed (if the queue had at least one item).
+     */
+    bool pop(T &value) {
+        Cell* cell;
+        Sequence pos = mDequeuePos;
+        while(true) {
+            cell = &mBuffer[pos & mMask];
+            Sequence seq = cell->mSequence;
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (dif == 0) {
+                if (SequenceOps::cas(&mDequeuePos, pos, pos + 1))
+                    break;
+            }
+            else if (dif < 0) {
+                return false;
+            }
+            pos = mDequeuePos;
+        }
+        value = cell->mContent;
+        cell->mContent = T();
+        // Hand the cell back to producers for the next lap around the ring.
+        SequenceOps::add(&cell->mSequence, (Sequence)mMask);
+        return true;
+    }
+
+    void blockingPop(T &item) {
+        while(!pop(item))
+            boost::this_thread::yield();
+    }
+
+    void swap(std::deque<T>&swapWith){
+        if (!swapWith.empty())
+            throw std::runtime_error(std::string("Trying to swap with a nonempty queue"));
+        popAll(&swapWith);
+    }
+
+    void popAll(std::deque<T>*toPop) {
+        assert (toPop->empty());
+        T value;
+        while (pop(value)){
+            toPop->push_back(value);
+        }
+    }
+
+    /** Get the approximate number of elements in the queue. This may be stale
+     *  by the time it returns and is only useful for monitoring.
+     */
+    size_t size() const {
+        Sequence enq = mEnqueuePos;
+        Sequence deq = mDequeuePos;
+        intptr_t dif = (intptr_t)enq - (intptr_t)deq;
+        return dif > 0 ? (size_t)dif : 0;
+    }
+
+    bool probablyEmpty() const {
+        return size() == 0;
+    }
+};
+
+}
+
+#endif //_SIRIKATA_BOUNDED_LOCK_FREE_QUEUE_HPP_
@@ -39,7 +39,10 @@
 /// LockFreeQueue.hpp
 namespace Sirikata {
 
-/// A queue of any type that has thread-safe push() and pop() functions.
+/** A queue of any type that has thread-safe push() and pop() functions.
+ *  push() allocates a node whenever the free list is empty. If the queue can
+ *  have a fixed capacity, BoundedLockFreeQueue avoids that.
+ */
 template <typename T> class LockFreeQueue {
 private:
     struct Node {
@@ -136,6 +136,30 @@ public:
         }
         return false;
     }
+    /** Push as many of the values in [begin, end) as the resource monitor
+     *  allows, locking the underlying queue only once. Values are accepted in
+     *  order, so on return the first N values have been pushed and the rest
+     *  were rejected.
+     *  \returns the number of values pushed
+     */
+    template<typename InputIterator>
+    uint32 pushMany(InputIterator begin, InputIterator end, bool force) {
+        InputIterator accepted_end = begin;
+        uint32 accepted = 0;
+        while(accepted_end != end && mResourceMonitor.preIncrement(*accepted_end,force)) {
+            ++accepted_end;
+            ++accepted;
+        }
+        if (accepted == 0) return 0;
+        try {
+            Superclass::pushMany(begin, accepted_end);
+        } catch (...) {
+            for(InputIterator it = begin; it != accepted_end; ++it)
+                mResourceMonitor.postDecrement(*it);
+            throw;//didn't get successfully pushed
+        }
+        return accepted;
+    }
     bool pop(T &value) {
         if (Superclass::pop(value)) {
             mResourceMonitor.postDecrement(value);
@@ -147,6 +171,17 @@ public:
         Superclass::blockingPop(value);
         mResourceMonitor.postDecrement(value);
     }
+    /** Pops up to max_elements elements, locking the underlying queue only
+     *  once. Popped elements are appended to popResults.
+     *  \returns the number of elements popped
+     */
+    uint32 popUpTo(uint32 max_elements, std::deque<T>*popResults) {
+        uint32 npopped = Superclass::popUpTo(max_elements, popResults);
+        for (typename std::deque<T>::iterator i=popResults->end()-npopped,ie=popResults->end();i!=ie;++i) {
+            mResourceMonitor.postDecrement(*i);
+        }
+        return npopped;
+    }
     template <class U> bool probablyCanPush(const U&specifier) {
         return mResourceMonitor.probablyCanPush(specifier);
     }
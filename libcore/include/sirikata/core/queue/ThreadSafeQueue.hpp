@@ -50,10 +50,27 @@ SIRIKATA_EXPORT bool timed_wait(Lock*lok,
           Duration timeout,
           bool(*check)(void*, void *),
           void* arg1, void* arg2);
+/// like wait, but keeps *waiters incremented while blocked on the condition
+SIRIKATA_EXPORT void wait(Lock*lok,
+          Condition* cond,
+          uint32* waiters,
+          bool(*check)(void*, void *),
+          void* arg1, void* arg2);
+/// like timed_wait, but keeps *waiters incremented while blocked on the condition
+SIRIKATA_EXPORT bool timed_wait(Lock*lok,
+          Condition* cond,
+          uint32* waiters,
+          Duration timeout,
+          bool(*check)(void*, void *),
+          void* arg1, void* arg2);
 /// Notifies the condition once
 SIRIKATA_EXPORT void notify(Condition* cond);
+/// Notifies all waiters on the condition
+SIRIKATA_EXPORT void notifyAll(Condition* cond);
 /// release the lock
 SIRIKATA_EXPORT void unlock(Lock*lok);
+/// gives up the rest of the calling thread's timeslice
+SIRIKATA_EXPORT void yield();
 /// creates a Lock class
 SIRIKATA_EXPORT Lock* lockCreate();
 /// creates a condition
@@ -66,6 +83,11 @@ SIRIKATA_EXPORT void condDestroy(Condition*oldcond);
 
 /** ThreadSafeQueue provides a queue interface whose operations -- push, pop,
  *  empty -- are thread-safe.
+ *
+ *  Producers only signal the condition variable when a consumer is actually
+ *  blocked in blockingPop(), and blockingPop() spins briefly before blocking,
+ *  so a busy queue doesn't pay for a wakeup per element. Use pushMany() and
+ *  popUpTo() to move bursts of elements with a single lock acquisition.
  */
 template <typename T>
 class ThreadSafeQueue {
@@ -74,6 +96,37 @@ class ThreadSafeQueue {
     ThreadSafeQueueNS::Lock* mLock;
     ListType mList;
     ThreadSafeQueueNS::Condition* mCond;
+    // Number of threads blocked in blockingPop(). Protected by mLock.
+    uint32 mWaiters;
+
+    // Number of times blockingPop() checks for data before blocking.
+    enum { BLOCKING_POP_SPIN_COUNT = 64 };
+
+    /** Wake up blocked consumers after new_elements were added. Assumes
+     *  mLock is held.
+     */
+    void notifyWaiters(uint32 new_elements) {
+        if (mWaiters == 0) return;
+        if (new_elements > 1 && mWaiters > 1)
+            ThreadSafeQueueNS::notifyAll(mCond);
+        else
+            ThreadSafeQueueNS::notify(mCond);
+    }
+
+    /** Spin for a short time waiting for an element to become available.
+     *  \returns true if an element was popped into retval
+     */
+    bool spinPop(T& retval) {
+        for(uint32 i = 0; i < BLOCKING_POP_SPIN_COUNT; i++) {
+            if (!probablyEmpty() && pop(retval))
+                return true;
+            // After a handful of tight checks, give up our timeslice between
+            // checks so we don't starve the producer on a loaded machine.
+            if (i >= BLOCKING_POP_SPIN_COUNT/4)
+                ThreadSafeQueueNS::yield();
+        }
+        return false;
+    }
   private:
     /**
      * Private function to copy a ThreadSafeQueue to another
@@ -113,6 +166,7 @@ class ThreadSafeQueue {
         return *this;
     }
 	ThreadSafeQueue(const ThreadSafeQueue &other){
+        mWaiters=0;
         mLock=ThreadSafeQueueNS::lockCreate();
         mCond=ThreadSafeQueueNS::condCreate();
         ThreadSafeQueueNS::lock(other.mLock);
@@ -171,6 +225,7 @@ public:
     friend class NodeIterator;
 
     ThreadSafeQueue() {
+        mWaiters=0;
         mLock=ThreadSafeQueueNS::lockCreate();
         mCond=ThreadSafeQueueNS::condCreate();
     }
@@ -208,7 +263,7 @@ public:
         try {
             mList.push_back(value);
             new_size = mList.size();
-            ThreadSafeQueueNS::notify(mCond);
+            notifyWaiters(1);
         } catch (...) {
             ThreadSafeQueueNS::unlock(mLock);
             throw;
@@ -217,20 +272,21 @@ public:
         return new_size;
     }
 
-    /** Push multiple values onto the queue, only locking once.
-     *  \param values queue holding values to push
+    /** Push a range of values onto the queue, only locking and notifying
+     *  once.
+     *  \param begin iterator to the first value to push
+     *  \param end iterator past the last value to push
+     *  \returns the size of the queue after the push
      */
-    int32 pushMultiple(const std::deque<T> &values) {
+    template<typename InputIterator>
+    int32 pushMany(InputIterator begin, InputIterator end) {
         int32 new_size;
         ThreadSafeQueueNS::lock(mLock);
         try {
-            while(!values.empty()) {
-                T& value = values.front();
-                mList.push_back(value);
-                values.pop();
-            }
+            size_t old_size = mList.size();
+            mList.insert(mList.end(), begin, end);
             new_size = mList.size();
-            ThreadSafeQueueNS::notify(mCond);
+            notifyWaiters(new_size - old_size);
         } catch (...) {
             ThreadSafeQueueNS::unlock(mLock);
             throw;
@@ -239,6 +295,13 @@ public:
         return new_size;
     }
 
+    /** Push multiple values onto the queue, only locking once.
+     *  \param values queue holding values to push
+     */
+    int32 pushMultiple(const std::deque<T> &values) {
+        return pushMany(values.begin(), values.end());
+    }
+
     /** Pops the front element from the queue and places it in ret.
      *  \param ret storage for the popped element
      *  \returns true if an element was popped, false if the queue was empty
@@ -266,7 +329,8 @@ public:
      *  \param retval storage for the popped element
      */
     void blockingPop(T& retval) {
-        ThreadSafeQueueNS::wait(mLock, mCond, &ThreadSafeQueue<T>::waitCheck, this, &retval);
+        if (spinPop(retval)) return;
+        ThreadSafeQueueNS::wait(mLock, mCond, &mWaiters, &ThreadSafeQueue<T>::waitCheck, this, &retval);
     }
 
     /** Pop an element from the queue, blocking until an element is available if
@@ -274,7 +338,30 @@ public:
      *  \param retval storage for the popped element
      */
     bool blockingPop(T& retval, const Duration& timeout) {
-        return ThreadSafeQueueNS::timed_wait(mLock, mCond, timeout, &ThreadSafeQueue<T>::waitCheck, this, &retval);
+        if (spinPop(retval)) return true;
+        return ThreadSafeQueueNS::timed_wait(mLock, mCond, &mWaiters, timeout, &ThreadSafeQueue<T>::waitCheck, this, &retval);
+    }
+
+    /** Pops up to max_elements elements from the front of the queue, only
+     *  locking once. Popped elements are appended to popResults.
+     *  \param max_elements the maximum number of elements to pop
+     *  \param popResults a deque to append popped elements to
+     *  \returns the number of elements popped
+     */
+    uint32 popUpTo(uint32 max_elements, std::deque<T> *popResults) {
+        uint32 npopped;
+        ThreadSafeQueueNS::lock(mLock);
+        try {
+            npopped = std::min((uint32)mList.size(), max_elements);
+            typename ListType::iterator split = mList.begin() + npopped;
+            popResults->insert(popResults->end(), mList.begin(), split);
+            mList.erase(mList.begin(), split);
+        }catch (...) {
+            ThreadSafeQueueNS::unlock(mLock);
+            throw;
+        }
+        ThreadSafeQueueNS::unlock(mLock);
+        return npopped;
     }
 
     /** Checks if the queue is probably empty, without any locking. Most of the
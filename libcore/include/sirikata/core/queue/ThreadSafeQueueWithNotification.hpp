@@ -93,6 +93,16 @@ class ThreadSafeQueueWithNotification {
             mCallback();
     }
 
+    /** \see ThreadSafeQueue::pushMany. */
+    template<typename InputIterator>
+    void pushMany(InputIterator begin, InputIterator end) {
+        int32 nelements = std::distance(begin, end);
+        if (nelements == 0) return;
+        int32 new_size = mQueue.pushMany(begin, end);
+        if (new_size == nelements)
+            mCallback();
+    }
+
     /** \see ThreadSafeQueue::pop. */
     bool pop(T& ret) {
         return mQueue.pop(ret);
@@ -103,6 +113,11 @@ class ThreadSafeQueueWithNotification {
         mQueue.blockingPop(retval);
     }
 
+    /** \see ThreadSafeQueue::popUpTo. */
+    uint32 popUpTo(uint32 max_elements, std::deque<T> *popResults) {
+        return mQueue.popUpTo(max_elements, popResults);
+    }
+
     /** \see ThreadSafeQueue::swap. */
     void swap(std::deque<T>& swapWith) {
         mQueue.swap(swapWith);
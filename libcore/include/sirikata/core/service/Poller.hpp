@@ -37,6 +37,7 @@
 #include <sirikata/core/network/IOService.hpp>
 #include <sirikata/core/network/IOStrand.hpp>
 #include <sirikata/core/network/IOTimer.hpp>
+#include <sirikata/core/network/TimerWheel.hpp>
 #include <sirikata/core/util/Time.hpp>
 
 namespace Sirikata {
@@ -55,10 +56,15 @@ namespace Sirikata {
  *  the user callback. The inaccurate version will only invoke callbacks at a
  *  slower rate, and usually not by much, so you should only use this in special
  *  circumstances.
+ *
+ *  Pollers can also be driven by a TimerWheel, which is cheaper when many
+ *  pollers share a strand and can tolerate the wheel's granularity. Callbacks
+ *  are invoked on the wheel's strand.
  */
 class SIRIKATA_EXPORT Poller {
 public:
     Poller(Network::IOStrand* str, const Network::IOCallback& cb, const char* cb_tag, const Duration& max_rate = Duration::microseconds(0), bool accurate = false);
+    Poller(const Network::TimerWheelPtr& wheel, const Network::IOCallback& cb, const char* cb_tag, const Duration& max_rate = Duration::microseconds(0), bool accurate = false);
     virtual ~Poller();
 
     /** Start polling this service on this strand at the given maximum rate. */
@@ -73,9 +79,13 @@ public:
 private:
     void setupNextTimeout(const Duration& user_time);
     void handleExec(const Network::IOTimerWPtr& timer);
+    void handleWheelExec(const Network::WheelTimerWPtr& timer);
+    void exec();
 
     Network::IOStrand* mStrand;
+    // Exactly one of these is set, depending on the constructor used
     Network::IOTimerPtr mTimer;
+    Network::WheelTimerPtr mWheelTimer;
     Duration mMaxRate;
     bool mAccurate;
     bool mUnschedule;
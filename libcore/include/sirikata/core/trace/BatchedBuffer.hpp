@@ -34,7 +34,10 @@
 #define _SIRIKATA_BATCHED_BUFFER_HPP_
 
 #include <sirikata/core/util/Platform.hpp>
-#include <boost/thread/recursive_mutex.hpp>
+#include <sirikata/core/util/Time.hpp>
+#include <sirikata/core/trace/TraceFormat.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 
 namespace Sirikata {
 
@@ -55,7 +58,20 @@ struct Batch {
     }
 };
 
-class BatchedBuffer {
+/** BatchedBuffer collects trace records from any number of threads and hands
+ *  them, in large batches, to a single thread which stores them.
+ *
+ *  Each writing thread fills its own batch, so recording never takes a lock:
+ *  the only shared state touched on the write path is a lock-free list which
+ *  full batches are pushed onto. Records are never split across a thread's
+ *  batches (unless they are larger than a batch), so records from different
+ *  threads can't interleave in the output.
+ *
+ *  Each batch also tracks the type and time of the records in it, and is
+ *  stored as a self-describing chunk (see TraceFormat.hpp) so analysis tools
+ *  can find the records they need without reading the whole file.
+ */
+class SIRIKATA_EXPORT BatchedBuffer {
 public:
     struct IOVec {
         IOVec()
@@ -73,9 +89,25 @@ public:
     };
 
     BatchedBuffer();
-
-    void write(const IOVec* iov, uint32 iovcnt);
-
+    ~BatchedBuffer();
+
+    /** Write a single, already framed, record.
+     *  \param type_hint the record's type, recorded in the chunk histogram
+     *  \param t the record's time, recorded in the chunk time range
+     */
+    void write(uint16 type_hint, const Time& t, const IOVec* iov, uint32 iovcnt);
+
+    /** Reserve nbytes of contiguous space in the calling thread's batch so a
+     *  framed record can be encoded in place. Every successful reserve() must
+     *  be followed by a commit() of the same size from the same thread before
+     *  any other write.
+     *  \returns a pointer to the reserved space, or NULL if nbytes is larger
+     *           than a single batch
+     */
+    uint8* reserve(uint32 nbytes);
+    void commit(uint32 nbytes, uint16 type_hint, const Time& t);
+
+    // Hand off all partially filled batches so the next store() writes them
     void flush();
 
     // write the buffer to an ostream
@@ -83,13 +115,67 @@ public:
 
     bool empty();
 private:
-    // write the specified number of bytes from the pointer to the buffer
-    void write(const void* buf, uint32 nbytes);
+    // A batch of records plus the summary and index written in its chunk
+    // header
+    struct ByteBatch : public Batch<uint8> {
+        ByteBatch();
+
+        void addRecord(uint32 offset, uint16 type_hint, const Time& t);
+        // Write the batch, and any batches continuing it, as a single chunk.
+        // Returns the last batch written.
+        ByteBatch* store(FILE* os);
+
+        // Link used when the batch is handed off to the storage thread
+        ByteBatch* next;
+        // If true, the record at the end of this batch continues in the
+        // batch handed off after it
+        bool continued;
+
+        uint32 num_records;
+        uint64 min_time;
+        uint64 max_time;
+        uint32 type_counts[TRACE_CHUNK_MAX_TYPE_HINT];
+        uint32 num_index;
+        uint32 index[max_size / (TRACE_RECORD_HEADER_SIZE * TRACE_CHUNK_INDEX_STRIDE) + 1];
+    };
+
+    // Per-thread batch. Ownership of the batch is claimed with an atomic
+    // exchange so flush() can steal it from an idle writer.
+    struct ThreadBatch {
+        ThreadBatch() : filling(NULL), reserved(NULL) {}
+        ByteBatch* volatile filling;
+        // Batch claimed by reserve(), waiting for commit(). Only touched by
+        // the owning thread.
+        ByteBatch* reserved;
+    };
+
+    static ByteBatch* exchange(ByteBatch* volatile* target, ByteBatch* val);
+    static void noopCleanup(ThreadBatch* tb) {}
+
+    ThreadBatch* getThreadBatch();
+
+    // Claim and return the calling thread's batch, ensuring it has at least
+    // nbytes available
+    ByteBatch* claim(ThreadBatch* tb, uint32 nbytes);
+    // Return a claimed batch to the calling thread, handing it off if it is
+    // full
+    void release(ThreadBatch* tb, ByteBatch* batch);
+
+    // Push a chain of batches, linked newest first through next, onto the
+    // list of batches ready to be stored
+    void handoff(ByteBatch* newest, ByteBatch* oldest);
+
+    // Write a record too large for a single batch
+    void writeLarge(uint16 type_hint, const Time& t, const IOVec* iov, uint32 iovcnt);
+
+    boost::thread_specific_ptr<ThreadBatch> mThreadBatch;
+    // All ThreadBatches ever created, so flush() can find them. Only locked
+    // when a thread writes for the first time and when flushing.
+    boost::mutex mThreadBatchesMutex;
+    std::vector<ThreadBatch*> mThreadBatches;
 
-    typedef Batch<uint8> ByteBatch;
-    boost::recursive_mutex mMutex;
-    ByteBatch* filling;
-    std::deque<ByteBatch*> batches;
+    // Lock-free stack of batches ready to be stored, newest first
+    ByteBatch* volatile mReady;
 };
 
 } // namespace Sirikata
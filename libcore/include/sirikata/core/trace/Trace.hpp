@@ -55,6 +55,7 @@ struct Drops {
         DROPPED_AT_SPACE_ENQUEUED,
         DROPPED_CSFQ_OVERFLOW,
         DROPPED_CSFQ_PROBABILISTIC,
+        DROPPED_DRR_OVERFLOW,
         NUM_DROPS
     };
     uint64 d[NUM_DROPS];
@@ -187,14 +188,29 @@ public:
     CREATE_TRACE_DECL(timestampMessage, const Time&t, uint64 packetId, MessagePath path);
 
 
-    // Helper to prepend framing (size and payload type hint)
-    void writeRecord(uint16 type_hint, BatchedBuffer::IOVec* data, uint32 iovcnt);
+    // Helper to prepend framing (size and payload type hint). t is the time
+    // of the record, used to index the trace file.
+    void writeRecord(uint16 type_hint, const Time& t, BatchedBuffer::IOVec* data, uint32 iovcnt);
 
-    // Helper to prepend framing (size and payload type hint)
+    // Helper to prepend framing (size and payload type hint). Encodes the
+    // record directly into the calling thread's trace batch when it fits.
     template<typename T>
     void writeRecord(uint16 type_hint, const T& pl) {
         if (mShuttingDown) return;
 
+        uint32 pl_size = pl.ByteSize();
+        const uint32 header_size = TRACE_RECORD_HEADER_SIZE;
+        uint8* dest = data.reserve(header_size + pl_size);
+        if (dest != NULL) {
+            memcpy(dest, &pl_size, sizeof(pl_size));
+            memcpy(dest + sizeof(uint32), &type_hint, sizeof(type_hint));
+            bool serialized_success = pl.SerializeToArray(dest + header_size, pl_size);
+            assert(serialized_success);
+            data.commit(header_size + pl_size, type_hint, pl.t());
+            return;
+        }
+
+        // Too large for a single batch, fall back to serializing separately
         std::string serialized_pl;
         bool serialized_success = pl.SerializeToString(&serialized_pl);
         assert(serialized_success);
@@ -203,7 +219,7 @@ public:
         BatchedBuffer::IOVec data_vec[num_data] = {
             BatchedBuffer::IOVec(&(serialized_pl[0]), serialized_pl.size())
         };
-        writeRecord(type_hint, data_vec, num_data);
+        writeRecord(type_hint, pl.t(), data_vec, num_data);
     }
 
 
@@ -0,0 +1,63 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_CORE_TRACE_FORMAT_HPP_
+#define _SIRIKATA_CORE_TRACE_FORMAT_HPP_
+
+#include <sirikata/core/util/Platform.hpp>
+
+namespace Sirikata {
+namespace Trace {
+
+/** Trace files are a sequence of chunks, each written by one call to
+ *  BatchedBuffer::store. A chunk is laid out as:
+ *
+ *   ChunkHeader
+ *   ChunkTypeCount[num_types]  -- histogram of record types in the chunk
+ *   uint32[num_index]          -- payload offset of every index_stride'th record
+ *   payload_size bytes of records
+ *
+ *  Each record in the payload is framed as a uint32 size, a uint16 type hint
+ *  and then size bytes of data. The header lets readers skip chunks which
+ *  can't contain records they are interested in, and split a file into
+ *  independent pieces which can be decoded in parallel, without scanning the
+ *  records. The index lets them seek to records in the middle of a chunk, so
+ *  large chunks can be split up too. All values are in host byte order.
+ *
+ *  Older trace files are just the records, without any chunk framing.
+ *  Readers can distinguish the two by checking the first four bytes for
+ *  TRACE_CHUNK_MAGIC.
+ */
+#define TRACE_CHUNK_MAGIC 0x4B484354 // "TCHK"
+#define TRACE_CHUNK_VERSION 3
+// Type hints at or above this are all counted in the last histogram bucket
+#define TRACE_CHUNK_MAX_TYPE_HINT 64
+#define TRACE_CHUNK_INDEX_STRIDE 64
+
+struct ChunkHeader {
+    uint32 magic;
+    uint16 version;
+    uint16 num_types;
+    uint32 num_records;
+    uint32 num_index;
+    uint32 index_stride;
+    uint32 payload_size;
+    // Range of record times, as Time::raw() values
+    uint64 min_time;
+    uint64 max_time;
+};
+
+struct ChunkTypeCount {
+    uint16 type_hint;
+    uint16 reserved;
+    uint32 count;
+};
+
+// Size of the framing on each record: uint32 size + uint16 type hint
+#define TRACE_RECORD_HEADER_SIZE (sizeof(uint32) + sizeof(uint16))
+
+} // namespace Trace
+} // namespace Sirikata
+
+#endif //_SIRIKATA_CORE_TRACE_FORMAT_HPP_
@@ -26,12 +26,14 @@ public:
             setRequestDeletion(it->second.aggregateRequest);
             mDeltaQueue.push(it->second.aggregateRequest);
         }
+        requestsAvailable();
     }
 
     //Puts a request into the pool
     virtual void addRequest(TransferRequestPtr req) {
         if (!req) {
             mDeltaQueue.push(req);
+            requestsAvailable();
             return;
         }
 
@@ -102,6 +104,7 @@ public:
         setRequestPriority(it->second.aggregateRequest, mAggregationAlgorithm->aggregate(it->second.inputRequests));
 
         mDeltaQueue.push(it->second.aggregateRequest);
+        requestsAvailable();
     }
 
     //Updates priority of a request in the pool
@@ -123,6 +126,7 @@ public:
         // Update aggregate priority
         setRequestPriority(it->second.aggregateRequest, mAggregationAlgorithm->aggregate(it->second.inputRequests));
         mDeltaQueue.push(it->second.aggregateRequest);
+        requestsAvailable();
     }
 
     //Updates priority of a request in the pool
@@ -159,7 +163,7 @@ public:
             setRequestPriority(it->second.aggregateRequest, mAggregationAlgorithm->aggregate(it->second.inputRequests));
             mDeltaQueue.push(it->second.aggregateRequest);
         }
-
+        requestsAvailable();
     }
 
 private:
@@ -173,11 +177,9 @@ private:
         mAggregationAlgorithm = new MaxPriorityAggregation();
     }
 
-    //Returns an item from the pool. Blocks if pool is empty.
-    inline std::tr1::shared_ptr<TransferRequest> getRequest() {
-        std::tr1::shared_ptr<TransferRequest> retval;
-        mDeltaQueue.blockingPop(retval);
-        return retval;
+    //Returns an item from the pool. Returns false if the pool is empty.
+    inline bool getRequest(std::tr1::shared_ptr<TransferRequest>& req) {
+        return mDeltaQueue.pop(req);
     }
 
 
@@ -42,6 +42,7 @@
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 // Apple defines the check macro in AssertMacros.h, which screws up some code in boost's iostreams lib
 #ifdef check
 #undef check
@@ -54,6 +55,7 @@
 #include <sirikata/core/network/Asio.hpp>
 #include <sirikata/core/network/Address.hpp>
 #include <sirikata/core/transfer/TransferData.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
 
 
 // This is a hack around a problem created by different packages
@@ -162,8 +164,12 @@ public:
         LAST_HEADER_CB mLastCallback;
         bool mHeaderComplete;
         bool mMessageComplete;
-        http_parser_settings mHttpSettings;
-        http_parser mHttpParser;
+        // The parser belongs to the connection since pipelined responses
+        // are parsed as one stream, so we save its flags for this response
+        unsigned char mParserFlags;
+        // Whether the server will keep the connection open after this
+        // response, from http_should_keep_alive
+        bool mKeepAlive;
         bool mGzip;
         std::stringstream mCompressedStream;
         //
@@ -180,7 +186,7 @@ public:
 
         HttpResponse()
             : mLastCallback(NONE), mHeaderComplete(false), mMessageComplete(false),
-              mGzip(false), mContentLength(0), mStatusCode(0),
+              mParserFlags(0), mKeepAlive(false), mGzip(false), mContentLength(0), mStatusCode(0),
               mBytesSent(0), mBytesReceived(0)
         {}
     public:
@@ -280,6 +286,21 @@ public:
         bool allow_redirects = true
     );
 
+    /** Perform a GET for a byte range of a resource. If coalesce_window is
+     *  non-zero, range requests for the same resource made within that window
+     *  are merged with others for adjacent or overlapping ranges into a
+     *  single request. The merged response is split back up, so each callback
+     *  gets a response with its own data, Content-Length and Content-Range,
+     *  as if its request had been made on its own. If the server doesn't
+     *  answer the merged request with a 206 for exactly the merged range, the
+     *  requests are retried separately.
+     */
+    void getRange(
+        Sirikata::Network::Address addr, const String& path, const Range& range,
+        HttpCallback cb, const Headers& headers = Headers(),
+        const Duration& coalesce_window = Duration::zero()
+    );
+
     /** Perform an HTTP POST using the specified content type and message
      *  body. This can be used if you want to use an unusual encoding or as a
      *  utility for other, more specific post methods.
@@ -333,6 +354,10 @@ private:
     typedef Sirikata::Network::IOCallback IOCallback;
     typedef boost::asio::ip::tcp::endpoint TCPEndPoint;
 
+    class HttpRequest;
+    typedef std::list<std::tr1::shared_ptr<HttpRequest> > RequestQueueType;
+    struct HostPool;
+
     //Convenience of storing request parameters together
     class HttpRequest {
     public:
@@ -357,54 +382,156 @@ private:
         Headers mHeaders;
     };
 
-    //Holds a queue of requests to be made
-    typedef std::list<std::tr1::shared_ptr<HttpRequest> > RequestQueueType;
-    RequestQueueType mRequestQueue;
-    //Lock this to access mRequestQueue
-    boost::mutex mRequestQueueLock;
-
     //TODO: should get these from settings
     static const uint32 MAX_CONNECTIONS_PER_ENDPOINT = 8;
     static const uint32 MAX_TOTAL_CONNECTIONS = 40;
+    static const uint32 DEFAULT_PIPELINE_DEPTH = 4;
     static const uint32 SOCKET_BUFFER_SIZE = 10240;
+    //Merged range requests are split if they'd grow larger than this
+    static const uint32 MAX_COALESCED_RANGE_BYTES = 4 * 1024 * 1024;
 
-    //Keeps track of the total number of connections currently open
-    uint32 mNumTotalConnections;
+    /*
+     * A connection to a host. GET requests may be pipelined on it: they're
+     * written back to back without waiting for responses, which arrive in the
+     * same order and are matched up with the outstanding requests. Other
+     * requests are only sent on an idle connection and nothing is pipelined
+     * behind them.
+     */
+    class HttpConnection {
+    public:
+        HttpConnection(HostPool* _pool, const Sirikata::Network::Address& _addr)
+         : pool(_pool), addr(_addr), connected(false), closed(false),
+           writing(false), reading(false), persistent(false), numRequests(0),
+           bytesReceived(0), readBuffer(SOCKET_BUFFER_SIZE)
+        {}
+
+        HostPool* const pool;
+        const Sirikata::Network::Address addr;
+        std::tr1::shared_ptr<TCPSocket> socket;
+        bool connected;
+        bool closed;
+        bool writing;
+        bool reading;
+        // Set once a response has shown the server keeps the connection
+        // open. We only pipeline on connections we know are persistent.
+        bool persistent;
+        // Total requests sent on this connection
+        uint32 numRequests;
+        // Bytes read since the last response completed. They're credited to
+        // the next one to complete, so with pipelining the split between
+        // responses is only approximate.
+        uint32 bytesReceived;
+        // Requests sent, or waiting to be written, that haven't gotten a full
+        // response yet. Responses arrive in this order.
+        RequestQueueType outstanding;
+        // Requests that couldn't be written yet because we're still
+        // connecting or another write is in progress
+        std::string pendingWrite;
+
+        // One parser for the connection since responses arrive as one stream
+        http_parser_settings mHttpSettings;
+        http_parser mHttpParser;
+        // Response currently being parsed, and responses that have been
+        // parsed but not yet matched up with their requests
+        std::tr1::shared_ptr<HttpResponse> currentResponse;
+        std::deque<std::tr1::shared_ptr<HttpResponse> > completed;
+        std::vector<unsigned char> readBuffer;
+    };
+    typedef std::tr1::shared_ptr<HttpConnection> HttpConnectionPtr;
+    typedef std::list<HttpConnectionPtr> ConnectionList;
 
-    //Keeps track of the number of connections open per host:port pair
-    typedef std::map<Sirikata::Network::Address, uint32> NumConnsType;
-    NumConnsType mNumConnsPerAddr;
-    //Lock this to access mNumTotalConnections or mNumConnsPerAddr
-    boost::mutex mNumConnsLock;
+    /*
+     * Requests and connections for one host:port pair. Each has its own lock
+     * so requests to different hosts never contend with each other.
+     */
+    struct HostPool {
+        //Requests waiting for a connection
+        RequestQueueType queue;
+        //Open connections and connections being established
+        ConnectionList connections;
+        //Lock this to access anything in the pool or its connections
+        boost::mutex mutex;
+    };
+    typedef std::map<Sirikata::Network::Address, HostPool*> HostPoolMap;
+    HostPoolMap mHostPools;
+    //Lock this to access mHostPools. Pools are never removed, so it's only
+    //locked exclusively to add new hosts.
+    boost::shared_mutex mHostPoolsLock;
 
-    //Holds connections that are open but not being used
-    typedef std::map<Sirikata::Network::Address,
-        std::queue<std::tr1::shared_ptr<TCPSocket> > > RecycleBinType;
-    RecycleBinType mRecycleBin;
-    //Lock this to access mRecycleBin
-    boost::mutex mRecycleBinLock;
+    //Keeps track of the total number of connections currently open
+    AtomicValue<uint32> mNumTotalConnections;
+    //Maximum number of requests outstanding on a connection at once
+    uint32 mPipelineDepth;
 
     IOServicePool* mServicePool;
     TCPResolver* mResolver;
+    //Lock this to start resolving a name
+    boost::mutex mResolverLock;
 
     http_parser_settings EMPTY_PARSER_SETTINGS;
 
-    void processQueue();
-
+    //Range requests waiting to be coalesced, grouped by resource
+    struct RangeRequest {
+        RangeRequest(const Range& _range, const HttpCallback& _cb)
+         : range(_range), cb(_cb)
+        {}
+        Range range;
+        HttpCallback cb;
+    };
+    typedef std::vector<RangeRequest> RangeRequestList;
+    struct RangeBatch {
+        RangeBatch(const Sirikata::Network::Address& _addr, const String& _path, const Headers& _headers)
+         : addr(_addr), path(_path), headers(_headers)
+        {}
+        const Sirikata::Network::Address addr;
+        const String path;
+        const Headers headers;
+        RangeRequestList requests;
+    };
+    typedef std::map<String, RangeBatch*> RangeBatchMap;
+    RangeBatchMap mRangeBatches;
+    //Lock this to access mRangeBatches
+    boost::mutex mRangeBatchesLock;
+
+    HostPool* getHostPool(const Sirikata::Network::Address& addr);
+    bool reserveConnection();
+
+    //These require the pool's lock to be held
+    void processQueue(HostPool* pool);
+    HttpConnectionPtr findConnection(HostPool* pool, std::tr1::shared_ptr<HttpRequest> req, bool pipeline);
+    HttpConnectionPtr open_connection(HostPool* pool, const Sirikata::Network::Address& addr);
+    void send_request(HttpConnectionPtr conn, std::tr1::shared_ptr<HttpRequest> req);
+    void start_write(HttpConnectionPtr conn);
+    void start_read(HttpConnectionPtr conn);
+    void close_connection(HttpConnectionPtr conn);
+    void requeue_outstanding(HttpConnectionPtr conn, bool count_try, RequestQueueType* failed);
+
+    //Closing a connection frees up room for any host, so this gives them all
+    //a chance to make progress
+    void processAllQueues();
     void add_req(std::tr1::shared_ptr<HttpRequest> req);
-    void decrement_connection(const Sirikata::Network::Address& addr);
-    void write_request(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req);
+    void fail_connection(HttpConnectionPtr conn, bool count_try, const boost::system::error_code& err);
+    void handle_response(std::tr1::shared_ptr<HttpRequest> req, std::tr1::shared_ptr<HttpResponse> respPtr);
 
-    void handle_resolve(std::tr1::shared_ptr<HttpRequest> req, const boost::system::error_code& err,
+    void handle_resolve(HttpConnectionPtr conn, const boost::system::error_code& err,
             TCPResolver::iterator endpoint_iterator);
-    void handle_connect(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
+    void handle_connect(HttpConnectionPtr conn,
             const boost::system::error_code& err, TCPResolver::iterator endpoint_iterator);
-    void handle_write_request(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
-            const boost::system::error_code& err, std::tr1::shared_ptr<boost::asio::streambuf> request_stream);
-    void handle_read(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
-            std::tr1::shared_ptr<std::vector<unsigned char> > vecbuf, std::tr1::shared_ptr<HttpResponse> respPtr,
+    void handle_write(HttpConnectionPtr conn, std::tr1::shared_ptr<std::string> written,
+            const boost::system::error_code& err);
+    void handle_read(HttpConnectionPtr conn,
             const boost::system::error_code& err, std::size_t bytes_transferred);
 
+    static String formatRange(const Range& range);
+    static bool rangeRequestStartsBefore(const RangeRequest& lhs, const RangeRequest& rhs);
+    void flushRangeBatch(const String& key);
+    void sendRange(const Sirikata::Network::Address& addr, const String& path, const Headers& headers,
+            const Range& range, HttpCallback cb);
+    void handle_coalesced_response(std::tr1::shared_ptr<RangeRequestList> requests, Range merged,
+            Sirikata::Network::Address addr, String path, Headers headers,
+            std::tr1::shared_ptr<HttpResponse> response, ERR_TYPE error, const boost::system::error_code& boost_error);
+
+    static int on_message_begin(http_parser *_);
     static int on_header_field(http_parser *_, const char *at, size_t len);
     static int on_header_value(http_parser *_, const char *at, size_t len);
     static int on_headers_complete(http_parser *_);
@@ -427,6 +554,32 @@ private:
     static void print_flags(std::tr1::shared_ptr<HttpResponse> resp);
 
 public:
+    struct Stats {
+        Stats()
+         : requests(0), connections(0), reused(0), pipelined(0),
+           coalesced(0), coalescedInto(0)
+        {}
+
+        // Requests written to a connection, including retries
+        AtomicValue<uint32> requests;
+        // Connections opened
+        AtomicValue<uint32> connections;
+        // Requests sent on a connection that had already been used
+        AtomicValue<uint32> reused;
+        // Requests sent while others were still outstanding on the connection
+        AtomicValue<uint32> pipelined;
+        // Range requests that were merged with others, and the number of
+        // requests they were merged into
+        AtomicValue<uint32> coalesced;
+        AtomicValue<uint32> coalescedInto;
+    };
+    const Stats& stats() const { return mStats; }
+
+    /** Set the maximum number of requests outstanding on a connection at
+     *  once. 1 disables pipelining.
+     */
+    void setPipelineDepth(uint32 depth) { mPipelineDepth = (depth > 0 ? depth : 1); }
+    uint32 pipelineDepth() const { return mPipelineDepth; }
 
     /*
      * Posts a callback on the service pool
@@ -434,6 +587,8 @@ public:
     void postCallback(IOCallback cb, const char* tag);
     void postCallback(const Duration& waitFor, IOCallback cb, const char* tag);
 
+private:
+    Stats mStats;
 };
 
 }
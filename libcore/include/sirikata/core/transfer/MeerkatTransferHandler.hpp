@@ -88,6 +88,8 @@ private:
     const std::string CDN_SERVICE;
     const std::string CDN_DOWNLOAD_URI_PREFIX;
     const Network::Address mCdnAddr;
+    //How long range requests wait to be merged with adjacent ones
+    const Duration mRangeCoalesceWindow;
 
     void cache_check_callback(const SparseData* data, const URI& uri,
             std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback);
@@ -0,0 +1,100 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_CORE_TRANSFER_SHARDED_MEMORY_CACHE_LAYER_HPP_
+#define _SIRIKATA_CORE_TRANSFER_SHARDED_MEMORY_CACHE_LAYER_HPP_
+
+#include <sirikata/core/transfer/CacheLayer.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+namespace Sirikata {
+namespace Transfer {
+
+/** ShardedMemoryCacheLayer is a MemoryCacheLayer for caches that are hit from
+ *  many threads at once. Instead of a single CacheMap guarded by one lock,
+ *  entries are spread over a number of shards, each with its own lock, so
+ *  lookups of different Fingerprints rarely contend. Hits only take their
+ *  shard's lock shared.
+ *
+ *  Eviction uses the CLOCK approximation of LRU: a hit just sets the entry's
+ *  reference bit, so it never has to reorder a shared list and can stay under
+ *  the shared lock. The byte budget is global, and when it is exceeded entries
+ *  are evicted from the shards in round-robin order.
+ */
+class SIRIKATA_EXPORT ShardedMemoryCacheLayer : public CacheLayer {
+public:
+    /** Create a ShardedMemoryCacheLayer.
+     *  @param budget total number of bytes of data to keep
+     *  @param num_shards number of independently locked shards
+     *  @param tryNext the next layer to try if data isn't found here
+     */
+    ShardedMemoryCacheLayer(cache_usize_type budget, uint32 num_shards, CacheLayer* tryNext);
+    virtual ~ShardedMemoryCacheLayer();
+
+    virtual void purgeFromCache(const Fingerprint& fileId);
+    virtual void getData(const Fingerprint& fileId, const Range& requestedRange, const TransferCallback& callback);
+
+    // Statistics
+    uint32 hits() const { return mHits.read(); }
+    uint32 misses() const { return mMisses.read(); }
+    uint32 insertions() const { return mInsertions.read(); }
+    uint32 evictions() const { return mEvictions.read(); }
+    cache_usize_type usedBytes() const { return (cache_usize_type)mUsedBytes.read(); }
+    cache_usize_type budget() const { return mBudget; }
+    uint32 numShards() const { return mShards.size(); }
+    uint32 numEntries();
+
+protected:
+    virtual void populateCache(const Fingerprint& fileId, const DenseDataPtr& data);
+
+private:
+    struct Entry;
+    typedef std::list<Entry*> ClockList;
+    struct Entry {
+        Entry(const Fingerprint& id_)
+         : id(id_),
+           size(0),
+           referenced(0)
+        {}
+
+        Fingerprint id;
+        SparseData data;
+        cache_usize_type size;
+        // Set on every hit, cleared as the clock hand passes
+        AtomicValue<uint32> referenced;
+        ClockList::iterator clockPosition;
+    };
+    typedef std::tr1::unordered_map<Fingerprint, Entry*, Fingerprint::Hasher> EntryMap;
+
+    struct Shard {
+        boost::shared_mutex mutex;
+        EntryMap entries;
+        ClockList clock;
+        ClockList::iterator hand;
+    };
+
+    Shard& shardFor(const Fingerprint& fileId);
+    // Remove entry from shard, which must be locked exclusively
+    void removeEntry(Shard& shard, EntryMap::iterator it);
+    // Evict entries until we're back under budget
+    void evict();
+    // Evict one entry from the shard. Returns false if it was empty.
+    bool evictOne(Shard& shard);
+
+    const cache_usize_type mBudget;
+    std::vector<Shard*> mShards;
+    AtomicValue<uint32> mEvictCursor;
+
+    AtomicValue<int64> mUsedBytes;
+    AtomicValue<uint32> mHits;
+    AtomicValue<uint32> mMisses;
+    AtomicValue<uint32> mInsertions;
+    AtomicValue<uint32> mEvictions;
+};
+
+} // namespace Transfer
+} // namespace Sirikata
+
+#endif //_SIRIKATA_CORE_TRANSFER_SHARDED_MEMORY_CACHE_LAYER_HPP_
@@ -0,0 +1,160 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_CORE_TRANSFER_SLAB_CACHE_LAYER_HPP_
+#define _SIRIKATA_CORE_TRANSFER_SLAB_CACHE_LAYER_HPP_
+
+#include <sirikata/core/transfer/CacheLayer.hpp>
+#include <sirikata/core/transfer/CacheMap.hpp>
+#include <sirikata/core/queue/ThreadSafeQueue.hpp>
+#include <sirikata/core/util/Thread.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+namespace Sirikata {
+namespace Transfer {
+
+/** SlabCacheLayer is an alternative to DiskCacheLayer which stores all cached
+ *  chunks in a single preallocated data file instead of one file per
+ *  Fingerprint.
+ *
+ *  The data file is used as a ring: new chunks are appended at the write head
+ *  and, once the head wraps around, overwrite the oldest chunks. The location
+ *  of every chunk is kept in memory and recorded in an append-only index file
+ *  which is replayed on startup, so restarting requires neither a directory
+ *  scan nor opening a file per entry. Chunks are flushed to disk before their
+ *  index record is written, so a crash can't leave the index pointing at
+ *  data that never made it out. The index is periodically compacted to
+ *  contain only live entries.
+ *
+ *  The data file is memory mapped where possible. All writes are performed by
+ *  a single writer thread (the log has to be appended in order) while reads
+ *  are serviced by a pool of reader threads, so cache hits aren't serialized
+ *  behind each other or behind writes.
+ *
+ *  The CachePolicy still decides which entries are evicted to stay under its
+ *  size limit. Independently, entries are dropped when the data they refer to
+ *  is overwritten by the ring, so the policy size should generally be no
+ *  larger than the capacity of the data file.
+ */
+class SIRIKATA_EXPORT SlabCacheLayer : public CacheLayer {
+public:
+    /** Create a SlabCacheLayer.
+     *  @param policy the policy used to decide which entries to evict
+     *  @param prefix directory holding the data and index files. Relative
+     *         paths are relative to the temp directory.
+     *  @param capacity size of the preallocated data file, in bytes
+     *  @param num_readers number of threads servicing cache hits
+     *  @param tryNext the next layer to try if data isn't found here
+     */
+    SlabCacheLayer(CachePolicy* policy, const String& prefix, cache_usize_type capacity, uint32 num_readers, CacheLayer* tryNext);
+    virtual ~SlabCacheLayer();
+
+    virtual void purgeFromCache(const Fingerprint& fileId);
+    virtual void getData(const Fingerprint& fileId, const Range& requestedRange, const TransferCallback& callback);
+
+    /// Number of Fingerprints with at least one chunk stored in the slab.
+    uint32 numEntries();
+    /// Bytes of the data file currently referenced by live entries.
+    cache_usize_type usedBytes();
+
+protected:
+    virtual void populateCache(const Fingerprint& fileId, const DenseDataPtr& data);
+    virtual void destroyCacheEntry(const Fingerprint& fileId, CacheEntry* cacheLayerData, cache_usize_type releaseSize);
+
+private:
+    // A contiguous chunk of a file, stored at offset in the data file.
+    struct Segment {
+        Segment(const Range& r, uint64 off)
+         : range(r), offset(off)
+        {}
+        Range range;
+        uint64 offset;
+    };
+    typedef std::vector<Segment> SegmentList;
+    // Entries in the CacheMap carry no data, they are only used for
+    // accounting by the CachePolicy. The real state is in mEntries.
+    struct CacheData : public CacheEntry {
+    };
+
+    struct SlabRequest {
+        enum Operation {OPREAD, OPWRITE, OPEXIT} op;
+
+        SlabRequest(Operation _op, const Fingerprint& id, const Range& r)
+         : op(_op), fileId(id), range(r)
+        {}
+
+        Fingerprint fileId;
+        Range range;
+        TransferCallback finished;
+        DenseDataPtr data;
+    };
+    typedef std::tr1::shared_ptr<SlabRequest> SlabRequestPtr;
+
+    void writerThread();
+    void readerThread();
+    void handleWrite(const SlabRequestPtr& req);
+    void handleRead(const SlabRequestPtr& req);
+
+    // Open (creating and sizing if necessary) the data file and map it
+    bool openData();
+    // Replay the index to rebuild mEntries and register everything with the
+    // CacheMap.
+    void loadIndex();
+    // Rewrite the index containing only live entries. Called on the writer
+    // thread.
+    void compactIndex();
+    // Append a record to the index. Requires mIndexMutex.
+    void appendIndexRecord(bool add, const Fingerprint& fileId, const Segment& seg);
+
+    // Find a segment of fileId covering range. Requires mSlabMutex.
+    const Segment* findSegment(const Fingerprint& fileId, const Range& range) const;
+    // Remove any segments overlapping [offset, offset+length) and, with
+    // them, the rest of their entries. Returns the Fingerprints that were
+    // removed. Requires exclusive mSlabMutex.
+    void evictRegion(uint64 offset, uint64 length, std::vector<Fingerprint>* evicted);
+    // Remove all segments for fileId. Requires exclusive mSlabMutex.
+    bool removeEntry(const Fingerprint& fileId);
+
+    void readSlab(uint64 offset, uint64 length, unsigned char* out);
+    void writeSlab(uint64 offset, uint64 length, const unsigned char* in);
+    // Flush a written region to disk before it's recorded in the index
+    void syncSlab(uint64 offset, uint64 length);
+
+    CacheMap mFiles;
+    String mPrefix;
+    cache_usize_type mCapacity;
+
+    // Protects mEntries, mOffsets and mHead. Readers hold it shared while
+    // copying data out of the slab so the region can't be reused underneath
+    // them.
+    boost::shared_mutex mSlabMutex;
+    typedef std::tr1::unordered_map<Fingerprint, SegmentList, Fingerprint::Hasher> EntryMap;
+    EntryMap mEntries;
+    // Live segments by offset in the data file, used to find entries which are
+    // about to be overwritten.
+    typedef std::map<uint64, std::pair<Fingerprint, uint64> > OffsetMap;
+    OffsetMap mOffsets;
+    uint64 mHead;
+
+    int mDataFD;
+    unsigned char* mMapping;
+    // Only used when the data file couldn't be mapped
+    boost::mutex mFileMutex;
+
+    boost::mutex mIndexMutex;
+    FILE* mIndexFile;
+    uint32 mIndexRecords;
+
+    ThreadSafeQueue<SlabRequestPtr> mWriteQueue;
+    ThreadSafeQueue<SlabRequestPtr> mReadQueue;
+    Thread* mWriterThread;
+    std::vector<Thread*> mReaderThreads;
+
+    bool mCleaningUp; // don't record removals while shutting down
+};
+
+} // namespace Transfer
+} // namespace Sirikata
+
+#endif //_SIRIKATA_CORE_TRANSFER_SLAB_CACHE_LAYER_HPP_
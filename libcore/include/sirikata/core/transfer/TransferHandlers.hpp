@@ -38,8 +38,10 @@
 #include <sirikata/core/transfer/TransferData.hpp>
 #include <sirikata/core/transfer/DiskCacheLayer.hpp>
 #include <sirikata/core/transfer/MemoryCacheLayer.hpp>
+#include <sirikata/core/transfer/ShardedMemoryCacheLayer.hpp>
 #include <sirikata/core/transfer/LRUPolicy.hpp>
 #include <sirikata/core/transfer/TransferRequest.hpp>
+#include <sirikata/core/command/Commander.hpp>
 
 namespace Sirikata {
 namespace Transfer {
@@ -173,15 +175,20 @@ class SIRIKATA_EXPORT SharedChunkCache {
 private:
     static const unsigned int DISK_LRU_CACHE_SIZE;
     static const unsigned int MEMORY_LRU_CACHE_SIZE;
+    static const unsigned int MEMORY_CACHE_SHARDS;
 
     CachePolicy* mDiskCachePolicy;
-    CachePolicy* mMemoryCachePolicy;
+    ShardedMemoryCacheLayer* mMemoryCache;
     std::vector<CacheLayer*> mCacheLayers;
     CacheLayer* mCache;
+
+    void commandMemoryStats(const Command::Command& cmd, Command::Commander* cmdr, Command::CommandID cmdid);
 public:
     SharedChunkCache();
     ~SharedChunkCache();
     CacheLayer* getCache();
+    // Register commands for inspecting the cache
+    void registerContext(Context* ctx);
     static SharedChunkCache& getSingleton();
     static void destroy();
 };
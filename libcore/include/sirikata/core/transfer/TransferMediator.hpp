@@ -43,8 +43,11 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/lambda/lambda.hpp>
 #include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/IOServicePool.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <sirikata/core/network/IOTimer.hpp>
 #include <sirikata/core/network/Asio.hpp>
-#include <sirikata/core/util/Thread.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
 #include <sirikata/core/util/Singleton.hpp>
 
 #include <sirikata/core/command/Commander.hpp>
@@ -55,11 +58,19 @@ namespace Transfer {
 using namespace boost::multi_index;
 
 /*
- * Mediates requests for name lookups and chunk downloads
+ * Mediates requests for name lookups and chunk downloads. Requests from all
+ * clients for the same data are merged, so it is only fetched once, and the
+ * highest priority requests are started first. Work is done on a small pool
+ * of threads shared by all clients, and the number of requests outstanding,
+ * both in total and to each host, is bounded.
  */
 class SIRIKATA_EXPORT TransferMediator
     : public AutoSingleton<TransferMediator> {
 
+	class AggregateRequest;
+	//Requests waiting to start, highest priority first
+	typedef std::multimap<Priority, std::tr1::shared_ptr<AggregateRequest>, std::greater<Priority> > WaitingQueue;
+
     /*
      * Used to aggregate requests from different clients. If multiple clients request
      * the same file, this object keeps track of the original separate requests so that
@@ -71,9 +82,16 @@ class SIRIKATA_EXPORT TransferMediator
 	public:
 	    //Stores the aggregated priority
 		Priority mPriority;
-            // Whether we've started processing this request.
+            // Whether we've started processing this request. Protected by
+            // mDispatchMutex.
             bool mExecuting;
+            // Position in its host's queue while waiting to start. Protected
+            // by mDispatchMutex.
+            WaitingQueue::iterator mWaitingPosition;
 	private:
+		//Server the request will be made to
+		const std::string mHost;
+
 		//Maps each client's string ID to the original TransferRequest object
 		std::map<std::string, std::tr1::shared_ptr<TransferRequest> > mTransferReqs;
 
@@ -99,6 +117,9 @@ class SIRIKATA_EXPORT TransferMediator
 		//Returns a unique identifier for this aggregated request
 		const std::string& getIdentifier() const;
 
+		//Returns the server the request will be made to
+		const std::string& getHost() const;
+
 		//Returns the aggregated priority value
 		Priority getPriority() const;
 
@@ -106,71 +127,73 @@ class SIRIKATA_EXPORT TransferMediator
 		AggregateRequest(std::tr1::shared_ptr<TransferRequest> req);
 	};
 
-	//lock this to access mAggregatedList
-	boost::mutex mAggMutex;
-
 	//tags used to index AggregateList (see boost::multi_index)
 	struct tagID{};
-	struct tagPriority{};
 
 	/*
 	 * This multi_index_container allows the efficient retrieval of an AggregateRequest
-	 * either by its identifier or sorted by its priority
+	 * by its identifier
 	 */
 	typedef multi_index_container<
 		std::tr1::shared_ptr<AggregateRequest>,
 		indexed_by<
-			hashed_unique<tag<tagID>, const_mem_fun<AggregateRequest,const std::string &,&AggregateRequest::getIdentifier> >,
-			ordered_non_unique<tag<tagPriority>,
-			member<AggregateRequest,Priority,&AggregateRequest::mPriority>,
-			std::greater<Priority> >
+			hashed_unique<tag<tagID>, const_mem_fun<AggregateRequest,const std::string &,&AggregateRequest::getIdentifier> >
 		>
 	> AggregateList;
-	AggregateList mAggregateList;
 
 	//access iterators for AggregateList for convenience (see boost::multi_index)
 	typedef AggregateList::index<tagID>::type AggregateListByID;
-	typedef AggregateList::index<tagPriority>::type AggregateListByPriority;
+
+	/*
+	 * AggregateRequests are spread over a number of shards by identifier,
+	 * each with its own lock, so clients adding requests and updating
+	 * priorities rarely contend with each other. Requests that are waiting
+	 * to start are also queued by host, see mHosts.
+	 */
+	struct AggregateShard {
+		//lock this to access list
+		boost::mutex mutex;
+		AggregateList list;
+	};
+	static const uint32 NUM_AGGREGATE_SHARDS = 16;
+	AggregateShard mShards[NUM_AGGREGATE_SHARDS];
+
+	AggregateShard& shardFor(const std::string& identifier);
 
 	/*
 	 * Used to process the queue of requests coming from a single client.
-	 * There is one PoolWorker for each client, and this makes it so that the client's
-	 * thread doesn't have to block when inserting a request. Instead, the PoolWorkers
-	 * block against each other when inserting the request into the aggregated list.
+	 * There is one PoolWorker for each client. When the client queues
+	 * requests, the worker drains them on its own strand, so a client's
+	 * requests are handled in order without needing a thread per client.
 	 */
 	class PoolWorker {
 	private:
 	    //The TransferPool associated with this worker
 		std::tr1::shared_ptr<TransferPool> mTransferPool;
 
-		//The worker's thread
-		Thread * mWorkerThread;
-
-		//Set to true when worker should shut down
-		bool mCleanup;
-
-		//Runs the worker thread
-	    void run();
+		//Strand the pool is drained on
+		Network::IOStrand* mStrand;
 
 	public:
 		//Initialize with the associated TransferPool
-		PoolWorker(std::tr1::shared_ptr<TransferPool> transferPool);
+		PoolWorker(std::tr1::shared_ptr<TransferPool> transferPool, Network::IOStrand* strand);
+		~PoolWorker();
 
 		//Returns the TransferPool this was initialized with
 		std::tr1::shared_ptr<TransferPool> getTransferPool() const;
 
-		//Returns the worker's thread
-		Thread * getThread() const;
+		//Returns the strand the pool is drained on
+		Network::IOStrand* getStrand() const;
 
-		//Signal to shut down
-		void cleanup();
+		//Non-zero while a drain of the pool is waiting to run
+		AtomicValue<uint32> mDrainScheduled;
 	};
 
     friend class PoolWorker;
     //Helper for compatibility with compilers where TransferPool declaring
     //TransferMediator as a friend does not give PoolWorker access
-    static inline std::tr1::shared_ptr<TransferRequest> getRequest(std::tr1::shared_ptr<TransferPool> pool) {
-        return pool->getRequest();
+    static inline bool getRequest(std::tr1::shared_ptr<TransferPool> pool, std::tr1::shared_ptr<TransferRequest>& req) {
+        return pool->getRequest(req);
     }
 
     Context* mContext;
@@ -183,28 +206,81 @@ class SIRIKATA_EXPORT TransferMediator
 	boost::shared_mutex mPoolMutex;
 
 	//Set to true to signal shutdown
-	bool mCleanup;
+	AtomicValue<bool> mCleanup;
+
+	//Limits on outstanding requests, from the transfer.* options
+	const uint32 mMaxOutstandingRequests;
+	const uint32 mMaxOutstandingPerHost;
+
+	//Waiting and outstanding requests for a single host
+	struct HostState {
+		HostState()
+		 : outstanding(0), ready(false), readyPriority(0)
+		{}
+		uint32 outstanding;
+		WaitingQueue waiting;
+		//Whether the host is in mReadyHosts, and under which priority
+		bool ready;
+		Priority readyPriority;
+	};
+	typedef std::map<std::string, HostState> HostStateMap;
+	//Hosts with waiting requests and room for more outstanding, ordered by
+	//the priority of their best waiting request
+	typedef std::pair<Priority, std::string> ReadyHost;
+	typedef std::set<ReadyHost, std::greater<ReadyHost> > ReadyHostSet;
+
 	//Number of outstanding requests
 	uint32 mNumOutstanding;
-
-	//TransferMediator's worker thread
-	Thread* mThread;
+	//Only hosts with waiting or outstanding requests have an entry
+	HostStateMap mHosts;
+	ReadyHostSet mReadyHosts;
+	//lock this to pick requests to start and to access the waiting queues
+	//and outstanding request counts. If a shard's lock is needed too, lock
+	//that first.
+	boost::mutex mDispatchMutex;
+
+	//Threads that drain the pools and start requests
+	Network::IOServicePool* mWorkers;
+	Network::IOTimerPtr mStatsTimer;
 
     // Algorithm used to aggregate priorities of requests
     PriorityAggregationAlgorithm* mAggregationAlgorithm;
 
-    //Main thread that handles the input pools
-    void mediatorThread();
+    //Called by a pool when it has new requests
+    void requestsAvailable(PoolWorker* worker);
+    //Handles all the requests queued in the worker's pool
+    void drainPool(PoolWorker* worker);
+    //Adds, updates or removes the AggregateRequest for req
+    void processRequest(std::tr1::shared_ptr<TransferRequest> req);
+
+    //Queue or unqueue a request that's waiting to start. Require
+    //mDispatchMutex.
+    void addWaiting(const std::tr1::shared_ptr<AggregateRequest>& agg);
+    void removeWaiting(const std::tr1::shared_ptr<AggregateRequest>& agg);
+    //Give up an outstanding request's slot. Requires mDispatchMutex.
+    void releaseSlot(const std::string& host);
+    //Put the host in or take it out of mReadyHosts after its queue or
+    //outstanding count changed, and forget it if it has nothing left.
+    //Requires mDispatchMutex.
+    void updateHost(HostStateMap::iterator host_it);
+
+    //A request that's been picked to start
+    struct StartRequest {
+        std::tr1::shared_ptr<TransferRequest> req;
+        std::string id;
+        std::string host;
+    };
 
     //Callback for when an executed request finishes
-    void execute_finished(std::tr1::shared_ptr<TransferRequest> req, std::string id);
+    void execute_finished(std::tr1::shared_ptr<TransferRequest> req, std::string id, std::string host);
 
     //Check our internal queue to see what request to process next
     void checkQueue();
 
     void registerPool(TransferPoolPtr pool);
 
-    //Update statistics from the TransferHandlers
+    //Update statistics from the TransferHandlers, then schedule the next
+    //update
     void updateStats();
 
     void commandListRequests(const Command::Command& cmd, Command::Commander* cmdr, Command::CommandID cmdid);
@@ -98,7 +98,16 @@ protected:
      : mClientID(clientID)
     {}
 
-    virtual TransferRequestPtr getRequest() = 0;
+    // Returns the next queued request without blocking. Returns false if
+    // there aren't any.
+    virtual bool getRequest(TransferRequestPtr& req) = 0;
+
+    // Implementations call this after queuing a request so the
+    // TransferMediator knows to pick it up
+    void requestsAvailable() {
+        if (mRequestsAvailable)
+            mRequestsAvailable();
+    }
 
     // Utility methods because they require being friended by
     // TransferRequest but that doesn't extend to subclasses
@@ -113,6 +122,10 @@ protected:
     }
 
     const std::string mClientID;
+
+private:
+    // Set by the TransferMediator when the pool is registered
+    std::tr1::function<void()> mRequestsAvailable;
 };
 typedef std::tr1::shared_ptr<TransferPool> TransferPoolPtr;
 
@@ -128,18 +141,21 @@ public:
         if (req)
             setRequestClientID(req);
         mDeltaQueue.push(req);
+        requestsAvailable();
     }
 
     //Updates priority of a request in the pool
     virtual void updatePriority(TransferRequestPtr req, Priority p) {
         setRequestPriority(req, p);
         mDeltaQueue.push(req);
+        requestsAvailable();
     }
 
     //Updates priority of a request in the pool
     inline void deleteRequest(TransferRequestPtr req) {
         setRequestDeletion(req);
         mDeltaQueue.push(req);
+        requestsAvailable();
     }
 
 private:
@@ -153,11 +169,9 @@ private:
     {
     }
 
-    //Returns an item from the pool. Blocks if pool is empty.
-    inline std::tr1::shared_ptr<TransferRequest> getRequest() {
-        std::tr1::shared_ptr<TransferRequest> retval;
-        mDeltaQueue.blockingPop(retval);
-        return retval;
+    //Returns an item from the pool. Returns false if the pool is empty.
+    inline bool getRequest(std::tr1::shared_ptr<TransferRequest>& req) {
+        return mDeltaQueue.pop(req);
     }
 };
 
@@ -45,6 +45,13 @@ public:
 	/// names could point to the same underlying hash).
 	virtual const std::string& getIdentifier() const = 0;
 
+	/// Get the server this request will be made to, used to limit the
+	/// number of requests outstanding to a single server. Requests with an
+	/// empty host go to the default service, e.g. the CDN.
+	virtual std::string getHost() const {
+	    return std::string();
+	}
+
 	inline const std::string& getClientID() const {
 		return mClientID;
 	}
@@ -105,6 +112,8 @@ public:
         return mURI;
     }
 
+    virtual std::string getHost() const;
+
     void execute(std::tr1::shared_ptr<TransferRequest> req, ExecuteFinished cb);
 
     inline void notifyCaller(TransferRequestPtr me, TransferRequestPtr from) {
@@ -225,6 +234,8 @@ public:
 		return *mChunk;
 	}
 
+    virtual std::string getHost() const;
+
     void execute(std::tr1::shared_ptr<TransferRequest> req, ExecuteFinished cb);
 
     void execute_finished(std::tr1::shared_ptr<const DenseData> response, ExecuteFinished cb);
@@ -0,0 +1,183 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_CORE_UTIL_FLAT_HASH_MAP_HPP_
+#define _SIRIKATA_CORE_UTIL_FLAT_HASH_MAP_HPP_
+
+#include <sirikata/core/util/Platform.hpp>
+
+namespace Sirikata {
+
+/** A hash map which stores its entries in one contiguous array, using open
+ *  addressing with linear probing. Lookups touch neighbouring slots instead
+ *  of chasing per-node allocations, which makes it much cheaper than
+ *  std::tr1::unordered_map for small keys and values looked up in hot loops.
+ *
+ *  Unlike the standard containers, inserting or erasing an entry may move
+ *  other entries, invalidating all iterators and references into the map.
+ *  Values are reset to Value() when erased so they don't hold on to
+ *  resources.
+ */
+template<typename Key, typename Value, typename Hasher = std::tr1::hash<Key> >
+class FlatHashMap {
+public:
+    typedef std::pair<Key, Value> value_type;
+
+    class iterator {
+    public:
+        iterator() : mMap(NULL), mIdx(0) {}
+
+        value_type& operator*() const { return mMap->mSlots[mIdx]; }
+        value_type* operator->() const { return &mMap->mSlots[mIdx]; }
+
+        iterator& operator++() {
+            mIdx = mMap->nextUsed(mIdx + 1);
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator orig(*this);
+            ++(*this);
+            return orig;
+        }
+
+        bool operator==(const iterator& rhs) const { return mIdx == rhs.mIdx; }
+        bool operator!=(const iterator& rhs) const { return mIdx != rhs.mIdx; }
+    private:
+        friend class FlatHashMap;
+        iterator(FlatHashMap* map, std::size_t idx) : mMap(map), mIdx(idx) {}
+
+        FlatHashMap* mMap;
+        std::size_t mIdx;
+    };
+    friend class iterator;
+
+    FlatHashMap()
+     : mSize(0),
+       mShift(64)
+    {}
+
+    std::size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+
+    iterator begin() { return iterator(this, nextUsed(0)); }
+    iterator end() { return iterator(this, mSlots.size()); }
+
+    iterator find(const Key& key) {
+        if (mSize == 0) return end();
+        std::size_t mask = mSlots.size() - 1;
+        for(std::size_t idx = home(key); mUsed[idx]; idx = (idx + 1) & mask) {
+            if (mSlots[idx].first == key)
+                return iterator(this, idx);
+        }
+        return end();
+    }
+
+    std::size_t count(const Key& key) {
+        return (find(key) == end()) ? 0 : 1;
+    }
+
+    /** Insert an entry if none exists for the key. Returns an iterator to the
+     *  entry for the key and whether it was inserted.
+     */
+    std::pair<iterator, bool> insert(const value_type& val) {
+        iterator it = find(val.first);
+        if (it != end())
+            return std::make_pair(it, false);
+
+        if ((mSize + 1) * 4 > mSlots.size() * 3)
+            grow();
+        std::size_t idx = place(val);
+        mSize++;
+        return std::make_pair(iterator(this, idx), true);
+    }
+
+    Value& operator[](const Key& key) {
+        return insert(value_type(key, Value())).first->second;
+    }
+
+    void erase(iterator it) {
+        std::size_t mask = mSlots.size() - 1;
+        std::size_t hole = it.mIdx;
+        // Backward shift deletion: pull later entries in the same run back
+        // into the hole so lookups never need tombstones.
+        for(std::size_t idx = (hole + 1) & mask; mUsed[idx]; idx = (idx + 1) & mask) {
+            std::size_t want = home(mSlots[idx].first);
+            // Only move the entry if the hole lies between its home slot and
+            // its current slot, cyclically
+            if (((idx - want) & mask) >= ((idx - hole) & mask)) {
+                mSlots[hole] = mSlots[idx];
+                hole = idx;
+            }
+        }
+        mSlots[hole] = value_type(Key(), Value());
+        mUsed[hole] = 0;
+        mSize--;
+    }
+
+    std::size_t erase(const Key& key) {
+        iterator it = find(key);
+        if (it == end()) return 0;
+        erase(it);
+        return 1;
+    }
+
+    void clear() {
+        mSlots.clear();
+        mUsed.clear();
+        mSize = 0;
+        mShift = 64;
+    }
+
+private:
+    // Fibonacci hashing spreads out weak hashes, e.g. the identity hash used
+    // for integers, so runs of keys don't pile up in one cluster
+    std::size_t home(const Key& key) const {
+        return (std::size_t)(((uint64)Hasher()(key) * 0x9E3779B97F4A7C15ULL) >> mShift);
+    }
+
+    std::size_t nextUsed(std::size_t idx) const {
+        while(idx < mSlots.size() && !mUsed[idx])
+            idx++;
+        return idx;
+    }
+
+    std::size_t place(const value_type& val) {
+        std::size_t mask = mSlots.size() - 1;
+        std::size_t idx = home(val.first);
+        while(mUsed[idx])
+            idx = (idx + 1) & mask;
+        mSlots[idx] = val;
+        mUsed[idx] = 1;
+        return idx;
+    }
+
+    void grow() {
+        std::vector<value_type> old_slots;
+        std::vector<uint8> old_used;
+        old_slots.swap(mSlots);
+        old_used.swap(mUsed);
+
+        std::size_t cap = old_slots.empty() ? 8 : old_slots.size() * 2;
+        mSlots.resize(cap);
+        mUsed.resize(cap, 0);
+        mShift = 64;
+        for(std::size_t c = cap; c > 1; c >>= 1)
+            mShift--;
+
+        for(std::size_t i = 0; i < old_slots.size(); i++) {
+            if (old_used[i])
+                place(old_slots[i]);
+        }
+    }
+
+    std::vector<value_type> mSlots;
+    std::vector<uint8> mUsed;
+    std::size_t mSize;
+    // 64 - log2(capacity), to take the top bits of the mixed hash
+    uint32 mShift;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_CORE_UTIL_FLAT_HASH_MAP_HPP_
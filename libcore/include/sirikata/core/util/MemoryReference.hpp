@@ -41,6 +41,10 @@ template <class T> class DataReference {
     T first;
     size_t second;
 public:
+    DataReference()
+     : first(NULL),
+       second(0)
+    {}
     DataReference(T data, size_t size) {
         first=data;
         second=size;
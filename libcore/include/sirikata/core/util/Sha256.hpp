@@ -133,6 +133,27 @@ public:
      * \returns SHASum digest
      */
     static SHA256 computeDigest(const std::string&data);
+    /**
+     * Computes the SHA256 digests of many independent buffers, e.g. the
+     * chunks of a file being uploaded or verified. Large batches are split
+     * between the calling thread and a pool of worker threads shared by all
+     * callers.
+     * \param data array of count pointers to the data to be hashed
+     * \param lengths array of count lengths of the data to be hashed
+     * \param count number of buffers
+     * \param digests array of count digests to be filled in
+     */
+    static void computeDigests(const void*const*data, const size_t*lengths, size_t count, SHA256*digests);
+    /**
+     * \returns the name of the implementation used to compute digests,
+     * "sha-ni" when the CPU's SHA extensions are used or "scalar"
+     */
+    static const char*implementation();
+    /**
+     * Forces the portable implementation even if the CPU supports a faster
+     * one. Only intended for testing and benchmarking.
+     */
+    static void useScalarImplementation(bool scalar);
     /**
      * Fills the SHA256 with array of entirely 0's.
      */
@@ -76,5 +76,30 @@ std::string Frame::parse(std::string& data) {
     return result;
 }
 
+uint8* Frame::append(std::vector<uint8>* output, uint32 len) {
+    uint32 start = output->size();
+    output->resize(start + sizeof(uint32) + len);
+
+    uint32 encoded_len = htonl(len);
+    memcpy(&((*output)[start]), &encoded_len, sizeof(uint32));
+
+    return &((*output)[0]) + start + sizeof(uint32);
+}
+
+bool Frame::parse(const uint8* data, uint32 size, uint32* offset, const uint8** payload, uint32* payload_len) {
+    if (*offset > size || size - *offset < sizeof(uint32)) return false;
+
+    uint32 len;
+    memcpy(&len, data + *offset, sizeof(uint32));
+    len = ntohl(len);
+
+    if (size - *offset - sizeof(uint32) < len) return false;
+
+    *payload = data + *offset + sizeof(uint32);
+    *payload_len = len;
+    *offset += sizeof(uint32) + len;
+    return true;
+}
+
 } // namespace Network
 } // namespace Frame
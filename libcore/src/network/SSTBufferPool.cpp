@@ -0,0 +1,160 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/core/util/Standard.hh>
+#include <sirikata/core/network/SSTBufferPool.hpp>
+#include <sirikata/core/queue/BoundedLockFreeQueue.hpp>
+
+// Maximum number of idle blocks kept for each size class
+#define SST_POOL_MAX_FREE_BLOCKS 4096
+
+namespace Sirikata {
+namespace SST {
+
+namespace {
+
+// Block sizes. The largest covers a full datagram plus the SegmentBuffer
+// header, the smaller ones cover StreamBuffer/ChannelSegment objects and
+// acks.
+const size_t sClassSizes[] = { 64, 256, 2048 };
+const uint32 sNumClasses = sizeof(sClassSizes)/sizeof(sClassSizes[0]);
+
+int32 sizeClass(size_t nbytes) {
+    for(uint32 i = 0; i < sNumClasses; i++)
+        if (nbytes <= sClassSizes[i]) return i;
+    return -1;
+}
+
+struct FreeList {
+    FreeList()
+     : blocks(SST_POOL_MAX_FREE_BLOCKS)
+    {}
+
+    BoundedLockFreeQueue<void*> blocks;
+};
+
+// Intentionally leaked: buffers held by other statics can be released during
+// static destruction, after a function local array would already be gone.
+FreeList* freeLists() {
+    static FreeList* lists = new FreeList[sNumClasses];
+    return lists;
+}
+
+// Make sure the header layout assumed by SegmentBuffer::data() is valid.
+struct SegmentBufferSizeCheck {
+    char header_fits[(sizeof(SegmentBuffer) <= 16) ? 1 : -1];
+};
+
+} // namespace
+
+AtomicValue<uint64> SegmentBufferPool::sRequests(0);
+AtomicValue<uint64> SegmentBufferPool::sAllocations(0);
+AtomicValue<uint64> SegmentBufferPool::sBytesCopied(0);
+AtomicValue<uint64> SegmentBufferPool::sBytesDelivered(0);
+
+SegmentBufferPool::Stats::Stats()
+ : requests(0),
+   allocations(0),
+   bytes_copied(0),
+   bytes_delivered(0)
+{
+}
+
+double SegmentBufferPool::Stats::allocationsPerDeliveredByte() const {
+    if (bytes_delivered == 0) return 0.0;
+    return (double)allocations / (double)bytes_delivered;
+}
+
+double SegmentBufferPool::Stats::copiesPerDeliveredByte() const {
+    if (bytes_delivered == 0) return 0.0;
+    return (double)bytes_copied / (double)bytes_delivered;
+}
+
+void* SegmentBufferPool::allocate(size_t nbytes) {
+    ++sRequests;
+
+    int32 cls = sizeClass(nbytes);
+    if (cls >= 0) {
+        void* block;
+        if (freeLists()[cls].blocks.pop(block))
+            return block;
+        nbytes = sClassSizes[cls];
+    }
+
+    ++sAllocations;
+    return new uint8[nbytes];
+}
+
+void SegmentBufferPool::release(void* block, size_t nbytes) {
+    if (block == NULL) return;
+
+    int32 cls = sizeClass(nbytes);
+    if (cls >= 0 && freeLists()[cls].blocks.tryPush(block))
+        return;
+    delete[] static_cast<uint8*>(block);
+}
+
+SegmentBufferPool::Stats SegmentBufferPool::stats() {
+    Stats result;
+    result.requests = sRequests.read();
+    result.allocations = sAllocations.read();
+    result.bytes_copied = sBytesCopied.read();
+    result.bytes_delivered = sBytesDelivered.read();
+    return result;
+}
+
+void SegmentBufferPool::resetStats() {
+    sRequests = 0;
+    sAllocations = 0;
+    sBytesCopied = 0;
+    sBytesDelivered = 0;
+}
+
+
+
+SegmentBuffer::SegmentBuffer(uint32 capacity)
+ : mRefCount(0),
+   mSize(capacity),
+   mCapacity(capacity)
+{
+}
+
+SegmentBuffer* SegmentBuffer::create(uint32 size) {
+    void* block = SegmentBufferPool::allocate(HeaderSize + size);
+    return new (block) SegmentBuffer(size);
+}
+
+SegmentBuffer* SegmentBuffer::create(const void* data, uint32 size) {
+    SegmentBuffer* buf = create(size);
+    if (size > 0) {
+        memcpy(buf->data(), data, size);
+        SegmentBufferPool::recordCopy(size);
+    }
+    return buf;
+}
+
+SegmentBuffer* SegmentBuffer::gather(const MemoryReference* pieces, uint32 npieces) {
+    uint32 total = 0;
+    for(uint32 i = 0; i < npieces; i++)
+        total += pieces[i].size();
+
+    SegmentBuffer* buf = create(total);
+    uint8* dest = buf->data();
+    for(uint32 i = 0; i < npieces; i++) {
+        if (pieces[i].size() == 0) continue;
+        memcpy(dest, pieces[i].data(), pieces[i].size());
+        dest += pieces[i].size();
+    }
+    SegmentBufferPool::recordCopy(total);
+    return buf;
+}
+
+void SegmentBuffer::destroy(SegmentBuffer* buf) {
+    size_t nbytes = HeaderSize + buf->mCapacity;
+    buf->~SegmentBuffer();
+    SegmentBufferPool::release(buf, nbytes);
+}
+
+} // namespace SST
+} // namespace Sirikata
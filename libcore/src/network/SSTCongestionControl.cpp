@@ -0,0 +1,283 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/core/util/Standard.hh>
+#include <sirikata/core/network/SSTImpl.hpp>
+
+#include <cmath>
+
+// Upper bound on any window, in segments. Well beyond what the channel's
+// queue of 3000 segments can fill.
+#define SST_CC_MAX_WINDOW 10000
+
+namespace Sirikata {
+namespace SST {
+
+namespace {
+
+/** The original SST behavior: grow the window by one segment with
+ *  probability 1/cwnd on each ack and halve it on timeouts. Losses detected
+ *  by later acks are ignored.
+ */
+class LegacyCongestionControl : public CongestionControl {
+public:
+    LegacyCongestionControl()
+     : mCwnd(1)
+    {}
+
+    virtual String name() const { return "legacy"; }
+
+    // The original check allowed cwnd+1 segments outstanding.
+    virtual uint32 window() const { return mCwnd + 1; }
+
+    virtual void onAck(const AckSample& sample) {
+        if (rand() % mCwnd == 0 && mCwnd < SST_CC_MAX_WINDOW)
+            mCwnd += 1;
+    }
+    virtual void onLoss(const Time& now) {
+    }
+    virtual void onTimeout(const Time& now) {
+        mCwnd /= 2;
+        if (mCwnd < 1)
+            mCwnd = 1;
+    }
+
+private:
+    uint32 mCwnd;
+};
+
+
+/** CUBIC, following RFC 8312. Slow start until the first loss, then the
+ *  window follows W(t) = C*(t-K)^3 + W_max, where W_max is the window at the
+ *  last loss, but never grows more slowly than an equivalent Reno flow.
+ */
+class CubicCongestionControl : public CongestionControl {
+public:
+    CubicCongestionControl()
+     : mCwnd(InitialWindow),
+       mSSThresh(SST_CC_MAX_WINDOW),
+       mWMax(0),
+       mK(0),
+       mWEst(0),
+       mEpochStart(Time::null())
+    {}
+
+    virtual String name() const { return "cubic"; }
+
+    virtual uint32 window() const {
+        return std::max((uint32)1, (uint32)mCwnd);
+    }
+
+    virtual void onAck(const AckSample& sample) {
+        if (mCwnd < mSSThresh) {
+            mCwnd += 1;
+        }
+        else {
+            if (mEpochStart == Time::null()) {
+                mEpochStart = sample.now;
+                if (mWMax < mCwnd) {
+                    mWMax = mCwnd;
+                    mK = 0;
+                }
+                else {
+                    mK = cbrt(mWMax * (1.0 - Beta) / C);
+                }
+                mWEst = mCwnd;
+            }
+
+            double rtt = sample.min_rtt.toSeconds();
+            double t = (sample.now - mEpochStart).toSeconds() + rtt;
+            double target = C * (t - mK) * (t - mK) * (t - mK) + mWMax;
+
+            // Reno-friendly estimate, growing by about
+            // 3*(1-beta)/(1+beta) segments per RTT
+            mWEst += (3.0 * (1.0 - Beta) / (1.0 + Beta)) / mCwnd;
+            if (target < mWEst)
+                target = mWEst;
+
+            if (target > mCwnd)
+                mCwnd += std::min(target - mCwnd, mCwnd * 0.5) / mCwnd;
+            else
+                mCwnd += 0.01 / mCwnd;
+        }
+
+        if (mCwnd > SST_CC_MAX_WINDOW)
+            mCwnd = SST_CC_MAX_WINDOW;
+    }
+
+    virtual void onLoss(const Time& now) {
+        reduce();
+        mCwnd = mSSThresh;
+    }
+
+    virtual void onTimeout(const Time& now) {
+        reduce();
+        mCwnd = 1;
+    }
+
+private:
+    static const uint32 InitialWindow = 10;
+    static const double C;
+    static const double Beta;
+
+    void reduce() {
+        mEpochStart = Time::null();
+        // Fast convergence: if we lost before reaching the last W_max, back
+        // off further to release bandwidth to newer flows
+        if (mCwnd < mWMax)
+            mWMax = mCwnd * (1.0 + Beta) / 2.0;
+        else
+            mWMax = mCwnd;
+        mSSThresh = std::max(mCwnd * Beta, 2.0);
+    }
+
+    double mCwnd;
+    double mSSThresh;
+    double mWMax;
+    double mK;
+    double mWEst;
+    Time mEpochStart;
+};
+
+const double CubicCongestionControl::C = 0.4;
+const double CubicCongestionControl::Beta = 0.7;
+
+
+/** A simplified BBR. Rather than reacting to loss, it tracks the maximum
+ *  delivery rate over recent round trips and the minimum RTT and sizes the
+ *  window to a multiple of their product. It starts up with a high gain until
+ *  the delivery rate stops growing, then cycles through gains which
+ *  periodically probe for more bandwidth and then drain the queue that
+ *  creates.
+ */
+class BBRCongestionControl : public CongestionControl {
+public:
+    BBRCongestionControl()
+     : mStartup(true),
+       mFullBandwidth(0),
+       mFullBandwidthRounds(0),
+       mRound(0),
+       mRoundStart(Time::null()),
+       mCycleIndex(0),
+       mCwnd(InitialWindow)
+    {
+        for(uint32 i = 0; i < BandwidthRounds; i++)
+            mMaxBandwidth[i] = 0;
+    }
+
+    virtual String name() const { return "bbr"; }
+
+    virtual uint32 window() const {
+        return mCwnd;
+    }
+
+    virtual void onAck(const AckSample& sample) {
+        // Rounds are approximated by min RTT intervals
+        bool new_round = false;
+        if (mRoundStart == Time::null()) {
+            mRoundStart = sample.now;
+        }
+        else if (sample.now - mRoundStart >= std::max(sample.min_rtt, Duration::microseconds(SST_RTO_GRANULARITY_US))) {
+            mRoundStart = sample.now;
+            mRound++;
+            mMaxBandwidth[mRound % BandwidthRounds] = 0;
+            new_round = true;
+        }
+
+        uint32 slot = mRound % BandwidthRounds;
+        if (sample.delivery_rate > mMaxBandwidth[slot])
+            mMaxBandwidth[slot] = sample.delivery_rate;
+
+        double bw = maxBandwidth();
+        if (new_round) {
+            if (mStartup) {
+                // Leave startup once the bandwidth stops growing by 25%
+                // for a few rounds
+                if (bw >= mFullBandwidth * 1.25) {
+                    mFullBandwidth = bw;
+                    mFullBandwidthRounds = 0;
+                }
+                else if (++mFullBandwidthRounds >= 3) {
+                    mStartup = false;
+                }
+            }
+            else {
+                mCycleIndex = (mCycleIndex + 1) % NumCycleGains;
+            }
+        }
+
+        double gain = mStartup ? StartupGain : CycleGains[mCycleIndex];
+        double bdp = bw * sample.min_rtt.toSeconds();
+        uint32 target = (uint32)(gain * bdp);
+        if (target < MinWindow)
+            target = MinWindow;
+        if (target > SST_CC_MAX_WINDOW)
+            target = SST_CC_MAX_WINDOW;
+
+        // During startup, with no bandwidth estimate yet, grow like slow
+        // start so we actually get samples
+        if (mStartup && mCwnd < target)
+            mCwnd = std::min(mCwnd + 1, target);
+        else
+            mCwnd = target;
+    }
+
+    virtual void onLoss(const Time& now) {
+        // BBR doesn't treat loss as a congestion signal
+    }
+
+    virtual void onTimeout(const Time& now) {
+        // Nothing is getting through, start over conservatively
+        mCwnd = MinWindow;
+        mRoundStart = Time::null();
+    }
+
+private:
+    static const uint32 InitialWindow = 10;
+    static const uint32 MinWindow = 4;
+    static const uint32 BandwidthRounds = 10;
+    static const uint32 NumCycleGains = 8;
+    static const double StartupGain;
+    static const double CycleGains[NumCycleGains];
+
+    double maxBandwidth() const {
+        double result = 0;
+        for(uint32 i = 0; i < BandwidthRounds; i++)
+            result = std::max(result, mMaxBandwidth[i]);
+        return result;
+    }
+
+    bool mStartup;
+    double mFullBandwidth;
+    uint32 mFullBandwidthRounds;
+
+    // Windowed max of delivery rate, one slot per round
+    double mMaxBandwidth[BandwidthRounds];
+    uint64 mRound;
+    Time mRoundStart;
+
+    uint32 mCycleIndex;
+    uint32 mCwnd;
+};
+
+// 2/ln(2), the smallest gain that doubles delivery rate each round
+const double BBRCongestionControl::StartupGain = 2.89;
+const double BBRCongestionControl::CycleGains[BBRCongestionControl::NumCycleGains] = {
+    1.25, 0.75, 1, 1, 1, 1, 1, 1
+};
+
+} // namespace
+
+CongestionControl* CongestionControl::create(const String& name) {
+    if (name == "cubic")
+        return new CubicCongestionControl();
+    if (name == "bbr")
+        return new BBRCongestionControl();
+    if (name != "legacy")
+        SILOG(sst,error,"Unknown SST congestion control '" << name << "', using legacy");
+    return new LegacyCongestionControl();
+}
+
+} // namespace SST
+} // namespace Sirikata
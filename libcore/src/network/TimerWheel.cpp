@@ -0,0 +1,269 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/core/util/Standard.hh>
+#include <sirikata/core/network/TimerWheel.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <sirikata/core/util/Timer.hpp>
+
+namespace Sirikata {
+namespace Network {
+
+namespace {
+// Expiries further out than the top level can represent are clamped, which
+// at 1ms granularity is about 49 days.
+const uint64 MaxTicks = ((uint64)1 << (TIMER_WHEEL_LEVEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+}
+
+TimerWheelPtr TimerWheel::create(IOStrand* strand, const Duration& granularity) {
+    TimerWheelPtr wheel(new TimerWheel(strand, granularity));
+    wheel->mTicker = IOTimer::create(
+        strand,
+        std::tr1::bind(&TimerWheel::handleTick, std::tr1::weak_ptr<TimerWheel>(wheel))
+    );
+    return wheel;
+}
+
+TimerWheel::TimerWheel(IOStrand* strand, const Duration& granularity)
+ : mStrand(strand),
+   mGranularity(granularity > Duration::zero() ? granularity : Duration::milliseconds((int64)1)),
+   mEpoch(Timer::now()),
+   mCurrentTick(0),
+   mCount(0),
+   mTicking(false),
+   mWakeTick(0)
+{
+    for(uint32 l = 0; l < TIMER_WHEEL_LEVELS; l++)
+        for(uint32 s = 0; s < SlotsPerLevel; s++)
+            mSlots[l][s] = NULL;
+}
+
+TimerWheel::~TimerWheel() {
+    // Every timer holds a reference to the wheel, so none can be armed here
+    assert(mCount == 0);
+    mTicker->cancel();
+}
+
+WheelTimerPtr TimerWheel::createTimer() {
+    return createTimer(IOCallback());
+}
+
+WheelTimerPtr TimerWheel::createTimer(const IOCallback& cb) {
+    WheelTimerPtr timer(new WheelTimer(shared_from_this(), cb));
+    timer->mWeakThis = timer;
+    return timer;
+}
+
+uint32 TimerWheel::size() {
+    boost::mutex::scoped_lock lock(mMutex);
+    return mCount;
+}
+
+uint64 TimerWheel::tickAt(const Time& t, bool round_up) const {
+    int64 us = (t - mEpoch).toMicroseconds();
+    if (us <= 0) return 0;
+    uint64 gran = (uint64)mGranularity.toMicroseconds();
+    return round_up ? ((uint64)us + gran - 1) / gran : (uint64)us / gran;
+}
+
+Time TimerWheel::timeOf(uint64 tick) const {
+    return mEpoch + mGranularity * tick;
+}
+
+bool TimerWheel::arm(WheelTimer* timer, const Duration& after) {
+    Time now = Timer::now();
+    boost::mutex::scoped_lock lock(mMutex);
+
+    timer->mGeneration++;
+    bool was_armed = timer->mArmed;
+    if (was_armed)
+        unlink(timer);
+
+    // An idle wheel doesn't tick, so catch up before computing the slot
+    if (mCount == 0)
+        mCurrentTick = std::max(mCurrentTick, tickAt(now, false));
+
+    uint64 expiry = tickAt(now + after, true);
+    if (expiry < mCurrentTick)
+        expiry = mCurrentTick;
+    if (expiry - mCurrentTick > MaxTicks)
+        expiry = mCurrentTick + MaxTicks;
+    timer->mExpiry = expiry;
+    insert(timer);
+
+    if (!mTicking || expiry < mWakeTick)
+        scheduleTick(expiry);
+    return was_armed;
+}
+
+bool TimerWheel::disarm(WheelTimer* timer) {
+    boost::mutex::scoped_lock lock(mMutex);
+    timer->mGeneration++;
+    if (!timer->mArmed)
+        return false;
+    unlink(timer);
+    // The ticker is left alone. If it fires with nothing to do it just stops.
+    return true;
+}
+
+void TimerWheel::insert(WheelTimer* timer) {
+    uint64 delta = timer->mExpiry - mCurrentTick;
+    uint32 level = 0;
+    while(level < TIMER_WHEEL_LEVELS - 1 &&
+        delta >= ((uint64)1 << (TIMER_WHEEL_LEVEL_BITS * (level + 1))))
+        level++;
+    uint32 slot = (uint32)(timer->mExpiry >> (TIMER_WHEEL_LEVEL_BITS * level)) & SlotMask;
+
+    timer->mLevel = level;
+    timer->mSlot = slot;
+    timer->mPrev = NULL;
+    timer->mNext = mSlots[level][slot];
+    if (timer->mNext != NULL)
+        timer->mNext->mPrev = timer;
+    mSlots[level][slot] = timer;
+    timer->mArmed = true;
+    mCount++;
+}
+
+void TimerWheel::unlink(WheelTimer* timer) {
+    if (timer->mPrev != NULL)
+        timer->mPrev->mNext = timer->mNext;
+    else
+        mSlots[timer->mLevel][timer->mSlot] = timer->mNext;
+    if (timer->mNext != NULL)
+        timer->mNext->mPrev = timer->mPrev;
+    timer->mPrev = timer->mNext = NULL;
+    timer->mArmed = false;
+    mCount--;
+}
+
+void TimerWheel::cascade(uint32 level, uint32 slot) {
+    // Redistribute a higher level slot now that its range is current. Each
+    // timer lands in a lower level since its expiry is now close.
+    WheelTimer* timer = mSlots[level][slot];
+    mSlots[level][slot] = NULL;
+    while(timer != NULL) {
+        WheelTimer* next = timer->mNext;
+        mCount--;
+        insert(timer);
+        timer = next;
+    }
+}
+
+void TimerWheel::scheduleTick(uint64 wake_tick) {
+    mTicking = true;
+    mWakeTick = wake_tick;
+    Duration wait = timeOf(wake_tick) - Timer::now();
+    mTicker->wait(wait > Duration::zero() ? wait : Duration::zero());
+}
+
+void TimerWheel::handleTick(const std::tr1::weak_ptr<TimerWheel>& wwheel) {
+    TimerWheelPtr wheel = wwheel.lock();
+    if (!wheel) return;
+    wheel->tick();
+}
+
+void TimerWheel::tick() {
+    typedef std::vector< std::pair<WheelTimerPtr, uint32> > ExpiredList;
+    ExpiredList expired;
+
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        uint64 now_tick = tickAt(Timer::now(), false);
+
+        // Handle every tick that has passed. A late wakeup (or a long sleep
+        // over empty slots) processes them all at once.
+        while(mCurrentTick <= now_tick && mCount > 0) {
+            uint64 t = mCurrentTick;
+            uint32 idx = (uint32)t & SlotMask;
+            if (idx == 0) {
+                for(uint32 level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+                    uint32 slot = (uint32)(t >> (TIMER_WHEEL_LEVEL_BITS * level)) & SlotMask;
+                    cascade(level, slot);
+                    if (slot != 0) break;
+                }
+            }
+
+            WheelTimer* timer = mSlots[0][idx];
+            while(timer != NULL) {
+                WheelTimer* next = timer->mNext;
+                unlink(timer);
+                // A timer being destroyed can't be locked, but is still
+                // removed here so its destructor doesn't touch the list
+                WheelTimerPtr locked = timer->mWeakThis.lock();
+                if (locked)
+                    expired.push_back(std::make_pair(locked, timer->mGeneration.read()));
+                timer = next;
+            }
+            mCurrentTick++;
+        }
+
+        mTicking = false;
+        if (mCount > 0) {
+            // Sleep until the next occupied slot on the lowest level, or
+            // until it wraps and the next cascade is needed
+            uint64 wake = mCurrentTick;
+            uint64 boundary = (mCurrentTick | SlotMask) + 1;
+            while(wake < boundary && mSlots[0][wake & SlotMask] == NULL)
+                wake++;
+            scheduleTick(wake);
+        }
+    }
+
+    for(ExpiredList::iterator it = expired.begin(); it != expired.end(); it++) {
+        // Skip timers rearmed or cancelled since they were pulled off the
+        // wheel
+        if (it->first->mGeneration.read() != it->second)
+            continue;
+        if (it->first->mFunc)
+            it->first->mFunc();
+    }
+}
+
+
+WheelTimer::WheelTimer(const TimerWheelPtr& wheel, const IOCallback& cb)
+ : mWheel(wheel),
+   mFunc(cb),
+   mExpiry(0),
+   mArmed(false),
+   mLevel(0),
+   mSlot(0),
+   mPrev(NULL),
+   mNext(NULL),
+   mGeneration(0)
+{
+}
+
+WheelTimer::~WheelTimer() {
+    mWheel->disarm(this);
+}
+
+void WheelTimer::setCallback(const IOCallback& cb) {
+    mFunc = cb;
+}
+
+uint32 WheelTimer::wait(const Duration& waitFor) {
+    return mWheel->arm(this, waitFor) ? 1 : 0;
+}
+
+uint32 WheelTimer::wait(const Duration& waitFor, const IOCallback& cb) {
+    setCallback(cb);
+    return wait(waitFor);
+}
+
+uint32 WheelTimer::cancel() {
+    return mWheel->disarm(this) ? 1 : 0;
+}
+
+Duration WheelTimer::expiresFromNow() {
+    Time now = Timer::now();
+    boost::mutex::scoped_lock lock(mWheel->mMutex);
+    if (!mArmed)
+        return Duration::zero();
+    Duration remaining = mWheel->timeOf(mExpiry) - now;
+    return remaining > Duration::zero() ? remaining : Duration::zero();
+}
+
+} // namespace Network
+} // namespace Sirikata
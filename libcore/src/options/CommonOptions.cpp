@@ -74,6 +74,9 @@ void InitOptions() {
         .addOption(new OptionValue("ohstreamoptions","--send-buffer-size=16384 --parallel-sockets=1 --no-delay=false",Sirikata::OptionValueType<String>(),"TCPSST stream options such as how many bytes to collect for sending during an ongoing asynchronous send call."))
 
         .addOption(new OptionValue(OPT_SST_DEFAULT_WINDOW_SIZE,"10000",Sirikata::OptionValueType<uint32>(),"Default window (and buffer) size for SST streams."))
+        .addOption(new OptionValue(OPT_SST_CONGESTION_CONTROL,"legacy",Sirikata::OptionValueType<String>(),"Congestion control algorithm for SST connections: legacy, cubic or bbr."))
+        .addOption(new OptionValue(OPT_SST_CONNECTION_STRANDS,"0",Sirikata::OptionValueType<uint32>(),"Number of strands SST connections are serviced on. 0 services all connections on the main strand."))
+        .addOption(new OptionValue(OPT_SST_TIMER_GRANULARITY,"1ms",Sirikata::OptionValueType<Duration>(),"Granularity of the timer wheels driving SST retransmission, servicing and keep-alive timers."))
 
         .addOption(new OptionValue(OPT_REGION_WEIGHT, "sqr", Sirikata::OptionValueType<String>(), "Type of region weight calculator to use, which affects communication falloff."))
         .addOption(new OptionValue(OPT_REGION_WEIGHT_ARGS, "--flatness=8 --const-cutoff=64", Sirikata::OptionValueType<String>(), "Arguments to region weight calculator."))
@@ -113,6 +116,13 @@ void InitOptions() {
         .addOption(new OptionValue(OPT_CDN_DOWNLOAD_URI_PREFIX, "/download", Sirikata::OptionValueType<String>(), "URI prefix for CDN HTTP downloads."))
         .addOption(new OptionValue(OPT_CDN_UPLOAD_URI_PREFIX, "/api/upload", Sirikata::OptionValueType<String>(), "URI prefix for CDN HTTP uploads."))
         .addOption(new OptionValue(OPT_CDN_UPLOAD_STATUS_URI_PREFIX, "/upload/processing", Sirikata::OptionValueType<String>(), "URI prefix for CDN HTTP upload status checks."))
+        .addOption(new OptionValue(OPT_CDN_DISK_CACHE, "files", Sirikata::OptionValueType<String>(), "Disk cache for downloaded content: files (one file per entry) or slab (a single preallocated file)."))
+        .addOption(new OptionValue(OPT_CDN_DISK_CACHE_READERS, "4", Sirikata::OptionValueType<uint32>(), "Number of threads servicing hits in the slab disk cache."))
+        .addOption(new OptionValue(OPT_CDN_RANGE_COALESCE_WINDOW, "0ms", Sirikata::OptionValueType<Duration>(), "How long to hold chunk range requests so adjacent ranges of the same file can be merged into one request. 0 disables merging."))
+
+        .addOption(new OptionValue(OPT_TRANSFER_MAX_OUTSTANDING, "40", Sirikata::OptionValueType<uint32>(), "Maximum number of transfer requests outstanding at once."))
+        .addOption(new OptionValue(OPT_TRANSFER_MAX_OUTSTANDING_PER_HOST, "32", Sirikata::OptionValueType<uint32>(), "Maximum number of transfer requests outstanding to a single host. The default keeps all of HttpManager's connections to a host busy."))
+        .addOption(new OptionValue(OPT_TRANSFER_THREADS, "2", Sirikata::OptionValueType<uint32>(), "Number of threads handling transfer requests."))
 
         .addOption(new OptionValue(OPT_TRACE_TIMESERIES, "null", Sirikata::OptionValueType<String>(), "Service to report TimeSeries data to."))
         .addOption(new OptionValue(OPT_TRACE_TIMESERIES_OPTIONS, "", Sirikata::OptionValueType<String>(), "Options for TimeSeries reporting service."))
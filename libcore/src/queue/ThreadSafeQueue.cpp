@@ -60,12 +60,38 @@ bool timed_wait(Lock*lok, Condition *cond, Duration timeout, bool (*check) (void
     }
     return true;
 }
+void wait(Lock*lok,Condition *cond, uint32* waiters, bool (*check) (void*, void*), void * arg1, void * arg2){
+    boost::unique_lock<boost::mutex> lock(*lok);
+    while ((*check)(arg1,arg2)){
+        (*waiters)++;
+        cond->wait(lock);
+        (*waiters)--;
+    }
+}
+bool timed_wait(Lock*lok, Condition *cond, uint32* waiters, Duration timeout, bool (*check) (void*, void*), void * arg1, void * arg2){
+    boost::system_time const stop_at = boost::get_system_time() + boost::posix_time::microseconds(timeout.microseconds());
+    boost::unique_lock<boost::mutex> lock(*lok);
+    while ((*check)(arg1,arg2)){
+        (*waiters)++;
+        bool got_event = cond->timed_wait(lock, stop_at);
+        (*waiters)--;
+        if (!got_event) // timeout
+            return false;
+    }
+    return true;
+}
 void notify(Condition *cond){
     cond->notify_one();
 }
+void notifyAll(Condition *cond){
+    cond->notify_all();
+}
 void unlock(Lock*lok){
     lok->unlock();
 }
+void yield(){
+    boost::this_thread::yield();
+}
 Lock* lockCreate(){
     return new Lock;
 }
@@ -54,6 +54,24 @@ Poller::Poller(Network::IOStrand* str, const Network::IOCallback& cb, const char
     mTimer->setCallback(mCB);
 }
 
+Poller::Poller(const Network::TimerWheelPtr& wheel, const Network::IOCallback& cb, const char* cb_tag, const Duration& max_rate, bool accurate)
+ : mStrand(wheel->strand()),
+   mWheelTimer( wheel->createTimer() ),
+   mMaxRate(max_rate),
+   mAccurate(accurate),
+   mUnschedule(false),
+   mUserCB(cb),
+   mCBTag(cb_tag)
+#if SIRIKATA_DEBUG
+   , mPollerRunCount(0)
+#endif
+
+{
+    Network::WheelTimerWPtr wtimer(mWheelTimer);
+    mCB = mStrand->wrap(std::tr1::bind(&Poller::handleWheelExec, this, wtimer));
+    mWheelTimer->setCallback(mCB);
+}
+
 Poller::~Poller() {
 #if SIRIKATA_DEBUG
     if (mPollerRunCount > 0)
@@ -78,6 +96,9 @@ void Poller::setupNextTimeout(const Duration& user_time) {
             // this is hit consistently, you're probably doing it wrong.
             mStrand->post(mCB, mCBTag);
         }
+        else if (mWheelTimer) {
+            mWheelTimer->wait(mMaxRate-user_time);
+        }
         else {
             mTimer->wait(mMaxRate-user_time);
         }
@@ -100,6 +121,16 @@ void Poller::stop() {
 void Poller::handleExec(const Network::IOTimerWPtr &wthis) {
     if (!wthis.lock())
         return;//deleted already
+    exec();
+}
+
+void Poller::handleWheelExec(const Network::WheelTimerWPtr &wthis) {
+    if (!wthis.lock())
+        return;//deleted already
+    exec();
+}
+
+void Poller::exec() {
     static Duration null_offset = Duration::zero();
     Time start = mAccurate ? Time::now(null_offset) : Time::null();
 
@@ -35,69 +35,254 @@
 
 namespace Sirikata {
 
-BatchedBuffer::BatchedBuffer()
- : filling(NULL)
+BatchedBuffer::ByteBatch::ByteBatch()
+ : next(NULL),
+   continued(false),
+   num_records(0),
+   min_time(0),
+   max_time(0),
+   num_index(0)
 {
+    memset(type_counts, 0, sizeof(type_counts));
+}
+
+void BatchedBuffer::ByteBatch::addRecord(uint32 offset, uint16 type_hint, const Time& t) {
+    uint64 traw = t.raw();
+    if (num_records == 0 || traw < min_time) min_time = traw;
+    if (num_records == 0 || traw > max_time) max_time = traw;
+
+    type_counts[std::min((uint32)type_hint, (uint32)TRACE_CHUNK_MAX_TYPE_HINT-1)]++;
+
+    if (num_records % TRACE_CHUNK_INDEX_STRIDE == 0)
+        index[num_index++] = offset;
+    num_records++;
+}
+
+BatchedBuffer::ByteBatch* BatchedBuffer::ByteBatch::store(FILE* os) {
+    Trace::ChunkHeader header;
+    header.magic = TRACE_CHUNK_MAGIC;
+    header.version = TRACE_CHUNK_VERSION;
+    header.num_records = num_records;
+    header.num_index = num_index;
+    header.index_stride = TRACE_CHUNK_INDEX_STRIDE;
+    header.min_time = min_time;
+    header.max_time = max_time;
+
+    header.payload_size = 0;
+    ByteBatch* last = this;
+    while(true) {
+        header.payload_size += last->size;
+        if (!last->continued) break;
+        last = last->next;
+    }
+
+    Trace::ChunkTypeCount types[TRACE_CHUNK_MAX_TYPE_HINT];
+    header.num_types = 0;
+    for(uint16 i = 0; i < TRACE_CHUNK_MAX_TYPE_HINT; i++) {
+        if (type_counts[i] == 0) continue;
+        types[header.num_types].type_hint = i;
+        types[header.num_types].reserved = 0;
+        types[header.num_types].count = type_counts[i];
+        header.num_types++;
+    }
+
+    fwrite((void*)&header, sizeof(header), 1, os);
+    fwrite((void*)types, sizeof(Trace::ChunkTypeCount), header.num_types, os);
+    fwrite((void*)index, sizeof(uint32), num_index, os);
+    for(ByteBatch* bb = this; ; bb = bb->next) {
+        fwrite((void*)&(bb->items[0]), 1, bb->size, os);
+        if (bb == last) break;
+    }
+    return last;
 }
 
-// write the specified number of bytes from the pointer to the buffer
-void BatchedBuffer::write(const void* buf, uint32 nbytes)
+BatchedBuffer::BatchedBuffer()
+ : mThreadBatch(&BatchedBuffer::noopCleanup),
+   mReady(NULL)
 {
-    boost::lock_guard<boost::recursive_mutex> lck(mMutex);
+}
 
-    const uint8* bufptr = (const uint8*)buf;
-    while( nbytes > 0 ) {
-        if (filling == NULL)
-            filling = new ByteBatch();
+BatchedBuffer::~BatchedBuffer() {
+    flush();
+    ByteBatch* ready = exchange(&mReady, NULL);
+    while(ready != NULL) {
+        ByteBatch* next = ready->next;
+        delete ready;
+        ready = next;
+    }
+    for(std::vector<ThreadBatch*>::iterator it = mThreadBatches.begin(); it != mThreadBatches.end(); it++)
+        delete *it;
+}
 
-        uint32 to_copy = std::min(filling->avail(), nbytes);
+BatchedBuffer::ByteBatch* BatchedBuffer::exchange(ByteBatch* volatile* target, ByteBatch* val) {
+    ByteBatch* old;
+    do {
+        old = *target;
+    } while(!compare_and_swap((volatile ByteBatch* volatile*)target, old, val));
+    return old;
+}
 
-        memcpy( &filling->items[filling->size], bufptr, to_copy);
-        filling->size += to_copy;
-        bufptr += to_copy;
-        nbytes -= to_copy;
+BatchedBuffer::ThreadBatch* BatchedBuffer::getThreadBatch() {
+    ThreadBatch* tb = mThreadBatch.get();
+    if (tb == NULL) {
+        tb = new ThreadBatch();
+        {
+            boost::lock_guard<boost::mutex> lck(mThreadBatchesMutex);
+            mThreadBatches.push_back(tb);
+        }
+        mThreadBatch.reset(tb);
+    }
+    return tb;
+}
 
-        if (filling->full())
-            flush();
+BatchedBuffer::ByteBatch* BatchedBuffer::claim(ThreadBatch* tb, uint32 nbytes) {
+    ByteBatch* batch = exchange(&tb->filling, NULL);
+    if (batch != NULL && batch->avail() < nbytes) {
+        handoff(batch, batch);
+        batch = NULL;
     }
+    if (batch == NULL)
+        batch = new ByteBatch();
+    return batch;
 }
 
-void BatchedBuffer::write(const IOVec* iov, uint32 iovcnt) {
-    boost::lock_guard<boost::recursive_mutex> lck(mMutex);
+void BatchedBuffer::release(ThreadBatch* tb, ByteBatch* batch) {
+    if (batch->full()) {
+        handoff(batch, batch);
+        return;
+    }
+    // Nobody else ever puts a batch into tb->filling, so it is still NULL. The
+    // exchange publishes the batch's contents before flush() can take it.
+    exchange(&tb->filling, batch);
+}
 
-    for(uint32 i = 0; i < iovcnt; i++)
-        write(iov[i].base, iov[i].len);
+void BatchedBuffer::handoff(ByteBatch* newest, ByteBatch* oldest) {
+    ByteBatch* head;
+    do {
+        head = mReady;
+        oldest->next = head;
+    } while(!compare_and_swap((volatile ByteBatch* volatile*)&mReady, head, newest));
 }
 
-void BatchedBuffer::flush() {
-    boost::lock_guard<boost::recursive_mutex> lck(mMutex);
+uint8* BatchedBuffer::reserve(uint32 nbytes) {
+    if (nbytes > ByteBatch::max_size)
+        return NULL;
+
+    ThreadBatch* tb = getThreadBatch();
+    assert(tb->reserved == NULL);
+    // While reserved, the batch isn't in tb->filling, so flush() can't steal
+    // it out from under the encoder.
+    tb->reserved = claim(tb, nbytes);
+    return &tb->reserved->items[tb->reserved->size];
+}
+
+void BatchedBuffer::commit(uint32 nbytes, uint16 type_hint, const Time& t) {
+    ThreadBatch* tb = getThreadBatch();
+    ByteBatch* batch = tb->reserved;
+    assert(batch != NULL && batch->avail() >= nbytes);
+    tb->reserved = NULL;
+
+    batch->addRecord(batch->size, type_hint, t);
+    batch->size += nbytes;
+    release(tb, batch);
+}
+
+void BatchedBuffer::write(uint16 type_hint, const Time& t, const IOVec* iov, uint32 iovcnt) {
+    uint32 total_size = 0;
+    for(uint32 i = 0; i < iovcnt; i++)
+        total_size += iov[i].len;
 
-    if (filling == NULL)
+    uint8* dest = reserve(total_size);
+    if (dest == NULL) {
+        writeLarge(type_hint, t, iov, iovcnt);
         return;
+    }
 
-    batches.push_back(filling);
-    filling = NULL;
+    for(uint32 i = 0; i < iovcnt; i++) {
+        memcpy(dest, iov[i].base, iov[i].len);
+        dest += iov[i].len;
+    }
+    commit(total_size, type_hint, t);
+}
+
+void BatchedBuffer::writeLarge(uint16 type_hint, const Time& t, const IOVec* iov, uint32 iovcnt) {
+    // Fill a private chain of batches and hand it off in one step so it stays
+    // contiguous in the output, as a single chunk.
+    ByteBatch* oldest = new ByteBatch();
+    oldest->addRecord(0, type_hint, t);
+    ByteBatch* newest = oldest;
+    for(uint32 i = 0; i < iovcnt; i++) {
+        const uint8* bufptr = (const uint8*)iov[i].base;
+        uint32 nbytes = iov[i].len;
+        while(nbytes > 0) {
+            if (newest->full()) {
+                ByteBatch* next = new ByteBatch();
+                next->next = newest;
+                newest->continued = true;
+                newest = next;
+            }
+            uint32 to_copy = std::min(newest->avail(), nbytes);
+            memcpy( &newest->items[newest->size], bufptr, to_copy);
+            newest->size += to_copy;
+            bufptr += to_copy;
+            nbytes -= to_copy;
+        }
+    }
+    handoff(newest, oldest);
+}
+
+void BatchedBuffer::flush() {
+    boost::lock_guard<boost::mutex> lck(mThreadBatchesMutex);
+
+    for(std::vector<ThreadBatch*>::iterator it = mThreadBatches.begin(); it != mThreadBatches.end(); it++) {
+        // If the owner is in the middle of a write, this comes back empty and
+        // the data will be picked up by a later flush.
+        ByteBatch* batch = exchange(&(*it)->filling, NULL);
+        if (batch == NULL) continue;
+        if (batch->size == 0) {
+            delete batch;
+            continue;
+        }
+        handoff(batch, batch);
+    }
 }
 
 // write the buffer to an ostream
 void BatchedBuffer::store(FILE* os) {
-    std::deque<ByteBatch*> bufs;
-
-    {
-        boost::lock_guard<boost::recursive_mutex> lck(mMutex);
-        batches.swap(bufs);
+    // Take everything that's ready, then reverse it to get the order batches
+    // were handed off in.
+    ByteBatch* ready = exchange(&mReady, NULL);
+    ByteBatch* ordered = NULL;
+    while(ready != NULL) {
+        ByteBatch* next = ready->next;
+        ready->next = ordered;
+        ordered = ready;
+        ready = next;
     }
 
-    for(std::deque<ByteBatch*>::iterator it = bufs.begin(); it != bufs.end(); it++) {
-        ByteBatch* bb = *it;
-        fwrite((void*)&(bb->items[0]), 1, bb->size, os);
-        delete bb;
+    while(ordered != NULL) {
+        ByteBatch* last = ordered->store(os);
+        ByteBatch* after = last->next;
+        for(ByteBatch* bb = ordered; bb != after; ) {
+            ByteBatch* next = bb->next;
+            delete bb;
+            bb = next;
+        }
+        ordered = after;
     }
 }
 
 bool BatchedBuffer::empty() {
-    boost::lock_guard<boost::recursive_mutex> lck(mMutex);
-    return (filling == NULL && batches.empty());
+    if (mReady != NULL)
+        return false;
+
+    boost::lock_guard<boost::mutex> lck(mThreadBatchesMutex);
+    for(std::vector<ThreadBatch*>::iterator it = mThreadBatches.begin(); it != mThreadBatches.end(); it++) {
+        ByteBatch* batch = (*it)->filling;
+        if (batch != NULL && batch->size > 0)
+            return false;
+    }
+    return true;
 }
 
 } // namespace Sirikata
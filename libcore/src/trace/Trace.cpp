@@ -108,7 +108,7 @@ void Trace::storageThread(const String& filename) {
     }
 }
 
-void Trace::writeRecord(uint16 type_hint, BatchedBuffer::IOVec* data_orig, uint32 iovcnt) {
+void Trace::writeRecord(uint16 type_hint, const Time& t, BatchedBuffer::IOVec* data_orig, uint32 iovcnt) {
     assert(iovcnt < 30);
 
     BatchedBuffer::IOVec data_vec[32];
@@ -123,7 +123,7 @@ void Trace::writeRecord(uint16 type_hint, BatchedBuffer::IOVec* data_orig, uint3
     for(uint32 i = 0; i < iovcnt; i++)
         data_vec[i+2] = data_orig[i];
 
-    data.write(data_vec, iovcnt+2);
+    data.write(type_hint, t, data_vec, iovcnt+2);
 }
 
 
@@ -152,7 +152,7 @@ CREATE_TRACE_DEF(Trace, timestampMessageCreation, mLogMessage, const Time&sent,
         BatchedBuffer::IOVec(&srcprt, sizeof(srcprt)),
         BatchedBuffer::IOVec(&dstprt, sizeof(dstprt)),
     };
-    writeRecord(MessageCreationTimestampTag, data_vec, num_data);
+    writeRecord(MessageCreationTimestampTag, sent, data_vec, num_data);
 }
 
 CREATE_TRACE_DEF(Trace, timestampMessage, mLogMessage, const Time&sent, uint64 uid, MessagePath path) {
@@ -164,7 +164,7 @@ CREATE_TRACE_DEF(Trace, timestampMessage, mLogMessage, const Time&sent, uint64 u
         BatchedBuffer::IOVec(&uid, sizeof(uid)),
         BatchedBuffer::IOVec(&path, sizeof(path)),
     };
-    writeRecord(MessageTimestampTag, data_vec, num_data);
+    writeRecord(MessageTimestampTag, sent, data_vec, num_data);
 }
 
 } // namespace Trace
@@ -44,6 +44,28 @@ AUTO_SINGLETON_INSTANCE(Sirikata::Transfer::HttpManager);
 namespace Sirikata {
 namespace Transfer {
 
+namespace {
+
+// Parses a Content-Range header value, "bytes first-last/total". The total
+// is kept as a string since it may be "*".
+bool parseContentRange(const String& value, uint64* first, uint64* last, String* total) {
+    if (value.substr(0, 6) != "bytes ") return false;
+    String::size_type dashPos = value.find('-', 6);
+    String::size_type slashPos = value.find('/', 6);
+    if (dashPos == String::npos || slashPos == String::npos || slashPos < dashPos)
+        return false;
+    try {
+        *first = boost::lexical_cast<uint64>(value.substr(6, dashPos - 6));
+        *last = boost::lexical_cast<uint64>(value.substr(dashPos + 1, slashPos - dashPos - 1));
+    } catch(boost::bad_lexical_cast&) {
+        return false;
+    }
+    *total = value.substr(slashPos + 1);
+    return true;
+}
+
+} // namespace
+
 HttpManager& HttpManager::getSingleton() {
     return AutoSingleton<HttpManager>::getSingleton();
 }
@@ -52,7 +74,8 @@ void HttpManager::destroy() {
 }
 
 HttpManager::HttpManager()
-    : mNumTotalConnections(0) {
+    : mNumTotalConnections(0),
+      mPipelineDepth(DEFAULT_PIPELINE_DEPTH) {
 
     EMPTY_PARSER_SETTINGS.on_message_begin = 0;
     EMPTY_PARSER_SETTINGS.on_header_field = 0;
@@ -89,8 +112,12 @@ HttpManager::~HttpManager() {
 
     //Clean up any data we still have to make sure anything
     //referencing the service pool is dead
-    mRequestQueue.clear();
-    mRecycleBin.clear();
+    for(HostPoolMap::iterator it = mHostPools.begin(); it != mHostPools.end(); it++)
+        delete it->second;
+    mHostPools.clear();
+    for(RangeBatchMap::iterator it = mRangeBatches.begin(); it != mRangeBatches.end(); it++)
+        delete it->second;
+    mRangeBatches.clear();
 
     //Delete dummy worker and service pool
     mServicePool->stopWork();
@@ -145,7 +172,6 @@ void HttpManager::makeRequest(Sirikata::Network::Address addr, HTTP_METHOD metho
     }
 
     add_req(r);
-    processQueue();
 }
 
 void HttpManager::makeRequest(
@@ -306,329 +332,610 @@ void HttpManager::postMultipartForm(
     );
 }
 
+String HttpManager::formatRange(const Range& range) {
+    std::ostringstream formatted;
+    formatted << "bytes=" << range.startbyte() << "-";
+    if (!range.goesToEndOfFile())
+        formatted << range.endbyte();
+    return formatted.str();
+}
 
+bool HttpManager::rangeRequestStartsBefore(const RangeRequest& lhs, const RangeRequest& rhs) {
+    return lhs.range.startbyte() < rhs.range.startbyte();
+}
 
-void HttpManager::processQueue() {
-    SILOG(transfer, insane, "processQueue called, mNumTotalConnections = "
-            << mNumTotalConnections << " and recycle bin size = " << mRecycleBin.size()
-            << " and size of hosts = " << mNumConnsPerAddr.size()
-            << " and request queue size = " << mRequestQueue.size());
-
-    boost::unique_lock<boost::mutex> lockQueue(mRequestQueueLock);
-    boost::unique_lock<boost::mutex> lockNumConns(mNumConnsLock, boost::defer_lock);
-
-    for (RequestQueueType::iterator req = mRequestQueue.begin(); req != mRequestQueue.end(); ) {
-
-        std::tr1::shared_ptr<TCPSocket> sock;
-
-        //First check the recycle bin to see if there's a connection already open we can use
-        boost::unique_lock<boost::mutex> lockRB(mRecycleBinLock); {
-            RecycleBinType::iterator findRec = mRecycleBin.find((*req)->addr);
-            if (findRec != mRecycleBin.end()) {
-                sock = findRec->second.front();
-                findRec->second.pop();
-                if (findRec->second.size() == 0) {
-                    mRecycleBin.erase(findRec);
-                }
-            }
-        }
-        lockRB.unlock();
+void HttpManager::getRange(
+    Sirikata::Network::Address addr, const String& path, const Range& range,
+    HttpCallback cb, const Headers& headers, const Duration& coalesce_window)
+{
+    //Open ended ranges can't be merged with anything after them
+    if (coalesce_window == Duration::zero() || range.goesToEndOfFile()) {
+        sendRange(addr, path, headers, range, cb);
+        return;
+    }
 
-        if (sock) {
-            //SILOG(transfer, debug, "Reusing a connection for " << (*req)->addr.toString());
-            write_request(sock, *req);
-            req = mRequestQueue.erase(req);
-        } else {
+    //Only requests for the same resource with the same headers can be merged
+    std::ostringstream key_stream;
+    key_stream << addr.toString() << " " << path;
+    for(Headers::const_iterator it = headers.begin(); it != headers.end(); it++)
+        key_stream << "\r\n" << it->first << ": " << it->second;
+    String key = key_stream.str();
+
+    boost::unique_lock<boost::mutex> lockBatches(mRangeBatchesLock);
+    RangeBatchMap::iterator batch_it = mRangeBatches.find(key);
+    if (batch_it == mRangeBatches.end()) {
+        batch_it = mRangeBatches.insert(
+            RangeBatchMap::value_type(key, new RangeBatch(addr, path, headers))
+        ).first;
+        postCallback(
+            coalesce_window,
+            std::tr1::bind(&HttpManager::flushRangeBatch, this, key),
+            "HttpManager::flushRangeBatch"
+        );
+    }
+    batch_it->second->requests.push_back(RangeRequest(range, cb));
+}
 
-            lockNumConns.lock(); {
-                //If nothing in the recycle bin, let's see if we can open a new connection
-                if (mNumTotalConnections < MAX_TOTAL_CONNECTIONS) {
-                    NumConnsType::iterator findNumC = mNumConnsPerAddr.find((*req)->addr);
-                    if (mNumTotalConnections < MAX_TOTAL_CONNECTIONS &&
-                            (findNumC == mNumConnsPerAddr.end() || findNumC->second < MAX_CONNECTIONS_PER_ENDPOINT)) {
-
-                        //We are safe to open a new connection, but increase counts first
-                        mNumTotalConnections++;
-                        if (findNumC == mNumConnsPerAddr.end()) {
-                           mNumConnsPerAddr[(*req)->addr] = 1;
-                        } else {
-                            mNumConnsPerAddr[(*req)->addr] = findNumC->second + 1;
-                        }
-
-                        //SILOG(transfer, debug, "Creating a new connection for " << (*req)->addr.toString());
-                        TCPResolver::query query((*req)->addr.getHostName(), (*req)->addr.getService(), Network::TCPResolver::query::all_matching);
-                        mResolver->async_resolve(query, boost::bind(&HttpManager::handle_resolve, this, *req,
-                                                boost::asio::placeholders::error, boost::asio::placeholders::iterator));
-
-                        req = mRequestQueue.erase(req);
-                    } else {
-                        //No available recycled connections, can't open a new one, so do nothing
-                        req++;
-                    }
-                } else {
-                    //No available recycled connections, can't open a new one, so do nothing
-                    req++;
-                }
-            } lockNumConns.unlock();
+void HttpManager::sendRange(const Sirikata::Network::Address& addr, const String& path, const Headers& headers,
+    const Range& range, HttpCallback cb)
+{
+    Headers range_headers(headers);
+    range_headers["Range"] = formatRange(range);
+    get(addr, path, cb, range_headers);
+}
+
+void HttpManager::flushRangeBatch(const String& key) {
+    RangeBatch* batch = NULL;
+    {
+        boost::unique_lock<boost::mutex> lockBatches(mRangeBatchesLock);
+        RangeBatchMap::iterator batch_it = mRangeBatches.find(key);
+        if (batch_it == mRangeBatches.end()) return;
+        batch = batch_it->second;
+        mRangeBatches.erase(batch_it);
+    }
+
+    RangeRequestList& requests = batch->requests;
+    std::stable_sort(requests.begin(), requests.end(), &HttpManager::rangeRequestStartsBefore);
+
+    //Collect runs of ranges that touch or overlap, each of which becomes one request
+    RangeRequestList::iterator run_start = requests.begin();
+    while(run_start != requests.end()) {
+        Range::base_type start = run_start->range.startbyte();
+        Range::base_type end = run_start->range.endbyte();
+        RangeRequestList::iterator run_end = run_start + 1;
+        while(run_end != requests.end() && run_end->range.startbyte() <= end + 1) {
+            Range::base_type new_end = std::max(end, run_end->range.endbyte());
+            if (new_end - start + 1 > MAX_COALESCED_RANGE_BYTES)
+                break;
+            end = new_end;
+            run_end++;
         }
+
+        if (run_end - run_start == 1) {
+            sendRange(batch->addr, batch->path, batch->headers, run_start->range, run_start->cb);
+        }
+        else {
+            std::tr1::shared_ptr<RangeRequestList> run(new RangeRequestList(run_start, run_end));
+            Range merged(start, end - start + 1, LENGTH, false);
+            mStats.coalesced += run->size();
+            mStats.coalescedInto++;
+            sendRange(
+                batch->addr, batch->path, batch->headers, merged,
+                std::tr1::bind(&HttpManager::handle_coalesced_response, this,
+                    run, merged, batch->addr, batch->path, batch->headers, _1, _2, _3)
+            );
+        }
+        run_start = run_end;
     }
 
-    lockQueue.unlock();
+    delete batch;
 }
 
-void HttpManager::decrement_connection(const Sirikata::Network::Address& addr) {
-    //SILOG(transfer, debug, "Reducing number of connections by 1 for " << addr.toString());
-    boost::unique_lock<boost::mutex> lockNumConns(mNumConnsLock); {
-        mNumTotalConnections--;
-        NumConnsType::iterator findNumC = mNumConnsPerAddr.find(addr);
-        if (findNumC != mNumConnsPerAddr.end()) {
-            if (findNumC->second == 1) {
-                mNumConnsPerAddr.erase(findNumC);
-            } else {
-                mNumConnsPerAddr[addr] = findNumC->second - 1;
-            }
+void HttpManager::handle_coalesced_response(std::tr1::shared_ptr<RangeRequestList> requests, Range merged,
+    Sirikata::Network::Address addr, String path, Headers headers,
+    std::tr1::shared_ptr<HttpResponse> response, ERR_TYPE error, const boost::system::error_code& boost_error)
+{
+    //Each of the requests would have failed in the same way
+    if (error != SUCCESS) {
+        for(RangeRequestList::iterator it = requests->begin(); it != requests->end(); it++)
+            it->cb(response, error, boost_error);
+        return;
+    }
+
+    //We can only split the response up if the server says it's exactly the
+    //merged range. Anything else, e.g. a 200 because it ignored the Range
+    //header, might happen to be the right length but not the right bytes, so
+    //make the requests separately so each is handled as if it had never been
+    //merged
+    std::tr1::shared_ptr<DenseData> data = response->getData();
+    uint64 first = 0, last = 0;
+    //The total size is the same for every piece
+    String total_size;
+    Headers::const_iterator findRange = response->mHeaders.find("Content-Range");
+    if (response->getStatusCode() != 206 ||
+        findRange == response->mHeaders.end() ||
+        !parseContentRange(findRange->second, &first, &last, &total_size) ||
+        first != (uint64)merged.startbyte() || last != (uint64)merged.endbyte() ||
+        !data || data->length() != merged.length())
+    {
+        SILOG(transfer, detailed, "Coalesced range request for " << path << " didn't return the requested range, retrying "
+            << requests->size() << " requests separately");
+        for(RangeRequestList::iterator it = requests->begin(); it != requests->end(); it++)
+            sendRange(addr, path, headers, it->range, it->cb);
+        return;
+    }
+
+    boost::system::error_code ec;
+    for(RangeRequestList::iterator it = requests->begin(); it != requests->end(); it++) {
+        const Range& range = it->range;
+
+        std::tr1::shared_ptr<HttpResponse> piece(new HttpResponse());
+        piece->mHeaders = response->mHeaders;
+        piece->mHeaders["Content-Length"] = boost::lexical_cast<String>(range.length());
+        piece->mHeaders["Content-Range"] = "bytes " + boost::lexical_cast<String>(range.startbyte()) + "-" +
+            boost::lexical_cast<String>(range.endbyte()) + "/" + total_size;
+        piece->mHeaderComplete = true;
+        piece->mMessageComplete = true;
+        piece->mParserFlags = response->mParserFlags;
+        piece->mKeepAlive = response->mKeepAlive;
+        piece->mStatusCode = response->mStatusCode;
+        piece->mContentLength = range.length();
+        piece->mData.reset(new DenseData(Range(true)));
+        piece->mData->append(
+            (const char*)(data->data() + (range.startbyte() - merged.startbyte())),
+            (size_t)range.length(), true
+        );
+        //The bytes on the wire were shared, so only count them once
+        if (it == requests->begin()) {
+            piece->mBytesSent = response->mBytesSent;
+            piece->mBytesReceived = response->mBytesReceived;
         }
+
+        it->cb(piece, SUCCESS, ec);
+    }
+}
+
+
+
+HttpManager::HostPool* HttpManager::getHostPool(const Sirikata::Network::Address& addr) {
+    {
+        boost::shared_lock<boost::shared_mutex> lockPools(mHostPoolsLock);
+        HostPoolMap::iterator findPool = mHostPools.find(addr);
+        if (findPool != mHostPools.end())
+            return findPool->second;
+    }
+
+    boost::unique_lock<boost::shared_mutex> lockPools(mHostPoolsLock);
+    HostPool*& pool = mHostPools[addr];
+    if (pool == NULL)
+        pool = new HostPool();
+    return pool;
+}
+
+bool HttpManager::reserveConnection() {
+    while(true) {
+        uint32 current = mNumTotalConnections.read();
+        if (current >= MAX_TOTAL_CONNECTIONS)
+            return false;
+        if (mNumTotalConnections.compareAndSwap(current, current + 1))
+            return true;
     }
-    lockNumConns.unlock();
 }
 
 void HttpManager::add_req(std::tr1::shared_ptr<HttpRequest> req) {
-    boost::unique_lock<boost::mutex> lockQueue(mRequestQueueLock);
-    mRequestQueue.push_back(req);
-    lockQueue.unlock();
+    HostPool* pool = getHostPool(req->addr);
+    boost::unique_lock<boost::mutex> lockPool(pool->mutex);
+    pool->queue.push_back(req);
+    processQueue(pool);
 }
 
-void HttpManager::handle_resolve(std::tr1::shared_ptr<HttpRequest> req, const boost::system::error_code& err,
-        TCPResolver::iterator endpoint_iterator) {
-    if (!err) {
-        TCPEndPoint endpoint = *endpoint_iterator;
-        std::tr1::shared_ptr<TCPSocket> socket(new TCPSocket(*(mServicePool->service())));
-        socket->async_connect(endpoint, boost::bind(
-                &HttpManager::handle_connect, this, socket, req,
-                boost::asio::placeholders::error, ++endpoint_iterator));
-    } else {
-        SILOG(transfer, error, "Failed to resolve hostname. Error = " << err.message());
-        decrement_connection(req->addr);
+void HttpManager::processAllQueues() {
+    std::vector<HostPool*> pools;
+    {
+        boost::shared_lock<boost::shared_mutex> lockPools(mHostPoolsLock);
+        for(HostPoolMap::iterator it = mHostPools.begin(); it != mHostPools.end(); it++)
+            pools.push_back(it->second);
+    }
+
+    for(std::vector<HostPool*>::iterator it = pools.begin(); it != pools.end(); it++) {
+        boost::unique_lock<boost::mutex> lockPool((*it)->mutex);
+        processQueue(*it);
+    }
+}
+
+void HttpManager::processQueue(HostPool* pool) {
+    SILOG(transfer, insane, "processQueue called, mNumTotalConnections = "
+            << mNumTotalConnections.read() << " and connections to host = " << pool->connections.size()
+            << " and request queue size = " << pool->queue.size());
+
+    //Once a GET can't be sent, none of the ones behind it can either, and
+    //likewise for other requests, which need an idle connection
+    bool getsBlocked = false, othersBlocked = false;
+    for (RequestQueueType::iterator req = pool->queue.begin(); req != pool->queue.end() && !(getsBlocked && othersBlocked); ) {
+        bool isGet = ((*req)->method == GET);
+        if ((isGet && getsBlocked) || (!isGet && othersBlocked)) {
+            req++;
+            continue;
+        }
 
-        req->mNumTries++;
-        if (req->mNumTries > 10) {
-            //This means this connection has gotten an error over 10 times. Let's stop trying
-            //TODO: this should probably be configurable
-            req->cb(std::tr1::shared_ptr<HttpResponse>(), BOOST_ERROR, boost::asio::error::host_not_found);
+        //Prefer an idle connection, then a new one so requests are spread
+        //across connections, and only then pipeline behind other requests
+        HttpConnectionPtr conn = findConnection(pool, *req, false);
+        if (!conn && pool->connections.size() < MAX_CONNECTIONS_PER_ENDPOINT && reserveConnection())
+            conn = open_connection(pool, (*req)->addr);
+        if (!conn)
+            conn = findConnection(pool, *req, true);
+
+        if (conn) {
+            send_request(conn, *req);
+            req = pool->queue.erase(req);
         } else {
-            add_req(req);
+            //No available connections, can't open a new one, so do nothing
+            if (isGet)
+                getsBlocked = true;
+            else
+                othersBlocked = true;
+            req++;
         }
+    }
+}
 
-        add_req(req);
-        processQueue();
+HttpManager::HttpConnectionPtr HttpManager::findConnection(HostPool* pool, std::tr1::shared_ptr<HttpRequest> req, bool pipeline) {
+    HttpConnectionPtr best;
+    for(ConnectionList::iterator it = pool->connections.begin(); it != pool->connections.end(); it++) {
+        const HttpConnectionPtr& conn = *it;
+        if (conn->outstanding.empty())
+            return conn;
+        if (!pipeline)
+            continue;
+
+        //Only GETs are pipelined, so if the first outstanding request is a
+        //GET, they all are
+        if (req->method != GET || conn->outstanding.front()->method != GET ||
+            !conn->persistent || conn->outstanding.size() >= mPipelineDepth)
+            continue;
+        if (!best || conn->outstanding.size() < best->outstanding.size())
+            best = conn;
     }
+    return best;
 }
 
-void HttpManager::write_request(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req) {
-    std::tr1::shared_ptr<boost::asio::streambuf> request_ptr(new boost::asio::streambuf());
-    std::ostream request_stream(request_ptr.get());
-    request_stream << req->req;
-    boost::asio::async_write(*socket, *request_ptr, boost::bind(
-            &HttpManager::handle_write_request, this, socket, req,
-            boost::asio::placeholders::error, request_ptr));
+HttpManager::HttpConnectionPtr HttpManager::open_connection(HostPool* pool, const Sirikata::Network::Address& addr) {
+    //SILOG(transfer, debug, "Creating a new connection for " << addr.toString());
+    HttpConnectionPtr conn(new HttpConnection(pool, addr));
+
+    //Initialize http parser settings callbacks
+    conn->mHttpSettings = EMPTY_PARSER_SETTINGS;
+    conn->mHttpSettings.on_message_begin = &HttpManager::on_message_begin;
+    conn->mHttpSettings.on_header_field = &HttpManager::on_header_field;
+    conn->mHttpSettings.on_header_value = &HttpManager::on_header_value;
+    conn->mHttpSettings.on_body = &HttpManager::on_body;
+    conn->mHttpSettings.on_headers_complete = &HttpManager::on_headers_complete;
+    conn->mHttpSettings.on_message_complete = &HttpManager::on_message_complete;
+
+    pool->connections.push_back(conn);
+    mStats.connections++;
+
+    TCPResolver::query query(addr.getHostName(), addr.getService(), Network::TCPResolver::query::all_matching);
+    boost::unique_lock<boost::mutex> lockResolver(mResolverLock);
+    mResolver->async_resolve(query, boost::bind(&HttpManager::handle_resolve, this, conn,
+                    boost::asio::placeholders::error, boost::asio::placeholders::iterator));
+
+    return conn;
 }
 
-void HttpManager::handle_connect(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
-        const boost::system::error_code& err, TCPResolver::iterator endpoint_iterator) {
-    if (!err) {
-        write_request(socket, req);
-    } else if (endpoint_iterator != TCPResolver::iterator()) {
-        socket->close();
-        TCPEndPoint endpoint = *endpoint_iterator;
-        socket->async_connect(endpoint, boost::bind(
-                &HttpManager::handle_connect, this, socket, req,
-                boost::asio::placeholders::error, ++endpoint_iterator));
+void HttpManager::send_request(HttpConnectionPtr conn, std::tr1::shared_ptr<HttpRequest> req) {
+    if (conn->outstanding.empty()) {
+        //Idle connection, so start parsing responses from scratch
+        http_parser_init(&(conn->mHttpParser), HTTP_RESPONSE);
+
+        /*
+         * http-parser library uses this void * parameter to callbacks for user-defined data
+         * Store a pointer to the HttpConnection object so we can access it during static callbacks
+         */
+        conn->mHttpParser.data = static_cast<void *>(conn.get());
+        conn->currentResponse.reset();
+        conn->bytesReceived = 0;
     } else {
-        SILOG(transfer, error, "Failed to connect. Error = " << err.message());
-        decrement_connection(req->addr);
+        mStats.pipelined++;
+    }
+    if (conn->numRequests > 0)
+        mStats.reused++;
+    mStats.requests++;
+
+    conn->numRequests++;
+    conn->outstanding.push_back(req);
+    conn->pendingWrite.append(req->req);
+    start_write(conn);
+}
 
-        req->mNumTries++;
-        if (req->mNumTries > 10) {
-            //This means this connection has gotten an error over 10 times. Let's stop trying
-            //TODO: this should probably be configurable
-            req->cb(std::tr1::shared_ptr<HttpResponse>(), BOOST_ERROR, boost::asio::error::host_unreachable);
-        } else {
-            add_req(req);
-        }
+void HttpManager::start_write(HttpConnectionPtr conn) {
+    if (!conn->connected || conn->writing || conn->pendingWrite.empty())
+        return;
 
-        processQueue();
+    //Everything queued up goes out in one write
+    std::tr1::shared_ptr<std::string> request_data(new std::string());
+    request_data->swap(conn->pendingWrite);
+    conn->writing = true;
+    boost::asio::async_write(*(conn->socket), boost::asio::buffer(*request_data), boost::bind(
+            &HttpManager::handle_write, this, conn, request_data,
+            boost::asio::placeholders::error));
+}
+
+void HttpManager::start_read(HttpConnectionPtr conn) {
+    if (conn->reading || conn->outstanding.empty())
+        return;
+
+    conn->reading = true;
+    conn->socket->async_read_some(boost::asio::buffer(conn->readBuffer), boost::bind(
+            &HttpManager::handle_read, this, conn,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred));
+}
+
+void HttpManager::close_connection(HttpConnectionPtr conn) {
+    //SILOG(transfer, debug, "Closing a connection for " << conn->addr.toString());
+    if (conn->closed) return;
+
+    conn->closed = true;
+    if (conn->socket)
+        conn->socket->close();
+    conn->pool->connections.remove(conn);
+    mNumTotalConnections--;
+}
+
+void HttpManager::requeue_outstanding(HttpConnectionPtr conn, bool count_try, RequestQueueType* failed) {
+    //Put requests back at the front of the queue, in order, so they go out
+    //before anything that arrived after them
+    RequestQueueType retry;
+    for(RequestQueueType::iterator it = conn->outstanding.begin(); it != conn->outstanding.end(); it++) {
+        if (count_try) {
+            (*it)->mNumTries++;
+            if ((*it)->mNumTries > 10) {
+                //This means this request has gotten an error over 10 times. Let's stop trying
+                //TODO: this should probably be configurable
+                failed->push_back(*it);
+                continue;
+            }
+        }
+        retry.push_back(*it);
     }
+    conn->outstanding.clear();
+    conn->pool->queue.splice(conn->pool->queue.begin(), retry);
 }
 
-void HttpManager::handle_write_request(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
-        const boost::system::error_code& err, std::tr1::shared_ptr<boost::asio::streambuf> request_stream) {
+void HttpManager::fail_connection(HttpConnectionPtr conn, bool count_try, const boost::system::error_code& err) {
+    RequestQueueType failed;
+    {
+        boost::unique_lock<boost::mutex> lockPool(conn->pool->mutex);
+        if (conn->closed) return;
 
+        close_connection(conn);
+        requeue_outstanding(conn, count_try, &failed);
+        processQueue(conn->pool);
+    }
+
+    for(RequestQueueType::iterator it = failed.begin(); it != failed.end(); it++)
+        (*it)->cb(std::tr1::shared_ptr<HttpResponse>(), BOOST_ERROR, err);
+
+    processAllQueues();
+}
+
+void HttpManager::handle_resolve(HttpConnectionPtr conn, const boost::system::error_code& err,
+        TCPResolver::iterator endpoint_iterator) {
     if (err) {
-        socket->close();
-        SILOG(transfer, error, "Failed to write. Error = " << err.message());
-        decrement_connection(req->addr);
-        add_req(req);
-        processQueue();
+        SILOG(transfer, error, "Failed to resolve hostname. Error = " << err.message());
+        fail_connection(conn, true, boost::asio::error::host_not_found);
         return;
     }
 
-    //Create a new response object
-    std::tr1::shared_ptr<HttpResponse> respPtr(new HttpResponse());
-    respPtr->mBytesSent = req->req.size();
+    boost::unique_lock<boost::mutex> lockPool(conn->pool->mutex);
+    if (conn->closed) return;
 
-    //Initiate an empty DenseData
-    std::tr1::shared_ptr<DenseData> emptyData(new DenseData(Range(true)));
-    respPtr->mData = emptyData;
+    TCPEndPoint endpoint = *endpoint_iterator;
+    conn->socket.reset(new TCPSocket(*(mServicePool->service())));
+    conn->socket->async_connect(endpoint, boost::bind(
+            &HttpManager::handle_connect, this, conn,
+            boost::asio::placeholders::error, ++endpoint_iterator));
+}
 
-    //Initialize http parser settings callbacks
-    respPtr->mHttpSettings = EMPTY_PARSER_SETTINGS;
-    respPtr->mHttpSettings.on_header_field = &HttpManager::on_header_field;
-    respPtr->mHttpSettings.on_header_value = &HttpManager::on_header_value;
-    respPtr->mHttpSettings.on_body = &HttpManager::on_body;
-    respPtr->mHttpSettings.on_headers_complete = &HttpManager::on_headers_complete;
-    respPtr->mHttpSettings.on_message_complete = &HttpManager::on_message_complete;
+void HttpManager::handle_connect(HttpConnectionPtr conn,
+        const boost::system::error_code& err, TCPResolver::iterator endpoint_iterator) {
+    boost::unique_lock<boost::mutex> lockPool(conn->pool->mutex);
+    if (conn->closed) return;
 
-    //Initialize the parser for parsing a response
-    http_parser_init(&(respPtr->mHttpParser), HTTP_RESPONSE);
+    if (!err) {
+        conn->connected = true;
+        start_write(conn);
+    } else if (endpoint_iterator != TCPResolver::iterator()) {
+        conn->socket->close();
+        TCPEndPoint endpoint = *endpoint_iterator;
+        conn->socket->async_connect(endpoint, boost::bind(
+                &HttpManager::handle_connect, this, conn,
+                boost::asio::placeholders::error, ++endpoint_iterator));
+    } else {
+        lockPool.unlock();
+        SILOG(transfer, error, "Failed to connect. Error = " << err.message());
+        fail_connection(conn, true, boost::asio::error::host_unreachable);
+    }
+}
 
-    /*
-     * http-parser library uses this void * parameter to callbacks for user-defined data
-     * Store a pointer to the HttpResponse object so we can access it during static callbacks
-     */
-    respPtr->mHttpParser.data = static_cast<void *>(respPtr.get());
+void HttpManager::handle_write(HttpConnectionPtr conn, std::tr1::shared_ptr<std::string> request_data,
+        const boost::system::error_code& err) {
+    boost::unique_lock<boost::mutex> lockPool(conn->pool->mutex);
+    conn->writing = false;
+    if (conn->closed) return;
 
-    //Create a buffer for receiving from socket
-    std::tr1::shared_ptr<std::vector<unsigned char> > vecbuf(new std::vector<unsigned char>(SOCKET_BUFFER_SIZE));
+    if (err) {
+        lockPool.unlock();
+        SILOG(transfer, error, "Failed to write. Error = " << err.message());
+        fail_connection(conn, false, err);
+        return;
+    }
 
-    //Read some data
-    socket->async_read_some(boost::asio::buffer(*vecbuf), boost::bind(
-            &HttpManager::handle_read, this, socket, req, vecbuf, respPtr,
-            boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
+    //Send anything that was pipelined while we were writing, and make sure
+    //we're reading responses
+    start_write(conn);
+    start_read(conn);
 }
 
-void HttpManager::handle_read(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
-        std::tr1::shared_ptr<std::vector<unsigned char> > vecbuf, std::tr1::shared_ptr<HttpResponse> respPtr,
+void HttpManager::handle_read(HttpConnectionPtr conn,
         const boost::system::error_code& err, std::size_t bytes_transferred) {
 
     SILOG(transfer, insane, "handle_read triggered with bytes_transferred = " << bytes_transferred << " EOF? "
             << (err == boost::asio::error::eof ? "Y" : "N"));
 
+    HostPool* pool = conn->pool;
+    boost::unique_lock<boost::mutex> lockPool(pool->mutex);
+    conn->reading = false;
+    if (conn->closed) return;
+
     if ((err || bytes_transferred == 0) && err != boost::asio::error::eof) {
-        SILOG(transfer, error, "Failed to write. Error = " << err.message());
-        socket->close();
-        decrement_connection(req->addr);
-        add_req(req);
-        processQueue();
+        lockPool.unlock();
+        SILOG(transfer, error, "Failed to read. Error = " << err.message());
+        fail_connection(conn, false, err);
         return;
     }
 
-    respPtr->mBytesReceived += bytes_transferred;
-
-    //Parse the data we just got back from the socket
-    size_t nparsed = http_parser_execute(&(respPtr->mHttpParser), &(respPtr->mHttpSettings),
-            (const char *)(&((*vecbuf)[0])), bytes_transferred);
-
-    boost::system::error_code ec;
-    if (nparsed != bytes_transferred) {
-        SILOG(transfer, warning, "Failed to parse http response. nparsed=" << nparsed << " while bytes_transferred=" << bytes_transferred);
-        req->cb(std::tr1::shared_ptr<HttpResponse>(), RESPONSE_PARSING_FAILED, ec);
-        socket->close();
-        decrement_connection(req->addr);
-        processQueue();
-        return;
+    conn->bytesReceived += bytes_transferred;
+
+    //Parse the data we just got back from the socket. With pipelining this
+    //may finish any number of responses.
+    bool parse_failed = false;
+    if (bytes_transferred != 0) {
+        size_t nparsed = http_parser_execute(&(conn->mHttpParser), &(conn->mHttpSettings),
+                (const char *)(&(conn->readBuffer[0])), bytes_transferred);
+        if (nparsed != bytes_transferred) {
+            SILOG(transfer, warning, "Failed to parse http response. nparsed=" << nparsed << " while bytes_transferred=" << bytes_transferred);
+            parse_failed = true;
+        }
     }
-
-    if (err == boost::asio::error::eof && bytes_transferred != 0) {
-        //Pass 0 as fourth parameter to parser to tell it that we got EOF
-        size_t nparsed = http_parser_execute(&(respPtr->mHttpParser), &(respPtr->mHttpSettings),
-                (const char *)(&((*vecbuf)[0])), 0);
+    if (!parse_failed && err == boost::asio::error::eof) {
+        //Pass 0 as length to tell the parser that we got EOF
+        size_t nparsed = http_parser_execute(&(conn->mHttpParser), &(conn->mHttpSettings),
+                (const char *)(&(conn->readBuffer[0])), 0);
         if (nparsed != 0) {
             SILOG(transfer, warning, "Failed to parse http response when giving EOF. nparsed=" << nparsed);
-            req->cb(std::tr1::shared_ptr<HttpResponse>(), RESPONSE_PARSING_FAILED, ec);
-            socket->close();
-            decrement_connection(req->addr);
-            processQueue();
-            return;
+            parse_failed = true;
         }
-
     }
 
-    if ((req->method == HEAD && respPtr->mHeaderComplete) ||
-        ((req->method == GET || req->method == POST) && respPtr->mMessageComplete)) {
-        //We're done
-
-        //If we didn't get any body data, erase the DenseData pointer
-        if (respPtr->mData->length() == 0) {
-            respPtr->mData.reset();
+    //Match up finished responses with the requests they answer
+    typedef std::vector<std::pair<std::tr1::shared_ptr<HttpRequest>, std::tr1::shared_ptr<HttpResponse> > > FinishedList;
+    FinishedList finished;
+    bool close = (err == boost::asio::error::eof);
+    while(!conn->completed.empty()) {
+        std::tr1::shared_ptr<HttpResponse> respPtr = conn->completed.front();
+        conn->completed.pop_front();
+        std::tr1::shared_ptr<HttpRequest> req = conn->outstanding.front();
+        conn->outstanding.pop_front();
+
+        respPtr->mBytesSent = req->req.size();
+        finished.push_back(std::make_pair(req, respPtr));
+
+        //If the server is closing the connection, e.g. Connection: close or
+        //HTTP/1.0 without keep-alive, nothing after it will be answered
+        if (!respPtr->mKeepAlive) {
+            close = true;
+            conn->completed.clear();
+            break;
         }
+        conn->persistent = true;
+    }
 
-        SILOG(transfer, detailed, "Finished http transfer with content length of " << respPtr->getContentLength());
-        Headers::const_iterator findLocation;
-        findLocation = respPtr->mHeaders.find("Location");
-        if (respPtr->getStatusCode() == 301 && findLocation != respPtr->mHeaders.end() && req->allow_redirects) {
-            SILOG(transfer, detailed, "Got a 301 redirect reply and location = " << findLocation->second);
-            std::ostringstream request_stream;
-            std::string request_method = methodAsString(req->method);
-            URL newURI(findLocation->second.c_str());
-            request_stream << request_method << " " << newURI.fullpath() << " HTTP/1.1\r\n";
-            Headers::const_iterator it;
-            for (it = req->mHeaders.begin(); it != req->mHeaders.end(); it++) {
-            	if (it->first == "Host") {
-            		request_stream << "Host: " << newURI.host() << "\r\n";
-            	} else {
-            		request_stream << it->first << ": " << it->second << "\r\n";
-            	}
-            }
-            request_stream << "\r\n";
-            Network::Address newaddr(newURI.host(), newURI.proto());
-            makeRequest(newaddr, req->method, request_stream.str(), req->allow_redirects, req->cb);
-        } else {
-            req->cb(respPtr, SUCCESS, ec);
+    RequestQueueType unparseable, failed;
+    if (parse_failed) {
+        //We can't tell where the next response would start, so give up on
+        //the connection
+        if (!conn->outstanding.empty()) {
+            unparseable.push_back(conn->outstanding.front());
+            conn->outstanding.pop_front();
         }
+        close = true;
+    }
 
-        //If this is Connection: Close or we reached EOF, then close connection, otherwise recycle
-        if ((respPtr->mHttpParser.flags & F_CONNECTION_CLOSE) || err == boost::asio::error::eof) {
-            socket->close();
-            decrement_connection(req->addr);
-        } else {
-            boost::unique_lock<boost::mutex> lockRB(mRecycleBinLock);
-            mRecycleBin[req->addr].push(socket);
-            lockRB.unlock();
-        }
-        processQueue();
-
-    } else if(err == boost::asio::error::eof || bytes_transferred == 0) {
-        SILOG(transfer, warning, "EOF was true or bytes_transferred==0 and the parser wasn't finished, so connection is broken");
-        socket->close();
-        decrement_connection(req->addr);
-
-        req->mNumTries++;
-        if (req->mNumTries > 10) {
-            //This means this connection has gotten an error over 10 times. Let's stop trying
-            //TODO: this should probably be configurable
-            req->cb(std::tr1::shared_ptr<HttpResponse>(), BOOST_ERROR, boost::asio::error::eof);
-        } else {
-            add_req(req);
-        }
+    if (close) {
+        //Anything still outstanding is retried on another connection. If we
+        //were in the middle of a response, the connection broke and that
+        //counts against the requests.
+        bool broken = (conn->currentResponse && !parse_failed);
+        if (broken)
+            SILOG(transfer, warning, "EOF was true and the parser wasn't finished, so connection is broken");
+        close_connection(conn);
+        requeue_outstanding(conn, broken, &failed);
+    } else {
+        //Keep reading if there are more responses coming
+        start_read(conn);
+    }
+    processQueue(pool);
+    lockPool.unlock();
 
-        processQueue();
-        return;
+    for(FinishedList::iterator it = finished.begin(); it != finished.end(); it++)
+        handle_response(it->first, it->second);
+
+    boost::system::error_code ec;
+    for(RequestQueueType::iterator it = unparseable.begin(); it != unparseable.end(); it++)
+        (*it)->cb(std::tr1::shared_ptr<HttpResponse>(), RESPONSE_PARSING_FAILED, ec);
+    for(RequestQueueType::iterator it = failed.begin(); it != failed.end(); it++)
+        (*it)->cb(std::tr1::shared_ptr<HttpResponse>(), BOOST_ERROR, boost::asio::error::eof);
+
+    if (close)
+        processAllQueues();
+}
+
+void HttpManager::handle_response(std::tr1::shared_ptr<HttpRequest> req, std::tr1::shared_ptr<HttpResponse> respPtr) {
+    boost::system::error_code ec;
+
+    //If we didn't get any body data, erase the DenseData pointer
+    if (respPtr->mData->length() == 0) {
+        respPtr->mData.reset();
+    }
+
+    SILOG(transfer, detailed, "Finished http transfer with content length of " << respPtr->getContentLength());
+    Headers::const_iterator findLocation;
+    findLocation = respPtr->mHeaders.find("Location");
+    if (respPtr->getStatusCode() == 301 && findLocation != respPtr->mHeaders.end() && req->allow_redirects) {
+        SILOG(transfer, detailed, "Got a 301 redirect reply and location = " << findLocation->second);
+        std::ostringstream request_stream;
+        std::string request_method = methodAsString(req->method);
+        URL newURI(findLocation->second.c_str());
+        request_stream << request_method << " " << newURI.fullpath() << " HTTP/1.1\r\n";
+        Headers::const_iterator it;
+        for (it = req->mHeaders.begin(); it != req->mHeaders.end(); it++) {
+        	if (it->first == "Host") {
+        		request_stream << "Host: " << newURI.host() << "\r\n";
+        	} else {
+        		request_stream << it->first << ": " << it->second << "\r\n";
+        	}
+        }
+        request_stream << "\r\n";
+        Network::Address newaddr(newURI.host(), newURI.proto());
+        makeRequest(newaddr, req->method, request_stream.str(), req->allow_redirects, req->cb);
     } else {
-        //Read some more data
-        socket->async_read_some(boost::asio::buffer(*vecbuf), boost::bind(
-                &HttpManager::handle_read, this, socket, req, vecbuf, respPtr,
-                boost::asio::placeholders::error,
-                boost::asio::placeholders::bytes_transferred));
+        req->cb(respPtr, SUCCESS, ec);
     }
+}
+
+int HttpManager::on_message_begin(http_parser* _) {
+    HttpConnection* conn = static_cast<HttpConnection*>(_->data);
+
+    //Responses arrive in the same order as the requests. If there's no
+    //request left for this one to answer, something is badly wrong.
+    if (conn->completed.size() >= conn->outstanding.size())
+        return 1;
 
+    conn->currentResponse.reset(new HttpResponse());
+    //Initiate an empty DenseData
+    conn->currentResponse->mData.reset(new DenseData(Range(true)));
+    return 0;
 }
 
 int HttpManager::on_headers_complete(http_parser* _) {
     //SILOG(transfer, debug, "headers complete. content length = " << _->content_length);
-    HttpResponse* curResponse = static_cast<HttpResponse*>(_->data);
+    HttpResponse* curResponse = static_cast<HttpConnection*>(_->data)->currentResponse.get();
     curResponse->mContentLength = _->content_length;
     curResponse->mStatusCode = _->status_code;
+    curResponse->mParserFlags = _->flags;
 
     //Check for last header that might not have been saved
     if (curResponse->mLastCallback == VALUE) {
@@ -642,11 +949,20 @@ int HttpManager::on_headers_complete(http_parser* _) {
     }
 
     curResponse->mHeaderComplete = true;
+
+    //Responses to HEAD requests describe a body that isn't sent, so the
+    //parser needs to be told to skip it
+    HttpConnection* conn = static_cast<HttpConnection*>(_->data);
+    RequestQueueType::iterator req = conn->outstanding.begin();
+    std::advance(req, conn->completed.size());
+    if ((*req)->method == HEAD)
+        return 1;
+
     return 0;
 }
 
 int HttpManager::on_header_field(http_parser* _, const char* at, size_t len) {
-    HttpResponse* curResponse = static_cast<HttpResponse*>(_->data);
+    HttpResponse* curResponse = static_cast<HttpConnection*>(_->data)->currentResponse.get();
 
     //See http-parser documentation for why this is necessary
     switch (curResponse->mLastCallback) {
@@ -670,7 +986,7 @@ int HttpManager::on_header_field(http_parser* _, const char* at, size_t len) {
 
 int HttpManager::on_header_value(http_parser* _, const char* at, size_t len) {
     //SILOG(transfer, debug, "on_header_value called");
-    HttpResponse* curResponse = static_cast<HttpResponse*>(_->data);
+    HttpResponse* curResponse = static_cast<HttpConnection*>(_->data)->currentResponse.get();
 
     //See http-parser documentation for why this is necessary
     switch(curResponse->mLastCallback) {
@@ -754,7 +1070,7 @@ int HttpManager::on_request_header_value(http_parser* _, const char* at, size_t
 
 int HttpManager::on_body(http_parser* _, const char* at, size_t len) {
     //SILOG(transfer, debug, "on_body called with length = " << len);
-    HttpResponse* curResponse = static_cast<HttpResponse*>(_->data);
+    HttpResponse* curResponse = static_cast<HttpConnection*>(_->data)->currentResponse.get();
 
     if(curResponse->mGzip) {
         //Gzip encoding, so pass this buffer through a decoder
@@ -769,7 +1085,7 @@ int HttpManager::on_body(http_parser* _, const char* at, size_t len) {
 
 int HttpManager::on_message_complete(http_parser* _) {
     //SILOG(transfer, debug, "message complete. content length = " << _->content_length);
-    HttpResponse* curResponse = static_cast<HttpResponse*>(_->data);
+    HttpResponse* curResponse = static_cast<HttpConnection*>(_->data)->currentResponse.get();
 
     if(curResponse->mGzip) {
         std::stringstream decompressed;
@@ -783,11 +1099,21 @@ int HttpManager::on_message_complete(http_parser* _) {
     }
 
     curResponse->mMessageComplete = true;
+    curResponse->mParserFlags = _->flags;
+    curResponse->mKeepAlive = (http_should_keep_alive(_) != 0);
+
+    //Hand it off to be matched up with its request, and get ready for the
+    //next response on the connection
+    HttpConnection* conn = static_cast<HttpConnection*>(_->data);
+    curResponse->mBytesReceived = conn->bytesReceived;
+    conn->bytesReceived = 0;
+    conn->completed.push_back(conn->currentResponse);
+    conn->currentResponse.reset();
     return 0;
 }
 
 void HttpManager::print_flags(std::tr1::shared_ptr<HttpResponse> resp) {
-    char flags = resp->mHttpParser.flags;
+    char flags = resp->mParserFlags;
     SILOG(transfer, detailed, "Flags are: "
             << (flags & F_CHUNKED ? "F_CHUNKED " : "")
             << (flags & F_CONNECTION_KEEP_ALIVE ? "F_CONNECTION_KEEP_ALIVE " : "")
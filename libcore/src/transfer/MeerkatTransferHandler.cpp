@@ -190,7 +190,8 @@ MeerkatChunkHandler::MeerkatChunkHandler()
  : CDN_HOST_NAME(GetOptionValue<String>(OPT_CDN_HOST)),
    CDN_SERVICE(GetOptionValue<String>(OPT_CDN_SERVICE)),
    CDN_DOWNLOAD_URI_PREFIX(GetOptionValue<String>(OPT_CDN_DOWNLOAD_URI_PREFIX)),
-   mCdnAddr(CDN_HOST_NAME, CDN_SERVICE)
+   mCdnAddr(CDN_HOST_NAME, CDN_SERVICE),
+   mRangeCoalesceWindow(GetOptionValue<Duration>(OPT_CDN_RANGE_COALESCE_WINDOW))
 {
 }
 
@@ -275,15 +276,22 @@ void MeerkatChunkHandler::cache_check_callback(const SparseData* data, const URI
         bool chunkReq = false;
         if(!chunk->getRange().goesToEndOfFile() || chunk->getRange().startbyte() != 0) {
             chunkReq = true;
-            headers["Range"] = "bytes=" + boost::lexical_cast<String>(chunk->getRange().startbyte()) +
-                "-" + boost::lexical_cast<String>(chunk->getRange().endbyte());
         }
 
-        HttpManager::getSingleton().get(
-            cdn_addr, download_uri_prefix + "/" + chunk->getHash().convertToHexString(),
-            std::tr1::bind(&MeerkatChunkHandler::request_finished, this, _1, _2, _3, uri, chunk, chunkReq, callback),
-            headers
+        String path = download_uri_prefix + "/" + chunk->getHash().convertToHexString();
+        HttpManager::HttpCallback request_cb = std::tr1::bind(
+            &MeerkatChunkHandler::request_finished, this, _1, _2, _3, uri, chunk, chunkReq, callback
         );
+        if (chunkReq) {
+            //Chunks of the same file are often requested together, so give
+            //the HttpManager a chance to merge them
+            HttpManager::getSingleton().getRange(
+                cdn_addr, path, chunk->getRange(), request_cb, headers, mRangeCoalesceWindow
+            );
+        }
+        else {
+            HttpManager::getSingleton().get(cdn_addr, path, request_cb, headers);
+        }
     }
 }
 
@@ -0,0 +1,175 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/core/util/Standard.hh>
+#include <sirikata/core/transfer/ShardedMemoryCacheLayer.hpp>
+
+namespace Sirikata {
+namespace Transfer {
+
+ShardedMemoryCacheLayer::ShardedMemoryCacheLayer(cache_usize_type budget, uint32 num_shards, CacheLayer* tryNext)
+ : CacheLayer(tryNext),
+   mBudget(budget),
+   mEvictCursor(0),
+   mUsedBytes(0),
+   mHits(0),
+   mMisses(0),
+   mInsertions(0),
+   mEvictions(0)
+{
+    if (num_shards == 0) num_shards = 1;
+    for(uint32 i = 0; i < num_shards; i++) {
+        Shard* shard = new Shard();
+        shard->hand = shard->clock.end();
+        mShards.push_back(shard);
+    }
+}
+
+ShardedMemoryCacheLayer::~ShardedMemoryCacheLayer() {
+    for(uint32 i = 0; i < mShards.size(); i++) {
+        Shard* shard = mShards[i];
+        for(EntryMap::iterator it = shard->entries.begin(); it != shard->entries.end(); it++)
+            delete it->second;
+        delete shard;
+    }
+    mShards.clear();
+}
+
+ShardedMemoryCacheLayer::Shard& ShardedMemoryCacheLayer::shardFor(const Fingerprint& fileId) {
+    // The low bits of the hash are used by the per-shard hash tables, so use
+    // the next bits to pick the shard.
+    return *mShards[(Fingerprint::Hasher()(fileId) >> 16) % mShards.size()];
+}
+
+uint32 ShardedMemoryCacheLayer::numEntries() {
+    uint32 total = 0;
+    for(uint32 i = 0; i < mShards.size(); i++) {
+        boost::shared_lock<boost::shared_mutex> lock(mShards[i]->mutex);
+        total += mShards[i]->entries.size();
+    }
+    return total;
+}
+
+void ShardedMemoryCacheLayer::removeEntry(Shard& shard, EntryMap::iterator it) {
+    Entry* entry = it->second;
+    if (shard.hand == entry->clockPosition)
+        shard.hand++;
+    shard.clock.erase(entry->clockPosition);
+    mUsedBytes -= (int64)entry->size;
+    shard.entries.erase(it);
+    delete entry;
+}
+
+bool ShardedMemoryCacheLayer::evictOne(Shard& shard) {
+    if (shard.clock.empty()) return false;
+
+    // Each pass either clears a reference bit or evicts, so we find a victim
+    // within two trips around the clock.
+    while(true) {
+        if (shard.hand == shard.clock.end())
+            shard.hand = shard.clock.begin();
+        Entry* entry = *shard.hand;
+        if (entry->referenced.read() != 0) {
+            entry->referenced = 0;
+            shard.hand++;
+            continue;
+        }
+
+        // removeEntry advances the hand past the victim for us
+        EntryMap::iterator it = shard.entries.find(entry->id);
+        assert(it != shard.entries.end());
+        removeEntry(shard, it);
+        mEvictions++;
+        return true;
+    }
+}
+
+void ShardedMemoryCacheLayer::evict() {
+    uint32 empty_shards = 0;
+    while(mUsedBytes.read() > (int64)mBudget && empty_shards < mShards.size()) {
+        Shard& shard = *mShards[(mEvictCursor++) % mShards.size()];
+        boost::unique_lock<boost::shared_mutex> lock(shard.mutex);
+        if (evictOne(shard))
+            empty_shards = 0;
+        else
+            empty_shards++;
+    }
+}
+
+void ShardedMemoryCacheLayer::populateCache(const Fingerprint& fileId, const DenseDataPtr& data) {
+    // Like CachePolicy, refuse anything that would take up more than half the
+    // cache.
+    if (data->length() <= mBudget / 2) {
+        Shard& shard = shardFor(fileId);
+        boost::unique_lock<boost::shared_mutex> lock(shard.mutex);
+
+        EntryMap::iterator it = shard.entries.find(fileId);
+        Entry* entry = NULL;
+        if (it == shard.entries.end()) {
+            entry = new Entry(fileId);
+            shard.entries[fileId] = entry;
+            // Insert just behind the hand so new entries get a full trip
+            // around the clock before being considered.
+            entry->clockPosition = shard.clock.insert(shard.hand, entry);
+            mInsertions++;
+        }
+        else {
+            entry = it->second;
+        }
+        entry->data.addValidData(data);
+        entry->referenced = 1;
+        cache_usize_type new_size = entry->data.getSpaceUsed();
+        mUsedBytes += (int64)new_size - (int64)entry->size;
+        entry->size = new_size;
+    }
+
+    evict();
+
+    CacheLayer::populateParentCaches(fileId, data);
+}
+
+void ShardedMemoryCacheLayer::purgeFromCache(const Fingerprint& fileId) {
+    {
+        Shard& shard = shardFor(fileId);
+        boost::unique_lock<boost::shared_mutex> lock(shard.mutex);
+        EntryMap::iterator it = shard.entries.find(fileId);
+        if (it != shard.entries.end())
+            removeEntry(shard, it);
+    }
+    CacheLayer::purgeFromCache(fileId);
+}
+
+void ShardedMemoryCacheLayer::getData(const Fingerprint& fileId, const Range& requestedRange, const TransferCallback& callback) {
+    bool haveData = false;
+    SparseData foundData;
+    {
+        Shard& shard = shardFor(fileId);
+        boost::shared_lock<boost::shared_mutex> lock(shard.mutex);
+        EntryMap::iterator it = shard.entries.find(fileId);
+        if (it != shard.entries.end() && it->second->data.contains(requestedRange)) {
+            haveData = true;
+            // Only copies the list of DenseDataPtrs, not the data
+            foundData = it->second->data;
+            it->second->referenced = 1;
+        }
+    }
+
+    if (haveData) {
+        mHits++;
+        for (DenseDataList::iterator iter = foundData.DenseDataList::begin();
+             iter != foundData.DenseDataList::end();
+             ++iter)
+        {
+            CacheLayer::populateParentCaches(fileId, iter.getPtr());
+        }
+        callback(&foundData);
+    }
+    else {
+        mMisses++;
+        CacheLayer::getData(fileId, requestedRange, callback);
+    }
+}
+
+} // namespace Transfer
+} // namespace Sirikata
@@ -0,0 +1,623 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/core/util/Standard.hh>
+#include <sirikata/core/transfer/SlabCacheLayer.hpp>
+#include <sirikata/core/util/Paths.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#define O_BINARY 0
+#else
+#include <io.h>
+#define open _open
+#define close _close
+#define read _read
+#define write _write
+#define lseek _lseeki64
+#endif
+
+#define SLABLOG(lvl, msg) SILOG(transfer, lvl, "[SLAB] " << msg)
+
+namespace Sirikata {
+namespace Transfer {
+
+namespace {
+
+const char* DATA_FILENAME = "slab.data";
+const char* INDEX_FILENAME = "slab.index";
+const char INDEX_MAGIC[8] = { 'S', 'K', 'S', 'L', 'A', 'B', '0', '1' };
+
+// Index records are fixed size: op, fingerprint, offset in the data file,
+// start byte, length, whether the range goes to the end of the file.
+enum IndexOp {
+    INDEX_ADD = 1,
+    INDEX_REMOVE = 2,
+    // Only written by compaction, restores the write head
+    INDEX_HEAD = 3
+};
+const size_t INDEX_RECORD_SIZE = 1 + SHA256::static_size + 8 + 8 + 8 + 1;
+
+// Compact when the index has this many more records than live segments
+const uint32 INDEX_COMPACT_SLACK = 4096;
+
+void encodeU64(unsigned char* out, uint64 val) {
+    for(int i = 0; i < 8; i++)
+        out[i] = (unsigned char)((val >> (8*i)) & 0xFF);
+}
+
+uint64 decodeU64(const unsigned char* in) {
+    uint64 val = 0;
+    for(int i = 0; i < 8; i++)
+        val |= ((uint64)in[i]) << (8*i);
+    return val;
+}
+
+uint64 segmentEnd(const Range& r) {
+    return r.startbyte() + r.length();
+}
+
+} // namespace
+
+SlabCacheLayer::SlabCacheLayer(CachePolicy* policy, const String& prefix, cache_usize_type capacity, uint32 num_readers, CacheLayer* tryNext)
+ : CacheLayer(tryNext),
+   mFiles(NULL, policy),
+   mPrefix(),
+   mCapacity(capacity),
+   mHead(0),
+   mDataFD(-1),
+   mMapping(NULL),
+   mIndexFile(NULL),
+   mIndexRecords(0),
+   mWriterThread(NULL),
+   mCleaningUp(false)
+{
+    mPrefix = Path::Get(Path::DIR_TEMP, prefix);
+    if (mPrefix[mPrefix.size()-1] != '/')
+        mPrefix += '/';
+    try {
+        boost::filesystem::create_directories(mPrefix);
+    } catch (boost::filesystem::filesystem_error) {
+        SLABLOG(error, "Couldn't create cache directory " << mPrefix);
+    }
+
+    mFiles.setOwner(this);
+
+    if (openData())
+        loadIndex();
+
+    mWriterThread = new Thread("SlabCacheLayer Writer", std::tr1::bind(&SlabCacheLayer::writerThread, this));
+    if (num_readers == 0) num_readers = 1;
+    for(uint32 i = 0; i < num_readers; i++)
+        mReaderThreads.push_back(new Thread("SlabCacheLayer Reader", std::tr1::bind(&SlabCacheLayer::readerThread, this)));
+}
+
+SlabCacheLayer::~SlabCacheLayer() {
+    mWriteQueue.push(SlabRequestPtr(new SlabRequest(SlabRequest::OPEXIT, Fingerprint(), Range(true))));
+    mWriterThread->join();
+    delete mWriterThread;
+
+    for(uint32 i = 0; i < mReaderThreads.size(); i++)
+        mReadQueue.push(SlabRequestPtr(new SlabRequest(SlabRequest::OPEXIT, Fingerprint(), Range(true))));
+    for(uint32 i = 0; i < mReaderThreads.size(); i++) {
+        mReaderThreads[i]->join();
+        delete mReaderThreads[i];
+    }
+    mReaderThreads.clear();
+
+    // Don't record these removals, we want the entries to still be available
+    // on the next run.
+    mCleaningUp = true;
+    {
+        CacheMap::write_iterator writer(mFiles);
+        writer.eraseAll();
+    }
+
+    if (mIndexFile != NULL)
+        fclose(mIndexFile);
+#ifndef _WIN32
+    if (mMapping != NULL)
+        munmap(mMapping, (size_t)mCapacity);
+#endif
+    if (mDataFD >= 0)
+        close(mDataFD);
+}
+
+bool SlabCacheLayer::openData() {
+    String data_path = mPrefix + DATA_FILENAME;
+    mDataFD = open(data_path.c_str(), O_RDWR|O_CREAT|O_BINARY, 0666);
+    if (mDataFD < 0) {
+        SLABLOG(error, "Failed to open " << data_path << "; reason: " << errno);
+        return false;
+    }
+
+#ifndef _WIN32
+    struct stat st;
+    if (fstat(mDataFD, &st) != 0 || (cache_usize_type)st.st_size != mCapacity) {
+        // Allocate the whole file up front so writes never have to extend it
+        // and the mapping below is valid for its entire length.
+        if (ftruncate(mDataFD, (off_t)mCapacity) != 0) {
+            SLABLOG(error, "Failed to size " << data_path << " to " << mCapacity << " bytes; reason: " << errno);
+            close(mDataFD);
+            mDataFD = -1;
+            return false;
+        }
+#if defined(__linux__)
+        if (posix_fallocate(mDataFD, 0, (off_t)mCapacity) != 0)
+            SLABLOG(detailed, "Couldn't preallocate " << data_path << ", it will be filled in as it's written");
+#endif
+    }
+
+    void* mapping = mmap(NULL, (size_t)mCapacity, PROT_READ|PROT_WRITE, MAP_SHARED, mDataFD, 0);
+    if (mapping == MAP_FAILED)
+        SLABLOG(warn, "Couldn't map " << data_path << ", falling back to read/write");
+    else
+        mMapping = (unsigned char*)mapping;
+#endif
+
+    return true;
+}
+
+void SlabCacheLayer::loadIndex() {
+    String index_path = mPrefix + INDEX_FILENAME;
+
+    bool valid = false;
+    FILE* in = fopen(index_path.c_str(), "rb");
+    if (in != NULL) {
+        unsigned char header[sizeof(INDEX_MAGIC) + 8];
+        if (fread(header, 1, sizeof(header), in) == sizeof(header) &&
+            memcmp(header, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+            decodeU64(header + sizeof(INDEX_MAGIC)) == mCapacity)
+        {
+            valid = true;
+            unsigned char rec[INDEX_RECORD_SIZE];
+            // A partial record at the end means we stopped while writing
+            // it. The data it refers to may not be complete, so just drop it.
+            while(fread(rec, 1, INDEX_RECORD_SIZE, in) == INDEX_RECORD_SIZE) {
+                mIndexRecords++;
+                Fingerprint fileId = Fingerprint::convertFromBinary(rec + 1);
+                uint64 offset = decodeU64(rec + 1 + SHA256::static_size);
+                uint64 start = decodeU64(rec + 1 + SHA256::static_size + 8);
+                uint64 length = decodeU64(rec + 1 + SHA256::static_size + 16);
+                bool to_eof = (rec[INDEX_RECORD_SIZE-1] != 0);
+
+                if (rec[0] == INDEX_ADD) {
+                    if (length == 0 || offset + length > mCapacity) continue;
+                    evictRegion(offset, length, NULL);
+                    Segment seg(Range(start, length, LENGTH, to_eof), offset);
+                    SegmentList& segs = mEntries[fileId];
+                    if (start == 0 && to_eof) {
+                        for(SegmentList::iterator it = segs.begin(); it != segs.end(); it++)
+                            mOffsets.erase(it->offset);
+                        segs.clear();
+                    }
+                    segs.push_back(seg);
+                    mOffsets[offset] = std::make_pair(fileId, length);
+                    mHead = offset + length;
+                }
+                else if (rec[0] == INDEX_REMOVE) {
+                    removeEntry(fileId);
+                }
+                else if (rec[0] == INDEX_HEAD) {
+                    mHead = (offset <= mCapacity ? offset : 0);
+                }
+            }
+        }
+        fclose(in);
+    }
+
+    if (!valid) {
+        // Missing, from an older format or for a different capacity. Nothing
+        // in the data file can be trusted, so start from scratch.
+        mEntries.clear();
+        mOffsets.clear();
+        mHead = 0;
+        mIndexRecords = 0;
+        mIndexFile = fopen(index_path.c_str(), "wb");
+        if (mIndexFile != NULL) {
+            unsigned char header[sizeof(INDEX_MAGIC) + 8];
+            memcpy(header, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+            encodeU64(header + sizeof(INDEX_MAGIC), mCapacity);
+            fwrite(header, 1, sizeof(header), mIndexFile);
+            fflush(mIndexFile);
+        }
+    }
+    else {
+        mIndexFile = fopen(index_path.c_str(), "ab");
+    }
+    if (mIndexFile == NULL)
+        SLABLOG(error, "Failed to open " << index_path << ", cache contents will not survive a restart");
+
+    SLABLOG(info, "Loaded " << mEntries.size() << " entries from " << mPrefix);
+
+    // Register everything with the CachePolicy. If the policy is smaller than
+    // it used to be, it will evict some of these as we go.
+    std::vector<std::pair<Fingerprint, cache_usize_type> > sizes;
+    for(EntryMap::iterator it = mEntries.begin(); it != mEntries.end(); it++) {
+        cache_usize_type total = 0;
+        for(SegmentList::iterator seg_it = it->second.begin(); seg_it != it->second.end(); seg_it++)
+            total += seg_it->range.length();
+        sizes.push_back(std::make_pair(it->first, total));
+    }
+    CacheMap::write_iterator writer(mFiles);
+    for(uint32 i = 0; i < sizes.size(); i++) {
+        if (!mFiles.alloc(sizes[i].second, writer)) {
+            boost::unique_lock<boost::shared_mutex> lock(mSlabMutex);
+            removeEntry(sizes[i].first);
+            continue;
+        }
+        if (writer.insert(sizes[i].first, sizes[i].second)) {
+            *writer = new CacheData;
+            writer.use();
+        }
+    }
+}
+
+void SlabCacheLayer::compactIndex() {
+    if (mIndexFile == NULL) return;
+
+    boost::shared_lock<boost::shared_mutex> slab_lock(mSlabMutex);
+    boost::lock_guard<boost::mutex> index_lock(mIndexMutex);
+
+    if (mIndexRecords < 2 * mOffsets.size() + INDEX_COMPACT_SLACK) return;
+
+    String index_path = mPrefix + INDEX_FILENAME;
+    String temp_path = index_path + ".temp";
+    FILE* out = fopen(temp_path.c_str(), "wb");
+    if (out == NULL) return;
+
+    unsigned char header[sizeof(INDEX_MAGIC) + 8];
+    memcpy(header, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    encodeU64(header + sizeof(INDEX_MAGIC), mCapacity);
+    fwrite(header, 1, sizeof(header), out);
+
+    FILE* old_index = mIndexFile;
+    mIndexFile = out;
+    mIndexRecords = 0;
+    for(EntryMap::iterator it = mEntries.begin(); it != mEntries.end(); it++) {
+        for(SegmentList::iterator seg_it = it->second.begin(); seg_it != it->second.end(); seg_it++)
+            appendIndexRecord(true, it->first, *seg_it);
+    }
+    // Replay leaves the head after the last segment it adds, so record the
+    // real one explicitly.
+    appendIndexRecord(false, Fingerprint::null(), Segment(Range(false), mHead));
+    fclose(out);
+    fclose(old_index);
+
+    rename(temp_path.c_str(), index_path.c_str());
+    mIndexFile = fopen(index_path.c_str(), "ab");
+}
+
+void SlabCacheLayer::appendIndexRecord(bool add, const Fingerprint& fileId, const Segment& seg) {
+    if (mIndexFile == NULL) return;
+
+    unsigned char rec[INDEX_RECORD_SIZE];
+    if (add)
+        rec[0] = INDEX_ADD;
+    else if (fileId == Fingerprint::null())
+        rec[0] = INDEX_HEAD;
+    else
+        rec[0] = INDEX_REMOVE;
+    memcpy(rec + 1, fileId.rawData().data(), SHA256::static_size);
+    encodeU64(rec + 1 + SHA256::static_size, seg.offset);
+    encodeU64(rec + 1 + SHA256::static_size + 8, seg.range.startbyte());
+    encodeU64(rec + 1 + SHA256::static_size + 16, seg.range.length());
+    rec[INDEX_RECORD_SIZE-1] = (seg.range.goesToEndOfFile() ? 1 : 0);
+
+    fwrite(rec, 1, INDEX_RECORD_SIZE, mIndexFile);
+    fflush(mIndexFile);
+    mIndexRecords++;
+}
+
+const SlabCacheLayer::Segment* SlabCacheLayer::findSegment(const Fingerprint& fileId, const Range& range) const {
+    EntryMap::const_iterator it = mEntries.find(fileId);
+    if (it == mEntries.end()) return NULL;
+    for(SegmentList::const_iterator seg_it = it->second.begin(); seg_it != it->second.end(); seg_it++) {
+        if (range.isContainedBy(seg_it->range))
+            return &(*seg_it);
+    }
+    return NULL;
+}
+
+void SlabCacheLayer::evictRegion(uint64 offset, uint64 length, std::vector<Fingerprint>* evicted) {
+    uint64 end = offset + length;
+
+    // Start at the last segment beginning before offset since it may extend
+    // into the region.
+    OffsetMap::iterator it = mOffsets.lower_bound(offset);
+    if (it != mOffsets.begin()) {
+        OffsetMap::iterator prev = it;
+        prev--;
+        if (prev->first + prev->second.second > offset)
+            it = prev;
+    }
+
+    std::vector<Fingerprint> overlapping;
+    for(; it != mOffsets.end() && it->first < end; it++)
+        overlapping.push_back(it->second.first);
+
+    for(uint32 i = 0; i < overlapping.size(); i++) {
+        if (removeEntry(overlapping[i]) && evicted != NULL)
+            evicted->push_back(overlapping[i]);
+    }
+}
+
+bool SlabCacheLayer::removeEntry(const Fingerprint& fileId) {
+    EntryMap::iterator it = mEntries.find(fileId);
+    if (it == mEntries.end()) return false;
+    for(SegmentList::iterator seg_it = it->second.begin(); seg_it != it->second.end(); seg_it++)
+        mOffsets.erase(seg_it->offset);
+    mEntries.erase(it);
+    return true;
+}
+
+void SlabCacheLayer::readSlab(uint64 offset, uint64 length, unsigned char* out) {
+    if (mMapping != NULL) {
+        memcpy(out, mMapping + offset, (size_t)length);
+        return;
+    }
+
+    boost::lock_guard<boost::mutex> lck(mFileMutex);
+    lseek(mDataFD, offset, SEEK_SET);
+    uint64 done = 0;
+    while(done < length) {
+        int nread = read(mDataFD, out + done, (unsigned int)(length - done));
+        if (nread <= 0) break;
+        done += nread;
+    }
+}
+
+void SlabCacheLayer::syncSlab(uint64 offset, uint64 length) {
+#ifndef _WIN32
+    if (mMapping != NULL) {
+        // msync needs a page aligned start
+        static const uint64 page_size = (uint64)sysconf(_SC_PAGESIZE);
+        uint64 aligned = offset - (offset % page_size);
+        if (msync(mMapping + aligned, (size_t)(offset + length - aligned), MS_SYNC) != 0)
+            SLABLOG(warn, "Failed to sync " << length << " bytes at " << offset << "; reason: " << errno);
+        return;
+    }
+#endif
+
+    boost::lock_guard<boost::mutex> lck(mFileMutex);
+#if defined(_WIN32)
+    int result = _commit(mDataFD);
+#elif defined(__linux__)
+    int result = fdatasync(mDataFD);
+#else
+    int result = fsync(mDataFD);
+#endif
+    if (result != 0)
+        SLABLOG(warn, "Failed to sync data file; reason: " << errno);
+}
+
+void SlabCacheLayer::writeSlab(uint64 offset, uint64 length, const unsigned char* in) {
+    if (mMapping != NULL) {
+        memcpy(mMapping + offset, in, (size_t)length);
+        return;
+    }
+
+    boost::lock_guard<boost::mutex> lck(mFileMutex);
+    lseek(mDataFD, offset, SEEK_SET);
+    uint64 done = 0;
+    while(done < length) {
+        int nwritten = write(mDataFD, in + done, (unsigned int)(length - done));
+        if (nwritten <= 0) break;
+        done += nwritten;
+    }
+}
+
+uint32 SlabCacheLayer::numEntries() {
+    boost::shared_lock<boost::shared_mutex> lock(mSlabMutex);
+    return mEntries.size();
+}
+
+cache_usize_type SlabCacheLayer::usedBytes() {
+    boost::shared_lock<boost::shared_mutex> lock(mSlabMutex);
+    cache_usize_type total = 0;
+    for(OffsetMap::iterator it = mOffsets.begin(); it != mOffsets.end(); it++)
+        total += it->second.second;
+    return total;
+}
+
+void SlabCacheLayer::populateCache(const Fingerprint& fileId, const DenseDataPtr& data) {
+    if (mDataFD >= 0) {
+        SlabRequestPtr req(new SlabRequest(SlabRequest::OPWRITE, fileId, *data));
+        req->data = data;
+        mWriteQueue.push(req);
+    }
+
+    CacheLayer::populateParentCaches(fileId, data);
+}
+
+void SlabCacheLayer::destroyCacheEntry(const Fingerprint& fileId, CacheEntry* cacheLayerData, cache_usize_type releaseSize) {
+    if (!mCleaningUp) {
+        boost::unique_lock<boost::shared_mutex> lock(mSlabMutex);
+        if (removeEntry(fileId)) {
+            boost::lock_guard<boost::mutex> index_lock(mIndexMutex);
+            appendIndexRecord(false, fileId, Segment(Range(true), 0));
+        }
+    }
+    CacheData* toDelete = static_cast<CacheData*>(cacheLayerData);
+    delete toDelete;
+}
+
+void SlabCacheLayer::purgeFromCache(const Fingerprint& fileId) {
+    {
+        CacheMap::write_iterator iter(mFiles);
+        if (iter.find(fileId))
+            iter.erase();
+    }
+    CacheLayer::purgeFromCache(fileId);
+}
+
+void SlabCacheLayer::getData(const Fingerprint& fileId, const Range& requestedRange, const TransferCallback& callback) {
+    bool haveRange = false;
+    {
+        boost::shared_lock<boost::shared_mutex> lock(mSlabMutex);
+        haveRange = (findSegment(fileId, requestedRange) != NULL);
+    }
+
+    if (haveRange) {
+        SlabRequestPtr req(new SlabRequest(SlabRequest::OPREAD, fileId, requestedRange));
+        req->finished = callback;
+        mReadQueue.push(req);
+    }
+    else {
+        CacheLayer::getData(fileId, requestedRange, callback);
+    }
+}
+
+void SlabCacheLayer::writerThread() {
+    while(true) {
+        SlabRequestPtr req;
+        mWriteQueue.blockingPop(req);
+        if (req->op == SlabRequest::OPEXIT)
+            break;
+        handleWrite(req);
+        compactIndex();
+    }
+}
+
+void SlabCacheLayer::readerThread() {
+    while(true) {
+        SlabRequestPtr req;
+        mReadQueue.blockingPop(req);
+        if (req->op == SlabRequest::OPEXIT)
+            break;
+        handleRead(req);
+    }
+}
+
+void SlabCacheLayer::handleWrite(const SlabRequestPtr& req) {
+    const Fingerprint& fileId = req->fileId;
+    const DenseDataPtr& data = req->data;
+    uint64 length = data->length();
+    if (length == 0 || length > mCapacity) return;
+
+    {
+        boost::shared_lock<boost::shared_mutex> lock(mSlabMutex);
+        if (findSegment(fileId, *data) != NULL) return;
+    }
+
+    // Reserve space at the head of the ring. Anything stored there is
+    // dropped, and once it's out of mEntries no reader can start copying
+    // from it. Readers already copying from it hold mSlabMutex, so taking it
+    // exclusively here waits for them.
+    uint64 offset;
+    std::vector<Fingerprint> evicted;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(mSlabMutex);
+        if (mHead + length > mCapacity)
+            mHead = 0;
+        offset = mHead;
+        mHead += length;
+        evictRegion(offset, length, &evicted);
+    }
+    // The CacheMap has to be updated without holding mSlabMutex since
+    // destroyCacheEntry acquires them in the opposite order. The entries are
+    // already gone, so this just releases their space in the policy.
+    for(uint32 i = 0; i < evicted.size(); i++) {
+        CacheMap::write_iterator writer(mFiles);
+        if (writer.find(evicted[i]))
+            writer.erase();
+    }
+
+    writeSlab(offset, length, data->data());
+    // The index record is what makes the data visible after a restart, so
+    // the data has to reach the disk first. Otherwise a crash could leave a
+    // record pointing at whatever was in the region before.
+    syncSlab(offset, length);
+
+    Segment seg(*data, offset);
+    cache_usize_type total = 0;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(mSlabMutex);
+        SegmentList& segs = mEntries[fileId];
+        // A complete copy makes any partial ranges we had redundant
+        if (seg.range.startbyte() == 0 && seg.range.goesToEndOfFile()) {
+            for(SegmentList::iterator it = segs.begin(); it != segs.end(); it++)
+                mOffsets.erase(it->offset);
+            segs.clear();
+        }
+        segs.push_back(seg);
+        mOffsets[offset] = std::make_pair(fileId, length);
+        for(SegmentList::iterator it = segs.begin(); it != segs.end(); it++)
+            total += it->range.length();
+
+        boost::lock_guard<boost::mutex> index_lock(mIndexMutex);
+        appendIndexRecord(true, fileId, seg);
+    }
+
+    CacheMap::write_iterator writer(mFiles);
+    bool cachable = mFiles.alloc(length, writer);
+    // Allocating may have evicted this entry itself
+    bool present;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(mSlabMutex);
+        present = (mEntries.find(fileId) != mEntries.end());
+        if (present && !cachable) {
+            removeEntry(fileId);
+            boost::lock_guard<boost::mutex> index_lock(mIndexMutex);
+            appendIndexRecord(false, fileId, seg);
+        }
+    }
+    if (!cachable || !present) return;
+
+    if (writer.insert(fileId, total)) {
+        *writer = new CacheData;
+        writer.use();
+    }
+    else {
+        writer.update(total);
+    }
+}
+
+void SlabCacheLayer::handleRead(const SlabRequestPtr& req) {
+    MutableDenseDataPtr datum;
+    {
+        boost::shared_lock<boost::shared_mutex> lock(mSlabMutex);
+        const Segment* seg = findSegment(req->fileId, req->range);
+        if (seg != NULL) {
+            uint64 start = req->range.startbyte();
+            uint64 seg_end = segmentEnd(seg->range);
+            uint64 end = seg_end;
+            if (!req->range.goesToEndOfFile() && segmentEnd(req->range) < seg_end)
+                end = segmentEnd(req->range);
+            if (end > start) {
+                Range toRead(start, end - start, LENGTH, seg->range.goesToEndOfFile() && end == seg_end);
+                datum.reset(new DenseData(toRead));
+                readSlab(seg->offset + (start - seg->range.startbyte()), end - start, datum->writableData());
+            }
+        }
+    }
+
+    if (!datum) {
+        // Overwritten or evicted since the request was queued
+        CacheLayer::getData(req->fileId, req->range, req->finished);
+        return;
+    }
+
+    {
+        CacheMap::read_iterator iter(mFiles);
+        if (iter.find(req->fileId))
+            iter.use();
+    }
+
+    CacheLayer::populateParentCaches(req->fileId, datum);
+    SparseData data;
+    data.addValidData(datum);
+    req->finished(&data);
+}
+
+} // namespace Transfer
+} // namespace Sirikata
@@ -1,4 +1,7 @@
 #include <sirikata/core/transfer/TransferHandlers.hpp>
+#include <sirikata/core/transfer/SlabCacheLayer.hpp>
+#include <sirikata/core/options/CommonOptions.hpp>
+#include <sirikata/core/service/Context.hpp>
 
 AUTO_SINGLETON_INSTANCE(Sirikata::Transfer::SharedChunkCache);
 
@@ -13,22 +16,35 @@ void SharedChunkCache::destroy() {
 }
 const unsigned int SharedChunkCache::DISK_LRU_CACHE_SIZE = 1024 * 1024 * 1024; //1GB
 const unsigned int SharedChunkCache::MEMORY_LRU_CACHE_SIZE = 1024 * 1024 * 50; //50MB
+const unsigned int SharedChunkCache::MEMORY_CACHE_SHARDS = 16;
 
 SharedChunkCache::SharedChunkCache() {
     //Use LRU for eviction
     mDiskCachePolicy = new LRUPolicy(DISK_LRU_CACHE_SIZE);
-    mMemoryCachePolicy = new LRUPolicy(MEMORY_LRU_CACHE_SIZE);
 
     //Make a disk cache as the bottom cache layer
-    CacheLayer* diskCache = new DiskCacheLayer(mDiskCachePolicy, "HttpChunkHandlerCache", NULL);
+    CacheLayer* diskCache = NULL;
+    String disk_cache_type = GetOptionValue<String>(OPT_CDN_DISK_CACHE);
+    if (disk_cache_type == "slab") {
+        diskCache = new SlabCacheLayer(
+            mDiskCachePolicy, "HttpChunkHandlerSlabCache", DISK_LRU_CACHE_SIZE,
+            GetOptionValue<uint32>(OPT_CDN_DISK_CACHE_READERS), NULL
+        );
+    }
+    else {
+        if (disk_cache_type != "files")
+            SILOG(transfer, error, "Unknown disk cache type " << disk_cache_type << ", using files");
+        diskCache = new DiskCacheLayer(mDiskCachePolicy, "HttpChunkHandlerCache", NULL);
+    }
     mCacheLayers.push_back(diskCache);
 
-    //Make a mem cache on top of the disk cache
-    CacheLayer* memCache = new MemoryCacheLayer(mMemoryCachePolicy, diskCache);
-    mCacheLayers.push_back(memCache);
+    //Make a mem cache on top of the disk cache. It's shared by all the
+    //handlers, so shard it to avoid contention on lookups.
+    mMemoryCache = new ShardedMemoryCacheLayer(MEMORY_LRU_CACHE_SIZE, MEMORY_CACHE_SHARDS, diskCache);
+    mCacheLayers.push_back(mMemoryCache);
 
     //Store top memory cache as the one we'll use
-    mCache = memCache;
+    mCache = mMemoryCache;
 }
 
 SharedChunkCache::~SharedChunkCache() {
@@ -40,12 +56,33 @@ SharedChunkCache::~SharedChunkCache() {
 
     //And delete LRU cache policies
     delete mDiskCachePolicy;
-    delete mMemoryCachePolicy;
 }
 
 CacheLayer* SharedChunkCache::getCache() {
     return mCache;
 }
 
+void SharedChunkCache::registerContext(Context* ctx) {
+    if (ctx->commander()) {
+        ctx->commander()->registerCommand(
+            "transfer.cache.memory.stats",
+            std::tr1::bind(&SharedChunkCache::commandMemoryStats, this, _1, _2, _3)
+        );
+    }
+}
+
+void SharedChunkCache::commandMemoryStats(const Command::Command& cmd, Command::Commander* cmdr, Command::CommandID cmdid) {
+    Command::Result result = Command::EmptyResult();
+    result.put("hits", mMemoryCache->hits());
+    result.put("misses", mMemoryCache->misses());
+    result.put("insertions", mMemoryCache->insertions());
+    result.put("evictions", mMemoryCache->evictions());
+    result.put("entries", mMemoryCache->numEntries());
+    result.put("bytes", mMemoryCache->usedBytes());
+    result.put("budget", mMemoryCache->budget());
+    result.put("shards", mMemoryCache->numShards());
+    cmdr->result(cmdid, result);
+}
+
 }
 }
@@ -3,6 +3,7 @@
 #include <sirikata/core/transfer/TransferMediator.hpp>
 #include <sirikata/core/transfer/MaxPriorityAggregation.hpp>
 #include <sirikata/core/util/Timer.hpp>
+#include <sirikata/core/options/CommonOptions.hpp>
 #include <stdio.h>
 #include <sirikata/core/transfer/TransferHandlers.hpp>
 #include <sirikata/core/transfer/DiskManager.hpp>
@@ -37,46 +38,37 @@ void TransferMediator::destroy() {
 }
 
 TransferMediator::TransferMediator()
- : mContext(NULL)
+ : mContext(NULL),
+   mCleanup(false),
+   mMaxOutstandingRequests(GetOptionValue<uint32>(OPT_TRANSFER_MAX_OUTSTANDING)),
+   mMaxOutstandingPerHost(GetOptionValue<uint32>(OPT_TRANSFER_MAX_OUTSTANDING_PER_HOST))
 {
-    mCleanup = false;
     mNumOutstanding = 0;
     mAggregationAlgorithm = new MaxPriorityAggregation();
-    mThread = new Thread("TransferMediator", std::tr1::bind(&TransferMediator::mediatorThread, this));
+
+    mWorkers = new Network::IOServicePool("TransferMediator", GetOptionValue<uint32>(OPT_TRANSFER_THREADS));
+    mWorkers->startWork();
+    mWorkers->run();
+
+    mStatsTimer = Network::IOTimer::create(
+        mWorkers->service(),
+        std::tr1::bind(&TransferMediator::updateStats, this)
+    );
+    mStatsTimer->wait(Duration::seconds(1));
 }
 
 TransferMediator::~TransferMediator() {
     cleanup();
+    //Pools may queue final requests when they're destroyed, so get rid of
+    //them while we can still ignore them
+    mPools.clear();
+    mStatsTimer.reset();
+    delete mWorkers;
     delete mAggregationAlgorithm;
-    delete mThread;
-}
-
-void TransferMediator::mediatorThread() {
-    uint32 its = 0;
-    while(!mCleanup) {
-        checkQueue();
-        // NOTE: This is tied specifically to the # of milliseconds below to
-        // give ~1sec granularity
-        if (its++ % 200 == 0)
-            updateStats();
-
-        /**
-           Ewen and I weren't able to identify why the below call caused a
-           deadlock on the shared space hosted on sns30 (could not reproduce on
-           other machines).  With the below line, in gdb, with bulletphysics on,
-           and servermap-options set to port 6880, we'd get 4 calls to
-           checkQueue, followed by no follow up calls.  Not sure what to say.
-         */
-        //boost::this_thread::sleep(boost::posix_time::milliseconds(5));
-        Timer::sleep(Duration::milliseconds(5));
-    }
-    for(PoolType::iterator pool = mPools.begin(); pool != mPools.end(); pool++) {
-        pool->second->cleanup();
-        pool->second->getTransferPool()->addRequest(std::tr1::shared_ptr<TransferRequest>());
-    }
-    for(PoolType::iterator pool = mPools.begin(); pool != mPools.end(); pool++) {
-        pool->second->getThread()->join();
-    }
+}
+
+TransferMediator::AggregateShard& TransferMediator::shardFor(const std::string& identifier) {
+    return mShards[std::tr1::hash<std::string>()(identifier) % NUM_AGGREGATE_SHARDS];
 }
 
 void TransferMediator::registerPool(TransferPoolPtr pool) {
@@ -88,33 +80,169 @@ void TransferMediator::registerPool(TransferPoolPtr pool) {
     PoolType::iterator findClientId = mPools.find(pool->getClientID());
     assert(findClientId == mPools.end());
 
-    std::tr1::shared_ptr<PoolWorker> worker(new PoolWorker(pool));
+    std::tr1::shared_ptr<PoolWorker> worker(new PoolWorker(
+        pool, mWorkers->service()->createStrand("TransferMediator " + pool->getClientID())
+    ));
+    pool->mRequestsAvailable = std::tr1::bind(&TransferMediator::requestsAvailable, this, worker.get());
     mPools.insert(PoolType::value_type(pool->getClientID(), worker));
 }
 
 void TransferMediator::cleanup() {
-    if (mCleanup) return;
+    if (mCleanup.read()) return;
 
     mCleanup = true;
-    mThread->join();
+    mStatsTimer->cancel();
+    mWorkers->stopWork();
+    mWorkers->join();
+}
+
+void TransferMediator::requestsAvailable(PoolWorker* worker) {
+    if (mCleanup.read()) return;
+
+    //A drain picks up everything queued before it runs, so only one needs
+    //to be waiting at a time
+    if (!worker->mDrainScheduled.compareAndSwap(0, 1)) return;
+    worker->getStrand()->post(
+        std::tr1::bind(&TransferMediator::drainPool, this, worker),
+        "TransferMediator::drainPool"
+    );
+}
+
+void TransferMediator::drainPool(PoolWorker* worker) {
+    //Clear this first so requests queued while we're draining schedule
+    //another drain
+    worker->mDrainScheduled = 0;
+
+    std::tr1::shared_ptr<TransferRequest> req;
+    while(getRequest(worker->getTransferPool(), req)) {
+        if (req) processRequest(req);
+    }
+    checkQueue();
+}
+
+void TransferMediator::processRequest(std::tr1::shared_ptr<TransferRequest> req) {
+    AggregateShard& shard = shardFor(req->getIdentifier());
+    boost::unique_lock<boost::mutex> lock(shard.mutex);
+    AggregateListByID& idIndex = shard.list.get<tagID>();
+    AggregateListByID::iterator findID = idIndex.find(req->getIdentifier());
+
+    //Check if this request already exists. It may already be executing, in
+    //which case the client will be notified when it finishes.
+    if(findID != idIndex.end()) {
+        //Check if this request is for deleting
+        if(req->isDeletionRequest()) {
+            const std::map<std::string, std::tr1::shared_ptr<TransferRequest> >&
+                allReqs = (*findID)->getTransferRequests();
+
+            std::map<std::string,
+                std::tr1::shared_ptr<TransferRequest> >::const_iterator findClient =
+                allReqs.find(req->getClientID());
+
+            /* If the client isn't in the aggregated request, it must have already
+             * been deleted, or the deletion request is invalid
+             */
+            if(findClient == allReqs.end()) {
+                return;
+            }
+
+            if(allReqs.size() > 1) {
+                /* If there are more than one, we need to just delete the single client
+                 * from the aggregate request
+                 */
+                (*findID)->removeClient(req->getClientID());
+            } else {
+                // If only one in the list, we can erase the entire request
+                std::tr1::shared_ptr<AggregateRequest> aggReq = *findID;
+                shard.list.erase(findID);
+
+                boost::unique_lock<boost::mutex> dispatchLock(mDispatchMutex);
+                if (!aggReq->mExecuting)
+                    removeWaiting(aggReq);
+            }
+        } else {
+            std::tr1::shared_ptr<AggregateRequest> aggReq = *findID;
+
+            //store original aggregated priority for later
+            Priority oldAggPriority = aggReq->getPriority();
+
+            //Update the priority of this client
+            aggReq->setClientPriority(req);
+
+            //And check if it's changed, we need to requeue it
+            if(oldAggPriority != aggReq->getPriority()) {
+                boost::unique_lock<boost::mutex> dispatchLock(mDispatchMutex);
+                if (!aggReq->mExecuting) {
+                    removeWaiting(aggReq);
+                    addWaiting(aggReq);
+                }
+            }
+        }
+    } else if (!req->isDeletionRequest()) {
+        //Make a new one and insert it
+        std::tr1::shared_ptr<AggregateRequest> newAggReq(new AggregateRequest(req));
+        shard.list.insert(newAggReq);
+
+        boost::unique_lock<boost::mutex> dispatchLock(mDispatchMutex);
+        addWaiting(newAggReq);
+    }
 }
 
-void TransferMediator::execute_finished(std::tr1::shared_ptr<TransferRequest> req, std::string id) {
-    boost::unique_lock<boost::mutex> lock(mAggMutex, boost::defer_lock_t());
-    lock.lock();
+void TransferMediator::addWaiting(const std::tr1::shared_ptr<AggregateRequest>& agg) {
+    HostStateMap::iterator host_it = mHosts.insert(HostStateMap::value_type(agg->getHost(), HostState())).first;
+    agg->mWaitingPosition = host_it->second.waiting.insert(WaitingQueue::value_type(agg->getPriority(), agg));
+    updateHost(host_it);
+}
+
+void TransferMediator::removeWaiting(const std::tr1::shared_ptr<AggregateRequest>& agg) {
+    HostStateMap::iterator host_it = mHosts.find(agg->getHost());
+    assert(host_it != mHosts.end());
+    host_it->second.waiting.erase(agg->mWaitingPosition);
+    updateHost(host_it);
+}
+
+void TransferMediator::releaseSlot(const std::string& host) {
+    mNumOutstanding--;
+    HostStateMap::iterator host_it = mHosts.find(host);
+    assert(host_it != mHosts.end());
+    host_it->second.outstanding--;
+    updateHost(host_it);
+}
+
+void TransferMediator::updateHost(HostStateMap::iterator host_it) {
+    HostState& state = host_it->second;
+    bool ready = !state.waiting.empty() && state.outstanding < mMaxOutstandingPerHost;
+    Priority priority = ready ? state.waiting.begin()->first : 0;
 
-    AggregateListByID& idIndex = mAggregateList.get<tagID>();
-    AggregateListByID::iterator findID = idIndex.find(id);
-    if(findID == idIndex.end()) {
-        //This can happen now if a request was canceled but it was already outstanding
-        mNumOutstanding--;
-        lock.unlock();
-        checkQueue();
-        return;
+    if (state.ready && (!ready || priority != state.readyPriority)) {
+        mReadyHosts.erase(ReadyHost(state.readyPriority, host_it->first));
+        state.ready = false;
+    }
+    if (ready && !state.ready) {
+        mReadyHosts.insert(ReadyHost(priority, host_it->first));
+        state.ready = true;
+        state.readyPriority = priority;
     }
 
-    const std::map<std::string, std::tr1::shared_ptr<TransferRequest> >&
-        allReqs = (*findID)->getTransferRequests();
+    if (state.outstanding == 0 && state.waiting.empty())
+        mHosts.erase(host_it);
+}
+
+void TransferMediator::execute_finished(std::tr1::shared_ptr<TransferRequest> req, std::string id, std::string host) {
+    //Grab the requests to notify, then notify them outside the lock since
+    //the callbacks may make new requests
+    std::map<std::string, std::tr1::shared_ptr<TransferRequest> > allReqs;
+    {
+        AggregateShard& shard = shardFor(id);
+        boost::unique_lock<boost::mutex> lock(shard.mutex);
+
+        AggregateListByID& idIndex = shard.list.get<tagID>();
+        AggregateListByID::iterator findID = idIndex.find(id);
+        //This can fail if a request was canceled but it was already outstanding
+        if(findID != idIndex.end()) {
+            allReqs = (*findID)->getTransferRequests();
+            shard.list.erase(findID);
+        }
+    }
 
     for(std::map<std::string, std::tr1::shared_ptr<TransferRequest> >::const_iterator
             it = allReqs.begin(); it != allReqs.end(); it++) {
@@ -122,45 +250,77 @@ void TransferMediator::execute_finished(std::tr1::shared_ptr<TransferRequest> re
         it->second->notifyCaller(it->second, req);
     }
 
-    mAggregateList.erase(findID);
-
-    mNumOutstanding--;
-    lock.unlock();
+    {
+        boost::unique_lock<boost::mutex> lock(mDispatchMutex);
+        releaseSlot(host);
+    }
     SILOG(transfer, detailed, "done transfer mediator execute_finished");
     checkQueue();
 }
 
 void TransferMediator::checkQueue() {
-    boost::unique_lock<boost::mutex> lock(mAggMutex, boost::defer_lock_t());
-
-    lock.lock();
-
-    AggregateListByPriority & priorityIndex = mAggregateList.get<tagPriority>();
-    AggregateListByPriority::iterator findTop = priorityIndex.begin();
+    if (mCleanup.read()) return;
+
+    std::vector<StartRequest> toStart;
+
+    bool retry = true;
+    while(retry) {
+        retry = false;
+
+        // While we have free slots, start the highest priority waiting
+        // request whose host has room for it. That's the best request of the
+        // first ready host.
+        std::vector<std::tr1::shared_ptr<AggregateRequest> > picked;
+        {
+            boost::unique_lock<boost::mutex> lock(mDispatchMutex);
+            while(mNumOutstanding < mMaxOutstandingRequests && !mReadyHosts.empty()) {
+                HostStateMap::iterator host_it = mHosts.find(mReadyHosts.begin()->second);
+                assert(host_it != mHosts.end());
+                HostState& state = host_it->second;
+
+                std::tr1::shared_ptr<AggregateRequest> best = state.waiting.begin()->second;
+                state.waiting.erase(state.waiting.begin());
+                best->mExecuting = true;
+                mNumOutstanding++;
+                state.outstanding++;
+                updateHost(host_it);
+                picked.push_back(best);
+            }
+        }
 
-    if(findTop != priorityIndex.end()) {
-        std::string topId = (*findTop)->getIdentifier();
-        SILOG(transfer, detailed, priorityIndex.size() << " length agg list, top priority "
-                << (*findTop)->getPriority() << " id " << topId);
-    }
+        // Shard locks have to be taken before mDispatchMutex, so we only get
+        // the TransferRequests to run now
+        for(uint32 i = 0; i < picked.size(); i++) {
+            const std::tr1::shared_ptr<AggregateRequest>& best = picked[i];
+            AggregateShard& shard = shardFor(best->getIdentifier());
+            boost::unique_lock<boost::mutex> shardLock(shard.mutex);
+            AggregateListByID& idIndex = shard.list.get<tagID>();
+            AggregateListByID::iterator findID = idIndex.find(best->getIdentifier());
+            if (findID == idIndex.end() || *findID != best) {
+                // Deleted since we picked it, so give its slot to something
+                // else
+                boost::unique_lock<boost::mutex> lock(mDispatchMutex);
+                releaseSlot(best->getHost());
+                retry = true;
+                continue;
+            }
 
-    // While we have free slots and there are items left, scan for items that
-    // haven't been started yet that we can process.
-    while(findTop != priorityIndex.end() && mNumOutstanding < 10) {
-        if (!(*findTop)->mExecuting) {
-            mNumOutstanding++;
-            (*findTop)->mExecuting = true;
-            std::tr1::shared_ptr<TransferRequest> req = (*findTop)->getSingleRequest();
-            req->execute(
-                req,
-                std::tr1::bind(&TransferMediator::execute_finished, this,
-                    req, (*findTop)->getIdentifier())
-            );
+            StartRequest start;
+            start.req = best->getSingleRequest();
+            start.id = best->getIdentifier();
+            start.host = best->getHost();
+            toStart.push_back(start);
         }
-        findTop++;
     }
 
-    lock.unlock();
+    for(uint32 i = 0; i < toStart.size(); i++) {
+        SILOG(transfer, detailed, "Starting request " << toStart[i].id);
+        toStart[i].req->execute(
+            toStart[i].req,
+            std::tr1::bind(&TransferMediator::execute_finished, this,
+                toStart[i].req, toStart[i].id, toStart[i].host)
+        );
+    }
 }
 
 
@@ -210,6 +370,9 @@ void TransferMediator::updateStats() {
             uploads << " uploads, " << uploads_bytes_transferred << " uploads_bytes, " <<
             (mContext->simTime()-Time::null()).microseconds() << " time");
     }
+
+    if (!mCleanup.read())
+        mStatsTimer->wait(Duration::seconds(1));
 }
 
 
@@ -256,12 +419,17 @@ const std::string& TransferMediator::AggregateRequest::getIdentifier() const {
     return mIdentifier;
 }
 
+const std::string& TransferMediator::AggregateRequest::getHost() const {
+    return mHost;
+}
+
 Priority TransferMediator::AggregateRequest::getPriority() const {
     return mPriority;
 }
 
 TransferMediator::AggregateRequest::AggregateRequest(std::tr1::shared_ptr<TransferRequest> req)
  : mExecuting(false),
+   mHost(req->getHost()),
    mIdentifier(req->getIdentifier())
 {
     setClientPriority(req);
@@ -271,88 +439,20 @@ TransferMediator::AggregateRequest::AggregateRequest(std::tr1::shared_ptr<Transf
  * TransferMediator::PoolWorker definitions
  */
 
-TransferMediator::PoolWorker::PoolWorker(std::tr1::shared_ptr<TransferPool> transferPool)
-    : mTransferPool(transferPool), mCleanup(false) {
-    mWorkerThread = new Thread("TransferMediator Worker", std::tr1::bind(&PoolWorker::run, this));
-}
-
-std::tr1::shared_ptr<TransferPool> TransferMediator::PoolWorker::getTransferPool() const {
-    return mTransferPool;
+TransferMediator::PoolWorker::PoolWorker(std::tr1::shared_ptr<TransferPool> transferPool, Network::IOStrand* strand)
+    : mTransferPool(transferPool), mStrand(strand), mDrainScheduled(0) {
 }
 
-Thread * TransferMediator::PoolWorker::getThread() const {
-    return mWorkerThread;
+TransferMediator::PoolWorker::~PoolWorker() {
+    delete mStrand;
 }
 
-void TransferMediator::PoolWorker::cleanup() {
-    mCleanup = true;
+std::tr1::shared_ptr<TransferPool> TransferMediator::PoolWorker::getTransferPool() const {
+    return mTransferPool;
 }
 
-void TransferMediator::PoolWorker::run() {
-    while(!mCleanup) {
-        std::tr1::shared_ptr<TransferRequest> req = TransferMediator::getRequest(mTransferPool);
-        if(req == NULL) {
-            continue;
-        }
-        //SILOG(transfer, debug, "worker got one!");
-
-        boost::unique_lock<boost::mutex> lock(TransferMediator::getSingleton().mAggMutex);
-        AggregateListByID& idIndex = TransferMediator::getSingleton().mAggregateList.get<tagID>();
-        AggregateListByID::iterator findID = idIndex.find(req->getIdentifier());
-
-        //Check if this request already exists
-        if(findID != idIndex.end()) {
-            //Check if this request is for deleting
-            if(req->isDeletionRequest()) {
-                const std::map<std::string, std::tr1::shared_ptr<TransferRequest> >&
-                    allReqs = (*findID)->getTransferRequests();
-
-                std::map<std::string,
-                    std::tr1::shared_ptr<TransferRequest> >::const_iterator findClient =
-                    allReqs.find(req->getClientID());
-
-                /* If the client isn't in the aggregated request, it must have already
-                 * been deleted, or the deletion request is invalid
-                 */
-                if(findClient == allReqs.end()) {
-                    continue;
-                }
-
-                if(allReqs.size() > 1) {
-                    /* If there are more than one, we need to just delete the single client
-                     * from the aggregate request
-                     */
-                    (*findID)->removeClient(req->getClientID());
-                } else {
-                    // If only one in the list, we can erase the entire request
-                    TransferMediator::getSingleton().mAggregateList.erase(findID);
-                }
-            } else {
-                //store original aggregated priority for later
-                Priority oldAggPriority = (*findID)->getPriority();
-
-                //Update the priority of this client
-                (*findID)->setClientPriority(req);
-
-                //And check if it's changed, we need to update the index
-                Priority newAggPriority = (*findID)->getPriority();
-                if(oldAggPriority != newAggPriority) {
-                    //Convert the iterator to the priority one and update
-                    AggregateListByPriority::iterator byPriority =
-                            TransferMediator::getSingleton().mAggregateList.project<tagPriority>(findID);
-                    AggregateListByPriority & priorityIndex =
-                            TransferMediator::getSingleton().mAggregateList.get<tagPriority>();
-                    priorityIndex.modify_key(byPriority, boost::lambda::_1=newAggPriority);
-                }
-            }
-        } else {
-            //Make a new one and insert it
-            //SILOG(transfer, debug, "worker id " << mTransferPool->getClientID() << " adding url " << req->getIdentifier());
-            std::tr1::shared_ptr<AggregateRequest> newAggReq(new AggregateRequest(req));
-            TransferMediator::getSingleton().mAggregateList.insert(newAggReq);
-        }
-
-    }
+Network::IOStrand* TransferMediator::PoolWorker::getStrand() const {
+    return mStrand;
 }
 
 void TransferMediator::registerContext(Context* ctx) {
@@ -370,12 +470,17 @@ void TransferMediator::commandListRequests(const Command::Command& cmd, Command:
     result.put( String("requests"), Command::Array());
     Command::Array& requests_ary = result.getArray("requests");
 
-    boost::unique_lock<boost::mutex> lock(mAggMutex);
-    AggregateListByPriority& priorityIndex = mAggregateList.get<tagPriority>();
-    for(AggregateListByPriority::iterator req_it = priorityIndex.begin(); req_it != priorityIndex.end(); req_it++) {
-        requests_ary.push_back(Command::Object());
-        requests_ary.back().put("id", (*req_it)->getIdentifier());
-        requests_ary.back().put("priority", (*req_it)->getPriority());
+    for(uint32 i = 0; i < NUM_AGGREGATE_SHARDS; i++) {
+        boost::unique_lock<boost::mutex> lock(mShards[i].mutex);
+        boost::unique_lock<boost::mutex> dispatchLock(mDispatchMutex);
+        AggregateListByID& idIndex = mShards[i].list.get<tagID>();
+        for(AggregateListByID::iterator req_it = idIndex.begin(); req_it != idIndex.end(); req_it++) {
+            requests_ary.push_back(Command::Object());
+            requests_ary.back().put("id", (*req_it)->getIdentifier());
+            requests_ary.back().put("priority", (*req_it)->getPriority());
+            requests_ary.back().put("host", (*req_it)->getHost());
+            requests_ary.back().put("executing", (*req_it)->mExecuting);
+        }
     }
 
     cmdr->result(cmdid, result);
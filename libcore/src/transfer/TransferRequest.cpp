@@ -7,10 +7,23 @@
 #include <sirikata/core/transfer/FileTransferHandler.hpp>
 #include <sirikata/core/transfer/HttpTransferHandler.hpp>
 #include <sirikata/core/transfer/DataTransferHandler.hpp>
+#include <sirikata/core/transfer/URL.hpp>
 
 namespace Sirikata {
 namespace Transfer {
 
+namespace {
+// Requests for the same scheme and host are made to the same server
+std::string hostForURI(const URI& uri) {
+    URL url(uri);
+    return uri.scheme() + "://" + url.host();
+}
+}
+
+std::string MetadataRequest::getHost() const {
+    return hostForURI(mURI);
+}
+
 void MetadataRequest::execute(std::tr1::shared_ptr<TransferRequest> req, ExecuteFinished cb) {
     std::tr1::shared_ptr<MetadataRequest> casted =
       std::tr1::static_pointer_cast<MetadataRequest, TransferRequest>(req);
@@ -34,6 +47,10 @@ void MetadataRequest::execute(std::tr1::shared_ptr<TransferRequest> req, Execute
 }
 
 
+std::string ChunkRequest::getHost() const {
+    return hostForURI(mMetadata->getURI());
+}
+
 void ChunkRequest::execute(std::tr1::shared_ptr<TransferRequest> req, ExecuteFinished cb) {
     std::tr1::shared_ptr<ChunkRequest> casted =
             std::tr1::static_pointer_cast<ChunkRequest, TransferRequest>(req);
@@ -32,7 +32,10 @@
 
 #include <sirikata/core/util/Standard.hh>
 #include <sirikata/core/util/Sha256.hpp>
+#include <sirikata/core/util/Thread.hpp>
+#include <sirikata/core/network/IOServicePool.hpp>
 #include "internal_sha2.hpp"
+#include <boost/thread/condition_variable.hpp>
 
 #include <stdexcept>
 #include <iostream>
@@ -107,6 +110,97 @@ SHA256 SHA256::computeDigest(const std::string&data) {
     return retval;
 }
 
+namespace {
+// Below this much data per thread, handing work to other threads costs more
+// than it saves
+const size_t MIN_BYTES_PER_DIGEST_THREAD = 128*1024;
+
+struct DigestBatch {
+    const void*const*data;
+    const size_t*lengths;
+    size_t count;
+    SHA256*digests;
+    AtomicValue<uint32> next;
+
+    boost::mutex mutex;
+    boost::condition_variable finished;
+    size_t done;
+};
+typedef std::tr1::shared_ptr<DigestBatch> DigestBatchPtr;
+
+void computeDigestBatch(DigestBatchPtr batch) {
+    // Buffers are handed out one at a time so threads that get small ones
+    // pick up more of them. Workers that start after everything has been
+    // handed out don't touch the caller's buffers.
+    size_t ncomputed = 0;
+    while(true) {
+        size_t idx = (size_t)(batch->next++);
+        if (idx >= batch->count) break;
+        batch->digests[idx] = SHA256::computeDigest(batch->data[idx], batch->lengths[idx]);
+        ncomputed++;
+    }
+    if (ncomputed == 0) return;
+
+    boost::lock_guard<boost::mutex> lck(batch->mutex);
+    batch->done += ncomputed;
+    if (batch->done == batch->count)
+        batch->finished.notify_all();
+}
+
+// Worker threads shared by all batches. The pool is created the first time
+// it's needed and never destroyed, so it can't go away under a batch that's
+// running during shutdown.
+boost::mutex sDigestPoolMutex;
+Network::IOServicePool* sDigestPool = NULL;
+
+Network::IOServicePool* digestPool() {
+    boost::lock_guard<boost::mutex> lck(sDigestPoolMutex);
+    if (sDigestPool == NULL) {
+        // The calling thread always does its share, so one fewer is enough
+        sDigestPool = new Network::IOServicePool("SHA256 Digests", std::max<uint32>(Thread::hardware_concurrency(), 2) - 1);
+        sDigestPool->startWork();
+        sDigestPool->run();
+    }
+    return sDigestPool;
+}
+}
+
+void SHA256::computeDigests(const void*const*data, const size_t*lengths, size_t count, SHA256*digests) {
+    size_t total = 0;
+    for (size_t i=0;i<count;++i)
+        total += lengths[i];
+
+    size_t nthreads = std::min<size_t>(Thread::hardware_concurrency(), count);
+    nthreads = std::min<size_t>(nthreads, total / MIN_BYTES_PER_DIGEST_THREAD);
+
+    DigestBatchPtr batch(new DigestBatch());
+    batch->data = data;
+    batch->lengths = lengths;
+    batch->count = count;
+    batch->digests = digests;
+    batch->next = 0;
+    batch->done = 0;
+
+    if (nthreads > 1) {
+        Network::IOService* ios = digestPool()->service();
+        for (size_t i=1;i<nthreads;++i)
+            ios->post(std::tr1::bind(&computeDigestBatch, batch), "SHA256::computeDigests");
+    }
+    computeDigestBatch(batch);
+
+    boost::unique_lock<boost::mutex> lck(batch->mutex);
+    while(batch->done < batch->count)
+        batch->finished.wait(lck);
+}
+
+const char*SHA256::implementation() {
+    return SHA256_Implementation();
+}
+
+void SHA256::useScalarImplementation(bool scalar) {
+    SHA256_UseScalar(scalar);
+}
+
 SHA256Context::SHA256Context() {
     mCtx = new SHA256_CTX;
     SHA256_Init((SHA256_CTX*)mCtx);
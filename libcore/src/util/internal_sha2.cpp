@@ -519,6 +519,34 @@ void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
 
 #endif /* SHA2_UNROLL_TRANSFORM */
 
+static volatile bool sha256_force_scalar = false;
+
+static SHA256_BlockFunction SHA256_Accelerated() {
+	/* Looked up once, the CPU can't change under us */
+	static SHA256_BlockFunction accelerated = SHA256_SHANIBlockFunction();
+	return sha256_force_scalar ? (SHA256_BlockFunction)0 : accelerated;
+}
+
+const char* SHA256_Implementation() {
+	return SHA256_Accelerated() ? "sha-ni" : "scalar";
+}
+
+void SHA256_UseScalar(bool scalar) {
+	sha256_force_scalar = scalar;
+}
+
+static void SHA256_TransformBlocks(SHA256_CTX* context, const sha2_byte* data, size_t nblocks) {
+	SHA256_BlockFunction accelerated = SHA256_Accelerated();
+	if (accelerated) {
+		accelerated(context->state, data, nblocks);
+		return;
+	}
+	while (nblocks--) {
+		SHA256_Transform(context, (const sha2_word32*)data);
+		data += SHA256_BLOCK_LENGTH;
+	}
+}
+
 void SHA256_Update(SHA256_CTX* context, const sha2_byte *data, size_t len) {
 	unsigned int	freespace, usedspace;
 
@@ -541,7 +569,7 @@ void SHA256_Update(SHA256_CTX* context, const sha2_byte *data, size_t len) {
 			context->bitcount += freespace << 3;
 			len -= freespace;
 			data += freespace;
-			SHA256_Transform(context, (sha2_word32*)context->buffer);
+			SHA256_TransformBlocks(context, context->buffer, 1);
 		} else {
 			/* The buffer is not yet full */
 			MEMCPY_BCOPY(&context->buffer[usedspace], data, len);
@@ -551,12 +579,13 @@ void SHA256_Update(SHA256_CTX* context, const sha2_byte *data, size_t len) {
 			return;
 		}
 	}
-	while (len >= SHA256_BLOCK_LENGTH) {
-		/* Process as many complete blocks as we can */
-		SHA256_Transform(context, (sha2_word32*)data);
-		context->bitcount += SHA256_BLOCK_LENGTH << 3;
-		len -= SHA256_BLOCK_LENGTH;
-		data += SHA256_BLOCK_LENGTH;
+	if (len >= SHA256_BLOCK_LENGTH) {
+		/* Process as many complete blocks as we can in one go */
+		size_t nblocks = len / SHA256_BLOCK_LENGTH;
+		SHA256_TransformBlocks(context, data, nblocks);
+		context->bitcount += (sha2_word64)(nblocks * SHA256_BLOCK_LENGTH) << 3;
+		len -= nblocks * SHA256_BLOCK_LENGTH;
+		data += nblocks * SHA256_BLOCK_LENGTH;
 	}
 	if (len > 0) {
 		/* There's left-overs, so save 'em */
@@ -593,7 +622,7 @@ void SHA256_Final(sha2_byte digest[], SHA256_CTX* context) {
 					MEMSET_BZERO(&context->buffer[usedspace], SHA256_BLOCK_LENGTH - usedspace);
 				}
 				/* Do second-to-last transform: */
-				SHA256_Transform(context, (sha2_word32*)context->buffer);
+				SHA256_TransformBlocks(context, context->buffer, 1);
 
 				/* And set-up for the last transform: */
 				MEMSET_BZERO(context->buffer, SHA256_SHORT_BLOCK_LENGTH);
@@ -609,7 +638,7 @@ void SHA256_Final(sha2_byte digest[], SHA256_CTX* context) {
         memcpy(&context->buffer[SHA256_SHORT_BLOCK_LENGTH], &context->bitcount,sizeof(context->bitcount));
 
 		/* Final transform: */
-		SHA256_Transform(context, (sha2_word32*)context->buffer);
+		SHA256_TransformBlocks(context, context->buffer, 1);
 
 #if SIRIKATA_BYTE_ORDER == SIRIKATA_LITTLE_ENDIAN
 		{
@@ -189,6 +189,24 @@ char* SHA512_Data();
 
 #endif /* NOPROTO */
 
+/*** SHA-256 Block Functions ******************************************/
+/*
+ * A block function runs the SHA-256 compression function over nblocks
+ * consecutive SHA256_BLOCK_LENGTH byte blocks of data, updating state.
+ * They let SHA256_Update hand whole runs of input to a hardware
+ * accelerated implementation when the CPU has one.
+ */
+typedef void (*SHA256_BlockFunction)(u_int32_t state[8], const u_int8_t* data, size_t nblocks);
+
+/* Returns the SHA-NI (Intel SHA extensions) block function if both the
+ * compiler and the running CPU support it, or NULL. */
+SHA256_BlockFunction SHA256_SHANIBlockFunction();
+
+/* Returns the name of the implementation SHA256_Update currently uses. */
+const char* SHA256_Implementation();
+/* Forces the portable implementation, e.g. to compare against it. */
+void SHA256_UseScalar(bool scalar);
+
 }
 }
 }
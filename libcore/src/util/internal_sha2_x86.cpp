@@ -0,0 +1,154 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/core/util/Standard.hh>
+#include "internal_sha2.hpp"
+
+// SHA-NI needs compiler support for the intrinsics. GCC and clang can compile
+// them for individual functions with the target attribute, so nothing else
+// needs to be built with them enabled.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#  define SIRIKATA_SHA256_SHANI 1
+#  define SIRIKATA_SHA256_SHANI_TARGET __attribute__((target("sha,sse4.1")))
+#  include <cpuid.h>
+#  include <immintrin.h>
+#elif (defined(_M_X64) || defined(_M_IX86)) && defined(_MSC_VER) && _MSC_VER >= 1900
+#  define SIRIKATA_SHA256_SHANI 1
+#  define SIRIKATA_SHA256_SHANI_TARGET
+#  include <intrin.h>
+#  include <immintrin.h>
+#endif
+
+namespace Sirikata {
+namespace Util {
+namespace Internal{
+
+#ifdef SIRIKATA_SHA256_SHANI
+
+namespace {
+
+const u_int32_t K256[64] = {
+    0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL,
+    0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+    0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL,
+    0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+    0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL,
+    0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+    0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL,
+    0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+    0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL,
+    0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+    0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL,
+    0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+    0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL,
+    0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+    0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL,
+    0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
+};
+
+bool CPUSupportsSHANI() {
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) return false;
+    __cpuid(regs, 1);
+    ecx = regs[2];
+    __cpuidex(regs, 7, 0);
+    ebx = regs[1];
+#else
+    if (__get_cpuid_max(0, NULL) < 7) return false;
+    __cpuid(1, eax, ebx, ecx, edx);
+    unsigned int ecx1 = ecx;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    ecx = ecx1;
+#endif
+    const bool ssse3 = (ecx & (1 << 9)) != 0;
+    const bool sse41 = (ecx & (1 << 19)) != 0;
+    const bool sha = (ebx & (1 << 29)) != 0;
+    return ssse3 && sse41 && sha;
+}
+
+// Each group of 4 rounds extends the message schedule by 4 words, adds the
+// round constants and runs the rounds, 2 at a time.
+#define SHANI_ROUNDS(i, msg)                                            \
+    tmp = _mm_add_epi32(msg, _mm_loadu_si128((const __m128i*)&K256[4*(i)])); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);                \
+    tmp = _mm_shuffle_epi32(tmp, 0x0E);                                 \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, tmp)
+
+#define SHANI_SCHEDULE(w0, w1, w2, w3)                                  \
+    w0 = _mm_sha256msg2_epu32(                                          \
+        _mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), _mm_alignr_epi8(w3, w2, 4)), \
+        w3)
+
+SIRIKATA_SHA256_SHANI_TARGET
+void SHA256_SHANIBlocks(u_int32_t state[8], const u_int8_t* data, size_t nblocks) {
+    const __m128i byteswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The instructions want the state as ABEF and CDGH
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    while(nblocks--) {
+        const __m128i abef = state0;
+        const __m128i cdgh = state1;
+
+        __m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), byteswap);
+        __m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), byteswap);
+        __m128i w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), byteswap);
+        __m128i w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), byteswap);
+
+        SHANI_ROUNDS(0, w0);
+        SHANI_ROUNDS(1, w1);
+        SHANI_ROUNDS(2, w2);
+        SHANI_ROUNDS(3, w3);
+        for(int i = 4; i < 16; i += 4) {
+            SHANI_SCHEDULE(w0, w1, w2, w3);
+            SHANI_ROUNDS(i, w0);
+            SHANI_SCHEDULE(w1, w2, w3, w0);
+            SHANI_ROUNDS(i+1, w1);
+            SHANI_SCHEDULE(w2, w3, w0, w1);
+            SHANI_ROUNDS(i+2, w2);
+            SHANI_SCHEDULE(w3, w0, w1, w2);
+            SHANI_ROUNDS(i+3, w3);
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        data += SHA256_BLOCK_LENGTH;
+    }
+
+    // Back to ABCD and EFGH
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+#undef SHANI_ROUNDS
+#undef SHANI_SCHEDULE
+
+} // namespace
+
+SHA256_BlockFunction SHA256_SHANIBlockFunction() {
+    return CPUSupportsSHANI() ? &SHA256_SHANIBlocks : NULL;
+}
+
+#else //SIRIKATA_SHA256_SHANI
+
+SHA256_BlockFunction SHA256_SHANIBlockFunction() {
+    return NULL;
+}
+
+#endif //SIRIKATA_SHA256_SHANI
+
+}
+}
+}
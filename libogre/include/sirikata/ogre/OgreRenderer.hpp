@@ -39,6 +39,7 @@
 #include <sirikata/mesh/ParserService.hpp>
 #include <sirikata/core/service/Context.hpp>
 #include <sirikata/core/transfer/TransferMediator.hpp>
+#include <sirikata/core/util/Thread.hpp>
 #include <sirikata/oh/TimeSteppedSimulation.hpp>
 #include <OgreWindowEventUtilities.h>
 #include <sirikata/core/util/Liveness.hpp>
@@ -0,0 +1,206 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_OH_CACHED_STORAGE_HPP_
+#define _SIRIKATA_OH_CACHED_STORAGE_HPP_
+
+#include <sirikata/oh/Storage.hpp>
+#include <sirikata/core/network/IOTimer.hpp>
+#include <sirikata/core/command/Commander.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Sirikata {
+namespace OH {
+
+/** A Storage that wraps another, keeping recently used keys in memory so
+ *  repeated reads of the same script state don't go to the backend.
+ *
+ *  Only buckets we hold a lease on (between leaseBucket and releaseBucket) are
+ *  cached, since otherwise another object host could change the data under
+ *  us. Leasing can fail without telling us, so nothing is answered from
+ *  memory until a commit to the backend succeeds for the bucket. After that,
+ *  transactions that only read, compare, write and erase keys which are all
+ *  in the cache are handled in memory. Their writes are reported as
+ *  successful immediately and written back to the backend together, either
+ *  periodically or when too many build up. Anything else, e.g. range
+ *  operations or reads of uncached keys, goes to the backend along with any
+ *  writes that haven't been flushed yet, so the backend always sees writes in
+ *  the order they were made. Until those transactions complete, later ones
+ *  also go to the backend so they see their results.
+ *
+ *  Releasing a bucket flushes its writes before the release is passed on. If
+ *  the backend reports a lock error, the lease was lost and anything cached
+ *  for the bucket, including unflushed writes, is dropped. The bucket is then
+ *  handled by the backend until a commit succeeds again.
+ */
+class SIRIKATA_OH_EXPORT CachedStorage : public Storage {
+public:
+    /** Create a CachedStorage.
+     *  \param ctx context the storage runs in
+     *  \param backend the storage to cache, owned by the CachedStorage
+     *  \param max_entries maximum number of keys to cache per bucket
+     *  \param max_dirty number of unflushed writes in a bucket that triggers
+     *         an immediate flush
+     *  \param flush_interval maximum time writes stay unflushed
+     */
+    CachedStorage(ObjectHostContext* ctx, Storage* backend, uint32 max_entries, uint32 max_dirty, const Duration& flush_interval);
+    virtual ~CachedStorage();
+
+    virtual void start();
+    virtual void stop();
+
+    virtual void leaseBucket(const Bucket& bucket);
+    virtual void releaseBucket(const Bucket& bucket);
+
+    virtual void beginTransaction(const Bucket& bucket);
+
+    virtual void commitTransaction(const Bucket& bucket, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool erase(const Bucket& bucket, const Key& key, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool write(const Bucket& bucket, const Key& key, const String& value, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool read(const Bucket& bucket, const Key& key, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool compare(const Bucket& bucket, const Key& key, const String& value, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool rangeRead(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool rangeErase(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool count(const Bucket& bucket, const Key& start, const Key& finish, const CountCallback& cb = 0, const String& timestamp="current");
+
+    struct Stats {
+        Stats()
+         : hits(0), misses(0),
+           localCommits(0), backendCommits(0),
+           flushes(0), flushedKeys(0), flushFailures(0)
+        {}
+
+        // Reads and compares answered from memory, and those that had to go
+        // to the backend
+        uint64 hits;
+        uint64 misses;
+        // Transactions handled entirely in memory, and those passed on
+        uint64 localCommits;
+        uint64 backendCommits;
+        // Write back transactions sent to the backend, the keys they
+        // contained, and how many failed
+        uint64 flushes;
+        uint64 flushedKeys;
+        uint64 flushFailures;
+    };
+    Stats stats();
+
+private:
+    struct Action {
+        enum Type {
+            Read,
+            ReadRange,
+            Compare,
+            Write,
+            Erase,
+            EraseRange
+        };
+
+        Action(Type t, const Key& k)
+         : type(t), key(k)
+        {}
+
+        Type type;
+        Key key;
+        Key keyEnd; // Only for *Range
+        String value; // Only for Write and Compare
+    };
+    typedef std::vector<Action> Transaction;
+    typedef std::tr1::unordered_map<Bucket, Transaction*, Bucket::Hasher> BucketTransactions;
+
+    typedef std::list<Key> KeyList;
+    struct Entry {
+        Entry()
+         : exists(false), dirty(false), version(0)
+        {}
+
+        String value;
+        // false caches the fact that the key isn't in storage
+        bool exists;
+        // Written locally but not flushed to the backend yet
+        bool dirty;
+        // Changes with every local write so a flush completing doesn't mark a
+        // newer write clean
+        uint64 version;
+        KeyList::iterator lru;
+    };
+    typedef std::tr1::unordered_map<Key, Entry> EntryMap;
+
+    struct BucketCache {
+        BucketCache()
+         : leased(true), confirmed(false), passThrough(0), dirtyCount(0), flushing(false)
+        {}
+
+        // Cleared when the bucket is released but writes are still being
+        // flushed. Nothing is answered from memory for unleased buckets.
+        bool leased;
+        // Set once a backend commit succeeds, showing the lease is really
+        // ours, and cleared if the backend reports it was lost
+        bool confirmed;
+        // Transactions passed through to the backend that haven't completed
+        uint32 passThrough;
+        EntryMap entries;
+        // Most recently used at the front
+        KeyList lru;
+        uint32 dirtyCount;
+        bool flushing;
+    };
+    typedef std::tr1::unordered_map<Bucket, BucketCache*, Bucket::Hasher> BucketCacheMap;
+
+    // Keys and versions of dirty entries sent to the backend
+    typedef std::vector<std::pair<Key, uint64> > FlushedList;
+
+    typedef boost::mutex Mutex;
+    typedef boost::lock_guard<Mutex> Lock;
+
+    // All of these require mMutex to be held
+    Transaction* getTransaction(const Bucket& bucket, bool* is_new = NULL);
+    BucketCache* getCache(const Bucket& bucket, bool leased_only);
+    // Tries to run the transaction against the cache. Returns false if it
+    // needs the backend, leaving the cache untouched.
+    bool tryCommitLocal(const Bucket& bucket, BucketCache* cache, const Transaction& trans, Result* result_out, ReadSet** rs_out);
+    // Adds the bucket's dirty entries to an open backend transaction
+    void addDirty(const Bucket& bucket, BucketCache* cache, FlushedList* flushed);
+    void markFlushed(BucketCache* cache, const FlushedList& flushed);
+    Entry& touch(BucketCache* cache, const Key& key);
+    void setClean(BucketCache* cache, const Key& key, bool exists, const String& value);
+    void evict(BucketCache* cache);
+    void dropClean(BucketCache* cache);
+    // Drops everything cached for a bucket whose lease was lost, including
+    // unflushed writes
+    void dropLost(const Bucket& bucket, BucketCache* cache);
+    void scheduleFlush();
+    // Sends the bucket's dirty entries to the backend if there are any. Unless
+    // forced, this does nothing while another flush is in progress.
+    void flushBucket(const Bucket& bucket, bool force = false);
+    // Deletes the cache for a released bucket and passes the release on once
+    // all its writes have been flushed and transactions passed through have
+    // completed. Returns true if it did.
+    bool finishRelease(const Bucket& bucket, BucketCache* cache);
+
+    void flushAll();
+    void handleFlush(const Bucket& bucket, FlushedList flushed, bool forced, Result result, ReadSet* rs);
+    void handleBackendCommit(const Bucket& bucket, FlushedList flushed, bool counted, Transaction* trans, CommitCallback cb, Result result, ReadSet* rs);
+
+    void commandStats(const Command::Command& cmd, Command::Commander* cmdr, Command::CommandID cmdid);
+
+    ObjectHostContext* mContext;
+    Storage* mBackend;
+    const uint32 mMaxEntries;
+    const uint32 mMaxDirty;
+    const Duration mFlushInterval;
+
+    Mutex mMutex;
+    BucketTransactions mTransactions;
+    BucketCacheMap mCaches;
+    uint64 mVersion;
+    Network::IOTimerPtr mFlushTimer;
+    bool mFlushScheduled;
+    Stats mStats;
+};
+
+} // namespace OH
+} // namespace Sirikata
+
+#endif //_SIRIKATA_OH_CACHED_STORAGE_HPP_
@@ -123,6 +123,8 @@ protected:
     const UUID mID;
 
     ObjectHost *mObjectHost;
+    // The strand this object, its presences and its script run on
+    Network::IOStrand* mStrand;
     ObjectScript *mObjectScript;
     typedef std::map<SpaceObjectReference, PerPresenceData*> PresenceDataMap;
     PresenceDataMap mPresenceData;
@@ -173,6 +175,13 @@ public:
     ObjectHostContext* context() { return mContext; }
     const ObjectHostContext* context() const { return mContext; }
 
+    /** Get the strand this object runs on. Session events, messages and
+     *  proximity results for this object are delivered on it. This is the
+     *  main strand unless the ObjectHost spreads objects over multiple
+     *  strands, see ObjectHost::objectStrand.
+     */
+    Network::IOStrand* strand() const { return mStrand; }
+
     /** \see ObjectHost::spaceTime */
     Time spaceTime(const SpaceID& space, const Time& t);
     /** \see ObjectHost::currentSpaceTime */
@@ -345,6 +354,9 @@ public:
 //    static bool handleEntityCreateMessage(const HostedObjectWPtr &weakSelf, const ODP::Endpoint& src, const ODP::Endpoint& dst, MemoryReference bodyData);
     static void handleMigrated(const HostedObjectWPtr &weakSelf, const SpaceID& space, const ObjectReference& obj, ServerID server);
     static void handleStreamCreated(const HostedObjectWPtr &weakSelf, const SpaceObjectReference& spaceobj, SessionManager::ConnectionEvent after, PresenceToken token);
+    // Versions of the above which run on the object's strand
+    static void iHandleMigrated(const HostedObjectWPtr &weakSelf, const SpaceID& space, const ObjectReference& obj, ServerID server);
+    static void iHandleStreamCreated(const HostedObjectWPtr &weakSelf, const SpaceObjectReference& spaceobj, SessionManager::ConnectionEvent after, PresenceToken token);
     static void handleDisconnected(const HostedObjectWPtr &weakSelf, const SpaceObjectReference& spaceobj, Disconnect::Code cc);
 
     // Helper that disconnects presences that were completed after the
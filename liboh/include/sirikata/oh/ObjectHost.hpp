@@ -44,12 +44,15 @@
 #include <sirikata/core/ohdp/Service.hpp>
 #include <sirikata/oh/SpaceNodeSession.hpp>
 #include <sirikata/oh/ObjectNodeSession.hpp>
+#include <sirikata/proxyobject/Defs.hpp>
 
 #include <sirikata/core/command/Commander.hpp>
 
 #include <sirikata/core/transfer/TransferPool.hpp>
 #include <sirikata/core/transfer/TransferMediator.hpp>
 
+#include <boost/thread/mutex.hpp>
+
 namespace Sirikata {
 class ProxyManager;
 class PluginManager;
@@ -95,15 +98,29 @@ class SIRIKATA_OH_EXPORT ObjectHost
     OH::Storage* mStorage;
     OH::PersistedObjectSet* mPersistentSet;
     OH::ObjectQueryProcessor* mQueryProcessor;
+
+    // Properties of remote objects, shared by all our presences' proxies
+    ProxyStateStorePtr mProxyStateStore;
+
     QueryDataLookupConstructor mQueryDataLookupConstructor;
     String mQueryDataLookupConstructorOpts;
 
+    // Only added to by addServerIDMap during setup. Object strands read it
+    // concurrently, so always look spaces up with find().
     SpaceSessionManagerMap mSessionManagers;
 
+    // Objects register and unregister themselves from their own strands, so
+    // these are protected by mHostedObjectsMutex
+    typedef boost::mutex Mutex;
+    mutable Mutex mHostedObjectsMutex;
     uint32 mActiveHostedObjects;
     HostedObjectMap mHostedObjects;
     InternalIDHostedObjectMap mHostedObjectsByID;
 
+    // Strands objects are spread over by ID. Empty if they all run on the main
+    // strand.
+    std::vector<Network::IOStrand*> mObjectStrands;
+
     typedef std::tr1::unordered_map<String, ObjectScriptManager*> ScriptManagerMap;
     ScriptManagerMap mScriptManagers;
 
@@ -150,6 +167,19 @@ public:
 
     ObjectHostContext* context() const { return mContext; }
 
+    /** Get the strand the object with the given ID runs on. Events for the
+     *  object, e.g. messages, session events and proximity results, are
+     *  delivered to it on this strand. This is the main strand unless
+     *  objectStrands is set.
+     */
+    Network::IOStrand* objectStrand(const UUID& id) const;
+    /** Get the number of strands objects are spread over, or 0 if they all
+     *  run on the main strand. Whoever runs the context needs this many
+     *  threads in addition to the one for the main strand to actually run
+     *  objects in parallel.
+     */
+    uint32 numObjectStrands() const { return mObjectStrands.size(); }
+
     /** Create an object with the specified script. This version allows you to
      *  specify the unique identifier manually, so it should only be used if you
      *  need an exact ID, e.g. if you are restoring an object.
@@ -188,6 +218,12 @@ public:
     void setQueryProcessor(OH::ObjectQueryProcessor* proc) { mQueryProcessor = proc; }
     OH::ObjectQueryProcessor* getQueryProcessor() { return mQueryProcessor; }
 
+    /** Get the store holding the properties of remote objects for all the
+     *  presences on this object host, so presences that see the same object
+     *  share a single copy of them.
+     */
+    const ProxyStateStorePtr& proxyStateStore() const { return mProxyStateStore; }
+
     // Get and set the storage backend to use for persistent object storage.
     void setQueryDataLookupConstructor(QueryDataLookupConstructor qdl, const String& opts) { mQueryDataLookupConstructor = qdl; mQueryDataLookupConstructorOpts = opts; }
     QueryDataLookupConstructor getQueryDataLookupConstructor() { return mQueryDataLookupConstructor; }
@@ -199,7 +235,9 @@ public:
 
     /** Connect the object to the space with the given starting parameters.
     *   returns true if the connection was initiated and no other objects are
-    *   using this ID to connect.
+    *   using this ID to connect. If objects run on their own strands, the
+    *   connection is started later from the main strand, and failing to start
+    *   it then is reported to disconnected_cb as Disconnect::LoginDenied.
     */
     bool connect(
         HostedObjectPtr ho, // requestor, or can be NULL
@@ -217,7 +255,7 @@ public:
     );
 
     /** Use this function to request the object host to send a disconnect message
-     *  to space for object.
+     *  to space for object. Safe to call from any object's strand.
      */
     void disconnectObject(const SpaceID& space, const ObjectReference& oref);
 
@@ -245,7 +283,11 @@ public:
     /** Get the current local time. */
     Time currentLocalTime() const;
 
-    /** Primary ODP send function. */
+    /** Primary ODP send function. Safe to call from any object's strand. If
+     *  objects don't run on the main strand, the message is handed to it and
+     *  false is only returned for unknown spaces. Messages are unreliable
+     *  either way, so callers shouldn't rely on the result.
+     */
     bool send(SpaceObjectReference& sporefsrc, const SpaceID& space, const ObjectMessagePort src_port, const UUID& dest, const ObjectMessagePort dest_port, const std::string& payload);
     bool send(SpaceObjectReference& sporefsrc, const SpaceID& space, const ObjectMessagePort src_port, const UUID& dest, const ObjectMessagePort dest_port, MemoryReference payload);
 
@@ -290,6 +332,21 @@ public:
     ObjectScriptManager* getScriptManager(const String& id);
 
   private:
+    // Stand in for a SessionManager and deliver messages through
+    // handleObjectMessage
+    friend class ObjectStrandBenchmark;
+    friend class ObjectHostTestAccess;
+
+    struct PendingConnect;
+    typedef std::tr1::shared_ptr<PendingConnect> PendingConnectPtr;
+
+    // SessionManagers may only be used from the main strand. These do the
+    // work for the corresponding public methods, which hand it over to the
+    // main strand when objects run on their own strands.
+    bool sessionConnect(PendingConnectPtr pc);
+    void postedSessionConnect(PendingConnectPtr pc);
+    void sessionDisconnect(const SpaceID& space, const ObjectReference& oref);
+    bool sessionSend(const SpaceObjectReference& sporef_src, const SpaceID& space, const ObjectMessagePort src_port, const UUID& dest, const ObjectMessagePort dest_port, const std::string& payload);
 
     // SpaceNodeSessionListener Interface -- forwards on to real listeners
     virtual void onSpaceNodeSession(const OHDP::SpaceNodeID& id, OHDPSST::StreamPtr sn_stream) { fireSpaceNodeSession(id, sn_stream); }
@@ -48,6 +48,7 @@
 
 #include <sirikata/oh/DisconnectCodes.hpp>
 #include <sirikata/oh/SpaceNodeSession.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace Sirikata {
 
@@ -165,6 +166,8 @@ class SIRIKATA_OH_EXPORT SessionManager
     // streams as part of the connection process.
     bool send(const SpaceObjectReference& sporef_objid, const ObjectMessagePort src_port, const UUID& dest, const ObjectMessagePort dest_port, const std::string& payload, ServerID dest_server = NullServerID);
 
+    // Safe to call from any strand, e.g. by objects not running on the main
+    // strand
     SSTStreamPtr getSpaceStream(const ObjectReference& objectID);
 
     // Service Implementation
@@ -460,6 +463,9 @@ private:
 
     void spaceConnectCallback(int err, SSTStreamPtr s, SpaceObjectReference obj, ConnectionEvent after);
     std::map<ObjectReference, SSTStreamPtr> mObjectToSpaceStreams;
+    // Protects mObjectToSpaceStreams, which getSpaceStream reads from other
+    // strands
+    boost::mutex mObjectToSpaceStreamsMutex;
 
 #ifdef PROFILE_OH_PACKET_RTT
     // Track outstanding packets for computing RTTs
@@ -255,6 +255,9 @@ class SIRIKATA_OH_EXPORT StorageFactory
       public Factory2<Storage*, ObjectHostContext*, const String&>
 {
 public:
+    StorageFactory();
+    ~StorageFactory();
+
     static StorageFactory& getSingleton();
     static void destroy();
 };
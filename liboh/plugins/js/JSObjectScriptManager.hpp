@@ -37,6 +37,7 @@
 #include <sirikata/oh/ObjectScriptManager.hpp>
 #include <sirikata/core/options/Options.hpp>
 #include <sirikata/core/transfer/TransferMediator.hpp>
+#include <sirikata/core/util/Thread.hpp>
 #include <sirikata/core/transfer/ResourceDownloadTask.hpp>
 #include <sirikata/mesh/ModelsSystem.hpp>
 #include <sirikata/mesh/Filter.hpp>
@@ -3,6 +3,7 @@
 // be found in the LICENSE file.
 
 #include <sirikata/oh/Platform.hpp>
+#include <sirikata/core/options/Options.hpp>
 #include "SimpleObjectQueryProcessor.hpp"
 
 static int oh_simple_query_plugin_refcount = 0;
@@ -31,6 +32,10 @@ SIRIKATA_PLUGIN_EXPORT_C void init() {
     using std::tr1::placeholders::_1;
     using std::tr1::placeholders::_2;
     if (oh_simple_query_plugin_refcount == 0) {
+        Sirikata::InitializeClassOptions ico(SIMPLE_QUERY_OPTIONS, NULL,
+            new OptionValue(SIMPLE_QUERY_LOC_ENCODING, "full", Sirikata::OptionValueType<String>(), "Encoding to request for location updates, full or compact. Compact updates are quantized and only carry changed properties."),
+            NULL);
+
         Sirikata::OH::ObjectQueryProcessorFactory::getSingleton().registerConstructor(
             "simple",
             std::tr1::bind(
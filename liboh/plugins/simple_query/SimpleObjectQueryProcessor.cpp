@@ -11,6 +11,8 @@
 #include <sirikata/proxyobject/ProxyManager.hpp>
 #include <sirikata/oh/OHSpaceTimeSynced.hpp>
 #include <sirikata/core/odp/SST.hpp>
+#include <sirikata/core/options/Options.hpp>
+#include <json_spirit/json_spirit.h>
 
 #define SOQP_LOG(lvl, msg) SILOG(simple-object-query-processor, lvl, msg)
 
@@ -19,13 +21,22 @@ namespace OH {
 namespace Simple {
 
 SimpleObjectQueryProcessor* SimpleObjectQueryProcessor::create(ObjectHostContext* ctx, const String& args) {
-    return new SimpleObjectQueryProcessor(ctx);
+    OptionSet* optionsSet = OptionSet::getOptions(SIMPLE_QUERY_OPTIONS,NULL);
+    optionsSet->parse(args);
+
+    String encoding_name = optionsSet->referenceOption(SIMPLE_QUERY_LOC_ENCODING)->as<String>();
+    LocUpdateEncoding encoding = LocUpdateEncodingFull;
+    if (!parseLocUpdateEncoding(encoding_name, &encoding))
+        SOQP_LOG(error, "Unknown location update encoding " << encoding_name << ", using full encoding.");
+
+    return new SimpleObjectQueryProcessor(ctx, encoding);
 }
 
 
-SimpleObjectQueryProcessor::SimpleObjectQueryProcessor(ObjectHostContext* ctx)
+SimpleObjectQueryProcessor::SimpleObjectQueryProcessor(ObjectHostContext* ctx, LocUpdateEncoding loc_encoding)
  : ObjectQueryProcessor(ctx),
-   mContext(ctx)
+   mContext(ctx),
+   mLocEncoding(loc_encoding)
 {
 }
 
@@ -160,9 +171,27 @@ bool SimpleObjectQueryProcessor::handleProximityMessage(HostedObjectPtr self, co
 }
 
 
+String SimpleObjectQueryProcessor::addLocEncoding(const String& query) {
+    // The space uses the full encoding by default, and an empty query
+    // indicates there's no query at all
+    if (mLocEncoding == LocUpdateEncodingFull || query.empty())
+        return query;
+
+    namespace json = json_spirit;
+    json::Value parsed;
+    if (!json::read(query, parsed) || !parsed.isObject())
+        return query;
+    parsed.put(LOC_UPDATE_ENCODING_QUERY_KEY, locUpdateEncodingName(mLocEncoding));
+    return json::write(parsed);
+}
+
+String SimpleObjectQueryProcessor::connectRequest(HostedObjectPtr ho, const SpaceObjectReference& sporef, const String& query) {
+    return addLocEncoding(query);
+}
+
 void SimpleObjectQueryProcessor::updateQuery(HostedObjectPtr ho, const SpaceObjectReference& sporef, const String& new_query) {
     Protocol::Prox::QueryRequest request;
-    request.set_query_parameters(new_query);
+    request.set_query_parameters(addLocEncoding(new_query));
     std::string payload = serializePBJMessage(request);
 
     SSTStreamPtr spaceStream = mContext->objectHost->getSpaceStream(sporef.space(), sporef.object());
@@ -215,8 +244,6 @@ bool SimpleObjectQueryProcessor::handleLocationMessage(const HostedObjectPtr& se
     Sirikata::Protocol::Frame frame;
     bool parse_success = frame.ParseFromString(payload);
     if (!parse_success) return false;
-    Sirikata::Protocol::Loc::BulkLocationUpdate contents;
-    contents.ParseFromString(frame.payload());
 
     // Each update is checked against the current proximity results (in this
     // implementation's case, that's just the object's ProxyObjects) and
@@ -231,13 +258,38 @@ bool SimpleObjectQueryProcessor::handleLocationMessage(const HostedObjectPtr& se
     }
     // As well as looking up object state (orhpan manager) only once
     ObjectStatePtr obj_state = mObjectStateMap[spaceobj];
+    OHSpaceTimeSynced sync(mContext->objectHost, spaceobj.space());
+
+    // Compact updates only carry the properties that changed, so they rely
+    // on the per-property seqnos to avoid applying stale data
+    if (CompactBulkLocationUpdate::isCompact(frame.payload())) {
+        CompactBulkLocationUpdate compact_contents;
+        if (!compact_contents.ParseFromString(frame.payload())) {
+            SOQP_LOG(error, "Failed to parse compact location update.");
+            return true;
+        }
+        for(int32 idx = 0; idx < compact_contents.update_size(); idx++) {
+            const CompactLocationUpdate& update = compact_contents.update(idx);
+            SpaceObjectReference observed(spaceobj.space(), ObjectReference(update.object));
+            ProxyObjectPtr proxy_obj = proxy_manager->getProxyObject(observed);
+
+            CompactProtocolLocUpdate clu(update, sync);
+            if (!proxy_obj)
+                obj_state->orphans.addOrphanUpdate(observed, clu);
+            else
+                deliverLocationUpdate(self, spaceobj, clu);
+        }
+        return true;
+    }
+
+    Sirikata::Protocol::Loc::BulkLocationUpdate contents;
+    contents.ParseFromString(frame.payload());
 
     for(int32 idx = 0; idx < contents.update_size(); idx++) {
         Sirikata::Protocol::Loc::LocationUpdate update = contents.update(idx);
         SpaceObjectReference observed(spaceobj.space(), ObjectReference(update.object()));
         ProxyObjectPtr proxy_obj = proxy_manager->getProxyObject(observed);
 
-        OHSpaceTimeSynced sync(mContext->objectHost, spaceobj.space());
         LocProtocolLocUpdate llu(update, sync);
         if (!proxy_obj) {
             obj_state->orphans.addOrphanUpdate(observed, llu);
@@ -8,6 +8,10 @@
 #include <sirikata/oh/ObjectQueryProcessor.hpp>
 
 #include <sirikata/pintoloc/OrphanLocUpdateManager.hpp>
+#include <sirikata/pintoloc/LocUpdate.hpp>
+
+#define SIMPLE_QUERY_OPTIONS      "simplequery"
+#define SIMPLE_QUERY_LOC_ENCODING "loc-encoding"
 
 namespace Sirikata {
 namespace OH {
@@ -25,7 +29,7 @@ class SimpleObjectQueryProcessor :
 public:
     static SimpleObjectQueryProcessor* create(ObjectHostContext* ctx, const String& args);
 
-    SimpleObjectQueryProcessor(ObjectHostContext* ctx);
+    SimpleObjectQueryProcessor(ObjectHostContext* ctx, LocUpdateEncoding loc_encoding);
     virtual ~SimpleObjectQueryProcessor();
 
     virtual void start();
@@ -34,6 +38,7 @@ public:
     virtual void presenceConnectedStream(HostedObjectPtr ho, const SpaceObjectReference& sporef, HostedObject::SSTStreamPtr strm);
     virtual void presenceDisconnected(HostedObjectPtr ho, const SpaceObjectReference& sporef);
 
+    virtual String connectRequest(HostedObjectPtr ho, const SpaceObjectReference& sporef, const String& query);
     virtual void updateQuery(HostedObjectPtr ho, const SpaceObjectReference& sporef, const String& new_query);
 
 
@@ -43,6 +48,10 @@ public:
 private:
     void handleStop();
 
+    // Add our location update encoding to a query so the space knows to use
+    // it
+    String addLocEncoding(const String& query);
+
     // Proximity
     void handleProximitySubstream(const HostedObjectWPtr &weakSelf, const SpaceObjectReference& spaceobj, int err, SSTStreamPtr s);
     void handleProximitySubstreamRead(const HostedObjectWPtr &weakSelf, const SpaceObjectReference& spaceobj, SSTStreamPtr s, String* prevdata, uint8* buffer, int length);
@@ -66,6 +75,7 @@ private:
 
 
     ObjectHostContext* mContext;
+    LocUpdateEncoding mLocEncoding;
 
     // We resolve ordering issues here instead of leaving it up to the
     // object. To do so, we track a bit of state for each query -- the
@@ -44,6 +44,11 @@ static void InitPluginOptions() {
     Sirikata::InitializeClassOptions ico("sqlitestorage",NULL,
         new Sirikata::OptionValue("db", "storage.db", Sirikata::OptionValueType<String>(), "Database file to store data to."),
         new Sirikata::OptionValue("lease-duration", "30s", Sirikata::OptionValueType<Duration>(), "Duration to register leases for. Longer times require less overhead, but also mean longer delays if an object or object host dies without cleaning up."),
+        new Sirikata::OptionValue("group-commit-max", "64", Sirikata::OptionValueType<uint32>(), "Maximum number of transactions, possibly from different objects, to commit together in one database transaction."),
+        new Sirikata::OptionValue("group-commit-delay", "0s", Sirikata::OptionValueType<Duration>(), "Maximum time to hold a transaction back waiting for others to commit with it. With 0, transactions are committed as soon as the storage thread is free, grouping whatever queued up in the meantime."),
+        new Sirikata::OptionValue("journal-mode", "", Sirikata::OptionValueType<String>(), "SQLite journal mode, e.g. delete or wal. wal lets readers proceed during writes and makes commits cheaper. Empty uses SQLite's default."),
+        new Sirikata::OptionValue("synchronous", "", Sirikata::OptionValueType<String>(), "SQLite synchronous setting, e.g. full or normal. normal with journal-mode=wal only syncs at checkpoints. Empty uses SQLite's default."),
+        new Sirikata::OptionValue("mmap-size", "0", Sirikata::OptionValueType<uint64>(), "Bytes of the database SQLite may read through memory mapped IO. 0 disables it."),
         NULL);
 
     Sirikata::InitializeClassOptions icop("sqlitepersistedset",NULL,
@@ -61,8 +66,15 @@ static OH::Storage* createSQLiteStorage(ObjectHostContext* ctx, const String& ar
 
     String db = optionsSet->referenceOption("db")->as<String>();
     Duration lease_duration = optionsSet->referenceOption("lease-duration")->as<Duration>();
-
-    return new OH::SQLiteStorage(ctx, db, lease_duration);
+    uint32 group_commit_max = optionsSet->referenceOption("group-commit-max")->as<uint32>();
+    Duration group_commit_delay = optionsSet->referenceOption("group-commit-delay")->as<Duration>();
+    String journal_mode = optionsSet->referenceOption("journal-mode")->as<String>();
+    String synchronous = optionsSet->referenceOption("synchronous")->as<String>();
+    uint64 mmap_size = optionsSet->referenceOption("mmap-size")->as<uint64>();
+
+    return new OH::SQLiteStorage(ctx, db, lease_duration,
+        group_commit_max, group_commit_delay,
+        journal_mode, synchronous, mmap_size);
 }
 
 static OH::PersistedObjectSet* createSQLitePersistedObjectSet(ObjectHostContext* ctx, const String& args) {
@@ -56,8 +56,101 @@ namespace OH {
  *  is sufficient because as soon as we read the data, we have a
  *  reader lock and the transaction won't complete if someone else
  *  tried to write to it.
+ *
+ *  Committing is what's expensive, since each commit has to sync to
+ *  disk, so transactions queued up by different buckets are committed
+ *  together in one SQLite transaction (group commit). Each gets its
+ *  own savepoint within the group so a failure only rolls back that
+ *  transaction. If the group as a whole can't be committed we fall
+ *  back to committing its transactions one at a time.
  */
 
+SQLiteStorage::StatementCache::StatementCache()
+ : mDB()
+{
+    for(int i = 0; i < NumStatements; i++)
+        mStatements[i] = NULL;
+}
+
+SQLiteStorage::StatementCache::~StatementCache() {
+    reset(SQLiteDBPtr());
+}
+
+void SQLiteStorage::StatementCache::reset(SQLiteDBPtr db) {
+    for(int i = 0; i < NumStatements; i++) {
+        if (mStatements[i] != NULL)
+            sqlite3_finalize(mStatements[i]);
+        mStatements[i] = NULL;
+    }
+    mDB = db;
+}
+
+sqlite3_stmt* SQLiteStorage::StatementCache::get(StatementType type) {
+    if (mStatements[type] != NULL)
+        return mStatements[type];
+    if (!mDB)
+        return NULL;
+
+    String sql;
+    switch(type) {
+      case SelectValueStatement:
+        sql = "SELECT value FROM \"" TABLE_NAME "\" WHERE object == ? AND key == ?";
+        break;
+      case SelectRangeStatement:
+        sql = "SELECT key, value FROM \"" TABLE_NAME "\" WHERE object == ? AND key BETWEEN ? AND ?";
+        break;
+      case InsertValueStatement:
+        sql = "INSERT OR REPLACE INTO \"" TABLE_NAME "\" (object, key, value) VALUES(?, ?, ?)";
+        break;
+      case DeleteValueStatement:
+        sql = "DELETE FROM \"" TABLE_NAME "\" WHERE object = ? AND key = ?";
+        break;
+      case DeleteRangeStatement:
+        sql = "DELETE FROM \"" TABLE_NAME "\" WHERE object = ? AND key BETWEEN ? AND ?";
+        break;
+      case CountRangeStatement:
+        sql = "SELECT COUNT(*) FROM \"" TABLE_NAME "\" WHERE object = ? AND key BETWEEN ? AND ?";
+        break;
+      case BeginStatement:
+        sql = "BEGIN DEFERRED TRANSACTION";
+        break;
+      case CommitStatement:
+        sql = "COMMIT TRANSACTION";
+        break;
+      case RollbackStatement:
+        sql = "ROLLBACK TRANSACTION";
+        break;
+      case SavepointStatement:
+        sql = "SAVEPOINT storage_transaction";
+        break;
+      case ReleaseSavepointStatement:
+        sql = "RELEASE SAVEPOINT storage_transaction";
+        break;
+      case RollbackSavepointStatement:
+        sql = "ROLLBACK TRANSACTION TO SAVEPOINT storage_transaction";
+        break;
+      default:
+        return NULL;
+    }
+
+    sqlite3_stmt* stmt = NULL;
+    int rc = sqlite3_prepare_v2(mDB->db(), sql.c_str(), -1, &stmt, NULL);
+    if (checkSQLiteError(mDB, rc, "Error preparing statement: " + sql)) {
+        sqlite3_finalize(stmt);
+        return NULL;
+    }
+
+    mStatements[type] = stmt;
+    return stmt;
+}
+
+void SQLiteStorage::StatementCache::release(sqlite3_stmt* stmt) {
+    // Errors from the last step are also returned here, but callers have
+    // already handled them
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+}
+
 
 SQLiteStorage::StorageAction::StorageAction()
  : type(Error),
@@ -87,7 +180,10 @@ SQLiteStorage::StorageAction& SQLiteStorage::StorageAction::operator=(const Stor
     return *this;
 }
 
-Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Bucket& bucket, ReadSet* rs) {
+Storage::Result SQLiteStorage::StorageAction::execute(StatementCache* stmts, const Bucket& bucket, ReadSet* rs) {
+    SQLiteDBPtr db = stmts->db();
+    String bucket_str = bucket.rawHexData();
+
     Result result = SUCCESS;
     switch(type) {
 
@@ -96,20 +192,16 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
       case Read:
       case Compare:
           {
-              String value_query = "SELECT value FROM ";
-              value_query += "\"" TABLE_NAME "\"";
-              value_query += " WHERE object == \'" + bucket.rawHexData() + "\' AND key == ?";
               int rc;
-              char* remain;
-              sqlite3_stmt* value_query_stmt;
               bool newStep = true;
-              rc = sqlite3_prepare_v2(db->db(), value_query.c_str(), -1, &value_query_stmt, (const char**)&remain);
-              bool success = true;
-              success = success && !checkSQLiteError(db, rc, "Error preparing value query statement");
-              if (rc==SQLITE_OK) {
-                  rc = sqlite3_bind_text(value_query_stmt, 1, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
+              sqlite3_stmt* value_query_stmt = stmts->get(SelectValueStatement);
+              bool success = (value_query_stmt != NULL);
+              if (success) {
+                  rc = sqlite3_bind_text(value_query_stmt, 1, bucket_str.c_str(), (int)bucket_str.size(), SQLITE_TRANSIENT);
+                  success = success && !checkSQLiteError(db, rc, "Error binding object to value query statement");
+                  rc = sqlite3_bind_text(value_query_stmt, 2, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
                   success = success && !checkSQLiteError(db, rc, "Error binding key name to value query statement");
-                  if (rc==SQLITE_OK) {
+                  if (success) {
                       int step_rc = sqlite3_step(value_query_stmt);
                       while(step_rc == SQLITE_ROW) {
                           newStep = false;
@@ -130,18 +222,17 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
                           step_rc = sqlite3_step(value_query_stmt);
                       }
                       if (step_rc != SQLITE_DONE) {
-                          // reset the statement so it'll clean up properly
-                          rc = sqlite3_reset(value_query_stmt);
-                          success = success && !checkSQLiteError(db, rc, "Error finalizing value query statement");
+                          success = false;
                           // Make sure we notify of temporary failures in case
                           // retrying is worth it
                           if (step_rc == SQLITE_LOCKED || step_rc == SQLITE_BUSY)
                               result = LOCK_ERROR;
+                          else
+                              checkSQLiteError(db, step_rc, "Error executing value query statement");
                       }
                   }
+                  stmts->release(value_query_stmt);
               }
-              rc = sqlite3_finalize(value_query_stmt);
-              success = success && !checkSQLiteError(db, rc, "Error finalizing value query statement");
 
               if (newStep) { // no rows were found, key is missing
                   success = false;
@@ -159,22 +250,17 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
 
       case ReadRange:
           {
-              String value_query = "SELECT key, value FROM ";
-              value_query += "\"" TABLE_NAME "\"";
-              value_query += " WHERE object == \'" + bucket.rawHexData() + "\' AND key BETWEEN ? AND ?";
-
               int rc;
-              char* remain;
-              sqlite3_stmt* value_query_stmt;
-              rc = sqlite3_prepare_v2(db->db(), value_query.c_str(), -1, &value_query_stmt, (const char**)&remain);
-              bool success = true;
-              success = success && !checkSQLiteError(db, rc, "Error preparing value query statement");
-              if (rc==SQLITE_OK){
-                  rc = sqlite3_bind_text(value_query_stmt, 1, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
+              sqlite3_stmt* value_query_stmt = stmts->get(SelectRangeStatement);
+              bool success = (value_query_stmt != NULL);
+              if (success) {
+                  rc = sqlite3_bind_text(value_query_stmt, 1, bucket_str.c_str(), (int)bucket_str.size(), SQLITE_TRANSIENT);
+                  success = success && !checkSQLiteError(db, rc, "Error binding object to value query statement");
+                  rc = sqlite3_bind_text(value_query_stmt, 2, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
                   success = success && !checkSQLiteError(db, rc, "Error binding start key to value query statement");
-                  rc = sqlite3_bind_text(value_query_stmt, 2, keyEnd.c_str(), (int)keyEnd.size(), SQLITE_TRANSIENT);
+                  rc = sqlite3_bind_text(value_query_stmt, 3, keyEnd.c_str(), (int)keyEnd.size(), SQLITE_TRANSIENT);
                   success = success && !checkSQLiteError(db, rc, "Error binding finish key to value query statement");
-                  if (rc==SQLITE_OK) {
+                  if (success) {
                       int step_rc = sqlite3_step(value_query_stmt);
                       int nread = 0;
                       while(step_rc == SQLITE_ROW) {
@@ -198,18 +284,17 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
                           // SILOG(sqlite-storage, error, "RangeRead found 0 keys in range");
                       }
                       if (step_rc != SQLITE_DONE) {
-                          // reset the statement so it'll clean up properly
-                          rc = sqlite3_reset(value_query_stmt);
-                          success = success && !checkSQLiteError(db, rc, "Error finalizing value query statement");
+                          success = false;
                           // Make sure we notify of temporary failures in case
                           // retrying is worth it
                           if (step_rc == SQLITE_LOCKED || step_rc == SQLITE_BUSY)
                               result = LOCK_ERROR;
+                          else
+                              checkSQLiteError(db, step_rc, "Error executing value query statement");
                       }
                   }
+                  stmts->release(value_query_stmt);
               }
-              rc = sqlite3_finalize(value_query_stmt);
-              success = success && !checkSQLiteError(db, rc, "Error finalizing value query statement");
               // If no other error condition is indicated yet, mark transaction
               // error for failures
               if (!success && result == SUCCESS)
@@ -223,70 +308,54 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
               // Erase and write use different statements, but the rest is the
               // same since it just needs to execute and check for success.
               int rc;
-              char* remain;
-
-              String value_insert;
-              if (type == Write) {
-                  value_insert = "INSERT OR REPLACE INTO ";
-                  value_insert += "\"" TABLE_NAME "\"";
-                  value_insert += " (object, key, value) VALUES(\'" + bucket.rawHexData() + "\', ?, ?)";
-              }
-              else if (type == Erase) {
-                  value_insert = "DELETE FROM ";
-                  value_insert += "\"" TABLE_NAME "\"";
-                  value_insert += " WHERE object = \'" + bucket.rawHexData() + "\' AND key = ?";
-              }
-
-              sqlite3_stmt* value_insert_stmt;
-              rc = sqlite3_prepare_v2(db->db(), value_insert.c_str(), -1, &value_insert_stmt, (const char**)&remain);
-              bool success = true;
-              success = success && !checkSQLiteError(db, rc, "Error preparing value insert statement");
-
-              rc = sqlite3_bind_text(value_insert_stmt, 1, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
-              success = success && !checkSQLiteError(db, rc, "Error binding key name to value insert statement");
-              if (rc==SQLITE_OK) {
-                  if (type == Write) {
+              sqlite3_stmt* value_insert_stmt = stmts->get(type == Write ? InsertValueStatement : DeleteValueStatement);
+              bool success = (value_insert_stmt != NULL);
+              if (success) {
+                  rc = sqlite3_bind_text(value_insert_stmt, 1, bucket_str.c_str(), (int)bucket_str.size(), SQLITE_TRANSIENT);
+                  success = success && !checkSQLiteError(db, rc, "Error binding object to value insert statement");
+                  rc = sqlite3_bind_text(value_insert_stmt, 2, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
+                  success = success && !checkSQLiteError(db, rc, "Error binding key name to value insert statement");
+                  if (success && type == Write) {
                       assert(value != NULL);
-                      rc = sqlite3_bind_blob(value_insert_stmt, 2, value->c_str(), (int)value->size(), SQLITE_TRANSIENT);
+                      rc = sqlite3_bind_blob(value_insert_stmt, 3, value->c_str(), (int)value->size(), SQLITE_TRANSIENT);
                       success = success && !checkSQLiteError(db, rc, "Error binding value to value insert statement");
                   }
               }
 
-              int step_rc = sqlite3_step(value_insert_stmt);
-              if (step_rc != SQLITE_OK && step_rc != SQLITE_DONE) {
-                  sqlite3_reset(value_insert_stmt); // allow this to be cleaned up
-                  success = false;
-                  // Make sure we notify of temporary failures in case
-                  // retrying is worth it
-                  if (step_rc == SQLITE_LOCKED || step_rc == SQLITE_BUSY)
-                      result = LOCK_ERROR;
-                  else
-                      SILOG(sqlite-storage, error, "Write or erase error: " << SQLite::resultAsString(step_rc));
-              }
-              else {
-                  // Check the number of changes that the statement actually
-                  // made. This is update, insertion, or deletion. This should
-                  // just be 1 since we expect exactly one change on a
-                  // write. On an erase, we ignore missing keys, but
-                  // we should see either 0 or 1 ops.
-                  int changes = sqlite3_changes(db->db());
-                  if (type == Write) {
-                      if (changes != 1) {
-                          success = false;
-                          SILOG(sqlite-storage, error, "Incorrect number of changes for write: " << changes);
-                      }
-                      success = success && (changes == 1);
+              if (success) {
+                  int step_rc = sqlite3_step(value_insert_stmt);
+                  if (step_rc != SQLITE_OK && step_rc != SQLITE_DONE) {
+                      success = false;
+                      // Make sure we notify of temporary failures in case
+                      // retrying is worth it
+                      if (step_rc == SQLITE_LOCKED || step_rc == SQLITE_BUSY)
+                          result = LOCK_ERROR;
+                      else
+                          SILOG(sqlite-storage, error, "Write or erase error: " << SQLite::resultAsString(step_rc));
                   }
-                  else if (type == Erase) {
-                      if (changes != 0 && changes != 1) {
-                          success = false;
-                          SILOG(sqlite-storage, error, "Incorrect number of changes for erase: " << changes);
+                  else {
+                      // Check the number of changes that the statement actually
+                      // made. This is update, insertion, or deletion. This should
+                      // just be 1 since we expect exactly one change on a
+                      // write. On an erase, we ignore missing keys, but
+                      // we should see either 0 or 1 ops.
+                      int changes = sqlite3_changes(db->db());
+                      if (type == Write) {
+                          if (changes != 1) {
+                              success = false;
+                              SILOG(sqlite-storage, error, "Incorrect number of changes for write: " << changes);
+                          }
+                      }
+                      else if (type == Erase) {
+                          if (changes != 0 && changes != 1) {
+                              success = false;
+                              SILOG(sqlite-storage, error, "Incorrect number of changes for erase: " << changes);
+                          }
                       }
                   }
               }
-
-              rc = sqlite3_finalize(value_insert_stmt);
-              success = success && !checkSQLiteError(db, rc, "Error finalizing value insert statement");
+              if (value_insert_stmt != NULL)
+                  stmts->release(value_insert_stmt);
 
               // If no other error condition is indicated yet, mark transaction
               // error for failures
@@ -297,32 +366,30 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
 
       case EraseRange:
           {
-              String value_delete = "DELETE FROM ";
-              value_delete += "\"" TABLE_NAME "\"";
-              value_delete += " WHERE object = \'" + bucket.rawHexData() + "\' AND key BETWEEN ? AND ?";
-
               int rc;
-              char* remain;
-              sqlite3_stmt* value_delete_stmt;
-              rc = sqlite3_prepare_v2(db->db(), value_delete.c_str(), -1, &value_delete_stmt, (const char**)&remain);
-              bool success = true;
-              success = success && !checkSQLiteError(db, rc, "Error preparing value delete statement");
-
-              rc = sqlite3_bind_text(value_delete_stmt, 1, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
-              success = success && !checkSQLiteError(db, rc, "Error binding start key to value delete statement");
-              rc = sqlite3_bind_text(value_delete_stmt, 2, keyEnd.c_str(), (int)keyEnd.size(), SQLITE_TRANSIENT);
-              success = success && !checkSQLiteError(db, rc, "Error binding finish key to value delete statement");
-
-              int step_rc = sqlite3_step(value_delete_stmt);
-              if (step_rc != SQLITE_OK && step_rc != SQLITE_DONE) {
-                  sqlite3_reset(value_delete_stmt); // allow this to be cleaned up
-                  // Make sure we notify of temporary failures in case
-                  // retrying is worth it
-                  if (step_rc == SQLITE_LOCKED || step_rc == SQLITE_BUSY)
-                      result = LOCK_ERROR;
+              sqlite3_stmt* value_delete_stmt = stmts->get(DeleteRangeStatement);
+              bool success = (value_delete_stmt != NULL);
+              if (success) {
+                  rc = sqlite3_bind_text(value_delete_stmt, 1, bucket_str.c_str(), (int)bucket_str.size(), SQLITE_TRANSIENT);
+                  success = success && !checkSQLiteError(db, rc, "Error binding object to value delete statement");
+                  rc = sqlite3_bind_text(value_delete_stmt, 2, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
+                  success = success && !checkSQLiteError(db, rc, "Error binding start key to value delete statement");
+                  rc = sqlite3_bind_text(value_delete_stmt, 3, keyEnd.c_str(), (int)keyEnd.size(), SQLITE_TRANSIENT);
+                  success = success && !checkSQLiteError(db, rc, "Error binding finish key to value delete statement");
+                  if (success) {
+                      int step_rc = sqlite3_step(value_delete_stmt);
+                      if (step_rc != SQLITE_OK && step_rc != SQLITE_DONE) {
+                          success = false;
+                          // Make sure we notify of temporary failures in case
+                          // retrying is worth it
+                          if (step_rc == SQLITE_LOCKED || step_rc == SQLITE_BUSY)
+                              result = LOCK_ERROR;
+                          else
+                              checkSQLiteError(db, step_rc, "Error executing value delete statement");
+                      }
+                  }
+                  stmts->release(value_delete_stmt);
               }
-              rc = sqlite3_finalize(value_delete_stmt);
-              success = success && !checkSQLiteError(db, rc, "Error finalizing value delete statement");
 
               // If no other error condition is indicated yet, mark transaction
               // error for failures
@@ -339,12 +406,12 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
     return result;
 }
 
-Storage::Result SQLiteStorage::StorageAction::executeWithRetry(SQLiteDBPtr db, const Bucket& bucket, ReadSet* rs, int32 retries, const Duration& retry_wait) {
+Storage::Result SQLiteStorage::StorageAction::executeWithRetry(StatementCache* stmts, const Bucket& bucket, ReadSet* rs, int32 retries, const Duration& retry_wait) {
     Storage::Result res = LOCK_ERROR;
     for(int32 i = 0; i < retries && res == LOCK_ERROR; i++) {
         if (i != 0) Timer::sleep(retry_wait);
 
-        res = execute(db, bucket, rs);
+        res = execute(stmts, bucket, rs);
     }
 
     if (res == LOCK_ERROR)
@@ -352,10 +419,16 @@ Storage::Result SQLiteStorage::StorageAction::executeWithRetry(SQLiteDBPtr db, c
     return res;
 }
 
-SQLiteStorage::SQLiteStorage(ObjectHostContext* ctx, const String& dbpath, const Duration& lease_duration)
+SQLiteStorage::SQLiteStorage(ObjectHostContext* ctx, const String& dbpath, const Duration& lease_duration,
+    uint32 max_group_commit, const Duration& group_commit_delay,
+    const String& journal_mode, const String& synchronous, uint64 mmap_size)
  : mContext(ctx),
    mDBFilename(dbpath),
    mDB(),
+   mStatements(),
+   mJournalMode(journal_mode),
+   mSynchronous(synchronous),
+   mMmapSize(mmap_size),
    mIOService(NULL),
    mWork(NULL),
    mThread(NULL),
@@ -365,7 +438,12 @@ SQLiteStorage::SQLiteStorage(ObjectHostContext* ctx, const String& dbpath, const
    mSQLClientID(UUID::random().rawHexData()),
    mLeaseDuration(lease_duration),
    mTransactionQueue(std::tr1::bind(&SQLiteStorage::postProcessTransactions, this)),
-   mMaxCoalescedTransactions(5),
+   mMaxCoalescedTransactions(std::max(max_group_commit, (uint32)1)),
+   mGroupCommitDelay(group_commit_delay),
+   mGroupCommitTimer(),
+   mGroupCommits(0),
+   mGroupedTransactions(0),
+   mGroupFallbacks(0),
    mRetrySleepDuration(Duration::milliseconds(25)),
    mNormalOpRetries(20),
    mLeaseOpRetries(100),
@@ -391,6 +469,10 @@ void SQLiteStorage::start() {
         mIOService,
         std::tr1::bind(&SQLiteStorage::processRenewals, this)
     );
+    mGroupCommitTimer = Network::IOTimer::create(
+        mIOService,
+        std::tr1::bind(&SQLiteStorage::processTransactions, this)
+    );
 }
 
 bool SQLiteStorage::checkSQLiteError(SQLiteDBPtr db, int rc, const String& msg) {
@@ -401,9 +483,30 @@ bool SQLiteStorage::checkSQLiteError(SQLiteDBPtr db, int rc, const String& msg)
     return res.first;
 }
 
+bool SQLiteStorage::sqlPragma(const String& name, const String& value) {
+    String pragma = "PRAGMA " + name + " = " + value;
+    char* err_msg = NULL;
+    int rc = sqlite3_exec(mDB->db(), pragma.c_str(), NULL, NULL, &err_msg);
+    std::pair<bool, String> res = SQLite::check_sql_error(mDB->db(), rc, &err_msg, "Error setting " + name);
+    if (res.first)
+        SILOG(sqlite-storage, error, res.second);
+    return !res.first;
+}
+
 void SQLiteStorage::initDB() {
     SQLiteDBPtr db = SQLite::getSingleton().open(mDBFilename);
     sqlite3_busy_timeout(db->db(), 1000);
+    mDB = db;
+
+    // Connection settings. These aren't fatal if they fail, we'll just run
+    // with SQLite's defaults. In WAL mode commits only append to the log, and
+    // with synchronous=normal they don't sync until a checkpoint.
+    if (!mJournalMode.empty())
+        sqlPragma("journal_mode", mJournalMode);
+    if (!mSynchronous.empty())
+        sqlPragma("synchronous", mSynchronous);
+    if (mMmapSize > 0)
+        sqlPragma("mmap_size", boost::lexical_cast<String>(mMmapSize));
 
     // Create the table for this object if it doesn't exist yet
     String table_create = "CREATE TABLE IF NOT EXISTS ";
@@ -414,8 +517,6 @@ void SQLiteStorage::initDB() {
     char* remain;
     sqlite3_stmt* table_create_stmt;
 
-    mDB = db;
-
     bool success = true;
 
     rc = sqlite3_prepare_v2(db->db(), table_create.c_str(), -1, &table_create_stmt, (const char**)&remain);
@@ -428,63 +529,43 @@ void SQLiteStorage::initDB() {
 
     if (!success)
         mDB.reset();
+    mStatements.reset(mDB);
 }
 
-bool SQLiteStorage::sqlBeginTransaction() {
-    String begin = "BEGIN DEFERRED TRANSACTION";
+bool SQLiteStorage::sqlExecute(StatementType type, const char* name) {
+    sqlite3_stmt* stmt = mStatements.get(type);
+    if (stmt == NULL)
+        return false;
 
-    int rc;
-    char* remain;
-    sqlite3_stmt* begin_stmt;
-    bool success = true;
-
-    rc = sqlite3_prepare_v2(mDB->db(), begin.c_str(), -1, &begin_stmt, (const char**)&remain);
-    success = success && !checkSQLiteError(mDB, rc, "Error preparing begin transaction statement");
-
-    rc = sqlite3_step(begin_stmt);
-    success = success && !checkSQLiteError(mDB, rc, "Error executing begin statement");
-    rc = sqlite3_finalize(begin_stmt);
-    success = success && !checkSQLiteError(mDB, rc, "Error finalizing begin statement");
+    int rc = sqlite3_step(stmt);
+    bool success = !checkSQLiteError(mDB, rc, String("Error executing ") + name + " statement");
+    mStatements.release(stmt);
 
     return success;
 }
 
-bool SQLiteStorage::sqlRollback() {
-    String rollback = "ROLLBACK TRANSACTION";
-
-    int rc;
-    char* remain;
-    sqlite3_stmt* rollback_stmt;
-    bool success = true;
-
-    rc = sqlite3_prepare_v2(mDB->db(), rollback.c_str(), -1, &rollback_stmt, (const char**)&remain);
-    success = success && !checkSQLiteError(mDB, rc, "Error preparing rollback transaction statement");
-
-    rc = sqlite3_step(rollback_stmt);
-    success = success && !checkSQLiteError(mDB, rc, "Error executing rollback statement");
-    rc = sqlite3_finalize(rollback_stmt);
-    success = success && !checkSQLiteError(mDB, rc, "Error finalizing rollback statement");
+bool SQLiteStorage::sqlBeginTransaction() {
+    return sqlExecute(BeginStatement, "begin");
+}
 
-    return success;
+bool SQLiteStorage::sqlRollback() {
+    return sqlExecute(RollbackStatement, "rollback");
 }
 
 bool SQLiteStorage::sqlCommit() {
-    String commit = "COMMIT TRANSACTION";
-
-    int rc;
-    char* remain;
-    sqlite3_stmt* commit_stmt;
-    bool success = true;
+    return sqlExecute(CommitStatement, "commit");
+}
 
-    rc = sqlite3_prepare_v2(mDB->db(), commit.c_str(), -1, &commit_stmt, (const char**)&remain);
-    success = success && !checkSQLiteError(mDB, rc, "Error preparing commit transaction statement");
+bool SQLiteStorage::sqlSavepoint() {
+    return sqlExecute(SavepointStatement, "savepoint");
+}
 
-    rc = sqlite3_step(commit_stmt);
-    success = success && !checkSQLiteError(mDB, rc, "Error executing commit statement");
-    rc = sqlite3_finalize(commit_stmt);
-    success = success && !checkSQLiteError(mDB, rc, "Error finalizing commit statement");
+bool SQLiteStorage::sqlReleaseSavepoint() {
+    return sqlExecute(ReleaseSavepointStatement, "release savepoint");
+}
 
-    return success;
+bool SQLiteStorage::sqlRollbackSavepoint() {
+    return sqlExecute(RollbackSavepointStatement, "rollback to savepoint");
 }
 
 void SQLiteStorage::stop() {
@@ -495,6 +576,13 @@ void SQLiteStorage::stop() {
     // canceling because we don't want to continue using the timer from the
     // other thread, where we don't know that stop has been called.
     mRenewTimer.reset();
+    // Transactions held back for group commit should go out now rather than
+    // waiting out the delay
+    mGroupCommitTimer.reset();
+    mIOService->post(
+        std::tr1::bind(&SQLiteStorage::processTransactions, this),
+        "SQLiteStorage::processTransactions"
+    );
 
     delete mWork;
     mWork = NULL;
@@ -504,6 +592,16 @@ void SQLiteStorage::stop() {
     delete mIOService;
     mIOService = NULL;
 
+    // The IO thread is gone, so it's safe to clean up its statements here
+    mStatements.reset(SQLiteDBPtr());
+
+    if (mGroupCommits > 0) {
+        SILOG(sqlite-storage, info,
+            mGroupedTransactions << " transactions in " << mGroupCommits << " commits ("
+            << ((float64)mGroupedTransactions / mGroupCommits) << " per commit), "
+            << mGroupFallbacks << " groups retried individually");
+    }
+
     // Clean up data from any outstanding pending transactions
     for(BucketTransactions::iterator it = mTransactions.begin(); it != mTransactions.end(); it++) {
         Transaction* trans = it->second;
@@ -558,7 +656,7 @@ void SQLiteStorage::commitTransaction(const Bucket& bucket, const CommitCallback
     }
 
     mTransactionQueue.push(
-        TransactionData(bucket, trans, cb)
+        TransactionData(bucket, trans, cb, Timer::now())
     );
 }
 
@@ -570,97 +668,129 @@ void SQLiteStorage::postProcessTransactions() {
 }
 
 
-void SQLiteStorage::processTransactions() {
-
-
-    while(!mTransactionQueue.empty()) {
-
-        // Try to execute up to the maximum number of coalesced transactions so
-        // long as we don't encounter a failure for some reason.
-        std::vector<TransactionData> transactions;
-        std::vector<ReadSet*> read_sets;
+void SQLiteStorage::takeQueuedTransactions() {
+    TransactionDataList queued;
+    mTransactionQueue.popAll(&queued);
+    mPendingTransactions.insert(mPendingTransactions.end(), queued.begin(), queued.end());
+}
 
-        Result result = SUCCESS;
-        if (!sqlBeginTransaction())
-            result = LOCK_ERROR;
-        for(uint32 i = 0;
-            (result == SUCCESS) && !mTransactionQueue.empty() && i < mMaxCoalescedTransactions;
-            i++)
+void SQLiteStorage::processTransactions() {
+    // Take everything queued so far. Since this empties the queue, the next
+    // push will notify us again, so we'll get a chance to commit as soon as a
+    // group fills up.
+    takeQueuedTransactions();
+
+    while(!mPendingTransactions.empty()) {
+        // Unless we have a full group, hold off a little while for more
+        // transactions to commit with, but never longer than the group commit
+        // delay from when the oldest was queued. The timer can be reset() by
+        // the other thread during stop(), in which case we commit immediately.
+        Network::IOTimerPtr group_timer = mGroupCommitTimer;
+        if (group_timer &&
+            mPendingTransactions.size() < mMaxCoalescedTransactions &&
+            mGroupCommitDelay > Duration::zero())
         {
-            TransactionData data;
-            bool popped = mTransactionQueue.pop(data);
-            assert(popped);
-            transactions.push_back(data);
-
-            ReadSet* cur_result = NULL;
-            result = executeCommit(data.bucket, data.trans, data.cb, &cur_result);
-            if (result == SUCCESS) {
-                read_sets.push_back(cur_result);
+            Duration waited = Timer::now() - mPendingTransactions.front().queued;
+            if (waited < mGroupCommitDelay) {
+                group_timer->wait(mGroupCommitDelay - waited);
+                return;
             }
         }
 
-        // If we succeeded so far, try to commit and move on
-        if (result == SUCCESS) {
-            if (!sqlCommit())
-                result = LOCK_ERROR;
-        }
-        // If still successful, cleanup, post callbacks, and move on to next
-        // round
-        if (result == SUCCESS) {
-            for(uint32 i = 0; i < transactions.size(); i++) {
-                delete transactions[i].trans;
-                if (transactions[i].cb) {
-                    mContext->mainStrand->post(
-                        std::tr1::bind(transactions[i].cb, SUCCESS, read_sets[i]),
-                        "SQLiteStorage completeCommit"
-                    );
-                }
-            }
-            continue;
+        commitGroup();
+
+        // Pick up anything that arrived while we were committing
+        takeQueuedTransactions();
+    }
+}
+
+void SQLiteStorage::commitGroup() {
+    uint32 ntrans = std::min((uint32)mPendingTransactions.size(), mMaxCoalescedTransactions);
+    std::vector<TransactionData> transactions(mPendingTransactions.begin(), mPendingTransactions.begin() + ntrans);
+    mPendingTransactions.erase(mPendingTransactions.begin(), mPendingTransactions.begin() + ntrans);
+
+    std::vector<Result> results(ntrans, SUCCESS);
+    std::vector<ReadSet*> read_sets(ntrans, (ReadSet*)NULL);
+
+    // Each transaction runs inside its own savepoint, so if it fails only its
+    // changes are rolled back and the rest of the group can still commit.
+    bool group_ok = sqlBeginTransaction();
+    for(uint32 i = 0; group_ok && i < ntrans; i++) {
+        if (!sqlSavepoint()) {
+            group_ok = false;
+            break;
         }
 
-        // We'll only get here if we, for some reason, failed to process all of
-        // these. Rollback, clean up results we had gotten, and work back
-        // through them one at a time.
-        sqlRollback();
-        for(uint32 i = 0; i < read_sets.size(); i++)
-            if (read_sets[i] != NULL) delete read_sets[i];
-        read_sets.clear();
-
-        for(uint32 i = 0; i < transactions.size(); i++) {
-            result = SUCCESS;
-            if (!sqlBeginTransaction())
-                result = LOCK_ERROR;
-
-            ReadSet* rs = NULL;
-            TransactionData& data = transactions[i];
-            result = executeCommit(data.bucket, data.trans, data.cb, &rs);
-
-            if (result == SUCCESS) {
-                if (!sqlCommit())
-                    result = LOCK_ERROR;
-            }
+        TransactionData& data = transactions[i];
+        results[i] = executeCommit(data.bucket, data.trans, data.cb, &read_sets[i]);
 
-            // Either way, we need to clean up the transaction
-            delete data.trans;
-            data.trans = NULL;
+        if (results[i] != SUCCESS)
+            group_ok = sqlRollbackSavepoint();
+        group_ok = group_ok && sqlReleaseSavepoint();
+    }
 
-            if (result != SUCCESS) {
-                sqlRollback();
-                delete rs;
-                rs = NULL;
-            }
+    // If we succeeded so far, try to commit and move on
+    if (group_ok)
+        group_ok = sqlCommit();
 
-            //actually have to check if there's a callback here.  otherwise failure.
-            if (data.cb)
-            {
-                mContext->mainStrand->post(
-                    std::tr1::bind(data.cb, result, rs),
-                    "SQLiteStorage completeCommit"
-                );
-            }
-        }
+    // If still successful, post callbacks and move on to the next group
+    if (group_ok) {
+        mGroupCommits++;
+        mGroupedTransactions += ntrans;
+        for(uint32 i = 0; i < ntrans; i++)
+            completeTransaction(transactions[i], results[i], read_sets[i]);
+        return;
+    }
+
+    // We'll only get here if we couldn't get the group as a whole through,
+    // e.g. the database was busy. Rollback, clean up results we had gotten,
+    // and work back through them one at a time.
+    mGroupFallbacks++;
+    sqlRollback();
+    for(uint32 i = 0; i < read_sets.size(); i++)
+        if (read_sets[i] != NULL) delete read_sets[i];
+    read_sets.clear();
+
+    for(uint32 i = 0; i < transactions.size(); i++)
+        commitSingle(transactions[i]);
+}
 
+void SQLiteStorage::commitSingle(TransactionData& data) {
+    Result result = SUCCESS;
+    if (!sqlBeginTransaction())
+        result = LOCK_ERROR;
+
+    ReadSet* rs = NULL;
+    if (result == SUCCESS)
+        result = executeCommit(data.bucket, data.trans, data.cb, &rs);
+
+    if (result == SUCCESS) {
+        if (!sqlCommit())
+            result = LOCK_ERROR;
+    }
+
+    if (result != SUCCESS) {
+        sqlRollback();
+        delete rs;
+        rs = NULL;
+    }
+
+    completeTransaction(data, result, rs);
+}
+
+void SQLiteStorage::completeTransaction(TransactionData& data, Result result, ReadSet* rs) {
+    delete data.trans;
+    data.trans = NULL;
+
+    //actually have to check if there's a callback here.  otherwise failure.
+    if (data.cb) {
+        mContext->mainStrand->post(
+            std::tr1::bind(data.cb, result, rs),
+            "SQLiteStorage completeCommit"
+        );
+    }
+    else {
+        delete rs;
     }
 }
 
@@ -674,7 +804,7 @@ Storage::Result SQLiteStorage::executeCommit(const Bucket& bucket, Transaction*
     // and return the error.
     Result result = acquireLease(bucket);
     for (Transaction::iterator it = trans->begin(); (result == SUCCESS) && it != trans->end(); it++) {
-        result = (*it).executeWithRetry(mDB, bucket, rs, mNormalOpRetries, mRetrySleepDuration);
+        result = (*it).executeWithRetry(&mStatements, bucket, rs, mNormalOpRetries, mRetrySleepDuration);
     }
 
     if (rs->empty() || (result != SUCCESS)) {
@@ -718,7 +848,7 @@ Storage::Result SQLiteStorage::acquireLease(const Bucket& bucket) {
         StorageAction sa;
         sa.type = StorageAction::Read;
         sa.key = LEASE_KEY;
-        result = sa.executeWithRetry(mDB, bucket, &lease_rs, mLeaseOpRetries, mRetrySleepDuration);
+        result = sa.executeWithRetry(&mStatements, bucket, &lease_rs, mLeaseOpRetries, mRetrySleepDuration);
     }
 
     // Decide the next course of action based on whether the lease key
@@ -760,7 +890,7 @@ Storage::Result SQLiteStorage::acquireLease(const Bucket& bucket) {
         sa.key = LEASE_KEY;
         sa.value = new String(getLeaseString());
         ReadSet no_rs;
-        result = sa.executeWithRetry(mDB, bucket, &no_rs, mLeaseOpRetries, mRetrySleepDuration);
+        result = sa.executeWithRetry(&mStatements, bucket, &no_rs, mLeaseOpRetries, mRetrySleepDuration);
 
         // If we succeeded here, we got the lease, otherwise we failed
         // and need to give up.
@@ -799,7 +929,7 @@ void SQLiteStorage::renewLease(const Bucket& bucket) {
         StorageAction sa;
         sa.type = StorageAction::Read;
         sa.key = LEASE_KEY;
-        result = sa.executeWithRetry(mDB, bucket, &lease_rs, mLeaseOpRetries, mRetrySleepDuration);
+        result = sa.executeWithRetry(&mStatements, bucket, &lease_rs, mLeaseOpRetries, mRetrySleepDuration);
     }
 
     // Nothing in there or database was busy? releaseLease was called and
@@ -829,7 +959,7 @@ void SQLiteStorage::renewLease(const Bucket& bucket) {
         sa.key = LEASE_KEY;
         sa.value = new String(getLeaseString());
         ReadSet no_rs;
-        result = sa.executeWithRetry(mDB, bucket, &no_rs, mLeaseOpRetries, mRetrySleepDuration);
+        result = sa.executeWithRetry(&mStatements, bucket, &no_rs, mLeaseOpRetries, mRetrySleepDuration);
     }
 
     // If we failed to write the new key, give up. This really shouldn't happen.
@@ -865,7 +995,7 @@ void SQLiteStorage::releaseLease(const Bucket& bucket) {
         StorageAction sa;
         sa.type = StorageAction::Read;
         sa.key = LEASE_KEY;
-        result = sa.executeWithRetry(mDB, bucket, &lease_rs, mLeaseOpRetries, mRetrySleepDuration);
+        result = sa.executeWithRetry(&mStatements, bucket, &lease_rs, mLeaseOpRetries, mRetrySleepDuration);
     }
 
     // Nothing in there or database was busy? Nothing to do, although it might
@@ -900,7 +1030,7 @@ void SQLiteStorage::releaseLease(const Bucket& bucket) {
         sa.type = StorageAction::Erase;
         sa.key = LEASE_KEY;
         ReadSet no_rs;
-        result = sa.executeWithRetry(mDB, bucket, &no_rs, mLeaseOpRetries, mRetrySleepDuration);
+        result = sa.executeWithRetry(&mStatements, bucket, &no_rs, mLeaseOpRetries, mRetrySleepDuration);
     }
 
     if (result != SUCCESS) {
@@ -1036,43 +1166,39 @@ bool SQLiteStorage::rangeErase(const Bucket& bucket, const Key& start, const Key
 
 bool SQLiteStorage::count(const Bucket& bucket, const Key& start, const Key& finish, const CountCallback& cb, const String& timestamp) {
     // FIXME doesn't fit into transactions...
-    String value_count = "SELECT COUNT(*) FROM ";
-    value_count += "\"" TABLE_NAME "\"";
-    value_count += " WHERE object = \'" + bucket.rawHexData() + "\' AND key BETWEEN ? AND ?";
-
     mIOService->post(
-        std::tr1::bind(&SQLiteStorage::executeCount, this, value_count, start, finish, cb),
+        std::tr1::bind(&SQLiteStorage::executeCount, this, bucket, start, finish, cb),
         "SQLiteStorage::executeCount"
     );
     return true;
 }
 
-void SQLiteStorage::executeCount(const String value_count, const Key& start, const Key& finish, CountCallback cb)
+void SQLiteStorage::executeCount(const Bucket& bucket, const Key& start, const Key& finish, CountCallback cb)
 {
     bool success = true;
     int32 count = 0;
+    String bucket_str = bucket.rawHexData();
 
-	int rc;
-    char* remain;
-    sqlite3_stmt* value_count_stmt;
-    rc = sqlite3_prepare_v2(mDB->db(), value_count.c_str(), -1, &value_count_stmt, (const char**)&remain);
-    success = success && !checkSQLiteError(mDB, rc, "Error preparing value count statement");
-
-    if (rc==SQLITE_OK) {
-    	rc = sqlite3_bind_text(value_count_stmt, 1, start.c_str(), (int)start.size(), SQLITE_TRANSIENT);
-    	success = success && !checkSQLiteError(mDB, rc, "Error binding start key to value count statement");
-    	rc = sqlite3_bind_text(value_count_stmt, 2, finish.c_str(), (int)finish.size(), SQLITE_TRANSIENT);
-    	success = success && !checkSQLiteError(mDB, rc, "Error binding finish key to value count statement");
-    	if (rc==SQLITE_OK) {
-    		int step_rc = sqlite3_step(value_count_stmt);
-    		count = sqlite3_column_int(value_count_stmt, 0);
-    		if (step_rc != SQLITE_OK && step_rc != SQLITE_DONE && step_rc != SQLITE_ROW)
-    			sqlite3_reset(value_count_stmt); // allow this to be cleaned up
-    	}
-
+    int rc;
+    sqlite3_stmt* value_count_stmt = mStatements.get(CountRangeStatement);
+    success = (value_count_stmt != NULL);
+
+    if (success) {
+        rc = sqlite3_bind_text(value_count_stmt, 1, bucket_str.c_str(), (int)bucket_str.size(), SQLITE_TRANSIENT);
+        success = success && !checkSQLiteError(mDB, rc, "Error binding object to value count statement");
+        rc = sqlite3_bind_text(value_count_stmt, 2, start.c_str(), (int)start.size(), SQLITE_TRANSIENT);
+        success = success && !checkSQLiteError(mDB, rc, "Error binding start key to value count statement");
+        rc = sqlite3_bind_text(value_count_stmt, 3, finish.c_str(), (int)finish.size(), SQLITE_TRANSIENT);
+        success = success && !checkSQLiteError(mDB, rc, "Error binding finish key to value count statement");
+        if (success) {
+            int step_rc = sqlite3_step(value_count_stmt);
+            if (step_rc == SQLITE_ROW)
+                count = sqlite3_column_int(value_count_stmt, 0);
+            else
+                success = !checkSQLiteError(mDB, step_rc, "Error executing value count statement");
+        }
+        mStatements.release(value_count_stmt);
     }
-    rc = sqlite3_finalize(value_count_stmt);
-    success = success && !checkSQLiteError(mDB, rc, "Error finalizing value delete statement");
 
     if (cb) {
         Result result = (success ? SUCCESS : TRANSACTION_ERROR);
@@ -45,7 +45,23 @@ class FileStorageEvent;
 class SQLiteStorage : public Storage
 {
 public:
-    SQLiteStorage(ObjectHostContext* ctx, const String& dbpath, const Duration& lease_duration);
+    /** Create a SQLiteStorage.
+     *  \param ctx context the storage runs in
+     *  \param dbpath path to the database file
+     *  \param lease_duration how long bucket leases are held before renewal
+     *  \param max_group_commit maximum number of queued transactions to commit
+     *         together as one SQLite transaction
+     *  \param group_commit_delay maximum time to hold a transaction back while
+     *         waiting for others to commit with it. Zero commits as soon as the
+     *         IO thread is free, grouping whatever queued up in the meantime.
+     *  \param journal_mode SQLite journal mode, e.g. delete or wal
+     *  \param synchronous SQLite synchronous setting, e.g. full or normal
+     *  \param mmap_size bytes of the database SQLite may access via mmap, 0
+     *         disables memory mapped IO
+     */
+    SQLiteStorage(ObjectHostContext* ctx, const String& dbpath, const Duration& lease_duration,
+        uint32 max_group_commit, const Duration& group_commit_delay,
+        const String& journal_mode, const String& synchronous, uint64 mmap_size);
     ~SQLiteStorage();
 
     virtual void start();
@@ -66,6 +82,47 @@ public:
     virtual bool count(const Bucket& bucket, const Key& start, const Key& finish, const CountCallback& cb = 0, const String& timestamp="current");
 
 private:
+    // All the SQL we run, prepared once per connection
+    enum StatementType {
+        SelectValueStatement,
+        SelectRangeStatement,
+        InsertValueStatement,
+        DeleteValueStatement,
+        DeleteRangeStatement,
+        CountRangeStatement,
+        BeginStatement,
+        CommitStatement,
+        RollbackStatement,
+        SavepointStatement,
+        ReleaseSavepointStatement,
+        RollbackSavepointStatement,
+        NumStatements
+    };
+
+    // Keeps prepared statements for the life of a connection so operations
+    // only need to bind parameters and step, instead of preparing and
+    // finalizing every time. Only used from the IO thread.
+    class StatementCache {
+    public:
+        StatementCache();
+        ~StatementCache();
+
+        // Finalizes any prepared statements and switches to db, which may be
+        // NULL
+        void reset(SQLiteDBPtr db);
+        SQLiteDBPtr db() const { return mDB; }
+
+        // Gets the statement, preparing it on first use. Returns NULL if it
+        // couldn't be prepared.
+        sqlite3_stmt* get(StatementType type);
+        // Resets a statement returned by get() and clears its bindings, ready
+        // for the next use.
+        void release(sqlite3_stmt* stmt);
+    private:
+        SQLiteDBPtr mDB;
+        sqlite3_stmt* mStatements[NumStatements];
+    };
+
     // StorageActions are individual actions to take, i.e. read, write,
     // erase. We queue them up in a list and eventually fire them off in a
     // transaction.
@@ -87,12 +144,12 @@ private:
         StorageAction& operator=(const StorageAction& rhs);
 
         // Executes this action. Assumes the owning SQLiteStorage has setup the transaction.
-        Result execute(SQLiteDBPtr db, const Bucket& bucket, ReadSet* rs);
+        Result execute(StatementCache* stmts, const Bucket& bucket, ReadSet* rs);
 
         // Executes this action, retrying the given number of times if there's a
         // temporary failure to lock the database. Assumes the owning
         // SQLiteStorage has setup the transaction.
-        Result executeWithRetry(SQLiteDBPtr db, const Bucket& bucket, ReadSet* rs, int32 retries, const Duration& retry_wait);
+        Result executeWithRetry(StatementCache* stmts, const Bucket& bucket, ReadSet* rs, int32 retries, const Duration& retry_wait);
 
         // Bucket is implicit, passed into execute
         Type type;
@@ -108,17 +165,19 @@ private:
     // more than one at a time, on the storage IOService
     struct TransactionData {
         TransactionData()
-         : bucket(), trans(NULL), cb()
+         : bucket(), trans(NULL), cb(), queued(Time::null())
         {}
-        TransactionData(const Bucket& b, Transaction* t, CommitCallback c)
-         : bucket(b), trans(t), cb(c)
+        TransactionData(const Bucket& b, Transaction* t, CommitCallback c, const Time& q)
+         : bucket(b), trans(t), cb(c), queued(q)
         {}
 
         Bucket bucket;
         Transaction* trans;
         CommitCallback cb;
+        Time queued;
     };
     typedef ThreadSafeQueueWithNotification<TransactionData> TransactionQueue;
+    typedef std::deque<TransactionData> TransactionDataList;
 
     // Helper that checks and logs errors, then returns bool indicating
     // success/failure
@@ -137,20 +196,37 @@ private:
     // Indirection to get on mIOService
     void postProcessTransactions();
     // Process transactions. Runs until queue is empty and is triggered anytime
-    // the queue goes from empty to non-empty.
+    // the queue goes from empty to non-empty, or by the group commit timer.
     void processTransactions();
+    // Moves everything in mTransactionQueue to the end of mPendingTransactions
+    void takeQueuedTransactions();
+    // Commits the transactions at the front of mPendingTransactions together,
+    // up to mMaxCoalescedTransactions of them.
+    void commitGroup();
+    // Commits a single transaction in its own SQLite transaction. Used when
+    // committing a group fails as a whole.
+    void commitSingle(TransactionData& data);
+    // Posts the callback for a finished transaction and cleans it up.
+    void completeTransaction(TransactionData& data, Result result, ReadSet* rs);
 
     // Tries to execute a commit *assuming it is within a SQL
     // transaction*. Returns whether it was successful, allowing for
     // rollback/retrying.
     Result executeCommit(const Bucket& bucket, Transaction* trans, CommitCallback cb, ReadSet** read_set_out);
 
-    void executeCount(const String value_count, const Key& start, const Key& finish, CountCallback cb);
+    void executeCount(const Bucket& bucket, const Key& start, const Key& finish, CountCallback cb);
 
     // A few helper methods that wrap sql operations.
+    bool sqlExecute(StatementType type, const char* name);
     bool sqlBeginTransaction();
     bool sqlCommit();
     bool sqlRollback();
+    // Savepoints let each transaction in a group fail without undoing the
+    // others.
+    bool sqlSavepoint();
+    bool sqlReleaseSavepoint();
+    bool sqlRollbackSavepoint();
+    bool sqlPragma(const String& name, const String& value);
 
 
     // Helpers for leases:
@@ -178,6 +254,11 @@ private:
     BucketTransactions mTransactions;
     String mDBFilename;
     SQLiteDBPtr mDB;
+    StatementCache mStatements;
+
+    const String mJournalMode;
+    const String mSynchronous;
+    const uint64 mMmapSize;
 
     // FIXME because we don't have proper multithreaded support in cppoh, we
     // need to allocate our own thread dedicated to IO
@@ -191,11 +272,19 @@ private:
     const Duration mLeaseDuration;
 
     TransactionQueue mTransactionQueue;
+    // Transactions pulled off mTransactionQueue, waiting to be committed in a
+    // group. Only used from the IO thread.
+    TransactionDataList mPendingTransactions;
     // Maximum transactions to combine into a single transaction in the
-    // underlying database. TODO(ewencp) this should probably be dynamic, should
-    // increase/decrease based on success/failure and avoid latency getting too
-    // hight. Right now we just have a reasonable, but small, number.
-    uint32 mMaxCoalescedTransactions;
+    // underlying database.
+    const uint32 mMaxCoalescedTransactions;
+    // Longest we'll hold a transaction back waiting for a group to fill up
+    const Duration mGroupCommitDelay;
+    Network::IOTimerPtr mGroupCommitTimer;
+    // Stats, reported on shutdown
+    uint64 mGroupCommits;
+    uint64 mGroupedTransactions;
+    uint64 mGroupFallbacks;
 
     // Amount of time to sleep between retries. Shouldn't be too big or you can
     // back up all storage, but should be long enough that transient errors such
@@ -0,0 +1,655 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/oh/CachedStorage.hpp>
+#include <sirikata/oh/ObjectHostContext.hpp>
+#include <sirikata/core/network/IOStrandImpl.hpp>
+
+#define CACHE_LOG(lvl, msg) SILOG(cached-storage, lvl, msg)
+
+namespace Sirikata {
+namespace OH {
+
+using std::tr1::placeholders::_1;
+using std::tr1::placeholders::_2;
+using std::tr1::placeholders::_3;
+
+CachedStorage::CachedStorage(ObjectHostContext* ctx, Storage* backend, uint32 max_entries, uint32 max_dirty, const Duration& flush_interval)
+ : mContext(ctx),
+   mBackend(backend),
+   mMaxEntries(max_entries),
+   mMaxDirty(max_dirty),
+   mFlushInterval(flush_interval),
+   mVersion(0),
+   mFlushScheduled(false)
+{
+}
+
+CachedStorage::~CachedStorage() {
+    for(BucketCacheMap::iterator it = mCaches.begin(); it != mCaches.end(); it++)
+        delete it->second;
+    mCaches.clear();
+
+    delete mBackend;
+}
+
+void CachedStorage::start() {
+    mBackend->start();
+
+    mFlushTimer = Network::IOTimer::create(
+        mContext->mainStrand,
+        std::tr1::bind(&CachedStorage::flushAll, this)
+    );
+
+    if (mContext->commander() != NULL) {
+        mContext->commander()->registerCommand(
+            "oh.storage.cache.stats",
+            mContext->mainStrand->wrap(std::tr1::bind(&CachedStorage::commandStats, this, _1, _2, _3))
+        );
+    }
+}
+
+void CachedStorage::stop() {
+    {
+        Lock lck(mMutex);
+
+        // Nothing can be buffered once the backend goes away, so push out
+        // everything left, including writes made since any flush that's still
+        // in progress. Backends finish outstanding transactions when they
+        // stop.
+        mFlushTimer.reset();
+        mFlushScheduled = false;
+        for(BucketCacheMap::iterator it = mCaches.begin(); it != mCaches.end(); it++)
+            flushBucket(it->first, true);
+
+        CACHE_LOG(info, "Cache stats: " <<
+            mStats.hits << " hits, " << mStats.misses << " misses, " <<
+            mStats.localCommits << " local commits, " << mStats.backendCommits << " backend commits, " <<
+            mStats.flushedKeys << " keys written back in " << mStats.flushes << " flushes (" <<
+            mStats.flushFailures << " failed)");
+
+        // Clean up data from any outstanding pending transactions
+        for(BucketTransactions::iterator it = mTransactions.begin(); it != mTransactions.end(); it++)
+            delete it->second;
+        mTransactions.clear();
+    }
+
+    mBackend->stop();
+}
+
+CachedStorage::Stats CachedStorage::stats() {
+    Lock lck(mMutex);
+    return mStats;
+}
+
+void CachedStorage::commandStats(const Command::Command& cmd, Command::Commander* cmdr, Command::CommandID cmdid) {
+    Stats st = stats();
+
+    Command::Result result = Command::EmptyResult();
+    result.put("hits", (int64)st.hits);
+    result.put("misses", (int64)st.misses);
+    result.put("commits.local", (int64)st.localCommits);
+    result.put("commits.backend", (int64)st.backendCommits);
+    result.put("flushes.total", (int64)st.flushes);
+    result.put("flushes.keys", (int64)st.flushedKeys);
+    result.put("flushes.failed", (int64)st.flushFailures);
+    cmdr->result(cmdid, result);
+}
+
+
+
+CachedStorage::Transaction* CachedStorage::getTransaction(const Bucket& bucket, bool* is_new) {
+    BucketTransactions::iterator it = mTransactions.find(bucket);
+    if (it != mTransactions.end())
+        return it->second;
+
+    if (is_new != NULL) *is_new = true;
+    Transaction* trans = new Transaction();
+    mTransactions[bucket] = trans;
+    return trans;
+}
+
+CachedStorage::BucketCache* CachedStorage::getCache(const Bucket& bucket, bool leased_only) {
+    BucketCacheMap::iterator it = mCaches.find(bucket);
+    if (it == mCaches.end()) return NULL;
+    if (leased_only && !it->second->leased) return NULL;
+    return it->second;
+}
+
+CachedStorage::Entry& CachedStorage::touch(BucketCache* cache, const Key& key) {
+    EntryMap::iterator it = cache->entries.find(key);
+    if (it == cache->entries.end()) {
+        Entry& entry = cache->entries[key];
+        cache->lru.push_front(key);
+        entry.lru = cache->lru.begin();
+        return entry;
+    }
+
+    cache->lru.splice(cache->lru.begin(), cache->lru, it->second.lru);
+    return it->second;
+}
+
+void CachedStorage::setClean(BucketCache* cache, const Key& key, bool exists, const String& value) {
+    Entry& entry = touch(cache, key);
+    // A newer local write wins over whatever the backend told us
+    if (entry.dirty) return;
+    entry.exists = exists;
+    entry.value = exists ? value : String();
+}
+
+void CachedStorage::evict(BucketCache* cache) {
+    // Dirty entries have to stay until they're flushed, so we may stay over
+    // the limit for a bit
+    KeyList::iterator it = cache->lru.end();
+    while(cache->entries.size() > mMaxEntries && it != cache->lru.begin()) {
+        it--;
+        EntryMap::iterator eit = cache->entries.find(*it);
+        if (eit->second.dirty) continue;
+        cache->entries.erase(eit);
+        it = cache->lru.erase(it);
+    }
+}
+
+void CachedStorage::dropClean(BucketCache* cache) {
+    for(EntryMap::iterator it = cache->entries.begin(); it != cache->entries.end(); ) {
+        if (it->second.dirty) {
+            it++;
+            continue;
+        }
+        cache->lru.erase(it->second.lru);
+        cache->entries.erase(it++);
+    }
+}
+
+void CachedStorage::dropLost(const Bucket& bucket, BucketCache* cache) {
+    if (cache->dirtyCount > 0)
+        CACHE_LOG(error, "Lost lease on bucket " << bucket.toString() << ", dropping " << cache->dirtyCount << " unflushed writes");
+    cache->entries.clear();
+    cache->lru.clear();
+    cache->dirtyCount = 0;
+    cache->confirmed = false;
+}
+
+void CachedStorage::markFlushed(BucketCache* cache, const FlushedList& flushed) {
+    for(FlushedList::const_iterator it = flushed.begin(); it != flushed.end(); it++) {
+        EntryMap::iterator eit = cache->entries.find(it->first);
+        if (eit == cache->entries.end()) continue;
+        Entry& entry = eit->second;
+        if (!entry.dirty || entry.version != it->second) continue;
+        entry.dirty = false;
+        cache->dirtyCount--;
+    }
+}
+
+void CachedStorage::addDirty(const Bucket& bucket, BucketCache* cache, FlushedList* flushed) {
+    if (cache == NULL || cache->dirtyCount == 0) return;
+
+    for(EntryMap::iterator it = cache->entries.begin(); it != cache->entries.end(); it++) {
+        const Entry& entry = it->second;
+        if (!entry.dirty) continue;
+        if (entry.exists)
+            mBackend->write(bucket, it->first, entry.value);
+        else
+            mBackend->erase(bucket, it->first);
+        flushed->push_back(std::make_pair(it->first, entry.version));
+    }
+}
+
+void CachedStorage::scheduleFlush() {
+    if (mFlushScheduled || !mFlushTimer) return;
+    mFlushScheduled = true;
+    mFlushTimer->wait(mFlushInterval);
+}
+
+void CachedStorage::flushBucket(const Bucket& bucket, bool force) {
+    BucketCache* cache = getCache(bucket, false);
+    if (cache == NULL || cache->dirtyCount == 0) return;
+    if (cache->flushing && !force) return;
+
+    FlushedList flushed;
+    mBackend->beginTransaction(bucket);
+    addDirty(bucket, cache, &flushed);
+    if (!force) cache->flushing = true;
+    mStats.flushes++;
+    mStats.flushedKeys += flushed.size();
+    mBackend->commitTransaction(
+        bucket,
+        std::tr1::bind(&CachedStorage::handleFlush, this, bucket, flushed, force, _1, _2)
+    );
+}
+
+void CachedStorage::flushAll() {
+    Lock lck(mMutex);
+    mFlushScheduled = false;
+    for(BucketCacheMap::iterator it = mCaches.begin(); it != mCaches.end(); it++)
+        flushBucket(it->first);
+}
+
+bool CachedStorage::finishRelease(const Bucket& bucket, BucketCache* cache) {
+    if (cache->leased || cache->dirtyCount > 0 || cache->flushing || cache->passThrough > 0)
+        return false;
+
+    delete cache;
+    mCaches.erase(bucket);
+    mBackend->releaseBucket(bucket);
+    return true;
+}
+
+void CachedStorage::handleFlush(const Bucket& bucket, FlushedList flushed, bool forced, Result result, ReadSet* rs) {
+    delete rs;
+
+    Lock lck(mMutex);
+    BucketCache* cache = getCache(bucket, false);
+    if (cache == NULL) return;
+    if (!forced) cache->flushing = false;
+
+    if (result == SUCCESS) {
+        markFlushed(cache, flushed);
+        cache->confirmed = true;
+    }
+    else {
+        mStats.flushFailures++;
+        if (result == LOCK_ERROR) {
+            // Someone else may be changing values under us, so retrying
+            // could overwrite their writes
+            dropLost(bucket, cache);
+        }
+        else if (!cache->leased) {
+            // We're giving up the bucket, so there won't be another chance
+            CACHE_LOG(error, "Failed to write back " << cache->dirtyCount << " keys for released bucket " << bucket.toString() << ", dropping them");
+            cache->entries.clear();
+            cache->lru.clear();
+            cache->dirtyCount = 0;
+        }
+        else {
+            CACHE_LOG(warn, "Failed to write back " << flushed.size() << " keys for bucket " << bucket.toString() << ", will retry");
+        }
+    }
+
+    if (finishRelease(bucket, cache))
+        return;
+
+    // Writes may have piled up while we were flushing. After a failure, wait
+    // a bit before trying again.
+    if (result == SUCCESS && cache->dirtyCount >= mMaxDirty)
+        flushBucket(bucket);
+    else if (cache->dirtyCount > 0)
+        scheduleFlush();
+}
+
+
+
+void CachedStorage::leaseBucket(const Bucket& bucket) {
+    Lock lck(mMutex);
+
+    BucketCache* cache = getCache(bucket, false);
+    if (cache == NULL) {
+        mCaches[bucket] = new BucketCache();
+    }
+    else {
+        // We'll only know we got it back once a commit succeeds
+        cache->leased = true;
+        cache->confirmed = false;
+    }
+
+    mBackend->leaseBucket(bucket);
+}
+
+void CachedStorage::releaseBucket(const Bucket& bucket) {
+    Lock lck(mMutex);
+
+    BucketCache* cache = getCache(bucket, false);
+    if (cache == NULL) {
+        mBackend->releaseBucket(bucket);
+        return;
+    }
+
+    // Keep only what's needed to write back, the release is passed on once
+    // that's done
+    cache->leased = false;
+    dropClean(cache);
+    if (!finishRelease(bucket, cache))
+        flushBucket(bucket);
+}
+
+void CachedStorage::beginTransaction(const Bucket& bucket) {
+    Lock lck(mMutex);
+    getTransaction(bucket);
+}
+
+bool CachedStorage::tryCommitLocal(const Bucket& bucket, BucketCache* cache, const Transaction& trans, Result* result_out, ReadSet** rs_out) {
+    // Values written earlier in this transaction, and whether they exist
+    typedef std::tr1::unordered_map<Key, std::pair<bool, String> > Overlay;
+    Overlay overlay;
+    ReadSet* rs = NULL;
+    uint32 reads = 0;
+    bool success = true;
+
+    for(Transaction::const_iterator it = trans.begin(); success && it != trans.end(); it++) {
+        const Action& action = *it;
+        switch(action.type) {
+          case Action::Read:
+          case Action::Compare:
+              {
+                  bool exists;
+                  const String* value;
+                  Overlay::iterator oit = overlay.find(action.key);
+                  if (oit != overlay.end()) {
+                      exists = oit->second.first;
+                      value = &(oit->second.second);
+                  }
+                  else {
+                      EntryMap::iterator eit = cache->entries.find(action.key);
+                      if (eit == cache->entries.end()) {
+                          delete rs;
+                          return false;
+                      }
+                      exists = eit->second.exists;
+                      value = &(eit->second.value);
+                  }
+                  reads++;
+
+                  if (!exists)
+                      success = false;
+                  else if (action.type == Action::Compare)
+                      success = (*value == action.value);
+                  else {
+                      if (rs == NULL) rs = new ReadSet();
+                      (*rs)[action.key] = *value;
+                  }
+              }
+              break;
+          case Action::Write:
+              overlay[action.key] = std::make_pair(true, action.value);
+              break;
+          case Action::Erase:
+              overlay[action.key] = std::make_pair(false, String());
+              break;
+          default:
+              // Ranges need the backend since we don't know that we have every
+              // key in the range
+              delete rs;
+              return false;
+        }
+    }
+
+    mStats.hits += reads;
+    mStats.localCommits++;
+
+    if (!success) {
+        delete rs;
+        *result_out = TRANSACTION_ERROR;
+        *rs_out = NULL;
+        return true;
+    }
+
+    for(Transaction::const_iterator it = trans.begin(); it != trans.end(); it++) {
+        const Action& action = *it;
+        if (action.type == Action::Read || action.type == Action::Compare) {
+            touch(cache, action.key);
+            continue;
+        }
+
+        Entry& entry = touch(cache, action.key);
+        if (!entry.dirty) {
+            entry.dirty = true;
+            cache->dirtyCount++;
+        }
+        entry.exists = (action.type == Action::Write);
+        entry.value = entry.exists ? action.value : String();
+        entry.version = ++mVersion;
+    }
+    evict(cache);
+
+    if (cache->dirtyCount >= mMaxDirty)
+        flushBucket(bucket);
+    else if (cache->dirtyCount > 0)
+        scheduleFlush();
+
+    *result_out = SUCCESS;
+    *rs_out = rs;
+    return true;
+}
+
+void CachedStorage::commitTransaction(const Bucket& bucket, const CommitCallback& cb, const String& timestamp)
+{
+    Lock lck(mMutex);
+
+    Transaction* trans = getTransaction(bucket);
+    mTransactions.erase(bucket);
+
+    // Transactions passed through before this one may have changed keys we
+    // have cached, so wait for them before answering locally
+    BucketCache* cache = getCache(bucket, true);
+    if (cache != NULL && (!cache->confirmed || cache->passThrough > 0))
+        cache = NULL;
+    if (trans->empty() || cache != NULL) {
+        Result result = SUCCESS;
+        ReadSet* rs = NULL;
+        if (trans->empty() || tryCommitLocal(bucket, cache, *trans, &result, &rs)) {
+            delete trans;
+            // Don't call back before the caller has returned, just like a
+            // real backend
+            if (cb)
+                mContext->mainStrand->post(
+                    std::tr1::bind(cb, result, rs),
+                    "CachedStorage::commitTransaction"
+                );
+            else
+                delete rs;
+            return;
+        }
+    }
+
+    // Pass the transaction through, preceded by any writes we're still holding
+    // for this bucket so they stay ordered before it.
+    for(Transaction::const_iterator it = trans->begin(); it != trans->end(); it++) {
+        if (it->type == Action::Read || it->type == Action::Compare || it->type == Action::ReadRange)
+            mStats.misses++;
+    }
+    mStats.backendCommits++;
+
+    FlushedList flushed;
+    cache = getCache(bucket, false);
+    if (cache != NULL) cache->passThrough++;
+    mBackend->beginTransaction(bucket);
+    addDirty(bucket, cache, &flushed);
+    for(Transaction::const_iterator it = trans->begin(); it != trans->end(); it++) {
+        const Action& action = *it;
+        switch(action.type) {
+          case Action::Read: mBackend->read(bucket, action.key); break;
+          case Action::ReadRange: mBackend->rangeRead(bucket, action.key, action.keyEnd); break;
+          case Action::Compare: mBackend->compare(bucket, action.key, action.value); break;
+          case Action::Write: mBackend->write(bucket, action.key, action.value); break;
+          case Action::Erase: mBackend->erase(bucket, action.key); break;
+          case Action::EraseRange: mBackend->rangeErase(bucket, action.key, action.keyEnd); break;
+        }
+    }
+    mBackend->commitTransaction(
+        bucket,
+        std::tr1::bind(&CachedStorage::handleBackendCommit, this, bucket, flushed, (cache != NULL), trans, cb, _1, _2),
+        timestamp
+    );
+}
+
+void CachedStorage::handleBackendCommit(const Bucket& bucket, FlushedList flushed, bool counted, Transaction* trans, CommitCallback cb, Result result, ReadSet* rs) {
+    {
+        Lock lck(mMutex);
+        BucketCache* cache = getCache(bucket, false);
+        if (cache != NULL) {
+            // The cache can't go away while we're counted, but it may have
+            // been created since we were sent
+            if (counted) cache->passThrough--;
+
+            if (result == SUCCESS) {
+                markFlushed(cache, flushed);
+                cache->confirmed = true;
+
+                // Learn whatever the transaction told us about the bucket
+                if (cache->leased) {
+                    for(Transaction::const_iterator it = trans->begin(); it != trans->end(); it++) {
+                        const Action& action = *it;
+                        switch(action.type) {
+                          case Action::Read:
+                            if (rs != NULL && rs->find(action.key) != rs->end())
+                                setClean(cache, action.key, true, (*rs)[action.key]);
+                            break;
+                          case Action::ReadRange:
+                            if (rs != NULL) {
+                                for(ReadSet::const_iterator rit = rs->begin(); rit != rs->end(); rit++) {
+                                    if (rit->first >= action.key && rit->first <= action.keyEnd)
+                                        setClean(cache, rit->first, true, rit->second);
+                                }
+                            }
+                            break;
+                          case Action::Compare:
+                          case Action::Write:
+                            setClean(cache, action.key, true, action.value);
+                            break;
+                          case Action::Erase:
+                            setClean(cache, action.key, false, String());
+                            break;
+                          case Action::EraseRange:
+                            for(EntryMap::iterator eit = cache->entries.begin(); eit != cache->entries.end(); ) {
+                                if (!eit->second.dirty && eit->first >= action.key && eit->first <= action.keyEnd) {
+                                    cache->lru.erase(eit->second.lru);
+                                    cache->entries.erase(eit++);
+                                }
+                                else {
+                                    eit++;
+                                }
+                            }
+                            break;
+                        }
+                    }
+                    evict(cache);
+                }
+            }
+            else if (result == TRANSACTION_ERROR && flushed.empty() && cache->leased &&
+                trans->size() == 1 && trans->front().type == Action::Read) {
+                // A lone read failing means the key doesn't exist. This is
+                // common for checking if a key exists, so remember it.
+                setClean(cache, trans->front().key, false, String());
+                evict(cache);
+            }
+            else if (result == LOCK_ERROR) {
+                dropLost(bucket, cache);
+            }
+
+            if (!finishRelease(bucket, cache) && cache->dirtyCount > 0)
+                scheduleFlush();
+        }
+    }
+
+    delete trans;
+    if (cb)
+        cb(result, rs);
+    else
+        delete rs;
+}
+
+bool CachedStorage::erase(const Bucket& bucket, const Key& key, const CommitCallback& cb, const String& timestamp) {
+    bool is_new = false;
+    {
+        Lock lck(mMutex);
+        Transaction* trans = getTransaction(bucket, &is_new);
+        trans->push_back(Action(Action::Erase, key));
+    }
+
+    // Run commit if this is a one-off transaction
+    if (is_new)
+        commitTransaction(bucket, cb, timestamp);
+
+    return true;
+}
+
+bool CachedStorage::write(const Bucket& bucket, const Key& key, const String& value, const CommitCallback& cb, const String& timestamp) {
+    bool is_new = false;
+    {
+        Lock lck(mMutex);
+        Transaction* trans = getTransaction(bucket, &is_new);
+        trans->push_back(Action(Action::Write, key));
+        trans->back().value = value;
+    }
+
+    if (is_new)
+        commitTransaction(bucket, cb, timestamp);
+
+    return true;
+}
+
+bool CachedStorage::read(const Bucket& bucket, const Key& key, const CommitCallback& cb, const String& timestamp) {
+    bool is_new = false;
+    {
+        Lock lck(mMutex);
+        Transaction* trans = getTransaction(bucket, &is_new);
+        trans->push_back(Action(Action::Read, key));
+    }
+
+    if (is_new)
+        commitTransaction(bucket, cb, timestamp);
+
+    return true;
+}
+
+bool CachedStorage::compare(const Bucket& bucket, const Key& key, const String& value, const CommitCallback& cb, const String& timestamp) {
+    bool is_new = false;
+    {
+        Lock lck(mMutex);
+        Transaction* trans = getTransaction(bucket, &is_new);
+        trans->push_back(Action(Action::Compare, key));
+        trans->back().value = value;
+    }
+
+    if (is_new)
+        commitTransaction(bucket, cb, timestamp);
+
+    return true;
+}
+
+bool CachedStorage::rangeRead(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb, const String& timestamp) {
+    bool is_new = false;
+    {
+        Lock lck(mMutex);
+        Transaction* trans = getTransaction(bucket, &is_new);
+        trans->push_back(Action(Action::ReadRange, start));
+        trans->back().keyEnd = finish;
+    }
+
+    if (is_new)
+        commitTransaction(bucket, cb, timestamp);
+
+    return true;
+}
+
+bool CachedStorage::rangeErase(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb, const String& timestamp) {
+    bool is_new = false;
+    {
+        Lock lck(mMutex);
+        Transaction* trans = getTransaction(bucket, &is_new);
+        trans->push_back(Action(Action::EraseRange, start));
+        trans->back().keyEnd = finish;
+    }
+
+    if (is_new)
+        commitTransaction(bucket, cb, timestamp);
+
+    return true;
+}
+
+bool CachedStorage::count(const Bucket& bucket, const Key& start, const Key& finish, const CountCallback& cb, const String& timestamp) {
+    // Counts aren't part of transactions, so the best we can do is get our
+    // writes to the backend first. They're queued before the count, although
+    // a backend that delays commits, e.g. for group commit, may still count
+    // first.
+    {
+        Lock lck(mMutex);
+        flushBucket(bucket, true);
+    }
+
+    return mBackend->count(bucket, start, finish, cb, timestamp);
+}
+
+} // namespace OH
+} // namespace Sirikata
@@ -84,6 +84,7 @@ HostedObject::HostedObject(ObjectHostContext* ctx, ObjectHost*parent, const UUID
  : mContext(ctx),
    mID(_id),
    mObjectHost(parent),
+   mStrand(parent != NULL ? parent->objectStrand(_id) : ctx->mainStrand),
    mObjectScript(NULL),
    destroyed(false)
 {
@@ -501,9 +502,9 @@ void HostedObject::handleConnected(const HostedObjectWPtr& weakSelf, ObjectHost*
               self->mContext, self->mDelegateODPService
            )   );
 
-    // We have to manually do what mContext->mainStrand->wrap( ... ) should be
-    // doing because it can't handle > 5 arguments.
-    self->mContext->mainStrand->post(
+    // We have to manually do what mStrand->wrap( ... ) should be doing because
+    // it can't handle > 5 arguments.
+    self->mStrand->post(
         std::tr1::bind(&HostedObject::handleConnectedIndirect, weakSelf, parentOH, space, obj, info, baseDatagramLayer),
         "HostedObject::handleConnectedIndirect"
     );
@@ -563,6 +564,21 @@ void HostedObject::handleConnectedIndirect(const HostedObjectWPtr& weakSelf, Obj
 }
 
 void HostedObject::handleMigrated(const HostedObjectWPtr& weakSelf, const SpaceID& space, const ObjectReference& obj, ServerID server)
+{
+    HostedObjectPtr self(weakSelf.lock());
+    if (!self)
+        return;
+    if (self->mStrand != self->mContext->mainStrand) {
+        self->mStrand->post(
+            std::tr1::bind(&HostedObject::iHandleMigrated, weakSelf, space, obj, server),
+            "HostedObject::iHandleMigrated"
+        );
+        return;
+    }
+    iHandleMigrated(weakSelf, space, obj, server);
+}
+
+void HostedObject::iHandleMigrated(const HostedObjectWPtr& weakSelf, const SpaceID& space, const ObjectReference& obj, ServerID server)
 {
     HostedObjectPtr self(weakSelf.lock());
     if (!self)
@@ -584,6 +600,22 @@ void HostedObject::handleMigrated(const HostedObjectWPtr& weakSelf, const SpaceI
 
 
 void HostedObject::handleStreamCreated(const HostedObjectWPtr& weakSelf, const SpaceObjectReference& spaceobj, SessionManager::ConnectionEvent after, PresenceToken token) {
+    HostedObjectPtr self(weakSelf.lock());
+    if (!self)
+        return;
+    // Posting also keeps this ordered after handleConnectedIndirect, which
+    // sets up the presence being notified about.
+    if (self->mStrand != self->mContext->mainStrand) {
+        self->mStrand->post(
+            std::tr1::bind(&HostedObject::iHandleStreamCreated, weakSelf, spaceobj, after, token),
+            "HostedObject::iHandleStreamCreated"
+        );
+        return;
+    }
+    iHandleStreamCreated(weakSelf, spaceobj, after, token);
+}
+
+void HostedObject::iHandleStreamCreated(const HostedObjectWPtr& weakSelf, const SpaceObjectReference& spaceobj, SessionManager::ConnectionEvent after, PresenceToken token) {
     HO_LOG(detailed,"Handling new SST stream from space server for " << spaceobj);
     HostedObjectPtr self(weakSelf.lock());
     if (!self)
@@ -636,7 +668,7 @@ void HostedObject::handleDisconnected(
         return;
     }
 
-    self->mContext->mainStrand->post(
+    self->mStrand->post(
         std::tr1::bind(&HostedObject::iHandleDisconnected,self.get(),
             weakSelf, spaceobj, cc),
         "HostedObject::iHandleDisconnected"
@@ -1143,6 +1175,14 @@ void HostedObject::requestQueryUpdate(const SpaceID& space, const ObjectReferenc
         }
     }
 
+    // The query processor runs on the main strand with the sessions
+    if (mStrand != mContext->mainStrand) {
+        mContext->mainStrand->post(
+            std::tr1::bind(&OH::ObjectQueryProcessor::updateQuery, mObjectHost->getQueryProcessor(), getSharedPtr(), sporef, new_query),
+            "ObjectQueryProcessor::updateQuery"
+        );
+        return;
+    }
     mObjectHost->getQueryProcessor()->updateQuery(getSharedPtr(), sporef, new_query);
 }
 
@@ -46,12 +46,15 @@
 #include <sirikata/core/util/SpaceObjectReference.hpp>
 #include <sirikata/core/service/Context.hpp>
 #include <sirikata/oh/ObjectQueryProcessor.hpp>
+#include <sirikata/proxyobject/ProxyStateStore.hpp>
 
 #include <sirikata/core/network/IOStrandImpl.hpp>
 
 // Transfer mediator added to download objects' Zernike descriptors
 #include <sirikata/core/transfer/AggregatedTransferPool.hpp>
 
+#include <boost/lexical_cast.hpp>
+
 #define OH_LOG(lvl,msg) SILOG(oh,lvl,msg)
 
 namespace Sirikata {
@@ -61,16 +64,19 @@ ObjectHost::ObjectHost(ObjectHostContext* ctx, Network::IOService *ioServ, const
    mStorage(NULL),
    mPersistentSet(NULL),
    mQueryProcessor(NULL),
+   mProxyStateStore(new ProxyStateStore()),
    mActiveHostedObjects(0)
 {
     mContext->objectHost = this;
     OptionValue *protocolOptions;
     OptionValue *scriptManagers;
     OptionValue *simOptions;
+    OptionValue *objectStrands;
     InitializeClassOptions ico("objecthost",this,
                            protocolOptions=new OptionValue("protocols","",OptionValueType<std::map<std::string,std::string> >(),"passes options into protocol specific libraries like \"tcpsst:{--send-buffer-size=1440 --parallel-sockets=1},udp:{--send-buffer-size=1500}\""),
                            scriptManagers=new OptionValue("scriptManagers","simplecamera:{},js:{}",OptionValueType<std::map<std::string,std::string> >(),"Instantiates script managers with specified options like \"simplecamera:{},js:{--import-paths=/path/to/scripts}\""),
                            simOptions=new OptionValue("simOptions","ogregraphics:{}",OptionValueType<std::map<std::string,std::string> >(),"Passes initialization strings to simulations, by name"),
+                           objectStrands=new OptionValue("objectStrands","0",OptionValueType<uint32>(),"Number of strands to spread objects over. Each object, including its presences and scripts, runs on one of them. 0 runs all objects on the main strand."),
 
                            NULL);
 
@@ -121,6 +127,10 @@ ObjectHost::ObjectHost(ObjectHostContext* ctx, Network::IOService *ioServ, const
         );
     }
 
+    uint32 num_object_strands = objectStrands->as<uint32>();
+    for(uint32 i = 0; i < num_object_strands; i++)
+        mObjectStrands.push_back(mContext->ioService->createStrand("ObjectHost Objects " + boost::lexical_cast<String>(i)));
+
     mTransferMediator = &(Transfer::TransferMediator::getSingleton());
     mTransferPool = mTransferMediator->registerClient<Transfer::AggregatedTransferPool>("ObjectHost");
 }
@@ -129,7 +139,10 @@ ObjectHost::~ObjectHost()
 {
     {
         HostedObjectMap objs;
-        mHostedObjects.swap(objs);
+        {
+            Mutex::scoped_lock lock(mHostedObjectsMutex);
+            mHostedObjects.swap(objs);
+        }
         for (HostedObjectMap::iterator iter = objs.begin();
                  iter != objs.end();
                  ++iter) {
@@ -137,6 +150,16 @@ ObjectHost::~ObjectHost()
         }
         objs.clear(); // The HostedObject destructor will attempt to delete from mHostedObjects
     }
+
+    for(uint32 i = 0; i < mObjectStrands.size(); i++)
+        delete mObjectStrands[i];
+    mObjectStrands.clear();
+}
+
+Network::IOStrand* ObjectHost::objectStrand(const UUID& id) const {
+    if (mObjectStrands.empty())
+        return mContext->mainStrand;
+    return mObjectStrands[id.hash() % mObjectStrands.size()];
 }
 
 HostedObjectPtr ObjectHost::createObject(const String& script_type, const String& script_opts, const String& script_contents) {
@@ -145,13 +168,16 @@ HostedObjectPtr ObjectHost::createObject(const String& script_type, const String
 }
 
 HostedObjectPtr ObjectHost::createObject(const UUID &uuid, const String& script_type, const String& script_opts, const String& script_contents) {
-    mActiveHostedObjects++;
     HostedObjectPtr ho = HostedObject::construct<HostedObject>(mContext, this, uuid);
 
-    // Safe weak reference by internal id. This lets us use the internal ID to
-    // uniquely reference the object and look it up, e.g. for external commands
-    assert(mHostedObjectsByID.find(uuid) == mHostedObjectsByID.end());
-    mHostedObjectsByID[uuid] = ho;
+    {
+        Mutex::scoped_lock lock(mHostedObjectsMutex);
+        mActiveHostedObjects++;
+        // Safe weak reference by internal id. This lets us use the internal ID to
+        // uniquely reference the object and look it up, e.g. for external commands
+        assert(mHostedObjectsByID.find(uuid) == mHostedObjectsByID.end());
+        mHostedObjectsByID[uuid] = ho;
+    }
 
     ho->start();
     // NOTE: This condition has been carefully thought through. Since you can
@@ -204,6 +230,18 @@ void ObjectHost::handleObjectDisconnected(const SpaceObjectReference& sporef_obj
 //use this function to request the object host to send a disconnect message
 //to space for object
 void ObjectHost::disconnectObject(const SpaceID& space, const ObjectReference& oref)
+{
+    if (!mObjectStrands.empty()) {
+        mContext->mainStrand->post(
+            std::tr1::bind(&ObjectHost::sessionDisconnect, this, space, oref),
+            "ObjectHost::sessionDisconnect"
+        );
+        return;
+    }
+    sessionDisconnect(space, oref);
+}
+
+void ObjectHost::sessionDisconnect(const SpaceID& space, const ObjectReference& oref)
 {
     SpaceSessionManagerMap::iterator iter = mSessionManagers.find(space);
     if (iter == mSessionManagers.end())
@@ -216,7 +254,15 @@ void ObjectHost::handleObjectMessage(const SpaceObjectReference& sporef_internal
     // Either we know the object and deliver, or somethings gone wacky
     HostedObjectPtr obj = getHostedObject(sporef_internalID);
     if (obj) {
-        obj->receiveMessage(space, msg);
+        if (obj->strand() == mContext->mainStrand) {
+            obj->receiveMessage(space, msg);
+        }
+        else {
+            obj->strand()->post(
+                std::tr1::bind(&HostedObject::receiveMessage, obj, space, msg),
+                "HostedObject::receiveMessage"
+            );
+        }
     }
     else {
         OH_LOG(warn, "Got message for " << sporef_internalID << " but no such object exists.");
@@ -226,6 +272,23 @@ void ObjectHost::handleObjectMessage(const SpaceObjectReference& sporef_internal
 
 // Primary HostedObject API
 
+struct ObjectHost::PendingConnect {
+    HostedObjectWPtr ho;
+    SpaceObjectReference sporef;
+    SpaceID space;
+    TimedMotionVector3f loc;
+    TimedMotionQuaternion orient;
+    BoundingSphere3f bnds;
+    String mesh;
+    String physics;
+    String query;
+    String query_data;
+    ConnectedCallback connected_cb;
+    MigratedCallback migrated_cb;
+    StreamCreatedCallback stream_created_cb;
+    DisconnectedCallback disconnected_cb;
+};
+
 bool ObjectHost::connect(
     HostedObjectPtr ho,
     const SpaceObjectReference& sporef, const SpaceID& space,
@@ -242,18 +305,63 @@ bool ObjectHost::connect(
     DisconnectedCallback disconnected_cb
 )
 {
+    {
+        Mutex::scoped_lock lock(mHostedObjectsMutex);
+        if (mHostedObjects.find(sporef)!=mHostedObjects.end())
+            return false;
+    }
+
+    PendingConnectPtr pc(new PendingConnect());
+    pc->ho = ho;
+    pc->sporef = sporef;
+    pc->space = space;
+    pc->loc = loc;
+    pc->orient = orient;
+    pc->bnds = bnds;
+    pc->mesh = mesh;
+    pc->physics = phy;
+    pc->query = query;
+    pc->query_data = query_data;
+    pc->connected_cb = connected_cb;
+    pc->migrated_cb = migrated_cb;
+    pc->stream_created_cb = stream_created_cb;
+    pc->disconnected_cb = disconnected_cb;
+
+    if (!mObjectStrands.empty()) {
+        mContext->mainStrand->post(
+            std::tr1::bind(&ObjectHost::postedSessionConnect, this, pc),
+            "ObjectHost::postedSessionConnect"
+        );
+        return true;
+    }
+    return sessionConnect(pc);
+}
+
+void ObjectHost::postedSessionConnect(PendingConnectPtr pc) {
+    if (sessionConnect(pc)) return;
+
+    // The object thinks the connection is underway, so tell it otherwise
+    OH_LOG(warn, "Couldn't start connection for " << pc->sporef);
+    pc->disconnected_cb(pc->sporef, Disconnect::LoginDenied);
+}
+
+bool ObjectHost::sessionConnect(PendingConnectPtr pc) {
     Sirikata::SerializationCheck::Scoped sc(&mSessionSerialization);
-    if (mHostedObjects.find(sporef)!=mHostedObjects.end())
+    SpaceSessionManagerMap::iterator iter = mSessionManagers.find(pc->space);
+    if (iter == mSessionManagers.end()) {
+        OH_LOG(error, "Can't connect " << pc->sporef << " to unknown space " << pc->space);
         return false;
-    SessionManager *sm = mSessionManagers[space];
+    }
+    SessionManager *sm = iter->second;
 
-    String filtered_query = mQueryProcessor->connectRequest(ho, sporef, query);
+    HostedObjectPtr ho(pc->ho.lock());
+    String filtered_query = mQueryProcessor->connectRequest(ho, pc->sporef, pc->query);
     return sm->connect(
-        sporef, loc, orient, bnds, mesh, phy, filtered_query, query_data,
-        std::tr1::bind(&ObjectHost::wrappedConnectedCallback, this, HostedObjectWPtr(ho), _1, _2, _3, connected_cb),
-        migrated_cb,
-        std::tr1::bind(&ObjectHost::wrappedStreamCreatedCallback, this, HostedObjectWPtr(ho), _1, _2, stream_created_cb),
-        std::tr1::bind(&ObjectHost::wrappedDisconnectedCallback, this, HostedObjectWPtr(ho), _1, _2, disconnected_cb)
+        pc->sporef, pc->loc, pc->orient, pc->bnds, pc->mesh, pc->physics, filtered_query, pc->query_data,
+        std::tr1::bind(&ObjectHost::wrappedConnectedCallback, this, pc->ho, _1, _2, _3, pc->connected_cb),
+        pc->migrated_cb,
+        std::tr1::bind(&ObjectHost::wrappedStreamCreatedCallback, this, pc->ho, _1, _2, pc->stream_created_cb),
+        std::tr1::bind(&ObjectHost::wrappedDisconnectedCallback, this, pc->ho, _1, _2, pc->disconnected_cb)
     );
 }
 
@@ -338,30 +446,53 @@ Time ObjectHost::currentLocalTime() const {
 
 
 bool ObjectHost::send(SpaceObjectReference& sporef_src, const SpaceID& space, const ObjectMessagePort src_port, const UUID& dest, const ObjectMessagePort dest_port, MemoryReference payload) {
-    Sirikata::SerializationCheck::Scoped sc(&mSessionSerialization);
-
     std::string payload_str( (char*)payload.begin(), (char*)payload.end() );
     return send(sporef_src, space, src_port, dest, dest_port, payload_str);
 }
 
 bool ObjectHost::send(SpaceObjectReference& sporef_src, const SpaceID& space, const ObjectMessagePort src_port, const UUID& dest, const ObjectMessagePort dest_port, const std::string& payload) {
+    if (!mObjectStrands.empty()) {
+        if (mSessionManagers.find(space) == mSessionManagers.end())
+            return false;
+        mContext->mainStrand->post(
+            std::tr1::bind(&ObjectHost::sessionSend, this, sporef_src, space, src_port, dest, dest_port, payload),
+            "ObjectHost::sessionSend"
+        );
+        return true;
+    }
+    return sessionSend(sporef_src, space, src_port, dest, dest_port, payload);
+}
+
+bool ObjectHost::sessionSend(const SpaceObjectReference& sporef_src, const SpaceID& space, const ObjectMessagePort src_port, const UUID& dest, const ObjectMessagePort dest_port, const std::string& payload) {
     Sirikata::SerializationCheck::Scoped sc(&mSessionSerialization);
-    return mSessionManagers[space]->send(sporef_src, src_port, dest, dest_port, payload);
+    SpaceSessionManagerMap::iterator iter = mSessionManagers.find(space);
+    if (iter == mSessionManagers.end())
+        return false;
+    return iter->second->send(sporef_src, src_port, dest, dest_port, payload);
 }
 
 void ObjectHost::registerHostedObject(const SpaceObjectReference &sporef_uuid, const HostedObjectPtr& obj)
 {
+    // Any object we replace must be released outside the lock, see
+    // unregisterHostedObject
+    HostedObjectPtr replaced;
+    Mutex::scoped_lock lock(mHostedObjectsMutex);
     HostedObjectMap::iterator iter = mHostedObjects.find(sporef_uuid);
     if (iter != mHostedObjects.end()) {
         SILOG(oh,error,"Two objects having the same internal name in the mHostedObjects map on connect"<<sporef_uuid.toString());
+        replaced = iter->second;
     }
     mHostedObjects[sporef_uuid]=obj;
 }
 void ObjectHost::unregisterHostedObject(const SpaceObjectReference& sporef_uuid, HostedObject* key_obj)
 {
+    // Declared outside the lock since this may be the last reference, and the
+    // object's destructor calls back into hostedObjectDestroyed
+    HostedObjectPtr obj;
+    Mutex::scoped_lock lock(mHostedObjectsMutex);
     HostedObjectMap::iterator iter = mHostedObjects.find(sporef_uuid);
     if (iter != mHostedObjects.end()) {
-        HostedObjectPtr obj (iter->second);
+        obj = iter->second;
         // The NULL case covers the possibility that the connection finishes
         // after the HostedObject requests destruction and stops paying
         // attention to connection events
@@ -373,6 +504,7 @@ void ObjectHost::unregisterHostedObject(const SpaceObjectReference& sporef_uuid,
 }
 
 void ObjectHost::hostedObjectDestroyed(const UUID& objid) {
+    Mutex::scoped_lock lock(mHostedObjectsMutex);
     // Remove our weak reference to the object
     assert(mHostedObjectsByID.find(objid) != mHostedObjectsByID.end());
     mHostedObjectsByID.erase(objid);
@@ -390,6 +522,7 @@ void ObjectHost::hostedObjectDestroyed(const UUID& objid) {
 
 
 HostedObjectPtr ObjectHost::getHostedObject(const SpaceObjectReference& sporef) const {
+    Mutex::scoped_lock lock(mHostedObjectsMutex);
     HostedObjectMap::const_iterator iter = mHostedObjects.find(sporef);
     if (iter != mHostedObjects.end()) {
         return iter->second;
@@ -398,6 +531,7 @@ HostedObjectPtr ObjectHost::getHostedObject(const SpaceObjectReference& sporef)
 }
 
 HostedObjectPtr ObjectHost::getHostedObject(const UUID& internal_id) const {
+    Mutex::scoped_lock lock(mHostedObjectsMutex);
     InternalIDHostedObjectMap::const_iterator iter = mHostedObjectsByID.find(internal_id);
     if (iter == mHostedObjectsByID.end()) return HostedObjectPtr();
     HostedObjectPtr ho = iter->second.lock();
@@ -407,7 +541,10 @@ HostedObjectPtr ObjectHost::getHostedObject(const UUID& internal_id) const {
 
 ObjectHost::SSTStreamPtr ObjectHost::getSpaceStream(const SpaceID& space, const ObjectReference& oref)
 {
-    return mSessionManagers[space]->getSpaceStream(oref);
+    SpaceSessionManagerMap::iterator iter = mSessionManagers.find(space);
+    if (iter == mSessionManagers.end())
+        return SSTStreamPtr();
+    return iter->second->getSpaceStream(oref);
 }
 
 
@@ -421,10 +558,17 @@ void ObjectHost::stop() {
         sm->stop();
     }
 
-    for(InternalIDHostedObjectMap::const_iterator it = mHostedObjectsByID.begin(); it != mHostedObjectsByID.end(); it++) {
-        HostedObjectPtr ho = it->second.lock();
-        if (ho) ho->stop();
+    // Objects may unregister themselves as they stop, so work from a copy
+    std::vector<HostedObjectPtr> objs;
+    {
+        Mutex::scoped_lock lock(mHostedObjectsMutex);
+        for(InternalIDHostedObjectMap::const_iterator it = mHostedObjectsByID.begin(); it != mHostedObjectsByID.end(); it++) {
+            HostedObjectPtr ho = it->second.lock();
+            if (ho) objs.push_back(ho);
+        }
     }
+    for(std::vector<HostedObjectPtr>::iterator it = objs.begin(); it != objs.end(); it++)
+        (*it)->stop();
 }
 
 OHDP::Port* ObjectHost::bindOHDPPort(const SpaceID& space, const OHDP::NodeID& node, OHDP::PortID port) {
@@ -480,11 +624,10 @@ void ObjectHost::commandListObjects(const Command::Command& cmd, Command::Comman
     result.put( String("objects"), Command::Array());
     Command::Array& objects_ary = result.getArray("objects");
 
-    Sirikata::SerializationCheck::Scoped sc(&mSessionSerialization);
-
-    for(InternalIDHostedObjectMap::const_iterator it = mHostedObjectsByID.begin(); it != mHostedObjectsByID.end(); it++) {
-        HostedObjectPtr ho = it->second.lock();
-        if (ho) objects_ary.push_back( ho->id().toString() );
+    {
+        Mutex::scoped_lock lock(mHostedObjectsMutex);
+        for(InternalIDHostedObjectMap::const_iterator it = mHostedObjectsByID.begin(); it != mHostedObjectsByID.end(); it++)
+            objects_ary.push_back( it->first.toString() );
     }
     cmdr->result(cmdid, result);
 }
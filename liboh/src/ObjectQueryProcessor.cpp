@@ -3,7 +3,10 @@
 // be found in the LICENSE file.
 
 #include <sirikata/oh/ObjectQueryProcessor.hpp>
+#include <sirikata/oh/ObjectHostContext.hpp>
+#include <sirikata/pintoloc/CopyableLocUpdate.hpp>
 #include "Protocol_Loc.pbj.hpp"
+#include "Protocol_Prox.pbj.hpp"
 
 AUTO_SINGLETON_INSTANCE(Sirikata::OH::ObjectQueryProcessorFactory);
 
@@ -37,10 +40,25 @@ String ObjectQueryProcessor::connectRequest(HostedObjectPtr ho, const SpaceObjec
 
 
 void ObjectQueryProcessor::deliverProximityUpdate(HostedObjectPtr ho, const SpaceObjectReference& sporef, const Sirikata::Protocol::Prox::ProximityUpdate& update) {
+    // Results arrive on the main strand, the object may run on another one
+    if (ho->strand() != ho->context()->mainStrand) {
+        ho->strand()->post(
+            std::tr1::bind(&HostedObject::handleProximityUpdate, ho, sporef, update),
+            "HostedObject::handleProximityUpdate"
+        );
+        return;
+    }
     ho->handleProximityUpdate(sporef, update);
 }
 
 void ObjectQueryProcessor::deliverLocationUpdate(HostedObjectPtr ho, const SpaceObjectReference& sporef, const LocUpdate& lu) {
+    if (ho->strand() != ho->context()->mainStrand) {
+        ho->strand()->post(
+            std::tr1::bind(&HostedObject::handleLocationUpdate, ho, sporef, CopyableLocUpdate(lu)),
+            "HostedObject::handleLocationUpdate"
+        );
+        return;
+    }
     ho->handleLocationUpdate(sporef, lu);
 }
 
@@ -6,6 +6,7 @@
 #include <sirikata/proxyobject/VWObject.hpp>
 #include <sirikata/oh/PerPresenceData.hpp>
 #include <sirikata/oh/ObjectHostContext.hpp>
+#include <sirikata/oh/ObjectHost.hpp>
 #include <sirikata/core/odp/SST.hpp>
 
 namespace Sirikata{
@@ -20,13 +21,16 @@ PerPresenceData::PerPresenceData(HostedObjectPtr _parent, const SpaceID& _space,
      : parent(_parent),
        space(_space),
        object(_oref),
-       proxyManager(ProxyManager::construct( _parent, SpaceObjectReference(_space, _oref) )),
+       proxyManager(ProxyManager::construct(
+               _parent, SpaceObjectReference(_space, _oref),
+               _parent->getObjectHost() ? _parent->getObjectHost()->proxyStateStore() : ProxyStateStorePtr()
+           )),
        query(_query),
        mSSTDatagramLayers(layer),
        updateFields(LOC_FIELD_NONE),
        requestEpoch(1),
        requestLoc( new SequencedPresenceProperties() ),
-       rerequestTimer( Network::IOTimer::create(_parent->context()->ioService) ),
+       rerequestTimer( Network::IOTimer::create(_parent->strand()) ),
        latestReportedEpoch(0)
     {
     }
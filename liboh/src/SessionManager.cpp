@@ -633,11 +633,19 @@ void SessionManager::migrate(const SpaceObjectReference& sporef_obj_id, ServerID
     //forcibly close the SST connection for this object to its current previous
     //space server
     //ObjectReference objref(sporef_obj_id.object());
-    if (mObjectToSpaceStreams.find(sporef_obj_id.object()) != mObjectToSpaceStreams.end())
+    SSTStreamPtr old_stream;
+    {
+        boost::mutex::scoped_lock lock(mObjectToSpaceStreamsMutex);
+        std::map<ObjectReference, SSTStreamPtr>::iterator stream_it = mObjectToSpaceStreams.find(sporef_obj_id.object());
+        if (stream_it != mObjectToSpaceStreams.end()) {
+            old_stream = stream_it->second;
+            mObjectToSpaceStreams.erase(stream_it);
+        }
+    }
+    if (old_stream)
     {
         SESSION_LOG(detailed, "deleting object-space streams  of " << sporef_obj_id << " to " << sid);
-        mObjectToSpaceStreams[sporef_obj_id.object()]->connection().lock()->close(true);
-        mObjectToSpaceStreams.erase(sporef_obj_id.object());
+        old_stream->connection().lock()->close(true);
     }
     mObjectConnections.startMigration(sporef_obj_id, sid);
 
@@ -1325,8 +1333,10 @@ void SessionManager::handleObjectFullyMigrated(const SpaceID& space, const Objec
 }
 
 SessionManager::SSTStreamPtr SessionManager::getSpaceStream(const ObjectReference& objectID) {
-  if (mObjectToSpaceStreams.find(objectID) != mObjectToSpaceStreams.end()) {
-    return mObjectToSpaceStreams[objectID];
+  boost::mutex::scoped_lock lock(mObjectToSpaceStreamsMutex);
+  std::map<ObjectReference, SSTStreamPtr>::iterator it = mObjectToSpaceStreams.find(objectID);
+  if (it != mObjectToSpaceStreams.end()) {
+    return it->second;
   }
 
   return SSTStreamPtr();
@@ -1354,7 +1364,10 @@ void SessionManager::spaceConnectCallback(int err, SSTStreamPtr s, SpaceObjectRe
         return;
     }
 
-    mObjectToSpaceStreams[spaceobj.object()] = s;
+    {
+        boost::mutex::scoped_lock lock(mObjectToSpaceStreamsMutex);
+        mObjectToSpaceStreams[spaceobj.object()] = s;
+    }
 
 
     bool time_synced = mTimeSyncClient != NULL && mTimeSyncClient->valid();
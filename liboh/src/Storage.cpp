@@ -31,12 +31,51 @@
  */
 
 #include <sirikata/oh/Storage.hpp>
+#include <sirikata/oh/CachedStorage.hpp>
+#include <sirikata/core/options/Options.hpp>
 
 AUTO_SINGLETON_INSTANCE(Sirikata::OH::StorageFactory);
 
 namespace Sirikata {
 namespace OH {
 
+namespace {
+
+void InitCachedStorageOptions() {
+    InitializeClassOptions ico("cachedstorage",NULL,
+        new OptionValue("backend", "sqlite", OptionValueType<String>(), "Type of storage to cache."),
+        new OptionValue("backend-options", "", OptionValueType<String>(), "Options for the cached storage. Quote them to pass more than one."),
+        new OptionValue("max-entries", "1024", OptionValueType<uint32>(), "Maximum number of keys to cache per object."),
+        new OptionValue("max-dirty", "64", OptionValueType<uint32>(), "Number of unflushed writes for an object that causes them to be written back immediately."),
+        new OptionValue("flush-interval", "100ms", OptionValueType<Duration>(), "Maximum time a write is held in memory before it's written back."),
+        NULL);
+}
+
+Storage* createCachedStorage(ObjectHostContext* ctx, const String& args) {
+    OptionSet* optionsSet = OptionSet::getOptions("cachedstorage",NULL);
+    optionsSet->parse(args);
+
+    String backend_type = optionsSet->referenceOption("backend")->as<String>();
+    String backend_opts = optionsSet->referenceOption("backend-options")->as<String>();
+    uint32 max_entries = optionsSet->referenceOption("max-entries")->as<uint32>();
+    uint32 max_dirty = optionsSet->referenceOption("max-dirty")->as<uint32>();
+    Duration flush_interval = optionsSet->referenceOption("flush-interval")->as<Duration>();
+
+    Storage* backend = StorageFactory::getSingleton().getConstructor(backend_type)(ctx, backend_opts);
+    return new CachedStorage(ctx, backend, max_entries, max_dirty, flush_interval);
+}
+
+} // namespace
+
+StorageFactory::StorageFactory() {
+    // A write-back cache that can be put in front of any other storage
+    InitCachedStorageOptions();
+    registerConstructor("cached", createCachedStorage);
+}
+
+StorageFactory::~StorageFactory() {
+}
+
 StorageFactory& StorageFactory::getSingleton() {
     return AutoSingleton<StorageFactory>::getSingleton();
 }
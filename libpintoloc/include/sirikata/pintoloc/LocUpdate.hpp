@@ -13,6 +13,9 @@
 #include <sirikata/core/util/AggregateBoundingInfo.hpp>
 #include <sirikata/core/prox/Defs.hpp>
 
+/// Key in JSON query parameters used to request a LocUpdateEncoding
+#define LOC_UPDATE_ENCODING_QUERY_KEY "loc_encoding"
+
 namespace Sirikata {
 
 class SpaceID;
@@ -86,6 +89,21 @@ public:
     virtual uint64 index_id_seqno() const = 0;
 };
 
+/** Encodings location updates can be sent to a subscriber with. */
+enum LocUpdateEncoding {
+    /// BulkLocationUpdate messages carrying every property of the object
+    LocUpdateEncodingFull,
+    /// CompactBulkLocationUpdate messages: quantized values, and only the
+    /// properties which changed since the last update to the subscriber
+    LocUpdateEncodingCompact
+};
+
+/** Parse an encoding name ("full" or "compact").
+ *  \returns false if the name isn't recognized, leaving out untouched
+ */
+SIRIKATA_LIBPINTOLOC_FUNCTION_EXPORT bool parseLocUpdateEncoding(const String& name, LocUpdateEncoding* out);
+SIRIKATA_LIBPINTOLOC_FUNCTION_EXPORT String locUpdateEncodingName(LocUpdateEncoding encoding);
+
 } // namespace Sirikata
 
 #endif //_SIRIKATA_LIBPINTOLOC_LOC_UPDATE_HPP_
@@ -184,6 +184,185 @@ private:
     const Sirikata::Protocol::Prox::ObjectAddition& mUpdate;
 };
 
+
+/** A single update in the compact location update format. Only the
+ *  properties flagged in fields are valid.
+ */
+struct SIRIKATA_LIBPINTOLOC_EXPORT CompactLocationUpdate {
+    enum Field {
+        Epoch = 1 << 0,
+        Parent = 1 << 1,
+        Location = 1 << 2,
+        Orientation = 1 << 3,
+        Bounds = 1 << 4,
+        Mesh = 1 << 5,
+        Physics = 1 << 6,
+        QueryData = 1 << 7,
+        IndexIDs = 1 << 8
+    };
+
+    CompactLocationUpdate()
+     : seqno(0),
+       fields(0),
+       epoch(0)
+    {}
+
+    UUID object;
+    uint64 seqno;
+    uint32 fields;
+
+    uint64 epoch;
+    UUID parent;
+    TimedMotionVector3f location;
+    TimedMotionQuaternion orientation;
+    AggregateBoundingInfo bounds;
+    String mesh;
+    String physics;
+    String query_data;
+    std::vector<ProxIndexID> index_ids;
+};
+
+/** Builds a compact bulk location update. Compared to BulkLocationUpdate:
+ *   - positions are quantized to a fixed resolution, relative to an origin
+ *     the sender picks per subscriber, and written as variable length
+ *     integers so nearby objects cost a few bytes per axis
+ *   - orientations are packed into 32 bits by dropping the largest
+ *     component (recovered from the others since they're unit length) and
+ *     quantizing the other three
+ *   - times are deltas from a base time shared by the message
+ *   - a bitmask records which properties are present, so unchanged ones
+ *     can be left out entirely
+ *
+ *  Each message carries its own origin and resolution, so messages can be
+ *  decoded independently and in any order.
+ */
+class SIRIKATA_LIBPINTOLOC_EXPORT CompactLocUpdateEncoder {
+public:
+    CompactLocUpdateEncoder(const Vector3f& origin, float32 position_resolution, float32 velocity_resolution);
+
+    void add(const CompactLocationUpdate& update);
+
+    /// Number of updates added
+    uint32 size() const { return mCount; }
+    /** Mean of the positions added, or the origin if there were none. This
+     *  makes a good origin for the next message to the same subscriber.
+     */
+    Vector3f centroid() const;
+
+    String serialize() const;
+
+private:
+    uint64 timeDelta(const Time& t);
+
+    Vector3f mOrigin;
+    float32 mPositionResolution;
+    float32 mVelocityResolution;
+
+    bool mHaveBaseTime;
+    uint64 mBaseTime;
+
+    uint32 mCount;
+    String mBody;
+
+    Vector3d mPositionSum;
+    uint32 mPositionCount;
+};
+
+/** A parsed compact bulk location update, with the same accessors as the
+ *  PBJ BulkLocationUpdate.
+ */
+class SIRIKATA_LIBPINTOLOC_EXPORT CompactBulkLocationUpdate {
+public:
+    /** Check whether a payload is in the compact format. Compact messages
+     *  start with a zero byte, which can never start a valid protocol buffer
+     *  since field number 0 is reserved, so both formats can share a stream.
+     */
+    static bool isCompact(const String& payload) {
+        return !payload.empty() && payload[0] == 0;
+    }
+
+    bool ParseFromString(const String& payload);
+
+    int32 update_size() const { return (int32)mUpdates.size(); }
+    const CompactLocationUpdate& update(int32 idx) const { return mUpdates[idx]; }
+
+private:
+    std::vector<CompactLocationUpdate> mUpdates;
+};
+
+/** Implementation of LocUpdate which collects its information from an update
+ *  in a CompactBulkLocationUpdate.
+ *
+ *  \note the references passed in here must remain valid for the lifetime
+ *  of this object.
+ */
+class SIRIKATA_LIBPINTOLOC_EXPORT CompactProtocolLocUpdate : public LocUpdate {
+public:
+    CompactProtocolLocUpdate(const CompactLocationUpdate& lu, const TimeSynced& sync)
+     : mUpdate(lu),
+       mSync(sync)
+    {}
+    virtual ~CompactProtocolLocUpdate() {}
+
+    virtual ObjectReference object() const { return ObjectReference(mUpdate.object); }
+
+    // Request epoch
+    virtual bool has_epoch() const { return has(CompactLocationUpdate::Epoch); }
+    virtual uint64 epoch() const { return mUpdate.epoch; }
+
+    // Parent aggregate
+    virtual bool has_parent() const { return has(CompactLocationUpdate::Parent); }
+    virtual ObjectReference parent() const { return ObjectReference(mUpdate.parent); }
+    virtual uint64 parent_seqno() const { return mUpdate.seqno; }
+
+    // Location
+    virtual bool has_location() const { return has(CompactLocationUpdate::Location); }
+    virtual TimedMotionVector3f location() const {
+        return TimedMotionVector3f(mSync.localTime(mUpdate.location.updateTime()), mUpdate.location.value());
+    }
+    virtual uint64 location_seqno() const { return mUpdate.seqno; }
+
+    // Orientation
+    virtual bool has_orientation() const { return has(CompactLocationUpdate::Orientation); }
+    virtual TimedMotionQuaternion orientation() const {
+        return TimedMotionQuaternion(mSync.localTime(mUpdate.orientation.updateTime()), mUpdate.orientation.value());
+    }
+    virtual uint64 orientation_seqno() const { return mUpdate.seqno; }
+
+    // Bounds
+    virtual bool has_bounds() const { return has(CompactLocationUpdate::Bounds); }
+    virtual AggregateBoundingInfo bounds() const { return mUpdate.bounds; }
+    virtual uint64 bounds_seqno() const { return mUpdate.seqno; }
+
+    // Mesh
+    virtual bool has_mesh() const { return has(CompactLocationUpdate::Mesh); }
+    virtual String mesh() const { return mUpdate.mesh; }
+    virtual uint64 mesh_seqno() const { return mUpdate.seqno; }
+
+    // Physics
+    virtual bool has_physics() const { return has(CompactLocationUpdate::Physics); }
+    virtual String physics() const { return mUpdate.physics; }
+    virtual uint64 physics_seqno() const { return mUpdate.seqno; }
+
+    // Query data
+    virtual bool has_query_data() const { return has(CompactLocationUpdate::QueryData); }
+    virtual String query_data() const { return mUpdate.query_data; }
+    virtual uint64 query_data_seqno() const { return mUpdate.seqno; }
+
+    virtual uint32 index_id_size() const { return mUpdate.index_ids.size(); }
+    virtual ProxIndexID index_id(int32 idx) const { return mUpdate.index_ids[idx]; }
+    virtual uint64 index_id_seqno() const { return mUpdate.seqno; }
+
+private:
+    CompactProtocolLocUpdate();
+    CompactProtocolLocUpdate(const CompactProtocolLocUpdate&);
+
+    bool has(CompactLocationUpdate::Field field) const { return (mUpdate.fields & field) != 0; }
+
+    const CompactLocationUpdate& mUpdate;
+    const TimeSynced& mSync;
+};
+
 } // namespace Sirikata
 
 #endif //_SIRIKATA_LIBPINTOLOC_PROTOCOL_LOC_UPDATE_HPP_
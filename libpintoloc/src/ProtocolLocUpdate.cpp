@@ -3,9 +3,28 @@
 // be found in the LICENSE file.
 
 #include <sirikata/pintoloc/ProtocolLocUpdate.hpp>
+#include <cmath>
+#include <cstring>
 
 namespace Sirikata {
 
+bool parseLocUpdateEncoding(const String& name, LocUpdateEncoding* out) {
+    if (name == "full")
+        *out = LocUpdateEncodingFull;
+    else if (name == "compact")
+        *out = LocUpdateEncodingCompact;
+    else
+        return false;
+    return true;
+}
+
+String locUpdateEncodingName(LocUpdateEncoding encoding) {
+    switch(encoding) {
+      case LocUpdateEncodingCompact: return "compact";
+      default: return "full";
+    }
+}
+
 TimedMotionVector3f LocProtocolLocUpdate::location() const {
     Sirikata::Protocol::TimedMotionVector update_loc = mUpdate.location();
     return TimedMotionVector3f(
@@ -22,4 +41,444 @@ TimedMotionQuaternion LocProtocolLocUpdate::orientation() const {
     );
 }
 
+
+
+// Compact format. A message is laid out as
+//   marker (0 byte), version
+//   base time (varint, microseconds)
+//   origin (3 x float32), position resolution, velocity resolution (float32)
+//   update count (varint)
+// followed by each update:
+//   object (16 bytes), seqno (varint), fields (varint)
+//   epoch (varint)                                     if Epoch
+//   parent (16 bytes)                                  if Parent
+//   time delta, 3 x position steps, 3 x velocity steps if Location
+//     (zigzag varints), or time delta and 6 x float32 if LocationRaw
+//   time delta, packed position, packed velocity       if Orientation
+//     direction, velocity magnitude (float32), or time
+//     delta and 8 x float32 if OrientationRaw
+//   center offset, center radius, max size (float32)   if Bounds
+//   length prefixed strings                            if Mesh, Physics, QueryData
+//   count, ids (varints)                               if IndexIDs
+// All fixed size values are little endian.
+
+namespace {
+
+const uint8 CompactMarker = 0;
+const uint8 CompactVersion = 1;
+
+// Set on the wire, in addition to Location/Orientation, when the value
+// couldn't be quantized and was written as raw floats
+const uint32 LocationRaw = 1 << 16;
+const uint32 OrientationRaw = 1 << 17;
+
+// Quantized values further than this many steps from the origin are sent
+// raw. It's well inside the range of int64 and of float64's integers.
+const float64 MaxSteps = 4503599627370496.0; // 2^52
+
+// Packed quaternion components lie in [-1/sqrt(2), 1/sqrt(2)]. An even
+// number of intervals keeps 0 exactly representable, so the identity
+// survives a round trip.
+const float64 QuatComponentRange = 0.70710678118654752;
+const uint32 QuatComponentSteps = 1022;
+
+
+void writeByte(String& out, uint8 v) {
+    out.push_back((char)v);
+}
+
+void writeVarint(String& out, uint64 v) {
+    while(v >= 0x80) {
+        out.push_back((char)((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+void writeZigZag(String& out, int64 v) {
+    writeVarint(out, ((uint64)v << 1) ^ (uint64)(v >> 63));
+}
+
+void writeFixed32(String& out, uint32 v) {
+    for(int i = 0; i < 4; i++)
+        out.push_back((char)((v >> (8*i)) & 0xFF));
+}
+
+void writeFloat(String& out, float32 v) {
+    uint32 bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    writeFixed32(out, bits);
+}
+
+void writeUUID(String& out, const UUID& id) {
+    out.append((const char*)id.getArray().data(), UUID::static_size);
+}
+
+void writeString(String& out, const String& v) {
+    writeVarint(out, v.size());
+    out.append(v);
+}
+
+
+// Bounds checked reader. Any read past the end marks it failed and returns
+// zeros, so callers can check once at the end.
+class CompactReader {
+public:
+    CompactReader(const String& data)
+     : mData(data), mPos(0), mFailed(false)
+    {}
+
+    bool failed() const { return mFailed; }
+    bool done() const { return mPos == mData.size(); }
+
+    uint8 readByte() {
+        if (!require(1)) return 0;
+        return (uint8)mData[mPos++];
+    }
+
+    uint64 readVarint() {
+        uint64 result = 0;
+        for(uint32 shift = 0; shift < 64; shift += 7) {
+            if (!require(1)) return 0;
+            uint8 b = (uint8)mData[mPos++];
+            result |= ((uint64)(b & 0x7F)) << shift;
+            if ((b & 0x80) == 0) return result;
+        }
+        mFailed = true;
+        return 0;
+    }
+
+    int64 readZigZag() {
+        uint64 v = readVarint();
+        return (int64)(v >> 1) ^ -(int64)(v & 1);
+    }
+
+    uint32 readFixed32() {
+        if (!require(4)) return 0;
+        uint32 v = 0;
+        for(int i = 0; i < 4; i++)
+            v |= ((uint32)(uint8)mData[mPos++]) << (8*i);
+        return v;
+    }
+
+    float32 readFloat() {
+        uint32 bits = readFixed32();
+        float32 v;
+        std::memcpy(&v, &bits, sizeof(v));
+        return v;
+    }
+
+    UUID readUUID() {
+        if (!require(UUID::static_size)) return UUID::null();
+        UUID id((const byte*)mData.data() + mPos, UUID::static_size);
+        mPos += UUID::static_size;
+        return id;
+    }
+
+    String readString() {
+        uint64 len = readVarint();
+        if (!require(len)) return String();
+        String v(mData, mPos, len);
+        mPos += len;
+        return v;
+    }
+
+private:
+    bool require(uint64 n) {
+        if (mFailed || mData.size() - mPos < n) {
+            mFailed = true;
+            return false;
+        }
+        return true;
+    }
+
+    const String& mData;
+    String::size_type mPos;
+    bool mFailed;
+};
+
+
+bool quantize(float64 v, float64 resolution, int64* out) {
+    float64 steps = std::floor(v / resolution + 0.5);
+    if (!(std::fabs(steps) < MaxSteps)) // Also catches NaN
+        return false;
+    *out = (int64)steps;
+    return true;
+}
+
+float64 quatLength(const Quaternion& q) {
+    return std::sqrt((float64)q.x*q.x + (float64)q.y*q.y + (float64)q.z*q.z + (float64)q.w*q.w);
+}
+
+// Smallest three packing of a unit quaternion: 2 bits for the index of the
+// largest component, which is dropped and made positive by negating the
+// whole quaternion (q and -q are the same rotation), then 10 bits for each
+// of the others.
+uint32 packQuaternion(const Quaternion& q) {
+    float64 len = quatLength(q);
+    if (len == 0) return packQuaternion(Quaternion::identity());
+    float64 c[4] = { q.x / len, q.y / len, q.z / len, q.w / len };
+
+    uint32 largest = 0;
+    for(uint32 i = 1; i < 4; i++)
+        if (std::fabs(c[i]) > std::fabs(c[largest])) largest = i;
+    float64 sign = (c[largest] < 0) ? -1.0 : 1.0;
+
+    uint32 packed = largest << 30;
+    uint32 shift = 20;
+    for(uint32 i = 0; i < 4; i++) {
+        if (i == largest) continue;
+        float64 norm = (c[i] * sign + QuatComponentRange) / (2 * QuatComponentRange);
+        int64 step = (int64)std::floor(norm * QuatComponentSteps + 0.5);
+        step = std::max((int64)0, std::min((int64)QuatComponentSteps, step));
+        packed |= ((uint32)step) << shift;
+        shift -= 10;
+    }
+    return packed;
+}
+
+Quaternion unpackQuaternion(uint32 packed) {
+    uint32 largest = packed >> 30;
+    float64 c[4];
+    float64 sum_sq = 0;
+    uint32 shift = 20;
+    for(uint32 i = 0; i < 4; i++) {
+        if (i == largest) continue;
+        uint32 step = (packed >> shift) & 0x3FF;
+        c[i] = ((float64)step / QuatComponentSteps) * (2 * QuatComponentRange) - QuatComponentRange;
+        sum_sq += c[i] * c[i];
+        shift -= 10;
+    }
+    c[largest] = std::sqrt(std::max(0.0, 1.0 - sum_sq));
+    return Quaternion((float32)c[0], (float32)c[1], (float32)c[2], (float32)c[3], Quaternion::XYZW());
+}
+
+} // namespace
+
+
+CompactLocUpdateEncoder::CompactLocUpdateEncoder(const Vector3f& origin, float32 position_resolution, float32 velocity_resolution)
+ : mOrigin(origin),
+   mPositionResolution(position_resolution),
+   mVelocityResolution(velocity_resolution),
+   mHaveBaseTime(false),
+   mBaseTime(0),
+   mCount(0),
+   mPositionSum(0, 0, 0),
+   mPositionCount(0)
+{
+}
+
+uint64 CompactLocUpdateEncoder::timeDelta(const Time& t) {
+    if (!mHaveBaseTime) {
+        mBaseTime = t.raw();
+        mHaveBaseTime = true;
+    }
+    return (int64)(t.raw() - mBaseTime);
+}
+
+void CompactLocUpdateEncoder::add(const CompactLocationUpdate& update) {
+    mCount++;
+
+    // Work out how location and orientation will be written first, since
+    // that decides the field flags
+    uint32 fields = update.fields & 0xFFFF;
+    int64 pos_steps[3], vel_steps[3];
+    if (fields & CompactLocationUpdate::Location) {
+        const Vector3f& pos = update.location.position();
+        const Vector3f& vel = update.location.velocity();
+        bool ok =
+            quantize((float64)pos.x - mOrigin.x, mPositionResolution, &pos_steps[0]) &&
+            quantize((float64)pos.y - mOrigin.y, mPositionResolution, &pos_steps[1]) &&
+            quantize((float64)pos.z - mOrigin.z, mPositionResolution, &pos_steps[2]) &&
+            quantize(vel.x, mVelocityResolution, &vel_steps[0]) &&
+            quantize(vel.y, mVelocityResolution, &vel_steps[1]) &&
+            quantize(vel.z, mVelocityResolution, &vel_steps[2]);
+        if (!ok) fields |= LocationRaw;
+    }
+    if (fields & CompactLocationUpdate::Orientation) {
+        // Only unit orientations can be packed
+        if (std::fabs(quatLength(update.orientation.position()) - 1.0) > 1e-3)
+            fields |= OrientationRaw;
+    }
+
+    writeUUID(mBody, update.object);
+    writeVarint(mBody, update.seqno);
+    writeVarint(mBody, fields);
+
+    if (fields & CompactLocationUpdate::Epoch)
+        writeVarint(mBody, update.epoch);
+    if (fields & CompactLocationUpdate::Parent)
+        writeUUID(mBody, update.parent);
+
+    if (fields & CompactLocationUpdate::Location) {
+        writeZigZag(mBody, timeDelta(update.location.updateTime()));
+        if (fields & LocationRaw) {
+            const Vector3f& pos = update.location.position();
+            const Vector3f& vel = update.location.velocity();
+            writeFloat(mBody, pos.x); writeFloat(mBody, pos.y); writeFloat(mBody, pos.z);
+            writeFloat(mBody, vel.x); writeFloat(mBody, vel.y); writeFloat(mBody, vel.z);
+        }
+        else {
+            for(int i = 0; i < 3; i++) writeZigZag(mBody, pos_steps[i]);
+            for(int i = 0; i < 3; i++) writeZigZag(mBody, vel_steps[i]);
+            mPositionSum += Vector3d(update.location.position());
+            mPositionCount++;
+        }
+    }
+
+    if (fields & CompactLocationUpdate::Orientation) {
+        writeZigZag(mBody, timeDelta(update.orientation.updateTime()));
+        const Quaternion& pos = update.orientation.position();
+        const Quaternion& vel = update.orientation.velocity();
+        if (fields & OrientationRaw) {
+            writeFloat(mBody, pos.x); writeFloat(mBody, pos.y); writeFloat(mBody, pos.z); writeFloat(mBody, pos.w);
+            writeFloat(mBody, vel.x); writeFloat(mBody, vel.y); writeFloat(mBody, vel.z); writeFloat(mBody, vel.w);
+        }
+        else {
+            writeFixed32(mBody, packQuaternion(pos));
+            // The velocity's magnitude is the rotation rate, so it's kept
+            // alongside the packed direction
+            writeFixed32(mBody, packQuaternion(vel));
+            writeFloat(mBody, (float32)quatLength(vel));
+        }
+    }
+
+    if (fields & CompactLocationUpdate::Bounds) {
+        writeFloat(mBody, update.bounds.centerOffset.x);
+        writeFloat(mBody, update.bounds.centerOffset.y);
+        writeFloat(mBody, update.bounds.centerOffset.z);
+        writeFloat(mBody, update.bounds.centerBoundsRadius);
+        writeFloat(mBody, update.bounds.maxObjectRadius);
+    }
+
+    if (fields & CompactLocationUpdate::Mesh)
+        writeString(mBody, update.mesh);
+    if (fields & CompactLocationUpdate::Physics)
+        writeString(mBody, update.physics);
+    if (fields & CompactLocationUpdate::QueryData)
+        writeString(mBody, update.query_data);
+
+    if (fields & CompactLocationUpdate::IndexIDs) {
+        writeVarint(mBody, update.index_ids.size());
+        for(uint32 i = 0; i < update.index_ids.size(); i++)
+            writeVarint(mBody, update.index_ids[i]);
+    }
+}
+
+Vector3f CompactLocUpdateEncoder::centroid() const {
+    if (mPositionCount == 0) return mOrigin;
+    return Vector3f(mPositionSum / (float64)mPositionCount);
+}
+
+String CompactLocUpdateEncoder::serialize() const {
+    String result;
+    result.reserve(mBody.size() + 32);
+    writeByte(result, CompactMarker);
+    writeByte(result, CompactVersion);
+    writeVarint(result, mBaseTime);
+    writeFloat(result, mOrigin.x);
+    writeFloat(result, mOrigin.y);
+    writeFloat(result, mOrigin.z);
+    writeFloat(result, mPositionResolution);
+    writeFloat(result, mVelocityResolution);
+    writeVarint(result, mCount);
+    result.append(mBody);
+    return result;
+}
+
+
+bool CompactBulkLocationUpdate::ParseFromString(const String& payload) {
+    mUpdates.clear();
+
+    CompactReader reader(payload);
+    if (reader.readByte() != CompactMarker || reader.readByte() != CompactVersion)
+        return false;
+    uint64 base_time = reader.readVarint();
+    Vector3d origin;
+    origin.x = reader.readFloat();
+    origin.y = reader.readFloat();
+    origin.z = reader.readFloat();
+    float64 position_resolution = reader.readFloat();
+    float64 velocity_resolution = reader.readFloat();
+    uint64 count = reader.readVarint();
+    if (reader.failed()) return false;
+
+    for(uint64 idx = 0; idx < count && !reader.failed(); idx++) {
+        mUpdates.push_back(CompactLocationUpdate());
+        CompactLocationUpdate& update = mUpdates.back();
+
+        update.object = reader.readUUID();
+        update.seqno = reader.readVarint();
+        uint32 fields = (uint32)reader.readVarint();
+        update.fields = fields & 0xFFFF;
+
+        if (fields & CompactLocationUpdate::Epoch)
+            update.epoch = reader.readVarint();
+        if (fields & CompactLocationUpdate::Parent)
+            update.parent = reader.readUUID();
+
+        if (fields & CompactLocationUpdate::Location) {
+            Time t = Time::null() + Duration::microseconds((int64)(base_time + reader.readZigZag()));
+            Vector3f pos, vel;
+            if (fields & LocationRaw) {
+                pos.x = reader.readFloat(); pos.y = reader.readFloat(); pos.z = reader.readFloat();
+                vel.x = reader.readFloat(); vel.y = reader.readFloat(); vel.z = reader.readFloat();
+            }
+            else {
+                pos.x = (float32)(origin.x + reader.readZigZag() * position_resolution);
+                pos.y = (float32)(origin.y + reader.readZigZag() * position_resolution);
+                pos.z = (float32)(origin.z + reader.readZigZag() * position_resolution);
+                vel.x = (float32)(reader.readZigZag() * velocity_resolution);
+                vel.y = (float32)(reader.readZigZag() * velocity_resolution);
+                vel.z = (float32)(reader.readZigZag() * velocity_resolution);
+            }
+            update.location = TimedMotionVector3f(t, MotionVector3f(pos, vel));
+        }
+
+        if (fields & CompactLocationUpdate::Orientation) {
+            Time t = Time::null() + Duration::microseconds((int64)(base_time + reader.readZigZag()));
+            Quaternion pos, vel;
+            if (fields & OrientationRaw) {
+                pos.x = reader.readFloat(); pos.y = reader.readFloat(); pos.z = reader.readFloat(); pos.w = reader.readFloat();
+                vel.x = reader.readFloat(); vel.y = reader.readFloat(); vel.z = reader.readFloat(); vel.w = reader.readFloat();
+            }
+            else {
+                pos = unpackQuaternion(reader.readFixed32());
+                vel = unpackQuaternion(reader.readFixed32());
+                vel *= reader.readFloat();
+            }
+            update.orientation = TimedMotionQuaternion(t, MotionQuaternion(pos, vel));
+        }
+
+        if (fields & CompactLocationUpdate::Bounds) {
+            Vector3f center;
+            center.x = reader.readFloat();
+            center.y = reader.readFloat();
+            center.z = reader.readFloat();
+            float32 center_rad = reader.readFloat();
+            float32 max_object_size = reader.readFloat();
+            update.bounds = AggregateBoundingInfo(center, center_rad, max_object_size);
+        }
+
+        if (fields & CompactLocationUpdate::Mesh)
+            update.mesh = reader.readString();
+        if (fields & CompactLocationUpdate::Physics)
+            update.physics = reader.readString();
+        if (fields & CompactLocationUpdate::QueryData)
+            update.query_data = reader.readString();
+
+        if (fields & CompactLocationUpdate::IndexIDs) {
+            uint64 nids = reader.readVarint();
+            for(uint64 i = 0; i < nids && !reader.failed(); i++)
+                update.index_ids.push_back((ProxIndexID)reader.readVarint());
+        }
+    }
+
+    if (reader.failed() || !reader.done()) {
+        mUpdates.clear();
+        return false;
+    }
+    return true;
+}
+
 } // namespace Sirikata
@@ -54,6 +54,9 @@ class ProxyManager;
 typedef std::tr1::shared_ptr<ProxyManager> ProxyManagerPtr;
 typedef std::tr1::weak_ptr<ProxyManager> ProxyManagerWPtr;
 
+class ProxyStateStore;
+typedef std::tr1::shared_ptr<ProxyStateStore> ProxyStateStorePtr;
+
 } // namespace Sirikata
 
 #endif //_SIRIKATA_PROXYOBJECT_DEFS_HPP_
@@ -53,13 +53,24 @@ class SIRIKATA_PROXYOBJECT_EXPORT ProxyManager
 public:
     typedef std::vector<SpaceObjectReference> ObjectReferenceList;
 
-    static ProxyManagerPtr construct(VWObjectPtr parent, const SpaceObjectReference& _id);
+    /** Construct a ProxyManager for a presence.
+     *  \param parent the object owning the presence
+     *  \param _id the presence
+     *  \param store where the proxies' properties are kept. Sharing one store
+     *         between all presences on an object host avoids keeping a copy of
+     *         every object's properties per presence that sees it. If NULL,
+     *         this ProxyManager uses a store of its own.
+     */
+    static ProxyManagerPtr construct(VWObjectPtr parent, const SpaceObjectReference& _id, ProxyStateStorePtr store = ProxyStateStorePtr());
     virtual ~ProxyManager();
 
     const SpaceObjectReference& id() const { return mID; }
 
     VWObjectPtr parent() const { return mParent; }
 
+    /// Get the store holding the properties of this ProxyManager's proxies
+    const ProxyStateStorePtr& stateStore() const { return mStateStore; }
+
     ///Called after providers attached
     virtual void initialize();
     ///Called before providers detatched
@@ -95,7 +106,7 @@ public:
 private:
     friend class ProxyObject;
 
-    ProxyManager(VWObjectPtr parent, const SpaceObjectReference& _id);
+    ProxyManager(VWObjectPtr parent, const SpaceObjectReference& _id, ProxyStateStorePtr store);
 
     // These track the *entire* lifetime of ProxyObjects. This allows
     // clients of ProxyManager to hold onto ProxyObjects beyond when
@@ -112,6 +123,8 @@ private:
     VWObjectPtr mParent;
     // Presence identifier that runs this ProxyManager
     SpaceObjectReference mID;
+    // Shared by the ProxyObjects, which keep a reference to it through us
+    ProxyStateStorePtr mStateStore;
 
     struct ProxyData {
         ProxyData(ProxyObjectPtr p)
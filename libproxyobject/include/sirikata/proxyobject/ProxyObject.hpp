@@ -51,6 +51,7 @@
 
 #include <sirikata/core/util/PresenceProperties.hpp>
 #include <sirikata/proxyobject/ProxyManager.hpp>
+#include <sirikata/proxyobject/ProxyStateStore.hpp>
 
 #include <sirikata/core/util/SerializationCheck.hpp>
 #include <boost/functional/hash.hpp>
@@ -97,12 +98,19 @@ public:
  * that this *always* represents the current reported status of the
  * object in the space, even if you own the presence.
  *
+ * The property values themselves live in the owning ProxyManager's
+ * ProxyStateStore, which is usually shared with the other presences on the
+ * object host, so each ProxyObject only tracks the sequence numbers of the
+ * updates its presence has seen. An update this presence accepts can still be
+ * older than one another presence already stored, in which case the newer
+ * shared value is kept and reported to listeners.
+ *
  * Note that this class is *not* thread safe. You need to protect it by locking
  * a mutex from the ProxyManager or HostedObject while accessing it.
  */
 class SIRIKATA_PROXYOBJECT_EXPORT ProxyObject
     : public SelfWeakPtr<ProxyObject>,
-      public SequencedPresenceProperties,
+      public virtual IPresencePropertiesRead,
       public ProxyObjectProvider,
       public PositionProvider,
       public MeshProvider,
@@ -120,10 +128,21 @@ public:
     };
     typedef TimedWeightedExtrapolator<Location,UpdateNeeded> Extrapolator;
 
+    typedef SequencedPresenceProperties::LOC_PARTS LOC_PARTS;
+
 private:
     bool mValid;
     const SpaceObjectReference mID;
     ProxyManagerPtr mParent;
+    ProxyStateStore::State* mState;
+    uint64 mUpdateSeqno[SequencedPresenceProperties::LOC_NUM_PART];
+    // Latest location or orientation update time we've accepted, used to
+    // order our updates to the other parts in the shared state
+    Time mEpoch;
+
+    // Checks the sequence number for an update against the latest one this
+    // proxy has seen, returning false if the update is stale
+    bool acceptUpdate(LOC_PARTS whichPart, uint64 seqno);
 
 public:
     /** Constructs a new ProxyObject. After constructing this object, it
@@ -183,7 +202,9 @@ public:
     virtual AggregateBoundingInfo bounds() const;
     virtual Transfer::URI mesh() const;
     virtual String physics() const;
+    virtual String queryData() const;
     virtual bool isAggregate() const;
+    virtual ObjectReference parent() const;
     virtual ObjectReference parentAggregate() const;
 
     // Alternatives that access only the *verified* location information,
@@ -193,6 +214,11 @@ public:
     AggregateBoundingInfo verifiedBounds() const;
     Transfer::URI verifiedMesh() const;
     String verifiedPhysics() const;
+    bool verifiedIsAggregate() const;
+
+    /// Get the sequence number of the latest update this proxy accepted for
+    /// the given part
+    uint64 getUpdateSeqNo(LOC_PARTS whichPart) const;
 
     void setLocation(const TimedMotionVector3f& reqloc, uint64 seqno);
     void setOrientation(const TimedMotionQuaternion& reqorient, uint64 seqno);
@@ -0,0 +1,100 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_PROXYOBJECT_PROXY_STATE_STORE_HPP_
+#define _SIRIKATA_PROXYOBJECT_PROXY_STATE_STORE_HPP_
+
+#include <sirikata/proxyobject/Platform.hpp>
+#include <sirikata/proxyobject/Defs.hpp>
+#include <sirikata/core/util/PresenceProperties.hpp>
+#include <sirikata/core/util/SpaceObjectReference.hpp>
+#include <sirikata/core/util/Noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Sirikata {
+
+/** Holds the properties reported by the space for remote objects, shared
+ *  between every ProxyObject for the same object. Many presences on one object
+ *  host usually see the same objects, so rather than each of their
+ *  ProxyManagers keeping a full copy of every object's location, mesh, etc.,
+ *  their ProxyObjects all refer to a single State here. Each ProxyObject still
+ *  tracks its own sequence numbers, since each presence gets its own stream of
+ *  updates.
+ *
+ *  Sequence numbers from different presences can't be compared, so the State
+ *  orders updates itself: location and orientation by their update times, and
+ *  the other parts by an epoch, the latest location or orientation update time
+ *  the reporting presence had seen. A presence that lags behind the others
+ *  can't replace a newer value with an older one.
+ *
+ *  States are reference counted and removed once the last ProxyObject using
+ *  them is gone. The store is safe to use from multiple threads, and each
+ *  State has a mutex which must be held while accessing its properties.
+ */
+class SIRIKATA_PROXYOBJECT_EXPORT ProxyStateStore : public Noncopyable {
+public:
+    class State : public Noncopyable {
+    public:
+        const SpaceObjectReference& id() const { return mID; }
+
+        typedef boost::mutex Mutex;
+        typedef boost::lock_guard<Mutex> Lock;
+        Mutex mutex;
+        // Protected by mutex. Read directly, but only modify through the
+        // update methods below so updates stay ordered.
+        PresenceProperties props;
+
+        /** Replace a part of props if the update is at least as new as the
+         *  current value. The mutex must be held.
+         *  \returns true if the value was replaced
+         */
+        bool updateLocation(const TimedMotionVector3f& loc);
+        bool updateOrientation(const TimedMotionQuaternion& orient);
+        bool updateBounds(const AggregateBoundingInfo& bnds, const Time& epoch);
+        bool updateMesh(const Transfer::URI& mesh, const Time& epoch);
+        bool updatePhysics(const String& phy, const Time& epoch);
+        bool updateIsAggregate(bool isAgg, const Time& epoch);
+    private:
+        friend class ProxyStateStore;
+
+        State(const SpaceObjectReference& id);
+
+        // Checks and records the epoch for an update to an untimed part
+        bool acceptEpoch(SequencedPresenceProperties::LOC_PARTS whichPart, const Time& epoch);
+
+        const SpaceObjectReference mID;
+        // Protected by mutex
+        Time mEpoch[SequencedPresenceProperties::LOC_NUM_PART];
+        // Protected by the store's mutex
+        uint32 mRefCount;
+    };
+
+    ProxyStateStore();
+    ~ProxyStateStore();
+
+    /** Get the State for the object, creating it if necessary. Every call must
+     *  be matched by a call to release.
+     */
+    State* acquire(const SpaceObjectReference& id);
+    void release(State* state);
+
+    /// Number of objects with state in the store
+    uint32 size() const;
+    /// Number of outstanding references to states, i.e. number of
+    /// ProxyObjects using the store
+    uint64 references() const;
+
+private:
+    typedef boost::mutex Mutex;
+    typedef boost::lock_guard<Mutex> Lock;
+    mutable Mutex mMutex;
+
+    typedef std::tr1::unordered_map<SpaceObjectReference, State*, SpaceObjectReference::Hasher> StateMap;
+    StateMap mStates;
+    uint64 mReferences;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_PROXYOBJECT_PROXY_STATE_STORE_HPP_
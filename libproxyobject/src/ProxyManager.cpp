@@ -34,6 +34,7 @@
 #include <sirikata/core/util/SpaceObjectReference.hpp>
 #include <sirikata/proxyobject/ProxyManager.hpp>
 #include <sirikata/proxyobject/ProxyObject.hpp>
+#include <sirikata/proxyobject/ProxyStateStore.hpp>
 
 // Helper for checking serialization of data access to a ProxyManager. These
 // don't necessarily cover all conflicts or uses, they just cover many parts of
@@ -44,14 +45,15 @@
 
 namespace Sirikata {
 
-ProxyManagerPtr ProxyManager::construct(VWObjectPtr parent, const SpaceObjectReference& _id) {
-    ProxyManagerPtr res(SelfWeakPtr<ProxyManager>::internalConstruct(new ProxyManager(parent, _id)));
+ProxyManagerPtr ProxyManager::construct(VWObjectPtr parent, const SpaceObjectReference& _id, ProxyStateStorePtr store) {
+    ProxyManagerPtr res(SelfWeakPtr<ProxyManager>::internalConstruct(new ProxyManager(parent, _id, store)));
     return res;
 }
 
-ProxyManager::ProxyManager(VWObjectPtr parent, const SpaceObjectReference& _id)
+ProxyManager::ProxyManager(VWObjectPtr parent, const SpaceObjectReference& _id, ProxyStateStorePtr store)
  : mParent(parent),
    mID(_id),
+   mStateStore(store ? store : ProxyStateStorePtr(new ProxyStateStore())),
    mActiveCount(0)
 {}
 
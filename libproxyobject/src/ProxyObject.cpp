@@ -59,9 +59,12 @@ ProxyObject::ProxyObject(ProxyManagerPtr man, const SpaceObjectReference& id)
      MeshProvider (),
      mValid(true),
      mID(id),
-     mParent(man)
+     mParent(man),
+     mState(NULL),
+     mEpoch(Time::null())
 {
     assert(mParent);
+    mState = mParent->stateStore()->acquire(mID);
 
     reset();
     // Validate is forced in ProxyObject::construct
@@ -70,10 +73,30 @@ ProxyObject::ProxyObject(ProxyManagerPtr man, const SpaceObjectReference& id)
 
 ProxyObject::~ProxyObject() {
     mParent->proxyDeleted(mID.object());
+    mParent->stateStore()->release(mState);
 }
 
 void ProxyObject::reset() {
-    SequencedPresenceProperties::reset();
+    // Only our view of the update stream is reset. The values stay, they're
+    // still the latest we know of and may be shared with other presences.
+    memset(mUpdateSeqno, 0, SequencedPresenceProperties::LOC_NUM_PART * sizeof(uint64));
+    mEpoch = Time::null();
+}
+
+bool ProxyObject::acceptUpdate(LOC_PARTS whichPart, uint64 seqno) {
+    if (seqno < mUpdateSeqno[whichPart])
+        return false;
+    mUpdateSeqno[whichPart] = seqno;
+    return true;
+}
+
+uint64 ProxyObject::getUpdateSeqNo(LOC_PARTS whichPart) const {
+    PROXY_SERIALIZED();
+    if (whichPart >= SequencedPresenceProperties::LOC_NUM_PART) {
+        SILOG(proxyobject, error, "Error in getUpdateSeqNo of proxy.  Requesting an update sequence number for a field that does not exist.  Returning 0");
+        return 0;
+    }
+    return mUpdateSeqno[whichPart];
 }
 
 void ProxyObject::validate() {
@@ -108,162 +131,246 @@ bool ProxyObject::UpdateNeeded::operator() (
 
 bool ProxyObject::isStatic() const {
     PROXY_SERIALIZED();
-    return mLoc.velocity() == Vector3f::zero() && mOrientation.velocity() == Quaternion::identity();
+    ProxyStateStore::State::Lock lck(mState->mutex);
+    return mState->props.location().velocity() == Vector3f::zero() && mState->props.orientation().velocity() == Quaternion::identity();
 }
 
 
 TimedMotionVector3f ProxyObject::location() const{
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::location();
+        return verifiedLocation();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_POS_PART))
-        return SequencedPresenceProperties::location();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_POS_PART))
+        return verifiedLocation();
     return req->location();
 }
 
 TimedMotionQuaternion ProxyObject::orientation() const {
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::orientation();
+        return verifiedOrientation();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_ORIENT_PART))
-        return SequencedPresenceProperties::orientation();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_ORIENT_PART))
+        return verifiedOrientation();
     return req->orientation();
 }
 
 AggregateBoundingInfo ProxyObject::bounds() const {
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::bounds();
+        return verifiedBounds();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_BOUNDS_PART))
-        return SequencedPresenceProperties::bounds();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_BOUNDS_PART))
+        return verifiedBounds();
     return req->bounds();
 }
 
 Transfer::URI ProxyObject::mesh() const {
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::mesh();
+        return verifiedMesh();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_MESH_PART))
-        return SequencedPresenceProperties::mesh();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_MESH_PART))
+        return verifiedMesh();
     return req->mesh();
 }
 
 String ProxyObject::physics() const {
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::physics();
+        return verifiedPhysics();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_PHYSICS_PART))
-        return SequencedPresenceProperties::physics();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_PHYSICS_PART))
+        return verifiedPhysics();
     return req->physics();
 }
 
 bool ProxyObject::isAggregate() const {
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::isAggregate();
+        return verifiedIsAggregate();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_IS_AGG_PART))
-        return SequencedPresenceProperties::isAggregate();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_IS_AGG_PART))
+        return verifiedIsAggregate();
     return req->isAggregate();
 }
 
-ObjectReference ProxyObject::parentAggregate() const {
+String ProxyObject::queryData() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::parent();
+    ProxyStateStore::State::Lock lck(mState->mutex);
+    return mState->props.queryData();
+}
+
+ObjectReference ProxyObject::parent() const {
+    PROXY_SERIALIZED();
+    ProxyStateStore::State::Lock lck(mState->mutex);
+    return mState->props.parent();
+}
+
+ObjectReference ProxyObject::parentAggregate() const {
+    return parent();
 }
 
 TimedMotionVector3f ProxyObject::verifiedLocation() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::location();
+    ProxyStateStore::State::Lock lck(mState->mutex);
+    return mState->props.location();
 }
 
 TimedMotionQuaternion ProxyObject::verifiedOrientation() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::orientation();
+    ProxyStateStore::State::Lock lck(mState->mutex);
+    return mState->props.orientation();
 }
 
 AggregateBoundingInfo ProxyObject::verifiedBounds() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::bounds();
+    ProxyStateStore::State::Lock lck(mState->mutex);
+    return mState->props.bounds();
 }
 
 Transfer::URI ProxyObject::verifiedMesh() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::mesh();
+    ProxyStateStore::State::Lock lck(mState->mutex);
+    return mState->props.mesh();
 }
 
 String ProxyObject::verifiedPhysics() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::physics();
+    ProxyStateStore::State::Lock lck(mState->mutex);
+    return mState->props.physics();
 }
 
+bool ProxyObject::verifiedIsAggregate() const {
+    PROXY_SERIALIZED();
+    ProxyStateStore::State::Lock lck(mState->mutex);
+    return mState->props.isAggregate();
+}
 
 
+
+// The shared state only takes an update if it's newer than what another
+// presence already reported, so listeners are always given the shared values,
+// read along with the rest of the location while holding its lock, and notified
+// after releasing it.
+
 void ProxyObject::setLocation(const TimedMotionVector3f& reqloc, uint64 seqno) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setLocation(reqloc, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        PositionProvider::notify(&PositionListener::updateLocation, ptr, mLoc, mOrientation, mBounds, mID);
+    if (!acceptUpdate(SequencedPresenceProperties::LOC_POS_PART, seqno))
+        return;
+    mEpoch = std::max(mEpoch, reqloc.updateTime());
+
+    TimedMotionVector3f loc;
+    TimedMotionQuaternion orient;
+    AggregateBoundingInfo bnds;
+    {
+        ProxyStateStore::State::Lock lck(mState->mutex);
+        mState->updateLocation(reqloc);
+        loc = mState->props.location();
+        orient = mState->props.orientation();
+        bnds = mState->props.bounds();
     }
+    ProxyObjectPtr ptr = getSharedPtr();
+    assert(ptr);
+    PositionProvider::notify(&PositionListener::updateLocation, ptr, loc, orient, bnds, mID);
 }
 
 void ProxyObject::setOrientation(const TimedMotionQuaternion& reqorient, uint64 seqno) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setOrientation(reqorient, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        PositionProvider::notify(&PositionListener::updateLocation, ptr, mLoc, mOrientation, mBounds, mID);
+    if (!acceptUpdate(SequencedPresenceProperties::LOC_ORIENT_PART, seqno))
+        return;
+    mEpoch = std::max(mEpoch, reqorient.updateTime());
+
+    TimedMotionVector3f loc;
+    TimedMotionQuaternion orient;
+    AggregateBoundingInfo bnds;
+    {
+        ProxyStateStore::State::Lock lck(mState->mutex);
+        mState->updateOrientation(reqorient);
+        loc = mState->props.location();
+        orient = mState->props.orientation();
+        bnds = mState->props.bounds();
     }
+    ProxyObjectPtr ptr = getSharedPtr();
+    assert(ptr);
+    PositionProvider::notify(&PositionListener::updateLocation, ptr, loc, orient, bnds, mID);
 }
 
-void ProxyObject::setBounds(const AggregateBoundingInfo& bnds, uint64 seqno) {
+void ProxyObject::setBounds(const AggregateBoundingInfo& reqbnds, uint64 seqno) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setBounds(bnds, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        PositionProvider::notify(&PositionListener::updateLocation, ptr, mLoc, mOrientation, mBounds, mID);
-        MeshProvider::notify (&MeshListener::onSetScale, ptr, mBounds.fullRadius(), mID);
+    if (!acceptUpdate(SequencedPresenceProperties::LOC_BOUNDS_PART, seqno))
+        return;
+
+    TimedMotionVector3f loc;
+    TimedMotionQuaternion orient;
+    AggregateBoundingInfo bnds;
+    {
+        ProxyStateStore::State::Lock lck(mState->mutex);
+        mState->updateBounds(reqbnds, mEpoch);
+        loc = mState->props.location();
+        orient = mState->props.orientation();
+        bnds = mState->props.bounds();
     }
+    ProxyObjectPtr ptr = getSharedPtr();
+    assert(ptr);
+    PositionProvider::notify(&PositionListener::updateLocation, ptr, loc, orient, bnds, mID);
+    MeshProvider::notify (&MeshListener::onSetScale, ptr, bnds.fullRadius(), mID);
 }
 
 //you can set a camera's mesh as of now.
-void ProxyObject::setMesh (Transfer::URI const& mesh, uint64 seqno) {
+void ProxyObject::setMesh (Transfer::URI const& reqmesh, uint64 seqno) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setMesh(mesh, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        if (ptr) MeshProvider::notify ( &MeshListener::onSetMesh, ptr, mesh, mID);
+    if (!acceptUpdate(SequencedPresenceProperties::LOC_MESH_PART, seqno))
+        return;
+
+    Transfer::URI mesh;
+    {
+        ProxyStateStore::State::Lock lck(mState->mutex);
+        mState->updateMesh(reqmesh, mEpoch);
+        mesh = mState->props.mesh();
     }
+    ProxyObjectPtr ptr = getSharedPtr();
+    assert(ptr);
+    if (ptr) MeshProvider::notify ( &MeshListener::onSetMesh, ptr, mesh, mID);
 }
 
 void ProxyObject::setPhysics (const String& rhs, uint64 seqno) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setPhysics(rhs, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        if (ptr) MeshProvider::notify ( &MeshListener::onSetPhysics, ptr, rhs, mID);
+    if (!acceptUpdate(SequencedPresenceProperties::LOC_PHYSICS_PART, seqno))
+        return;
+
+    String phy;
+    {
+        ProxyStateStore::State::Lock lck(mState->mutex);
+        mState->updatePhysics(rhs, mEpoch);
+        phy = mState->props.physics();
     }
+    ProxyObjectPtr ptr = getSharedPtr();
+    assert(ptr);
+    if (ptr) MeshProvider::notify ( &MeshListener::onSetPhysics, ptr, phy, mID);
 }
 
-void ProxyObject::setIsAggregate(bool isAggregate, uint64 seqno) {
+void ProxyObject::setIsAggregate(bool reqIsAggregate, uint64 seqno) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setIsAggregate(isAggregate, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        if (ptr) MeshProvider::notify ( &MeshListener::onSetIsAggregate, ptr, isAggregate, mID);
+    if (!acceptUpdate(SequencedPresenceProperties::LOC_IS_AGG_PART, seqno))
+        return;
+
+    bool isAggregate;
+    {
+        ProxyStateStore::State::Lock lck(mState->mutex);
+        mState->updateIsAggregate(reqIsAggregate, mEpoch);
+        isAggregate = mState->props.isAggregate();
     }
+    ProxyObjectPtr ptr = getSharedPtr();
+    assert(ptr);
+    if (ptr) MeshProvider::notify ( &MeshListener::onSetIsAggregate, ptr, isAggregate, mID);
 }
 
 }
@@ -0,0 +1,109 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/proxyobject/Platform.hpp>
+#include <sirikata/proxyobject/ProxyStateStore.hpp>
+
+namespace Sirikata {
+
+ProxyStateStore::State::State(const SpaceObjectReference& id)
+ : mID(id), mRefCount(0)
+{
+    for(int i = 0; i < SequencedPresenceProperties::LOC_NUM_PART; i++)
+        mEpoch[i] = Time::null();
+}
+
+bool ProxyStateStore::State::acceptEpoch(SequencedPresenceProperties::LOC_PARTS whichPart, const Time& epoch) {
+    if (epoch < mEpoch[whichPart])
+        return false;
+    mEpoch[whichPart] = epoch;
+    return true;
+}
+
+bool ProxyStateStore::State::updateLocation(const TimedMotionVector3f& loc) {
+    if (loc.updateTime() < props.location().updateTime())
+        return false;
+    return props.setLocation(loc);
+}
+
+bool ProxyStateStore::State::updateOrientation(const TimedMotionQuaternion& orient) {
+    if (orient.updateTime() < props.orientation().updateTime())
+        return false;
+    return props.setOrientation(orient);
+}
+
+bool ProxyStateStore::State::updateBounds(const AggregateBoundingInfo& bnds, const Time& epoch) {
+    if (!acceptEpoch(SequencedPresenceProperties::LOC_BOUNDS_PART, epoch))
+        return false;
+    return props.setBounds(bnds);
+}
+
+bool ProxyStateStore::State::updateMesh(const Transfer::URI& mesh, const Time& epoch) {
+    if (!acceptEpoch(SequencedPresenceProperties::LOC_MESH_PART, epoch))
+        return false;
+    return props.setMesh(mesh);
+}
+
+bool ProxyStateStore::State::updatePhysics(const String& phy, const Time& epoch) {
+    if (!acceptEpoch(SequencedPresenceProperties::LOC_PHYSICS_PART, epoch))
+        return false;
+    return props.setPhysics(phy);
+}
+
+bool ProxyStateStore::State::updateIsAggregate(bool isAgg, const Time& epoch) {
+    if (!acceptEpoch(SequencedPresenceProperties::LOC_IS_AGG_PART, epoch))
+        return false;
+    return props.setIsAggregate(isAgg);
+}
+
+ProxyStateStore::ProxyStateStore()
+ : mReferences(0)
+{
+}
+
+ProxyStateStore::~ProxyStateStore() {
+    // ProxyManagers hold a reference to the store, so everything should have
+    // been released by now
+    if (!mStates.empty())
+        SILOG(proxyobject, error, "Destroying ProxyStateStore with " << mStates.size() << " objects still in use");
+    for(StateMap::iterator it = mStates.begin(); it != mStates.end(); it++)
+        delete it->second;
+    mStates.clear();
+}
+
+ProxyStateStore::State* ProxyStateStore::acquire(const SpaceObjectReference& id) {
+    Lock lck(mMutex);
+
+    StateMap::iterator it = mStates.find(id);
+    if (it == mStates.end())
+        it = mStates.insert( StateMap::value_type(id, new State(id)) ).first;
+    State* state = it->second;
+    state->mRefCount++;
+    mReferences++;
+    return state;
+}
+
+void ProxyStateStore::release(State* state) {
+    Lock lck(mMutex);
+
+    assert(state->mRefCount > 0);
+    mReferences--;
+    if (--state->mRefCount > 0)
+        return;
+
+    mStates.erase(state->id());
+    delete state;
+}
+
+uint32 ProxyStateStore::size() const {
+    Lock lck(mMutex);
+    return mStates.size();
+}
+
+uint64 ProxyStateStore::references() const {
+    Lock lck(mMutex);
+    return mReferences;
+}
+
+} // namespace Sirikata
@@ -20,6 +20,7 @@
 #include <sirikata/space/ObjectSessionManager.hpp>
 
 #include <sirikata/core/prox/Defs.hpp>
+#include <sirikata/pintoloc/LocUpdate.hpp>
 
 namespace Sirikata {
 
@@ -172,6 +173,14 @@ public:
     /** Unsubscribe remote for updates about all objects across all indices. */
     virtual void unsubscribe(const UUID& remote) = 0;
 
+
+    /** Request that updates to remote use the given encoding. Policies which
+     *  only support the full encoding can ignore this.
+     */
+    virtual void setEncoding(ServerID remote, LocUpdateEncoding encoding) {}
+    virtual void setEncoding(const OHDP::NodeID& remote, LocUpdateEncoding encoding) {}
+    virtual void setEncoding(const UUID& remote, LocUpdateEncoding encoding) {}
+
     virtual void service() = 0;
 
 protected:
@@ -272,6 +281,11 @@ public:
     /** Unsubscripe the given server from all its location subscriptions. */
     virtual void unsubscribe(const UUID& remote);
 
+    /** Set the encoding used for location updates sent to a subscriber. */
+    virtual void setUpdateEncoding(ServerID remote, LocUpdateEncoding encoding);
+    virtual void setUpdateEncoding(const OHDP::NodeID& remote, LocUpdateEncoding encoding);
+    virtual void setUpdateEncoding(const UUID& remote, LocUpdateEncoding encoding);
+
 
     /** MessageRecipient Interface. */
     virtual void receiveMessage(Message* msg) = 0;
@@ -0,0 +1,538 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_LIBSPACE_LOCATION_SUBSCRIPTION_INDEX_HPP_
+#define _SIRIKATA_LIBSPACE_LOCATION_SUBSCRIPTION_INDEX_HPP_
+
+#include <sirikata/space/Platform.hpp>
+#include <sirikata/core/util/UUID.hpp>
+#include <sirikata/core/util/MotionVector.hpp>
+#include <sirikata/core/util/MotionQuaternion.hpp>
+#include <sirikata/core/util/AggregateBoundingInfo.hpp>
+#include <sirikata/core/util/FlatHashMap.hpp>
+#include <sirikata/core/prox/Defs.hpp>
+#include <sirikata/core/network/IODefs.hpp>
+#include <sirikata/pintoloc/LocUpdate.hpp>
+
+#include <deque>
+
+// Subscribers with updates to build are spread over this many shards, which
+// are the unit of work when service() builds updates in parallel
+#define LOC_SUBSCRIPTION_SHARDS 16
+
+namespace Sirikata {
+
+/** Interns strings which many objects share, e.g. mesh URLs, so each distinct
+ *  value is stored once and objects only hold a small id. References are
+ *  counted so strings are dropped once no object uses them. Id 0 is always
+ *  the empty string and isn't counted.
+ *
+ *  Not thread safe, although get() may be called from multiple threads as
+ *  long as nothing is interned or released concurrently.
+ */
+class SIRIKATA_SPACE_EXPORT LocationStringTable {
+public:
+    LocationStringTable();
+
+    /** Get the id for a string, adding a reference to it. */
+    uint32 intern(const String& str);
+    /** Remove a reference added by intern(). */
+    void release(uint32 id);
+
+    const String& get(uint32 id) const {
+        return mEntries[id].str;
+    }
+
+    /// Number of distinct non-empty strings currently interned
+    uint32 size() const {
+        return mIDs.size();
+    }
+
+private:
+    struct Entry {
+        Entry() : refs(0) {}
+        String str;
+        uint32 refs;
+    };
+
+    std::vector<Entry> mEntries;
+    std::vector<uint32> mFreeEntries;
+    FlatHashMap<String, uint32> mIDs;
+};
+
+/** Latest location information for an object. An index keeps one copy per
+ *  object, shared by all its subscribers, rather than one per subscriber.
+ *
+ *  Properties should be modified through the setters, which track the
+ *  version each property last changed in. Subscribers using the compact
+ *  encoding remember the version they were last sent, so only properties
+ *  which changed since then need to be sent to them. The mesh and physics
+ *  properties are ids in the index's LocationStringTable and are set by the
+ *  index itself. Query data is usually unique to each object, so it isn't
+ *  interned.
+ */
+struct SIRIKATA_SPACE_EXPORT LocationSubscriptionState {
+    enum Property {
+        Location,
+        Orientation,
+        Bounds,
+        Mesh,
+        Physics,
+        QueryData,
+        NumProperties
+    };
+
+    LocationSubscriptionState();
+
+    void setLocation(const TimedMotionVector3f& newval);
+    void setOrientation(const TimedMotionQuaternion& newval);
+    void setBounds(const AggregateBoundingInfo& newval);
+    void setQueryData(const String& newval);
+
+    /// Whether a property changed after the given version
+    bool changedSince(Property p, uint32 since) const {
+        return changed[p] > since;
+    }
+
+    uint64 epoch;
+    TimedMotionVector3f location;
+    TimedMotionQuaternion orientation;
+    AggregateBoundingInfo bounds;
+    uint32 mesh;
+    uint32 physics;
+    String query_data;
+
+    uint32 version;
+    uint32 changed[NumProperties];
+
+private:
+    friend class LocationSubscriptionIndexBase;
+
+    void touch(Property p) {
+        changed[p] = ++version;
+    }
+};
+
+struct LocationSubscriberInfo;
+
+/** An object in the reverse index: who is subscribed to it and the state to
+ *  send them.
+ */
+struct LocationSubscriptionObject {
+    LocationSubscriptionObject()
+     : pending(0)
+    {}
+
+    UUID uuid;
+    // Contiguous so fan-out of an update is a linear scan. Each subscriber
+    // records its position here for O(1) removal.
+    std::vector<LocationSubscriberInfo*> subscribers;
+    LocationSubscriptionState state;
+    // Number of subscribers with an update for this object queued. The
+    // object is only released once this drops to zero, so queued ids for it
+    // stay valid.
+    uint32 pending;
+};
+
+struct SIRIKATA_SPACE_EXPORT LocationSubscriberInfo {
+    LocationSubscriberInfo(SeqNoPtr seq_number_ptr);
+    virtual ~LocationSubscriberInfo();
+
+    typedef std::set<ProxIndexID> ProxIndexSet;
+    struct Subscription {
+        Subscription()
+         : subscribed(false), queued(false), slot(0), sentVersion(0), buildVersion(0)
+        {}
+        // Indexes this subscriber is observing the object in. Empty if
+        // indexes aren't being used (no tree replication).
+        ProxIndexSet indexes;
+        // An entry can outlive its subscription while an update is queued
+        bool subscribed;
+        bool queued;
+        // Position in LocationSubscriptionObject::subscribers
+        uint32 slot;
+        // Version of the object's state this subscriber was last sent, or 0
+        // if it needs everything. Only used with the compact encoding.
+        uint32 sentVersion;
+        // Version of the state captured by the message being built, which
+        // becomes sentVersion if it's sent
+        uint32 buildVersion;
+    };
+    // Keyed by the index's id for the object
+    typedef FlatHashMap<uint32, Subscription> SubscriptionMap;
+
+    SeqNoPtr seqnoPtr;
+    SubscriptionMap subscriptions;
+    uint32 numSubscribed;
+    // Ids of objects with an update queued for this subscriber, oldest first
+    std::vector<uint32> outstandingUpdates;
+
+    LocUpdateEncoding encoding;
+    // Origin positions are quantized relative to in compact updates. It
+    // follows the objects being sent so offsets stay small.
+    Vector3f frameOrigin;
+    bool hasFrameOrigin;
+    // Set when an update may have been lost, so the next compact updates
+    // must include everything
+    bool resync;
+
+    // Position in the index's list of subscribers
+    uint32 registrySlot;
+
+    // Indicates that there are no subscriptions for this object left,
+    // allowing us to clear out its entry. Subscribers which asked for a
+    // non-default encoding are kept since the request is usually made before
+    // the first subscription and will be followed by more.
+    bool noSubscriptionsLeft() const {
+        return numSubscribed == 0 && encoding == LocUpdateEncodingFull;
+    }
+};
+typedef std::tr1::shared_ptr<LocationSubscriberInfo> LocationSubscriberInfoPtr;
+
+/** The LocationService accessors an index reads object state from. See
+ *  LocationSourceAdapter for wrapping anything that provides them.
+ */
+class LocationSubscriptionSource {
+public:
+    virtual ~LocationSubscriptionSource() {}
+
+    virtual uint64 epoch(const UUID& uuid) = 0;
+    virtual TimedMotionVector3f location(const UUID& uuid) = 0;
+    virtual TimedMotionQuaternion orientation(const UUID& uuid) = 0;
+    virtual AggregateBoundingInfo bounds(const UUID& uuid) = 0;
+    virtual const String& mesh(const UUID& uuid) = 0;
+    virtual const String& physics(const UUID& uuid) = 0;
+    virtual const String& queryData(const UUID& uuid) = 0;
+};
+
+template<typename LocationSource>
+class LocationSourceAdapter : public LocationSubscriptionSource {
+public:
+    LocationSourceAdapter(LocationSource* source)
+     : mSource(source)
+    {}
+
+    virtual uint64 epoch(const UUID& uuid) { return mSource->epoch(uuid); }
+    virtual TimedMotionVector3f location(const UUID& uuid) { return mSource->location(uuid); }
+    virtual TimedMotionQuaternion orientation(const UUID& uuid) { return mSource->orientation(uuid); }
+    virtual AggregateBoundingInfo bounds(const UUID& uuid) { return mSource->bounds(uuid); }
+    virtual const String& mesh(const UUID& uuid) { return mSource->mesh(uuid); }
+    virtual const String& physics(const UUID& uuid) { return mSource->physics(uuid); }
+    virtual const String& queryData(const UUID& uuid) { return mSource->queryData(uuid); }
+
+private:
+    LocationSource* mSource;
+};
+
+
+/** Runs service()'s per-shard jobs on an existing IOService, normally the
+ *  space's, whose worker threads pick them up. The calling thread claims
+ *  jobs too and only waits for jobs already running elsewhere, so it never
+ *  blocks on the IOService having a free thread. With a parallelism of 0,
+ *  all jobs run on the calling thread.
+ */
+class SIRIKATA_SPACE_EXPORT LocationSubscriptionWorkers {
+public:
+    LocationSubscriptionWorkers(Network::IOService* service, uint32 parallelism);
+
+    /** Run all the jobs, returning once they have all completed. */
+    void run(const std::vector<Network::IOCallback>& jobs);
+
+private:
+    Network::IOService* mService;
+    uint32 mParallelism;
+};
+
+
+/** Tracks which subscribers are observing which objects and queues location
+ *  updates for them, then batches queued updates into BulkLocationUpdates,
+ *  or CompactBulkLocationUpdates for subscribers which asked for them.
+ *
+ *  This holds everything that doesn't depend on the type of subscriber.
+ *  LocationSubscriptionIndex maps subscriber ids to LocationSubscriberInfos
+ *  and implements the hooks by calling its parent.
+ *
+ *  Except for the parallel part of service(), which only reads the index,
+ *  all methods must be called from a single thread.
+ */
+class SIRIKATA_SPACE_EXPORT LocationSubscriptionIndexBase {
+public:
+    typedef LocationSubscriberInfo SubscriberInfo;
+    typedef LocationSubscriberInfoPtr SubscriberInfoPtr;
+    typedef LocationSubscriptionState UpdateInfo;
+
+    // Sometimes a subscriber may stall or hang, leaving the underlying
+    // connection open but not handling loc update substreams. In this
+    // case, we can end up generating a ton of update streams that fail
+    // and eat up a bunch of our processor just looping for
+    // retries. With objects moving, we could get arbitarily many
+    // outstanding updates since once the substream request is started
+    // it frees up the spot in the outstanding updates, allowing more
+    // for the same object to be sent. To protect against this, we
+    // track how many loc update messages are outstanding and stall
+    // updates while we're waiting for them to return (or fail!).
+    static long numOutstandingMessages(const SubscriberInfoPtr& sub_info) {
+        return sub_info.use_count()-1;
+    }
+
+    /** Record that a message to the subscriber was lost. Compact updates
+     *  only carry changes, so this forces the next ones to be complete.
+     */
+    static void updateLost(const SubscriberInfoPtr& sub_info) {
+        sub_info->resync = true;
+    }
+
+    /** \param include_all_data Some data (really just query_data) about
+     *  objects is not useful in some cases, and could potentially be very
+     *  wasteful to send -- e.g. objects should really never need it, but we
+     *  may need to send updates for it to other consumers, e.g. servers
+     *  receiving replicated objects which they need to perform queries over.
+     */
+    LocationSubscriptionIndexBase(bool include_all_data, AtomicValue<uint32>& _sent_count);
+    virtual ~LocationSubscriptionIndexBase();
+
+    /** Set the resolution positions and velocities are quantized to in
+     *  compact updates.
+     */
+    void setCompactResolution(float32 position, float32 velocity);
+
+    // Update the shared state for an object and queue an update for each of
+    // its subscribers
+    void locationUpdated(const UUID& uuid, const TimedMotionVector3f& newval, LocationSubscriptionSource* locservice);
+    void orientationUpdated(const UUID& uuid, const TimedMotionQuaternion& newval, LocationSubscriptionSource* locservice);
+    void boundsUpdated(const UUID& uuid, const AggregateBoundingInfo& newval, LocationSubscriptionSource* locservice);
+    void meshUpdated(const UUID& uuid, const String& newval, LocationSubscriptionSource* locservice);
+    void physicsUpdated(const UUID& uuid, const String& newval, LocationSubscriptionSource* locservice);
+    void queryDataUpdated(const UUID& uuid, const String& newval, LocationSubscriptionSource* locservice);
+
+    /** Batch queued updates into BulkLocationUpdates of up to max_updates
+     *  entries and send them. Building and serializing the messages is split
+     *  by shard across workers, then the results are sent from the calling
+     *  thread.
+     */
+    void service(uint32 max_updates, LocationSubscriptionWorkers* workers);
+
+    /// Number of subscribers
+    uint32 numSubscribers() const {
+        return mSubscribers.size();
+    }
+    /// Number of objects with subscribers or queued updates
+    uint32 numObjects() const {
+        return mObjectIDs.size();
+    }
+    /// Number of distinct mesh and physics strings held for those objects
+    uint32 numStrings() const {
+        return mStrings.size();
+    }
+
+protected:
+    // Hooks for the subscriber type specific part of the index.
+    virtual bool validSubscriber(SubscriberInfo* sub_info) = 0;
+    // Called while building messages, possibly from worker threads
+    virtual bool isSelfSubscriber(const SubscriberInfo* sub_info, const UUID& observed) = 0;
+    virtual bool trySend(const SubscriberInfoPtr& sub_info, const String& serialized_blu) = 0;
+    // The subscriber is about to be removed from the index
+    virtual void subscriberRemoved(SubscriberInfo* sub_info) = 0;
+
+    /** Take ownership of a new subscriber. */
+    void addSubscriber(const SubscriberInfoPtr& sub_info);
+    void setSubscriberEncoding(SubscriberInfo* sub_info, LocUpdateEncoding encoding);
+    void addSubscription(SubscriberInfo* sub_info, const UUID& uuid, ProxIndexID* index_id, LocationSubscriptionSource* locservice);
+    void removeSubscription(SubscriberInfo* sub_info, const UUID& uuid, ProxIndexID* index_id);
+    void removeAllSubscriptions(SubscriberInfo* sub_info);
+
+private:
+    static const long outstanding_message_soft_limit = 25;
+
+    // Work for one subscriber during service()
+    struct Job {
+        SubscriberInfoPtr sub_info;
+        long max_messages;
+        // Serialized BulkLocationUpdates, and the number of queued updates
+        // covered by each message and the ones before it
+        std::vector<String> messages;
+        std::vector<uint32> message_ends;
+    };
+    typedef std::list<Job> JobList;
+
+    typedef FlatHashMap<UUID, uint32, UUID::Hasher> ObjectIDMap;
+
+    void removeSubscriber(SubscriberInfo* sub_info);
+    void maybeRemoveSubscriber(SubscriberInfo* sub_info);
+
+    uint32 acquireObject(const UUID& uuid);
+    void maybeReleaseObject(uint32 obj_id);
+
+    // Bring the shared state for an object up to date. Returns false if
+    // nobody is subscribed to it.
+    bool beginUpdate(const UUID& uuid, LocationSubscriptionSource* locservice, uint32* obj_id_out);
+    void refreshState(uint32 obj_id, LocationSubscriptionSource* locservice);
+    void setString(LocationSubscriptionState& ui, uint32& field, LocationSubscriptionState::Property prop, const String& newval);
+    void queueUpdates(uint32 obj_id);
+
+    void resyncSubscriber(SubscriberInfo* sub_info);
+    void queueUpdate(SubscriberInfo* sub_info, SubscriberInfo::Subscription& subscription, uint32 obj_id);
+    void dropSubscription(SubscriberInfo* sub_info, SubscriberInfo::SubscriptionMap::iterator subscription_it);
+    void detach(SubscriberInfo* sub_info, uint32 obj_id, uint32 slot);
+    void releaseQueued(uint32 obj_id);
+    void releaseSent(SubscriberInfo* sub_info, uint32 count, bool delivered);
+
+    void buildShard(uint32 shard, uint32 max_updates);
+    void buildMessages(Job& job, uint32 max_updates);
+    void buildCompactMessages(Job& job, uint32 max_updates);
+
+    const bool send_all_data;
+    AtomicValue<uint32>& sent_count;
+    float32 compact_position_resolution;
+    float32 compact_velocity_resolution;
+
+    // Forward index: Subscriber -> Objects + Updates. This list owns the
+    // subscribers, so numOutstandingMessages() can count the other
+    // references to them.
+    std::vector<SubscriberInfoPtr> mSubscribers;
+    // Reverse index: Objects -> Subscribers + State. Objects are referred to
+    // by their position in mObjects, which never moves existing entries, and
+    // released positions are reused.
+    ObjectIDMap mObjectIDs;
+    std::deque<LocationSubscriptionObject> mObjects;
+    std::vector<uint32> mFreeObjects;
+    LocationStringTable mStrings;
+    // Per-shard work during service(), kept to reuse allocations
+    JobList mJobs[LOC_SUBSCRIPTION_SHARDS];
+};
+
+
+/** LocationSubscriptionIndex for a particular type of subscriber.
+ *
+ *  Parent must provide
+ *    bool validSubscriber(const SubscriberType&);
+ *    bool isSelfSubscriber(const SubscriberType&, const UUID& observed);
+ *    bool trySend(const SubscriberType&, const String& serialized_blu, const LocationSubscriberInfoPtr&);
+ *  and LocationSource the LocationService accessors epoch(), location(),
+ *  orientation(), bounds(), mesh(), physics() and queryData(). If service()
+ *  is given workers, isSelfSubscriber() must be safe to call from them.
+ */
+template<typename SubscriberType, typename Parent, typename LocationSource, typename SubscriberHasher = std::tr1::hash<SubscriberType> >
+class LocationSubscriptionIndex : public LocationSubscriptionIndexBase {
+public:
+    LocationSubscriptionIndex(Parent* p, bool include_all_data, AtomicValue<uint32>& _sent_count)
+     : LocationSubscriptionIndexBase(include_all_data, _sent_count),
+       parent(p)
+    {
+    }
+
+    /** Set the encoding to use for updates to a subscriber. This can be
+     *  called before the subscriber has any subscriptions.
+     */
+    void setEncoding(const SubscriberType& remote, LocUpdateEncoding encoding) {
+        SubscriberInfo* sub_info = lookup(remote, encoding != LocUpdateEncodingFull, SeqNoPtr());
+        if (sub_info != NULL)
+            setSubscriberEncoding(sub_info, encoding);
+    }
+
+    void subscribe(const SubscriberType& remote, const UUID& uuid, LocationSource* locservice, SeqNoPtr seqnoPtr) {
+        subscribe(remote, uuid, (ProxIndexID*)NULL, locservice, seqnoPtr);
+    }
+    void subscribe(const SubscriberType& remote, const UUID& uuid, ProxIndexID index_id, LocationSource* locservice, SeqNoPtr seqnoPtr) {
+        subscribe(remote, uuid, &index_id, locservice, seqnoPtr);
+    }
+    void subscribe(const SubscriberType& remote, const UUID& uuid, ProxIndexID* index_id, LocationSource* locservice, SeqNoPtr seqnoPtr) {
+        LocationSourceAdapter<LocationSource> source(locservice);
+        addSubscription(lookup(remote, true, seqnoPtr), uuid, index_id, &source);
+    }
+
+    void unsubscribe(const SubscriberType& remote, const UUID& uuid) {
+        unsubscribe(remote, uuid, (ProxIndexID*)NULL);
+    }
+    void unsubscribe(const SubscriberType& remote, const UUID& uuid, ProxIndexID index_id) {
+        unsubscribe(remote, uuid, &index_id);
+    }
+    void unsubscribe(const SubscriberType& remote, const UUID& uuid, ProxIndexID* index_id) {
+        SubscriberInfo* sub_info = lookup(remote, false, SeqNoPtr());
+        if (sub_info != NULL)
+            removeSubscription(sub_info, uuid, index_id);
+    }
+    void unsubscribe(const SubscriberType& remote) {
+        SubscriberInfo* sub_info = lookup(remote, false, SeqNoPtr());
+        if (sub_info != NULL)
+            removeAllSubscriptions(sub_info);
+    }
+
+    void locationUpdated(const UUID& uuid, const TimedMotionVector3f& newval, LocationSource* locservice) {
+        LocationSourceAdapter<LocationSource> source(locservice);
+        LocationSubscriptionIndexBase::locationUpdated(uuid, newval, &source);
+    }
+    void orientationUpdated(const UUID& uuid, const TimedMotionQuaternion& newval, LocationSource* locservice) {
+        LocationSourceAdapter<LocationSource> source(locservice);
+        LocationSubscriptionIndexBase::orientationUpdated(uuid, newval, &source);
+    }
+    void boundsUpdated(const UUID& uuid, const AggregateBoundingInfo& newval, LocationSource* locservice) {
+        LocationSourceAdapter<LocationSource> source(locservice);
+        LocationSubscriptionIndexBase::boundsUpdated(uuid, newval, &source);
+    }
+    void meshUpdated(const UUID& uuid, const String& newval, LocationSource* locservice) {
+        LocationSourceAdapter<LocationSource> source(locservice);
+        LocationSubscriptionIndexBase::meshUpdated(uuid, newval, &source);
+    }
+    void physicsUpdated(const UUID& uuid, const String& newval, LocationSource* locservice) {
+        LocationSourceAdapter<LocationSource> source(locservice);
+        LocationSubscriptionIndexBase::physicsUpdated(uuid, newval, &source);
+    }
+    void queryDataUpdated(const UUID& uuid, const String& newval, LocationSource* locservice) {
+        LocationSourceAdapter<LocationSource> source(locservice);
+        LocationSubscriptionIndexBase::queryDataUpdated(uuid, newval, &source);
+    }
+
+protected:
+    virtual bool validSubscriber(SubscriberInfo* sub_info) {
+        return parent->validSubscriber(subscriberID(sub_info));
+    }
+    virtual bool isSelfSubscriber(const SubscriberInfo* sub_info, const UUID& observed) {
+        return parent->isSelfSubscriber(subscriberID(sub_info), observed);
+    }
+    virtual bool trySend(const SubscriberInfoPtr& sub_info, const String& serialized_blu) {
+        return parent->trySend(subscriberID(sub_info.get()), serialized_blu, sub_info);
+    }
+    virtual void subscriberRemoved(SubscriberInfo* sub_info) {
+        mLookup.erase(subscriberID(sub_info));
+    }
+
+private:
+    struct Subscriber : public LocationSubscriberInfo {
+        Subscriber(const SubscriberType& _id, SeqNoPtr seqno)
+         : LocationSubscriberInfo(seqno),
+           id(_id)
+        {}
+        SubscriberType id;
+    };
+    typedef FlatHashMap<SubscriberType, SubscriberInfo*, SubscriberHasher> LookupMap;
+
+    static const SubscriberType& subscriberID(const SubscriberInfo* sub_info) {
+        return static_cast<const Subscriber*>(sub_info)->id;
+    }
+
+    SubscriberInfo* lookup(const SubscriberType& remote, bool create, SeqNoPtr seqnoPtr) {
+        typename LookupMap::iterator it = mLookup.find(remote);
+        if (it != mLookup.end()) {
+            // Entries created by setEncoding() don't have one yet
+            if (!it->second->seqnoPtr)
+                it->second->seqnoPtr = seqnoPtr;
+            return it->second;
+        }
+        if (!create)
+            return NULL;
+
+        Subscriber* sub_info = new Subscriber(remote, seqnoPtr);
+        mLookup.insert(typename LookupMap::value_type(remote, sub_info));
+        addSubscriber(SubscriberInfoPtr(sub_info));
+        return sub_info;
+    }
+
+    Parent* parent;
+    LookupMap mLookup;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_LIBSPACE_LOCATION_SUBSCRIPTION_INDEX_HPP_
@@ -166,6 +166,18 @@ public:
 
       
     virtual OSegEntry lookup(const UUID& obj_id) = 0;
+    /** Look up a set of objects at once. results is filled in parallel with
+     *  obj_ids: entries that could be resolved immediately are set, and null
+     *  entries will be reported through the lookup listener just like a
+     *  lookup() that returned null. Implementations should override this to
+     *  pipeline or batch requests to their backing store; the default just
+     *  issues an individual lookup() for each object.
+     */
+    virtual void lookupBatch(const std::vector<UUID>& obj_ids, std::vector<OSegEntry>* results) {
+        results->resize(obj_ids.size());
+        for(uint32 i = 0; i < obj_ids.size(); i++)
+            (*results)[i] = lookup(obj_ids[i]);
+    }
     virtual OSegEntry cacheLookup(const UUID& obj_id) = 0;
     virtual void migrateObject(const UUID& obj_id, const OSegEntry& new_server_id) = 0;
     virtual void addNewObject(const UUID& obj_id, float radius) = 0;
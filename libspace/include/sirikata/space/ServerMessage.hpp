@@ -105,6 +105,13 @@ public:
     bool serialize(Network::Chunk* result) const;
     static Message* deserialize(const Network::Chunk& wire);
 
+    // Appends this message to result as a Network::Frame, serializing
+    // directly into result's buffer. Used to pack several messages into one
+    // network write; the result can be split with Network::Frame::parse and
+    // each piece handed to deserialize.
+    bool serializeFramed(Network::Chunk* result) const;
+    static Message* deserialize(const uint8* data, uint32 size);
+
     // Deprecated. Remains for backwards compatibility.
     uint32 serializedSize() const;
     uint32 size() const { return serializedSize(); }
@@ -57,6 +57,7 @@ public:
     CREATE_TRACE_DECL(processOSegShutdownEvents, const Time &t, const ServerID& sID, const int& num_lookups, const int& num_on_this_server, const int& num_cache_hits, const int& num_craq_lookups, const int& num_time_elapsed_cache_eviction, const int& num_migration_not_complete_yet);
     CREATE_TRACE_DECL(osegCacheResponse, const Time &t, const ServerID& sID, const UUID& obj);
     CREATE_TRACE_DECL(osegCumulativeResponse, const Time &t, OSegLookupTraceToken* traceToken);
+    CREATE_TRACE_DECL(osegLookupLatency, const Time &t, const ServerID& sID, const std::vector<uint64>& bucket_bounds, const std::vector<uint64>& bucket_counts, uint64 batches, uint64 batched_lookups, uint64 not_found_hits);
 
     // Migration
     CREATE_TRACE_DECL(objectBeginMigrate, const Time& t, const UUID& ojb_id, const ServerID migrate_from, const ServerID migrate_to);
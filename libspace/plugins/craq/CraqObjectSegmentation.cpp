@@ -325,7 +325,53 @@ int CraqObjectSegmentation::getPushback()
     if (mStopping)
       return CraqEntry::null();
 
+    OSegLookupTraceToken* traceToken = NULL;
+    CraqEntry localReturn = checkLocalLookup(obj_id, &traceToken);
+    if (localReturn.notNull())
+      return localReturn;
 
+    oStrand->post(
+        boost::bind(&CraqObjectSegmentation::beginCraqLookup,this,obj_id, traceToken),
+        "CraqObjectSegmentation::beginCraqLookup"
+    );
+
+    return CraqEntry::null();
+  }
+
+  /*
+    Same as lookup, but everything that has to go to craq is handed off in a
+    single post so the gets are issued back to back and pipelined on the craq
+    connections instead of each waiting for its own turn on the strand.
+  */
+  void CraqObjectSegmentation::lookupBatch(const std::vector<UUID>& obj_ids, std::vector<OSegEntry>* results)
+  {
+    results->resize(obj_ids.size());
+    PendingCraqLookups pending;
+    for (uint32 i = 0; i < obj_ids.size(); ++i)
+    {
+      (*results)[i] = CraqEntry::null();
+      if (mStopping)
+        continue;
+
+      OSegLookupTraceToken* traceToken = NULL;
+      CraqEntry localReturn = checkLocalLookup(obj_ids[i], &traceToken);
+      if (localReturn.notNull())
+        (*results)[i] = localReturn;
+      else
+        pending.push_back(std::make_pair(obj_ids[i], traceToken));
+    }
+
+    if (pending.empty())
+      return;
+
+    oStrand->post(
+        boost::bind(&CraqObjectSegmentation::beginCraqLookupBatch,this,pending),
+        "CraqObjectSegmentation::beginCraqLookupBatch"
+    );
+  }
+
+  CraqEntry CraqObjectSegmentation::checkLocalLookup(const UUID& obj_id, OSegLookupTraceToken** traceTokenOut)
+  {
     OSegLookupTraceToken* traceToken = new OSegLookupTraceToken(obj_id,shouldLog());
     traceToken->stamp(OSegLookupTraceToken::OSEG_TRACE_INITIAL_LOOKUP_TIME);
 
@@ -376,16 +422,18 @@ int CraqObjectSegmentation::getPushback()
 
     ++mOSegQueueLen;
     traceToken->osegQLenPostQuery = mOSegQueueLen;
-    oStrand->post(
-        boost::bind(&CraqObjectSegmentation::beginCraqLookup,this,obj_id, traceToken),
-        "CraqObjectSegmentation::beginCraqLookup"
-    );
-
+    *traceTokenOut = traceToken;
     return CraqEntry::null();
   }
 
 
 
+  void CraqObjectSegmentation::beginCraqLookupBatch(const PendingCraqLookups& lookups)
+  {
+    for (uint32 i = 0; i < lookups.size(); ++i)
+      beginCraqLookup(lookups[i].first, lookups[i].second);
+  }
+
 
   void CraqObjectSegmentation::beginCraqLookup(const UUID& obj_id, OSegLookupTraceToken* traceToken)
   {
@@ -174,7 +174,12 @@ class CraqObjectSegmentation : public ObjectSegmentation
     OSegCache* mCraqCache;
     //end building for the cache
 
+    // Performs the checks lookup() can satisfy without going to craq. If they
+    // fail, returns null and a trace token for the craq lookup.
+    CraqEntry checkLocalLookup(const UUID& obj_id, OSegLookupTraceToken** traceToken);
     void beginCraqLookup(const UUID& obj_id, OSegLookupTraceToken* traceToken);
+    typedef std::vector< std::pair<UUID, OSegLookupTraceToken*> > PendingCraqLookups;
+    void beginCraqLookupBatch(const PendingCraqLookups& lookups);
     void callOsegLookupCompleted(const UUID& obj_id, const CraqEntry& sID, OSegLookupTraceToken* traceToken);
 
       bool shouldLog();
@@ -187,6 +192,7 @@ class CraqObjectSegmentation : public ObjectSegmentation
 
       virtual ~CraqObjectSegmentation();
       virtual OSegEntry lookup(const UUID& obj_id);
+      virtual void lookupBatch(const std::vector<UUID>& obj_ids, std::vector<OSegEntry>* results);
       virtual OSegEntry cacheLookup(const UUID& obj_id);
       virtual void migrateObject(const UUID& obj_id, const OSegEntry& new_server_id);
       virtual void addNewObject(const UUID& obj_id, float radius);
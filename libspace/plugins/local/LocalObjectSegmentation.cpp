@@ -49,16 +49,39 @@ OSegEntry LocalObjectSegmentation::cacheLookup(const UUID& obj_id) {
 }
 
 OSegEntry LocalObjectSegmentation::lookup(const UUID& obj_id) {
-    // Local, so all objects should be available.
+    // Local, so all objects should be available. Unknown objects won't show
+    // up later, so report them as not found just like lookupBatch does.
     OSegMap::const_iterator it = mOSeg.find(obj_id);
     if (it == mOSeg.end()) {
         LOCALOSEG_LOG(warn, "Couldn't find object OSegEntry in LocalObjectSegmentation.");
+        mLookupListener->osegLookupCompleted(obj_id, OSegEntry::null());
         return OSegEntry::null();
     }
 
     return it->second;
 }
 
+void LocalObjectSegmentation::lookupBatch(const std::vector<UUID>& obj_ids, std::vector<OSegEntry>* results) {
+    // Everything is local, so the whole batch resolves immediately. Unknown
+    // objects won't show up later, so they're reported through the listener
+    // as not found rather than left pending forever
+    results->resize(obj_ids.size());
+    uint32 missing = 0;
+    for(uint32 i = 0; i < obj_ids.size(); i++) {
+        OSegMap::const_iterator it = mOSeg.find(obj_ids[i]);
+        if (it == mOSeg.end()) {
+            (*results)[i] = OSegEntry::null();
+            mLookupListener->osegLookupCompleted(obj_ids[i], OSegEntry::null());
+            missing++;
+        }
+        else {
+            (*results)[i] = it->second;
+        }
+    }
+    if (missing > 0)
+        LOCALOSEG_LOG(warn, "Couldn't find " << missing << " of " << obj_ids.size() << " objects in LocalObjectSegmentation batch lookup.");
+}
+
 void LocalObjectSegmentation::addNewObject(const UUID& obj_id, float radius)
 {
     OSegWriteListener::OSegAddNewStatus status = OSegWriteListener::SUCCESS;
@@ -12,6 +12,7 @@
 #include <sirikata/core/transfer/RemoteFileMetadata.hpp>
 #include <sirikata/core/transfer/TransferPool.hpp>
 #include <sirikata/core/transfer/TransferMediator.hpp>
+#include <sirikata/core/util/Thread.hpp>
 #include <sirikata/core/transfer/ResourceDownloadTask.hpp>
 
 #include <sirikata/space/LocationService.hpp>
@@ -105,8 +105,8 @@ void LibproxManualProximity::poll() {
 
     while(!mOHResultsToSend.empty()) {
         const OHResult& msg_front = mOHResultsToSend.front();
-        sendObjectHostResult(OHDP::NodeID(msg_front.first), msg_front.second);
-        delete msg_front.second;
+        sendObjectHostResult(std::tr1::get<0>(msg_front), std::tr1::get<1>(msg_front), std::tr1::get<2>(msg_front));
+        delete std::tr1::get<2>(msg_front);
         mOHResultsToSend.pop_front();
     }
 
@@ -1237,6 +1237,9 @@ void LibproxManualProximity::queryHasEvents(ProxQuery* query) {
         PROXLOG(detailed, evts.size() << " events for server query " << server_query_id);
     else
         PROXLOG(detailed, evts.size() << " events for object host query " << query_id);
+    // Every result from this batch of events gets the same t, which lets
+    // sendObjectHostResult pack the OH ones into a single frame
+    Time results_t = mContext->simTime();
     while(!evts.empty()) {
         // We need to support encoding both server messages, which
         // want a Container, and object messages, which want just
@@ -1247,7 +1250,7 @@ void LibproxManualProximity::queryHasEvents(ProxQuery* query) {
         Sirikata::Protocol::Prox::Container container;
         Sirikata::Protocol::Prox::IProximityResults prox_results = container.mutable_result();
 
-        prox_results.set_t(mContext->simTime());
+        prox_results.set_t(results_t);
 
         uint32 count = 0;
         while(count < max_count && !evts.empty()) {
@@ -1458,7 +1461,7 @@ void LibproxManualProximity::queryHasEvents(ProxQuery* query) {
                 UUID::null(), OBJECT_PORT_PROXIMITY,
                 serializePBJMessage(prox_results)
             );
-            mOHResults.push( OHResult(query_id, obj_msg) );
+            mOHResults.push( OHResult(query_id, results_t, obj_msg) );
         }
         else if (qhandler_type == QUERY_HANDLER_TYPE_SERVER) {
             Message* msg = new Message(
@@ -35,7 +35,9 @@ private:
     typedef Prox::QueryEvent<ObjectProxSimulationTraits> ProxQueryEvent;
     typedef Prox::LocationServiceCache<ObjectProxSimulationTraits> ProxLocCache;
 
-    typedef std::pair<OHDP::NodeID, Sirikata::Protocol::Object::ObjectMessage*> OHResult;
+    // An encoded ProximityResults for an object host along with its t, which
+    // decides whether it can be batched with others
+    typedef std::tr1::tuple<OHDP::NodeID, Time, Sirikata::Protocol::Object::ObjectMessage*> OHResult;
 public:
     LibproxManualProximity(SpaceContext* ctx, LocationService* locservice, CoordinateSegmentation* cseg, SpaceNetwork* net, AggregateManager* aggmgr);
     ~LibproxManualProximity();
@@ -62,7 +62,7 @@ static uint32 NoUpdateMaxResults = ((uint32)INT_MAX)+1;
 
 namespace {
 
-bool parseQueryRequest(const String& query, SolidAngle* qangle_out, uint32* max_results_out) {
+bool parseQueryRequest(const String& query, SolidAngle* qangle_out, uint32* max_results_out, LocUpdateEncoding* loc_encoding_out) {
     if (query.empty())
         return false;
 
@@ -73,6 +73,9 @@ bool parseQueryRequest(const String& query, SolidAngle* qangle_out, uint32* max_
 
     *qangle_out = SolidAngle( parsed.getReal("angle", SolidAngle::Max.asFloat()) );
     *max_results_out = parsed.getInt("max_result", 0);
+    // Unknown encodings fall back to the full one, which everyone can decode
+    *loc_encoding_out = LocUpdateEncodingFull;
+    parseLocUpdateEncoding(parsed.getString(LOC_UPDATE_ENCODING_QUERY_KEY, "full"), loc_encoding_out);
 
     return true;
 }
@@ -261,8 +264,11 @@ void LibproxProximity::handleObjectProximityMessage(const UUID& objid, void* buf
     if (prox_update.has_query_parameters()) {
         SolidAngle sa;
         uint32 max_results;
-        if (parseQueryRequest(prox_update.query_parameters(), &sa, &max_results))
+        LocUpdateEncoding loc_encoding;
+        if (parseQueryRequest(prox_update.query_parameters(), &sa, &max_results, &loc_encoding)) {
+            mLocService->setUpdateEncoding(objid, loc_encoding);
             updateQuery(objid, mLocService->location(objid), mLocService->bounds(objid).fullBounds(), sa, max_results);
+        }
     }
     else {
         if (!prox_update.has_query_angle()) return;
@@ -561,8 +567,11 @@ void LibproxProximity::addQuery(UUID obj, SolidAngle sa, uint32 max_results) {
 void LibproxProximity::addQuery(UUID obj, const String& params) {
     SolidAngle sa;
     uint32 max_results;
-    if (parseQueryRequest(params, &sa, &max_results))
+    LocUpdateEncoding loc_encoding;
+    if (parseQueryRequest(params, &sa, &max_results, &loc_encoding)) {
+        mLocService->setUpdateEncoding(obj, loc_encoding);
         updateQuery(obj, mLocService->location(obj), mLocService->bounds(obj).fullBounds(), sa, max_results);
+    }
 }
 
 void LibproxProximity::updateQuery(UUID obj, const TimedMotionVector3f& loc, const BoundingSphere3f& bounds, SolidAngle sa, uint32 max_results) {
@@ -1013,6 +1022,8 @@ void LibproxProximity::generateServerQueryEvents(Query* query) {
     QueryEventList evts;
     query->popEvents(evts);
 
+    // Results are collected and handed to the main strand in one batch
+    std::deque<Message*> results;
     while(!evts.empty()) {
         Sirikata::Protocol::Prox::Container container;
         Sirikata::Protocol::Prox::IProximityResults contents = container.mutable_result();
@@ -1114,8 +1125,9 @@ void LibproxProximity::generateServerQueryEvents(Query* query) {
             SERVER_PORT_PROX,
             serializePBJMessage(container)
         );
-        mServerResults.push(msg);
+        results.push_back(msg);
     }
+    mServerResults.pushMany(results.begin(), results.end());
 }
 
 void LibproxProximity::generateObjectQueryEvents(Query* query, bool do_first) {
@@ -1144,6 +1156,8 @@ void LibproxProximity::generateObjectQueryEvents(Query* query, bool do_first) {
         mObjectQueriesFirstIteration.erase(query);
     }
 
+    // Results are collected and handed to the main strand in one batch
+    std::deque<Sirikata::Protocol::Object::ObjectMessage*> results;
     while(!evts.empty()) {
         Sirikata::Protocol::Prox::ProximityResults prox_results;
         prox_results.set_t(mContext->simTime());
@@ -1248,8 +1262,9 @@ void LibproxProximity::generateObjectQueryEvents(Query* query, bool do_first) {
             query_id, OBJECT_PORT_PROXIMITY,
             serializePBJMessage(prox_results)
         );
-        mObjectResults.push(obj_msg);
+        results.push_back(obj_msg);
     }
+    mObjectResults.pushMany(results.begin(), results.end());
 }
 
 
@@ -90,6 +90,18 @@ void LibproxProximityBase::ProxStreamInfo<EndpointType, StreamType>::writeSomeOb
         );
 }
 
+template<typename EndpointType, typename StreamType>
+bool LibproxProximityBase::ProxStreamInfo<EndpointType, StreamType>::flushBatch(Context* ctx, Ptr prox_stream) {
+    if (prox_stream->batch.empty()) return false;
+
+    prox_stream->outstanding.push(Network::Frame::write(prox_stream->batch.data()));
+    prox_stream->batch.clear();
+
+    if (!prox_stream->writing)
+        writeSomeObjectResults(ctx, prox_stream);
+    return true;
+}
+
 template<typename EndpointType, typename StreamType>
 void LibproxProximityBase::ProxStreamInfo<EndpointType, StreamType>::requestProxSubstream(LibproxProximityBase* parent, Context* ctx, const EndpointType& ep, Ptr prox_stream) {
     using std::tr1::placeholders::_1;
@@ -179,6 +191,9 @@ LibproxProximityBase::LibproxProximityBase(SpaceContext* ctx, LocationService* l
     mSeparateDynamicObjects = GetOptionValue<bool>(OPT_PROX_SPLIT_DYNAMIC);
     mNumQueryHandlers = (mSeparateDynamicObjects ? 2 : 1);
     mMoveToStaticDelay = Duration::minutes(1);
+
+    mOHBatchBytes = GetOptionValue<uint32>(OPT_PROX_OH_BATCH_BYTES);
+    mOHBatchDelay = GetOptionValue<Duration>(OPT_PROX_OH_BATCH_DELAY);
 }
 
 LibproxProximityBase::~LibproxProximityBase() {
@@ -435,7 +450,7 @@ void LibproxProximityBase::sendObjectResult(Sirikata::Protocol::Object::ObjectMe
         ProxObjectStreamInfo::writeSomeObjectResults(mContext, prox_stream);
 }
 
-void LibproxProximityBase::sendObjectHostResult(const OHDP::NodeID& node, Sirikata::Protocol::Object::ObjectMessage* msg) {
+void LibproxProximityBase::sendObjectHostResult(const OHDP::NodeID& node, const Time& t, Sirikata::Protocol::Object::ObjectMessage* msg) {
     using std::tr1::placeholders::_1;
     using std::tr1::placeholders::_2;
 
@@ -454,16 +469,44 @@ void LibproxProximityBase::sendObjectHostResult(const OHDP::NodeID& node, Sirika
     if (!prox_stream->iostream_requested)
         ProxObjectHostStreamInfo::requestProxSubstream(this, mContext, node, prox_stream);
 
-    // Build the result and push it into the stream
+    // Add the result to the current batch. OHs may have many queries (and
+    // receive many small results as their cuts are refined), so rather than
+    // paying for a frame and a stream write per result, we append the encoded
+    // ProximityResults and send them as one frame once the batch is large
+    // enough or has been waiting long enough. Results from a different
+    // time can't share the batch's ProximityResults::t, so they start a new
+    // one.
+    if (!prox_stream->batch.accepts(t)) {
+        if (ProxObjectHostStreamInfo::flushBatch(mContext, prox_stream))
+            mStats.objectHostSentFrames++;
+    }
     // FIXME this is an infinite sized queue, but we don't really want to drop
     // proximity results....
-    prox_stream->outstanding.push(Network::Frame::write(msg->payload()));
+    prox_stream->batch.append(msg->payload(), t);
     mStats.objectHostSentBytes += msg->payload().size();
     mStats.objectHostSentMessages++;
 
-    // If writing isn't already in progress, start it up
-    if (!prox_stream->writing)
-        ProxObjectHostStreamInfo::writeSomeObjectResults(mContext, prox_stream);
+    if (prox_stream->batch.size() >= mOHBatchBytes || mOHBatchDelay == Duration::zero()) {
+        if (ProxObjectHostStreamInfo::flushBatch(mContext, prox_stream))
+            mStats.objectHostSentFrames++;
+    }
+    else if (!prox_stream->batch_flush_scheduled) {
+        prox_stream->batch_flush_scheduled = true;
+        mContext->mainStrand->post(
+            mOHBatchDelay,
+            std::tr1::bind(&LibproxProximityBase::flushObjectHostBatch, this, ProxObjectHostStreamInfo::WPtr(prox_stream)),
+            "LibproxProximityBase::flushObjectHostBatch"
+        );
+    }
+}
+
+void LibproxProximityBase::flushObjectHostBatch(ProxObjectHostStreamInfo::WPtr w_prox_stream) {
+    ProxObjectHostStreamInfoPtr prox_stream = w_prox_stream.lock();
+    if (!prox_stream) return;
+
+    prox_stream->batch_flush_scheduled = false;
+    if (ProxObjectHostStreamInfo::flushBatch(mContext, prox_stream))
+        mStats.objectHostSentFrames++;
 }
 
 
@@ -823,6 +866,7 @@ void LibproxProximityBase::commandStats(const Command::Command& cmd, Command::Co
 
     result.put("stats.oh.sent.bytes", mStats.objectHostSentBytes.read());
     result.put("stats.oh.sent.messages", mStats.objectHostSentMessages.read());
+    result.put("stats.oh.sent.frames", mStats.objectHostSentFrames.read());
     result.put("stats.oh.received.bytes", mStats.objectHostReceivedBytes.read());
     result.put("stats.oh.received.messages", mStats.objectHostReceivedMessages.read());
 
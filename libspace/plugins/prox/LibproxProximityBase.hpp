@@ -7,6 +7,7 @@
 
 #include <sirikata/space/Proximity.hpp>
 #include "CBRLocationServiceCache.hpp"
+#include "ProximityResultsBatch.hpp"
 #include <prox/base/QueryEvent.hpp>
 #include <sirikata/space/PintoServerQuerier.hpp>
 
@@ -71,6 +72,7 @@ protected:
            objectReceivedMessages(0),
            objectHostSentBytes(0),
            objectHostSentMessages(0),
+           objectHostSentFrames(0),
            objectHostReceivedBytes(0),
            objectHostReceivedMessages(0),
            spaceSentBytes(0),
@@ -92,6 +94,9 @@ protected:
         AtomicValue<uint32> objectHostSentBytes;
         // Total messages sent to objects hosts (calls to sendObjectHostResult)
         AtomicValue<uint32> objectHostSentMessages;
+        // Total frames sent to object hosts. Results are batched, so this
+        // is usually smaller than objectHostSentMessages
+        AtomicValue<uint32> objectHostSentFrames;
         // Total number of bytes received to object hosts
         AtomicValue<uint32> objectHostReceivedBytes;
         // Total messages received from object hosts
@@ -119,6 +124,12 @@ protected:
     // in and out of trees frequently because of short stops (e.g. and avatar
     // stops for a few seconds while walking).
     Duration mMoveToStaticDelay;
+    // Results destined for an object host are accumulated until either
+    // mOHBatchBytes have been collected or mOHBatchDelay has passed since the
+    // first of them was queued, and then sent as a single frame. Only results
+    // with the same ProximityResults::t are batched together.
+    uint32 mOHBatchBytes;
+    Duration mOHBatchDelay;
 
 
     // Top level Pinto + server interactions. The base class takes
@@ -185,10 +196,10 @@ protected:
         // Start a fresh ProxStreamInfo, which will require requesting
         // a new substream
         ProxStreamInfo()
-         : iostream_requested(false), writing(false) {}
+         : iostream_requested(false), writing(false), batch_flush_scheduled(false) {}
         // Start a ProxStreamInfo on an existing stream.
         ProxStreamInfo(StreamTypePtr strm)
-         : iostream(strm), iostream_requested(true), writing(false) {}
+         : iostream(strm), iostream_requested(true), writing(false), batch_flush_scheduled(false) {}
 
         void disable() {
             if (iostream)
@@ -213,6 +224,11 @@ protected:
         // Stored callback for writing
         std::tr1::function<void()> writecb;
 
+        // Encoded results that haven't been framed yet
+        ProximityResultsBatch batch;
+        // Whether a timeout to flush batch is already pending
+        bool batch_flush_scheduled;
+
         // Stored callback for reading frames
         FrameReceivedCallback read_frame_cb;
         // Backlog of data, i.e. incomplete frame
@@ -227,6 +243,9 @@ protected:
 
         // The driver for getting data to the OH, initially triggered by sendObjectResults
         static void writeSomeObjectResults(Context* ctx, WPtr prox_stream);
+        // Frame any batched results, queue them in outstanding and make sure
+        // writing is in progress. Returns true if a frame was queued.
+        static bool flushBatch(Context* ctx, Ptr prox_stream);
         // Helper for setting up the initial proximity stream. Retries automatically
         // until successful.
         static void requestProxSubstream(LibproxProximityBase* parent, Context* ctx, const EndpointType& oref, Ptr prox_stream);
@@ -252,7 +271,12 @@ protected:
     // Utility for poll.  Queues a message for delivery, encoding it and putting
     // it on the send stream.  If necessary, starts send processing on the stream.
     void sendObjectResult(Sirikata::Protocol::Object::ObjectMessage*);
-    void sendObjectHostResult(const OHDP::NodeID& node, Sirikata::Protocol::Object::ObjectMessage*);
+    // Object host results may be batched with others, so they also need the t
+    // the encoded ProximityResults was generated with.
+    void sendObjectHostResult(const OHDP::NodeID& node, const Time& t, Sirikata::Protocol::Object::ObjectMessage*);
+    // Timeout handler which sends a partially filled batch of object host
+    // results.
+    void flushObjectHostBatch(ProxObjectHostStreamInfo::WPtr prox_stream);
 
     // Helpers that are protocol-specific
     bool validSession(const ObjectReference& oref) const;
@@ -9,6 +9,8 @@
 #define OPT_PINTO_OPTIONS          "pinto-options"
 #define OPT_PROX_QUERY_RANGE       "prox.range"
 #define PROX_MAX_PER_RESULT        "prox.max-per-result"
+#define OPT_PROX_OH_BATCH_BYTES    "prox.oh.batch-bytes"
+#define OPT_PROX_OH_BATCH_DELAY    "prox.oh.batch-delay"
 #define OPT_PROX_SPLIT_DYNAMIC     "prox.split-dynamic"
 
 #define OPT_PROX_SERVER_QUERY_HANDLER_TYPE         "prox.server.handler"
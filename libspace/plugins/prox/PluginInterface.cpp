@@ -51,6 +51,8 @@ static void InitPluginOptions() {
         .addOption(new OptionValue(OPT_PINTO_OPTIONS,"",Sirikata::OptionValueType<String>(),"Specifies arguments to Pinto."))
 
         .addOption(new OptionValue(PROX_MAX_PER_RESULT, "5", Sirikata::OptionValueType<uint32>(), "Maximum number of changes to report in each result message."))
+        .addOption(new OptionValue(OPT_PROX_OH_BATCH_BYTES, "16384", Sirikata::OptionValueType<uint32>(), "Results to an object host are packed into a single frame until it reaches this many bytes. 0 sends each result in its own frame."))
+        .addOption(new OptionValue(OPT_PROX_OH_BATCH_DELAY, "0ms", Sirikata::OptionValueType<Duration>(), "Maximum time a partially filled batch of object host results is held before being sent. 0 disables batching and sends each result in its own frame."))
 
         .addOption(new OptionValue(OPT_PROX_SPLIT_DYNAMIC, "true", Sirikata::OptionValueType<bool>(), "If true, separate query handlers will be used for static and dynamic objects."))
 
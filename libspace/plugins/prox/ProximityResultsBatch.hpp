@@ -0,0 +1,57 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_LIBPROX_PROXIMITY_RESULTS_BATCH_HPP_
+#define _SIRIKATA_LIBPROX_PROXIMITY_RESULTS_BATCH_HPP_
+
+#include <sirikata/core/util/Platform.hpp>
+#include <sirikata/core/util/Time.hpp>
+
+namespace Sirikata {
+
+/** Collects encoded ProximityResults so they can be sent in a single frame.
+ *  Serialized ProximityResults concatenate into one valid ProximityResults
+ *  with all the updates in order, but it only has room for one t: parsing
+ *  keeps the last one. So a batch only takes results computed at the same
+ *  time, and the caller has to send the batch before adding results with a
+ *  different t.
+ */
+class ProximityResultsBatch {
+public:
+    ProximityResultsBatch()
+     : mTime(Time::null())
+    {}
+
+    bool empty() const { return mData.empty(); }
+    uint32 size() const { return mData.size(); }
+    const String& data() const { return mData; }
+    /// The t shared by all results in the batch, only valid if it's not empty
+    const Time& time() const { return mTime; }
+
+    /// Whether results computed at t can be added to this batch
+    bool accepts(const Time& t) const {
+        return (mData.empty() || t == mTime);
+    }
+
+    /** Add an encoded ProximityResults whose t is the given time. The batch
+     *  must accept(t).
+     */
+    void append(const String& encoded, const Time& t) {
+        assert(accepts(t));
+        mData.append(encoded);
+        mTime = t;
+    }
+
+    void clear() {
+        mData.clear();
+    }
+
+private:
+    String mData;
+    Time mTime;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_LIBPROX_PROXIMITY_RESULTS_BATCH_HPP_
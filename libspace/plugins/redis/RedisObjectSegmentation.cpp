@@ -114,6 +114,17 @@ struct RedisObjectMigratedOperationInfo {
     uint8 refcount;
 };
 
+// State tracking for a batched read, covering all the objects requested by a
+// single MGET
+struct RedisObjectBatchOperationInfo {
+    RedisObjectBatchOperationInfo(RedisObjectSegmentation* _oseg)
+     : oseg(_oseg)
+    {}
+
+    RedisObjectSegmentation* oseg;
+    std::vector<UUID> objs;
+};
+
 void globalRedisLookupObjectReadFinished(redisAsyncContext* c, void* _reply, void* privdata) {
     redisReply *reply = (redisReply*)_reply;
     RedisObjectOperationInfo* wi = (RedisObjectOperationInfo*)privdata;
@@ -139,6 +150,39 @@ void globalRedisLookupObjectReadFinished(redisAsyncContext* c, void* _reply, voi
     delete wi;
 }
 
+void globalRedisLookupObjectBatchReadFinished(redisAsyncContext* c, void* _reply, void* privdata) {
+    redisReply *reply = (redisReply*)_reply;
+    RedisObjectBatchOperationInfo* bi = (RedisObjectBatchOperationInfo*)privdata;
+
+    // Unlike single reads, any failure of the whole MGET is reported for every
+    // object so lookups waiting on the batch don't stall
+    if (reply == NULL) {
+        REDISOSEG_LOG(error, "Unknown redis error when reading batch of " << bi->objs.size() << " objects");
+        for(uint32 i = 0; i < bi->objs.size(); i++)
+            bi->oseg->failReadObject(bi->objs[i]);
+    }
+    else if (reply->type == REDIS_REPLY_ERROR) {
+        REDISOSEG_LOG(error, "Redis error when reading batch of " << bi->objs.size() << " objects: " << String(reply->str, reply->len));
+        for(uint32 i = 0; i < bi->objs.size(); i++)
+            bi->oseg->failReadObject(bi->objs[i]);
+    }
+    else if (reply->type == REDIS_REPLY_ARRAY && reply->elements == bi->objs.size()) {
+        for(uint32 i = 0; i < bi->objs.size(); i++) {
+            redisReply* elem = reply->element[i];
+            if (elem->type == REDIS_REPLY_STRING)
+                bi->oseg->finishReadObject(bi->objs[i], String(elem->str, elem->len));
+            else // Nil, the object isn't registered
+                bi->oseg->failReadObject(bi->objs[i]);
+        }
+    }
+    else {
+        REDISOSEG_LOG(error, "Unexpected redis reply when reading batch of " << bi->objs.size() << " objects: type " << reply->type);
+        for(uint32 i = 0; i < bi->objs.size(); i++)
+            bi->oseg->failReadObject(bi->objs[i]);
+    }
+
+    delete bi;
+}
 
 void globalRedisAddNewObjectWriteFinished(redisAsyncContext* c, void* _reply, void* privdata) {
     redisReply *reply = (redisReply*)_reply;
@@ -595,6 +639,50 @@ OSegEntry RedisObjectSegmentation::lookup(const UUID& obj_id) {
     return OSegEntry::null();
 }
 
+void RedisObjectSegmentation::lookupBatch(const std::vector<UUID>& obj_ids, std::vector<OSegEntry>* results) {
+    results->resize(obj_ids.size());
+    if (mStopping) {
+        for(uint32 i = 0; i < obj_ids.size(); i++)
+            (*results)[i] = OSegEntry::null();
+        return;
+    }
+
+    // Resolve what we can locally and collect the rest into a single MGET,
+    // which costs one round trip regardless of the batch size.
+    RedisObjectBatchOperationInfo* bi = new RedisObjectBatchOperationInfo(this);
+    std::vector<String> keys;
+    for(uint32 i = 0; i < obj_ids.size(); i++) {
+        OSegMap::const_iterator it = mOSeg.find(obj_ids[i]);
+        if (it != mOSeg.end()) {
+            (*results)[i] = it->second;
+            continue;
+        }
+        (*results)[i] = OSegEntry::null();
+        bi->objs.push_back(obj_ids[i]);
+        keys.push_back(mRedisPrefix + obj_ids[i].toString());
+    }
+
+    if (bi->objs.empty()) {
+        delete bi;
+        return;
+    }
+
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    argv.push_back("MGET");
+    argvlen.push_back(4);
+    for(uint32 i = 0; i < keys.size(); i++) {
+        argv.push_back(keys[i].c_str());
+        argvlen.push_back(keys[i].size());
+    }
+
+    ensureConnected();
+    {
+        Lock lck(mMutex);
+        redisAsyncCommandArgv(mRedisContext, globalRedisLookupObjectBatchReadFinished, bi, argv.size(), &argv[0], &argvlen[0]);
+    }
+}
+
 void RedisObjectSegmentation::finishReadObject(const UUID& obj_id, const String& data_str) {
     REDISOSEG_LOG(detailed, "Finished reading OSEG entry for object " << obj_id.toString());
     if (mStopping) return;
@@ -55,6 +55,7 @@ public:
 
     virtual OSegEntry cacheLookup(const UUID& obj_id);
     virtual OSegEntry lookup(const UUID& obj_id);
+    virtual void lookupBatch(const std::vector<UUID>& obj_ids, std::vector<OSegEntry>* results);
 
     virtual void addNewObject(const UUID& obj_id, float radius);
     virtual void addMigratedObject(const UUID& obj_id, float radius, ServerID idServerAckTo, bool);
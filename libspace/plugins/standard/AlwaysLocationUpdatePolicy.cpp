@@ -44,6 +44,9 @@ namespace Sirikata {
 void InitAlwaysLocationUpdatePolicyOptions() {
     Sirikata::InitializeClassOptions ico(ALWAYS_POLICY_OPTIONS, NULL,
         new OptionValue(LOC_MAX_PER_RESULT, "5", Sirikata::OptionValueType<uint32>(), "Maximum number of loc updates to report in each result message."),
+        new OptionValue(LOC_SERVICE_THREADS, "0", Sirikata::OptionValueType<uint32>(), "Number of jobs posted to the space's IOService to build loc update messages in parallel with the main strand. 0 builds them all on the main strand."),
+        new OptionValue(LOC_COMPACT_POSITION_RESOLUTION, "0.001", Sirikata::OptionValueType<float32>(), "Resolution positions are quantized to in compact loc updates."),
+        new OptionValue(LOC_COMPACT_VELOCITY_RESOLUTION, "0.001", Sirikata::OptionValueType<float32>(), "Resolution velocities are quantized to in compact loc updates."),
         NULL);
 }
 
@@ -62,15 +65,28 @@ AlwaysLocationUpdatePolicy::AlwaysLocationUpdatePolicy(SpaceContext* ctx, const
    mOHUpdatesPerSecond(0),
    mTimeSeriesObjectUpdatesName(String("space.server") + boost::lexical_cast<String>(ctx->id()) + ".loc.object_updates_per_second"),
    mObjectUpdatesPerSecond(0),
+   mServiceWorkers(NULL),
    mServerSubscriptions(this, /*include_all_data=*/true, mServerUpdatesPerSecond),
    mOHSubscriptions(this, /*include_all_data=*/true, mOHUpdatesPerSecond),
    mObjectSubscriptions(this, /*include_all_data=*/false, mObjectUpdatesPerSecond)
 {
     OptionSet* optionsSet = OptionSet::getOptions(ALWAYS_POLICY_OPTIONS,NULL);
     optionsSet->parse(args);
+
+    mServiceWorkers = new LocationSubscriptionWorkers(
+        ctx->ioService,
+        GetOptionValue<uint32>(ALWAYS_POLICY_OPTIONS, LOC_SERVICE_THREADS)
+    );
+
+    float32 pos_res = GetOptionValue<float32>(ALWAYS_POLICY_OPTIONS, LOC_COMPACT_POSITION_RESOLUTION);
+    float32 vel_res = GetOptionValue<float32>(ALWAYS_POLICY_OPTIONS, LOC_COMPACT_VELOCITY_RESOLUTION);
+    mServerSubscriptions.setCompactResolution(pos_res, vel_res);
+    mOHSubscriptions.setCompactResolution(pos_res, vel_res);
+    mObjectSubscriptions.setCompactResolution(pos_res, vel_res);
 }
 
 AlwaysLocationUpdatePolicy::~AlwaysLocationUpdatePolicy() {
+    delete mServiceWorkers;
 }
 
 void AlwaysLocationUpdatePolicy::start() {
@@ -111,13 +127,13 @@ void AlwaysLocationUpdatePolicy::reportStats() {
 void AlwaysLocationUpdatePolicy::subscribe(ServerID remote, const UUID& uuid, SeqNoPtr seqnoPtr)
 {
     if (validSubscriber(remote))
-        mServerSubscriptions.subscribe(remote, uuid, seqnoPtr);
+        mServerSubscriptions.subscribe(remote, uuid, mLocService, seqnoPtr);
 }
 
 void AlwaysLocationUpdatePolicy::subscribe(ServerID remote, const UUID& uuid, ProxIndexID index_id, SeqNoPtr seqnoPtr)
 {
     if (validSubscriber(remote))
-        mServerSubscriptions.subscribe(remote, uuid, index_id, seqnoPtr);
+        mServerSubscriptions.subscribe(remote, uuid, index_id, mLocService, seqnoPtr);
 }
 
 void AlwaysLocationUpdatePolicy::unsubscribe(ServerID remote, const UUID& uuid) {
@@ -137,12 +153,12 @@ void AlwaysLocationUpdatePolicy::unsubscribe(ServerID remote) {
 
 void AlwaysLocationUpdatePolicy::subscribe(const OHDP::NodeID& remote, const UUID& uuid) {
     if (validSubscriber(remote))
-        mOHSubscriptions.subscribe(remote, uuid, mLocService->context()->ohSessionManager()->getSession(remote)->seqNoPtr());
+        mOHSubscriptions.subscribe(remote, uuid, mLocService, mLocService->context()->ohSessionManager()->getSession(remote)->seqNoPtr());
 }
 
 void AlwaysLocationUpdatePolicy::subscribe(const OHDP::NodeID& remote, const UUID& uuid, ProxIndexID index_id) {
     if (validSubscriber(remote))
-        mOHSubscriptions.subscribe(remote, uuid, index_id, mLocService->context()->ohSessionManager()->getSession(remote)->seqNoPtr());
+        mOHSubscriptions.subscribe(remote, uuid, index_id, mLocService, mLocService->context()->ohSessionManager()->getSession(remote)->seqNoPtr());
 }
 
 void AlwaysLocationUpdatePolicy::unsubscribe(const OHDP::NodeID& remote, const UUID& uuid) {
@@ -162,12 +178,12 @@ void AlwaysLocationUpdatePolicy::unsubscribe(const OHDP::NodeID& remote) {
 
 void AlwaysLocationUpdatePolicy::subscribe(const UUID& remote, const UUID& uuid) {
     if (validSubscriber(remote))
-        mObjectSubscriptions.subscribe(remote, uuid, mLocService->context()->objectSessionManager()->getSession(ObjectReference(remote))->getSeqNoPtr());
+        mObjectSubscriptions.subscribe(remote, uuid, mLocService, mLocService->context()->objectSessionManager()->getSession(ObjectReference(remote))->getSeqNoPtr());
 }
 
 void AlwaysLocationUpdatePolicy::subscribe(const UUID& remote, const UUID& uuid, ProxIndexID index_id) {
     if (validSubscriber(remote))
-        mObjectSubscriptions.subscribe(remote, uuid, index_id, mLocService->context()->objectSessionManager()->getSession(ObjectReference(remote))->getSeqNoPtr());
+        mObjectSubscriptions.subscribe(remote, uuid, index_id, mLocService, mLocService->context()->objectSessionManager()->getSession(ObjectReference(remote))->getSeqNoPtr());
 }
 
 void AlwaysLocationUpdatePolicy::unsubscribe(const UUID& remote, const UUID& uuid) {
@@ -183,6 +199,21 @@ void AlwaysLocationUpdatePolicy::unsubscribe(const UUID& remote) {
 }
 
 
+// Encodings
+
+void AlwaysLocationUpdatePolicy::setEncoding(ServerID remote, LocUpdateEncoding encoding) {
+    mServerSubscriptions.setEncoding(remote, encoding);
+}
+
+void AlwaysLocationUpdatePolicy::setEncoding(const OHDP::NodeID& remote, LocUpdateEncoding encoding) {
+    mOHSubscriptions.setEncoding(remote, encoding);
+}
+
+void AlwaysLocationUpdatePolicy::setEncoding(const UUID& remote, LocUpdateEncoding encoding) {
+    mObjectSubscriptions.setEncoding(remote, encoding);
+}
+
+
 
 
 void AlwaysLocationUpdatePolicy::localObjectAdded(const UUID& uuid, bool agg, const TimedMotionVector3f& loc, const TimedMotionQuaternion& orient, const AggregateBoundingInfo& bounds, const String& mesh, const String& physics) {
@@ -269,9 +300,10 @@ void AlwaysLocationUpdatePolicy::replicaQueryDataUpdated(const UUID& uuid, const
 }
 
 void AlwaysLocationUpdatePolicy::service() {
-    mServerSubscriptions.service();
-    mOHSubscriptions.service();
-    mObjectSubscriptions.service();
+    uint32 max_updates = GetOptionValue<uint32>(ALWAYS_POLICY_OPTIONS, LOC_MAX_PER_RESULT);
+    mServerSubscriptions.service(max_updates, mServiceWorkers);
+    mOHSubscriptions.service(max_updates, mServiceWorkers);
+    mObjectSubscriptions.service(max_updates, mServiceWorkers);
 }
 
 void AlwaysLocationUpdatePolicy::tryCreateChildStream(const UUID& dest, ODPSST::StreamPtr parent_stream, std::string* msg, int count, const SubscriberInfoPtr&numOutstandingMessageCount) {
@@ -305,6 +337,7 @@ void AlwaysLocationUpdatePolicy::objectLocSubstreamCallback(int x, ODPSST::Strea
     else {
         SILOG(always_loc,error,"Failed multiple times to open loc update substream.");
         //mObjectSubscriptions.decrementOutstandingMessageCount(dest);
+        ObjectSubscriberIndex::updateLost(numOutstandingMessageCount);
         delete msg;
     }
 }
@@ -340,6 +373,7 @@ void AlwaysLocationUpdatePolicy::ohLocSubstreamCallback(int x, OHDPSST::StreamPt
     else {
         //mOHSubscriptions.decrementOutstandingMessageCount(dest);
         SILOG(always_loc,error,"Failed multiple times to open loc update substream.");
+        OHSubscriberIndex::updateLost(numOutstandingMessageCount);
         delete msg;
     }
 }
@@ -376,10 +410,8 @@ bool AlwaysLocationUpdatePolicy::isSelfSubscriber(const ServerID& sid, const UUI
     return false;
 }
 
-bool AlwaysLocationUpdatePolicy::trySend(const UUID& dest, const Sirikata::Protocol::Loc::BulkLocationUpdate& blu, const SubscriberInfoPtr& numOutstandingMessageCount)
+bool AlwaysLocationUpdatePolicy::trySend(const UUID& dest, const String& serialized_blu, const SubscriberInfoPtr& numOutstandingMessageCount)
 {
-    std::string bluMsg = serializePBJMessage(blu);
-
     ObjectSession* session = mLocService->context()->objectSessionManager()->getSession(ObjectReference(dest));
     if (session == NULL) {
         //mObjectSubscriptions.decrementOutstandingMessageCount(dest);
@@ -392,16 +424,14 @@ bool AlwaysLocationUpdatePolicy::trySend(const UUID& dest, const Sirikata::Proto
     }
 
     Sirikata::Protocol::Frame msg_frame;
-    msg_frame.set_payload(bluMsg);
+    msg_frame.set_payload(serialized_blu);
     std::string* framed_loc_msg = new std::string(serializePBJMessage(msg_frame));
     tryCreateChildStream(dest, locServiceStream, framed_loc_msg, 0, numOutstandingMessageCount);
     return true;
 }
 
-bool AlwaysLocationUpdatePolicy::trySend(const OHDP::NodeID& dest, const Sirikata::Protocol::Loc::BulkLocationUpdate& blu, const SubscriberInfoPtr& numOutstandingMessageCount)
+bool AlwaysLocationUpdatePolicy::trySend(const OHDP::NodeID& dest, const String& serialized_blu, const SubscriberInfoPtr& numOutstandingMessageCount)
 {
-    std::string bluMsg = serializePBJMessage(blu);
-
     ObjectHostSessionPtr session = mLocService->context()->ohSessionManager()->getSession(dest);
     if (!session) {
         //mOHSubscriptions.decrementOutstandingMessageCount(dest);
@@ -414,19 +444,19 @@ bool AlwaysLocationUpdatePolicy::trySend(const OHDP::NodeID& dest, const Sirikat
     }
 
     Sirikata::Protocol::Frame msg_frame;
-    msg_frame.set_payload(bluMsg);
+    msg_frame.set_payload(serialized_blu);
     std::string* framed_loc_msg = new std::string(serializePBJMessage(msg_frame));
     tryCreateChildStream(dest, locServiceStream, framed_loc_msg, 0, numOutstandingMessageCount);
     return true;
 }
 
-bool AlwaysLocationUpdatePolicy::trySend(const ServerID& dest, const Sirikata::Protocol::Loc::BulkLocationUpdate& blu, const SubscriberInfoPtr& numOutstandingMessageCount) {
+bool AlwaysLocationUpdatePolicy::trySend(const ServerID& dest, const String& serialized_blu, const SubscriberInfoPtr& numOutstandingMessageCount) {
     Message* msg = new Message(
         mLocService->context()->id(),
         SERVER_PORT_LOCATION,
         dest,
         SERVER_PORT_LOCATION,
-        serializePBJMessage(blu)
+        serialized_blu
     );
 
     // There's no retries/async step for servers since they either get on the
@@ -257,6 +257,18 @@ void LocationService::unsubscribe(const UUID& remote) {
     mUpdatePolicy->unsubscribe(remote);
 }
 
+void LocationService::setUpdateEncoding(ServerID remote, LocUpdateEncoding encoding) {
+    mUpdatePolicy->setEncoding(remote, encoding);
+}
+
+void LocationService::setUpdateEncoding(const OHDP::NodeID& remote, LocUpdateEncoding encoding) {
+    mUpdatePolicy->setEncoding(remote, encoding);
+}
+
+void LocationService::setUpdateEncoding(const UUID& remote, LocUpdateEncoding encoding) {
+    mUpdatePolicy->setEncoding(remote, encoding);
+}
+
 
 
 
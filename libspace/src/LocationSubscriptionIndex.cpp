@@ -0,0 +1,738 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/space/LocationSubscriptionIndex.hpp>
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/Message.hpp>
+#include <sirikata/pintoloc/ProtocolLocUpdate.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "Protocol_Loc.pbj.hpp"
+
+namespace Sirikata {
+
+// LocationStringTable
+
+LocationStringTable::LocationStringTable()
+ : mEntries(1)
+{
+}
+
+uint32 LocationStringTable::intern(const String& str) {
+    if (str.empty()) return 0;
+
+    FlatHashMap<String, uint32>::iterator it = mIDs.find(str);
+    if (it != mIDs.end()) {
+        mEntries[it->second].refs++;
+        return it->second;
+    }
+
+    uint32 id;
+    if (!mFreeEntries.empty()) {
+        id = mFreeEntries.back();
+        mFreeEntries.pop_back();
+    }
+    else {
+        id = mEntries.size();
+        mEntries.push_back(Entry());
+    }
+    mEntries[id].str = str;
+    mEntries[id].refs = 1;
+    mIDs.insert(FlatHashMap<String, uint32>::value_type(str, id));
+    return id;
+}
+
+void LocationStringTable::release(uint32 id) {
+    if (id == 0) return;
+
+    Entry& entry = mEntries[id];
+    assert(entry.refs > 0);
+    if (--entry.refs > 0) return;
+
+    mIDs.erase(entry.str);
+    entry.str = String();
+    mFreeEntries.push_back(id);
+}
+
+
+// LocationSubscriptionState
+
+LocationSubscriptionState::LocationSubscriptionState()
+ : epoch(0),
+   mesh(0),
+   physics(0),
+   version(1)
+{
+    for(uint32 i = 0; i < NumProperties; i++)
+        changed[i] = version;
+}
+
+void LocationSubscriptionState::setLocation(const TimedMotionVector3f& newval) {
+    if (newval.updateTime() == location.updateTime() &&
+        newval.position() == location.position() &&
+        newval.velocity() == location.velocity())
+        return;
+    location = newval;
+    touch(Location);
+}
+
+void LocationSubscriptionState::setOrientation(const TimedMotionQuaternion& newval) {
+    if (newval.updateTime() == orientation.updateTime() &&
+        newval.position() == orientation.position() &&
+        newval.velocity() == orientation.velocity())
+        return;
+    orientation = newval;
+    touch(Orientation);
+}
+
+void LocationSubscriptionState::setBounds(const AggregateBoundingInfo& newval) {
+    // AggregateBoundingInfo's comparison isn't const
+    AggregateBoundingInfo cmp(newval);
+    if (cmp == bounds) return;
+    bounds = newval;
+    touch(Bounds);
+}
+
+void LocationSubscriptionState::setQueryData(const String& newval) {
+    if (newval == query_data) return;
+    query_data = newval;
+    touch(QueryData);
+}
+
+
+// LocationSubscriberInfo
+
+LocationSubscriberInfo::LocationSubscriberInfo(SeqNoPtr seq_number_ptr)
+ : seqnoPtr(seq_number_ptr),
+   numSubscribed(0),
+   encoding(LocUpdateEncodingFull),
+   frameOrigin(0, 0, 0),
+   hasFrameOrigin(false),
+   resync(false),
+   registrySlot(0)
+{
+}
+
+LocationSubscriberInfo::~LocationSubscriberInfo() {
+}
+
+
+// LocationSubscriptionWorkers
+
+namespace {
+
+// One call to LocationSubscriptionWorkers::run(). Helpers posted to the
+// IOService may only get to run after it has returned, so they hold a
+// reference to keep this alive and find nothing left to do.
+struct WorkerRound {
+    WorkerRound(const std::vector<Network::IOCallback>& _jobs)
+     : jobs(_jobs),
+       next(0),
+       running(0)
+    {}
+
+    // Claim and run one job, returning false if none were left
+    bool runNext() {
+        uint32 idx;
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (next >= jobs.size())
+                return false;
+            idx = next++;
+            running++;
+        }
+        jobs[idx]();
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            if (--running == 0 && next >= jobs.size())
+                done.notify_all();
+        }
+        return true;
+    }
+
+    void waitForRunning() {
+        boost::mutex::scoped_lock lock(mutex);
+        while(running > 0)
+            done.wait(lock);
+    }
+
+    std::vector<Network::IOCallback> jobs;
+    boost::mutex mutex;
+    boost::condition_variable done;
+    uint32 next;
+    uint32 running;
+};
+typedef std::tr1::shared_ptr<WorkerRound> WorkerRoundPtr;
+
+void runWorkerRound(WorkerRoundPtr round) {
+    while(round->runNext()) {}
+}
+
+} // namespace
+
+LocationSubscriptionWorkers::LocationSubscriptionWorkers(Network::IOService* service, uint32 parallelism)
+ : mService(service),
+   mParallelism(service != NULL ? parallelism : 0)
+{
+}
+
+void LocationSubscriptionWorkers::run(const std::vector<Network::IOCallback>& jobs) {
+    if (jobs.empty()) return;
+    if (mParallelism == 0 || jobs.size() == 1) {
+        for(uint32 i = 0; i < jobs.size(); i++)
+            jobs[i]();
+        return;
+    }
+
+    WorkerRoundPtr round(new WorkerRound(jobs));
+    uint32 helpers = std::min<uint32>(mParallelism, jobs.size() - 1);
+    for(uint32 i = 0; i < helpers; i++)
+        mService->post(std::tr1::bind(&runWorkerRound, round), "LocationSubscriptionWorkers::run");
+    // The caller does a share of the work instead of just waiting, and ends
+    // up doing all of it if the IOService's threads are busy
+    runWorkerRound(round);
+    round->waitForRunning();
+}
+
+
+// LocationSubscriptionIndexBase
+
+LocationSubscriptionIndexBase::LocationSubscriptionIndexBase(bool include_all_data, AtomicValue<uint32>& _sent_count)
+ : send_all_data(include_all_data),
+   sent_count(_sent_count),
+   compact_position_resolution(0.001f),
+   compact_velocity_resolution(0.001f)
+{
+}
+
+LocationSubscriptionIndexBase::~LocationSubscriptionIndexBase() {
+}
+
+void LocationSubscriptionIndexBase::setCompactResolution(float32 position, float32 velocity) {
+    compact_position_resolution = position;
+    compact_velocity_resolution = velocity;
+}
+
+void LocationSubscriptionIndexBase::addSubscriber(const SubscriberInfoPtr& sub_info) {
+    sub_info->registrySlot = mSubscribers.size();
+    mSubscribers.push_back(sub_info);
+}
+
+void LocationSubscriptionIndexBase::removeSubscriber(SubscriberInfo* sub_info) {
+    subscriberRemoved(sub_info);
+
+    uint32 slot = sub_info->registrySlot;
+    assert(slot < mSubscribers.size() && mSubscribers[slot].get() == sub_info);
+    if (slot != mSubscribers.size() - 1) {
+        mSubscribers[slot] = mSubscribers.back();
+        mSubscribers[slot]->registrySlot = slot;
+    }
+    mSubscribers.pop_back();
+}
+
+void LocationSubscriptionIndexBase::maybeRemoveSubscriber(SubscriberInfo* sub_info) {
+    if (sub_info->noSubscriptionsLeft() && sub_info->outstandingUpdates.empty())
+        removeSubscriber(sub_info);
+}
+
+void LocationSubscriptionIndexBase::setSubscriberEncoding(SubscriberInfo* sub_info, LocUpdateEncoding encoding) {
+    if (sub_info->encoding == encoding) return;
+    sub_info->encoding = encoding;
+    // Anything the subscriber has came in the other encoding, so start
+    // over with complete updates
+    sub_info->resync = true;
+    maybeRemoveSubscriber(sub_info);
+}
+
+void LocationSubscriptionIndexBase::addSubscription(SubscriberInfo* sub_info, const UUID& uuid, ProxIndexID* index_id, LocationSubscriptionSource* locservice) {
+    uint32 obj_id = acquireObject(uuid);
+    LocationSubscriptionObject& obj = mObjects[obj_id];
+
+    // Add object to subscriber's list, tracking which index it's in
+    SubscriberInfo::Subscription& subscription = sub_info->subscriptions[obj_id];
+    if (!subscription.subscribed) {
+        subscription.subscribed = true;
+        sub_info->numSubscribed++;
+
+        // And add the subscriber to the object's list
+        subscription.slot = obj.subscribers.size();
+        obj.subscribers.push_back(sub_info);
+    }
+    else {
+        // If we already have an entry for this subscriber then either
+        // subscribing w/o indices (must have empty list of indices) or
+        // w/ indices (if we already have an entry, the set must be
+        // non-empty).
+        assert((index_id == NULL && subscription.indexes.empty()) ||
+            (index_id != NULL && !subscription.indexes.empty()));
+    }
+    // If we are using indices, add this to the list
+    if (index_id != NULL)
+        subscription.indexes.insert(*index_id);
+    // The subscriber may have dropped its copy of the object, so
+    // compact updates need to start from scratch
+    subscription.sentVersion = 0;
+
+    // Force an update. This is necessary because the subscription comes
+    // in asynchronously from Proximity, so its possible the data sent
+    // with the origin subscription is out of date by the time this
+    // subscription occurs. Forcing an extra update handles this case.
+    refreshState(obj_id, locservice);
+    queueUpdate(sub_info, subscription, obj_id);
+}
+
+void LocationSubscriptionIndexBase::removeSubscription(SubscriberInfo* sub_info, const UUID& uuid, ProxIndexID* index_id) {
+    ObjectIDMap::iterator id_it = mObjectIDs.find(uuid);
+    if (id_it == mObjectIDs.end()) return;
+
+    SubscriberInfo::SubscriptionMap::iterator subscription_it = sub_info->subscriptions.find(id_it->second);
+    if (subscription_it == sub_info->subscriptions.end() || !subscription_it->second.subscribed)
+        return;
+
+    if (index_id != NULL) {
+        // If we're using indexes, erase the index and only completely
+        // remove the object as being tracked if we hit no indices marked
+        // as still tracking
+        subscription_it->second.indexes.erase(*index_id);
+        if (!subscription_it->second.indexes.empty())
+            return;
+    }
+    // Otherwise, we have one implicit index we're tracking. This call is
+    // enough to remove it since we can only have 1 subscription to it
+    dropSubscription(sub_info, subscription_it);
+    maybeRemoveSubscriber(sub_info);
+}
+
+void LocationSubscriptionIndexBase::removeAllSubscriptions(SubscriberInfo* sub_info) {
+    // Remove this subscriber from every object it's observing
+    for(SubscriberInfo::SubscriptionMap::iterator subscription_it = sub_info->subscriptions.begin(); subscription_it != sub_info->subscriptions.end(); subscription_it++) {
+        if (subscription_it->second.subscribed)
+            detach(sub_info, subscription_it->first, subscription_it->second.slot);
+    }
+    sub_info->subscriptions.clear();
+    sub_info->numSubscribed = 0;
+
+    // Just drop any outstanding updates we have left. They
+    // are useless if we're using tree replication since we
+    // just destroyed the information about indices the
+    // updates apply to. Even in basic queries, this doesn't
+    // matter because the querier will just be left with stale
+    // data, which they would have been anyway.
+    for(uint32 i = 0; i < sub_info->outstandingUpdates.size(); i++)
+        releaseQueued(sub_info->outstandingUpdates[i]);
+    sub_info->outstandingUpdates.clear();
+
+    // Keep the entry if it's only recording the encoding
+    if (sub_info->noSubscriptionsLeft())
+        removeSubscriber(sub_info);
+}
+
+uint32 LocationSubscriptionIndexBase::acquireObject(const UUID& uuid) {
+    ObjectIDMap::iterator id_it = mObjectIDs.find(uuid);
+    if (id_it != mObjectIDs.end())
+        return id_it->second;
+
+    uint32 obj_id;
+    if (!mFreeObjects.empty()) {
+        obj_id = mFreeObjects.back();
+        mFreeObjects.pop_back();
+    }
+    else {
+        obj_id = mObjects.size();
+        mObjects.push_back(LocationSubscriptionObject());
+    }
+    mObjects[obj_id].uuid = uuid;
+    mObjectIDs.insert(ObjectIDMap::value_type(uuid, obj_id));
+    return obj_id;
+}
+
+void LocationSubscriptionIndexBase::maybeReleaseObject(uint32 obj_id) {
+    LocationSubscriptionObject& obj = mObjects[obj_id];
+    if (!obj.subscribers.empty() || obj.pending != 0)
+        return;
+
+    mObjectIDs.erase(obj.uuid);
+    mStrings.release(obj.state.mesh);
+    mStrings.release(obj.state.physics);
+    obj.state = LocationSubscriptionState();
+    mFreeObjects.push_back(obj_id);
+}
+
+bool LocationSubscriptionIndexBase::beginUpdate(const UUID& uuid, LocationSubscriptionSource* locservice, uint32* obj_id_out) {
+    ObjectIDMap::iterator id_it = mObjectIDs.find(uuid);
+    if (id_it == mObjectIDs.end() || mObjects[id_it->second].subscribers.empty())
+        return false;
+    refreshState(id_it->second, locservice);
+    *obj_id_out = id_it->second;
+    return true;
+}
+
+// A full snapshot is only needed when nobody has an update queued, since the
+// state is kept current by applying each property update while anyone does.
+void LocationSubscriptionIndexBase::refreshState(uint32 obj_id, LocationSubscriptionSource* locservice) {
+    LocationSubscriptionObject& obj = mObjects[obj_id];
+    const UUID& uuid = obj.uuid;
+    UpdateInfo& ui = obj.state;
+    if (obj.pending == 0) {
+        ui.setLocation(locservice->location(uuid));
+        ui.setBounds(locservice->bounds(uuid));
+        setString(ui, ui.mesh, UpdateInfo::Mesh, locservice->mesh(uuid));
+        ui.setOrientation(locservice->orientation(uuid));
+        setString(ui, ui.physics, UpdateInfo::Physics, locservice->physics(uuid));
+        // Don't bother copying possibly big data if not necessary
+        if (send_all_data)
+            ui.setQueryData(locservice->queryData(uuid));
+    }
+    ui.epoch = locservice->epoch(uuid);
+}
+
+void LocationSubscriptionIndexBase::setString(LocationSubscriptionState& ui, uint32& field, LocationSubscriptionState::Property prop, const String& newval) {
+    if (mStrings.get(field) == newval) return;
+    uint32 id = mStrings.intern(newval);
+    mStrings.release(field);
+    field = id;
+    ui.touch(prop);
+}
+
+void LocationSubscriptionIndexBase::queueUpdates(uint32 obj_id) {
+    LocationSubscriptionObject& obj = mObjects[obj_id];
+    for(uint32 i = 0; i < obj.subscribers.size(); i++) {
+        SubscriberInfo* sub_info = obj.subscribers[i];
+        SubscriberInfo::SubscriptionMap::iterator subscription_it = sub_info->subscriptions.find(obj_id);
+        assert(subscription_it != sub_info->subscriptions.end());
+        queueUpdate(sub_info, subscription_it->second, obj_id);
+    }
+}
+
+void LocationSubscriptionIndexBase::locationUpdated(const UUID& uuid, const TimedMotionVector3f& newval, LocationSubscriptionSource* locservice) {
+    uint32 obj_id;
+    if (!beginUpdate(uuid, locservice, &obj_id)) return;
+    mObjects[obj_id].state.setLocation(newval);
+    queueUpdates(obj_id);
+}
+
+void LocationSubscriptionIndexBase::orientationUpdated(const UUID& uuid, const TimedMotionQuaternion& newval, LocationSubscriptionSource* locservice) {
+    uint32 obj_id;
+    if (!beginUpdate(uuid, locservice, &obj_id)) return;
+    mObjects[obj_id].state.setOrientation(newval);
+    queueUpdates(obj_id);
+}
+
+void LocationSubscriptionIndexBase::boundsUpdated(const UUID& uuid, const AggregateBoundingInfo& newval, LocationSubscriptionSource* locservice) {
+    uint32 obj_id;
+    if (!beginUpdate(uuid, locservice, &obj_id)) return;
+    mObjects[obj_id].state.setBounds(newval);
+    queueUpdates(obj_id);
+}
+
+void LocationSubscriptionIndexBase::meshUpdated(const UUID& uuid, const String& newval, LocationSubscriptionSource* locservice) {
+    uint32 obj_id;
+    if (!beginUpdate(uuid, locservice, &obj_id)) return;
+    UpdateInfo& ui = mObjects[obj_id].state;
+    setString(ui, ui.mesh, UpdateInfo::Mesh, newval);
+    queueUpdates(obj_id);
+}
+
+void LocationSubscriptionIndexBase::physicsUpdated(const UUID& uuid, const String& newval, LocationSubscriptionSource* locservice) {
+    uint32 obj_id;
+    if (!beginUpdate(uuid, locservice, &obj_id)) return;
+    UpdateInfo& ui = mObjects[obj_id].state;
+    setString(ui, ui.physics, UpdateInfo::Physics, newval);
+    queueUpdates(obj_id);
+}
+
+void LocationSubscriptionIndexBase::queryDataUpdated(const UUID& uuid, const String& newval, LocationSubscriptionSource* locservice) {
+    // Don't bother copying possibly big data if not necessary
+    if (!send_all_data) return;
+
+    uint32 obj_id;
+    if (!beginUpdate(uuid, locservice, &obj_id)) return;
+    mObjects[obj_id].state.setQueryData(newval);
+    queueUpdates(obj_id);
+}
+
+// Start compact updates for every subscribed object over from scratch
+void LocationSubscriptionIndexBase::resyncSubscriber(SubscriberInfo* sub_info) {
+    for(SubscriberInfo::SubscriptionMap::iterator subscription_it = sub_info->subscriptions.begin(); subscription_it != sub_info->subscriptions.end(); subscription_it++) {
+        subscription_it->second.sentVersion = 0;
+        if (!subscription_it->second.subscribed) continue;
+        queueUpdate(sub_info, subscription_it->second, subscription_it->first);
+    }
+}
+
+void LocationSubscriptionIndexBase::queueUpdate(SubscriberInfo* sub_info, SubscriberInfo::Subscription& subscription, uint32 obj_id) {
+    if (subscription.queued) return;
+    subscription.queued = true;
+    sub_info->outstandingUpdates.push_back(obj_id);
+    mObjects[obj_id].pending++;
+}
+
+void LocationSubscriptionIndexBase::dropSubscription(SubscriberInfo* sub_info, SubscriberInfo::SubscriptionMap::iterator subscription_it) {
+    uint32 obj_id = subscription_it->first;
+    uint32 slot = subscription_it->second.slot;
+    subscription_it->second.subscribed = false;
+    subscription_it->second.indexes.clear();
+    sub_info->numSubscribed--;
+    // Keep the entry around if an update is still queued for it
+    if (!subscription_it->second.queued)
+        sub_info->subscriptions.erase(subscription_it);
+    detach(sub_info, obj_id, slot);
+}
+
+// Remove a subscriber from an object's subscriber list
+void LocationSubscriptionIndexBase::detach(SubscriberInfo* sub_info, uint32 obj_id, uint32 slot) {
+    std::vector<SubscriberInfo*>& subs = mObjects[obj_id].subscribers;
+    assert(slot < subs.size() && subs[slot] == sub_info);
+    if (slot != subs.size() - 1) {
+        subs[slot] = subs.back();
+        SubscriberInfo::SubscriptionMap::iterator moved_it = subs[slot]->subscriptions.find(obj_id);
+        assert(moved_it != subs[slot]->subscriptions.end());
+        moved_it->second.slot = slot;
+    }
+    subs.pop_back();
+    maybeReleaseObject(obj_id);
+}
+
+void LocationSubscriptionIndexBase::releaseQueued(uint32 obj_id) {
+    mObjects[obj_id].pending--;
+    maybeReleaseObject(obj_id);
+}
+
+// Clear the first count queued updates for a subscriber. If they were
+// delivered, the state they carried is what the subscriber now has.
+void LocationSubscriptionIndexBase::releaseSent(SubscriberInfo* sub_info, uint32 count, bool delivered) {
+    if (count == 0) return;
+    for(uint32 i = 0; i < count; i++) {
+        uint32 obj_id = sub_info->outstandingUpdates[i];
+        SubscriberInfo::SubscriptionMap::iterator subscription_it = sub_info->subscriptions.find(obj_id);
+        assert(subscription_it != sub_info->subscriptions.end());
+        subscription_it->second.queued = false;
+        if (delivered)
+            subscription_it->second.sentVersion = subscription_it->second.buildVersion;
+        if (!subscription_it->second.subscribed)
+            sub_info->subscriptions.erase(subscription_it);
+        releaseQueued(obj_id);
+    }
+    sub_info->outstandingUpdates.erase(sub_info->outstandingUpdates.begin(), sub_info->outstandingUpdates.begin() + count);
+}
+
+void LocationSubscriptionIndexBase::service(uint32 max_updates, LocationSubscriptionWorkers* workers) {
+    if (max_updates == 0) max_updates = 1;
+
+    // Decide what to build. Validity checks and cleanup of dead
+    // subscribers stay on this thread since they touch the parent. Jobs are
+    // dealt out to shards in turn so each gets a similar amount of work.
+    uint32 njobs = 0;
+    for(uint32 i = 0; i < mSubscribers.size(); ) {
+        SubscriberInfo* sub_info = mSubscribers[i].get();
+
+        // We can end up with leftover updates after a subscriber has
+        // already disconnected. We need to ignore them if we're not
+        // even going to be able to send the messages.
+        if (!validSubscriber(sub_info)) {
+            releaseSent(sub_info, sub_info->outstandingUpdates.size(), false);
+            if (sub_info->numSubscribed == 0) {
+                // Moves the last subscriber into this slot
+                removeSubscriber(sub_info);
+                continue;
+            }
+            i++;
+            continue;
+        }
+        const SubscriberInfoPtr& sub_ptr = mSubscribers[i++];
+
+        if (sub_info->resync) {
+            sub_info->resync = false;
+            if (sub_info->encoding != LocUpdateEncodingFull)
+                resyncSubscriber(sub_info);
+        }
+
+        if (sub_info->outstandingUpdates.empty())
+            continue;
+
+        long in_flight = numOutstandingMessages(sub_ptr);
+        if (in_flight >= outstanding_message_soft_limit)
+            continue;
+
+        JobList& jobs = mJobs[njobs++ % LOC_SUBSCRIPTION_SHARDS];
+        jobs.push_back(Job());
+        Job& job = jobs.back();
+        job.sub_info = sub_ptr;
+        job.max_messages = outstanding_message_soft_limit - in_flight;
+    }
+
+    // Build messages in parallel
+    std::vector<Network::IOCallback> build_jobs;
+    for(uint32 s = 0; s < LOC_SUBSCRIPTION_SHARDS; s++) {
+        if (!mJobs[s].empty())
+            build_jobs.push_back(std::tr1::bind(&LocationSubscriptionIndexBase::buildShard, this, s, max_updates));
+    }
+    if (workers != NULL)
+        workers->run(build_jobs);
+    else
+        for(uint32 i = 0; i < build_jobs.size(); i++) build_jobs[i]();
+
+    // And send them, stopping for a subscriber at the first failure
+    for(uint32 s = 0; s < LOC_SUBSCRIPTION_SHARDS; s++) {
+        for(JobList::iterator job_it = mJobs[s].begin(); job_it != mJobs[s].end(); job_it++) {
+            Job& job = *job_it;
+            SubscriberInfo* sub_info = job.sub_info.get();
+            uint32 shipped = 0;
+            for(uint32 m = 0; m < job.messages.size(); m++) {
+                if (!trySend(job.sub_info, job.messages[m]))
+                    break;
+                sent_count++;
+                shipped = job.message_ends[m];
+            }
+            // Finally clear out any entries successfully sent out
+            releaseSent(sub_info, shipped, true);
+            maybeRemoveSubscriber(sub_info);
+        }
+        mJobs[s].clear();
+    }
+}
+
+// Build messages for all the jobs in one shard. This may run on a worker
+// thread, so it only reads the index and touches per-subscriber state owned
+// by the job.
+void LocationSubscriptionIndexBase::buildShard(uint32 shard, uint32 max_updates) {
+    for(JobList::iterator job_it = mJobs[shard].begin(); job_it != mJobs[shard].end(); job_it++)
+        buildMessages(*job_it, max_updates);
+}
+
+void LocationSubscriptionIndexBase::buildMessages(Job& job, uint32 max_updates) {
+    SubscriberInfo* sub_info = job.sub_info.get();
+    if (sub_info->encoding == LocUpdateEncodingCompact) {
+        buildCompactMessages(job, max_updates);
+        return;
+    }
+    const std::vector<uint32>& queued = sub_info->outstandingUpdates;
+
+    uint32 idx = 0;
+    while(idx < queued.size() && (long)job.messages.size() < job.max_messages) {
+        Sirikata::Protocol::Loc::BulkLocationUpdate bulk_update;
+        for(uint32 count = 0; count < max_updates && idx < queued.size(); count++, idx++) {
+            uint32 obj_id = queued[idx];
+            const LocationSubscriptionObject& obj = mObjects[obj_id];
+            const UpdateInfo& ui = obj.state;
+
+            Sirikata::Protocol::Loc::ILocationUpdate update = bulk_update.add_update();
+            update.set_object(obj.uuid);
+
+            //write and update sequence number
+            update.set_seqno( (*(sub_info->seqnoPtr)) ++ );
+
+            if (isSelfSubscriber(sub_info, obj.uuid))
+                update.set_epoch(ui.epoch);
+
+            // If we're tracking indexes (tree replication), add the
+            // list in
+            SubscriberInfo::SubscriptionMap::iterator subscription_it = sub_info->subscriptions.find(obj_id);
+            if (subscription_it != sub_info->subscriptions.end()) {
+                const SubscriberInfo::ProxIndexSet& indexes = subscription_it->second.indexes;
+                for (SubscriberInfo::ProxIndexSet::const_iterator prox_idx_it = indexes.begin(); prox_idx_it != indexes.end(); prox_idx_it++)
+                    update.add_index_id((uint32)*prox_idx_it);
+            }
+
+            Sirikata::Protocol::ITimedMotionVector location = update.mutable_location();
+            location.set_t(ui.location.updateTime());
+            location.set_position(ui.location.position());
+            location.set_velocity(ui.location.velocity());
+
+            Sirikata::Protocol::ITimedMotionQuaternion orientation = update.mutable_orientation();
+            orientation.set_t(ui.orientation.updateTime());
+            orientation.set_position(ui.orientation.position());
+            orientation.set_velocity(ui.orientation.velocity());
+
+            Sirikata::Protocol::IAggregateBoundingInfo msg_bounds = update.mutable_aggregate_bounds();
+            msg_bounds.set_center_offset(ui.bounds.centerOffset);
+            msg_bounds.set_center_bounds_radius(ui.bounds.centerBoundsRadius);
+            msg_bounds.set_max_object_size(ui.bounds.maxObjectRadius);
+
+            update.set_mesh(mStrings.get(ui.mesh));
+            update.set_physics(mStrings.get(ui.physics));
+            // Don't bother copying possibly big data if not necessary
+            if (send_all_data)
+                update.set_query_data(ui.query_data);
+        }
+        job.messages.push_back(serializePBJMessage(bulk_update));
+        job.message_ends.push_back(idx);
+    }
+}
+
+// Like buildMessages, but each update only includes the properties which
+// changed since the subscriber's last update for the object
+void LocationSubscriptionIndexBase::buildCompactMessages(Job& job, uint32 max_updates) {
+    typedef LocationSubscriptionState State;
+    SubscriberInfo* sub_info = job.sub_info.get();
+    const std::vector<uint32>& queued = sub_info->outstandingUpdates;
+
+    if (!sub_info->hasFrameOrigin && !queued.empty()) {
+        sub_info->frameOrigin = mObjects[queued[0]].state.location.position();
+        sub_info->hasFrameOrigin = true;
+    }
+
+    uint32 idx = 0;
+    while(idx < queued.size() && (long)job.messages.size() < job.max_messages) {
+        CompactLocUpdateEncoder encoder(sub_info->frameOrigin, compact_position_resolution, compact_velocity_resolution);
+        for(uint32 count = 0; count < max_updates && idx < queued.size(); count++, idx++) {
+            uint32 obj_id = queued[idx];
+            const LocationSubscriptionObject& obj = mObjects[obj_id];
+            const UpdateInfo& ui = obj.state;
+            SubscriberInfo::SubscriptionMap::iterator subscription_it = sub_info->subscriptions.find(obj_id);
+            assert(subscription_it != sub_info->subscriptions.end());
+            SubscriberInfo::Subscription& subscription = subscription_it->second;
+            uint32 since = subscription.sentVersion;
+            subscription.buildVersion = ui.version;
+
+            CompactLocationUpdate update;
+            update.object = obj.uuid;
+            update.seqno = (*(sub_info->seqnoPtr)) ++;
+
+            if (isSelfSubscriber(sub_info, obj.uuid)) {
+                update.fields |= CompactLocationUpdate::Epoch;
+                update.epoch = ui.epoch;
+            }
+            if (!subscription.indexes.empty()) {
+                update.fields |= CompactLocationUpdate::IndexIDs;
+                update.index_ids.assign(subscription.indexes.begin(), subscription.indexes.end());
+            }
+
+            if (ui.changedSince(State::Location, since)) {
+                update.fields |= CompactLocationUpdate::Location;
+                update.location = ui.location;
+            }
+            if (ui.changedSince(State::Orientation, since)) {
+                update.fields |= CompactLocationUpdate::Orientation;
+                update.orientation = ui.orientation;
+            }
+            if (ui.changedSince(State::Bounds, since)) {
+                update.fields |= CompactLocationUpdate::Bounds;
+                update.bounds = ui.bounds;
+            }
+            if (ui.changedSince(State::Mesh, since)) {
+                update.fields |= CompactLocationUpdate::Mesh;
+                update.mesh = mStrings.get(ui.mesh);
+            }
+            if (ui.changedSince(State::Physics, since)) {
+                update.fields |= CompactLocationUpdate::Physics;
+                update.physics = mStrings.get(ui.physics);
+            }
+            // Don't bother copying possibly big data if not necessary
+            if (send_all_data && ui.changedSince(State::QueryData, since)) {
+                update.fields |= CompactLocationUpdate::QueryData;
+                update.query_data = ui.query_data;
+            }
+
+            encoder.add(update);
+        }
+        job.messages.push_back(encoder.serialize());
+        job.message_ends.push_back(idx);
+        // Follow the objects so the next message's offsets stay small
+        sub_info->frameOrigin = encoder.centroid();
+    }
+}
+
+} // namespace Sirikata
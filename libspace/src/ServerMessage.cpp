@@ -32,6 +32,7 @@
 
 #include <sirikata/space/ServerMessage.hpp>
 #include <sirikata/space/SpaceContext.hpp>
+#include <sirikata/core/network/Frame.hpp>
 
 namespace Sirikata {
 
@@ -120,6 +121,31 @@ Message* Message::deserialize(const Network::Chunk& wire) {
     return result;
 }
 
+bool Message::serializeFramed(Network::Chunk* output) const {
+    uint32 start = output->size();
+    // Recompute rather than trusting mCachedSize, the message may have been
+    // modified since it was last measured
+    uint32 msg_size = mCachedSize = mImpl.ByteSize();
+    uint8* dest = Network::Frame::append(output, msg_size);
+    if (!mImpl.SerializeToArray(dest, msg_size)) {
+        output->resize(start);
+        return false;
+    }
+    return true;
+}
+
+Message* Message::deserialize(const uint8* data, uint32 size) {
+    Message* result = new Message();
+    bool parsed = result->ParseFromArray(data, size);
+    if (!parsed) {
+        SILOG(msg,warning,"Couldn't parse message.");
+        delete result;
+        return NULL;
+    }
+    result->mCachedSize = size;
+    return result;
+}
+
 uint32 Message::serializedSize() const {
     if (mCachedSize != 0)
         return mCachedSize;
@@ -203,6 +203,25 @@ CREATE_TRACE_DEF(SpaceTrace, osegCumulativeResponse, mLogOSegCumulative, const T
     mTrace->writeRecord(OSegCumulativeTraceAnalysisTag, rec);
 }
 
+// Summaries of lookups over an interval are written as CumulativeResponses
+// without per-lookup timing data so they share the same trace path.
+CREATE_TRACE_DEF(SpaceTrace, osegLookupLatency, mLogOSegCumulative, const Time &t, const ServerID& sID, const std::vector<uint64>& bucket_bounds, const std::vector<uint64>& bucket_counts, uint64 batches, uint64 batched_lookups, uint64 not_found_hits)
+{
+    Sirikata::Trace::OSeg::CumulativeResponse rec;
+    rec.set_t(t);
+    rec.set_lookup_server(sID);
+
+    for(uint32 i = 0; i < bucket_bounds.size() && i < bucket_counts.size(); i++) {
+        rec.add_latency_bucket_bound(bucket_bounds[i]);
+        rec.add_latency_bucket_count(bucket_counts[i]);
+    }
+    rec.set_lookup_batches(batches);
+    rec.set_batched_lookups(batched_lookups);
+    rec.set_negative_cache_hits(not_found_hits);
+
+    mTrace->writeRecord(OSegCumulativeTraceAnalysisTag, rec);
+}
+
 // Migration
 
 CREATE_TRACE_DEF(SpaceTrace, objectBeginMigrate, mLogMigration, const Time& t, const UUID& obj_id, const ServerID migrate_from, const ServerID migrate_to) {
@@ -79,7 +79,7 @@ class FlowFairness:
 
         cc - ClusterConfig
         cs - ClusterSimSettings
-        scheme - the fairness scheme used.  Current valid values are 'region' and 'csfq'.
+        scheme - the fairness scheme used.  Current valid values are 'region', 'csfq' and 'drr'.
         payload - size of ping payloads
         local - force messages to be to local objects
         """
@@ -0,0 +1,95 @@
+#!/usr/bin/python
+
+# forwarding_throughput.py
+#
+# Runs the deluge scenario with all traffic originating away from the
+# flooded server, so every ping has to pass through the forwarders, at
+# increasing rates and with different numbers of forwarder routing
+# strands. The flow stats analysis for each run shows the rate actually
+# achieved, so the point at which each configuration stops keeping up with
+# the offered load is its forwarding throughput.
+#
+# Usage: forwarding_throughput.py strands1,strands2,... rate1 rate2 ...
+
+import sys
+import subprocess
+import os.path
+
+# FIXME It would be nice to have a better way of making this script able to find
+# other modules in sibling packages
+sys.path.insert(0, sys.path[0]+"/..")
+
+import util.stdio
+from cluster.config import ClusterConfig
+from cluster.sim import ClusterSimSettings,ClusterSim
+import flow_fairness
+
+def get_logfile_name(strands, rate):
+    return 'forwarding_throughput.log.' + str(strands) + '.' + str(rate)
+
+def get_flowstats_name(strands, rate):
+    return 'forwarding_throughput.stats.' + str(strands) + '.' + str(rate)
+
+class ForwardingThroughput(flow_fairness.FlowFairness):
+    def __init__(self, cc, cs, strands, payload=1024):
+        flow_fairness.FlowFairness.__init__(self, cc, cs, scheme='region', payload=payload, local=False)
+        self.strands = strands
+
+    def _setup_cluster_sim(self, rate, io):
+        self.cs.forwarder_routing_strands = self.strands
+        return flow_fairness.FlowFairness._setup_cluster_sim(self, rate, io)
+
+    def analysis(self, io=util.stdio.StdIO()):
+        rate = self._last_rate
+        cluster_sim = self._setup_cluster_sim(rate, io)
+        flow_fairness.run_flow_stats_analysis(cluster_sim,
+                                              get_logfile_name(self.strands, rate),
+                                              get_flowstats_name(self.strands, rate)
+                                              )
+
+
+if __name__ == "__main__":
+    nss = 4
+    nobjects = 1000 * nss
+    packname = 'forwarding_objects.pack'
+    numoh = 2
+
+    cc = ClusterConfig()
+    cs = ClusterSimSettings(cc, nss, (nss,1), numoh)
+
+    cs.debug = False
+    cs.valgrind = False
+    cs.profile = False
+    cs.oprofile = False
+
+    cs.loc = 'standard'
+    cs.blocksize = 110
+    # Keep the network out of the way so the forwarders are the bottleneck
+    cs.tx_bandwidth = 500000000
+    cs.rx_bandwidth = 500000000
+
+    # Large enough that lookups stay off the critical path after warmup
+    cs.oseg_cache_size = 65536
+    cs.oseg_cache_selector = 'cache_clock'
+    cs.oseg_cache_entry_lifetime = "1000s"
+
+    # Use pack across multiple ohs
+    cs.num_random_objects = 0
+    cs.num_pack_objects = nobjects / cs.num_oh
+    cs.object_pack = packname
+    cs.pack_dump = True
+
+    cs.object_connect_phase = '20s'
+
+    cs.object_static = 'static'
+    cs.object_query_frac = 0.0
+
+    cs.duration = '100s'
+
+    strand_counts = [int(x) for x in sys.argv[1].split(',')]
+    rates = sys.argv[2:]
+    for strands in strand_counts:
+        plan = ForwardingThroughput(cc, cs, strands)
+        for rate in rates:
+            plan.run(rate)
+            plan.analysis()
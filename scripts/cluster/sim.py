@@ -43,6 +43,7 @@ class ClusterSimSettings:
         self.server_queue = 'fair'
         self.server_queue_length = 8192
         self.odp_flow_scheduler = 'region'
+        self.forwarder_routing_strands = 4
 
         # OH: basic oh settings
         self.num_oh = num_object_hosts
@@ -258,6 +259,7 @@ class ClusterSim:
             'server.queue' : "--server.queue=" + self.settings.server_queue,
             'server.queue.length' : "--server.queue.length=" + str(self.settings.server_queue_length),
             'server.odp.flowsched' : "--server.odp.flowsched=" + self.settings.odp_flow_scheduler,
+            'forwarder.routing-strands' : "--forwarder.routing-strands=" + str(self.settings.forwarder_routing_strands),
             'loc' : "--loc=" + self.settings.loc,
             'cseg' : "--cseg=" + self.settings.cseg,
             'cseg-service-host' : "--cseg-service-host=" + self.settings.cseg_service_host,
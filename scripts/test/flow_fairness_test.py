@@ -16,7 +16,7 @@ class FlowFairnessTest(ClusterSimTest):
         """
         name: Name of the test
         rate: Ping rate to test with
-        scheme: Fairness scheme to use. ('region', 'csfq')
+        scheme: Fairness scheme to use. ('region', 'csfq', 'drr')
         payload: Size of ping payloads
         local: Whether only local messages should be generated, False by default
         Others: see ClusterSimTest.__init__
@@ -348,36 +348,10 @@ float CSFQODPFlowScheduler::totalReceiverUsedWeight() {
     return mTotalUsedWeight[RECEIVER];
 }
 
-BoundingBox3f CSFQODPFlowScheduler::getObjectWeightRegion(const UUID& objid, const OSegEntry& info) const {
-    // We might have exact info
-    if (mLoc->contains(objid)) {
-        Vector3f pos = mLoc->currentPosition(objid);
-        BoundingSphere3f bounds = mLoc->bounds(objid).fullBounds();
-        BoundingBox3f bb(pos + bounds.center(), bounds.radius());
-        return bb;
-    }
-
-    if (info.server() == mContext->id())
-        CSFQLOG(warn,"Using approximation for local object!");
-    if (info.radius()==1.0) {
-        CSFQLOG(warn,"Radius approximation failure! (migration? should we do a cache lookup)");
-    }
-    // Otherwise, we need to use server info
-    // Blech, why is this a bbox list?
-    BoundingBoxList server_bbox_list = mContext->cseg()->serverRegion(info.server());
-    BoundingBox3f server_bbox = BoundingBox3f::null();
-    for(uint32 i = 0; i < server_bbox_list.size(); i++)
-        server_bbox.mergeIn(server_bbox_list[i]);
-    return BoundingBox3f(server_bbox.center(), info.radius());
-}
-
 CSFQODPFlowScheduler::FlowInfo* CSFQODPFlowScheduler::getFlow(const ObjectPair& new_packet_pair, const OSegEntry&source_info, const OSegEntry&dst_info, const Time& t) {
     FlowMap::iterator where = mFlows.find(new_packet_pair);
     if (where==mFlows.end()) {
-        BoundingBox3f source_bbox = getObjectWeightRegion(new_packet_pair.source, source_info);
-        BoundingBox3f dest_bbox = getObjectWeightRegion(new_packet_pair.dest, dst_info);
-
-        double weight = mWeightCalculator->weight(source_bbox, dest_bbox);
+        double weight = flowWeight(mLoc, new_packet_pair, source_info, dst_info);
 
         std::pair<FlowMap::iterator, bool> ins_it = mFlows.insert(FlowMap::value_type(new_packet_pair,FlowInfo(weight, t)));
         assert(ins_it.second == true);
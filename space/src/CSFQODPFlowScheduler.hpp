@@ -77,30 +77,6 @@ private:
         NUM_DOWNSTREAM = 2
     };
 
-    struct ObjectPair {
-        ObjectPair(const UUID& s, const UUID& d)
-         : source(s), dest(d)
-        {}
-
-        bool operator<(const ObjectPair& rhs) const {
-            return (source < rhs.source || (source == rhs.source && dest < rhs.dest));
-        }
-
-        bool operator==(const ObjectPair& rhs) const {
-            return (source == rhs.source && dest == rhs.dest);
-        }
-
-        class Hasher {
-        public:
-            size_t operator() (const ObjectPair& op) const {
-                return *(uint32*)op.source.getArray().data() ^ *(uint32*)op.dest.getArray().data();
-            }
-        };
-
-        UUID source;
-        UUID dest;
-    };
-
     struct FlowInfo {
         FlowInfo(double w, const Time& start)
          : rate(0.0, start),
@@ -150,9 +126,6 @@ private:
     bool queueExceedsLowWaterMark() const { return true; } // Not necessary in our implementation
     double minCongestedAlpha() const { return mCapacityRate.get() / std::max(1, flowCount()); }
 
-    // Helper to get the region we compute weight over
-    BoundingBox3f getObjectWeightRegion(const UUID& objid, const OSegEntry& sid) const;
-
 
     boost::mutex mPushMutex;
 
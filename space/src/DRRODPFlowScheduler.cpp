@@ -0,0 +1,331 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "DRRODPFlowScheduler.hpp"
+#include <sirikata/core/trace/Trace.hpp>
+
+// Bytes per round given to a flow with the average weight of the backlogged
+// flows. Should be at least the size of a typical ODP message, otherwise flows
+// need several rounds to send one message.
+#define BASE_QUANTUM 1500
+// Very low weight flows still get this much per round so pop() doesn't spin
+#define MIN_QUANTUM 64
+#define INITIAL_RING_SIZE 4
+// Falloff for the arrival rate estimate, matches CSFQ
+#define ARRIVAL_RATE_FALLOFF (Duration::milliseconds((int64)200).toSeconds())
+// How long a flow has to be idle before we forget it (and its weight)
+#define FLOW_IDLE_TIMEOUT (Duration::seconds((int64)10))
+
+namespace Sirikata {
+
+DRRODPFlowScheduler::Flow::Flow(const ObjectPair& op, double w)
+ : id(op),
+   weight(w),
+   deficit(0),
+   queuedBytes(0),
+   ring(INITIAL_RING_SIZE),
+   head(0),
+   count(0),
+   nextActive(NULL),
+   active(false),
+   idleSince(Time::null()),
+   queuedForCollection(false)
+{
+}
+
+DRRODPFlowScheduler::Flow::~Flow() {
+    while(!queueEmpty())
+        delete queuePop().msg;
+}
+
+void DRRODPFlowScheduler::Flow::queuePush(const QueuedMessage& qm) {
+    if (count == ring.size()) {
+        // Grow by doubling, unwrapping the contents to start at 0
+        std::vector<QueuedMessage> bigger(ring.size() * 2);
+        for(uint32 i = 0; i < count; i++)
+            bigger[i] = ring[(head + i) & (ring.size()-1)];
+        ring.swap(bigger);
+        head = 0;
+    }
+    ring[(head + count) & (ring.size()-1)] = qm;
+    count++;
+    queuedBytes += qm.size;
+}
+
+DRRODPFlowScheduler::QueuedMessage DRRODPFlowScheduler::Flow::queuePop() {
+    QueuedMessage result = ring[head];
+    ring[head] = QueuedMessage();
+    head = (head + 1) & (ring.size()-1);
+    count--;
+    queuedBytes -= result.size;
+    return result;
+}
+
+
+DRRODPFlowScheduler::DRRODPFlowScheduler(SpaceContext* ctx, ForwarderServiceQueue* parent, ServerID sid, uint32 serv_id, uint32 max_size, LocationService* loc)
+ : ODPFlowScheduler(ctx, parent, sid, serv_id),
+   mLoc(loc),
+   mMaxSize(max_size),
+   mActiveHead(NULL),
+   mActiveTail(NULL),
+   mActiveCount(0),
+   mBackloggedWeight(0),
+   mFrontBuffer(),
+   mQueuedBytes(0),
+   mNeedsNotification(true),
+   mArrivalRate(ARRIVAL_RATE_FALLOFF),
+   mTotalActiveWeight(0)
+{
+}
+
+DRRODPFlowScheduler::~DRRODPFlowScheduler() {
+    delete mFrontBuffer.msg;
+    for(FlowMap::iterator it = mFlows.begin(); it != mFlows.end(); it++)
+        delete it->second;
+    mFlows.clear();
+}
+
+DRRODPFlowScheduler::Flow* DRRODPFlowScheduler::getFlow(const ObjectPair& op, const OSegEntry& src_info, const OSegEntry& dst_info, const Time& t) {
+    FlowMap::iterator where = mFlows.find(op);
+    if (where != mFlows.end())
+        return where->second;
+
+    Flow* flow = new Flow(op, flowWeight(mLoc, op, src_info, dst_info));
+    flow->idleSince = t;
+    mFlows[op] = flow;
+    mTotalActiveWeight += flow->weight;
+    // New flows only get queued for collection when they empty out, so make
+    // sure one that never gets a message through is still cleaned up
+    queueForCollection(flow, t);
+    return flow;
+}
+
+void DRRODPFlowScheduler::queueForCollection(Flow* flow, const Time& t) const {
+    if (flow->queuedForCollection)
+        return;
+    flow->queuedForCollection = true;
+    mIdleFlows.push_back(std::make_pair(flow->id, t));
+}
+
+void DRRODPFlowScheduler::collectIdleFlows(const Time& t) {
+    while(!mIdleFlows.empty()) {
+        const std::pair<ObjectPair, Time>& oldest = mIdleFlows.front();
+        if (t - oldest.second < FLOW_IDLE_TIMEOUT)
+            break;
+
+        FlowMap::iterator where = mFlows.find(oldest.first);
+        mIdleFlows.pop_front();
+        assert(where != mFlows.end());
+        Flow* flow = where->second;
+        flow->queuedForCollection = false;
+
+        // Backlogged flows get queued again when they empty out
+        if (flow->active || !flow->queueEmpty())
+            continue;
+
+        if (t - flow->idleSince >= FLOW_IDLE_TIMEOUT) {
+            mTotalActiveWeight -= flow->weight;
+            delete flow;
+            mFlows.erase(where);
+        }
+        else {
+            // Used since it was queued, check again a full timeout from now.
+            // Queueing at t rather than idleSince keeps mIdleFlows sorted.
+            queueForCollection(flow, t);
+        }
+    }
+    if (mFlows.empty()) mTotalActiveWeight = 0; // Clear accumulated rounding error
+}
+
+void DRRODPFlowScheduler::appendActive(Flow* flow) const {
+    flow->nextActive = NULL;
+    if (mActiveTail == NULL)
+        mActiveHead = flow;
+    else
+        mActiveTail->nextActive = flow;
+    mActiveTail = flow;
+}
+
+DRRODPFlowScheduler::Flow* DRRODPFlowScheduler::popActive() const {
+    Flow* flow = mActiveHead;
+    mActiveHead = flow->nextActive;
+    if (mActiveHead == NULL)
+        mActiveTail = NULL;
+    flow->nextActive = NULL;
+    return flow;
+}
+
+int64 DRRODPFlowScheduler::quantum(const Flow* flow) const {
+    // Normalize by the average backlogged weight so the total handed out per
+    // round stays around BASE_QUANTUM per flow whatever the weights' scale is
+    double mean_weight = mBackloggedWeight / std::max(mActiveCount, (uint32)1);
+    if (mean_weight <= 0) return BASE_QUANTUM;
+    return std::max((int64)(BASE_QUANTUM * flow->weight / mean_weight), (int64)MIN_QUANTUM);
+}
+
+bool DRRODPFlowScheduler::admit(const Flow* flow, uint32 packet_size) const {
+    if (mQueuedBytes + packet_size > mMaxSize)
+        return false;
+    // Once the buffer is half full, only flows within their weighted share of
+    // it get in, so a single heavy sender can't starve everybody else of
+    // buffer space
+    if (mQueuedBytes > mMaxSize / 2 && flow->active) {
+        double total_weight = mBackloggedWeight;
+        double share = (total_weight > 0) ? (mMaxSize * flow->weight / total_weight) : mMaxSize;
+        if (flow->queuedBytes + packet_size > share)
+            return false;
+    }
+    return true;
+}
+
+bool DRRODPFlowScheduler::push(Sirikata::Protocol::Object::ObjectMessage* msg, const OSegEntry& source_entry, const OSegEntry& dest_entry) {
+    bool notify = false;
+    {
+        boost::lock_guard<boost::mutex> lck(mMutex);
+
+        ObjectPair op(msg->source_object(), msg->dest_object());
+        Time curtime = mContext->recentSimTime();
+        collectIdleFlows(curtime);
+        Flow* flow = getFlow(op, source_entry, dest_entry, curtime);
+
+        // Priority computation failure...
+        if (!flow->weight)
+            return false;
+
+        uint32 packet_size = msg->ByteSize();
+        if (!admit(flow, packet_size)) {
+            TRACE_DROP(DROPPED_DRR_OVERFLOW);
+            return false;
+        }
+
+        mArrivalRate.estimate_rate(curtime, packet_size);
+
+        flow->queuePush(QueuedMessage(createMessageFromODP(msg, mDestServer), packet_size));
+        mQueuedBytes += packet_size;
+        if (!flow->active) {
+            // Newly backlogged flows start a fresh round, they don't get to
+            // save up credit while idle
+            flow->active = true;
+            flow->deficit = 0;
+            mActiveCount++;
+            mBackloggedWeight += flow->weight;
+            appendActive(flow);
+        }
+
+        if (mNeedsNotification) {
+            mNeedsNotification = false;
+            notify = true;
+        }
+    }
+
+    // Outside the lock since this calls back into the ForwarderServiceQueue,
+    // which takes its own lock and then calls front()
+    if (notify)
+        notifyPushFront();
+
+    return true;
+}
+
+DRRODPFlowScheduler::QueuedMessage DRRODPFlowScheduler::dequeue() const {
+    while(mActiveHead != NULL) {
+        Flow* flow = mActiveHead;
+        const QueuedMessage& next = flow->queueFront();
+        if (flow->deficit < (int64)next.size) {
+            // Not enough credit left this round, top up and go to the back
+            flow->deficit += quantum(flow);
+            appendActive(popActive());
+            continue;
+        }
+
+        QueuedMessage result = flow->queuePop();
+        flow->deficit -= result.size;
+        mQueuedBytes -= result.size;
+        if (flow->queueEmpty()) {
+            popActive();
+            flow->active = false;
+            flow->deficit = 0;
+            mActiveCount--;
+            mBackloggedWeight -= flow->weight;
+            if (mActiveCount == 0) mBackloggedWeight = 0;
+            flow->idleSince = mContext->recentSimTime();
+            queueForCollection(flow, flow->idleSince);
+        }
+        return result;
+    }
+    return QueuedMessage();
+}
+
+void DRRODPFlowScheduler::primeFront() const {
+    if (mFrontBuffer.msg != NULL)
+        return;
+    mFrontBuffer = dequeue();
+    if (mFrontBuffer.msg == NULL)
+        mNeedsNotification = true;
+}
+
+static DRRODPFlowScheduler::Type null_response = NULL;
+
+const DRRODPFlowScheduler::Type& DRRODPFlowScheduler::front() const {
+    boost::lock_guard<boost::mutex> lck(mMutex);
+    primeFront();
+    if (mFrontBuffer.msg == NULL)
+        return null_response;
+    return mFrontBuffer.msg;
+}
+
+DRRODPFlowScheduler::Type& DRRODPFlowScheduler::front() {
+    boost::lock_guard<boost::mutex> lck(mMutex);
+    primeFront();
+    if (mFrontBuffer.msg == NULL)
+        return null_response;
+    return mFrontBuffer.msg;
+}
+
+DRRODPFlowScheduler::Type DRRODPFlowScheduler::pop() {
+    boost::lock_guard<boost::mutex> lck(mMutex);
+    primeFront();
+    Message* result = mFrontBuffer.msg;
+    mFrontBuffer = QueuedMessage();
+    // Reprime so we notice if we've run dry and need notification for the
+    // next push
+    primeFront();
+    return result;
+}
+
+bool DRRODPFlowScheduler::empty() const {
+    boost::lock_guard<boost::mutex> lck(mMutex);
+    primeFront();
+    return (mFrontBuffer.msg == NULL);
+}
+
+uint32 DRRODPFlowScheduler::size() const {
+    boost::lock_guard<boost::mutex> lck(mMutex);
+    return mQueuedBytes + mFrontBuffer.size;
+}
+
+float DRRODPFlowScheduler::totalActiveWeight() {
+    boost::lock_guard<boost::mutex> lck(mMutex);
+    return mTotalActiveWeight;
+}
+
+float DRRODPFlowScheduler::usedWeight(double downstream_total_weight, double downstream_capacity) {
+    boost::lock_guard<boost::mutex> lck(mMutex);
+    // Backlogged flows are getting all they can, so they use their full
+    // weight. Beyond that, we estimate how much weight we'd need downstream to
+    // sustain our current arrival rate.
+    double total_weights = std::max(std::max(downstream_total_weight, mTotalActiveWeight), .0001);
+    double acc_rate = std::max(downstream_capacity, 1.0);
+    double rate_weight = mArrivalRate.get(mContext->recentSimTime(), ARRIVAL_RATE_FALLOFF) * total_weights / acc_rate;
+    return std::min(mTotalActiveWeight, std::max(mBackloggedWeight, rate_weight));
+}
+
+float DRRODPFlowScheduler::totalSenderUsedWeight() {
+    return usedWeight(mSenderTotalWeight, mSenderCapacity);
+}
+
+float DRRODPFlowScheduler::totalReceiverUsedWeight() {
+    return usedWeight(mReceiverTotalWeight, mReceiverCapacity);
+}
+
+} // namespace Sirikata
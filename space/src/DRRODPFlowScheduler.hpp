@@ -0,0 +1,146 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _DRR_ODP_FLOW_SCHEDULER_HPP_
+#define _DRR_ODP_FLOW_SCHEDULER_HPP_
+
+#include "ODPFlowScheduler.hpp"
+#include "RateEstimator.hpp"
+#include <boost/thread/mutex.hpp>
+#include <deque>
+
+namespace Sirikata {
+
+class LocationService;
+
+/** DRRODPFlowScheduler keeps a queue per flow (source/destination object pair)
+ *  and serves them with weighted deficit round robin, so each backlogged flow
+ *  gets a share of the link proportional to its region weight no matter how
+ *  fast it is sending. Each flow's messages live in a ring buffer which only
+ *  grows, and backlogged flows sit on an intrusive list, so push and pop are
+ *  O(1) amortized. When the shared buffer fills up, messages are dropped from
+ *  flows using more than their weighted share of it instead of from whoever
+ *  arrives next. Flows which stay idle long enough are forgotten.
+ */
+class DRRODPFlowScheduler : public ODPFlowScheduler {
+public:
+    DRRODPFlowScheduler(SpaceContext* ctx, ForwarderServiceQueue* parent, ServerID sid, uint32 serv_id, uint32 max_size, LocationService* loc);
+    virtual ~DRRODPFlowScheduler();
+
+    // Interface: AbstractQueue<Message*>
+    virtual const Type& front() const;
+    virtual Type& front();
+    virtual Type pop();
+    virtual bool empty() const;
+    virtual uint32 size() const;
+
+    // ODP push interface
+    virtual bool push(Sirikata::Protocol::Object::ObjectMessage* msg, const OSegEntry&, const OSegEntry&);
+    // Get the sum of the weights of active queues.
+    virtual float totalActiveWeight();
+    // Get the total used weight of active queues, from the perspective of the
+    // downstream send scheduler.  If all flows are saturating, this should
+    // equal totalActiveWeights, otherwise it will be smaller.
+    virtual float totalSenderUsedWeight();
+    // Get the total used weight of active queues, from the perspective of the
+    // downstream receive scheduler.  If all flows are saturating, this should
+    // equal totalActiveWeights, otherwise it will be smaller.
+    virtual float totalReceiverUsedWeight();
+private:
+    struct QueuedMessage {
+        QueuedMessage()
+         : msg(NULL),
+           size(0)
+        {}
+
+        QueuedMessage(Message* m, uint32 s)
+         : msg(m),
+           size(s)
+        {}
+
+        Message* msg;
+        uint32 size;
+    };
+
+    struct Flow {
+        Flow(const ObjectPair& op, double w);
+        ~Flow();
+
+        bool queueEmpty() const { return count == 0; }
+        const QueuedMessage& queueFront() const { return ring[head]; }
+        void queuePush(const QueuedMessage& qm);
+        QueuedMessage queuePop();
+
+        ObjectPair id;
+        double weight;
+        // Bytes this flow may still send in the current round
+        int64 deficit;
+        uint32 queuedBytes;
+        // Ring buffer of queued messages, size is always a power of 2
+        std::vector<QueuedMessage> ring;
+        uint32 head;
+        uint32 count;
+
+        // Links in the list of backlogged flows
+        Flow* nextActive;
+        bool active;
+        // When the flow last went idle, used to garbage collect it
+        Time idleSince;
+        // Whether the flow has an entry in mIdleFlows
+        bool queuedForCollection;
+    };
+
+    // Find or create the flow, updating mTotalActiveWeight for new ones
+    Flow* getFlow(const ObjectPair& op, const OSegEntry& src_info, const OSegEntry& dst_info, const Time& t);
+    // Drops flows which have been idle for too long. Each entry it looks at is
+    // either dropped or pushed back a full timeout, so push stays O(1)
+    // amortized.
+    void collectIdleFlows(const Time& t);
+    // Adds an entry for the flow to mIdleFlows unless it already has one
+    void queueForCollection(Flow* flow, const Time& t) const;
+
+    void appendActive(Flow* flow) const;
+    Flow* popActive() const;
+    // Bytes added to a flow's deficit each time it comes around
+    int64 quantum(const Flow* flow) const;
+    // Whether a message of packet_size bytes from flow fits in the buffer
+    bool admit(const Flow* flow, uint32 packet_size) const;
+
+    // Pulls the next message into mFrontBuffer if it's empty. Must hold mMutex.
+    void primeFront() const;
+    // Runs the DRR loop to find the next message to send. Must hold mMutex.
+    QueuedMessage dequeue() const;
+
+    float usedWeight(double downstream_total_weight, double downstream_capacity);
+
+    mutable boost::mutex mMutex;
+
+    // Used to collect information for weight computation
+    LocationService* mLoc;
+    uint32 mMaxSize;
+
+    typedef std::tr1::unordered_map<ObjectPair, Flow*, ObjectPair::Hasher> FlowMap;
+    mutable FlowMap mFlows;
+    // Flows to check for collection, in the order they were queued. Each flow
+    // has at most one entry, so this never holds more than mFlows does.
+    typedef std::deque< std::pair<ObjectPair, Time> > IdleFlowQueue;
+    mutable IdleFlowQueue mIdleFlows;
+
+    // Backlogged flows, served round robin from the head
+    mutable Flow* mActiveHead;
+    mutable Flow* mActiveTail;
+    mutable uint32 mActiveCount;
+    mutable double mBackloggedWeight;
+
+    mutable QueuedMessage mFrontBuffer;
+    mutable uint32 mQueuedBytes;
+    mutable bool mNeedsNotification;
+
+    SimpleRateEstimator mArrivalRate;
+    double mTotalActiveWeight;
+}; // class DRRODPFlowScheduler
+
+} // namespace Sirikata
+
+#endif //_DRR_ODP_FLOW_SCHEDULER_HPP_
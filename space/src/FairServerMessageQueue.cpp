@@ -108,6 +108,19 @@ void FairServerMessageQueue::service() {
     bool last_blocked = false;
     uint32 num_sent = 0;
     uint32 cum_sent_size = 0;
+    std::vector<ServerID> blocked;
+
+    // Batches left over from a round where the network blocked us go out
+    // first. Their queues stay disabled until the network is ready again, so
+    // nothing could have been queued behind them.
+    {
+        MutexLock lck(mMutex);
+        cum_sent_size += trySendBatches(&blocked);
+        for(uint32 i = 0; i < blocked.size(); i++)
+            disableDownstream(blocked[i]);
+        blocked.clear();
+    }
+
     while( num_sent < MAX_MESSAGES_PER_ROUND && !mContext->stopped() ) {
         uint32 packet_size = 0;
         {
@@ -119,19 +132,24 @@ void FairServerMessageQueue::service() {
 
             last_blocked = false;
 
-            uint32 sent_size = trySend(sid, next_msg);
-            bool sent_success = (sent_size != 0);
-            if (!sent_success) {
-                last_blocked = true;
-                disableDownstream(sid);
-                continue;
+            // Messages are coalesced per destination, only hitting the
+            // network when the batch is full or at the end of the round
+            if (!batchHasRoom(sid, next_msg)) {
+                uint32 sent_size = trySendBatch(sid);
+                bool sent_success = (sent_size != 0);
+                if (!sent_success) {
+                    last_blocked = true;
+                    disableDownstream(sid);
+                    continue;
+                }
+                cum_sent_size += sent_size;
             }
 
             // Pop the message
             Message* next_msg_popped = mServerQueues.pop();
             assert(next_msg == next_msg_popped);
 
-            cum_sent_size += sent_size;
+            appendToBatch(sid, next_msg);
         }
 
         // Record trace send times
@@ -147,11 +165,20 @@ void FairServerMessageQueue::service() {
         }
         */
 
-        // Get rid of the message
+        // The batch owns the message now
         num_sent++;
-        delete next_msg;
     }
 
+    // Flush whatever accumulated this round. Anything that can't be sent
+    // stays batched, with its queue disabled until the network is ready.
+    {
+        MutexLock lck(mMutex);
+        cum_sent_size += trySendBatches(&blocked);
+        for(uint32 i = 0; i < blocked.size(); i++)
+            disableDownstream(blocked[i]);
+        if (!blocked.empty())
+            last_blocked = true;
+    }
 
     if (num_sent == MAX_MESSAGES_PER_ROUND) {
         mBlocked = true;
@@ -55,6 +55,7 @@
 #include "ODPFlowScheduler.hpp"
 #include "RegionODPFlowScheduler.hpp"
 #include "CSFQODPFlowScheduler.hpp"
+#include "DRRODPFlowScheduler.hpp"
 
 #include <sirikata/core/odp/DelegateService.hpp>
 
@@ -107,7 +108,6 @@ Forwarder::Forwarder(SpaceContext* ctx)
              mServerMessageQueue(NULL),
              mServerMessageReceiver(NULL),
              mLocalForwarder(NULL),
-             mOSegLookups(NULL),
              mUniqueConnIDs(0),
              mServiceIDSource(0),
              mServerWeightPoller(
@@ -156,7 +156,19 @@ Forwarder::Forwarder(SpaceContext* ctx)
       this->unregisterMessageRecipient(SERVER_PORT_FORWARDER_WEIGHT_UPDATE, this);
 
       delete mOutgoingMessages;
-      delete mOSegLookups;
+
+      for(uint32 i = 0; i < mRoutingStrands.size(); i++) {
+          RoutingStrand* rs = mRoutingStrands[i];
+          RoutingRequest req;
+          while(rs->requests->pop(req))
+              delete req.msg;
+          delete rs->requests;
+          delete rs->lookups;
+          if (rs->ownsStrand)
+              delete rs->strand;
+          delete rs;
+      }
+      mRoutingStrands.clear();
   }
 
   /*
@@ -166,7 +178,30 @@ void Forwarder::initialize(ObjectSegmentation* oseg, ServerMessageQueue* smq, Se
 {
     addODPServerMessageService(loc);
 
-    mOSegLookups = new OSegLookupQueue(mContext->mainStrand, oseg);
+    // OSeg lookups stay on the main strand, where the OSeg's own state is
+    // updated. Each routing strand's queue hops over to it to issue lookups.
+    uint32 num_routing_strands = GetOptionValue<uint32>(FORWARDER_ROUTING_STRANDS);
+    uint32 routing_queue_size = GetOptionValue<uint32>(FORWARDER_ROUTING_QUEUE_SIZE);
+    for(uint32 i = 0; i < std::max(num_routing_strands, (uint32)1); i++) {
+        RoutingStrand* rs = new RoutingStrand();
+        if (num_routing_strands == 0) {
+            rs->strand = mContext->mainStrand;
+            rs->ownsStrand = false;
+        }
+        else {
+            rs->strand = mContext->ioService->createStrand(
+                String("Forwarder Routing ") + boost::lexical_cast<String>(i)
+            );
+            rs->ownsStrand = true;
+        }
+        rs->requests = new RoutingRequestQueue(CountResourceMonitor(routing_queue_size));
+        rs->lookups = new OSegLookupQueue(mContext, rs->strand, oseg, mContext->mainStrand);
+        mRoutingStrands.push_back(rs);
+    }
+    // Each OSegLookupQueue registers itself as the listener, replace them so
+    // results get back to the right queue
+    oseg->setLookupListener(this);
+
     mServerMessageQueue = smq;
     mServerMessageReceiver = smr;
 }
@@ -299,20 +334,37 @@ ODPFlowScheduler* Forwarder::createODPFlowScheduler(LocationService* loc, Server
         new_flow_scheduler =
             new CSFQODPFlowScheduler(mContext, mOutgoingMessages, remote_server, mServiceIDMap[ODP_SERVER_MESSAGE_SERVICE], max_size, loc);
     }
+    else if (flow_sched_type == "drr") {
+        new_flow_scheduler =
+            new DRRODPFlowScheduler(mContext, mOutgoingMessages, remote_server, mServiceIDMap[ODP_SERVER_MESSAGE_SERVICE], max_size, loc);
+    }
 
     assert(new_flow_scheduler != NULL);
 
     {
-        boost::lock_guard<boost::recursive_mutex> lck(mODPRouterMapMutex);
+        boost::unique_lock<boost::shared_mutex> lck(mODPRouterMapMutex);
         mODPRouters[remote_server] = new_flow_scheduler;
     }
     return new_flow_scheduler;
 }
 
+ODPFlowScheduler* Forwarder::getODPFlowScheduler(ServerID server) {
+    boost::shared_lock<boost::shared_mutex> lck(mODPRouterMapMutex);
+    ODPRouterMap::iterator it = mODPRouters.find(server);
+    return (it == mODPRouters.end()) ? NULL : it->second;
+}
+
 void Forwarder::updateServerWeights() {
-    boost::lock_guard<boost::recursive_mutex> lck(mODPRouterMapMutex);
+    // Work from a copy so we don't hold the lock while pushing weight updates
+    // into mOutgoingMessages, which takes its own lock and may need to create
+    // flow schedulers
+    ODPRouterMap routers;
+    {
+        boost::shared_lock<boost::shared_mutex> lck(mODPRouterMapMutex);
+        routers = mODPRouters;
+    }
 
-    for(ODPRouterMap::iterator it = mODPRouters.begin(); it != mODPRouters.end(); it++) {
+    for(ODPRouterMap::iterator it = routers.begin(); it != routers.end(); it++) {
         ServerID serv_id = it->first;
         ODPFlowScheduler* serv_flow_sched = it->second;
 
@@ -392,13 +444,7 @@ void Forwarder::routeObjectHostMessage(Sirikata::Protocol::Object::ObjectMessage
         return;
     }
 
-    bool forwarded = forward(obj_msg);
-    if (!forwarded) {
-        mDroppedPerSecond++;
-        TIMESTAMP(obj_msg, Trace::DROPPED_DURING_FORWARDING);
-        TRACE_DROP(DROPPED_DURING_FORWARDING);
-        delete obj_msg;
-    }
+    enqueueRoutingRequest(obj_msg, NullServerID);
 }
 
 // --- Forwarded from other space servers
@@ -437,15 +483,7 @@ void Forwarder::receiveObjectRoutingMessage(Message* msg) {
 
 
     // Otherwise, try to forward it
-    bool forward_success = forward(obj_msg, msg->source_server());
-
-    if (!forward_success) {
-        mDroppedPerSecond++;
-        TIMESTAMP(obj_msg, Trace::DROPPED_DURING_FORWARDING);
-        TRACE_DROP(DROPPED_DURING_FORWARDING_ROUTING);
-        delete obj_msg;
-    }
-
+    enqueueRoutingRequest(obj_msg, msg->source_server());
     delete msg;
 }
 
@@ -476,13 +514,7 @@ void Forwarder::receiveWeightUpdateMessage(Message* msg) {
         weight_update.server_pair_used_weight()
     );
 
-    ODPFlowScheduler* serv_flow_sched = NULL;
-    {
-        boost::lock_guard<boost::recursive_mutex> lck(mODPRouterMapMutex);
-        ODPRouterMap::iterator flow_sched_it = mODPRouters.find(source);
-        if (flow_sched_it != mODPRouters.end())
-            serv_flow_sched = flow_sched_it->second;
-    }
+    ODPFlowScheduler* serv_flow_sched = getODPFlowScheduler(source);
     if (serv_flow_sched != NULL) {
         // Update with receiver stats from this remote server.
         serv_flow_sched->updateReceiverStats(
@@ -501,6 +533,89 @@ void Forwarder::receiveWeightUpdateMessage(Message* msg) {
 }
 
 
+// -- Routing Strands - Object messages that need a routing decision are
+// -- handed to the strand for their destination object.
+
+bool Forwarder::usesRoutingStrands() const {
+    return !mRoutingStrands.empty() && mRoutingStrands[0]->ownsStrand;
+}
+
+Forwarder::RoutingStrand* Forwarder::routingStrandFor(const UUID& dest) const {
+    if (mRoutingStrands.size() == 1)
+        return mRoutingStrands[0];
+    return mRoutingStrands[dest.hash() % mRoutingStrands.size()];
+}
+
+void Forwarder::enqueueRoutingRequest(Sirikata::Protocol::Object::ObjectMessage* msg, ServerID forwardFrom) {
+    RoutingStrand* rs = routingStrandFor(msg->dest_object());
+
+    bool got_empty;
+    bool push_success;
+    {
+        boost::lock_guard<boost::mutex> lock(rs->requestsMutex);
+        got_empty = rs->requests->probablyEmpty();
+        push_success = rs->requests->push(RoutingRequest(msg, forwardFrom), false);
+    }
+
+    if (!push_success) {
+        mDroppedPerSecond++;
+        TIMESTAMP(msg, Trace::DROPPED_DURING_FORWARDING);
+        if (forwardFrom == NullServerID) {
+            TRACE_DROP(DROPPED_DURING_FORWARDING);
+        }
+        else {
+            TRACE_DROP(DROPPED_DURING_FORWARDING_ROUTING);
+        }
+        delete msg;
+        return;
+    }
+
+    if (got_empty)
+        scheduleProcessRoutingRequests(rs);
+}
+
+void Forwarder::scheduleProcessRoutingRequests(RoutingStrand* rs) {
+    rs->strand->post(
+        std::tr1::bind(&Forwarder::processRoutingRequests, this, rs),
+        "Forwarder::processRoutingRequests"
+    );
+}
+
+void Forwarder::processRoutingRequests(RoutingStrand* rs) {
+#define MAX_ROUTING_REQUESTS_PROCESSED 100
+
+    std::deque<RoutingRequest> requests;
+    bool got_empty;
+    {
+        boost::lock_guard<boost::mutex> lock(rs->requestsMutex);
+        rs->requests->popUpTo(MAX_ROUTING_REQUESTS_PROCESSED, &requests);
+        got_empty = rs->requests->probablyEmpty();
+    }
+
+    for(std::deque<RoutingRequest>::iterator it = requests.begin(); it != requests.end(); it++) {
+        bool forwarded = forward(it->msg, it->forwardFrom);
+        if (!forwarded) {
+            mDroppedPerSecond++;
+            TIMESTAMP(it->msg, Trace::DROPPED_DURING_FORWARDING);
+            if (it->forwardFrom == NullServerID) {
+                TRACE_DROP(DROPPED_DURING_FORWARDING);
+            }
+            else {
+                TRACE_DROP(DROPPED_DURING_FORWARDING_ROUTING);
+            }
+            delete it->msg;
+        }
+    }
+
+    if (!got_empty)
+        scheduleProcessRoutingRequests(rs);
+}
+
+void Forwarder::osegLookupCompleted(const UUID& id, const OSegEntry& dest) {
+    routingStrandFor(id)->lookups->osegLookupCompleted(id, dest);
+}
+
+
 // -- Real Routing - Given an object message, from any source, decide where it
 // -- needs to go and send it out in that direction.
 
@@ -517,7 +632,7 @@ bool Forwarder::forward(Sirikata::Protocol::Object::ObjectMessage* msg, ServerID
     // to forward the message to
     TIMESTAMP_END(tstamp, Trace::OSEG_LOOKUP_STARTED);
 
-    bool accepted = mOSegLookups->lookup(
+    bool accepted = routingStrandFor(msg->dest_object())->lookups->lookup(
         msg,
         (forwardFrom==NullServerID?mNullServerIDOSegCallback:std::tr1::bind(&Forwarder::routeObjectMessageToServerNoReturn, this, std::tr1::placeholders::_1, std::tr1::placeholders::_2,std::tr1::placeholders:: _3, forwardFrom))
     );
@@ -530,7 +645,7 @@ bool Forwarder::tryCacheForward(Sirikata::Protocol::Object::ObjectMessage* msg)
     TIMESTAMP_START(tstamp, msg);
 
     TIMESTAMP_END(tstamp, Trace::OSEG_CACHE_CHECK_STARTED);
-    OSegEntry destserver = mOSegLookups->cacheLookup(msg->dest_object());
+    OSegEntry destserver = routingStrandFor(msg->dest_object())->lookups->cacheLookup(msg->dest_object());
     TIMESTAMP_END(tstamp, Trace::OSEG_CACHE_CHECK_FINISHED);
     if (destserver.isNull())
         return false;
@@ -575,23 +690,17 @@ bool Forwarder::routeObjectMessageToServer(Sirikata::Protocol::Object::ObjectMes
   // And then we can actually push
   // We try to look up the ODPFlowScheduler efficiently first, and only prePush
   // if we fail to find it.
-  ODPFlowScheduler* flow_sched = NULL;
-  {
-      boost::lock_guard<boost::recursive_mutex> lck(mODPRouterMapMutex);
-      ODPRouterMap::iterator odp_it = mODPRouters.find(dest_serv.server());
-      if (odp_it != mODPRouters.end())
-          flow_sched = odp_it->second;
-  }
+  ODPFlowScheduler* flow_sched = getODPFlowScheduler(dest_serv.server());
   if (flow_sched == NULL) {
-      // Will force allocation of ODPFlowScheduler if its not there already
-      {
-          boost::lock_guard<boost::recursive_mutex> lck(mODPRouterMapMutex);
-          mOutgoingMessages->prePush(dest_serv.server());
-          flow_sched = mODPRouters[dest_serv.server()];
-      }
+      // Will force allocation of ODPFlowScheduler if its not there
+      // already. Another strand may beat us to it, but prePush only ever
+      // creates one.
+      mOutgoingMessages->prePush(dest_serv.server());
+      flow_sched = getODPFlowScheduler(dest_serv.server());
   }
+  assert(flow_sched != NULL);
 
-  OSegEntry source_object_data(OSegEntry::null());//FIXME: do we want mandatory lookup for nonlocal guys?! = mOSegLookups->cacheLookup(obj_msg->source_object());
+  OSegEntry source_object_data(OSegEntry::null());//FIXME: do we want mandatory lookup for nonlocal guys?! = routingStrandFor(obj_msg->source_object())->lookups->cacheLookup(obj_msg->source_object());
   if (source_object_data.isNull()) {
       source_object_data=OSegEntry(mContext->id(),1.0);//FIXME dumb default: RADIUS of reforwarded messages are 1.0
   }
@@ -607,7 +716,8 @@ bool Forwarder::routeObjectMessageToServer(Sirikata::Protocol::Object::ObjectMes
 
   // Note that this is done *after* the real message is sent since it is an optimization and
   // we don't want it blocking useful traffic
-  // NOTE: Again, not thread safe, but the OH networking thread will never hit this.
+  // NOTE: This runs on the routing strands, but the router just pushes into
+  // mOutgoingMessages, which is thread safe.
   if (forwardFrom != NullServerID) {
       UUID obj_id =  obj_msg->dest_object();
       // FIXME we used to kind of keep track of sending the same OSeg cache fix to a server multiple
@@ -650,9 +760,6 @@ bool Forwarder::serverMessageEmpty(ServerID dest) {
 }
 
 void Forwarder::serverConnectionReceived(ServerID sid) {
-    ///need to take the lock because createODPFlowScheduler will want the lock later but an intervening lock will be taken
-    boost::lock_guard<boost::recursive_mutex> lck(mODPRouterMapMutex);
-
     // With a new connection, we just need to make sure we get
     // information flowing back and forth (e.g. capacity/weight for
     // ODPFlowScheduler). This just gets that process started.
@@ -683,16 +790,18 @@ void Forwarder::serverMessageReceived(Message* msg) {
             return;
         }
 
-        // OSeg Cache
-        // 4. Try to shortcut them main thread. Use forwarder to try to forward
-        // using the cache. FIXME when we do this, we skip over some checks that
-        // happen during the full forwarding
-        if (tryCacheForward(obj_msg)) {
+        // Otherwise it needs a routing decision, which happens on the
+        // destination's routing strand, skipping the main strand
+        // entirely. The OSeg cache is checked there, in order with any
+        // earlier messages to the same object still waiting on a lookup.
+        if (obj_msg->dest_object() != UUID::null()) {
+            TIMESTAMP(obj_msg, Trace::HANDLE_SPACE_MESSAGE);
+            enqueueRoutingRequest(obj_msg, msg->source_server());
             delete msg;
             return;
         }
 
-        // Couldn't get rid of it, forward normally.
+        // Messages to the space itself are dispatched from the main strand
         delete obj_msg;
     }
 
@@ -730,21 +839,16 @@ void Forwarder::processReceivedServerMessages() {
 #define MAX_RECEIVED_MESSAGES_PROCESSED 20 // need a better way to decide this
 
     // First, pull out messages we're going to process in this round
-    uint32 pulled = 0;
-    Message* messages[MAX_RECEIVED_MESSAGES_PROCESSED];
+    std::deque<Message*> messages;
     bool got_empty;
     {
         boost::lock_guard<boost::mutex> lock(mReceivedMessagesMutex);
-        while(!mReceivedMessages.probablyEmpty() && pulled < MAX_RECEIVED_MESSAGES_PROCESSED) {
-            bool popped = mReceivedMessages.pop( messages[pulled] );
-            if (!popped) break;
-            pulled++;
-        }
+        mReceivedMessages.popUpTo(MAX_RECEIVED_MESSAGES_PROCESSED, &messages);
         got_empty = mReceivedMessages.probablyEmpty();
     }
 
-    for(uint32 i = 0; i < pulled; i++)
-        ServerMessageDispatcher::dispatchMessage(messages[i]);
+    for(std::deque<Message*>::iterator it = messages.begin(); it != messages.end(); it++)
+        ServerMessageDispatcher::dispatchMessage(*it);
 
     if (!got_empty)
         scheduleProcessReceivedServerMessages();
@@ -51,8 +51,11 @@
 #include "ForwarderServiceQueue.hpp"
 
 #include <sirikata/core/queue/SizedThreadSafeQueue.hpp>
+#include <sirikata/core/queue/CountResourceMonitor.hpp>
 #include <sirikata/core/queue/ThreadSafeQueueWithNotification.hpp>
 
+#include <boost/thread/shared_mutex.hpp>
+
 namespace Sirikata
 {
   class Object;
@@ -79,6 +82,7 @@ class Forwarder : public ServerMessageDispatcher,
                     public ServerMessageQueue::Sender,
                   public ServerMessageReceiver::Listener,
                   private ForwarderServiceQueue::Listener,
+                  private OSegLookupListener,
                   public Service
 {
 private:
@@ -88,8 +92,35 @@ private:
     ServerMessageReceiver* mServerMessageReceiver;
 
     LocalForwarder* mLocalForwarder;
-    OSegLookupQueue* mOSegLookups; //this maps the object ids to a list of
-                                   //messages that are being looked up in oseg.
+
+    // Object messages that need a routing decision are partitioned by
+    // destination object across a set of strands. Each has its own queue of
+    // messages waiting to be routed and its own OSegLookupQueue, so all the
+    // routing work for one object happens in order on one strand, while
+    // different objects are routed in parallel.
+    struct RoutingRequest {
+        RoutingRequest()
+         : msg(NULL), forwardFrom(NullServerID)
+        {}
+        RoutingRequest(Sirikata::Protocol::Object::ObjectMessage* _msg, ServerID _forwardFrom)
+         : msg(_msg), forwardFrom(_forwardFrom)
+        {}
+
+        Sirikata::Protocol::Object::ObjectMessage* msg;
+        ServerID forwardFrom;
+    };
+    typedef Sirikata::SizedThreadSafeQueue<RoutingRequest, CountResourceMonitor> RoutingRequestQueue;
+    struct RoutingStrand {
+        Network::IOStrand* strand;
+        bool ownsStrand; // False if this is the main strand
+        // Like mReceivedMessages, protected by an extra lock so checking for
+        // empty and pushing are atomic
+        boost::mutex requestsMutex;
+        RoutingRequestQueue* requests;
+        OSegLookupQueue* lookups; //this maps the object ids to a list of
+                                  //messages that are being looked up in oseg.
+    };
+    std::vector<RoutingStrand*> mRoutingStrands;
 
     // We maintain a pointer to this Server's DelegateODPService because the
     // forwarder is the one that actually intercepts messages
@@ -122,7 +153,9 @@ private:
     Router<Message*>* mOSegCacheUpdateRouter;
     Router<Message*>* mForwarderWeightRouter;
     typedef std::tr1::unordered_map<ServerID, ODPFlowScheduler*> ODPRouterMap;
-    boost::recursive_mutex mODPRouterMapMutex;
+    // Read on every routed message from all the routing strands, only
+    // written when a new server shows up
+    boost::shared_mutex mODPRouterMapMutex;
     ODPRouterMap mODPRouters;
     Poller mServerWeightPoller; // For updating ServerMessageQueue, remote
                                 // ServerMessageReceiver with per-server weights
@@ -170,16 +203,28 @@ private:
     // ServerMessageReceivers.
     void updateServerWeights();
 
+    // Looks up the ODPFlowScheduler for a server, or NULL if there isn't one
+    // yet
+    ODPFlowScheduler* getODPFlowScheduler(ServerID server);
+
     // -- Public routing interface
   public:
     virtual Router<Message*>* createServerMessageService(const String& name);
 
     // Used only by Server.  Called from networking thready to try to forward
     // quickly (avoiding going through OSeg Lookup Queue) by checking OSeg
-    // cache.
+    // cache. Only safe when routing happens on the main strand, see
+    // usesRoutingStrands().
     WARN_UNUSED
     bool tryCacheForward(Sirikata::Protocol::Object::ObjectMessage* msg);
 
+    // Whether routing decisions are made on separate routing strands
+    // (forwarder.routing-strands > 0) instead of the main strand. In that
+    // case every message must be routed via routeObjectHostMessage so the
+    // cache check happens on its destination's strand, in order with
+    // earlier messages still waiting on an OSeg lookup.
+    bool usesRoutingStrands() const;
+
     // -- Real routing interface + implementation
 
 
@@ -196,11 +241,26 @@ private:
     void receiveWeightUpdateMessage(Message* msg);
 
   private:
+    // --- Routing strands - partition routing work by destination object
+
+    RoutingStrand* routingStrandFor(const UUID& dest) const;
+    // Queue a message for a routing decision on its destination's routing
+    // strand. Ownership is given to Forwarder whether it is accepted or
+    // dropped.
+    void enqueueRoutingRequest(Sirikata::Protocol::Object::ObjectMessage* msg, ServerID forwardFrom);
+    void scheduleProcessRoutingRequests(RoutingStrand* rs);
+    void processRoutingRequests(RoutingStrand* rs);
+
+    // OSegLookupListener Interface - passes results to the OSegLookupQueue on
+    // the object's routing strand
+    virtual void osegLookupCompleted(const UUID& id, const OSegEntry& dest);
+
     // --- Worker Methods - do the real forwarding decision making and work
 
     /** Try to forward a message to get it closer to the destination object.
      *  This checks if we have a direct connection to the object, then does an
-     *  OSeg lookup if necessary.
+     *  OSeg lookup if necessary. Must be called on the destination's routing
+     *  strand.
      */
     WARN_UNUSED
     bool forward(Sirikata::Protocol::Object::ObjectMessage* msg, ServerID forwardFrom = NullServerID);
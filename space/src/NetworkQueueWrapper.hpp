@@ -36,26 +36,28 @@
 #include <sirikata/space/SpaceNetwork.hpp>
 #include <sirikata/space/ServerMessage.hpp>
 #include <sirikata/core/trace/Trace.hpp>
+#include <sirikata/core/network/Frame.hpp>
 
 namespace Sirikata {
 class NetworkQueueWrapper {
     Context* mContext;
     SpaceNetwork::ReceiveStream* mReceiveStream;
     Message* mFront;
+    // Each chunk from the network is a batch of Network::Frames, one per
+    // message. This is how far into the front chunk we've parsed.
+    uint32 mOffset;
     Trace::MessagePath mPathTag;
     typedef Network::Chunk Chunk;
 
-    Message* parse(Chunk* c) {
-        Message* msg = Message::deserialize(*c);
+    Message* parse(const uint8* data, uint32 size) {
+        Message* msg = Message::deserialize(data, size);
 
         if (msg == NULL) {
-            // FIXME if this happens we're probably going to never remove the chunk from the network...
             SILOG(net,warning,"Couldn't parse message.");
             return NULL;
         }
 
         if (msg->source_server() != mReceiveStream->id()) {
-            // FIXME if this happens we're probably going to never remove the chunk from the network...
             SILOG(net,warning,"Message source doesn't match connection's ID");
             delete msg;
             return NULL;
@@ -65,6 +67,12 @@ class NetworkQueueWrapper {
 
         return msg;
     }
+
+    // Done with the front chunk, free it up so the network can read more
+    void popChunk() {
+        delete mReceiveStream->pop();
+        mOffset = 0;
+    }
 public:
     typedef Message* ElementType;
 
@@ -72,6 +80,7 @@ public:
      : mContext(ctx),
        mReceiveStream(rstrm),
        mFront(NULL),
+       mOffset(0),
        mPathTag(tag)
     {}
 
@@ -82,33 +91,43 @@ public:
     }
 
     Message* front() {
-        if (mFront == NULL) {
+        while (mFront == NULL) {
             Chunk* c = mReceiveStream->front();
-            if (c != NULL)
-                mFront = parse(c);
+            if (c == NULL)
+                return NULL;
+
+            if (mOffset >= c->size()) {
+                popChunk();
+                continue;
+            }
+
+            // Messages are parsed straight out of the chunk, no copies
+            const uint8* payload = NULL;
+            uint32 payload_len = 0;
+            if (!Network::Frame::parse(&(*c)[0], c->size(), &mOffset, &payload, &payload_len)) {
+                SILOG(net,warning,"Truncated message frame, dropping rest of batch.");
+                popChunk();
+                continue;
+            }
+
+            // Bad messages are skipped, the frame tells us where the next one
+            // starts
+            mFront = parse(payload, payload_len);
         }
 
         return mFront;
     }
 
     Message* pop(){
-        Chunk* c = mReceiveStream->pop();
-
-        if (c == NULL) {
-            assert(mFront == NULL);
+        Message* result = front();
+        if (result == NULL)
             return NULL;
-        }
+        mFront = NULL;
 
-        Message* result = NULL;
-        if (mFront != NULL) {
-            result = mFront;
-            mFront = NULL;
-        }
-        else {
-            result = parse(c);
-        }
+        Chunk* c = mReceiveStream->front();
+        if (c != NULL && mOffset >= c->size())
+            popChunk();
 
-        delete c;
         return result;
     }
 
@@ -0,0 +1,42 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "ODPFlowScheduler.hpp"
+#include <sirikata/space/LocationService.hpp>
+#include <sirikata/space/CoordinateSegmentation.hpp>
+
+#define ODPLOG(level, msg) SILOG(odpflow,level, mContext->id() << "->" << mDestServer << ": " << msg)
+
+namespace Sirikata {
+
+BoundingBox3f ODPFlowScheduler::getObjectWeightRegion(LocationService* loc, const UUID& objid, const OSegEntry& info) const {
+    // We might have exact info
+    if (loc != NULL && loc->contains(objid)) {
+        Vector3f pos = loc->currentPosition(objid);
+        BoundingSphere3f bounds = loc->bounds(objid).fullBounds();
+        BoundingBox3f bb(pos + bounds.center(), bounds.radius());
+        return bb;
+    }
+
+    if (loc != NULL && info.server() == mContext->id())
+        ODPLOG(warn,"Using approximation for local object!");
+    if (info.radius()==1.0) {
+        ODPLOG(warn,"Radius approximation failure! (migration? should we do a cache lookup)");
+    }
+    // Otherwise, we need to use server info
+    // Blech, why is this a bbox list?
+    BoundingBoxList server_bbox_list = mContext->cseg()->serverRegion(info.server());
+    BoundingBox3f server_bbox = BoundingBox3f::null();
+    for(uint32 i = 0; i < server_bbox_list.size(); i++)
+        server_bbox.mergeIn(server_bbox_list[i]);
+    return BoundingBox3f(server_bbox.center(), info.radius());
+}
+
+double ODPFlowScheduler::flowWeight(LocationService* loc, const ObjectPair& flow, const OSegEntry& src_info, const OSegEntry& dst_info) const {
+    BoundingBox3f source_bbox = getObjectWeightRegion(loc, flow.source, src_info);
+    BoundingBox3f dest_bbox = getObjectWeightRegion(loc, flow.dest, dst_info);
+    return mWeightCalculator->weight(source_bbox, dest_bbox);
+}
+
+} // namespace Sirikata
@@ -42,6 +42,8 @@
 
 namespace Sirikata {
 
+class LocationService;
+
 /** An ODPFlowScheduler acts as a filter and queue for ODP messages for a single
  *  server. It has 2 primary roles. First, it acts as an ODP input queue for
  *  ForwarderServiceQueue; i.e. queues ODP messages, converts them to server
@@ -121,6 +123,38 @@ public:
         mReceiverCapacity = capacity;
     }
 protected:
+    // Identifies a flow, i.e. all the messages from one object to another
+    struct ObjectPair {
+        ObjectPair(const UUID& s, const UUID& d)
+         : source(s), dest(d)
+        {}
+
+        bool operator<(const ObjectPair& rhs) const {
+            return (source < rhs.source || (source == rhs.source && dest < rhs.dest));
+        }
+
+        bool operator==(const ObjectPair& rhs) const {
+            return (source == rhs.source && dest == rhs.dest);
+        }
+
+        class Hasher {
+        public:
+            size_t operator() (const ObjectPair& op) const {
+                return *(uint32*)op.source.getArray().data() ^ *(uint32*)op.dest.getArray().data();
+            }
+        };
+
+        UUID source;
+        UUID dest;
+    };
+
+    // Helper to get the region we compute an object's weight over. Uses exact
+    // information from loc when it's available (and loc isn't NULL),
+    // otherwise approximates using the object's server and radius.
+    BoundingBox3f getObjectWeightRegion(LocationService* loc, const UUID& objid, const OSegEntry& info) const;
+    // Weight for a new flow between two objects
+    double flowWeight(LocationService* loc, const ObjectPair& flow, const OSegEntry& src_info, const OSegEntry& dst_info) const;
+
     // Should be called by implementations when an ODP message is successfully added.
     void notifyPushFront() {
         mParent->notifyPushFront(mDestServer, mServiceID);
@@ -34,11 +34,38 @@
 #include <sirikata/space/ObjectSegmentation.hpp>
 #include "Options.hpp"
 #include <sirikata/core/options/CommonOptions.hpp>
+#include <sirikata/core/util/Timer.hpp>
+#include <limits>
 
 namespace Sirikata {
 
+// Smallest histogram bucket bound, in microseconds. Bounds double from here,
+// so 17 buckets covers up to ~8s with everything slower in the last one.
+#define LATENCY_HISTOGRAM_MIN_US 128
+#define LATENCY_HISTOGRAM_BUCKETS 18
+
 // OSegLookupList Implementation
 
+OSegLookupQueue::OSegLookupList::OSegLookupList()
+ : mTotalSize(0),
+   mStarted(Time::null())
+{
+}
+
+void OSegLookupQueue::OSegLookupList::swap(OSegLookupList& other) {
+    OSegLookupVector::swap(other);
+    std::swap(mTotalSize, other.mTotalSize);
+    std::swap(mStarted, other.mStarted);
+}
+
+const Time& OSegLookupQueue::OSegLookupList::started() const {
+    return mStarted;
+}
+
+void OSegLookupQueue::OSegLookupList::setStarted(const Time& t) {
+    mStarted = t;
+}
+
 size_t OSegLookupQueue::OSegLookupList::ByteSize() const{
     return mTotalSize;
 }
@@ -68,12 +95,23 @@ OSegLookupQueue::OSegLookupList::iterator OSegLookupQueue::OSegLookupList::end()
 // OSegLookupQueue Implementation
 
 
-OSegLookupQueue::OSegLookupQueue(Network::IOStrand* net_strand, ObjectSegmentation* oseg)
- : mNetworkStrand(net_strand),
+OSegLookupQueue::OSegLookupQueue(SpaceContext* ctx, Network::IOStrand* net_strand, ObjectSegmentation* oseg, Network::IOStrand* oseg_strand)
+ : mContext(ctx),
+   mNetworkStrand(net_strand),
+   mOSegStrand(oseg_strand != NULL ? oseg_strand : net_strand),
    mOSeg(oseg),
-   mTotalSize(0)
+   mTotalSize(0),
+   mFlushScheduled(false),
+   mLatencyCounts(LATENCY_HISTOGRAM_BUCKETS, 0),
+   mBatches(0),
+   mBatchedLookups(0),
+   mNotFoundHits(0)
 {
     mMaxLookups = GetOptionValue<uint32>(OSEG_LOOKUP_QUEUE_SIZE);
+    mMaxBatchSize = std::max(GetOptionValue<uint32>(OSEG_LOOKUP_BATCH_SIZE), (uint32)1);
+    mNotFoundLifetime = GetOptionValue<Duration>(OSEG_NEGATIVE_CACHE_LIFETIME);
+    mStatsInterval = GetOptionValue<Duration>(OSEG_LOOKUP_STATS_INTERVAL);
+    mNextStatsReport = Timer::now() + mStatsInterval;
     mOSeg->setLookupListener(this);
 }
 
@@ -88,7 +126,7 @@ bool OSegLookupQueue::lookup(Sirikata::Protocol::Object::ObjectMessage* msg, con
   size_t cursize = msg->ByteSize();
 
   //if already looking up, do not call lookup on mOSeg;
-  LookupMap::const_iterator it = mLookups.find(dest_obj);
+  LookupMap::iterator it = mLookups.find(dest_obj);
   if (it != mLookups.end())
   {
     //we are already looking up the object.  Just add it to mLookups
@@ -98,7 +136,7 @@ bool OSegLookupQueue::lookup(Sirikata::Protocol::Object::ObjectMessage* msg, con
     lu.msg = msg;
     lu.cb = cb;
     lu.size = cursize;
-    mLookups[dest_obj].push_back(lu);
+    it->second.push_back(lu);
     return true;
   }
 
@@ -110,6 +148,14 @@ bool OSegLookupQueue::lookup(Sirikata::Protocol::Object::ObjectMessage* msg, con
     return true;
   }
 
+  // If we just learned the object doesn't exist, don't ask again
+  Time now = Timer::now();
+  if (checkNotFound(dest_obj, now)) {
+    mNotFoundHits++;
+    cb(msg, OSegEntry::null(), ResolvedFromCache);
+    return true;
+  }
+
   //if did not get a cache hit, check if have enough room to add it;
   if (mLookups.size() > mMaxLookups)
     return false;
@@ -120,24 +166,78 @@ bool OSegLookupQueue::lookup(Sirikata::Protocol::Object::ObjectMessage* msg, con
   if (mOSeg->getPushback() > MAX_OSEG_PUSHBACK_PARAMETER)
       return false;
 
-  //  otherwise, do full oseg lookup;
-  destServer = mOSeg->lookup(dest_obj);
-  // If we already have a server, handle the callback right away
-  if (destServer.notNull()) {
-    cb(msg, destServer, ResolvedFromCache);
-    return true;
-  }
-
-  // And if we do, stick it on a list and wait
+  // Otherwise, queue it up and add it to the next batch of OSeg lookups
   mTotalSize += cursize;
   OSegLookup lu;
   lu.msg = msg;
   lu.cb = cb;
   lu.size = cursize;
-  mLookups[dest_obj].push_back(lu);
+  OSegLookupList& lookups = mLookups[dest_obj];
+  lookups.setStarted(now);
+  lookups.push_back(lu);
+
+  mPendingBatch.push_back(dest_obj);
+  if (mPendingBatch.size() >= mMaxBatchSize) {
+      flushBatch();
+  }
+  else if (!mFlushScheduled) {
+      // Anything else that arrives while we're still processing on this
+      // strand will get added to the same batch
+      mFlushScheduled = true;
+      mNetworkStrand->post(
+          std::tr1::bind(&OSegLookupQueue::handleFlushBatch, this),
+          "OSegLookupQueue::handleFlushBatch"
+      );
+  }
   return true;
 }
 
+void OSegLookupQueue::handleFlushBatch() {
+    mFlushScheduled = false;
+    flushBatch();
+}
+
+void OSegLookupQueue::flushBatch() {
+    if (mPendingBatch.empty()) return;
+
+    // Swap out the batch so callbacks for immediate results can safely submit
+    // new lookups
+    LookupBatch* batch = new LookupBatch();
+    batch->ids.swap(mPendingBatch);
+
+    if (mOSegStrand == mNetworkStrand) {
+        mOSeg->lookupBatch(batch->ids, &batch->results);
+        handleLookupBatchResults(batch);
+    }
+    else {
+        mOSegStrand->post(
+            std::tr1::bind(&OSegLookupQueue::handleOSegLookupBatch, this, batch),
+            "OSegLookupQueue::handleOSegLookupBatch"
+        );
+    }
+}
+
+void OSegLookupQueue::handleOSegLookupBatch(LookupBatch* batch) {
+    mOSeg->lookupBatch(batch->ids, &batch->results);
+    mNetworkStrand->post(
+        std::tr1::bind(&OSegLookupQueue::handleLookupBatchResults, this, batch),
+        "OSegLookupQueue::handleLookupBatchResults"
+    );
+}
+
+void OSegLookupQueue::handleLookupBatchResults(LookupBatch* batch) {
+    mBatches++;
+    mBatchedLookups += batch->ids.size();
+
+    // If we already have a server, handle the callbacks right away. Others
+    // will come back through osegLookupCompleted.
+    for(uint32 i = 0; i < batch->ids.size(); i++) {
+        if (batch->results[i].notNull())
+            completeLookup(batch->ids[i], batch->results[i], ResolvedFromCache);
+    }
+    delete batch;
+}
+
 void OSegLookupQueue::osegLookupCompleted(const UUID& id, const OSegEntry& dest) {
     mNetworkStrand->post(
         std::tr1::bind(&OSegLookupQueue::handleLookupCompleted, this, id, dest),
@@ -146,17 +246,90 @@ void OSegLookupQueue::osegLookupCompleted(const UUID& id, const OSegEntry& dest)
 }
 
 void OSegLookupQueue::handleLookupCompleted(const UUID& id, const OSegEntry& dest) {
+    completeLookup(id, dest, ResolvedFromServer);
+}
+
+void OSegLookupQueue::completeLookup(const UUID& id, const OSegEntry& dest, ResolvedFrom resolved_from) {
     //Now sending messages that we had saved up from oseg lookup calls.
     LookupMap::iterator iterQueueMap = mLookups.find(id);
     if (iterQueueMap == mLookups.end())
         return;
 
-    for (int s=0; s < (signed) ((iterQueueMap->second).size()); ++ s) {
-        const OSegLookup& lu = (iterQueueMap->second[s]);
+    // Pull the list out before invoking callbacks, which may submit new
+    // lookups for the same object
+    OSegLookupList lookups;
+    lookups.swap(iterQueueMap->second);
+    mLookups.erase(iterQueueMap);
+
+    Time now = Timer::now();
+    recordLatency(now - lookups.started(), now);
+    if (dest.isNull())
+        recordNotFound(id, now);
+
+    for (int s=0; s < (signed) (lookups.size()); ++ s) {
+        const OSegLookup& lu = lookups[s];
         mTotalSize -= lu.size;
-        lu.cb(lu.msg, dest, ResolvedFromServer);
+        lu.cb(lu.msg, dest, resolved_from);
     }
-    mLookups.erase(iterQueueMap);
+}
+
+void OSegLookupQueue::recordNotFound(const UUID& id, const Time& now) {
+    if (mNotFoundLifetime <= Duration::zero()) return;
+
+    // Clear out anything that has expired. Entries refreshed since they were
+    // queued will have a later expiration in the map and are left alone.
+    while(!mNotFoundExpiry.empty() && mNotFoundExpiry.front().first <= now) {
+        NotFoundMap::iterator it = mNotFound.find(mNotFoundExpiry.front().second);
+        if (it != mNotFound.end() && it->second <= now)
+            mNotFound.erase(it);
+        mNotFoundExpiry.pop_front();
+    }
+
+    Time expires = now + mNotFoundLifetime;
+    mNotFound[id] = expires;
+    mNotFoundExpiry.push_back(std::make_pair(expires, id));
+}
+
+bool OSegLookupQueue::checkNotFound(const UUID& id, const Time& now) {
+    if (mNotFound.empty()) return false;
+
+    NotFoundMap::iterator it = mNotFound.find(id);
+    if (it == mNotFound.end()) return false;
+    if (it->second <= now) {
+        mNotFound.erase(it);
+        return false;
+    }
+    return true;
+}
+
+void OSegLookupQueue::recordLatency(const Duration& latency, const Time& now) {
+    int64 us = latency.toMicroseconds();
+    uint32 bucket = 0;
+    while(bucket < LATENCY_HISTOGRAM_BUCKETS-1 && us >= ((int64)LATENCY_HISTOGRAM_MIN_US << bucket))
+        bucket++;
+    mLatencyCounts[bucket]++;
+
+    if (now >= mNextStatsReport)
+        reportStats(now);
+}
+
+void OSegLookupQueue::reportStats(const Time& now) {
+    std::vector<uint64> bounds(LATENCY_HISTOGRAM_BUCKETS);
+    for(uint32 i = 0; i < LATENCY_HISTOGRAM_BUCKETS-1; i++)
+        bounds[i] = ((uint64)LATENCY_HISTOGRAM_MIN_US << i);
+    bounds[LATENCY_HISTOGRAM_BUCKETS-1] = std::numeric_limits<uint64>::max();
+
+    CONTEXT_SPACETRACE(osegLookupLatency,
+        mContext->id(),
+        bounds, mLatencyCounts,
+        mBatches, mBatchedLookups, mNotFoundHits
+    );
+
+    mLatencyCounts.assign(LATENCY_HISTOGRAM_BUCKETS, 0);
+    mBatches = 0;
+    mBatchedLookups = 0;
+    mNotFoundHits = 0;
+    mNextStatsReport = now + mStatsInterval;
 }
 
 } // namespace Sirikata
@@ -36,6 +36,7 @@
 #include <sirikata/core/util/Platform.hpp>
 #include <sirikata/space/ServerMessage.hpp>
 #include <sirikata/space/ObjectSegmentation.hpp>
+#include <sirikata/space/SpaceContext.hpp>
 
 namespace Sirikata {
 
@@ -44,6 +45,12 @@ namespace Sirikata {
  *  The user can specify a policy for how these rejections occur, e.g. based
  *  on a total number of outstanding lookups, a total number of bytes in messages
  *  for outstanding lookups, etc.
+ *
+ *  New lookups are collected and handed to the OSeg in batches, either when
+ *  the batch fills up or once the current burst of work on the network strand
+ *  finishes. Objects the OSeg couldn't find are remembered for a short time so
+ *  repeated messages to them don't each trigger a lookup. Lookup latencies are
+ *  collected into a histogram which is periodically traced.
  */
 class OSegLookupQueue : public OSegLookupListener {
 public:
@@ -71,7 +78,15 @@ private:
     class OSegLookupList : protected std::vector<OSegLookup> {
         typedef std::vector<OSegLookup> OSegLookupVector;
         size_t mTotalSize;
+        Time mStarted;
     public:
+        OSegLookupList();
+        void swap(OSegLookupList& other);
+
+        // Time the lookup for the object was started
+        const Time& started() const;
+        void setStarted(const Time& t);
+
         size_t ByteSize() const;
         size_t size() const;
         OSegLookup& operator[] (size_t where);
@@ -82,8 +97,24 @@ private:
 
     typedef std::tr1::unordered_map<UUID, OSegLookupList, UUID::Hasher> LookupMap;
 
+    // Objects recently reported as not found, with the time to forget them.
+    // The queue tracks the order they expire in so they can be cleaned out.
+    // Only used if oseg-negative-cache-lifetime is set, since it can hide an
+    // object that's created before the entry expires.
+    typedef std::tr1::unordered_map<UUID, Time, UUID::Hasher> NotFoundMap;
+    typedef std::deque< std::pair<Time, UUID> > NotFoundExpiryQueue;
+
 
+    // A batch of lookups handed to the OSeg on its own strand, and the
+    // results it returned immediately
+    struct LookupBatch {
+        std::vector<UUID> ids;
+        std::vector<OSegEntry> results;
+    };
+
+    SpaceContext* mContext;
     Network::IOStrand* mNetworkStrand;
+    Network::IOStrand* mOSegStrand; // Strand the OSeg expects lookups on
     ObjectSegmentation* mOSeg; // The OSeg that does the heavy lifting
 
     LookupMap mLookups; // Map of object id being queried -> msgs destined for that object
@@ -91,21 +122,62 @@ private:
     uint32 mMaxLookups; // Total number of unique OSeg lookups (i.e. number of
                         // UUIDs, not number of requests).
 
-    /* OSegLookupListener Interface */
-    virtual void osegLookupCompleted(const UUID& id, const OSegEntry& dest);
+    // Lookups accepted but not yet sent to the OSeg
+    std::vector<UUID> mPendingBatch;
+    uint32 mMaxBatchSize;
+    bool mFlushScheduled;
+
+    NotFoundMap mNotFound;
+    NotFoundExpiryQueue mNotFoundExpiry;
+    Duration mNotFoundLifetime;
+
+    // Latency histogram, bucket i covering lookups taking less than
+    // LATENCY_HISTOGRAM_MIN_US << i microseconds; the last is unbounded
+    std::vector<uint64> mLatencyCounts;
+    uint64 mBatches;
+    uint64 mBatchedLookups;
+    uint64 mNotFoundHits;
+    Duration mStatsInterval;
+    Time mNextStatsReport;
+
     /* Main thread handler for lookups. */
     void handleLookupCompleted(const UUID& id, const OSegEntry& dest);
+
+    // Send the pending batch to the OSeg
+    void handleFlushBatch();
+    void flushBatch();
+    // Run a batch on the OSeg strand, then handle its results back on the
+    // network strand
+    void handleOSegLookupBatch(LookupBatch* batch);
+    void handleLookupBatchResults(LookupBatch* batch);
+    // Deliver all messages waiting on the object and record the lookup's latency
+    void completeLookup(const UUID& id, const OSegEntry& dest, ResolvedFrom resolved_from);
+
+    void recordNotFound(const UUID& id, const Time& now);
+    bool checkNotFound(const UUID& id, const Time& now);
+
+    void recordLatency(const Duration& latency, const Time& now);
+    void reportStats(const Time& now);
 public:
     /** Create an OSegLookupQueue which uses the specified ObjectSegmentation to resolve queries and
      *  the specified predicate to determine if new lookups are accepted.
+     *  \param ctx the SpaceContext, used for tracing lookup statistics
      *  \param net_strand the strand used for networking, i.e. the one which should handle lookup
      *                    results
      *  \param oseg the ObjectSegmentation which resolves queries
+     *  \param oseg_strand the strand to issue OSeg lookups on, if it isn't
+     *                     net_strand
      */
-    OSegLookupQueue(Network::IOStrand* net_strand, ObjectSegmentation* oseg);
+    OSegLookupQueue(SpaceContext* ctx, Network::IOStrand* net_strand, ObjectSegmentation* oseg, Network::IOStrand* oseg_strand = NULL);
 
     virtual ~OSegLookupQueue() {}
 
+    /* OSegLookupListener Interface. Public so an owner splitting lookups
+     * between several queues can register itself as the OSeg's listener and
+     * hand each result to the right queue.
+     */
+    virtual void osegLookupCompleted(const UUID& id, const OSegEntry& dest);
+
     /** Perform an OSeg cache lookup, returning the ServerID or NullServerID if
      *  the cache doesn't contain an entry for the object.
      */
@@ -115,6 +187,8 @@ public:
      *  call.  Otherwise, it will be triggered when a service() call produces a result.
      *  Note that if the request is accepted, the message is owned by the OSegLookupQueue until
      *  the callback is invoked, at which time control is passed back to the caller.
+     *  If the object was recently found not to exist, the callback is invoked
+     *  immediately with a null OSegEntry.
      *  \param msg the ObjectMessage to perform the lookup for
      *  \param cb the callback to invoke when the lookup is complete
      *  \returns true if the lookup was accepted, false if it was rejected (due to the push predicate).
@@ -59,10 +59,13 @@ void InitSpaceOptions() {
 
         .addOption(new OptionValue(SERVER_QUEUE, "fair", Sirikata::OptionValueType<String>(), "The type of ServerMessageQueue to use for routing."))
         .addOption(new OptionValue(SERVER_QUEUE_LENGTH, "8192", Sirikata::OptionValueType<uint32>(), "Length of queue for each server."))
+        .addOption(new OptionValue(SERVER_QUEUE_BATCH_BYTES, "16384", Sirikata::OptionValueType<uint32>(), "Messages to the same server are packed into one network write up to this many bytes. Messages larger than this are still sent, one per write."))
         .addOption(new OptionValue(SERVER_RECEIVER, "fair", Sirikata::OptionValueType<String>(), "The type of ServerMessageReceiver to use for routing."))
-        .addOption(new OptionValue(SERVER_ODP_FLOW_SCHEDULER, "region", Sirikata::OptionValueType<String>(), "The type of ODPFlowScheduler to use for routing."))
+        .addOption(new OptionValue(SERVER_ODP_FLOW_SCHEDULER, "region", Sirikata::OptionValueType<String>(), "The type of ODPFlowScheduler to use for routing: region (FIFO), csfq, or drr (per-flow queues, weighted deficit round robin)."))
         .addOption(new OptionValue(FORWARDER_RECEIVE_QUEUE_SIZE, "16384", Sirikata::OptionValueType<uint32>(), "The type of ODPFlowScheduler to use for routing."))
         .addOption(new OptionValue(FORWARDER_SEND_QUEUE_SIZE, "65536", Sirikata::OptionValueType<uint32>(), "The type of ODPFlowScheduler to use for routing."))
+        .addOption(new OptionValue(FORWARDER_ROUTING_STRANDS, "0", Sirikata::OptionValueType<uint32>(), "Number of strands object messages are routed on, partitioned by destination object. 0 routes everything on the main strand."))
+        .addOption(new OptionValue(FORWARDER_ROUTING_QUEUE_SIZE, "4096", Sirikata::OptionValueType<uint32>(), "Maximum number of object messages waiting to be routed on each routing strand."))
 
         .addOption(new OptionValue(NETWORK_TYPE, "tcp", Sirikata::OptionValueType<String>(), "The networking subsystem to use."))
 
@@ -70,16 +73,20 @@ void InitSpaceOptions() {
         .addOption(new OptionValue(OSEG_OPTIONS,"",Sirikata::OptionValueType<String>(),"Specifies arguments to OSeg."))
 
         .addOption(new OptionValue(OSEG_LOOKUP_QUEUE_SIZE, "2000", Sirikata::OptionValueType<uint32>(), "Number of new lookups you can have on oseg lookup queue."))
+        .addOption(new OptionValue(OSEG_LOOKUP_BATCH_SIZE, "64", Sirikata::OptionValueType<uint32>(), "Maximum number of new oseg lookups to issue to the OSeg as a single batch."))
+        .addOption(new OptionValue(OSEG_NEGATIVE_CACHE_LIFETIME, "0", Sirikata::OptionValueType<Duration>(), "How long to remember that an oseg lookup found no object. Messages to the object during this time are resolved without another lookup, so an object created in the meantime can be missed. 0, the default, disables it."))
+        .addOption(new OptionValue(OSEG_LOOKUP_STATS_INTERVAL, "10s", Sirikata::OptionValueType<Duration>(), "How often to trace the oseg lookup latency histogram (requires the oseg cumulative trace)."))
 
         .addOption(new OptionValue(OSEG_CACHE_SIZE, "200", Sirikata::OptionValueType<uint32>(), "Maximum number of entries in the OSeg cache."))
 
-        .addOption(new OptionValue(CACHE_SELECTOR,CACHE_TYPE_ORIGINAL_LRU,Sirikata::OptionValueType<String>(),"Which caching algorithm to use."))
+        .addOption(new OptionValue(CACHE_SELECTOR,CACHE_TYPE_ORIGINAL_LRU,Sirikata::OptionValueType<String>(),"Which caching algorithm to use: cache_clock, cache_originallru, or cache_communication."))
 
          .addOption(new OptionValue(CACHE_COMM_SCALING,"1.0",Sirikata::OptionValueType<double>(),"What the communication falloff function scaling factor is."))
          .addOption(new OptionValue("send-capacity-overestimate","80000",Sirikata::OptionValueType<double>(),"How much to overestimate send capacity when queue is not blocked."))
          .addOption(new OptionValue("receive-capacity-overestimate","1",Sirikata::OptionValueType<double>(),"How much to overestimate recv capacity when queue is not blocked."))
         .addOption(new OptionValue(OSEG_CACHE_CLEAN_GROUP_SIZE, "25", Sirikata::OptionValueType<uint32>(), "Number of items to remove from the OSeg cache when it reaches the maximum size."))
         .addOption(new OptionValue(OSEG_CACHE_ENTRY_LIFETIME, "8s", Sirikata::OptionValueType<Duration>(), "Maximum lifetime for an OSeg cache entry."))
+        .addOption(new OptionValue(OSEG_CACHE_SHARDS, "16", Sirikata::OptionValueType<uint32>(), "Maximum number of independently locked shards in the cache_clock OSeg cache. Small caches use fewer so each shard holds at least 64 entries."))
 
         .addOption(new OptionValue(CSEG, "uniform", Sirikata::OptionValueType<String>(), "Type of Coordinate Segmentation implementation to use."))
         .addOption(new OptionValue("cseg-service-host", "meru00", Sirikata::OptionValueType<String>(), "Hostname of machine running the CSEG service (running with --cseg=distributed)"))
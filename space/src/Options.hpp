@@ -40,6 +40,7 @@
 
 #define SERVER_QUEUE         "server.queue"
 #define SERVER_QUEUE_LENGTH  "server.queue.length"
+#define SERVER_QUEUE_BATCH_BYTES  "server.queue.batch-bytes"
 #define SERVER_RECEIVER      "server.receiver"
 #define SERVER_ODP_FLOW_SCHEDULER   "server.odp.flowsched"
 
@@ -60,18 +61,25 @@
 #define OSEG_CACHE_SIZE              "oseg-cache-size"
 #define OSEG_CACHE_CLEAN_GROUP_SIZE  "oseg-cache-clean-group-size"
 #define OSEG_CACHE_ENTRY_LIFETIME    "oseg-cache-entry-lifetime"
+#define OSEG_CACHE_SHARDS            "oseg-cache-shards"
 
 #define CACHE_SELECTOR              "oseg-cache-selector"
 #define CACHE_TYPE_COMMUNICATION    "cache_communication"
 #define CACHE_TYPE_ORIGINAL_LRU     "cache_originallru"
+#define CACHE_TYPE_CLOCK            "cache_clock"
 
 
 #define CACHE_COMM_SCALING          "oseg-cache-scaling"
 
 #define FORWARDER_SEND_QUEUE_SIZE "forwarder.send-queue-size"
 #define FORWARDER_RECEIVE_QUEUE_SIZE "forwarder.receive-queue-size"
+#define FORWARDER_ROUTING_STRANDS "forwarder.routing-strands"
+#define FORWARDER_ROUTING_QUEUE_SIZE "forwarder.routing-queue-size"
 
 #define OSEG_LOOKUP_QUEUE_SIZE     "oseg_lookup_queue_size"
+#define OSEG_LOOKUP_BATCH_SIZE       "oseg-lookup-batch-size"
+#define OSEG_NEGATIVE_CACHE_LIFETIME "oseg-negative-cache-lifetime"
+#define OSEG_LOOKUP_STATS_INTERVAL   "oseg-lookup-stats-interval"
 
 #define OPT_PROX                   "prox"
 #define OPT_PROX_OPTIONS           "prox-options"
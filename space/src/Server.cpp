@@ -347,11 +347,21 @@ bool Server::onObjectHostMessageReceived(const ObjectHostConnectionID& conn_id,
     if (mLocalForwarder->tryForward(obj_msg))
         return true;
 
-    // 4. Try to shortcut them main thread. Use forwarder to try to forward
+    // 4. Try to shortcut them main thread. With routing strands, messages
+    // from connected objects go straight to their destination's routing
+    // strand, which checks the cache in order with earlier messages still
+    // waiting on an OSeg lookup. Otherwise use forwarder to try to forward
     // using the cache. FIXME when we do this, we skip over some checks that
-    // happen during the full forwarding
-    if (mForwarder->tryCacheForward(obj_msg))
+    // happen during the full forwarding.
+    if (mForwarder->usesRoutingStrands()) {
+        if (canRouteDirectly(obj_msg)) {
+            mForwarder->routeObjectHostMessage(obj_msg);
+            return true;
+        }
+    }
+    else if (mForwarder->tryCacheForward(obj_msg)) {
         return true;
+    }
 
     // 5. Otherwise, we're going to have to ship this to the main thread, either
     // for handling session messages, messages to the space, or to make a
@@ -487,6 +497,29 @@ bool Server::handleSingleObjectHostMessageRouting() {
     return true;
 }
 
+void Server::updateRoutableSource(const UUID& obj_id) {
+    bool routable =
+        mObjects.find(obj_id) != mObjects.end() ||
+        mMigratingConnections.find(obj_id) != mMigratingConnections.end();
+
+    boost::lock_guard<boost::mutex> lock(mRoutableSourcesMutex);
+    if (routable)
+        mRoutableSources.insert(obj_id);
+    else
+        mRoutableSources.erase(obj_id);
+}
+
+bool Server::canRouteDirectly(const Sirikata::Protocol::Object::ObjectMessage* obj_msg) {
+    // OHDP messages and messages to the space are handled on the main strand
+    static UUID null_ID = UUID::null();
+    if (obj_msg->source_object() == null_ID || obj_msg->dest_object() == null_ID)
+        return false;
+
+    // Unknown sources take the slow path, which logs and drops them
+    boost::lock_guard<boost::mutex> lock(mRoutableSourcesMutex);
+    return mRoutableSources.find(obj_msg->source_object()) != mRoutableSources.end();
+}
+
 // Handle Session messages from an object
 void Server::handleSessionMessage(const ObjectHostConnectionID& oh_conn_id, Sirikata::Protocol::Object::ObjectMessage* msg) {
     Sirikata::Protocol::Session::Container session_msg;
@@ -715,6 +748,7 @@ void Server::finishAddObject(const UUID& obj_id, OSegAddNewStatus status)
           // Create and store the connection
           ObjectConnection* conn = new ObjectConnection(obj_id, mObjectHostConnectionManager, sc.conn_id, sc.session_seqno);
           mObjects[obj_id] = conn;
+          updateRoutableSource(obj_id);
           mContext->timeSeries->report(mTimeSeriesObjects, mObjects.size());
 
           //TODO: assumes each server process is assigned only one region... perhaps we should enforce this constraint
@@ -863,6 +897,7 @@ void Server::handleDisconnect(UUID obj_id, ObjectConnection* conn, uint64 sessio
     mForwarder->removeObjectConnection(obj_id);
 
     mObjects.erase(obj_id);
+    updateRoutableSource(obj_id);
     // Num objects is reported by the caller
 
     ObjectReference obj(obj_id);
@@ -961,6 +996,7 @@ void Server::handleMigration(const UUID& obj_id)
 
     // Move from list waiting for migration message to active objects
     mObjects[obj_id] = obj_conn;
+    updateRoutableSource(obj_id);
     mContext->timeSeries->report(mTimeSeriesObjects, mObjects.size());
     mLocalForwarder->addActiveConnection(obj_conn);
 
@@ -1121,6 +1157,7 @@ void Server::handleMigrationEvent(const UUID& obj_id) {
             mocd.serviceConnection    =                                      true;
 
             mMigratingConnections[obj_id] = mocd;
+            updateRoutableSource(obj_id);
 
 
 
@@ -1130,6 +1167,7 @@ void Server::handleMigrationEvent(const UUID& obj_id) {
             mLocalForwarder->removeActiveConnection(obj_id);
             mObjects.erase(obj_id);
             mContext->timeSeries->report(mTimeSeriesObjects, mObjects.size());
+            updateRoutableSource(obj_id);
             ObjectReference obj(obj_id);
 
             mObjectSessionManager->removeSession(obj);
@@ -1219,6 +1257,7 @@ void Server::processAlreadyMigrating(const UUID& obj_id)
     mLocalForwarder->removeActiveConnection( obj_id );
     // Move from list waiting for migration message to active objects
     mObjects[obj_id] = obj_conn;
+    updateRoutableSource(obj_id);
     mContext->timeSeries->report(mTimeSeriesObjects, mObjects.size());
     mLocalForwarder->addActiveConnection(obj_conn);
 
@@ -1318,6 +1357,7 @@ void Server::killObjectConnection(const UUID& obj_id)
     CONTEXT_SPACETRACE(objectMigrationRoundTrip, obj_id, mContext->id(), migTo , timeTakenMs);
 
     mMigratingConnections.erase(objConMapIt);
+    updateRoutableSource(obj_id);
   }
 }
 
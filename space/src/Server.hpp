@@ -154,6 +154,13 @@ private:
     // couldn't be forwarded directly by the networking code
     // (i.e. needs routing to another node)
     bool handleSingleObjectHostMessageRouting();
+    // Records whether messages from an object can be routed, i.e. it's in
+    // mObjects or mMigratingConnections. Must be called on the main strand
+    // after either changes.
+    void updateRoutableSource(const UUID& obj_id);
+    // Whether an object host message can skip the main strand and go directly
+    // to the forwarder's routing strands. Safe to call from networking threads.
+    bool canRouteDirectly(const Sirikata::Protocol::Object::ObjectMessage* obj_msg);
 
     // Handle Session messages from an object
     void handleSessionMessage(const ObjectHostConnectionID& oh_conn_id, Sirikata::Protocol::Object::ObjectMessage* msg);
@@ -281,6 +288,13 @@ private:
     boost::mutex mRouteObjectMessageMutex;
     Sirikata::SizedThreadSafeQueue<ConnectionIDObjectMessagePair>mRouteObjectMessage;
 
+    // Copy of the objects messages may be routed from (see
+    // updateRoutableSource), readable from networking threads so that, with
+    // routing strands, OH messages don't have to cross the main strand
+    typedef std::tr1::unordered_set<UUID, UUID::Hasher> UUIDSet;
+    boost::mutex mRoutableSourcesMutex;
+    UUIDSet mRoutableSources;
+
     // TimeSeries identifiers. Must include the ServerID for uniqueness, so we
     // cache them so TimeSeries reports are fast
     String mTimeSeriesObjects;
@@ -33,6 +33,7 @@
 #include "ServerMessageQueue.hpp"
 #include <sirikata/core/trace/Trace.hpp>
 #include <sirikata/core/options/CommonOptions.hpp>
+#include "Options.hpp"
 
 namespace Sirikata {
 
@@ -41,6 +42,7 @@ ServerMessageQueue::ServerMessageQueue(SpaceContext* ctx, SpaceNetwork* net, Sen
           mSenderStrand(ctx->ioService->createStrand("ServerMessageQueue SenderStrand")),
           mNetwork(net),
           mSender(sender),
+          mBatchBytes(GetOptionValue<uint32>(SERVER_QUEUE_BATCH_BYTES)),
           mUsedWeightSum(0.0),
           mCapacityEstimator(Duration::milliseconds((int64)200).toSeconds()),
           mBlocked(false)
@@ -51,6 +53,10 @@ ServerMessageQueue::ServerMessageQueue(SpaceContext* ctx, SpaceNetwork* net, Sen
 }
 
 ServerMessageQueue::~ServerMessageQueue() {
+    for(OutgoingBatchMap::iterator it = mOutgoingBatches.begin(); it != mOutgoingBatches.end(); it++) {
+        for(uint32 i = 0; i < it->second.messages.size(); i++)
+            delete it->second.messages[i];
+    }
     delete mProfiler;
     delete mSenderStrand;
 }
@@ -68,7 +74,35 @@ void ServerMessageQueue::connect(const ServerID& dest) {
     }
 }
 
-uint32 ServerMessageQueue::trySend(const ServerID& dest, const Message* msg) {
+bool ServerMessageQueue::batchHasRoom(const ServerID& dest, const Message* msg) {
+    OutgoingBatchMap::iterator it = mOutgoingBatches.find(dest);
+    if (it == mOutgoingBatches.end() || it->second.messages.empty())
+        return true;
+    // Frame header is a uint32 length
+    return (it->second.data.size() + sizeof(uint32) + msg->size() <= mBatchBytes);
+}
+
+void ServerMessageQueue::appendToBatch(const ServerID& dest, Message* msg) {
+    OutgoingBatch& batch = mOutgoingBatches[dest];
+    if (!msg->serializeFramed(&batch.data)) {
+        SILOG(smqueue,error,"Failed to serialize message to " << dest << ", dropping.");
+        delete msg;
+        return;
+    }
+    batch.messages.push_back(msg);
+}
+
+bool ServerMessageQueue::batchPending(const ServerID& dest) {
+    OutgoingBatchMap::iterator it = mOutgoingBatches.find(dest);
+    return (it != mOutgoingBatches.end() && !it->second.messages.empty());
+}
+
+uint32 ServerMessageQueue::trySendBatch(const ServerID& dest) {
+    OutgoingBatchMap::iterator batch_it = mOutgoingBatches.find(dest);
+    if (batch_it == mOutgoingBatches.end() || batch_it->second.messages.empty())
+        return 0;
+    OutgoingBatch& batch = batch_it->second;
+
     SendStreamMap::iterator it = mSendStreams.find(dest);
     if (it == mSendStreams.end()) {
         mSendStreams[dest]=NULL;
@@ -80,17 +114,31 @@ uint32 ServerMessageQueue::trySend(const ServerID& dest, const Message* msg) {
     if (strm_out==NULL) {
         return 0;
     }
-    Network::Chunk serialized;
-    msg->serialize(&serialized);
-    uint32 packet_size = serialized.size();
-    bool sent_success = strm_out->send(serialized);
+    uint32 packet_size = batch.data.size();
+    bool sent_success = strm_out->send(batch.data);
+    if (!sent_success)
+        return 0; // Failed
 
-    if (sent_success) {
+    for(uint32 i = 0; i < batch.messages.size(); i++) {
+        Message* msg = batch.messages[i];
         TIMESTAMP_PAYLOAD(msg, Trace::SPACE_TO_SPACE_HIT_NETWORK);
-        return packet_size;
+        delete msg;
     }
+    batch.messages.clear();
+    batch.data.clear();
+    return packet_size;
+}
 
-    return 0; // Failed
+uint32 ServerMessageQueue::trySendBatches(std::vector<ServerID>* blocked) {
+    uint32 total_sent = 0;
+    for(OutgoingBatchMap::iterator it = mOutgoingBatches.begin(); it != mOutgoingBatches.end(); it++) {
+        if (it->second.messages.empty()) continue;
+        uint32 sent_size = trySendBatch(it->first);
+        if (sent_size == 0)
+            blocked->push_back(it->first);
+        total_sent += sent_size;
+    }
+    return total_sent;
 }
 
 double ServerMessageQueue::totalUsedWeight() {
@@ -92,10 +92,27 @@ public:
     // ServerMessageReceiver Protected (Implementation) Interface
     virtual void handleUpdateReceiverStats(ServerID sid, double total_weight, double used_weight) = 0;
 
-    // Tries to send the Message to the SpaceNetwork, and tags it for analysis if
-    // successful. Helper method for implementations.
-    // If sent, returns the size of the serialized packet.  Otherwise, returns 0.
-    uint32 trySend(const ServerID& addr, const Message* msg);
+    // Messages are sent in batches: each destination has a buffer that
+    // messages are serialized into, back to back as Network::Frames, and the
+    // whole buffer goes to the SpaceNetwork as one write. Helper methods for
+    // implementations, all must be called from the sender strand.
+
+    // Returns true if msg can be added to dest's batch without going over the
+    // byte budget. An empty batch always accepts a message.
+    bool batchHasRoom(const ServerID& dest, const Message* msg);
+    // Adds msg to dest's batch, taking ownership of it.
+    void appendToBatch(const ServerID& dest, Message* msg);
+    // Returns true if dest has messages waiting in its batch
+    bool batchPending(const ServerID& dest);
+    // Tries to send dest's batch to the SpaceNetwork, tagging its messages for
+    // analysis if successful. If sent, returns the number of bytes sent and
+    // empties the batch. Otherwise, returns 0 and leaves the batch to be
+    // retried.
+    uint32 trySendBatch(const ServerID& dest);
+    // Tries to send every pending batch, adding the destinations that couldn't
+    // be sent to to blocked. Returns the total number of bytes sent.
+    uint32 trySendBatches(std::vector<ServerID>* blocked);
+
     double mCapacityOverestimate;
     SpaceContext* mContext;
     Network::IOStrand* mSenderStrand;
@@ -105,6 +122,17 @@ public:
     typedef std::tr1::unordered_map<ServerID, SpaceNetwork::SendStream*> SendStreamMap;
     SendStreamMap mSendStreams;
 
+    struct OutgoingBatch {
+        // Serialized, framed messages. Keeps its capacity between batches so
+        // steady state sending doesn't allocate.
+        Network::Chunk data;
+        // The messages in data, kept until they're sent for tracing
+        std::vector<Message*> messages;
+    };
+    typedef std::tr1::unordered_map<ServerID, OutgoingBatch> OutgoingBatchMap;
+    OutgoingBatchMap mOutgoingBatches;
+    uint32 mBatchBytes;
+
     // Total weights are handled by the main strand since that's the only place
     // they are needed. Handling of used weights is implementation dependent and
     // goes to the receiver strand.
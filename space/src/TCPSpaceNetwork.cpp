@@ -160,6 +160,8 @@ bool TCPSpaceNetwork::TCPSendStream::send(const Chunk& data) {
     if (!remote_stream)
         return false;
 
+    // data is usually a batch of framed messages from the ServerMessageQueue,
+    // so this is one stream write for all of them
     bool success = (
         remote_stream->connected &&
         !remote_stream->shutting_down &&
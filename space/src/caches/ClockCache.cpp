@@ -0,0 +1,265 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "ClockCache.hpp"
+
+#define SKETCH_DEPTH 4
+#define SKETCH_MAX_COUNT 15
+// Shards smaller than this evict too eagerly when lookups aren't spread
+// evenly, so small caches get fewer shards
+#define MIN_ENTRIES_PER_SHARD 64
+
+namespace Sirikata {
+
+namespace {
+uint32 nextPowerOfTwo(uint32 v) {
+    uint32 result = 1;
+    while(result < v) result <<= 1;
+    return result;
+}
+
+uint32 numShardsFor(uint32 maxSize, uint32 requested) {
+    uint32 shards = nextPowerOfTwo(std::max(requested, (uint32)1));
+    while(shards > 1 && maxSize / shards < MIN_ENTRIES_PER_SHARD)
+        shards >>= 1;
+    return shards;
+}
+
+// Per-row seeds for the frequency sketch
+const uint64 SketchSeeds[SKETCH_DEPTH] = {
+    0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL
+};
+}
+
+ClockCache::Slot::Slot()
+ : id(UUID::null()),
+   entry(OSegEntry::null()),
+   inserted(Time::null()),
+   hash(0),
+   used(false),
+   referenced(false)
+{
+}
+
+ClockCache::Shard::Shard()
+ : mask(0),
+   count(0),
+   capacity(0),
+   hand(0),
+   sketchMask(0),
+   sketchIncrements(0),
+   resetInterval(0)
+{
+}
+
+
+ClockCache::ClockCache(Context* ctx, uint32 maxSize, uint32 numShards, Duration entryLifetime)
+ : mContext(ctx),
+   mEntryLifetime(entryLifetime),
+   mShards(NULL),
+   mNumShards(numShardsFor(maxSize, numShards)),
+   mShardMask(mNumShards-1)
+{
+    uint32 per_shard = std::max((maxSize + mNumShards - 1) / mNumShards, (uint32)1);
+
+    mShards = new Shard[mNumShards];
+    for(uint32 i = 0; i < mNumShards; i++) {
+        Shard& shard = mShards[i];
+        shard.capacity = per_shard;
+        // Keep the load factor at or below 1/2 so probe sequences stay short
+        shard.slots.resize(nextPowerOfTwo(per_shard * 2));
+        shard.mask = shard.slots.size() - 1;
+
+        uint32 sketch_width = nextPowerOfTwo(std::max(per_shard * 4, (uint32)16));
+        shard.sketch.resize(sketch_width * SKETCH_DEPTH, 0);
+        shard.sketchMask = sketch_width - 1;
+        shard.resetInterval = per_shard * 10;
+    }
+}
+
+ClockCache::~ClockCache() {
+    delete[] mShards;
+}
+
+uint64 ClockCache::mix(uint64 h) {
+    // Murmur3 finalizer, spreads UUID::hash() so shard, slot, and sketch
+    // indices can use independent bits
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+int32 ClockCache::find(Shard& shard, const UUID& uuid, uint32 hash) const {
+    uint32 idx = hash & shard.mask;
+    while(shard.slots[idx].used) {
+        if (shard.slots[idx].hash == hash && shard.slots[idx].id == uuid)
+            return (int32)idx;
+        idx = (idx + 1) & shard.mask;
+    }
+    return -1;
+}
+
+void ClockCache::erase(Shard& shard, uint32 idx) {
+    // Backward shift deletion: pull later entries in the probe sequence into
+    // the hole unless their home slot lies after it, so no tombstones are
+    // needed
+    shard.slots[idx].used = false;
+    shard.count--;
+
+    uint32 hole = idx;
+    uint32 next = (idx + 1) & shard.mask;
+    while(shard.slots[next].used) {
+        uint32 home = shard.slots[next].hash & shard.mask;
+        bool stays = (hole <= next)
+            ? (hole < home && home <= next)
+            : (hole < home || home <= next);
+        if (!stays) {
+            shard.slots[hole] = shard.slots[next];
+            shard.slots[next].used = false;
+            hole = next;
+        }
+        next = (next + 1) & shard.mask;
+    }
+}
+
+void ClockCache::place(Shard& shard, const UUID& uuid, uint32 hash, const OSegEntry& sID, const Time& now) {
+    uint32 idx = hash & shard.mask;
+    while(shard.slots[idx].used)
+        idx = (idx + 1) & shard.mask;
+
+    Slot& slot = shard.slots[idx];
+    slot.id = uuid;
+    slot.entry = sID;
+    slot.inserted = now;
+    slot.hash = hash;
+    slot.used = true;
+    slot.referenced = false;
+    shard.count++;
+}
+
+uint32 ClockCache::findVictim(Shard& shard, const Time& now) {
+    // Only called on a full shard, so this finishes within two sweeps
+    while(true) {
+        uint32 idx = shard.hand;
+        shard.hand = (shard.hand + 1) & shard.mask;
+
+        Slot& slot = shard.slots[idx];
+        if (!slot.used) continue;
+        if (expired(slot, now)) return idx;
+        if (slot.referenced) {
+            slot.referenced = false;
+            continue;
+        }
+        return idx;
+    }
+}
+
+void ClockCache::recordAccess(Shard& shard, uint32 hash) {
+    uint32 width = shard.sketchMask + 1;
+    for(uint32 row = 0; row < SKETCH_DEPTH; row++) {
+        uint8& counter = shard.sketch[row * width + (mix(hash ^ SketchSeeds[row]) & shard.sketchMask)];
+        if (counter < SKETCH_MAX_COUNT) counter++;
+    }
+
+    if (++shard.sketchIncrements >= shard.resetInterval) {
+        for(uint32 i = 0; i < shard.sketch.size(); i++)
+            shard.sketch[i] >>= 1;
+        shard.sketchIncrements = 0;
+    }
+}
+
+uint8 ClockCache::frequency(const Shard& shard, uint32 hash) const {
+    uint32 width = shard.sketchMask + 1;
+    uint8 result = SKETCH_MAX_COUNT;
+    for(uint32 row = 0; row < SKETCH_DEPTH; row++)
+        result = std::min(result, shard.sketch[row * width + (mix(hash ^ SketchSeeds[row]) & shard.sketchMask)]);
+    return result;
+}
+
+void ClockCache::insert(const UUID& uuid, const OSegEntry& sID) {
+    uint64 h = mix(uuid.hash());
+    uint32 hash = (uint32)(h >> 32);
+    Shard& shard = shardFor(h);
+    Time now = mContext->recentSimTime();
+
+    boost::lock_guard<boost::mutex> lck(shard.mutex);
+
+    int32 idx = find(shard, uuid, hash);
+    if (idx >= 0) {
+        Slot& slot = shard.slots[idx];
+        slot.entry = sID;
+        slot.inserted = now;
+        slot.referenced = true;
+        return;
+    }
+
+    if (shard.count >= shard.capacity) {
+        uint32 victim = findVictim(shard, now);
+        // Only displace a live entry if the new one has been asked for at
+        // least as often
+        if (!expired(shard.slots[victim], now) &&
+            frequency(shard, hash) < frequency(shard, shard.slots[victim].hash))
+            return;
+        erase(shard, victim);
+    }
+    place(shard, uuid, hash, sID, now);
+}
+
+const OSegEntry& ClockCache::get(const UUID& uuid) {
+    OSegEntry* result = mResult.get();
+    if (result == NULL) {
+        result = new OSegEntry();
+        mResult.reset(result);
+    }
+
+    uint64 h = mix(uuid.hash());
+    uint32 hash = (uint32)(h >> 32);
+    Shard& shard = shardFor(h);
+    {
+        boost::lock_guard<boost::mutex> lck(shard.mutex);
+
+        // Misses count too, so objects that keep getting looked up are
+        // admitted when they're finally inserted
+        recordAccess(shard, hash);
+
+        int32 idx = find(shard, uuid, hash);
+        if (idx >= 0) {
+            Slot& slot = shard.slots[idx];
+            if (!expired(slot, mContext->recentSimTime())) {
+                slot.referenced = true;
+                *result = slot.entry;
+                return *result;
+            }
+            erase(shard, idx);
+        }
+    }
+
+    *result = OSegEntry::null();
+    return *result;
+}
+
+void ClockCache::remove(const UUID& uuid) {
+    uint64 h = mix(uuid.hash());
+    uint32 hash = (uint32)(h >> 32);
+    Shard& shard = shardFor(h);
+
+    boost::lock_guard<boost::mutex> lck(shard.mutex);
+    int32 idx = find(shard, uuid, hash);
+    if (idx >= 0)
+        erase(shard, idx);
+}
+
+uint32 ClockCache::size() {
+    uint32 total = 0;
+    for(uint32 i = 0; i < mNumShards; i++) {
+        boost::lock_guard<boost::mutex> lck(mShards[i].mutex);
+        total += mShards[i].count;
+    }
+    return total;
+}
+
+} // namespace Sirikata
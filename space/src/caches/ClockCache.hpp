@@ -0,0 +1,103 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_SPACE_CLOCK_CACHE_HPP_
+#define _SIRIKATA_SPACE_CLOCK_CACHE_HPP_
+
+#include <sirikata/core/service/Context.hpp>
+#include <sirikata/space/OSegCache.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace Sirikata {
+
+/** An OSegCache split into independently locked shards so lookups from
+ *  different threads rarely contend. Each shard is an open addressing table
+ *  with a fixed number of slots, evicting with the CLOCK algorithm. New
+ *  entries only displace the CLOCK victim if a small frequency sketch says
+ *  they've been requested at least as often (TinyLFU admission), which keeps
+ *  one-off lookups from flushing out frequently used entries.
+ *
+ *  get() returns a reference to storage owned by the calling thread, valid
+ *  until that thread's next call to get().
+ */
+class ClockCache : public OSegCache {
+public:
+    /** Create a cache.
+     *  \param ctx context, used for the current time to expire entries
+     *  \param maxSize maximum number of entries across all shards
+     *  \param numShards number of shards, rounded up to a power of 2. Fewer
+     *         are used if the shards would hold less than 64 entries each.
+     *  \param entryLifetime maximum age of an entry before it is ignored
+     */
+    ClockCache(Context* ctx, uint32 maxSize, uint32 numShards, Duration entryLifetime);
+    virtual ~ClockCache();
+
+    virtual void insert(const UUID& uuid, const OSegEntry& sID);
+    virtual const OSegEntry& get(const UUID& uuid);
+    virtual void remove(const UUID& uuid);
+
+    uint32 size();
+    uint32 numShards() const { return mNumShards; }
+private:
+    struct Slot {
+        Slot();
+
+        UUID id;
+        OSegEntry entry;
+        Time inserted;
+        uint32 hash;
+        bool used;
+        bool referenced;
+    };
+
+    struct Shard {
+        Shard();
+
+        boost::mutex mutex;
+        std::vector<Slot> slots;
+        uint32 mask; // slots.size()-1
+        uint32 count;
+        uint32 capacity;
+        uint32 hand; // CLOCK hand
+
+        // Count-min sketch, SKETCH_DEPTH rows of 4-bit saturating counters
+        // (stored one per byte), halved every resetInterval increments so old
+        // popularity fades.
+        std::vector<uint8> sketch;
+        uint32 sketchMask;
+        uint32 sketchIncrements;
+        uint32 resetInterval;
+    };
+
+    static uint64 mix(uint64 h);
+
+    Shard& shardFor(uint64 h) { return mShards[h & mShardMask]; }
+    // Returns slot index or -1
+    int32 find(Shard& shard, const UUID& uuid, uint32 hash) const;
+    void erase(Shard& shard, uint32 idx);
+    void place(Shard& shard, const UUID& uuid, uint32 hash, const OSegEntry& sID, const Time& now);
+    // Picks a slot to evict, clearing reference bits as it goes. Expired
+    // entries are taken immediately.
+    uint32 findVictim(Shard& shard, const Time& now);
+
+    void recordAccess(Shard& shard, uint32 hash);
+    uint8 frequency(const Shard& shard, uint32 hash) const;
+
+    bool expired(const Slot& slot, const Time& now) const {
+        return (now - slot.inserted) > mEntryLifetime;
+    }
+
+    Context* mContext;
+    Duration mEntryLifetime;
+    Shard* mShards;
+    uint32 mNumShards;
+    uint64 mShardMask;
+
+    boost::thread_specific_ptr<OSegEntry> mResult;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_SPACE_CLOCK_CACHE_HPP_
@@ -0,0 +1,42 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "LockedCache.hpp"
+
+namespace Sirikata {
+
+LockedCache::LockedCache(OSegCache* cache)
+ : mCache(cache)
+{
+}
+
+LockedCache::~LockedCache() {
+    delete mCache;
+}
+
+void LockedCache::insert(const UUID& uuid, const OSegEntry& sID) {
+    boost::mutex::scoped_lock lock(mMutex);
+    mCache->insert(uuid, sID);
+}
+
+const OSegEntry& LockedCache::get(const UUID& uuid) {
+    OSegEntry* result = mResult.get();
+    if (result == NULL) {
+        result = new OSegEntry(OSegEntry::null());
+        mResult.reset(result);
+    }
+
+    // The wrapped cache returns a reference into its own storage, so copy
+    // it out before letting anyone else in
+    boost::mutex::scoped_lock lock(mMutex);
+    *result = mCache->get(uuid);
+    return *result;
+}
+
+void LockedCache::remove(const UUID& uuid) {
+    boost::mutex::scoped_lock lock(mMutex);
+    mCache->remove(uuid);
+}
+
+} // namespace Sirikata
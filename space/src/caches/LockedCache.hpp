@@ -0,0 +1,37 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_SPACE_LOCKED_CACHE_HPP_
+#define _SIRIKATA_SPACE_LOCKED_CACHE_HPP_
+
+#include <sirikata/space/OSegCache.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace Sirikata {
+
+/** Wraps an OSegCache which isn't thread safe with a single lock, for use
+ *  when the Forwarder checks the cache from several routing strands at once.
+ *  Like ClockCache, get() returns a reference to storage owned by the
+ *  calling thread, valid until that thread's next call to get().
+ */
+class LockedCache : public OSegCache {
+public:
+    /// Takes ownership of cache
+    LockedCache(OSegCache* cache);
+    virtual ~LockedCache();
+
+    virtual void insert(const UUID& uuid, const OSegEntry& sID);
+    virtual const OSegEntry& get(const UUID& uuid);
+    virtual void remove(const UUID& uuid);
+
+private:
+    OSegCache* mCache;
+    boost::mutex mMutex;
+    boost::thread_specific_ptr<OSegEntry> mResult;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_SPACE_LOCKED_CACHE_HPP_
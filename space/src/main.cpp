@@ -66,6 +66,8 @@
 #include <sirikata/space/ObjectSegmentation.hpp>
 #include "caches/CommunicationCache.hpp"
 #include "caches/CacheLRUOriginal.hpp"
+#include "caches/ClockCache.hpp"
+#include "caches/LockedCache.hpp"
 
 #include <sirikata/space/SpaceContext.hpp>
 #include <sirikata/mesh/Filter.hpp>
@@ -76,6 +78,7 @@
 #include <sirikata/core/ohdp/SST.hpp>
 
 #include <sirikata/core/transfer/TransferMediator.hpp>
+#include <sirikata/core/transfer/TransferHandlers.hpp>
 
 namespace {
 using namespace Sirikata;
@@ -191,6 +194,7 @@ int main(int argc, char** argv) {
         commander = Command::CommanderFactory::getSingleton().getConstructor(commander_type)(space_context, commander_options);
 
     Transfer::TransferMediator::getSingleton().registerContext(space_context);
+    Transfer::SharedChunkCache::getSingleton().registerContext(space_context);
 
 
     Sirikata::SpaceNetwork* gNetwork = NULL;
@@ -280,11 +284,20 @@ int main(int argc, char** argv) {
         Duration entryLifetime = GetOptionValue<Duration>(OSEG_CACHE_ENTRY_LIFETIME);
         oseg_cache = new CacheLRUOriginal(space_context, cacheSize, cacheCleanGroupSize, entryLifetime);
     }
+    else if (cacheSelector == CACHE_TYPE_CLOCK) {
+        uint32 cacheShards = GetOptionValue<uint32>(OSEG_CACHE_SHARDS);
+        Duration entryLifetime = GetOptionValue<Duration>(OSEG_CACHE_ENTRY_LIFETIME);
+        oseg_cache = new ClockCache(space_context, cacheSize, cacheShards, entryLifetime);
+    }
     else {
         std::cout<<"\n\nUNKNOWN CACHE TYPE SELECTED.  Please re-try.\n\n";
         std::cout.flush();
         assert(false);
     }
+    // With routing strands the cache is read from several threads at once,
+    // which only ClockCache handles itself
+    if (GetOptionValue<uint32>(FORWARDER_ROUTING_STRANDS) > 0 && cacheSelector != CACHE_TYPE_CLOCK)
+        oseg_cache = new LockedCache(oseg_cache);
 
     //Create OSeg
     std::string oseg_type = GetOptionValue<String>(OSEG);
@@ -376,7 +389,9 @@ int main(int argc, char** argv) {
     space_context->add(ohSstConnMgr);
     space_context->add(prox);
 
-    space_context->run(3);
+    // Enough threads for each of the forwarder's routing strands to get its
+    // own core on top of the original main and networking threads
+    space_context->run(3 + GetOptionValue<uint32>(FORWARDER_ROUTING_STRANDS));
 
     space_context->cleanup();
 
@@ -0,0 +1,216 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include "../../../analysis/src/TraceReader.hpp"
+#include <sirikata/core/trace/BatchedBuffer.hpp>
+#include <sirikata/core/trace/Trace.hpp>
+#include <sirikata/core/util/Paths.hpp>
+#include <sirikata/core/util/Thread.hpp>
+#include <boost/filesystem.hpp>
+
+using namespace Sirikata;
+
+#define TRACE_TEST_FILE "TraceReaderTest.trace"
+// Records written by each thread in testConcurrentWriters
+#define RECORDS_PER_WRITER 5000
+
+class TraceReaderTest : public CxxTest::TestSuite {
+    std::vector<MessageTimestampEvent*> mEvents;
+
+    static String filename() {
+        return Path::Get(Path::DIR_TEMP, TRACE_TEST_FILE);
+    }
+
+    // Frame and write a record the same way Trace::timestampMessage does. The
+    // record's time is derived from its uid so it can be checked on the way
+    // back in.
+    static void writeTimestamp(BatchedBuffer* buf, uint16 type_hint, uint64 uid) {
+        Time t = Time::microseconds(1000 + uid * 10);
+        Trace::MessagePath path = Trace::CREATED;
+        ObjectMessagePort port = 7;
+
+        BatchedBuffer::IOVec data[7];
+        uint32 ndata = 5;
+        uint32 total_size = sizeof(t) + sizeof(uid) + sizeof(path);
+        data[2] = BatchedBuffer::IOVec(&t, sizeof(t));
+        data[3] = BatchedBuffer::IOVec(&uid, sizeof(uid));
+        data[4] = BatchedBuffer::IOVec(&path, sizeof(path));
+        if (type_hint == MessageCreationTimestampTag) {
+            total_size += 2 * sizeof(port);
+            data[ndata++] = BatchedBuffer::IOVec(&port, sizeof(port));
+            data[ndata++] = BatchedBuffer::IOVec(&port, sizeof(port));
+        }
+        data[0] = BatchedBuffer::IOVec(&total_size, sizeof(total_size));
+        data[1] = BatchedBuffer::IOVec(&type_hint, sizeof(type_hint));
+        buf->write(type_hint, t, data, ndata);
+    }
+
+    static void store(BatchedBuffer* buf) {
+        buf->flush();
+        FILE* os = fopen(filename().c_str(), "ab");
+        buf->store(os);
+        fclose(os);
+    }
+
+    void gotEvent(Event* evt) {
+        MessageTimestampEvent* ts_evt = dynamic_cast<MessageTimestampEvent*>(evt);
+        TS_ASSERT(ts_evt != NULL);
+        if (ts_evt == NULL) {
+            delete evt;
+            return;
+        }
+        mEvents.push_back(ts_evt);
+    }
+
+    void read(const TraceFilter& filter, uint32 nthreads) {
+        clearEvents();
+        TraceReader reader(filename(), 1);
+        TS_ASSERT(reader.valid());
+        reader.read(filter, nthreads, std::tr1::bind(&TraceReaderTest::gotEvent, this, std::tr1::placeholders::_1));
+    }
+
+    void clearEvents() {
+        for(uint32 i = 0; i < mEvents.size(); i++)
+            delete mEvents[i];
+        mEvents.clear();
+    }
+
+    void writer(BatchedBuffer* buf, uint32 writer_idx) {
+        for(uint64 i = 0; i < RECORDS_PER_WRITER; i++)
+            writeTimestamp(buf, MessageTimestampTag, writer_idx * RECORDS_PER_WRITER + i);
+    }
+
+public:
+    void setUp() {
+        boost::filesystem::remove(filename());
+    }
+
+    void tearDown() {
+        clearEvents();
+        boost::filesystem::remove(filename());
+    }
+
+    void testRoundTrip() {
+        // Enough records to fill several batches, plus a partial one, so
+        // there are full size chunks to split up and a small one at the end
+        BatchedBuffer buf;
+        uint32 total = 10000;
+        for(uint64 i = 0; i < total; i++)
+            writeTimestamp(&buf, MessageTimestampTag, i);
+        store(&buf);
+
+        TraceReader reader(filename(), 1);
+        TS_ASSERT(reader.numChunks() > 1);
+
+        // Whether or not chunks are split up, events come back in order
+        uint32 nthreads[] = { 1, 4 };
+        for(uint32 ti = 0; ti < 2; ti++) {
+            read(TraceFilter(), nthreads[ti]);
+            TS_ASSERT_EQUALS(mEvents.size(), total);
+            for(uint32 i = 0; i < mEvents.size(); i++) {
+                TS_ASSERT_EQUALS(mEvents[i]->uid, (uint64)i);
+                TS_ASSERT_EQUALS(mEvents[i]->time, Time::microseconds(1000 + i * 10));
+                TS_ASSERT_EQUALS(mEvents[i]->path, Trace::CREATED);
+            }
+        }
+    }
+
+    void testChunkIndex() {
+        BatchedBuffer buf;
+        uint32 total = 1000;
+        for(uint64 i = 0; i < total; i++)
+            writeTimestamp(&buf, MessageTimestampTag, i);
+        store(&buf);
+
+        // Everything fits in one chunk. Each index entry must point at the
+        // start of every index_stride'th record.
+        FILE* is = fopen(filename().c_str(), "rb");
+        Trace::ChunkHeader header;
+        TS_ASSERT_EQUALS(fread(&header, sizeof(header), 1, is), 1u);
+        TS_ASSERT_EQUALS(header.magic, (uint32)TRACE_CHUNK_MAGIC);
+        TS_ASSERT_EQUALS(header.num_records, total);
+        TS_ASSERT_EQUALS(header.index_stride, (uint32)TRACE_CHUNK_INDEX_STRIDE);
+        TS_ASSERT_EQUALS(header.num_index, (total + TRACE_CHUNK_INDEX_STRIDE - 1) / TRACE_CHUNK_INDEX_STRIDE);
+
+        std::vector<Trace::ChunkTypeCount> types(header.num_types);
+        std::vector<uint32> index(header.num_index);
+        std::vector<uint8> payload(header.payload_size);
+        TS_ASSERT_EQUALS(fread(&types[0], sizeof(Trace::ChunkTypeCount), types.size(), is), types.size());
+        TS_ASSERT_EQUALS(fread(&index[0], sizeof(uint32), index.size(), is), index.size());
+        TS_ASSERT_EQUALS(fread(&payload[0], 1, payload.size(), is), payload.size());
+        fclose(is);
+
+        TS_ASSERT_EQUALS(header.num_types, 1);
+        TS_ASSERT_EQUALS(types[0].type_hint, MessageTimestampTag);
+        TS_ASSERT_EQUALS(types[0].count, total);
+
+        for(uint32 i = 0; i < index.size(); i++) {
+            TS_ASSERT(index[i] + TRACE_RECORD_HEADER_SIZE + sizeof(Time) + sizeof(uint64) <= payload.size());
+            uint16 type_hint;
+            uint64 uid;
+            memcpy(&type_hint, &payload[index[i] + sizeof(uint32)], sizeof(type_hint));
+            memcpy(&uid, &payload[index[i] + TRACE_RECORD_HEADER_SIZE + sizeof(Time)], sizeof(uid));
+            TS_ASSERT_EQUALS(type_hint, MessageTimestampTag);
+            TS_ASSERT_EQUALS(uid, (uint64)i * TRACE_CHUNK_INDEX_STRIDE);
+        }
+    }
+
+    void testFilters() {
+        // Alternate between two record types, in a few chunks
+        BatchedBuffer buf;
+        uint32 total = 4000;
+        for(uint64 i = 0; i < total; i++) {
+            writeTimestamp(&buf, (i % 2 == 0) ? MessageTimestampTag : MessageCreationTimestampTag, i);
+            if (i % 1000 == 999)
+                store(&buf);
+        }
+        TS_ASSERT_EQUALS(TraceReader(filename(), 1).numChunks(), 4u);
+
+        TraceFilter creation;
+        creation.type(MessageCreationTimestampTag);
+        read(creation, 4);
+        TS_ASSERT_EQUALS(mEvents.size(), total / 2);
+        for(uint32 i = 0; i < mEvents.size(); i++) {
+            TS_ASSERT(dynamic_cast<MessageCreationTimestampEvent*>(mEvents[i]) != NULL);
+            TS_ASSERT_EQUALS(mEvents[i]->uid, (uint64)(2 * i + 1));
+        }
+
+        // A window in the middle only returns the records in it
+        TraceFilter window;
+        window.window(Time::microseconds(1000 + 1500 * 10), Time::microseconds(1000 + 2499 * 10));
+        read(window, 4);
+        TS_ASSERT_EQUALS(mEvents.size(), 1000u);
+        for(uint32 i = 0; i < mEvents.size(); i++)
+            TS_ASSERT_EQUALS(mEvents[i]->uid, (uint64)(1500 + i));
+    }
+
+    void testConcurrentWriters() {
+        BatchedBuffer buf;
+        std::vector<Thread*> threads;
+        for(uint32 i = 0; i < 4; i++)
+            threads.push_back(new Thread("TraceReaderTest", std::tr1::bind(&TraceReaderTest::writer, this, &buf, i)));
+        for(uint32 i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+        store(&buf);
+
+        // Every record comes back, and records from each writer stay in the
+        // order they were written
+        read(TraceFilter(), 4);
+        TS_ASSERT_EQUALS(mEvents.size(), 4u * RECORDS_PER_WRITER);
+        std::vector<uint64> next(4);
+        for(uint32 i = 0; i < 4; i++)
+            next[i] = i * RECORDS_PER_WRITER;
+        for(uint32 i = 0; i < mEvents.size(); i++) {
+            uint32 writer_idx = (uint32)(mEvents[i]->uid / RECORDS_PER_WRITER);
+            TS_ASSERT_LESS_THAN(writer_idx, 4u);
+            if (writer_idx >= 4) continue;
+            TS_ASSERT_EQUALS(mEvents[i]->uid, next[writer_idx]);
+            next[writer_idx] = mEvents[i]->uid + 1;
+        }
+    }
+};
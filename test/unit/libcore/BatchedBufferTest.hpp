@@ -0,0 +1,282 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/trace/BatchedBuffer.hpp>
+#include <sirikata/core/util/Thread.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
+
+using namespace Sirikata;
+
+#define NUM_WRITERS 8
+#define RECORDS_PER_WRITER 20000
+
+class BatchedBufferTest : public CxxTest::TestSuite {
+    // A record read back from the stored chunks
+    struct Record {
+        uint16 type_hint;
+        uint32 writer;
+        uint32 seq;
+        uint32 size;
+        uint32 chunk;
+    };
+    typedef std::vector<Record> RecordList;
+
+    AtomicValue<uint32> mWritersDone;
+
+    // Write a framed record, padded out to size bytes of data. The writer
+    // is used as the type hint and seq as the time.
+    static void writeRecord(BatchedBuffer* buf, uint32 writer, uint32 seq, uint32 size) {
+        std::vector<uint8> data(size, (uint8)seq);
+        memcpy(&data[0], &writer, sizeof(writer));
+        memcpy(&data[sizeof(writer)], &seq, sizeof(seq));
+        uint16 type_hint = (uint16)writer;
+
+        BatchedBuffer::IOVec iov[3] = {
+            BatchedBuffer::IOVec(&size, sizeof(size)),
+            BatchedBuffer::IOVec(&type_hint, sizeof(type_hint)),
+            BatchedBuffer::IOVec(&data[0], size)
+        };
+        buf->write(type_hint, Time::microseconds(seq), iov, 3);
+    }
+
+    // Same record, encoded in place with reserve/commit
+    static void reserveRecord(BatchedBuffer* buf, uint32 writer, uint32 seq, uint32 size) {
+        uint16 type_hint = (uint16)writer;
+        uint32 total = TRACE_RECORD_HEADER_SIZE + size;
+        uint8* dest = buf->reserve(total);
+        TS_ASSERT(dest != NULL);
+        memcpy(dest, &size, sizeof(size));
+        memcpy(dest + sizeof(size), &type_hint, sizeof(type_hint));
+        memset(dest + TRACE_RECORD_HEADER_SIZE, (uint8)seq, size);
+        memcpy(dest + TRACE_RECORD_HEADER_SIZE, &writer, sizeof(writer));
+        memcpy(dest + TRACE_RECORD_HEADER_SIZE + sizeof(writer), &seq, sizeof(seq));
+        buf->commit(total, type_hint, Time::microseconds(seq));
+    }
+
+    // Parse everything stored to os, checking each chunk header against the
+    // records in it
+    static RecordList parse(FILE* os) {
+        RecordList records;
+        fflush(os);
+        rewind(os);
+
+        Trace::ChunkHeader header;
+        for(uint32 chunk = 0; fread(&header, sizeof(header), 1, os) == 1; chunk++) {
+            TS_ASSERT_EQUALS(header.magic, (uint32)TRACE_CHUNK_MAGIC);
+            TS_ASSERT_EQUALS(header.version, TRACE_CHUNK_VERSION);
+            if (header.magic != TRACE_CHUNK_MAGIC) break;
+
+            std::vector<Trace::ChunkTypeCount> types(header.num_types);
+            std::vector<uint32> index(header.num_index);
+            std::vector<uint8> payload(header.payload_size);
+            if (!types.empty())
+                TS_ASSERT_EQUALS(fread(&types[0], sizeof(Trace::ChunkTypeCount), types.size(), os), types.size());
+            if (!index.empty())
+                TS_ASSERT_EQUALS(fread(&index[0], sizeof(uint32), index.size(), os), index.size());
+            TS_ASSERT_EQUALS(fread(&payload[0], 1, payload.size(), os), payload.size());
+
+            // Records never straddle chunks, so the payload is exactly a
+            // whole number of them
+            std::map<uint16, uint32> type_counts;
+            uint32 num_records = 0;
+            uint64 min_time = (uint64)-1, max_time = 0;
+            uint32 offset = 0;
+            while(offset < payload.size()) {
+                TS_ASSERT_LESS_THAN_EQUALS(offset + TRACE_RECORD_HEADER_SIZE + 2 * sizeof(uint32), payload.size());
+                if (offset + TRACE_RECORD_HEADER_SIZE + 2 * sizeof(uint32) > payload.size()) break;
+                if (num_records % TRACE_CHUNK_INDEX_STRIDE == 0) {
+                    TS_ASSERT_LESS_THAN(num_records / TRACE_CHUNK_INDEX_STRIDE, index.size());
+                    if (num_records / TRACE_CHUNK_INDEX_STRIDE < index.size())
+                        TS_ASSERT_EQUALS(index[num_records / TRACE_CHUNK_INDEX_STRIDE], offset);
+                }
+
+                Record rec;
+                rec.chunk = chunk;
+                memcpy(&rec.size, &payload[offset], sizeof(rec.size));
+                memcpy(&rec.type_hint, &payload[offset + sizeof(uint32)], sizeof(rec.type_hint));
+                memcpy(&rec.writer, &payload[offset + TRACE_RECORD_HEADER_SIZE], sizeof(rec.writer));
+                memcpy(&rec.seq, &payload[offset + TRACE_RECORD_HEADER_SIZE + sizeof(uint32)], sizeof(rec.seq));
+                TS_ASSERT_LESS_THAN_EQUALS(offset + TRACE_RECORD_HEADER_SIZE + rec.size, payload.size());
+                if (offset + TRACE_RECORD_HEADER_SIZE + rec.size > payload.size()) break;
+                // The padding survives too
+                for(uint32 i = 2 * sizeof(uint32); i < rec.size; i++) {
+                    if (payload[offset + TRACE_RECORD_HEADER_SIZE + i] != (uint8)rec.seq) {
+                        TS_FAIL("Corrupted record data");
+                        break;
+                    }
+                }
+
+                records.push_back(rec);
+                type_counts[std::min(rec.type_hint, (uint16)(TRACE_CHUNK_MAX_TYPE_HINT-1))]++;
+                min_time = std::min(min_time, (uint64)rec.seq);
+                max_time = std::max(max_time, (uint64)rec.seq);
+                num_records++;
+                offset += TRACE_RECORD_HEADER_SIZE + rec.size;
+            }
+
+            TS_ASSERT_EQUALS(header.num_records, num_records);
+            TS_ASSERT_EQUALS(header.min_time, min_time);
+            TS_ASSERT_EQUALS(header.max_time, max_time);
+            TS_ASSERT_EQUALS(header.num_types, type_counts.size());
+            for(uint32 i = 0; i < types.size(); i++)
+                TS_ASSERT_EQUALS(types[i].count, type_counts[types[i].type_hint]);
+        }
+        // Later stores append
+        fseek(os, 0, SEEK_END);
+        return records;
+    }
+
+    void writer(BatchedBuffer* buf, uint32 writer_idx) {
+        for(uint32 seq = 0; seq < RECORDS_PER_WRITER; seq++) {
+            // A mix of sizes, so batches fill up at different points
+            uint32 size = 8 + (seq * 7 + writer_idx) % 120;
+            if (seq % 2 == 0)
+                writeRecord(buf, writer_idx, seq, size);
+            else
+                reserveRecord(buf, writer_idx, seq, size);
+        }
+        mWritersDone++;
+    }
+
+public:
+    void testOrder() {
+        BatchedBuffer buf;
+        TS_ASSERT(buf.empty());
+        for(uint32 seq = 0; seq < 1000; seq++)
+            writeRecord(&buf, 1, seq, 16);
+        TS_ASSERT(!buf.empty());
+
+        FILE* os = tmpfile();
+        buf.flush();
+        buf.store(os);
+        TS_ASSERT(buf.empty());
+
+        RecordList records = parse(os);
+        fclose(os);
+        TS_ASSERT_EQUALS(records.size(), 1000u);
+        for(uint32 i = 0; i < records.size(); i++) {
+            TS_ASSERT_EQUALS(records[i].seq, i);
+            TS_ASSERT_EQUALS(records[i].chunk, 0u);
+        }
+    }
+
+    void testFlush() {
+        // A partially filled batch stays with its writer until a flush
+        BatchedBuffer buf;
+        writeRecord(&buf, 1, 0, 16);
+
+        FILE* os = tmpfile();
+        buf.store(os);
+        TS_ASSERT_EQUALS(parse(os).size(), 0u);
+
+        buf.flush();
+        buf.store(os);
+        RecordList records = parse(os);
+        TS_ASSERT_EQUALS(records.size(), 1u);
+
+        // Flushing again, with nothing new written, doesn't add a chunk
+        buf.flush();
+        buf.store(os);
+        TS_ASSERT_EQUALS(parse(os).size(), 1u);
+        fclose(os);
+    }
+
+    void testBatchBoundaries() {
+        // Records of this size don't divide the batch size evenly, so each
+        // batch ends with some unused space rather than a split record
+        BatchedBuffer buf;
+        uint32 size = 1000;
+        uint32 per_batch = Batch<uint8>::max_size / (TRACE_RECORD_HEADER_SIZE + size);
+        uint32 total = per_batch * 3 + 5;
+        for(uint32 seq = 0; seq < total; seq++)
+            writeRecord(&buf, 1, seq, size);
+
+        // Only full batches have been handed off so far
+        FILE* os = tmpfile();
+        buf.store(os);
+        RecordList records = parse(os);
+        TS_ASSERT_EQUALS(records.size(), per_batch * 3);
+
+        buf.flush();
+        buf.store(os);
+        records = parse(os);
+        fclose(os);
+        TS_ASSERT_EQUALS(records.size(), total);
+        for(uint32 i = 0; i < records.size(); i++) {
+            TS_ASSERT_EQUALS(records[i].seq, i);
+            TS_ASSERT_EQUALS(records[i].chunk, i / per_batch);
+        }
+    }
+
+    void testLargeRecord() {
+        // Records larger than a batch can't be reserved, but still get
+        // written, whole, as their own chunk
+        BatchedBuffer buf;
+        uint32 large_size = 3 * Batch<uint8>::max_size;
+        TS_ASSERT(buf.reserve(TRACE_RECORD_HEADER_SIZE + large_size) == NULL);
+
+        writeRecord(&buf, 1, 0, 16);
+        writeRecord(&buf, 1, 1, large_size);
+        writeRecord(&buf, 1, 2, 16);
+
+        FILE* os = tmpfile();
+        buf.flush();
+        buf.store(os);
+        RecordList records = parse(os);
+        fclose(os);
+
+        TS_ASSERT_EQUALS(records.size(), 3u);
+        if (records.size() != 3) return;
+        // The large record goes straight out, before the batch holding the
+        // small ones is flushed
+        TS_ASSERT_EQUALS(records[0].seq, 1u);
+        TS_ASSERT_EQUALS(records[0].size, large_size);
+        TS_ASSERT_EQUALS(records[1].seq, 0u);
+        TS_ASSERT_EQUALS(records[2].seq, 2u);
+        TS_ASSERT_EQUALS(records[1].chunk, records[2].chunk);
+        TS_ASSERT_DIFFERS(records[0].chunk, records[1].chunk);
+    }
+
+    void testConcurrentProducers() {
+        BatchedBuffer buf;
+        FILE* os = tmpfile();
+        mWritersDone = 0;
+
+        std::vector<Thread*> threads;
+        for(uint32 i = 0; i < NUM_WRITERS; i++)
+            threads.push_back(new Thread("BatchedBufferTest", std::tr1::bind(&BatchedBufferTest::writer, this, &buf, i)));
+
+        // Store, and steal partial batches, while the writers are running,
+        // like the trace storage thread does
+        while(mWritersDone.read() < NUM_WRITERS) {
+            buf.flush();
+            buf.store(os);
+        }
+        for(uint32 i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+        buf.flush();
+        buf.store(os);
+        TS_ASSERT(buf.empty());
+
+        // Every record shows up exactly once, and each writer's records are
+        // in the order it wrote them
+        RecordList records = parse(os);
+        fclose(os);
+        TS_ASSERT_EQUALS(records.size(), (uint32)(NUM_WRITERS * RECORDS_PER_WRITER));
+        std::vector<uint32> next(NUM_WRITERS, 0);
+        for(uint32 i = 0; i < records.size(); i++) {
+            TS_ASSERT_LESS_THAN(records[i].writer, (uint32)NUM_WRITERS);
+            if (records[i].writer >= NUM_WRITERS) continue;
+            TS_ASSERT_EQUALS(records[i].type_hint, records[i].writer);
+            TS_ASSERT_EQUALS(records[i].seq, next[records[i].writer]);
+            next[records[i].writer] = records[i].seq + 1;
+        }
+        for(uint32 i = 0; i < NUM_WRITERS; i++)
+            TS_ASSERT_EQUALS(next[i], (uint32)RECORDS_PER_WRITER);
+    }
+};
@@ -0,0 +1,114 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/util/Thread.hpp>
+#include <sirikata/core/queue/BoundedLockFreeQueue.hpp>
+
+using namespace Sirikata;
+
+class BoundedLockFreeQueueTest : public CxxTest::TestSuite {
+    typedef BoundedLockFreeQueue<uint32> IntQueue;
+
+    static void produce(IntQueue* queue, uint32 first, uint32 count) {
+        for(uint32 i = 0; i < count; i++)
+            queue->push(first + i);
+    }
+
+    static void consume(IntQueue* queue, uint32 count, uint64* sum) {
+        uint32 val;
+        for(uint32 i = 0; i < count; i++) {
+            queue->blockingPop(val);
+            *sum += val;
+        }
+    }
+
+public:
+    void testOrder() {
+        IntQueue queue(8);
+        for(uint32 i = 0; i < 5; i++)
+            TS_ASSERT(queue.tryPush(i));
+        TS_ASSERT_EQUALS(queue.size(), (size_t)5);
+
+        uint32 result;
+        for(uint32 i = 0; i < 5; i++) {
+            TS_ASSERT(queue.pop(result));
+            TS_ASSERT_EQUALS(result, i);
+        }
+        TS_ASSERT(!queue.pop(result));
+        TS_ASSERT(queue.probablyEmpty());
+    }
+
+    void testFull() {
+        // Capacity rounds up to a power of two
+        IntQueue queue(3);
+        TS_ASSERT_EQUALS(queue.capacity(), (size_t)4);
+
+        for(uint32 i = 0; i < 4; i++)
+            TS_ASSERT(queue.tryPush(i));
+        TS_ASSERT(!queue.tryPush(4));
+
+        uint32 result;
+        TS_ASSERT(queue.pop(result));
+        TS_ASSERT_EQUALS(result, (uint32)0);
+        TS_ASSERT(queue.tryPush(4));
+    }
+
+    void testWraparound() {
+        IntQueue queue(4);
+        uint32 result;
+        for(uint32 i = 0; i < 1000; i++) {
+            TS_ASSERT(queue.tryPush(i));
+            TS_ASSERT(queue.tryPush(i+1));
+            TS_ASSERT(queue.pop(result));
+            TS_ASSERT_EQUALS(result, i);
+            TS_ASSERT(queue.pop(result));
+            TS_ASSERT_EQUALS(result, i+1);
+        }
+    }
+
+    void testNodeIterator() {
+        IntQueue queue(16);
+        for(uint32 i = 0; i < 10; i++)
+            queue.push(i);
+
+        uint32 expected = 0;
+        IntQueue::NodeIterator it(queue);
+        while(uint32* val = it.next()) {
+            TS_ASSERT_EQUALS(*val, expected);
+            expected++;
+        }
+        TS_ASSERT_EQUALS(expected, (uint32)10);
+        TS_ASSERT(queue.probablyEmpty());
+    }
+
+    void testMultipleProducersConsumers() {
+        // Small queue forces producers to wait on consumers regularly
+        IntQueue queue(64);
+        const uint32 nthreads = 4;
+        const uint32 per_thread = 100000;
+
+        uint64 sums[nthreads];
+        std::vector<Thread*> threads;
+        for(uint32 i = 0; i < nthreads; i++) {
+            sums[i] = 0;
+            threads.push_back(new Thread("BoundedLockFreeQueueTest Producer",
+                    std::tr1::bind(&BoundedLockFreeQueueTest::produce, &queue, i*per_thread, per_thread)));
+            threads.push_back(new Thread("BoundedLockFreeQueueTest Consumer",
+                    std::tr1::bind(&BoundedLockFreeQueueTest::consume, &queue, per_thread, &sums[i])));
+        }
+        for(uint32 i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+
+        uint64 total = 0;
+        for(uint32 i = 0; i < nthreads; i++)
+            total += sums[i];
+        uint64 n = nthreads * per_thread;
+        TS_ASSERT_EQUALS(total, n*(n-1)/2);
+        TS_ASSERT(queue.probablyEmpty());
+    }
+};
@@ -0,0 +1,110 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+#include <sirikata/core/util/FlatHashMap.hpp>
+
+using namespace Sirikata;
+
+class FlatHashMapTest : public CxxTest::TestSuite
+{
+    typedef FlatHashMap<uint32, uint32> IntMap;
+
+    // Deliberately terrible hash so every key lands in one run of slots,
+    // exercising wraparound and backward shift deletion
+    struct CollidingHasher {
+        size_t operator()(uint32 v) const { return 1; }
+    };
+    typedef FlatHashMap<uint32, uint32, CollidingHasher> CollidingMap;
+
+public:
+    void testInsertFind() {
+        IntMap map;
+        TS_ASSERT(map.empty());
+        TS_ASSERT(map.find(1) == map.end());
+
+        TS_ASSERT(map.insert(IntMap::value_type(1, 10)).second);
+        TS_ASSERT(!map.insert(IntMap::value_type(1, 11)).second);
+        map[2] = 20;
+
+        TS_ASSERT_EQUALS(map.size(), 2u);
+        TS_ASSERT(map.find(1) != map.end());
+        TS_ASSERT_EQUALS(map.find(1)->second, 10u);
+        TS_ASSERT_EQUALS(map[2], 20u);
+        TS_ASSERT_EQUALS(map.count(3), 0u);
+    }
+
+    void testGrowAndIterate() {
+        IntMap map;
+        for(uint32 i = 0; i < 1000; i++)
+            map[i] = i * 2;
+        TS_ASSERT_EQUALS(map.size(), 1000u);
+
+        std::vector<bool> seen(1000, false);
+        uint32 count = 0;
+        for(IntMap::iterator it = map.begin(); it != map.end(); it++) {
+            TS_ASSERT_LESS_THAN(it->first, 1000u);
+            TS_ASSERT_EQUALS(it->second, it->first * 2);
+            TS_ASSERT(!seen[it->first]);
+            seen[it->first] = true;
+            count++;
+        }
+        TS_ASSERT_EQUALS(count, 1000u);
+    }
+
+    void testErase() {
+        IntMap map;
+        for(uint32 i = 0; i < 100; i++)
+            map[i] = i;
+        for(uint32 i = 0; i < 100; i += 2)
+            TS_ASSERT_EQUALS(map.erase(i), 1u);
+        TS_ASSERT_EQUALS(map.erase(0), 0u);
+
+        TS_ASSERT_EQUALS(map.size(), 50u);
+        for(uint32 i = 0; i < 100; i++)
+            TS_ASSERT_EQUALS(map.count(i), (i % 2 == 0) ? 0u : 1u);
+
+        map.clear();
+        TS_ASSERT(map.empty());
+        TS_ASSERT(map.begin() == map.end());
+    }
+
+    void testCollidingErase() {
+        // Every key collides, so removing any of them has to move the rest
+        // of the run back for them to stay reachable
+        CollidingMap map;
+        for(uint32 i = 0; i < 6; i++)
+            map[i] = i + 100;
+        map.erase(map.find(0));
+        map.erase(3);
+        TS_ASSERT_EQUALS(map.size(), 4u);
+        uint32 expected[] = { 1, 2, 4, 5 };
+        for(uint32 i = 0; i < 4; i++) {
+            TS_ASSERT(map.find(expected[i]) != map.end());
+            TS_ASSERT_EQUALS(map.find(expected[i])->second, expected[i] + 100);
+        }
+        TS_ASSERT(map.find(0) == map.end());
+        TS_ASSERT(map.find(3) == map.end());
+
+        // Refill past the first growth with keys reusing erased slots
+        for(uint32 i = 6; i < 20; i++)
+            map[i] = i + 100;
+        for(uint32 i = 0; i < 20; i++) {
+            if (i == 0 || i == 3)
+                TS_ASSERT_EQUALS(map.count(i), 0u);
+            else
+                TS_ASSERT_EQUALS(map[i], i + 100);
+        }
+    }
+
+    void testStringKeys() {
+        FlatHashMap<String, uint32> map;
+        map["meerkat:///a/mesh.dae"] = 1;
+        map["meerkat:///b/mesh.dae"] = 2;
+        TS_ASSERT_EQUALS(map["meerkat:///a/mesh.dae"], 1u);
+        TS_ASSERT_EQUALS(map.erase("meerkat:///a/mesh.dae"), 1u);
+        TS_ASSERT(map.find("meerkat:///a/mesh.dae") == map.end());
+        TS_ASSERT_EQUALS(map["meerkat:///b/mesh.dae"], 2u);
+    }
+};
@@ -0,0 +1,59 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/network/Frame.hpp>
+
+using namespace Sirikata;
+using namespace Sirikata::Network;
+
+class FrameTest : public CxxTest::TestSuite {
+public:
+    void testAppendParse() {
+        std::vector<uint8> buf;
+        memcpy(Frame::append(&buf, 3), "abc", 3);
+        // Empty frames are allowed
+        Frame::append(&buf, 0);
+        memcpy(Frame::append(&buf, 5), "defgh", 5);
+        TS_ASSERT_EQUALS(buf.size(), (size_t)(3*sizeof(uint32) + 8));
+
+        uint32 offset = 0;
+        const uint8* payload = NULL;
+        uint32 payload_len = 0;
+
+        TS_ASSERT(Frame::parse(&buf[0], buf.size(), &offset, &payload, &payload_len));
+        TS_ASSERT_EQUALS(payload_len, (uint32)3);
+        TS_ASSERT(memcmp(payload, "abc", 3) == 0);
+
+        TS_ASSERT(Frame::parse(&buf[0], buf.size(), &offset, &payload, &payload_len));
+        TS_ASSERT_EQUALS(payload_len, (uint32)0);
+
+        TS_ASSERT(Frame::parse(&buf[0], buf.size(), &offset, &payload, &payload_len));
+        TS_ASSERT_EQUALS(payload_len, (uint32)5);
+        TS_ASSERT(memcmp(payload, "defgh", 5) == 0);
+
+        TS_ASSERT_EQUALS(offset, (uint32)buf.size());
+        TS_ASSERT(!Frame::parse(&buf[0], buf.size(), &offset, &payload, &payload_len));
+    }
+
+    void testMatchesStringFraming() {
+        std::vector<uint8> buf;
+        memcpy(Frame::append(&buf, 7), "payload", 7);
+        TS_ASSERT_EQUALS(Frame::write("payload"), std::string((const char*)&buf[0], buf.size()));
+    }
+
+    void testTruncated() {
+        std::vector<uint8> buf;
+        memcpy(Frame::append(&buf, 5), "hello", 5);
+
+        uint32 offset = 0;
+        const uint8* payload = NULL;
+        uint32 payload_len = 0;
+        // Partial header and partial payload both leave offset alone
+        TS_ASSERT(!Frame::parse(&buf[0], 2, &offset, &payload, &payload_len));
+        TS_ASSERT(!Frame::parse(&buf[0], buf.size()-1, &offset, &payload, &payload_len));
+        TS_ASSERT_EQUALS(offset, (uint32)0);
+    }
+};
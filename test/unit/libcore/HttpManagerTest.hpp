@@ -0,0 +1,289 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/transfer/HttpManager.hpp>
+#include <sirikata/core/network/Address.hpp>
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+
+using namespace Sirikata;
+using boost::asio::ip::tcp;
+
+class HttpManagerTest : public CxxTest::TestSuite {
+    typedef Transfer::HttpManager HttpManager;
+
+    static const uint32 RESOURCE_SIZE = 20000;
+    static unsigned char byteAt(uint32 i) {
+        return (unsigned char)((i * 7 + 3) & 0xFF);
+    }
+
+    /** A minimal HTTP server on localhost with a few resources, each
+     *  RESOURCE_SIZE bytes:
+     *   /data     - honors Range headers
+     *   /norange  - ignores Range headers and always sends the whole thing
+     *   /http10   - answers with HTTP/1.0 and no keep-alive, but leaves the
+     *               connection open to see if the client (wrongly) reuses it
+     */
+    class TestServer {
+    public:
+        TestServer()
+         : mAcceptor(mIOService, tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0)),
+           mReusedAfterHttp10(0)
+        {
+            boost::thread acceptThread(std::tr1::bind(&TestServer::acceptLoop, this));
+            acceptThread.detach();
+        }
+
+        String port() {
+            return boost::lexical_cast<String>(mAcceptor.local_endpoint().port());
+        }
+
+        uint32 requests(const String& path) {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            return mRequests[path];
+        }
+
+        // Requests received on a connection after it answered /http10
+        uint32 reusedAfterHttp10() {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            return mReusedAfterHttp10;
+        }
+
+    private:
+        void acceptLoop() {
+            while(true) {
+                tcp::socket* sock = new tcp::socket(mIOService);
+                boost::system::error_code ec;
+                mAcceptor.accept(*sock, ec);
+                if (ec) {
+                    delete sock;
+                    return;
+                }
+                boost::thread serveThread(std::tr1::bind(&TestServer::serve, this, sock));
+                serveThread.detach();
+            }
+        }
+
+        void serve(tcp::socket* sock) {
+            String buffered;
+            char data[4096];
+            bool sentHttp10 = false;
+            boost::system::error_code ec;
+            while(true) {
+                size_t nread = sock->read_some(boost::asio::buffer(data, sizeof(data)), ec);
+                if (ec) break;
+                buffered.append(data, nread);
+
+                String out;
+                size_t end;
+                while((end = buffered.find("\r\n\r\n")) != String::npos) {
+                    String req = buffered.substr(0, end + 4);
+                    buffered.erase(0, end + 4);
+
+                    size_t path_start = req.find(' ') + 1;
+                    String path = req.substr(path_start, req.find(' ', path_start) - path_start);
+                    {
+                        boost::unique_lock<boost::mutex> lock(mMutex);
+                        mRequests[path]++;
+                        if (sentHttp10) mReusedAfterHttp10++;
+                    }
+
+                    uint32 first = 0, last = RESOURCE_SIZE - 1;
+                    size_t range_pos = req.find("Range: bytes=");
+                    bool ranged = (range_pos != String::npos && path == "/data");
+                    if (ranged)
+                        sscanf(req.c_str() + range_pos + 13, "%u-%u", &first, &last);
+
+                    std::ostringstream resp;
+                    if (path == "/http10") {
+                        resp << "HTTP/1.0 200 OK\r\n";
+                        sentHttp10 = true;
+                    }
+                    else if (ranged) {
+                        resp << "HTTP/1.1 206 Partial Content\r\n"
+                             << "Content-Range: bytes " << first << "-" << last << "/" << RESOURCE_SIZE << "\r\n";
+                    }
+                    else {
+                        resp << "HTTP/1.1 200 OK\r\n";
+                    }
+                    resp << "Content-Length: " << (last - first + 1) << "\r\n\r\n";
+                    for(uint32 i = first; i <= last; i++)
+                        resp << byteAt(i);
+                    out += resp.str();
+                }
+                if (!out.empty())
+                    boost::asio::write(*sock, boost::asio::buffer(out), ec);
+                if (ec) break;
+            }
+            sock->close(ec);
+            delete sock;
+        }
+
+        boost::asio::io_service mIOService;
+        tcp::acceptor mAcceptor;
+        boost::mutex mMutex;
+        std::map<String, uint32> mRequests;
+        uint32 mReusedAfterHttp10;
+    };
+
+    // Collects the responses to a set of requests
+    class Responses {
+    public:
+        Responses(uint32 count)
+         : mResponses(count), mErrors(count, HttpManager::SUCCESS), mRemaining(count)
+        {}
+
+        HttpManager::HttpCallback callback(uint32 idx) {
+            return std::tr1::bind(&Responses::finished, this, idx,
+                std::tr1::placeholders::_1, std::tr1::placeholders::_2, std::tr1::placeholders::_3);
+        }
+
+        bool wait() {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            boost::system_time timeout = boost::get_system_time() + boost::posix_time::seconds(10);
+            while(mRemaining > 0) {
+                if (!mDone.timed_wait(lock, timeout))
+                    return false;
+            }
+            return true;
+        }
+
+        HttpManager::HttpResponsePtr response(uint32 idx) { return mResponses[idx]; }
+        HttpManager::ERR_TYPE error(uint32 idx) { return mErrors[idx]; }
+
+    private:
+        void finished(uint32 idx, HttpManager::HttpResponsePtr response, HttpManager::ERR_TYPE error, const boost::system::error_code& boost_error) {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            mResponses[idx] = response;
+            mErrors[idx] = error;
+            mRemaining--;
+            mDone.notify_all();
+        }
+
+        boost::mutex mMutex;
+        boost::condition_variable mDone;
+        std::vector<HttpManager::HttpResponsePtr> mResponses;
+        std::vector<HttpManager::ERR_TYPE> mErrors;
+        uint32 mRemaining;
+    };
+
+    static String header(HttpManager::HttpResponsePtr response, const String& name) {
+        HttpManager::Headers::const_iterator it = response->getHeaders().find(name);
+        return (it == response->getHeaders().end() ? String() : it->second);
+    }
+
+    // Checks that response holds exactly the bytes [first, first+length) of
+    // the resource
+    static bool hasBytes(HttpManager::HttpResponsePtr response, uint32 first, uint32 length) {
+        if (!response || !response->getData() || response->getData()->length() != length)
+            return false;
+        for(uint32 i = 0; i < length; i++) {
+            if (response->getData()->data()[i] != byteAt(first + i))
+                return false;
+        }
+        return true;
+    }
+
+    // Shared by all the tests and never destroyed since its threads keep
+    // running until the process exits
+    static TestServer& server() {
+        static TestServer* sServer = new TestServer();
+        return *sServer;
+    }
+
+    TestServer* mServer;
+    std::tr1::shared_ptr<Network::Address> mAddr;
+    HttpManager::Headers mHeaders;
+
+public:
+    void setUp() {
+        mServer = &server();
+        mAddr.reset(new Network::Address("127.0.0.1", mServer->port()));
+        mHeaders["Host"] = "127.0.0.1";
+    }
+
+    void testCoalescesAdjacentRanges() {
+        HttpManager& http = HttpManager::getSingleton();
+        uint32 requests_before = mServer->requests("/data");
+        uint32 coalesced_before = http.stats().coalesced.read();
+        uint32 into_before = http.stats().coalescedInto.read();
+
+        // Three adjacent ranges and one overlapping them are merged into a
+        // single request. The last one is too far away to be merged.
+        const uint32 NUM_RANGES = 5;
+        uint32 firsts[NUM_RANGES] = { 200, 0, 100, 150, 5000 };
+        uint32 lengths[NUM_RANGES] = { 100, 100, 100, 100, 100 };
+        Responses responses(NUM_RANGES);
+        for(uint32 i = 0; i < NUM_RANGES; i++) {
+            http.getRange(
+                *mAddr, "/data", Transfer::Range(firsts[i], lengths[i], Transfer::LENGTH, false),
+                responses.callback(i), mHeaders, Duration::milliseconds(50)
+            );
+        }
+        TS_ASSERT(responses.wait());
+
+        TS_ASSERT_EQUALS(mServer->requests("/data") - requests_before, 2u);
+        TS_ASSERT_EQUALS(http.stats().coalesced.read() - coalesced_before, 4u);
+        TS_ASSERT_EQUALS(http.stats().coalescedInto.read() - into_before, 1u);
+
+        // Each requester gets a response for just its own range
+        for(uint32 i = 0; i < NUM_RANGES; i++) {
+            TS_ASSERT_EQUALS(responses.error(i), HttpManager::SUCCESS);
+            HttpManager::HttpResponsePtr response = responses.response(i);
+            TS_ASSERT(response);
+            if (!response) continue;
+            TS_ASSERT_EQUALS(response->getStatusCode(), 206);
+            TS_ASSERT(hasBytes(response, firsts[i], lengths[i]));
+            TS_ASSERT_EQUALS(header(response, "Content-Length"), boost::lexical_cast<String>(lengths[i]));
+            TS_ASSERT_EQUALS(header(response, "Content-Range"),
+                "bytes " + boost::lexical_cast<String>(firsts[i]) + "-" +
+                boost::lexical_cast<String>(firsts[i] + lengths[i] - 1) + "/" +
+                boost::lexical_cast<String>((uint32)RESOURCE_SIZE));
+        }
+    }
+
+    void testMismatchedMergedResponseRetried() {
+        // The server answers the merged request with the whole resource, so
+        // it can't be split up. Each request is made again on its own and
+        // gets whatever it would have gotten without merging.
+        HttpManager& http = HttpManager::getSingleton();
+        uint32 requests_before = mServer->requests("/norange");
+
+        const uint32 NUM_RANGES = 3;
+        Responses responses(NUM_RANGES);
+        for(uint32 i = 0; i < NUM_RANGES; i++) {
+            http.getRange(
+                *mAddr, "/norange", Transfer::Range(i * 100, 100, Transfer::LENGTH, false),
+                responses.callback(i), mHeaders, Duration::milliseconds(50)
+            );
+        }
+        TS_ASSERT(responses.wait());
+
+        TS_ASSERT_EQUALS(mServer->requests("/norange") - requests_before, 1u + NUM_RANGES);
+        for(uint32 i = 0; i < NUM_RANGES; i++) {
+            TS_ASSERT_EQUALS(responses.error(i), HttpManager::SUCCESS);
+            HttpManager::HttpResponsePtr response = responses.response(i);
+            TS_ASSERT(response);
+            if (!response) continue;
+            TS_ASSERT_EQUALS(response->getStatusCode(), 200);
+            TS_ASSERT(hasBytes(response, 0, RESOURCE_SIZE));
+        }
+    }
+
+    void testHttp10ConnectionNotReused() {
+        // Without keep-alive an HTTP/1.0 server may close the connection at
+        // any time, so it must not be used for another request
+        HttpManager& http = HttpManager::getSingleton();
+        for(uint32 i = 0; i < 3; i++) {
+            Responses responses(1);
+            http.get(*mAddr, "/http10", responses.callback(0), mHeaders);
+            TS_ASSERT(responses.wait());
+            TS_ASSERT_EQUALS(responses.error(0), HttpManager::SUCCESS);
+            TS_ASSERT(hasBytes(responses.response(0), 0, RESOURCE_SIZE));
+        }
+        TS_ASSERT_EQUALS(mServer->reusedAfterHttp10(), 0u);
+    }
+};
@@ -0,0 +1,75 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/network/SSTBufferPool.hpp>
+
+using namespace Sirikata;
+using namespace Sirikata::SST;
+
+class SSTBufferPoolTest : public CxxTest::TestSuite {
+public:
+    void testCreateCopies() {
+        const char data[] = "segment data";
+        SegmentBufferPtr buf(SegmentBuffer::create(data, sizeof(data)));
+        TS_ASSERT_EQUALS(buf->size(), (uint32)sizeof(data));
+        TS_ASSERT(memcmp(buf->data(), data, sizeof(data)) == 0);
+
+        buf->resize(4);
+        TS_ASSERT_EQUALS(buf->size(), (uint32)4);
+        TS_ASSERT_EQUALS(buf->capacity(), (uint32)sizeof(data));
+    }
+
+    void testGather() {
+        const char a[] = "abc";
+        const char b[] = "defgh";
+        MemoryReference pieces[3] = {
+            MemoryReference(a, 3),
+            MemoryReference::null(),
+            MemoryReference(b, 5)
+        };
+        SegmentBufferPtr buf(SegmentBuffer::gather(pieces, 3));
+        TS_ASSERT_EQUALS(buf->size(), (uint32)8);
+        TS_ASSERT(memcmp(buf->data(), "abcdefgh", 8) == 0);
+    }
+
+    void testReuse() {
+        // Warm the pool up, then check that releasing and reallocating the
+        // same size doesn't hit the heap.
+        {
+            SegmentBufferPtr warm(SegmentBuffer::create(1000));
+        }
+        SegmentBufferPool::Stats before = SegmentBufferPool::stats();
+        for(int i = 0; i < 100; i++) {
+            SegmentBufferPtr buf(SegmentBuffer::create(1000));
+            SegmentBufferPtr shared = buf;
+            TS_ASSERT_EQUALS(shared->size(), (uint32)1000);
+        }
+        SegmentBufferPool::Stats after = SegmentBufferPool::stats();
+        TS_ASSERT_EQUALS(after.requests - before.requests, (uint64)100);
+        TS_ASSERT_EQUALS(after.allocations, before.allocations);
+    }
+
+    void testLargeBypassesPool() {
+        SegmentBufferPool::Stats before = SegmentBufferPool::stats();
+        {
+            SegmentBufferPtr buf(SegmentBuffer::create(64*1024));
+            memset(buf->data(), 0, buf->size());
+        }
+        SegmentBufferPool::Stats after = SegmentBufferPool::stats();
+        TS_ASSERT_EQUALS(after.allocations - before.allocations, (uint64)1);
+    }
+
+    void testStats() {
+        SegmentBufferPool::resetStats();
+        SegmentBufferPool::recordDelivered(1000);
+        { SegmentBufferPtr buf(SegmentBuffer::create("x", 1)); }
+        SegmentBufferPool::Stats stats = SegmentBufferPool::stats();
+        TS_ASSERT_EQUALS(stats.requests, (uint64)1);
+        TS_ASSERT_EQUALS(stats.bytes_copied, (uint64)1);
+        TS_ASSERT(stats.allocationsPerDeliveredByte() <= 0.001);
+        TS_ASSERT_DELTA(stats.copiesPerDeliveredByte(), 0.001, 1e-9);
+    }
+};
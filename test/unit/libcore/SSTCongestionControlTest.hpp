@@ -0,0 +1,151 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/network/SSTImpl.hpp>
+
+using namespace Sirikata;
+using namespace Sirikata::SST;
+
+class SSTCongestionControlTest : public CxxTest::TestSuite {
+    // Feed a CongestionControl acks for a steady flow: one ack every
+    // rtt/window, each with a delivery rate matching the window.
+    void steadyAcks(CongestionControl* cc, Time& now, uint32 nacks, const Duration& rtt) {
+        for(uint32 i = 0; i < nacks; i++) {
+            CongestionControl::AckSample sample;
+            uint32 window = cc->window();
+            now += rtt / window;
+            sample.now = now;
+            sample.rtt = rtt;
+            sample.min_rtt = rtt;
+            sample.delivery_rate = window / rtt.toSeconds();
+            sample.in_flight = window - 1;
+            cc->onAck(sample);
+        }
+    }
+
+public:
+    void testRTTEstimator() {
+        RTTEstimator est;
+        TS_ASSERT(!est.hasSample());
+        TS_ASSERT_EQUALS(est.rto(), Duration::seconds(1));
+
+        est.sample(Duration::milliseconds(100));
+        TS_ASSERT(est.hasSample());
+        TS_ASSERT_EQUALS(est.srtt(), Duration::milliseconds(100));
+        // SRTT + 4 * (RTT/2)
+        TS_ASSERT_EQUALS(est.rto(), Duration::milliseconds(300));
+
+        // Steady samples shrink the variance
+        for(int i = 0; i < 50; i++)
+            est.sample(Duration::milliseconds(100));
+        TS_ASSERT(est.rto() < Duration::milliseconds(110));
+        TS_ASSERT_EQUALS(est.minRTT(), Duration::milliseconds(100));
+
+        est.backoff();
+        TS_ASSERT(est.rto() >= Duration::milliseconds(200));
+        for(int i = 0; i < 40; i++)
+            est.backoff();
+        TS_ASSERT_EQUALS(est.rto(), Duration::microseconds(SST_MAX_RTO_US));
+    }
+
+    void testCreate() {
+        const char* names[] = { "legacy", "cubic", "bbr" };
+        for(int i = 0; i < 3; i++) {
+            CongestionControl* cc = CongestionControl::create(names[i]);
+            TS_ASSERT_EQUALS(cc->name(), String(names[i]));
+            TS_ASSERT(cc->window() >= 1);
+            delete cc;
+        }
+    }
+
+    void testCubicGrowsAndBacksOff() {
+        CongestionControl* cc = CongestionControl::create("cubic");
+        Time now = Time::epoch();
+        uint32 initial = cc->window();
+
+        steadyAcks(cc, now, 200, Duration::milliseconds(10));
+        uint32 grown = cc->window();
+        TS_ASSERT(grown > initial);
+
+        cc->onLoss(now);
+        uint32 after_loss = cc->window();
+        TS_ASSERT(after_loss < grown);
+        TS_ASSERT(after_loss >= (uint32)(grown * 0.6));
+
+        // Recovers towards the previous maximum
+        steadyAcks(cc, now, 2000, Duration::milliseconds(10));
+        TS_ASSERT(cc->window() > after_loss);
+
+        cc->onTimeout(now);
+        TS_ASSERT_EQUALS(cc->window(), (uint32)1);
+        delete cc;
+    }
+
+    // A loss, or BBR's first bandwidth estimate, can shrink the window below
+    // the number of segments already outstanding. The connection must then
+    // wait for acks to drain the excess before sending again.
+    void testShrinkWithFullWindow() {
+        CongestionControl* cc = CongestionControl::create("cubic");
+        Time now = Time::epoch();
+        Duration rtt = Duration::milliseconds(10);
+
+        steadyAcks(cc, now, 200, rtt);
+        uint32 in_flight = cc->window();
+        TS_ASSERT(!cc->hasRoom(in_flight));
+        cc->onLoss(now);
+        TS_ASSERT(cc->window() < in_flight);
+        TS_ASSERT(!cc->hasRoom(in_flight - 1));
+
+        // Each ack takes one segment out of flight, without sending more
+        // until there is room again
+        while(in_flight > 0 && !cc->hasRoom(in_flight)) {
+            CongestionControl::AckSample sample;
+            now += rtt / in_flight;
+            in_flight--;
+            sample.now = now;
+            sample.rtt = rtt;
+            sample.min_rtt = rtt;
+            sample.delivery_rate = in_flight / rtt.toSeconds();
+            sample.in_flight = in_flight;
+            cc->onAck(sample);
+        }
+        TS_ASSERT(in_flight > 0);
+        TS_ASSERT(cc->hasRoom(in_flight));
+        delete cc;
+
+        cc = CongestionControl::create("bbr");
+        now = Time::epoch();
+        in_flight = cc->window();
+        // No delivery rate sample yet, so the window drops to the minimum
+        CongestionControl::AckSample sample;
+        in_flight--;
+        sample.now = now;
+        sample.rtt = rtt;
+        sample.min_rtt = rtt;
+        sample.delivery_rate = 0;
+        sample.in_flight = in_flight;
+        cc->onAck(sample);
+        TS_ASSERT(cc->window() < in_flight);
+        TS_ASSERT(!cc->hasRoom(in_flight));
+        TS_ASSERT(cc->hasRoom(cc->window() - 1));
+        delete cc;
+    }
+
+    void testBBRIgnoresLoss() {
+        CongestionControl* cc = CongestionControl::create("bbr");
+        Time now = Time::epoch();
+
+        steadyAcks(cc, now, 500, Duration::milliseconds(10));
+        uint32 before = cc->window();
+        cc->onLoss(now);
+        TS_ASSERT_EQUALS(cc->window(), before);
+
+        cc->onTimeout(now);
+        TS_ASSERT(cc->window() < before);
+        TS_ASSERT(cc->window() >= 1);
+        delete cc;
+    }
+};
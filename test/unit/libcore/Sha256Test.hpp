@@ -0,0 +1,140 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/util/Sha256.hpp>
+#include <sirikata/core/util/Thread.hpp>
+
+using namespace Sirikata;
+
+class Sha256Test : public CxxTest::TestSuite {
+    // Deterministic, non-repeating test data
+    static String makeData(size_t length, uint32 seed) {
+        String data(length, '\0');
+        uint32 x = seed * 2654435761u + 1;
+        for(size_t i = 0; i < length; i++) {
+            x = x * 1103515245u + 12345u;
+            data[i] = (char)(x >> 24);
+        }
+        return data;
+    }
+
+    struct Batch {
+        std::vector<String> buffers;
+        std::vector<const void*> data;
+        std::vector<size_t> lengths;
+
+        Batch(size_t count, size_t max_length) {
+            for(size_t i = 0; i < count; i++)
+                buffers.push_back(makeData((i * 7919) % max_length, i));
+            for(size_t i = 0; i < count; i++) {
+                data.push_back(buffers[i].data());
+                lengths.push_back(buffers[i].size());
+            }
+        }
+    };
+
+    static void computeBatch(const Batch* batch, std::vector<SHA256>* digests) {
+        digests->resize(batch->buffers.size());
+        if (batch->buffers.empty())
+            SHA256::computeDigests(NULL, NULL, 0, NULL);
+        else
+            SHA256::computeDigests(&batch->data[0], &batch->lengths[0], batch->buffers.size(), &(*digests)[0]);
+    }
+
+    void checkBatch(const Batch& batch, const std::vector<SHA256>& digests) {
+        TS_ASSERT_EQUALS(digests.size(), batch.buffers.size());
+        for(size_t i = 0; i < batch.buffers.size(); i++)
+            TS_ASSERT_EQUALS(digests[i], SHA256::computeDigest(batch.buffers[i]));
+    }
+
+public:
+    void tearDown() {
+        SHA256::useScalarImplementation(false);
+    }
+
+    void checkVectors() {
+        // FIPS 180-2 test vectors
+        TS_ASSERT_EQUALS(SHA256::computeDigest("").convertToHexString(),
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        TS_ASSERT_EQUALS(SHA256::emptyDigest().convertToHexString(),
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        TS_ASSERT_EQUALS(SHA256::computeDigest("abc").convertToHexString(),
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        TS_ASSERT_EQUALS(SHA256::computeDigest("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq").convertToHexString(),
+            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+        String million_a(1000000, 'a');
+        TS_ASSERT_EQUALS(SHA256::computeDigest(million_a).convertToHexString(),
+            "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+        // Fed in pieces that don't line up with blocks
+        SHA256Context ctx;
+        for(size_t offset = 0; offset < million_a.size(); offset += 999)
+            ctx.update(million_a.data() + offset, std::min<size_t>(999, million_a.size() - offset));
+        TS_ASSERT_EQUALS(ctx.get().convertToHexString(),
+            "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    }
+
+    void testVectors() {
+        checkVectors();
+    }
+
+    void testScalarVectors() {
+        SHA256::useScalarImplementation(true);
+        TS_ASSERT_EQUALS(String(SHA256::implementation()), "scalar");
+        checkVectors();
+    }
+
+    void testScalarMatchesAccelerated() {
+        // Covers partial blocks, the padding spilling into an extra block
+        // and runs of several whole blocks
+        String data = makeData(1024, 0);
+        std::vector<SHA256> scalar;
+        SHA256::useScalarImplementation(true);
+        for(size_t len = 0; len <= data.size(); len++)
+            scalar.push_back(SHA256::computeDigest(data.data(), len));
+
+        SHA256::useScalarImplementation(false);
+        for(size_t len = 0; len <= data.size(); len++)
+            TS_ASSERT_EQUALS(SHA256::computeDigest(data.data(), len), scalar[len]);
+    }
+
+    void testBatch() {
+        // Empty, too small to be worth any threads, and large enough to be
+        // split between them
+        Batch empty(0, 1);
+        std::vector<SHA256> empty_digests;
+        computeBatch(&empty, &empty_digests);
+        TS_ASSERT(empty_digests.empty());
+
+        Batch small(16, 1024);
+        std::vector<SHA256> small_digests;
+        computeBatch(&small, &small_digests);
+        checkBatch(small, small_digests);
+
+        Batch large(64, 256*1024);
+        std::vector<SHA256> large_digests;
+        computeBatch(&large, &large_digests);
+        checkBatch(large, large_digests);
+        // Again, now that the worker threads already exist
+        computeBatch(&large, &large_digests);
+        checkBatch(large, large_digests);
+    }
+
+    void testConcurrentBatches() {
+        Batch large(64, 256*1024);
+        std::vector<SHA256> digests[4];
+        std::vector<Thread*> threads;
+        for(int i = 0; i < 4; i++)
+            threads.push_back(new Thread("Sha256Test", std::tr1::bind(&computeBatch, &large, &digests[i])));
+        for(size_t i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+        for(int i = 0; i < 4; i++)
+            checkBatch(large, digests[i]);
+    }
+};
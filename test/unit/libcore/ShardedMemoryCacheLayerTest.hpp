@@ -0,0 +1,237 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/transfer/ShardedMemoryCacheLayer.hpp>
+#include <sirikata/core/util/Thread.hpp>
+
+using namespace Sirikata;
+using namespace Sirikata::Transfer;
+
+#define CHUNK_SIZE 1024
+
+class ShardedMemoryCacheLayerTest : public CxxTest::TestSuite {
+    // Stands in for the disk cache behind the memory cache: holds whole
+    // chunks and hands them back up when asked for them
+    class BackingLayer : public CacheLayer {
+    public:
+        BackingLayer()
+         : CacheLayer(NULL), lookups(0), purges(0)
+        {}
+
+        virtual void purgeFromCache(const Fingerprint& fileId) {
+            purges++;
+            mData.erase(fileId);
+        }
+
+        virtual void getData(const Fingerprint& fileId, const Range& requestedRange, const TransferCallback& callback) {
+            lookups++;
+            std::map<Fingerprint, DenseDataPtr>::iterator it = mData.find(fileId);
+            if (it == mData.end()) {
+                callback(NULL);
+                return;
+            }
+            populateParentCaches(fileId, it->second);
+            SparseData data;
+            data.addValidData(it->second);
+            callback(&data);
+        }
+
+        uint32 lookups;
+        uint32 purges;
+
+    protected:
+        virtual void populateCache(const Fingerprint& fileId, const DenseDataPtr& data) {
+            mData[fileId] = data;
+            populateParentCaches(fileId, data);
+        }
+
+    private:
+        std::map<Fingerprint, DenseDataPtr> mData;
+    };
+
+    // Chunks of CHUNK_SIZE bytes, each filled with its index
+    std::vector<DenseDataPtr> mChunks;
+    std::vector<Fingerprint> mFingerprints;
+
+    AtomicValue<uint32> mFound;
+
+    // getData completes synchronously for this layer
+    void gotData(const SparseData* data) {
+        if (data != NULL)
+            ++mFound;
+    }
+
+    bool contains(ShardedMemoryCacheLayer* cache, uint32 idx, const Range& range = Range(true)) {
+        uint32 before = mFound.read();
+        cache->getData(mFingerprints[idx], range, std::tr1::bind(&ShardedMemoryCacheLayerTest::gotData, this, std::tr1::placeholders::_1));
+        return mFound.read() != before;
+    }
+
+    void add(ShardedMemoryCacheLayer* cache, uint32 idx) {
+        cache->addToCache(mFingerprints[idx], mChunks[idx]);
+    }
+
+    void hammer(ShardedMemoryCacheLayer* cache, uint32 thread_idx) {
+        for(uint32 round = 0; round < 20000; round++) {
+            uint32 idx = (round * 7 + thread_idx * 13) % mChunks.size();
+            if (round % 5 == 0)
+                add(cache, idx);
+            else
+                contains(cache, idx);
+            if (round % 997 == 0)
+                cache->purgeFromCache(mFingerprints[idx]);
+        }
+    }
+
+public:
+    void setUp() {
+        mFound = 0;
+        for(uint32 i = 0; i < 100; i++) {
+            MutableDenseDataPtr chunk(new DenseData(Range(0, CHUNK_SIZE, LENGTH, true)));
+            memset(chunk->writableData(), (int)i, CHUNK_SIZE);
+            mFingerprints.push_back(SHA256::computeDigest(chunk->writableData(), CHUNK_SIZE));
+            mChunks.push_back(chunk);
+        }
+    }
+
+    void tearDown() {
+        mChunks.clear();
+        mFingerprints.clear();
+    }
+
+    void testHitsAndMisses() {
+        ShardedMemoryCacheLayer cache(16 * CHUNK_SIZE, 4, NULL);
+        TS_ASSERT_EQUALS(cache.numShards(), 4u);
+
+        add(&cache, 0);
+        add(&cache, 1);
+        TS_ASSERT(contains(&cache, 0));
+        TS_ASSERT(contains(&cache, 1));
+        TS_ASSERT(!contains(&cache, 2));
+        TS_ASSERT_EQUALS(cache.hits(), 2u);
+        TS_ASSERT_EQUALS(cache.misses(), 1u);
+        TS_ASSERT_EQUALS(cache.insertions(), 2u);
+        TS_ASSERT_EQUALS(cache.numEntries(), 2u);
+        TS_ASSERT_EQUALS(cache.usedBytes(), (cache_usize_type)(2 * CHUNK_SIZE));
+
+        // Adding the same data again doesn't count it twice
+        add(&cache, 0);
+        TS_ASSERT_EQUALS(cache.insertions(), 2u);
+        TS_ASSERT_EQUALS(cache.usedBytes(), (cache_usize_type)(2 * CHUNK_SIZE));
+
+        cache.purgeFromCache(mFingerprints[0]);
+        TS_ASSERT(!contains(&cache, 0));
+        TS_ASSERT_EQUALS(cache.numEntries(), 1u);
+        TS_ASSERT_EQUALS(cache.usedBytes(), (cache_usize_type)CHUNK_SIZE);
+    }
+
+    void testTooLarge() {
+        // Like CachePolicy, anything over half the budget isn't kept
+        ShardedMemoryCacheLayer cache(CHUNK_SIZE, 1, NULL);
+        add(&cache, 0);
+        TS_ASSERT(!contains(&cache, 0));
+        TS_ASSERT_EQUALS(cache.numEntries(), 0u);
+    }
+
+    void testBudget() {
+        ShardedMemoryCacheLayer cache(10 * CHUNK_SIZE, 4, NULL);
+        for(uint32 i = 0; i < 30; i++) {
+            add(&cache, i);
+            TS_ASSERT_LESS_THAN_EQUALS(cache.usedBytes(), cache.budget());
+        }
+        TS_ASSERT_EQUALS(cache.numEntries(), 10u);
+        TS_ASSERT_EQUALS(cache.evictions(), 20u);
+    }
+
+    void testClockEviction() {
+        // A single shard, so the clock order is the insertion order
+        const uint32 capacity = 8;
+        ShardedMemoryCacheLayer cache(capacity * CHUNK_SIZE, 1, NULL);
+        for(uint32 i = 0; i < capacity; i++)
+            add(&cache, i);
+
+        // Entry 1 is used before every insertion, so it always has its
+        // reference bit set when the hand reaches it. Everything else is
+        // only used when it's added.
+        uint32 last = 40;
+        for(uint32 i = capacity; i <= last; i++) {
+            TS_ASSERT(contains(&cache, 1));
+            add(&cache, i);
+            TS_ASSERT_EQUALS(cache.numEntries(), capacity);
+        }
+        TS_ASSERT(contains(&cache, 1));
+        TS_ASSERT(contains(&cache, last));
+        TS_ASSERT(!contains(&cache, 2));
+    }
+
+    void testMissGoesToNextLayer() {
+        BackingLayer backing;
+        // Only the next layer has chunk 2
+        backing.addToCache(mFingerprints[2], mChunks[2]);
+        ShardedMemoryCacheLayer cache(16 * CHUNK_SIZE, 4, &backing);
+
+        // A miss is looked up in the next layer, and what it finds is kept
+        // here for next time
+        TS_ASSERT(contains(&cache, 2));
+        TS_ASSERT_EQUALS(backing.lookups, 1u);
+        TS_ASSERT_EQUALS(cache.misses(), 1u);
+        TS_ASSERT(contains(&cache, 2));
+        TS_ASSERT_EQUALS(backing.lookups, 1u);
+        TS_ASSERT_EQUALS(cache.hits(), 1u);
+
+        // addToCache stores in the last layer, which fills in the ones in
+        // front of it
+        add(&cache, 0);
+        TS_ASSERT(contains(&cache, 0));
+        TS_ASSERT_EQUALS(backing.lookups, 1u);
+        TS_ASSERT_EQUALS(cache.numEntries(), 2u);
+
+        // Purging removes it from every layer
+        cache.purgeFromCache(mFingerprints[0]);
+        TS_ASSERT_EQUALS(backing.purges, 1u);
+        TS_ASSERT(!contains(&cache, 0));
+        TS_ASSERT_EQUALS(backing.lookups, 2u);
+    }
+
+    void testPartialData() {
+        // Only part of the chunk is cached, so only requests inside that part
+        // are hits
+        ShardedMemoryCacheLayer cache(16 * CHUNK_SIZE, 4, NULL);
+        MutableDenseDataPtr half(new DenseData(Range(0, CHUNK_SIZE / 2, LENGTH, false)));
+        memcpy(half->writableData(), mChunks[0]->data(), CHUNK_SIZE / 2);
+        cache.addToCache(mFingerprints[0], half);
+
+        TS_ASSERT(contains(&cache, 0, Range(0, CHUNK_SIZE / 4, LENGTH, false)));
+        TS_ASSERT(!contains(&cache, 0, Range(CHUNK_SIZE / 4, CHUNK_SIZE / 2, LENGTH, false)));
+        TS_ASSERT(!contains(&cache, 0));
+        TS_ASSERT_EQUALS(cache.usedBytes(), (cache_usize_type)(CHUNK_SIZE / 2));
+
+        // The rest of it fills in the same entry
+        cache.addToCache(mFingerprints[0], mChunks[0]);
+        TS_ASSERT(contains(&cache, 0));
+        TS_ASSERT_EQUALS(cache.numEntries(), 1u);
+        TS_ASSERT_EQUALS(cache.insertions(), 1u);
+    }
+
+    void testConcurrentAccess() {
+        const uint32 budget_chunks = 50;
+        ShardedMemoryCacheLayer cache(budget_chunks * CHUNK_SIZE, 8, NULL);
+
+        std::vector<Thread*> threads;
+        for(uint32 i = 0; i < 8; i++)
+            threads.push_back(new Thread("ShardedMemoryCacheLayerTest", std::tr1::bind(&ShardedMemoryCacheLayerTest::hammer, this, &cache, i)));
+        for(uint32 i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+
+        // Every entry is a single chunk, so the accounting has to agree with
+        // what's actually stored
+        TS_ASSERT_LESS_THAN_EQUALS(cache.numEntries(), budget_chunks);
+        TS_ASSERT_EQUALS(cache.usedBytes(), (cache_usize_type)(cache.numEntries() * CHUNK_SIZE));
+        TS_ASSERT_EQUALS(cache.hits(), mFound.read());
+    }
+};
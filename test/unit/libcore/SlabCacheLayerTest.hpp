@@ -0,0 +1,194 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/transfer/SlabCacheLayer.hpp>
+#include <sirikata/core/transfer/LRUPolicy.hpp>
+#include <sirikata/core/util/Paths.hpp>
+#include <boost/filesystem.hpp>
+
+using namespace Sirikata;
+using namespace Sirikata::Transfer;
+
+#define SLAB_TEST_DIR "SlabCacheLayerTest"
+#define CHUNK_SIZE 1000
+// The data file holds exactly this many chunks
+#define SLAB_CHUNKS 16
+// Size of a record in the index file
+#define INDEX_RECORD_SIZE 58
+
+class SlabCacheLayerTest : public CxxTest::TestSuite {
+    LRUPolicy* mPolicy;
+    SlabCacheLayer* mCache;
+
+    boost::mutex mMutex;
+    boost::condition_variable mCond;
+    bool mDone;
+    String mResult;
+    bool mFound;
+
+    // Deterministic chunk contents, different for each index
+    static String makeData(uint32 idx) {
+        String data(CHUNK_SIZE, '\0');
+        uint32 x = idx * 2654435761u + 1;
+        for(size_t i = 0; i < data.size(); i++) {
+            x = x * 1103515245u + 12345u;
+            data[i] = (char)(x >> 24);
+        }
+        return data;
+    }
+
+    static Fingerprint fingerprint(uint32 idx) {
+        return SHA256::computeDigest(makeData(idx));
+    }
+
+    static String dir() {
+        return Path::Get(Path::DIR_TEMP, SLAB_TEST_DIR);
+    }
+
+    void open() {
+        mPolicy = new LRUPolicy(1000000);
+        mCache = new SlabCacheLayer(mPolicy, SLAB_TEST_DIR, SLAB_CHUNKS * CHUNK_SIZE, 2, NULL);
+    }
+
+    // Destroying the layer finishes all queued writes
+    void close() {
+        delete mCache;
+        mCache = NULL;
+        delete mPolicy;
+        mPolicy = NULL;
+    }
+
+    void restart() {
+        close();
+        open();
+    }
+
+    void add(uint32 idx) {
+        mCache->addToCache(fingerprint(idx), DenseDataPtr(new DenseData(makeData(idx))));
+    }
+
+    void gotData(const SparseData* data) {
+        boost::lock_guard<boost::mutex> lock(mMutex);
+        mFound = (data != NULL);
+        if (data != NULL)
+            mResult = data->flatten()->asString();
+        mDone = true;
+        mCond.notify_all();
+    }
+
+    // Returns whether the cache had the range, leaving the data in mResult
+    bool get(uint32 idx, const Range& range) {
+        {
+            boost::lock_guard<boost::mutex> lock(mMutex);
+            mDone = false;
+            mResult.clear();
+        }
+        mCache->getData(fingerprint(idx), range, std::tr1::bind(&SlabCacheLayerTest::gotData, this, std::tr1::placeholders::_1));
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        while(!mDone)
+            mCond.wait(lock);
+        return mFound;
+    }
+
+    bool contains(uint32 idx) {
+        return get(idx, Range(true)) && mResult == makeData(idx);
+    }
+
+public:
+    void setUp() {
+        boost::filesystem::remove_all(dir());
+        open();
+    }
+
+    void tearDown() {
+        close();
+        boost::filesystem::remove_all(dir());
+    }
+
+    void testIndexReplay() {
+        for(uint32 i = 0; i < 8; i++)
+            add(i);
+        restart();
+
+        TS_ASSERT_EQUALS(mCache->numEntries(), 8u);
+        TS_ASSERT_EQUALS(mCache->usedBytes(), (cache_usize_type)(8 * CHUNK_SIZE));
+        for(uint32 i = 0; i < 8; i++)
+            TS_ASSERT(contains(i));
+        TS_ASSERT(!contains(8));
+
+        // Partial reads come out of the middle of the stored chunk
+        TS_ASSERT(get(3, Range(10, 20, LENGTH, false)));
+        TS_ASSERT_EQUALS(mResult, makeData(3).substr(10, 20));
+
+        // Removals are recorded too
+        mCache->purgeFromCache(fingerprint(5));
+        TS_ASSERT(!contains(5));
+        restart();
+        TS_ASSERT_EQUALS(mCache->numEntries(), 7u);
+        TS_ASSERT(!contains(5));
+        TS_ASSERT(contains(6));
+    }
+
+    void testIndexForOtherCapacity() {
+        add(0);
+        close();
+
+        // Nothing recorded for a data file of a different size can be trusted
+        mPolicy = new LRUPolicy(1000000);
+        mCache = new SlabCacheLayer(mPolicy, SLAB_TEST_DIR, 2 * SLAB_CHUNKS * CHUNK_SIZE, 2, NULL);
+        TS_ASSERT_EQUALS(mCache->numEntries(), 0u);
+        TS_ASSERT(!contains(0));
+    }
+
+    void testRingWrap() {
+        // Two and a half times around the ring; each new chunk overwrites
+        // the oldest one
+        uint32 total = SLAB_CHUNKS * 5 / 2;
+        for(uint32 i = 0; i < total; i++)
+            add(i);
+        restart();
+
+        TS_ASSERT_EQUALS(mCache->numEntries(), (uint32)SLAB_CHUNKS);
+        TS_ASSERT_EQUALS(mCache->usedBytes(), (cache_usize_type)(SLAB_CHUNKS * CHUNK_SIZE));
+        for(uint32 i = 0; i < total - SLAB_CHUNKS; i++)
+            TS_ASSERT(!contains(i));
+        for(uint32 i = total - SLAB_CHUNKS; i < total; i++)
+            TS_ASSERT(contains(i));
+
+        // The write head survives the restart, so the next chunk replaces
+        // the oldest one rather than a newer one
+        add(total);
+        restart();
+        TS_ASSERT(!contains(total - SLAB_CHUNKS));
+        for(uint32 i = total - SLAB_CHUNKS + 1; i <= total; i++)
+            TS_ASSERT(contains(i));
+    }
+
+    void testCompaction() {
+        // The index gets one record per chunk written, and is compacted down
+        // to the live entries once it has 4096 more records than twice their
+        // number. Stop right after that, so nothing but the compacted index
+        // is left to restore the contents and write head from.
+        uint32 total = 2 * SLAB_CHUNKS + 4096;
+        for(uint32 i = 0; i < total; i++)
+            add(i);
+        close();
+
+        String index_path = (boost::filesystem::path(dir()) / "slab.index").string();
+        uint64 index_size = boost::filesystem::file_size(index_path);
+        TS_ASSERT_LESS_THAN(index_size, (uint64)(total * INDEX_RECORD_SIZE / 2));
+
+        open();
+        TS_ASSERT_EQUALS(mCache->numEntries(), (uint32)SLAB_CHUNKS);
+        for(uint32 i = total - SLAB_CHUNKS; i < total; i++)
+            TS_ASSERT(contains(i));
+        add(total);
+        restart();
+        TS_ASSERT(!contains(total - SLAB_CHUNKS));
+        for(uint32 i = total - SLAB_CHUNKS + 1; i <= total; i++)
+            TS_ASSERT(contains(i));
+    }
+};
@@ -30,7 +30,12 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <cxxtest/TestSuite.h>
 #include <sirikata/core/queue/ThreadSafeQueue.hpp>
+#include <sirikata/core/queue/SizedThreadSafeQueue.hpp>
+#include <sirikata/core/queue/LockFreeQueue.hpp>
+
+using namespace Sirikata;
 
 class ThreadSafeQueueTest : public CxxTest::TestSuite
 {
@@ -76,6 +81,7 @@ public:
         mQueue->push(e);
         mQueue->push(f);
         mQueue->push(g);
+        mQueue->push(h);
         std::tr1::shared_ptr<MyClass> result;
         for (unsigned int i=0;i<8;++i) {
             TS_ASSERT(mQueue->pop(result));
@@ -84,4 +90,45 @@ public:
         TS_ASSERT(!mQueue->pop(result));
     }
 
+    void testPushManyPopUpTo( void ) {
+        ThreadSafeQueue<int> queue;
+        std::vector<int> values;
+        for (int i=0;i<10;++i)
+            values.push_back(i);
+        TS_ASSERT_EQUALS(queue.pushMany(values.begin(), values.end()), 10);
+        TS_ASSERT_EQUALS(queue.pushMany(values.begin(), values.begin()), 10);
+
+        std::deque<int> popped;
+        TS_ASSERT_EQUALS(queue.popUpTo(4, &popped), (uint32)4);
+        TS_ASSERT_EQUALS(queue.popUpTo(4, &popped), (uint32)4);
+        TS_ASSERT_EQUALS(queue.popUpTo(4, &popped), (uint32)2);
+        TS_ASSERT_EQUALS(queue.popUpTo(4, &popped), (uint32)0);
+        TS_ASSERT_EQUALS(popped.size(), (size_t)10);
+        for (int i=0;i<10;++i)
+            TS_ASSERT_EQUALS(popped[i], i);
+        TS_ASSERT(queue.probablyEmpty());
+    }
+
+    void testSizedPushMany( void ) {
+        // Each string counts its length against the limit
+        SizedThreadSafeQueue<std::string> queue(SizedResourceMonitor(10));
+        std::vector<std::string> values;
+        values.push_back("aaa");
+        values.push_back("bbb");
+        values.push_back("ccc");
+        values.push_back("ddd");
+        // Only the first three fit under the limit
+        TS_ASSERT_EQUALS(queue.pushMany(values.begin(), values.end(), false), (uint32)3);
+        TS_ASSERT_EQUALS(queue.getResourceMonitor().filledSize(), (uint32)9);
+
+        std::deque<std::string> popped;
+        TS_ASSERT_EQUALS(queue.popUpTo(2, &popped), (uint32)2);
+        TS_ASSERT_EQUALS(popped.front(), "aaa");
+        TS_ASSERT_EQUALS(popped.back(), "bbb");
+        TS_ASSERT_EQUALS(queue.getResourceMonitor().filledSize(), (uint32)3);
+
+        // Forced pushes ignore the limit
+        TS_ASSERT_EQUALS(queue.pushMany(values.begin(), values.end(), true), (uint32)4);
+    }
+
 };
@@ -0,0 +1,149 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/util/Thread.hpp>
+#include <sirikata/core/util/Timer.hpp>
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <sirikata/core/network/IOWork.hpp>
+#include <sirikata/core/network/TimerWheel.hpp>
+
+using namespace Sirikata;
+
+class TimerWheelTest : public CxxTest::TestSuite {
+    Network::IOService* ios;
+    Network::IOStrand* strand;
+    Network::IOWork* work;
+    std::vector<Thread*> threads;
+
+    boost::mutex fired_mutex;
+    std::vector< std::pair<int, Time> > fired;
+
+public:
+    void setUp() {
+        ios = new Network::IOService("TimerWheelTest");
+        strand = ios->createStrand("TimerWheelTest Strand");
+        work = new Network::IOWork(ios);
+        for(int i = 0; i < 2; i++) {
+            threads.push_back(
+                new Thread(
+                    "TimerWheelTest Thread",
+                    std::tr1::bind(&Network::IOService::runNoReturn, ios)
+                )
+            );
+        }
+        fired.clear();
+    }
+
+    void waitForWorkers() {
+        if (work != NULL) {
+            delete work; work = NULL;
+        }
+        for(uint32 i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+        threads.clear();
+    }
+    void tearDown() {
+        waitForWorkers();
+        delete strand; strand = NULL;
+        delete ios; ios = NULL;
+    }
+
+    void recordFired(int id) {
+        boost::mutex::scoped_lock lock(fired_mutex);
+        fired.push_back(std::make_pair(id, Timer::now()));
+    }
+    uint32 numFired() {
+        boost::mutex::scoped_lock lock(fired_mutex);
+        return fired.size();
+    }
+    void waitForFired(uint32 n, const Duration& timeout) {
+        Time start = Timer::now();
+        while(numFired() < n && Timer::now() - start < timeout)
+            Timer::sleep(Duration::milliseconds((int64)5));
+    }
+
+    void testFiresInOrderAndNotEarly() {
+        Network::TimerWheelPtr wheel = Network::TimerWheel::create(strand, Duration::milliseconds((int64)1));
+        std::vector<Network::WheelTimerPtr> timers;
+        Time start = Timer::now();
+        // Delays past 256ms cross into the second level and must cascade
+        const int delays_ms[] = { 50, 10, 300, 30 };
+        for(int i = 0; i < 4; i++) {
+            timers.push_back(wheel->createTimer(
+                std::tr1::bind(&TimerWheelTest::recordFired, this, delays_ms[i])
+            ));
+            timers.back()->wait(Duration::milliseconds((int64)delays_ms[i]));
+        }
+        TS_ASSERT_EQUALS(wheel->size(), (uint32)4);
+
+        waitForFired(4, Duration::seconds(5));
+        TS_ASSERT_EQUALS(numFired(), (uint32)4);
+        TS_ASSERT_EQUALS(wheel->size(), (uint32)0);
+        for(uint32 i = 0; i < fired.size(); i++) {
+            TS_ASSERT(fired[i].second - start >= Duration::milliseconds((int64)fired[i].first));
+            if (i > 0) TS_ASSERT(fired[i-1].first < fired[i].first);
+        }
+    }
+
+    void testCancelAndRearm() {
+        Network::TimerWheelPtr wheel = Network::TimerWheel::create(strand, Duration::milliseconds((int64)1));
+        Network::WheelTimerPtr cancelled = wheel->createTimer(
+            std::tr1::bind(&TimerWheelTest::recordFired, this, 1)
+        );
+        Network::WheelTimerPtr rearmed = wheel->createTimer(
+            std::tr1::bind(&TimerWheelTest::recordFired, this, 2)
+        );
+
+        TS_ASSERT_EQUALS(cancelled->wait(Duration::milliseconds((int64)20)), (uint32)0);
+        TS_ASSERT(cancelled->expiresFromNow() > Duration::zero());
+        TS_ASSERT_EQUALS(cancelled->cancel(), (uint32)1);
+        TS_ASSERT_EQUALS(cancelled->cancel(), (uint32)0);
+        TS_ASSERT_EQUALS(cancelled->expiresFromNow(), Duration::zero());
+
+        rearmed->wait(Duration::milliseconds((int64)10));
+        TS_ASSERT_EQUALS(rearmed->wait(Duration::milliseconds((int64)40)), (uint32)1);
+        TS_ASSERT(rearmed->expiresFromNow() > Duration::milliseconds((int64)20));
+        TS_ASSERT_EQUALS(wheel->size(), (uint32)1);
+
+        waitForFired(1, Duration::seconds(5));
+        Timer::sleep(Duration::milliseconds((int64)50));
+        TS_ASSERT_EQUALS(numFired(), (uint32)1);
+        if (!fired.empty())
+            TS_ASSERT_EQUALS(fired[0].first, 2);
+    }
+
+    void testCoalescedExpiry() {
+        // Everything armed for the same coarse tick fires together
+        Network::TimerWheelPtr wheel = Network::TimerWheel::create(strand, Duration::milliseconds((int64)50));
+        std::vector<Network::WheelTimerPtr> timers;
+        for(int i = 0; i < 1000; i++) {
+            timers.push_back(wheel->createTimer(
+                std::tr1::bind(&TimerWheelTest::recordFired, this, i)
+            ));
+            timers.back()->wait(Duration::milliseconds((int64)20));
+        }
+        waitForFired(1000, Duration::seconds(5));
+        TS_ASSERT_EQUALS(numFired(), (uint32)1000);
+        if (!fired.empty())
+            TS_ASSERT(fired.back().second - fired.front().second < Duration::milliseconds((int64)20));
+    }
+
+    void testDestroyArmedTimer() {
+        Network::TimerWheelPtr wheel = Network::TimerWheel::create(strand, Duration::milliseconds((int64)1));
+        {
+            Network::WheelTimerPtr timer = wheel->createTimer(
+                std::tr1::bind(&TimerWheelTest::recordFired, this, 1)
+            );
+            timer->wait(Duration::milliseconds((int64)10));
+        }
+        TS_ASSERT_EQUALS(wheel->size(), (uint32)0);
+        Timer::sleep(Duration::milliseconds((int64)30));
+        TS_ASSERT_EQUALS(numFired(), (uint32)0);
+    }
+};
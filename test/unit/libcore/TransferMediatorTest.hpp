@@ -0,0 +1,216 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/transfer/TransferMediator.hpp>
+#include <sirikata/core/transfer/TransferPool.hpp>
+#include <sirikata/core/options/CommonOptions.hpp>
+#include <sirikata/core/util/Thread.hpp>
+
+using namespace Sirikata;
+
+class TransferMediatorTest : public CxxTest::TestSuite {
+    // Keeps track of which requests the mediator has started and which
+    // callers it has notified. Requests only finish when the test says so.
+    class Recorder {
+    public:
+        void started(const String& id, Transfer::TransferRequest::ExecuteFinished cb) {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            mStarted.push_back(id);
+            mFinishers[id] = cb;
+            mChanged.notify_all();
+        }
+
+        void notified(const String& client, const String& id) {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            mNotified.push_back(client + ":" + id);
+        }
+
+        // Waits until at least count requests have started, returning how
+        // many did
+        uint32 waitForStarted(uint32 count) {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            boost::system_time timeout = boost::get_system_time() + boost::posix_time::seconds(5);
+            while(mStarted.size() < count) {
+                if (!mChanged.timed_wait(lock, timeout))
+                    break;
+            }
+            return mStarted.size();
+        }
+
+        // Gives requests that shouldn't start a chance to (wrongly) do so
+        uint32 settle() {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            return mStarted.size();
+        }
+
+        bool wasStarted(const String& id) {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            return std::find(mStarted.begin(), mStarted.end(), id) != mStarted.end();
+        }
+
+        uint32 timesStarted(const String& id) {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            return std::count(mStarted.begin(), mStarted.end(), id);
+        }
+
+        bool wasNotified(const String& client, const String& id) {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            return std::find(mNotified.begin(), mNotified.end(), client + ":" + id) != mNotified.end();
+        }
+
+        // Finishes a started request. The mediator may start more requests
+        // from the callback, so this can't hold the lock while calling it.
+        void finish(const String& id) {
+            Transfer::TransferRequest::ExecuteFinished cb;
+            {
+                boost::unique_lock<boost::mutex> lock(mMutex);
+                std::map<String, Transfer::TransferRequest::ExecuteFinished>::iterator it = mFinishers.find(id);
+                TS_ASSERT(it != mFinishers.end());
+                if (it == mFinishers.end()) return;
+                cb = it->second;
+                mFinishers.erase(it);
+            }
+            cb();
+        }
+
+        void clear() {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            mStarted.clear();
+            mFinishers.clear();
+            mNotified.clear();
+        }
+
+    private:
+        boost::mutex mMutex;
+        boost::condition_variable mChanged;
+        std::vector<String> mStarted;
+        std::map<String, Transfer::TransferRequest::ExecuteFinished> mFinishers;
+        std::vector<String> mNotified;
+    };
+
+    class FakeRequest : public Transfer::TransferRequest {
+    public:
+        FakeRequest(Recorder* rec, const String& id, const String& host, Transfer::Priority priority)
+         : mRecorder(rec), mID(id), mHost(host)
+        {
+            mPriority = priority;
+            mDeletionRequest = false;
+        }
+
+        virtual const std::string& getIdentifier() const { return mID; }
+        virtual std::string getHost() const { return mHost; }
+
+        virtual void execute(std::tr1::shared_ptr<TransferRequest> req, ExecuteFinished cb) {
+            mRecorder->started(mID, cb);
+        }
+
+        virtual void notifyCaller(Transfer::TransferRequestPtr me, Transfer::TransferRequestPtr from) {
+            mRecorder->notified(getClientID(), mID);
+        }
+
+    private:
+        Recorder* mRecorder;
+        const String mID;
+        const String mHost;
+    };
+
+    Recorder mRecorder;
+    Transfer::TransferMediator* mMediator;
+
+    void add(const std::tr1::shared_ptr<Transfer::SimpleTransferPool>& pool, const String& id, const String& host, Transfer::Priority priority) {
+        pool->addRequest(Transfer::TransferRequestPtr(new FakeRequest(&mRecorder, id, host, priority)));
+    }
+
+public:
+    void setUp() {
+        // Small limits so they're easy to hit
+        const char* argv[] = {
+            "test",
+            "--" OPT_TRANSFER_MAX_OUTSTANDING "=3",
+            "--" OPT_TRANSFER_MAX_OUTSTANDING_PER_HOST "=2"
+        };
+        ParseOptions(3, const_cast<char**>(argv));
+        mMediator = &Transfer::TransferMediator::getSingleton();
+    }
+
+    void tearDown() {
+        mMediator->cleanup();
+        mMediator = NULL;
+        Transfer::TransferMediator::destroy();
+        mRecorder.clear();
+    }
+
+    void testPerHostLimit() {
+        std::tr1::shared_ptr<Transfer::SimpleTransferPool> pool =
+            mMediator->registerClient<Transfer::SimpleTransferPool>("client");
+
+        // a3 outranks b1 but host a is already at its limit, so it waits
+        // and b1 gets the last slot
+        add(pool, "a1", "a", 0.9f);
+        add(pool, "a2", "a", 0.8f);
+        add(pool, "a3", "a", 0.7f);
+        add(pool, "b1", "b", 0.1f);
+
+        TS_ASSERT_EQUALS(mRecorder.waitForStarted(3), 3u);
+        TS_ASSERT_EQUALS(mRecorder.settle(), 3u);
+        TS_ASSERT(mRecorder.wasStarted("a1"));
+        TS_ASSERT(mRecorder.wasStarted("a2"));
+        TS_ASSERT(mRecorder.wasStarted("b1"));
+        TS_ASSERT(!mRecorder.wasStarted("a3"));
+
+        // Finishing one of host a's requests lets the waiting one start
+        mRecorder.finish("a1");
+        TS_ASSERT_EQUALS(mRecorder.waitForStarted(4), 4u);
+        TS_ASSERT(mRecorder.wasStarted("a3"));
+        TS_ASSERT(mRecorder.wasNotified("client", "a1"));
+    }
+
+    void testTotalLimit() {
+        std::tr1::shared_ptr<Transfer::SimpleTransferPool> pool =
+            mMediator->registerClient<Transfer::SimpleTransferPool>("client");
+
+        // Each host is under its own limit, but only 3 can be outstanding
+        add(pool, "a1", "a", 0.9f);
+        add(pool, "a2", "a", 0.8f);
+        add(pool, "b1", "b", 0.7f);
+        add(pool, "b2", "b", 0.6f);
+
+        TS_ASSERT_EQUALS(mRecorder.waitForStarted(3), 3u);
+        TS_ASSERT_EQUALS(mRecorder.settle(), 3u);
+        TS_ASSERT(!mRecorder.wasStarted("b2"));
+
+        // A slot freed by any host goes to the best waiting request
+        mRecorder.finish("a2");
+        TS_ASSERT_EQUALS(mRecorder.waitForStarted(4), 4u);
+        TS_ASSERT(mRecorder.wasStarted("b2"));
+    }
+
+    void testMergesSameIdentifier() {
+        std::tr1::shared_ptr<Transfer::SimpleTransferPool> pool1 =
+            mMediator->registerClient<Transfer::SimpleTransferPool>("client1");
+        std::tr1::shared_ptr<Transfer::SimpleTransferPool> pool2 =
+            mMediator->registerClient<Transfer::SimpleTransferPool>("client2");
+
+        add(pool1, "x", "a", 0.5f);
+        add(pool2, "x", "a", 0.5f);
+        // A pool's requests are handled in order, so once the marker has
+        // started client2's request for x has been merged in, whether or not
+        // x was already running
+        add(pool2, "marker", "m", 0.1f);
+
+        TS_ASSERT_EQUALS(mRecorder.waitForStarted(2), 2u);
+        TS_ASSERT(mRecorder.wasStarted("marker"));
+        TS_ASSERT_EQUALS(mRecorder.settle(), 2u);
+        TS_ASSERT_EQUALS(mRecorder.timesStarted("x"), 1u);
+
+        // One fetch notifies both clients
+        mRecorder.finish("x");
+        TS_ASSERT(mRecorder.wasNotified("client1", "x"));
+        TS_ASSERT(mRecorder.wasNotified("client2", "x"));
+        TS_ASSERT(!mRecorder.wasNotified("client2", "marker"));
+    }
+};
@@ -0,0 +1,410 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+#include "StorageTestBase.hpp"
+#include <sirikata/oh/CachedStorage.hpp>
+#include <sirikata/oh/ObjectHostContext.hpp>
+
+// Runs the standard storage tests through the write-back cache, backed by
+// SQLite. Values written in one test are read back in later ones by a new
+// storage instance, so these also check that writes held in the cache make it
+// to the backend.
+class CachedStorageTest : public CxxTest::TestSuite
+{
+    static const Sirikata::String dbfile;
+    StorageTestBase _base;
+public:
+    CachedStorageTest()
+     : _base("oh-sqlite", "cached", Sirikata::String("--backend=sqlite --backend-options=--db=") + dbfile + " --max-entries=256 --max-dirty=16 --flush-interval=10ms")
+    {
+    }
+
+    void setUp() {_base.setUp(); }
+    void tearDown() {_base.tearDown(); }
+
+    void testSetupTeardown() {_base.testSetupTeardown(); }
+    void testSingleWrite() {_base.testSingleWrite(); }
+    void testSingleRead() {_base.testSingleRead(); }
+    void testSingleInvalidRead() {_base.testSingleInvalidRead(); }
+    void testSingleCompare() {_base.testSingleCompare(); }
+    void testSingleInvalidCompare() {_base.testSingleInvalidCompare(); }
+    void testSingleErase() {_base.testSingleErase(); }
+
+    void testMultiWrite() {_base.testMultiWrite(); }
+    void testMultiRead() {_base.testMultiRead(); }
+    void testMultiInvalidRead() {_base.testMultiInvalidRead(); }
+    void testMultiSomeInvalidRead() {_base.testMultiSomeInvalidRead(); }
+    void testMultiErase() {_base.testMultiErase(); }
+
+    void testAtomicWrite() {_base.testAtomicWrite(); }
+    void testAtomicWriteErase() {_base.testAtomicWriteErase(); }
+
+    void testRangeRead() {_base.testRangeRead(); }
+    void testCount() {_base.testCount(); }
+    void testRangeErase() {_base.testRangeErase(); }
+
+    void testAllTransaction() {_base.testAllTransaction(); }
+
+    void testRollback() {_base.testRollback(); }
+};
+
+const Sirikata::String CachedStorageTest::dbfile("test-cached.db");
+
+
+// In-memory backend for checking what the cache sends on. Transactions are
+// applied when they're committed, but their callbacks are held until
+// complete() so tests control when results arrive.
+class CachedStorageTestBackend : public Sirikata::OH::Storage
+{
+public:
+    typedef std::vector<Sirikata::String> Ops;
+
+    // Values in the single bucket the tests use
+    std::map<Key, Sirikata::String> data;
+    // Every transaction committed, as a list of operations
+    std::vector<Ops> commits;
+    // Number of releaseBucket calls
+    int releases;
+    // Result to give commits instead of applying them, e.g. LOCK_ERROR
+    Result failWith;
+
+    CachedStorageTestBackend()
+     : releases(0), failWith(SUCCESS)
+    {}
+
+    virtual ~CachedStorageTestBackend() {
+        for(Sirikata::uint32 i = 0; i < mPending.size(); i++)
+            delete mPending[i].rs;
+    }
+
+    virtual void leaseBucket(const Bucket& bucket) {}
+    virtual void releaseBucket(const Bucket& bucket) { releases++; }
+
+    virtual void beginTransaction(const Bucket& bucket) { mOps.clear(); }
+
+    virtual void commitTransaction(const Bucket& bucket, const CommitCallback& cb = 0, const Sirikata::String& timestamp="current") {
+        commits.push_back(Ops());
+        for(Sirikata::uint32 i = 0; i < mOps.size(); i++)
+            commits.back().push_back(mOps[i].type + " " + mOps[i].key);
+
+        Pending pending;
+        pending.cb = cb;
+        pending.result = failWith;
+        pending.rs = NULL;
+        if (failWith == SUCCESS) {
+            for(Sirikata::uint32 i = 0; i < mOps.size(); i++) {
+                const Op& op = mOps[i];
+                if ((op.type == "read" || op.type == "compare") &&
+                    (data.find(op.key) == data.end() || (op.type == "compare" && data[op.key] != op.value)))
+                    pending.result = TRANSACTION_ERROR;
+            }
+        }
+        if (pending.result == SUCCESS) {
+            for(Sirikata::uint32 i = 0; i < mOps.size(); i++) {
+                const Op& op = mOps[i];
+                if (op.type == "read") {
+                    if (pending.rs == NULL) pending.rs = new ReadSet();
+                    (*pending.rs)[op.key] = data[op.key];
+                }
+                else if (op.type == "write") {
+                    data[op.key] = op.value;
+                }
+                else if (op.type == "erase") {
+                    data.erase(op.key);
+                }
+            }
+        }
+        mOps.clear();
+        mPending.push_back(pending);
+    }
+
+    virtual bool erase(const Bucket& bucket, const Key& key, const CommitCallback& cb = 0, const Sirikata::String& timestamp="current") {
+        return addOp("erase", key);
+    }
+    virtual bool write(const Bucket& bucket, const Key& key, const Sirikata::String& value, const CommitCallback& cb = 0, const Sirikata::String& timestamp="current") {
+        return addOp("write", key, value);
+    }
+    virtual bool read(const Bucket& bucket, const Key& key, const CommitCallback& cb = 0, const Sirikata::String& timestamp="current") {
+        return addOp("read", key);
+    }
+    virtual bool compare(const Bucket& bucket, const Key& key, const Sirikata::String& value, const CommitCallback& cb = 0, const Sirikata::String& timestamp="current") {
+        return addOp("compare", key, value);
+    }
+    virtual bool rangeRead(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb = 0, const Sirikata::String& timestamp="current") {
+        return addOp("rangeRead", start);
+    }
+    virtual bool rangeErase(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb = 0, const Sirikata::String& timestamp="current") {
+        return addOp("rangeErase", start);
+    }
+    virtual bool count(const Bucket& bucket, const Key& start, const Key& finish, const CountCallback& cb = 0, const Sirikata::String& timestamp="current") {
+        return false;
+    }
+
+    // Delivers results for everything committed so far, returning how many
+    // there were
+    Sirikata::uint32 complete() {
+        std::vector<Pending> pending;
+        pending.swap(mPending);
+        for(Sirikata::uint32 i = 0; i < pending.size(); i++) {
+            if (pending[i].cb)
+                pending[i].cb(pending[i].result, pending[i].rs);
+            else
+                delete pending[i].rs;
+        }
+        return pending.size();
+    }
+
+private:
+    struct Op {
+        Sirikata::String type;
+        Key key;
+        Sirikata::String value;
+    };
+    struct Pending {
+        CommitCallback cb;
+        Result result;
+        ReadSet* rs;
+    };
+
+    bool addOp(const Sirikata::String& type, const Key& key, const Sirikata::String& value = "") {
+        Op op;
+        op.type = type;
+        op.key = key;
+        op.value = value;
+        mOps.push_back(op);
+        return true;
+    }
+
+    std::vector<Op> mOps;
+    std::vector<Pending> mPending;
+};
+
+// Checks the cache's own behavior against the backend above. Nothing runs the
+// event loop in other threads, settle() drives it from the test thread.
+class CachedStorageBehaviorTest : public CxxTest::TestSuite
+{
+    typedef Sirikata::OH::Storage Storage;
+    typedef Sirikata::OH::CachedStorage CachedStorage;
+
+    static const Storage::Bucket _bucket;
+
+    Sirikata::Trace::Trace* _trace;
+    Sirikata::Network::IOService* _ios;
+    Sirikata::Network::IOStrand* _mainStrand;
+    Sirikata::Network::IOWork* _work;
+    Sirikata::ObjectHostContext* _ctx;
+
+    CachedStorageTestBackend* _backend;
+    CachedStorage* _storage;
+
+    // Results of the last transaction through the cache
+    int _results;
+    Storage::Result _result;
+    Storage::ReadSet _readSet;
+
+public:
+    void setUp() {
+        _trace = new Sirikata::Trace::Trace("dummy.trace");
+        _ios = new Sirikata::Network::IOService("CachedStorageTest");
+        _mainStrand = _ios->createStrand("CachedStorageTest");
+        _work = new Sirikata::Network::IOWork(*_ios, "CachedStorageTest");
+        _ctx = new Sirikata::ObjectHostContext("test", Sirikata::ObjectHostID(1), NULL, NULL, _ios, _mainStrand, _trace, Sirikata::Timer::now());
+
+        // Flushes only happen when 3 writes build up or on release, the timer
+        // never goes off during a test
+        _backend = new CachedStorageTestBackend();
+        _storage = new CachedStorage(_ctx, _backend, 16, 3, Sirikata::Duration::seconds(3600));
+        _storage->start();
+        _storage->leaseBucket(_bucket);
+
+        _results = 0;
+    }
+
+    void tearDown() {
+        _storage->stop();
+        delete _storage;
+        _storage = NULL;
+        _backend = NULL;
+
+        delete _work;
+        _work = NULL;
+
+        _trace->prepareShutdown();
+        delete _ctx;
+        _ctx = NULL;
+        _trace->shutdown();
+        delete _trace;
+        _trace = NULL;
+
+        delete _mainStrand;
+        _mainStrand = NULL;
+        delete _ios;
+        _ios = NULL;
+    }
+
+    void handleResult(Storage::Result result, Storage::ReadSet* rs) {
+        _results++;
+        _result = result;
+        _readSet.clear();
+        if (rs != NULL) _readSet = *rs;
+        delete rs;
+    }
+
+    // Delivers backend results and runs anything posted until nothing is left
+    void settle() {
+        while(_backend->complete() + _ios->poll() > 0) {}
+    }
+
+    Storage::CommitCallback callback() {
+        return std::tr1::bind(&CachedStorageBehaviorTest::handleResult, this, std::tr1::placeholders::_1, std::tr1::placeholders::_2);
+    }
+
+    void write(const Sirikata::String& key, const Sirikata::String& value) {
+        _storage->write(_bucket, key, value, callback());
+        settle();
+        TS_ASSERT_EQUALS(_result, Storage::SUCCESS);
+    }
+
+    void read(const Sirikata::String& key) {
+        _storage->read(_bucket, key, callback());
+        settle();
+    }
+
+    void testReadsAnsweredAfterConfirm() {
+        _backend->data["a"] = "1";
+
+        // Until a backend commit succeeds we don't know the lease is ours
+        read("a");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 1u);
+        TS_ASSERT_EQUALS(_result, Storage::SUCCESS);
+        TS_ASSERT_EQUALS(_readSet["a"], "1");
+
+        read("a");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 1u);
+        TS_ASSERT_EQUALS(_result, Storage::SUCCESS);
+        TS_ASSERT_EQUALS(_readSet["a"], "1");
+
+        // Uncached and missing keys go to the backend
+        read("b");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 2u);
+        TS_ASSERT_EQUALS(_result, Storage::TRANSACTION_ERROR);
+        // and we remember that they're missing
+        read("b");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 2u);
+        TS_ASSERT_EQUALS(_result, Storage::TRANSACTION_ERROR);
+
+        CachedStorage::Stats st = _storage->stats();
+        TS_ASSERT_EQUALS(st.hits, 2u);
+        TS_ASSERT_EQUALS(st.misses, 2u);
+        TS_ASSERT_EQUALS(st.localCommits, 2u);
+        TS_ASSERT_EQUALS(st.backendCommits, 2u);
+        TS_ASSERT_EQUALS(_results, 4);
+    }
+
+    void testWritesBufferedUntilMaxDirty() {
+        write("a", "1");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 1u);
+
+        write("b", "2");
+        write("c", "3");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 1u);
+        TS_ASSERT(_backend->data.find("b") == _backend->data.end());
+
+        // The third write fills the dirty limit and they all go out together
+        write("d", "4");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 2u);
+        TS_ASSERT_EQUALS(_backend->commits.back().size(), 3u);
+        TS_ASSERT_EQUALS(_backend->data["b"], "2");
+        TS_ASSERT_EQUALS(_backend->data["d"], "4");
+
+        CachedStorage::Stats st = _storage->stats();
+        TS_ASSERT_EQUALS(st.flushes, 1u);
+        TS_ASSERT_EQUALS(st.flushedKeys, 3u);
+    }
+
+    void testReleaseFlushes() {
+        write("a", "1");
+        write("b", "2");
+        TS_ASSERT(_backend->data.find("b") == _backend->data.end());
+
+        // The release has to wait for the write back to finish
+        _storage->releaseBucket(_bucket);
+        TS_ASSERT_EQUALS(_backend->commits.size(), 2u);
+        TS_ASSERT_EQUALS(_backend->data["b"], "2");
+        TS_ASSERT_EQUALS(_backend->releases, 0);
+        settle();
+        TS_ASSERT_EQUALS(_backend->releases, 1);
+
+        // Once released nothing is answered from memory
+        read("b");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 3u);
+        TS_ASSERT_EQUALS(_readSet["b"], "2");
+    }
+
+    void testLockErrorDropsCache() {
+        _backend->data["a"] = "1";
+        read("a");
+        write("b", "2");
+        write("c", "3");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 1u);
+
+        // The write back finds the lease gone
+        _backend->failWith = Storage::LOCK_ERROR;
+        _storage->write(_bucket, "d", "4", callback());
+        TS_ASSERT_EQUALS(_backend->commits.size(), 2u);
+        settle();
+        _backend->failWith = Storage::SUCCESS;
+        _backend->data["a"] = "changed";
+
+        // The writes are given up rather than retried over someone else's
+        settle();
+        TS_ASSERT_EQUALS(_backend->commits.size(), 2u);
+        TS_ASSERT_EQUALS(_storage->stats().flushFailures, 1u);
+
+        // and nothing is answered from memory until a commit succeeds again
+        read("a");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 3u);
+        TS_ASSERT_EQUALS(_readSet["a"], "changed");
+        read("b");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 4u);
+        TS_ASSERT_EQUALS(_result, Storage::TRANSACTION_ERROR);
+        read("a");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 4u);
+
+        // Nothing is left to flush, so the release goes straight through
+        _storage->releaseBucket(_bucket);
+        TS_ASSERT_EQUALS(_backend->releases, 1);
+    }
+
+    void testReadAfterPassThrough() {
+        _backend->data["a"] = "1";
+        _backend->data["x"] = "x";
+        read("a");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 1u);
+
+        // Reading an uncached key sends the transaction through, including its
+        // write
+        _storage->beginTransaction(_bucket);
+        _storage->read(_bucket, "x");
+        _storage->write(_bucket, "a", "2");
+        _storage->commitTransaction(_bucket, callback());
+        TS_ASSERT_EQUALS(_backend->commits.size(), 2u);
+
+        // Before it completes, the cache would still say "1"
+        _storage->read(_bucket, "a", callback());
+        TS_ASSERT_EQUALS(_backend->commits.size(), 3u);
+        settle();
+        TS_ASSERT_EQUALS(_results, 3);
+        TS_ASSERT_EQUALS(_result, Storage::SUCCESS);
+        TS_ASSERT_EQUALS(_readSet["a"], "2");
+
+        // and after, it knows the new value
+        read("a");
+        TS_ASSERT_EQUALS(_backend->commits.size(), 3u);
+        TS_ASSERT_EQUALS(_readSet["a"], "2");
+    }
+};
+
+const Sirikata::OH::Storage::Bucket CachedStorageBehaviorTest::_bucket("72a537a6-c18f-48fe-a97d-90b40727062e", Sirikata::OH::Storage::Bucket::HumanReadable());
@@ -0,0 +1,259 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/oh/ObjectHost.hpp>
+#include <sirikata/oh/ObjectHostContext.hpp>
+#include <sirikata/oh/HostedObject.hpp>
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <sirikata/core/network/ObjectMessage.hpp>
+#include <sirikata/core/transfer/TransferMediator.hpp>
+#include <sirikata/core/trace/Trace.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
+#include <sirikata/core/util/Timer.hpp>
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+
+#define TEST_PORT 20
+
+namespace Sirikata {
+// Delivers messages to objects as if they came from a SessionManager. A
+// friend of ObjectHost.
+class ObjectHostTestAccess {
+public:
+    static void deliver(ObjectHost* oh, const SpaceObjectReference& sporef, Sirikata::Protocol::Object::ObjectMessage* msg) {
+        oh->handleObjectMessage(sporef, sporef.space(), msg);
+    }
+};
+} // namespace Sirikata
+
+using namespace Sirikata;
+
+class ObjectHostTest : public CxxTest::TestSuite {
+    class TestObjectHost : public ObjectHost {
+    public:
+        TestObjectHost(ObjectHostContext* ctx, uint32 num_strands)
+         : ObjectHost(ctx, ctx->ioService, "--objectStrands=" + boost::lexical_cast<String>(num_strands))
+        {}
+
+        virtual const String& defaultScriptType() const { return mEmpty; }
+        virtual const String& defaultScriptOptions() const { return mEmpty; }
+        virtual const String& defaultScriptContents() const { return mEmpty; }
+
+    private:
+        String mEmpty;
+    };
+
+    struct Object {
+        Object()
+         : port(NULL), received(0), outOfOrder(0), overlapping(0)
+        {}
+        HostedObjectPtr ho;
+        SpaceObjectReference sporef;
+        ODP::Port* port;
+        // Held while handling a message, to catch two threads handling the
+        // object's messages at once
+        boost::mutex handling;
+        uint32 received;
+        uint32 outOfOrder;
+        uint32 overlapping;
+    };
+
+    Trace::Trace* mTrace;
+    Network::IOService* mIOService;
+    Network::IOStrand* mMainStrand;
+    ObjectHostContext* mContext;
+    TestObjectHost* mObjectHost;
+    SpaceID mSpace;
+    std::vector<Object*> mObjects;
+
+    void createObjects(uint32 num_strands, uint32 count) {
+        using std::tr1::placeholders::_1;
+        using std::tr1::placeholders::_2;
+        using std::tr1::placeholders::_3;
+
+        mObjectHost = new TestObjectHost(mContext, num_strands);
+        for(uint32 i = 0; i < count; i++) {
+            Object* obj = new Object();
+            UUID id = UUID::random();
+            obj->ho = mObjectHost->createObject(id, "", "", "");
+            obj->sporef = SpaceObjectReference(mSpace, ObjectReference(id));
+            mObjectHost->registerHostedObject(obj->sporef, obj->ho);
+            obj->port = obj->ho->bindODPPort(obj->sporef, TEST_PORT);
+            obj->port->receive(std::tr1::bind(&ObjectHostTest::handleMessage, this, obj, _1, _2, _3));
+            mObjects.push_back(obj);
+        }
+    }
+
+    void handleMessage(Object* obj, const ODP::Endpoint& src, const ODP::Endpoint& dst, MemoryReference payload) {
+        boost::unique_lock<boost::mutex> lock(obj->handling, boost::try_to_lock);
+        if (!lock.owns_lock())
+            obj->overlapping++;
+
+        // Payloads are sequence numbers, so messages have to arrive in order
+        uint32 seqno = boost::lexical_cast<uint32>(String((const char*)payload.data(), payload.size()));
+        if (seqno != obj->received)
+            obj->outOfOrder++;
+        obj->received++;
+
+        // Give other threads a chance to (wrongly) pick up the object's next
+        // message
+        boost::this_thread::yield();
+    }
+
+    void deliver(Object* obj, uint32 seqno) {
+        UUID id = obj->sporef.object().getAsUUID();
+        ObjectHostTestAccess::deliver(
+            mObjectHost, obj->sporef,
+            createObjectMessage(0, id, TEST_PORT, id, TEST_PORT, boost::lexical_cast<String>(seqno))
+        );
+    }
+
+    // Runs the IOService on several threads until it runs out of work
+    void run(uint32 num_threads) {
+        std::vector<boost::thread*> threads;
+        for(uint32 i = 0; i < num_threads; i++)
+            threads.push_back(new boost::thread(std::tr1::bind(&Network::IOService::runNoReturn, mIOService)));
+        for(uint32 i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+    }
+
+    // Registers presences for the objects under made up spaces and checks
+    // lookups by presence and by ID see them. Lookups that return the wrong
+    // object are counted in errors.
+    void registerPresences(uint32 iterations, AtomicValue<uint32>* errors) {
+        for(uint32 i = 0; i < iterations; i++) {
+            Object* obj = mObjects[i % mObjects.size()];
+            SpaceObjectReference sporef(SpaceID(UUID::random()), obj->sporef.object());
+            mObjectHost->registerHostedObject(sporef, obj->ho);
+            if (mObjectHost->getHostedObject(sporef) != obj->ho)
+                ++(*errors);
+            if (mObjectHost->getHostedObject(obj->ho->id()) != obj->ho)
+                ++(*errors);
+            mObjectHost->unregisterHostedObject(sporef, obj->ho.get());
+            if (mObjectHost->getHostedObject(sporef))
+                ++(*errors);
+        }
+    }
+
+    // Creates and destroys objects, which adds to and removes from the map of
+    // objects by ID
+    void createAndDestroy(uint32 iterations, AtomicValue<uint32>* errors) {
+        for(uint32 i = 0; i < iterations; i++) {
+            UUID id = UUID::random();
+            HostedObjectPtr ho = mObjectHost->createObject(id, "", "", "");
+            if (mObjectHost->getHostedObject(id) != ho)
+                ++(*errors);
+            ho->destroy();
+        }
+    }
+
+public:
+    void setUp() {
+        mTrace = new Trace::Trace("ObjectHostTest.trace");
+        mIOService = new Network::IOService("ObjectHostTest");
+        mMainStrand = mIOService->createStrand("ObjectHostTest Main");
+        mContext = new ObjectHostContext("ObjectHostTest", ObjectHostID(1), NULL, NULL, mIOService, mMainStrand, mTrace, Timer::now());
+        mObjectHost = NULL;
+        mSpace = SpaceID(UUID::random());
+    }
+
+    void tearDown() {
+        for(uint32 i = 0; i < mObjects.size(); i++) {
+            Object* obj = mObjects[i];
+            delete obj->port;
+            mObjectHost->unregisterHostedObject(obj->sporef, obj->ho.get());
+            obj->ho->destroy();
+            delete obj;
+        }
+        mObjects.clear();
+
+        delete mObjectHost;
+        mObjectHost = NULL;
+        // Each ObjectHost registers a transfer pool under the same name
+        Transfer::TransferMediator::getSingleton().cleanup();
+        Transfer::TransferMediator::destroy();
+
+        mTrace->prepareShutdown();
+        delete mContext;
+        mTrace->shutdown();
+        delete mTrace;
+        delete mMainStrand;
+        delete mIOService;
+    }
+
+    void testObjectsRunOnTheirStrands() {
+        const uint32 NUM_STRANDS = 4;
+        const uint32 NUM_MESSAGES = 20;
+        createObjects(NUM_STRANDS, 64);
+
+        std::set<Network::IOStrand*> strands;
+        for(uint32 i = 0; i < mObjects.size(); i++) {
+            HostedObjectPtr ho = mObjects[i]->ho;
+            TS_ASSERT_EQUALS(ho->strand(), mObjectHost->objectStrand(ho->id()));
+            TS_ASSERT_DIFFERS(ho->strand(), mMainStrand);
+            strands.insert(ho->strand());
+        }
+        TS_ASSERT_EQUALS(strands.size(), NUM_STRANDS);
+
+        // The test stands in for the main strand. Messages are handed to each
+        // object's strand rather than handled right away.
+        for(uint32 seqno = 0; seqno < NUM_MESSAGES; seqno++) {
+            for(uint32 i = 0; i < mObjects.size(); i++)
+                deliver(mObjects[i], seqno);
+        }
+        for(uint32 i = 0; i < mObjects.size(); i++)
+            TS_ASSERT_EQUALS(mObjects[i]->received, 0u);
+
+        // With more threads than strands, each object still handles its
+        // messages one at a time and in order
+        run(NUM_STRANDS + 2);
+        for(uint32 i = 0; i < mObjects.size(); i++) {
+            TS_ASSERT_EQUALS(mObjects[i]->received, NUM_MESSAGES);
+            TS_ASSERT_EQUALS(mObjects[i]->outOfOrder, 0u);
+            TS_ASSERT_EQUALS(mObjects[i]->overlapping, 0u);
+        }
+    }
+
+    void testMainStrandDeliversDirectly() {
+        // Without object strands, messages are handled on the main strand as
+        // soon as they arrive
+        createObjects(0, 4);
+        TS_ASSERT_EQUALS(mObjectHost->numObjectStrands(), 0u);
+        for(uint32 i = 0; i < mObjects.size(); i++) {
+            TS_ASSERT_EQUALS(mObjects[i]->ho->strand(), mMainStrand);
+            deliver(mObjects[i], 0);
+            TS_ASSERT_EQUALS(mObjects[i]->received, 1u);
+        }
+    }
+
+    void testHostedObjectMapsShared() {
+        // Objects register presences and are created and destroyed from their
+        // own strands, so the ObjectHost's maps are used from many threads
+        createObjects(4, 8);
+
+        const uint32 NUM_THREADS = 4;
+        const uint32 ITERATIONS = 2000;
+        AtomicValue<uint32> errors(0);
+        std::vector<boost::thread*> threads;
+        for(uint32 i = 0; i < NUM_THREADS; i++)
+            threads.push_back(new boost::thread(std::tr1::bind(&ObjectHostTest::registerPresences, this, ITERATIONS, &errors)));
+        threads.push_back(new boost::thread(std::tr1::bind(&ObjectHostTest::createAndDestroy, this, ITERATIONS / 4, &errors)));
+        for(uint32 i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+        TS_ASSERT_EQUALS(errors.read(), 0u);
+
+        // The original registrations are untouched
+        for(uint32 i = 0; i < mObjects.size(); i++) {
+            TS_ASSERT_EQUALS(mObjectHost->getHostedObject(mObjects[i]->sporef), mObjects[i]->ho);
+            TS_ASSERT_EQUALS(mObjectHost->getHostedObject(mObjects[i]->ho->id()), mObjects[i]->ho);
+        }
+    }
+};
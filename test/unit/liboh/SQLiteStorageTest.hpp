@@ -75,3 +75,26 @@ public:
 };
 
 const Sirikata::String SQLiteStorageTest::dbfile("test.db");
+
+// Same storage with write-ahead logging and a group commit delay, checking
+// that those settings still give correct results.
+class SQLiteWALStorageTest : public CxxTest::TestSuite
+{
+    static const Sirikata::String dbfile;
+    StorageTestBase _base;
+public:
+    SQLiteWALStorageTest()
+     : _base("oh-sqlite", "sqlite", Sirikata::String("--db=") + dbfile + " --journal-mode=wal --synchronous=normal --group-commit-delay=5ms --mmap-size=67108864")
+    {
+    }
+
+    void setUp() {_base.setUp(); }
+    void tearDown() {_base.tearDown(); }
+
+    void testSingleWrite() {_base.testSingleWrite(); }
+    void testSingleRead() {_base.testSingleRead(); }
+    void testAtomicWrite() {_base.testAtomicWrite(); }
+    void testRollback() {_base.testRollback(); }
+};
+
+const Sirikata::String SQLiteWALStorageTest::dbfile("test-wal.db");
@@ -55,6 +55,34 @@ public:
         _base.testMultiRounds("10", 10, 10, 5, StressTestBase::Throughput);
     }
 
+    //(transactionNum, bucketNum, failEvery)
+    void testConcurrentTransactions() {
+        _base.testConcurrentTransactions(2000, 2, 50);
+    }
+
 };
 
 const Sirikata::String SQLiteStressTest::dbfile("test.db");
+
+// Same storage with write-ahead logging and a group commit delay
+class SQLiteWALStressTest : public CxxTest::TestSuite
+{
+    static const Sirikata::String dbfile;
+    StressTestBase _base;
+public:
+    SQLiteWALStressTest()
+     : _base("oh-sqlite", "sqlite", Sirikata::String("--db=") + dbfile + " --journal-mode=wal --synchronous=normal --group-commit-delay=5ms --mmap-size=67108864")
+    {
+    }
+
+    void setUp() {_base.setUp(); }
+    void tearDown() {_base.tearDown(); }
+
+    //(transactionNum, bucketNum, failEvery)
+    void testConcurrentTransactions() {
+        _base.testConcurrentTransactions(2000, 2, 50);
+    }
+
+};
+
+const Sirikata::String SQLiteWALStressTest::dbfile("test-wal.db");
@@ -41,6 +41,7 @@
 #include <sirikata/core/network/IOWork.hpp>
 #include <sirikata/core/odp/SST.hpp>
 #include <sirikata/core/ohdp/SST.hpp>
+#include <boost/lexical_cast.hpp>
 
 class StressTestBase {
 public:
@@ -204,6 +205,14 @@ public:
             _cond.notify_one();
     }
 
+    void checkCount(Result expected_result, Sirikata::int32 expected_count, Result result, Sirikata::int32 count) {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        TS_ASSERT_EQUALS(expected_result, result);
+        TS_ASSERT_EQUALS(expected_count, count);
+        if (--_outstanding == 0)
+            _cond.notify_one();
+    }
+
     void waitForTransaction(boost::unique_lock<boost::mutex>& lock) {
         _cond.wait(lock);
     }
@@ -410,6 +419,61 @@ public:
     }
 
 
+    // Lots of small, independent transactions in flight at once, like
+    // scripts saving their state every tick. Every failEvery'th one fails (a
+    // read of a missing key), which shouldn't affect the others even if the
+    // storage commits them together.
+    void testConcurrentTransactions(int transactionNum, int bucketNum, int failEvery) {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+
+        using std::tr1::placeholders::_1;
+        using std::tr1::placeholders::_2;
+
+        std::vector<int> expected_count(bucketNum, 0);
+
+        Sirikata::Time start = Sirikata::Timer::now();
+
+        for(int i = 0; i < transactionNum; i++) {
+            int b = i % bucketNum;
+            if (i % failEvery == failEvery-1) {
+                _storage->read(_buckets[b], "concurrent:missing",
+                    std::tr1::bind(&StressTestBase::checkSuccess, this, Sirikata::OH::Storage::TRANSACTION_ERROR, ReadSet(), _1, _2)
+                );
+            }
+            else {
+                Sirikata::String key = "concurrent:" + boost::lexical_cast<Sirikata::String>(i);
+                _storage->write(_buckets[b], key, key,
+                    std::tr1::bind(&StressTestBase::checkSuccess, this, Sirikata::OH::Storage::SUCCESS, ReadSet(), _1, _2)
+                );
+                expected_count[b]++;
+            }
+            ++_outstanding;
+        }
+        while(_outstanding > 0)
+            waitForTransaction(lock);
+
+        Sirikata::Time end = Sirikata::Timer::now();
+        reportTiming("Concurrent transaction time", start, end, Throughput, transactionNum);
+
+        // All the writes should have made it
+        for(int b = 0; b < bucketNum; b++) {
+            _storage->count(_buckets[b], "concurrent:", "concurrent:@",
+                std::tr1::bind(&StressTestBase::checkCount, this, Sirikata::OH::Storage::SUCCESS, expected_count[b], _1, _2)
+            );
+            ++_outstanding;
+            waitForTransaction(lock);
+        }
+
+        // Clean up so reruns against the same database start fresh
+        for(int b = 0; b < bucketNum; b++) {
+            _storage->rangeErase(_buckets[b], "concurrent:", "concurrent:@",
+                std::tr1::bind(&StressTestBase::checkSuccess, this, Sirikata::OH::Storage::SUCCESS, ReadSet(), _1, _2)
+            );
+            ++_outstanding;
+            waitForTransaction(lock);
+        }
+    }
+
   void testMultiRounds(Sirikata::String length, int keyNum, int bucketNum, int times, TestType tt) {
 
       if (tt == Latency)
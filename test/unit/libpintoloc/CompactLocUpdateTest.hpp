@@ -0,0 +1,315 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/pintoloc/ProtocolLocUpdate.hpp>
+#include <sirikata/pintoloc/TimeSynced.hpp>
+#include <cmath>
+
+using namespace Sirikata;
+
+class CompactLocUpdateTest : public CxxTest::TestSuite {
+    // Deterministic pseudo-random values
+    uint32 mRand;
+
+    float32 random(float32 lo, float32 hi) {
+        mRand = mRand * 1103515245u + 12345u;
+        return lo + (hi - lo) * ((mRand >> 8) / (float32)(1 << 24));
+    }
+
+    static Time at(int64 us) {
+        return Time::null() + Duration::microseconds(us);
+    }
+
+    static CompactLocationUpdate makeUpdate(uint32 id, uint32 fields) {
+        CompactLocationUpdate update;
+        update.object = UUID(id);
+        update.seqno = 1000 + id;
+        update.fields = fields;
+        update.location = TimedMotionVector3f(at(1000000), MotionVector3f(Vector3f::zero(), Vector3f::zero()));
+        update.orientation = TimedMotionQuaternion(at(1000000), MotionQuaternion(Quaternion::identity(), Quaternion::identity()));
+        return update;
+    }
+
+    // Encodes updates into a single message and parses it back
+    static void roundTrip(const std::vector<CompactLocationUpdate>& in, const Vector3f& origin, float32 pos_res, float32 vel_res, CompactBulkLocationUpdate* out) {
+        CompactLocUpdateEncoder encoder(origin, pos_res, vel_res);
+        for(uint32 i = 0; i < in.size(); i++)
+            encoder.add(in[i]);
+        TS_ASSERT_EQUALS(encoder.size(), in.size());
+
+        String serialized = encoder.serialize();
+        TS_ASSERT(CompactBulkLocationUpdate::isCompact(serialized));
+        TS_ASSERT(out->ParseFromString(serialized));
+        TS_ASSERT_EQUALS(out->update_size(), (int32)in.size());
+    }
+
+    static float64 quatDot(const Quaternion& a, const Quaternion& b) {
+        return (float64)a.x*b.x + (float64)a.y*b.y + (float64)a.z*b.z + (float64)a.w*b.w;
+    }
+
+    static bool sameBits(float32 a, float32 b) {
+        return memcmp(&a, &b, sizeof(float32)) == 0;
+    }
+
+    String validMessage() {
+        std::vector<CompactLocationUpdate> in;
+        for(uint32 i = 0; i < 4; i++) {
+            CompactLocationUpdate update = makeUpdate(i + 1,
+                CompactLocationUpdate::Epoch | CompactLocationUpdate::Location |
+                CompactLocationUpdate::Orientation | CompactLocationUpdate::Bounds |
+                CompactLocationUpdate::Mesh | CompactLocationUpdate::IndexIDs
+            );
+            update.epoch = 5;
+            update.location = TimedMotionVector3f(at(1000000 + i), MotionVector3f(Vector3f(i, 2.f*i, 0), Vector3f(1, 0, 0)));
+            update.mesh = "meerkat:///test/mesh.dae";
+            update.index_ids.push_back(i);
+            in.push_back(update);
+        }
+        // One raw location so the fallback's framing is covered too
+        in[3].location = TimedMotionVector3f(at(1000000), MotionVector3f(Vector3f(1e30f, 0, 0), Vector3f::zero()));
+
+        CompactLocUpdateEncoder encoder(Vector3f::zero(), 0.001f, 0.001f);
+        for(uint32 i = 0; i < in.size(); i++)
+            encoder.add(in[i]);
+        return encoder.serialize();
+    }
+
+public:
+    void setUp() {
+        mRand = 1;
+    }
+
+    void testQuantizationError() {
+        const Vector3f origin(1000.f, -2000.f, 50.f);
+        const float32 pos_res = 0.01f, vel_res = 0.001f;
+
+        std::vector<CompactLocationUpdate> in;
+        for(uint32 i = 0; i < 500; i++) {
+            CompactLocationUpdate update = makeUpdate(i + 1, CompactLocationUpdate::Location);
+            Vector3f pos = origin + Vector3f(random(-500, 500), random(-500, 500), random(-500, 500));
+            Vector3f vel(random(-20, 20), random(-20, 20), random(-20, 20));
+            update.location = TimedMotionVector3f(at(1000000 + i * 997), MotionVector3f(pos, vel));
+            in.push_back(update);
+        }
+
+        CompactBulkLocationUpdate out;
+        roundTrip(in, origin, pos_res, vel_res, &out);
+        for(int32 i = 0; i < out.update_size(); i++) {
+            const CompactLocationUpdate& orig = in[i];
+            const CompactLocationUpdate& parsed = out.update(i);
+            TS_ASSERT_EQUALS(parsed.fields, (uint32)CompactLocationUpdate::Location);
+            TS_ASSERT(parsed.location.updateTime() == orig.location.updateTime());
+
+            // Half a step, plus rounding the result back to a float
+            for(int axis = 0; axis < 3; axis++) {
+                float32 p = orig.location.position()[axis];
+                TS_ASSERT_LESS_THAN_EQUALS(std::fabs(parsed.location.position()[axis] - p), pos_res * 0.5f + std::fabs(p) * 1e-6f);
+                float32 v = orig.location.velocity()[axis];
+                TS_ASSERT_LESS_THAN_EQUALS(std::fabs(parsed.location.velocity()[axis] - v), vel_res * 0.5f + std::fabs(v) * 1e-6f);
+            }
+        }
+    }
+
+    void testRawFallback() {
+        std::vector<CompactLocationUpdate> in;
+        // Too far from the origin to quantize
+        CompactLocationUpdate far_away = makeUpdate(1, CompactLocationUpdate::Location);
+        far_away.location = TimedMotionVector3f(at(1000000), MotionVector3f(Vector3f(1e30f, -3.25f, 0.1f), Vector3f(0.3f, 0, -1e25f)));
+        in.push_back(far_away);
+        // Not a number
+        CompactLocationUpdate nan = makeUpdate(2, CompactLocationUpdate::Location);
+        nan.location = TimedMotionVector3f(at(1000000), MotionVector3f(Vector3f(std::sqrt(-1.f), 0, 0), Vector3f::zero()));
+        in.push_back(nan);
+        // Orientations that aren't unit length can't be packed
+        CompactLocationUpdate zero_orient = makeUpdate(3, CompactLocationUpdate::Orientation);
+        zero_orient.orientation = TimedMotionQuaternion(at(1000000), MotionQuaternion(Quaternion(0, 0, 0, 0, Quaternion::XYZW()), Quaternion::identity()));
+        in.push_back(zero_orient);
+        CompactLocationUpdate long_orient = makeUpdate(4, CompactLocationUpdate::Orientation);
+        long_orient.orientation = TimedMotionQuaternion(at(1000000), MotionQuaternion(Quaternion(0.1f, 0.2f, 0.3f, 2.f, Quaternion::XYZW()), Quaternion::identity()));
+        in.push_back(long_orient);
+
+        CompactBulkLocationUpdate out;
+        roundTrip(in, Vector3f::zero(), 0.001f, 0.001f, &out);
+
+        // Raw values come back bit for bit, and the raw flags stay internal
+        for(int32 i = 0; i < 2; i++) {
+            TS_ASSERT_EQUALS(out.update(i).fields, (uint32)CompactLocationUpdate::Location);
+            for(int axis = 0; axis < 3; axis++) {
+                TS_ASSERT(sameBits(out.update(i).location.position()[axis], in[i].location.position()[axis]));
+                TS_ASSERT(sameBits(out.update(i).location.velocity()[axis], in[i].location.velocity()[axis]));
+            }
+        }
+        for(int32 i = 2; i < 4; i++) {
+            TS_ASSERT_EQUALS(out.update(i).fields, (uint32)CompactLocationUpdate::Orientation);
+            Quaternion orig = in[i].orientation.position(), parsed = out.update(i).orientation.position();
+            TS_ASSERT(sameBits(parsed.x, orig.x) && sameBits(parsed.y, orig.y) && sameBits(parsed.z, orig.z) && sameBits(parsed.w, orig.w));
+        }
+    }
+
+    void testQuaternionReconstruction() {
+        std::vector<CompactLocationUpdate> in;
+        // Each component in turn as the largest, with both signs, so every
+        // choice of dropped component is covered
+        for(uint32 largest = 0; largest < 4; largest++) {
+            for(int sign = -1; sign <= 1; sign += 2) {
+                float32 c[4] = { 0.1f, -0.2f, 0.15f, 0.05f };
+                c[largest] = 0.9f * sign;
+                Quaternion q(c[0], c[1], c[2], c[3], Quaternion::XYZW());
+                q = q / q.length();
+                CompactLocationUpdate update = makeUpdate(in.size() + 1, CompactLocationUpdate::Orientation);
+                update.orientation = TimedMotionQuaternion(at(1000000), MotionQuaternion(q, Quaternion::identity()));
+                in.push_back(update);
+            }
+        }
+        // Arbitrary rotations, with spinning velocities
+        for(uint32 i = 0; i < 200; i++) {
+            Vector3f axis(random(-1, 1), random(-1, 1), random(-1, 1));
+            if (axis.length() < 0.01f) axis = Vector3f(0, 1, 0);
+            Quaternion q(axis.normal(), random(-3.14159f, 3.14159f));
+            Quaternion vel = Quaternion(Vector3f(0, 0, 1), random(0.1f, 1.f)) * random(0.5f, 4.f);
+            CompactLocationUpdate update = makeUpdate(in.size() + 1, CompactLocationUpdate::Orientation);
+            update.orientation = TimedMotionQuaternion(at(1000000 - i), MotionQuaternion(q, vel));
+            in.push_back(update);
+        }
+
+        CompactBulkLocationUpdate out;
+        roundTrip(in, Vector3f::zero(), 0.001f, 0.001f, &out);
+        for(int32 i = 0; i < out.update_size(); i++) {
+            const TimedMotionQuaternion& orig = in[i].orientation;
+            const TimedMotionQuaternion& parsed = out.update(i).orientation;
+            TS_ASSERT(parsed.updateTime() == orig.updateTime());
+            // q and -q are the same rotation, so only the angle between them
+            // matters. 10 bits per component keeps it well under a degree.
+            TS_ASSERT_LESS_THAN_EQUALS(0.9999, std::fabs(quatDot(parsed.position(), orig.position())));
+            TS_ASSERT_DELTA(parsed.position().length(), 1.f, 1e-5f);
+            TS_ASSERT_DELTA(parsed.velocity().length(), orig.velocity().length(), 1e-4f * orig.velocity().length());
+            if (orig.velocity().length() > 0)
+                TS_ASSERT_LESS_THAN_EQUALS(0.9999, std::fabs(quatDot(parsed.velocity() / parsed.velocity().length(), orig.velocity() / orig.velocity().length())));
+        }
+
+        // The identity, the common case for objects that don't rotate, is
+        // exact
+        for(int32 i = 0; i < 8; i++) {
+            Quaternion vel = out.update(i).orientation.velocity();
+            TS_ASSERT(vel.x == 0 && vel.y == 0 && vel.z == 0 && vel.w == 1);
+        }
+    }
+
+    void testOtherFields() {
+        std::vector<CompactLocationUpdate> in;
+        CompactLocationUpdate all = makeUpdate(1,
+            CompactLocationUpdate::Epoch | CompactLocationUpdate::Parent |
+            CompactLocationUpdate::Bounds | CompactLocationUpdate::Mesh |
+            CompactLocationUpdate::Physics | CompactLocationUpdate::QueryData |
+            CompactLocationUpdate::IndexIDs
+        );
+        all.epoch = (uint64)1 << 40;
+        all.parent = UUID((uint32)77);
+        all.bounds = AggregateBoundingInfo(Vector3f(1.5f, -2.f, 3.f), 4.25f, 5.5f);
+        all.mesh = "meerkat:///test/mesh.dae";
+        all.physics = String("{\"treatment\":\"static\"}");
+        all.query_data = String("with\0nul", 8);
+        all.index_ids.push_back(0);
+        all.index_ids.push_back(300);
+        all.index_ids.push_back(1 << 20);
+        in.push_back(all);
+        // Nothing but the object
+        in.push_back(makeUpdate(2, 0));
+
+        CompactBulkLocationUpdate out;
+        roundTrip(in, Vector3f::zero(), 0.001f, 0.001f, &out);
+
+        const CompactLocationUpdate& parsed = out.update(0);
+        TS_ASSERT_EQUALS(parsed.object, all.object);
+        TS_ASSERT_EQUALS(parsed.seqno, all.seqno);
+        TS_ASSERT_EQUALS(parsed.fields, all.fields);
+        TS_ASSERT_EQUALS(parsed.epoch, all.epoch);
+        TS_ASSERT_EQUALS(parsed.parent, all.parent);
+        TS_ASSERT(all.bounds == parsed.bounds);
+        TS_ASSERT_EQUALS(parsed.mesh, all.mesh);
+        TS_ASSERT_EQUALS(parsed.physics, all.physics);
+        TS_ASSERT_EQUALS(parsed.query_data, all.query_data);
+        TS_ASSERT(parsed.index_ids == all.index_ids);
+
+        TS_ASSERT_EQUALS(out.update(1).object, UUID((uint32)2));
+        TS_ASSERT_EQUALS(out.update(1).fields, 0u);
+
+        // And through the LocUpdate interface
+        NopTimeSynced sync;
+        CompactProtocolLocUpdate lu(parsed, sync);
+        TS_ASSERT_EQUALS(lu.object(), ObjectReference(all.object));
+        TS_ASSERT(lu.has_epoch() && lu.has_parent() && lu.has_bounds() && lu.has_mesh());
+        TS_ASSERT(!lu.has_location() && !lu.has_orientation());
+        TS_ASSERT_EQUALS(lu.mesh_seqno(), all.seqno);
+        TS_ASSERT_EQUALS(lu.index_id_size(), 3u);
+    }
+
+    void testEmpty() {
+        CompactLocUpdateEncoder encoder(Vector3f(1, 2, 3), 0.001f, 0.001f);
+        TS_ASSERT_EQUALS(encoder.centroid(), Vector3f(1, 2, 3));
+        CompactBulkLocationUpdate out;
+        TS_ASSERT(out.ParseFromString(encoder.serialize()));
+        TS_ASSERT_EQUALS(out.update_size(), 0);
+    }
+
+    void testRejectsTruncated() {
+        String valid = validMessage();
+        CompactBulkLocationUpdate out;
+        TS_ASSERT(out.ParseFromString(valid));
+        TS_ASSERT_EQUALS(out.update_size(), 4);
+
+        for(String::size_type len = 0; len < valid.size(); len++) {
+            TS_ASSERT(!out.ParseFromString(valid.substr(0, len)));
+            TS_ASSERT_EQUALS(out.update_size(), 0);
+        }
+        // Trailing data is an error too
+        TS_ASSERT(!out.ParseFromString(valid + '\0'));
+    }
+
+    void testRejectsGarbage() {
+        CompactBulkLocationUpdate out;
+
+        String valid = validMessage();
+        String wrong_version = valid;
+        wrong_version[1] = 2;
+        TS_ASSERT(!out.ParseFromString(wrong_version));
+
+        // Protocol buffers never start with a zero byte
+        TS_ASSERT(!CompactBulkLocationUpdate::isCompact(String()));
+        TS_ASSERT(!CompactBulkLocationUpdate::isCompact(String("\x0a\x02", 2)));
+        TS_ASSERT(!out.ParseFromString(String("\x0a\x02", 2)));
+
+        // A huge update count or string length with nothing behind it
+        String huge_count = String("\0\x01", 2) + String(1, '\0') + String(20, '\0') + String("\xff\xff\xff\xff\x0f", 5);
+        TS_ASSERT(!out.ParseFromString(huge_count));
+        // A varint that never ends
+        String endless = String("\0\x01", 2) + String(16, '\xff');
+        TS_ASSERT(!out.ParseFromString(endless));
+
+        // Random corruption of a valid message must fail or parse cleanly,
+        // never read out of bounds
+        for(uint32 trial = 0; trial < 2000; trial++) {
+            String corrupt = valid;
+            uint32 nflips = 1 + trial % 4;
+            for(uint32 f = 0; f < nflips; f++) {
+                uint32 pos = 2 + (uint32)random(0, (float32)(corrupt.size() - 2));
+                corrupt[std::min<uint32>(pos, corrupt.size() - 1)] = (char)(uint32)random(0, 256);
+            }
+            if (!out.ParseFromString(corrupt))
+                TS_ASSERT_EQUALS(out.update_size(), 0);
+        }
+
+        // And entirely random bytes after a valid marker
+        for(uint32 trial = 0; trial < 2000; trial++) {
+            String noise("\0\x01", 2);
+            uint32 len = (uint32)random(0, 200);
+            for(uint32 i = 0; i < len; i++)
+                noise.push_back((char)(uint32)random(0, 256));
+            if (!out.ParseFromString(noise))
+                TS_ASSERT_EQUALS(out.update_size(), 0);
+        }
+    }
+};
@@ -0,0 +1,139 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/proxyobject/ProxyStateStore.hpp>
+
+using namespace Sirikata;
+
+class ProxyStateStoreTest : public CxxTest::TestSuite {
+    typedef ProxyStateStore::State State;
+
+    static SpaceObjectReference makeID(uint32 space, uint32 obj) {
+        return SpaceObjectReference(
+            SpaceID(UUID(space)),
+            ObjectReference(UUID(obj))
+        );
+    }
+
+    static Time at(uint64 secs) {
+        return Time::null() + Duration::seconds((float64)secs);
+    }
+
+    static TimedMotionVector3f loc(uint64 secs, float x) {
+        return TimedMotionVector3f(at(secs), MotionVector3f(Vector3f(x, 0, 0), Vector3f::zero()));
+    }
+
+    static TimedMotionQuaternion orient(uint64 secs, const Quaternion& q) {
+        return TimedMotionQuaternion(at(secs), MotionQuaternion(q, Quaternion::identity()));
+    }
+
+public:
+    void testRefCounting() {
+        ProxyStateStore store;
+        SpaceObjectReference a = makeID(1, 1), b = makeID(1, 2);
+
+        State* a1 = store.acquire(a);
+        TS_ASSERT_EQUALS(store.size(), 1u);
+        TS_ASSERT_EQUALS(store.references(), 1u);
+        TS_ASSERT_EQUALS(a1->id(), a);
+
+        State* a2 = store.acquire(a);
+        State* b1 = store.acquire(b);
+        TS_ASSERT_EQUALS(store.size(), 2u);
+        TS_ASSERT_EQUALS(store.references(), 3u);
+
+        // The entry stays as long as anybody references it
+        store.release(a1);
+        TS_ASSERT_EQUALS(store.size(), 2u);
+        TS_ASSERT_EQUALS(store.references(), 2u);
+        store.release(a2);
+        TS_ASSERT_EQUALS(store.size(), 1u);
+        store.release(b1);
+        TS_ASSERT_EQUALS(store.size(), 0u);
+        TS_ASSERT_EQUALS(store.references(), 0u);
+    }
+
+    void testSharing() {
+        ProxyStateStore store;
+        // Same object in different spaces is a different object
+        SpaceObjectReference a = makeID(1, 1), other_space = makeID(2, 1);
+
+        State* a1 = store.acquire(a);
+        State* a2 = store.acquire(a);
+        State* c = store.acquire(other_space);
+        TS_ASSERT_EQUALS(a1, a2);
+        TS_ASSERT_DIFFERS(a1, c);
+
+        {
+            State::Lock lck(a1->mutex);
+            TS_ASSERT(a1->updateMesh(Transfer::URI("meerkat:///a.dae"), at(1)));
+        }
+        TS_ASSERT_EQUALS(a2->props.mesh(), Transfer::URI("meerkat:///a.dae"));
+        TS_ASSERT(c->props.mesh().empty());
+
+        // Once the last reference is gone, a new entry starts out empty
+        store.release(a1);
+        store.release(a2);
+        State* a3 = store.acquire(a);
+        TS_ASSERT(a3->props.mesh().empty());
+
+        store.release(a3);
+        store.release(c);
+    }
+
+    void testLocationOrdering() {
+        ProxyStateStore store;
+        State* state = store.acquire(makeID(1, 1));
+        {
+            State::Lock lck(state->mutex);
+
+            TS_ASSERT(state->updateLocation(loc(10, 1.f)));
+            // Another presence that's behind reports an older location
+            TS_ASSERT(!state->updateLocation(loc(5, 2.f)));
+            TS_ASSERT_EQUALS(state->props.location().position().x, 1.f);
+            // Same time is fine, it's the same update
+            TS_ASSERT(state->updateLocation(loc(10, 1.f)));
+            TS_ASSERT(state->updateLocation(loc(11, 3.f)));
+            TS_ASSERT_EQUALS(state->props.location().position().x, 3.f);
+
+            Quaternion rot(Vector3f(0, 1, 0), 1.f);
+            TS_ASSERT(state->updateOrientation(orient(10, rot)));
+            TS_ASSERT(!state->updateOrientation(orient(9, Quaternion::identity())));
+            TS_ASSERT_EQUALS(state->props.orientation().position(), rot);
+        }
+        store.release(state);
+    }
+
+    void testEpochOrdering() {
+        ProxyStateStore store;
+        State* state = store.acquire(makeID(1, 1));
+        {
+            State::Lock lck(state->mutex);
+
+            TS_ASSERT(state->updateBounds(AggregateBoundingInfo(Vector3f::zero(), 2.f), at(10)));
+            TS_ASSERT(!state->updateBounds(AggregateBoundingInfo(Vector3f::zero(), 1.f), at(9)));
+            TS_ASSERT_EQUALS(state->props.bounds().fullRadius(), 2.f);
+
+            TS_ASSERT(state->updateMesh(Transfer::URI("meerkat:///new.dae"), at(10)));
+            TS_ASSERT(!state->updateMesh(Transfer::URI("meerkat:///old.dae"), at(3)));
+            TS_ASSERT_EQUALS(state->props.mesh(), Transfer::URI("meerkat:///new.dae"));
+
+            TS_ASSERT(state->updatePhysics("new", at(10)));
+            TS_ASSERT(!state->updatePhysics("old", at(3)));
+            TS_ASSERT_EQUALS(state->props.physics(), "new");
+
+            TS_ASSERT(state->updateIsAggregate(true, at(10)));
+            TS_ASSERT(!state->updateIsAggregate(false, at(3)));
+            TS_ASSERT(state->props.isAggregate());
+
+            // Parts are ordered independently
+            TS_ASSERT(state->updatePhysics("newer", at(20)));
+            TS_ASSERT(state->updateMesh(Transfer::URI("meerkat:///newer.dae"), at(15)));
+            TS_ASSERT_EQUALS(state->props.physics(), "newer");
+        }
+        store.release(state);
+    }
+};
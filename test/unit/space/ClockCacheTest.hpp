@@ -0,0 +1,146 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include "../../../space/src/caches/ClockCache.hpp"
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <sirikata/core/util/Timer.hpp>
+
+using namespace Sirikata;
+
+class ClockCacheTest : public CxxTest::TestSuite {
+    Network::IOService* mIOService;
+    Network::IOStrand* mStrand;
+    Context* mContext;
+
+    static UUID id(uint32 i) {
+        return UUID(i + 1);
+    }
+
+    static OSegEntry entry(uint32 i) {
+        return OSegEntry(i + 1, 1.f);
+    }
+
+    bool contains(ClockCache& cache, uint32 i) {
+        return cache.get(id(i)).server() == entry(i).server();
+    }
+
+public:
+    void setUp() {
+        mIOService = new Network::IOService("ClockCacheTest");
+        mStrand = mIOService->createStrand("ClockCacheTest");
+        mContext = new Context("ClockCacheTest", mIOService, mStrand, NULL, Timer::now());
+    }
+
+    void tearDown() {
+        delete mContext;
+        delete mStrand;
+        delete mIOService;
+    }
+
+    void testShardSizing() {
+        // The default settings, 200 entries and 16 shards, would leave each
+        // shard with a dozen entries
+        TS_ASSERT_EQUALS(ClockCache(mContext, 200, 16, Duration::seconds(8)).numShards(), 2u);
+        TS_ASSERT_EQUALS(ClockCache(mContext, 10, 16, Duration::seconds(8)).numShards(), 1u);
+        TS_ASSERT_EQUALS(ClockCache(mContext, 100000, 16, Duration::seconds(8)).numShards(), 16u);
+        TS_ASSERT_EQUALS(ClockCache(mContext, 100000, 5, Duration::seconds(8)).numShards(), 8u);
+    }
+
+    void testInsertRemove() {
+        // One shard at its capacity, so probe sequences collide and every
+        // removal has to shift entries back to close the gap
+        const uint32 capacity = 64;
+        ClockCache cache(mContext, capacity, 1, Duration::seconds(8));
+
+        for(uint32 i = 0; i < capacity; i++)
+            cache.insert(id(i), entry(i));
+        TS_ASSERT_EQUALS(cache.size(), capacity);
+        for(uint32 i = 0; i < capacity; i++)
+            TS_ASSERT(contains(cache, i));
+
+        std::vector<bool> present(capacity, true);
+        uint32 x = 1;
+        for(uint32 round = 0; round < 2000; round++) {
+            x = x * 1103515245u + 12345u;
+            uint32 i = (x >> 8) % capacity;
+            if (present[i])
+                cache.remove(id(i));
+            else
+                cache.insert(id(i), entry(i));
+            present[i] = !present[i];
+
+            if (round % 50 == 0) {
+                uint32 expected_size = 0;
+                for(uint32 j = 0; j < capacity; j++) {
+                    TS_ASSERT_EQUALS(contains(cache, j), (bool)present[j]);
+                    if (present[j]) expected_size++;
+                }
+                TS_ASSERT_EQUALS(cache.size(), expected_size);
+            }
+        }
+
+        // Removing something that isn't there does nothing
+        uint32 before = cache.size();
+        cache.remove(id(capacity + 1));
+        TS_ASSERT_EQUALS(cache.size(), before);
+
+        // Updating an entry replaces it in place
+        uint32 updated = 0;
+        while(!present[updated]) updated++;
+        cache.insert(id(updated), entry(capacity));
+        TS_ASSERT_EQUALS(cache.get(id(updated)).server(), entry(capacity).server());
+        TS_ASSERT_EQUALS(cache.size(), before);
+    }
+
+    void testClockEviction() {
+        const uint32 capacity = 64;
+        ClockCache cache(mContext, capacity, 1, Duration::seconds(8));
+        for(uint32 i = 0; i < capacity; i++)
+            cache.insert(id(i), entry(i));
+
+        // Entry 0 keeps getting used, so it always has its second chance when
+        // the hand comes around. Entry 1 is never used again.
+        uint32 last = capacity * 4;
+        for(uint32 i = capacity; i <= last; i++) {
+            TS_ASSERT(contains(cache, 0));
+            // Ask for the new entry often enough that admission never turns
+            // it away, so only CLOCK decides what's evicted
+            for(uint32 n = 0; n < 16; n++)
+                cache.get(id(i));
+            cache.insert(id(i), entry(i));
+            TS_ASSERT_EQUALS(cache.size(), capacity);
+        }
+        TS_ASSERT(contains(cache, 0));
+        TS_ASSERT(contains(cache, last));
+        TS_ASSERT(!contains(cache, 1));
+    }
+
+    void testAdmission() {
+        const uint32 capacity = 64;
+        ClockCache cache(mContext, capacity, 1, Duration::seconds(8));
+        for(uint32 i = 0; i < capacity; i++)
+            cache.insert(id(i), entry(i));
+        // Everything in the cache has been asked for a few times
+        for(uint32 n = 0; n < 3; n++)
+            for(uint32 i = 0; i < capacity; i++)
+                TS_ASSERT(contains(cache, i));
+
+        // A one-off lookup doesn't push out anything more popular
+        uint32 newcomer = capacity;
+        cache.insert(id(newcomer), entry(newcomer));
+        TS_ASSERT(!contains(cache, newcomer));
+        for(uint32 i = 0; i < capacity; i++)
+            TS_ASSERT(contains(cache, i));
+
+        // Once it's been asked for more often than the others it gets in
+        for(uint32 n = 0; n < 6; n++)
+            cache.get(id(newcomer));
+        cache.insert(id(newcomer), entry(newcomer));
+        TS_ASSERT(contains(cache, newcomer));
+        TS_ASSERT_EQUALS(cache.size(), capacity);
+    }
+};
@@ -0,0 +1,317 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include "../../../space/src/DRRODPFlowScheduler.hpp"
+#include <sirikata/space/CoordinateSegmentation.hpp>
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <sirikata/core/network/ObjectMessage.hpp>
+#include <sirikata/core/trace/Trace.hpp>
+#include <sirikata/core/util/Timer.hpp>
+
+using namespace Sirikata;
+
+#define LOCAL_SERVER 1
+#define REMOTE_SERVER 2
+#define ODP_SERVICE 0
+
+class DRRODPFlowSchedulerTest : public CxxTest::TestSuite, public ForwarderServiceQueue::Listener {
+    // Two servers side by side. Without a LocationService the scheduler
+    // computes weights from the server's region and the object's radius.
+    class TestCoordinateSegmentation : public CoordinateSegmentation {
+    public:
+        TestCoordinateSegmentation(SpaceContext* ctx)
+         : CoordinateSegmentation(ctx)
+        {}
+
+        virtual ServerID lookup(const Vector3f& pos) {
+            return (pos.x < 100.f) ? LOCAL_SERVER : REMOTE_SERVER;
+        }
+        virtual BoundingBoxList serverRegion(const ServerID& server) {
+            BoundingBoxList result;
+            float32 xmin = (server - 1) * 100.f;
+            result.push_back(BoundingBox3f(Vector3f(xmin, 0, 0), Vector3f(xmin + 100.f, 100.f, 100.f)));
+            return result;
+        }
+        virtual BoundingBox3f region() {
+            return BoundingBox3f(Vector3f(0, 0, 0), Vector3f(200.f, 100.f, 100.f));
+        }
+        virtual uint32 numServers() {
+            return 2;
+        }
+        virtual std::vector<ServerID> lookupBoundingBox(const BoundingBox3f& bbox) {
+            std::vector<ServerID> result;
+            if (bbox.min().x < 100.f) result.push_back(LOCAL_SERVER);
+            if (bbox.max().x >= 100.f) result.push_back(REMOTE_SERVER);
+            return result;
+        }
+        virtual void receiveMessage(Message* msg) {
+            delete msg;
+        }
+    private:
+        virtual void service() {}
+    };
+
+    // Weighs each flow by its source object's radius so tests can pick
+    // weights directly
+    static double sourceRadiusWeight(const Vector3d& src_min, const Vector3d& src_max, const Vector3d& dst_min, const Vector3d& dst_max) {
+        return (src_max.x - src_min.x) / 2;
+    }
+    static RegionWeightCalculator* createWeightCalculator(const String& args) {
+        return new RegionWeightCalculator(&sourceRadiusWeight);
+    }
+
+    struct Flow {
+        Flow(float w, uint32 payload)
+         : source(UUID::random()),
+           dest(UUID::random()),
+           weight(w),
+           payloadSize(payload),
+           popped(0),
+           poppedBytes(0)
+        {}
+
+        UUID source;
+        UUID dest;
+        float weight;
+        uint32 payloadSize;
+        uint32 popped;
+        uint32 poppedBytes;
+    };
+
+    Trace::Trace* mTrace;
+    Network::IOService* mIOService;
+    Network::IOStrand* mStrand;
+    SpaceContext* mContext;
+    TestCoordinateSegmentation* mCSeg;
+    String mWeightCalculatorName;
+    bool mRegisteredWeightCalculator;
+
+    ForwarderServiceQueue* mQueue;
+    DRRODPFlowScheduler* mScheduler;
+    std::vector<Flow> mFlows;
+    std::map<UniqueMessageID, uint32> mFlowsByPayload;
+
+    AbstractQueue<Message*>* createScheduler(ServerID sid, uint32 max_size) {
+        mScheduler = new DRRODPFlowScheduler(mContext, mQueue, sid, ODP_SERVICE, max_size, NULL);
+        return mScheduler;
+    }
+
+    void createQueue(uint32 max_size) {
+        using std::tr1::placeholders::_1;
+        using std::tr1::placeholders::_2;
+
+        mQueue = new ForwarderServiceQueue(LOCAL_SERVER, max_size, this);
+        mQueue->addService(
+            ODP_SERVICE,
+            std::tr1::bind(&DRRODPFlowSchedulerTest::createScheduler, this, _1, _2)
+        );
+        // Forces allocation of the scheduler for the remote server
+        mQueue->empty(REMOTE_SERVER);
+        TS_ASSERT(mScheduler != NULL);
+    }
+
+    uint32 addFlow(float weight, uint32 payload_size) {
+        mFlows.push_back(Flow(weight, payload_size));
+        return mFlows.size() - 1;
+    }
+
+    bool push(uint32 flow_idx) {
+        Flow& flow = mFlows[flow_idx];
+        Sirikata::Protocol::Object::ObjectMessage* msg =
+            createObjectMessage(LOCAL_SERVER, flow.source, 1, flow.dest, 1, String(flow.payloadSize, 'x'));
+        mFlowsByPayload[msg->unique()] = flow_idx;
+        // Radius 1 makes the scheduler warn about a bad approximation
+        bool pushed = mScheduler->push(msg, OSegEntry(LOCAL_SERVER, flow.weight), OSegEntry(REMOTE_SERVER, 2.f));
+        delete msg;
+        return pushed;
+    }
+
+    uint32 messageSize(uint32 flow_idx) {
+        Flow& flow = mFlows[flow_idx];
+        Sirikata::Protocol::Object::ObjectMessage* msg =
+            createObjectMessage(LOCAL_SERVER, flow.source, 1, flow.dest, 1, String(flow.payloadSize, 'x'));
+        uint32 result = msg->ByteSize();
+        delete msg;
+        return result;
+    }
+
+    // Pops the next message, returning the index of the flow it came from or
+    // -1 if nothing was queued
+    int32 pop() {
+        Message* msg = mQueue->pop(REMOTE_SERVER);
+        if (msg == NULL) return -1;
+        uint32 flow_idx = mFlowsByPayload[msg->payload_id()];
+        mFlows[flow_idx].popped++;
+        mFlows[flow_idx].poppedBytes += msg->size();
+        delete msg;
+        return flow_idx;
+    }
+
+    uint64 overflowDrops() {
+        return mTrace->drops.d[Trace::Drops::DROPPED_DRR_OVERFLOW];
+    }
+
+public:
+    virtual void forwarderServiceMessageReady(ServerID dest_server) {}
+
+    void setUp() {
+        mWeightCalculatorName = GetOptionValue<String>(OPT_REGION_WEIGHT);
+        mRegisteredWeightCalculator =
+            RegionWeightCalculatorFactory::getSingleton().registerConstructor(
+                mWeightCalculatorName, &createWeightCalculator
+            );
+        TS_ASSERT(mRegisteredWeightCalculator);
+
+        mTrace = new Trace::Trace("DRRODPFlowSchedulerTest.trace");
+        mIOService = new Network::IOService("DRRODPFlowSchedulerTest");
+        mStrand = mIOService->createStrand("DRRODPFlowSchedulerTest");
+        mContext = new SpaceContext("DRRODPFlowSchedulerTest", LOCAL_SERVER, NULL, NULL, mIOService, mStrand, Timer::now(), mTrace);
+        mCSeg = new TestCoordinateSegmentation(mContext);
+        mQueue = NULL;
+        mScheduler = NULL;
+    }
+
+    void tearDown() {
+        if (mQueue != NULL) {
+            while(pop() != -1) {}
+            delete mQueue;
+        }
+        mQueue = NULL;
+        mScheduler = NULL;
+        mFlows.clear();
+        mFlowsByPayload.clear();
+
+        delete mCSeg;
+        delete mContext;
+        delete mStrand;
+        delete mIOService;
+        mTrace->prepareShutdown();
+        mTrace->shutdown();
+        delete mTrace;
+
+        if (mRegisteredWeightCalculator)
+            RegionWeightCalculatorFactory::getSingleton().unregisterConstructor(mWeightCalculatorName);
+    }
+
+    void testEqualWeightsShareEvenly() {
+        createQueue(1 << 20);
+        uint32 a = addFlow(4.f, 1000), b = addFlow(4.f, 1000);
+        for(uint32 i = 0; i < 20; i++) {
+            TS_ASSERT(push(a));
+            TS_ASSERT(push(b));
+        }
+
+        for(uint32 i = 0; i < 20; i++)
+            TS_ASSERT(pop() != -1);
+        TS_ASSERT_LESS_THAN_EQUALS(mFlows[a].popped, 11u);
+        TS_ASSERT_LESS_THAN_EQUALS(mFlows[b].popped, 11u);
+
+        // Everything that went in comes out
+        while(pop() != -1) {}
+        TS_ASSERT_EQUALS(mFlows[a].popped, 20u);
+        TS_ASSERT_EQUALS(mFlows[b].popped, 20u);
+        TS_ASSERT(mScheduler->empty());
+        TS_ASSERT_EQUALS(mScheduler->size(), 0u);
+    }
+
+    void testQuantumScalesWithWeight() {
+        // Flow a's quantum is 3x flow b's, so while both are backlogged it
+        // should get 3 messages out for every one of b's
+        createQueue(1 << 20);
+        uint32 a = addFlow(6.f, 1000), b = addFlow(2.f, 1000);
+        for(uint32 i = 0; i < 40; i++) {
+            TS_ASSERT(push(a));
+            TS_ASSERT(push(b));
+        }
+        TS_ASSERT_DELTA(mScheduler->totalActiveWeight(), 8.f, .001f);
+
+        for(uint32 i = 0; i < 40; i++)
+            TS_ASSERT(pop() != -1);
+        TS_ASSERT_LESS_THAN_EQUALS(29u, mFlows[a].popped);
+        TS_ASSERT_LESS_THAN_EQUALS(mFlows[a].popped, 31u);
+        TS_ASSERT_EQUALS(mFlows[a].popped + mFlows[b].popped, 40u);
+    }
+
+    void testDeficitSharesBytesNotMessages() {
+        // Equal weights but a's messages are 4x larger. Deficits carry over
+        // between rounds, so a still gets through and both get the same
+        // number of bytes, not the same number of messages.
+        createQueue(1 << 20);
+        uint32 a = addFlow(4.f, 4000), b = addFlow(4.f, 1000);
+        for(uint32 i = 0; i < 40; i++) {
+            TS_ASSERT(push(a));
+            TS_ASSERT(push(b));
+        }
+
+        for(uint32 i = 0; i < 40; i++)
+            TS_ASSERT(pop() != -1);
+        TS_ASSERT_LESS_THAN(0u, mFlows[a].popped);
+        TS_ASSERT_LESS_THAN(mFlows[a].popped * 2, mFlows[b].popped);
+        int32 byte_diff = (int32)mFlows[a].poppedBytes - (int32)mFlows[b].poppedBytes;
+        TS_ASSERT_LESS_THAN_EQUALS(std::abs(byte_diff), (int32)(2 * messageSize(a)));
+    }
+
+    void testNewlyBackloggedFlowDoesNotWait() {
+        // A flow that shows up behind a long backlog is served as soon as the
+        // backlogged flow has used up its credit, not after the backlog
+        // drains. That's at most a couple of quanta plus the message already
+        // staged for front().
+        createQueue(1 << 20);
+        uint32 a = addFlow(4.f, 1000), b = addFlow(4.f, 1000);
+        for(uint32 i = 0; i < 20; i++)
+            TS_ASSERT(push(a));
+        TS_ASSERT_EQUALS(pop(), (int32)a);
+        TS_ASSERT(push(b));
+
+        bool saw_b = false;
+        for(uint32 i = 0; i < 5 && !saw_b; i++)
+            saw_b = (pop() == (int32)b);
+        TS_ASSERT(saw_b);
+    }
+
+    void testOverflowDrops() {
+        // Room for 4 messages, anything past that is dropped and traced
+        createQueue(4 * 1100);
+        uint32 a = addFlow(4.f, 1000);
+        TS_ASSERT_LESS_THAN_EQUALS(messageSize(a), 1100u);
+        TS_ASSERT_LESS_THAN(1100u * 4, 5 * messageSize(a));
+
+        for(uint32 i = 0; i < 4; i++)
+            TS_ASSERT(push(a));
+        TS_ASSERT_EQUALS(overflowDrops(), 0u);
+        TS_ASSERT(!push(a));
+        TS_ASSERT(!push(a));
+        TS_ASSERT_EQUALS(overflowDrops(), 2u);
+        TS_ASSERT_LESS_THAN_EQUALS(mScheduler->size(), 4u * 1100);
+
+        // Draining makes room again
+        TS_ASSERT_EQUALS(pop(), (int32)a);
+        TS_ASSERT_EQUALS(pop(), (int32)a);
+        TS_ASSERT(push(a));
+        TS_ASSERT_EQUALS(overflowDrops(), 2u);
+    }
+
+    void testOverflowDropsHeavyFlowFirst() {
+        // Once the buffer is half full, a flow over its weighted share is
+        // dropped while the other flow can still get messages in
+        createQueue(10 * 1100);
+        uint32 heavy = addFlow(4.f, 1000), light = addFlow(4.f, 1000);
+        TS_ASSERT(push(light));
+
+        uint32 accepted = 0;
+        while(push(heavy))
+            accepted++;
+        // Its share is half of the buffer
+        TS_ASSERT_LESS_THAN_EQUALS(accepted, 5u);
+        TS_ASSERT_LESS_THAN_EQUALS(4u, accepted);
+        TS_ASSERT_EQUALS(overflowDrops(), 1u);
+
+        TS_ASSERT(push(light));
+        TS_ASSERT(!push(heavy));
+        TS_ASSERT_EQUALS(overflowDrops(), 2u);
+    }
+};
@@ -0,0 +1,428 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/space/LocationSubscriptionIndex.hpp>
+#include <sirikata/pintoloc/ProtocolLocUpdate.hpp>
+#include <sirikata/core/network/IOServicePool.hpp>
+
+#include "Protocol_Loc.pbj.hpp"
+
+using namespace Sirikata;
+
+class LocationSubscriptionIndexTest : public CxxTest::TestSuite {
+public:
+    typedef LocationSubscriptionIndex<UUID, LocationSubscriptionIndexTest, LocationSubscriptionIndexTest, UUID::Hasher> TestIndex;
+
+    // A decoded update, from either encoding
+    struct Update {
+        UUID subscriber;
+        UUID object;
+        bool has_epoch;
+        bool has_location;
+        bool has_mesh;
+        Vector3f position;
+        String mesh;
+        std::vector<uint32> indexes;
+    };
+
+    // Interface used by the index
+    bool validSubscriber(const UUID& sub) {
+        return mInvalid.count(sub) == 0;
+    }
+    bool isSelfSubscriber(const UUID& sub, const UUID& observed) {
+        return sub == observed;
+    }
+    bool trySend(const UUID& sub, const String& serialized_blu, const LocationSubscriberInfoPtr& sub_info) {
+        if (mRefuseSends) return false;
+        mMessages++;
+        mLastSubInfo = sub_info;
+
+        if (CompactBulkLocationUpdate::isCompact(serialized_blu)) {
+            CompactBulkLocationUpdate bulk;
+            TS_ASSERT(bulk.ParseFromString(serialized_blu));
+            for(int32 i = 0; i < bulk.update_size(); i++) {
+                const CompactLocationUpdate& cu = bulk.update(i);
+                Update u;
+                u.subscriber = sub;
+                u.object = cu.object;
+                u.has_epoch = (cu.fields & CompactLocationUpdate::Epoch) != 0;
+                u.has_location = (cu.fields & CompactLocationUpdate::Location) != 0;
+                u.has_mesh = (cu.fields & CompactLocationUpdate::Mesh) != 0;
+                u.position = cu.location.position();
+                u.mesh = cu.mesh;
+                u.indexes.assign(cu.index_ids.begin(), cu.index_ids.end());
+                mUpdates.push_back(u);
+            }
+            return true;
+        }
+
+        Sirikata::Protocol::Loc::BulkLocationUpdate bulk;
+        TS_ASSERT(bulk.ParseFromString(serialized_blu));
+        for(int32 i = 0; i < bulk.update_size(); i++) {
+            Sirikata::Protocol::Loc::LocationUpdate lu = bulk.update(i);
+            Update u;
+            u.subscriber = sub;
+            u.object = lu.object();
+            u.has_epoch = lu.has_epoch();
+            u.has_location = true;
+            u.has_mesh = true;
+            u.position = lu.location().position();
+            u.mesh = lu.mesh();
+            for(int32 j = 0; j < lu.index_id_size(); j++)
+                u.indexes.push_back(lu.index_id(j));
+            mUpdates.push_back(u);
+        }
+        return true;
+    }
+
+    uint64 epoch(const UUID& uuid) { return 3; }
+    TimedMotionVector3f location(const UUID& uuid) {
+        return TimedMotionVector3f(Time::null(), MotionVector3f(mPositions[uuid], Vector3f(0, 0, 0)));
+    }
+    TimedMotionQuaternion orientation(const UUID& uuid) {
+        return TimedMotionQuaternion(Time::null(), MotionQuaternion(Quaternion::identity(), Quaternion::identity()));
+    }
+    AggregateBoundingInfo bounds(const UUID& uuid) {
+        return AggregateBoundingInfo(Vector3f(0, 0, 0), 0.f, 1.f);
+    }
+    const String& mesh(const UUID& uuid) { return mMeshes[uuid]; }
+    const String& physics(const UUID& uuid) { return mEmpty; }
+    const String& queryData(const UUID& uuid) { return mEmpty; }
+
+private:
+    static UUID id(uint32 i) {
+        return UUID(i + 1);
+    }
+
+    void moveObject(TestIndex& index, const UUID& obj, const Vector3f& pos) {
+        mPositions[obj] = pos;
+        index.locationUpdated(obj, location(obj), this);
+    }
+
+    // Updates received by a subscriber, in the order received
+    std::vector<Update> updatesFor(const UUID& sub) {
+        std::vector<Update> result;
+        for(uint32 i = 0; i < mUpdates.size(); i++) {
+            if (mUpdates[i].subscriber == sub)
+                result.push_back(mUpdates[i]);
+        }
+        return result;
+    }
+
+    std::set<UUID> mInvalid;
+    bool mRefuseSends;
+    uint32 mMessages;
+    LocationSubscriberInfoPtr mLastSubInfo;
+    std::vector<Update> mUpdates;
+    std::map<UUID, Vector3f> mPositions;
+    std::map<UUID, String> mMeshes;
+    String mEmpty;
+
+    AtomicValue<uint32> mSentCount;
+    SeqNoPtr mSeqNo;
+
+public:
+    void setUp() {
+        mInvalid.clear();
+        mRefuseSends = false;
+        mMessages = 0;
+        mLastSubInfo.reset();
+        mUpdates.clear();
+        mPositions.clear();
+        mMeshes.clear();
+        mSentCount = 0;
+        mSeqNo = SeqNoPtr(new SeqNo(0));
+    }
+
+    void testSubscribe() {
+        TestIndex index(this, true, mSentCount);
+        UUID sub = id(0), obj = id(100);
+        mPositions[obj] = Vector3f(1, 2, 3);
+        mMeshes[obj] = "meerkat:///test/a.dae";
+
+        // Subscribing forces an update with the current state
+        index.subscribe(sub, obj, this, mSeqNo);
+        TS_ASSERT_EQUALS(index.numSubscribers(), 1u);
+        TS_ASSERT_EQUALS(index.numObjects(), 1u);
+        index.service(5, NULL);
+
+        TS_ASSERT_EQUALS(mMessages, 1u);
+        TS_ASSERT_EQUALS(mSentCount.read(), 1u);
+        TS_ASSERT_EQUALS(mUpdates.size(), 1u);
+        TS_ASSERT_EQUALS(mUpdates[0].subscriber, sub);
+        TS_ASSERT_EQUALS(mUpdates[0].object, obj);
+        TS_ASSERT_EQUALS(mUpdates[0].position, Vector3f(1, 2, 3));
+        TS_ASSERT_EQUALS(mUpdates[0].mesh, "meerkat:///test/a.dae");
+        TS_ASSERT(!mUpdates[0].has_epoch);
+
+        // Nothing new to send
+        index.service(5, NULL);
+        TS_ASSERT_EQUALS(mMessages, 1u);
+
+        // Objects subscribed to themselves get their epoch
+        index.subscribe(obj, obj, this, mSeqNo);
+        index.service(5, NULL);
+        TS_ASSERT_EQUALS(mUpdates.size(), 2u);
+        TS_ASSERT_EQUALS(mUpdates[1].subscriber, obj);
+        TS_ASSERT(mUpdates[1].has_epoch);
+    }
+
+    void testFanOut() {
+        TestIndex index(this, true, mSentCount);
+        UUID obj = id(100), other = id(101);
+        for(uint32 s = 0; s < 5; s++)
+            index.subscribe(id(s), obj, this, mSeqNo);
+        index.subscribe(id(0), other, this, mSeqNo);
+        index.service(5, NULL);
+        mUpdates.clear();
+
+        // Several updates before service() collapse into one per subscriber,
+        // carrying the latest state
+        moveObject(index, obj, Vector3f(1, 0, 0));
+        moveObject(index, obj, Vector3f(2, 0, 0));
+        index.service(5, NULL);
+
+        TS_ASSERT_EQUALS(mUpdates.size(), 5u);
+        for(uint32 s = 0; s < 5; s++) {
+            std::vector<Update> updates = updatesFor(id(s));
+            TS_ASSERT_EQUALS(updates.size(), 1u);
+            if (updates.size() != 1) continue;
+            TS_ASSERT_EQUALS(updates[0].object, obj);
+            TS_ASSERT_EQUALS(updates[0].position, Vector3f(2, 0, 0));
+        }
+
+        // Updates for objects nobody observes are ignored
+        mUpdates.clear();
+        moveObject(index, id(200), Vector3f(1, 1, 1));
+        index.service(5, NULL);
+        TS_ASSERT(mUpdates.empty());
+        TS_ASSERT_EQUALS(index.numObjects(), 2u);
+    }
+
+    void testBatching() {
+        TestIndex index(this, true, mSentCount);
+        UUID sub = id(0);
+        for(uint32 o = 0; o < 12; o++)
+            index.subscribe(sub, id(100 + o), this, mSeqNo);
+        index.service(5, NULL);
+
+        // Queued updates are split into messages of at most 5, in the order
+        // they were queued
+        TS_ASSERT_EQUALS(mMessages, 3u);
+        TS_ASSERT_EQUALS(mUpdates.size(), 12u);
+        for(uint32 o = 0; o < mUpdates.size(); o++)
+            TS_ASSERT_EQUALS(mUpdates[o].object, id(100 + o));
+    }
+
+    void testUnsubscribe() {
+        TestIndex index(this, true, mSentCount);
+        UUID obj = id(100), other = id(101);
+        for(uint32 s = 0; s < 3; s++) {
+            index.subscribe(id(s), obj, this, mSeqNo);
+            index.subscribe(id(s), other, this, mSeqNo);
+        }
+        index.service(5, NULL);
+        mUpdates.clear();
+
+        // Removing one subscription only stops updates for that object
+        index.unsubscribe(id(0), obj);
+        moveObject(index, obj, Vector3f(1, 0, 0));
+        moveObject(index, other, Vector3f(2, 0, 0));
+        index.service(5, NULL);
+        std::vector<Update> updates = updatesFor(id(0));
+        TS_ASSERT_EQUALS(updates.size(), 1u);
+        TS_ASSERT_EQUALS(updates[0].object, other);
+        TS_ASSERT_EQUALS(updatesFor(id(1)).size(), 2u);
+        TS_ASSERT_EQUALS(updatesFor(id(2)).size(), 2u);
+
+        // Removing a subscriber entirely drops its queued updates
+        mUpdates.clear();
+        moveObject(index, obj, Vector3f(3, 0, 0));
+        index.unsubscribe(id(1));
+        index.service(5, NULL);
+        TS_ASSERT(updatesFor(id(1)).empty());
+        TS_ASSERT_EQUALS(updatesFor(id(2)).size(), 1u);
+        TS_ASSERT_EQUALS(index.numSubscribers(), 2u);
+
+        // Once nobody is subscribed, everything is released
+        index.unsubscribe(id(0));
+        index.unsubscribe(id(2), obj);
+        index.unsubscribe(id(2), other);
+        index.service(5, NULL);
+        TS_ASSERT_EQUALS(index.numSubscribers(), 0u);
+        TS_ASSERT_EQUALS(index.numObjects(), 0u);
+    }
+
+    void testUnsubscribeWithUpdateQueued() {
+        TestIndex index(this, true, mSentCount);
+        UUID sub = id(0), obj = id(100);
+        index.subscribe(sub, obj, this, mSeqNo);
+        index.subscribe(id(1), obj, this, mSeqNo);
+
+        // The update queued by subscribing is still sent, but the object is
+        // released afterwards
+        index.unsubscribe(sub, obj);
+        index.unsubscribe(id(1), obj);
+        TS_ASSERT_EQUALS(index.numObjects(), 1u);
+        index.service(5, NULL);
+        TS_ASSERT_EQUALS(mUpdates.size(), 2u);
+        TS_ASSERT_EQUALS(index.numObjects(), 0u);
+        TS_ASSERT_EQUALS(index.numSubscribers(), 0u);
+
+        // And the object can be subscribed to again from scratch
+        index.subscribe(sub, obj, this, mSeqNo);
+        index.service(5, NULL);
+        TS_ASSERT_EQUALS(mUpdates.size(), 3u);
+        TS_ASSERT_EQUALS(index.numObjects(), 1u);
+    }
+
+    void testIndexes() {
+        TestIndex index(this, true, mSentCount);
+        UUID sub = id(0), obj = id(100);
+        index.subscribe(sub, obj, (ProxIndexID)1, this, mSeqNo);
+        index.subscribe(sub, obj, (ProxIndexID)2, this, mSeqNo);
+        index.service(5, NULL);
+        TS_ASSERT_EQUALS(mUpdates.size(), 1u);
+        TS_ASSERT_EQUALS(mUpdates[0].indexes.size(), 2u);
+
+        // The subscription lasts until it's removed from every index
+        mUpdates.clear();
+        index.unsubscribe(sub, obj, (ProxIndexID)1);
+        moveObject(index, obj, Vector3f(1, 0, 0));
+        index.service(5, NULL);
+        TS_ASSERT_EQUALS(mUpdates.size(), 1u);
+        TS_ASSERT_EQUALS(mUpdates[0].indexes.size(), 1u);
+        TS_ASSERT_EQUALS(mUpdates[0].indexes[0], 2u);
+
+        mUpdates.clear();
+        index.unsubscribe(sub, obj, (ProxIndexID)2);
+        moveObject(index, obj, Vector3f(2, 0, 0));
+        index.service(5, NULL);
+        TS_ASSERT(mUpdates.empty());
+        TS_ASSERT_EQUALS(index.numObjects(), 0u);
+    }
+
+    void testFailedSendsRetry() {
+        TestIndex index(this, true, mSentCount);
+        index.subscribe(id(0), id(100), this, mSeqNo);
+
+        mRefuseSends = true;
+        index.service(5, NULL);
+        TS_ASSERT(mUpdates.empty());
+
+        mRefuseSends = false;
+        index.service(5, NULL);
+        TS_ASSERT_EQUALS(mUpdates.size(), 1u);
+        TS_ASSERT_EQUALS(mSentCount.read(), 1u);
+    }
+
+    void testInvalidSubscriber() {
+        TestIndex index(this, true, mSentCount);
+        index.subscribe(id(0), id(100), this, mSeqNo);
+        index.subscribe(id(1), id(100), this, mSeqNo);
+
+        // Updates for subscribers which went away are dropped
+        mInvalid.insert(id(0));
+        index.service(5, NULL);
+        TS_ASSERT(updatesFor(id(0)).empty());
+        TS_ASSERT_EQUALS(updatesFor(id(1)).size(), 1u);
+
+        index.unsubscribe(id(0));
+        TS_ASSERT_EQUALS(index.numSubscribers(), 1u);
+    }
+
+    void testInterning() {
+        TestIndex index(this, true, mSentCount);
+        String shared("meerkat:///test/shared.dae");
+        for(uint32 o = 0; o < 10; o++) {
+            mMeshes[id(100 + o)] = shared;
+            index.subscribe(id(0), id(100 + o), this, mSeqNo);
+        }
+        TS_ASSERT_EQUALS(index.numStrings(), 1u);
+
+        index.meshUpdated(id(100), "meerkat:///test/other.dae", this);
+        TS_ASSERT_EQUALS(index.numStrings(), 2u);
+        index.service(10, NULL);
+        TS_ASSERT_EQUALS(mUpdates.size(), 10u);
+        TS_ASSERT_EQUALS(mUpdates[0].mesh, "meerkat:///test/other.dae");
+        for(uint32 i = 1; i < mUpdates.size(); i++)
+            TS_ASSERT_EQUALS(mUpdates[i].mesh, shared);
+
+        // Strings are dropped along with the last object using them
+        index.unsubscribe(id(0), id(100));
+        TS_ASSERT_EQUALS(index.numStrings(), 1u);
+        index.unsubscribe(id(0));
+        TS_ASSERT_EQUALS(index.numStrings(), 0u);
+    }
+
+    void testCompactOnlySendsChanges() {
+        TestIndex index(this, true, mSentCount);
+        UUID sub = id(0), obj = id(100);
+        mMeshes[obj] = "meerkat:///test/a.dae";
+        index.setEncoding(sub, LocUpdateEncodingCompact);
+        // Kept even though it has no subscriptions yet
+        TS_ASSERT_EQUALS(index.numSubscribers(), 1u);
+
+        index.subscribe(sub, obj, this, mSeqNo);
+        index.service(5, NULL);
+        TS_ASSERT_EQUALS(mUpdates.size(), 1u);
+        TS_ASSERT(mUpdates[0].has_location);
+        TS_ASSERT(mUpdates[0].has_mesh);
+        TS_ASSERT_EQUALS(mUpdates[0].mesh, "meerkat:///test/a.dae");
+
+        mUpdates.clear();
+        moveObject(index, obj, Vector3f(5, 0, 0));
+        index.service(5, NULL);
+        TS_ASSERT_EQUALS(mUpdates.size(), 1u);
+        TS_ASSERT(mUpdates[0].has_location);
+        TS_ASSERT(!mUpdates[0].has_mesh);
+
+        // A lost update forces everything to be sent again
+        TS_ASSERT(mLastSubInfo);
+        TestIndex::updateLost(mLastSubInfo);
+        mLastSubInfo.reset();
+        mUpdates.clear();
+        moveObject(index, obj, Vector3f(6, 0, 0));
+        index.service(5, NULL);
+        TS_ASSERT_EQUALS(mUpdates.size(), 1u);
+        TS_ASSERT(mUpdates[0].has_location);
+        TS_ASSERT(mUpdates[0].has_mesh);
+    }
+
+    void testParallelService() {
+        // The same fan-out built by workers on a thread pool
+        Network::IOServicePool pool("LocationSubscriptionIndexTest", 3);
+        pool.startWork();
+        pool.run();
+        LocationSubscriptionWorkers workers(pool.service(), 3);
+
+        TestIndex index(this, true, mSentCount);
+        uint32 nsubs = 64, nobjs = 20;
+        for(uint32 s = 0; s < nsubs; s++) {
+            for(uint32 o = 0; o < nobjs; o++)
+                index.subscribe(id(s), id(1000 + o), this, mSeqNo);
+        }
+        index.service(5, &workers);
+        TS_ASSERT_EQUALS(mUpdates.size(), nsubs * nobjs);
+
+        for(uint32 round = 0; round < 5; round++) {
+            mUpdates.clear();
+            for(uint32 o = 0; o < nobjs; o++)
+                moveObject(index, id(1000 + o), Vector3f(round, o, 0));
+            index.service(5, &workers);
+
+            TS_ASSERT_EQUALS(mUpdates.size(), nsubs * nobjs);
+            for(uint32 s = 0; s < nsubs; s++) {
+                std::vector<Update> updates = updatesFor(id(s));
+                TS_ASSERT_EQUALS(updates.size(), nobjs);
+                for(uint32 i = 0; i < updates.size(); i++)
+                    TS_ASSERT_EQUALS(updates[i].position, mPositions[updates[i].object]);
+            }
+        }
+
+        pool.join();
+    }
+};
@@ -0,0 +1,346 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include "../../../space/src/OSegLookupQueue.hpp"
+#include "../../../space/src/Options.hpp"
+#include <sirikata/space/ObjectSegmentation.hpp>
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <sirikata/core/network/ObjectMessage.hpp>
+#include <sirikata/core/options/CommonOptions.hpp>
+#include <sirikata/core/trace/Trace.hpp>
+#include <sirikata/core/util/Timer.hpp>
+#include <boost/thread.hpp>
+
+using namespace Sirikata;
+
+#define LOCAL_SERVER 1
+#define REMOTE_SERVER 2
+
+class OSegLookupQueueTest : public CxxTest::TestSuite {
+    // ObjectSegmentation registers a server message service and recipients,
+    // which are never used here
+    class NullRouter : public Router<Message*> {
+    public:
+        virtual bool route(Message* msg) {
+            delete msg;
+            return true;
+        }
+    };
+    class NullServerMessageRouter : public ServerMessageRouter {
+    public:
+        NullServerMessageRouter(SpaceContext* ctx)
+         : ServerMessageRouter(ctx)
+        {}
+        virtual Router<Message*>* createServerMessageService(const String& name) {
+            return new NullRouter();
+        }
+    };
+
+    // Answers lookups for known objects right away. Others are left
+    // outstanding until the test completes them.
+    class FakeOSeg : public ObjectSegmentation {
+    public:
+        FakeOSeg(SpaceContext* ctx, bool batching)
+         : ObjectSegmentation(ctx, ctx->mainStrand),
+           mBatching(batching)
+        {}
+
+        void addKnown(const UUID& id, const OSegEntry& entry) {
+            mKnown[id] = entry;
+        }
+        void complete(const UUID& id, const OSegEntry& entry) {
+            mLookupListener->osegLookupCompleted(id, entry);
+        }
+
+        virtual OSegEntry lookup(const UUID& obj_id) {
+            lookups.push_back(obj_id);
+            return known(obj_id);
+        }
+        // Without batching this leaves it to the default, one lookup() each
+        virtual void lookupBatch(const std::vector<UUID>& obj_ids, std::vector<OSegEntry>* results) {
+            if (!mBatching) {
+                ObjectSegmentation::lookupBatch(obj_ids, results);
+                return;
+            }
+            batches.push_back(obj_ids);
+            results->resize(obj_ids.size());
+            for(uint32 i = 0; i < obj_ids.size(); i++)
+                (*results)[i] = known(obj_ids[i]);
+        }
+        virtual OSegEntry cacheLookup(const UUID& obj_id) {
+            return OSegEntry::null();
+        }
+
+        virtual void migrateObject(const UUID& obj_id, const OSegEntry& new_server_id) {}
+        virtual void addNewObject(const UUID& obj_id, float radius) {}
+        virtual void addMigratedObject(const UUID& obj_id, float radius, ServerID idServerAckTo, bool) {}
+        virtual void removeObject(const UUID& obj_id) {}
+        virtual bool clearToMigrate(const UUID& obj_id) { return true; }
+
+        std::vector<UUID> lookups;
+        std::vector< std::vector<UUID> > batches;
+
+    private:
+        virtual void handleMigrateMessageAck(const Sirikata::Protocol::OSeg::MigrateMessageAcknowledge& msg) {}
+        virtual void handleUpdateOSegMessage(const Sirikata::Protocol::OSeg::UpdateOSegMessage& update_oseg_msg) {}
+
+        OSegEntry known(const UUID& id) {
+            std::map<UUID, OSegEntry>::iterator it = mKnown.find(id);
+            return (it == mKnown.end() ? OSegEntry::null() : it->second);
+        }
+
+        const bool mBatching;
+        std::map<UUID, OSegEntry> mKnown;
+    };
+
+    struct Result {
+        UUID dest;
+        OSegEntry entry;
+        OSegLookupQueue::ResolvedFrom resolvedFrom;
+    };
+
+    Trace::Trace* mTrace;
+    Network::IOService* mIOService;
+    Network::IOStrand* mStrand;
+    SpaceContext* mContext;
+    NullServerMessageRouter* mRouter;
+    ServerMessageDispatcher* mDispatcher;
+    FakeOSeg* mOSeg;
+    OSegLookupQueue* mQueue;
+    std::vector<Result> mResults;
+
+    void createQueue(bool batching) {
+        mOSeg = new FakeOSeg(mContext, batching);
+        mQueue = new OSegLookupQueue(mContext, mStrand, mOSeg);
+    }
+
+    void lookupCompleted(Sirikata::Protocol::Object::ObjectMessage* msg, const OSegEntry& entry, OSegLookupQueue::ResolvedFrom resolved_from) {
+        Result result;
+        result.dest = msg->dest_object();
+        result.entry = entry;
+        result.resolvedFrom = resolved_from;
+        mResults.push_back(result);
+        delete msg;
+    }
+
+    bool lookup(const UUID& dest) {
+        using std::tr1::placeholders::_1;
+        using std::tr1::placeholders::_2;
+        using std::tr1::placeholders::_3;
+
+        Sirikata::Protocol::Object::ObjectMessage* msg =
+            createObjectMessage(LOCAL_SERVER, UUID::random(), 1, dest, 1, "x");
+        bool accepted = mQueue->lookup(
+            msg, std::tr1::bind(&OSegLookupQueueTest::lookupCompleted, this, _1, _2, _3)
+        );
+        if (!accepted) delete msg;
+        return accepted;
+    }
+
+    // Accessors which fail instead of running off the end when there are
+    // fewer results, batches or lookups than expected
+    const Result& result(uint32 idx) {
+        static Result missing;
+        TS_ASSERT_LESS_THAN(idx, mResults.size());
+        return (idx < mResults.size() ? mResults[idx] : missing);
+    }
+    uint32 batchSize(uint32 idx) {
+        TS_ASSERT_LESS_THAN(idx, mOSeg->batches.size());
+        return (idx < mOSeg->batches.size() ? mOSeg->batches[idx].size() : 0);
+    }
+    UUID lookedUp(uint32 idx) {
+        TS_ASSERT_LESS_THAN(idx, mOSeg->lookups.size());
+        return (idx < mOSeg->lookups.size() ? mOSeg->lookups[idx] : UUID::null());
+    }
+
+    // Runs everything posted to the strand so far, i.e. finishes the current
+    // burst of work
+    void runPosted() {
+        mIOService->reset();
+        mIOService->poll();
+    }
+
+public:
+    void setUp() {
+        InitSpaceOptions();
+        const char* argv[] = {
+            "test",
+            "--" OSEG_LOOKUP_BATCH_SIZE "=3",
+            "--" OSEG_NEGATIVE_CACHE_LIFETIME "=200ms"
+        };
+        ParseOptions(3, const_cast<char**>(argv));
+
+        mTrace = new Trace::Trace("OSegLookupQueueTest.trace");
+        mIOService = new Network::IOService("OSegLookupQueueTest");
+        mStrand = mIOService->createStrand("OSegLookupQueueTest");
+        mContext = new SpaceContext("OSegLookupQueueTest", LOCAL_SERVER, NULL, NULL, mIOService, mStrand, Timer::now(), mTrace);
+        mRouter = new NullServerMessageRouter(mContext);
+        mDispatcher = new ServerMessageDispatcher(mContext);
+        mOSeg = NULL;
+        mQueue = NULL;
+    }
+
+    void tearDown() {
+        runPosted();
+        delete mQueue;
+        mQueue = NULL;
+        delete mOSeg;
+        mOSeg = NULL;
+        mResults.clear();
+
+        delete mDispatcher;
+        delete mRouter;
+        delete mContext;
+        delete mStrand;
+        delete mIOService;
+        mTrace->prepareShutdown();
+        mTrace->shutdown();
+        delete mTrace;
+    }
+
+    void testBurstIsOneBatch() {
+        createQueue(true);
+        UUID a = UUID::random(), b = UUID::random();
+        mOSeg->addKnown(a, OSegEntry(REMOTE_SERVER, 1.f));
+        mOSeg->addKnown(b, OSegEntry(REMOTE_SERVER, 2.f));
+
+        // Nothing goes to the OSeg until the current burst of work finishes
+        TS_ASSERT(lookup(a));
+        TS_ASSERT(lookup(b));
+        TS_ASSERT(mOSeg->batches.empty());
+
+        runPosted();
+        TS_ASSERT_EQUALS(mOSeg->batches.size(), 1u);
+        TS_ASSERT_EQUALS(batchSize(0), 2u);
+        TS_ASSERT(mOSeg->lookups.empty());
+
+        TS_ASSERT_EQUALS(mResults.size(), 2u);
+        for(uint32 i = 0; i < mResults.size(); i++) {
+            TS_ASSERT_EQUALS(mResults[i].entry.server(), (uint32)REMOTE_SERVER);
+            TS_ASSERT_EQUALS(mResults[i].resolvedFrom, OSegLookupQueue::ResolvedFromCache);
+        }
+    }
+
+    void testFullBatchFlushesImmediately() {
+        createQueue(true);
+        std::vector<UUID> ids;
+        for(uint32 i = 0; i < 4; i++) {
+            ids.push_back(UUID::random());
+            mOSeg->addKnown(ids[i], OSegEntry(REMOTE_SERVER, 1.f));
+        }
+
+        for(uint32 i = 0; i < 3; i++)
+            TS_ASSERT(lookup(ids[i]));
+        TS_ASSERT_EQUALS(mOSeg->batches.size(), 1u);
+        TS_ASSERT_EQUALS(batchSize(0), 3u);
+        TS_ASSERT_EQUALS(mResults.size(), 3u);
+
+        // Anything after that starts the next batch
+        TS_ASSERT(lookup(ids[3]));
+        TS_ASSERT_EQUALS(mOSeg->batches.size(), 1u);
+        runPosted();
+        TS_ASSERT_EQUALS(mOSeg->batches.size(), 2u);
+        TS_ASSERT_EQUALS(batchSize(1), 1u);
+        TS_ASSERT_EQUALS(mResults.size(), 4u);
+    }
+
+    void testOutstandingLookupShared() {
+        createQueue(true);
+        UUID a = UUID::random();
+        TS_ASSERT(lookup(a));
+        runPosted();
+        TS_ASSERT(lookup(a));
+        runPosted();
+        TS_ASSERT_EQUALS(mOSeg->batches.size(), 1u);
+        TS_ASSERT(mResults.empty());
+
+        // One answer from the OSeg finishes both
+        mOSeg->complete(a, OSegEntry(REMOTE_SERVER, 1.f));
+        runPosted();
+        TS_ASSERT_EQUALS(mResults.size(), 2u);
+        for(uint32 i = 0; i < mResults.size(); i++) {
+            TS_ASSERT_EQUALS(mResults[i].dest, a);
+            TS_ASSERT_EQUALS(mResults[i].entry.server(), (uint32)REMOTE_SERVER);
+            TS_ASSERT_EQUALS(mResults[i].resolvedFrom, OSegLookupQueue::ResolvedFromServer);
+        }
+    }
+
+    void testDefaultLookupBatchFallsBack() {
+        // An OSeg that doesn't implement lookupBatch gets one lookup() per
+        // object, in order
+        createQueue(false);
+        UUID a = UUID::random(), b = UUID::random();
+        mOSeg->addKnown(a, OSegEntry(REMOTE_SERVER, 1.f));
+        TS_ASSERT(lookup(a));
+        TS_ASSERT(lookup(b));
+        runPosted();
+
+        TS_ASSERT_EQUALS(mOSeg->lookups.size(), 2u);
+        TS_ASSERT_EQUALS(lookedUp(0), a);
+        TS_ASSERT_EQUALS(lookedUp(1), b);
+
+        // The known one finishes right away, the other waits on the OSeg
+        TS_ASSERT_EQUALS(mResults.size(), 1u);
+        TS_ASSERT_EQUALS(result(0).dest, a);
+        mOSeg->complete(b, OSegEntry(REMOTE_SERVER, 2.f));
+        runPosted();
+        TS_ASSERT_EQUALS(mResults.size(), 2u);
+        TS_ASSERT_EQUALS(result(1).dest, b);
+        TS_ASSERT_EQUALS(result(1).resolvedFrom, OSegLookupQueue::ResolvedFromServer);
+    }
+
+    void testNotFoundCachedUntilExpired() {
+        createQueue(true);
+        UUID a = UUID::random();
+        TS_ASSERT(lookup(a));
+        runPosted();
+        mOSeg->complete(a, OSegEntry::null());
+        runPosted();
+        TS_ASSERT_EQUALS(mResults.size(), 1u);
+        TS_ASSERT(result(0).entry.isNull());
+
+        // Answered right away without asking the OSeg again
+        TS_ASSERT(lookup(a));
+        runPosted();
+        TS_ASSERT_EQUALS(mResults.size(), 2u);
+        TS_ASSERT(result(1).entry.isNull());
+        TS_ASSERT_EQUALS(result(1).resolvedFrom, OSegLookupQueue::ResolvedFromCache);
+        TS_ASSERT_EQUALS(mOSeg->batches.size(), 1u);
+
+        // Once it expires the object is looked up again
+        boost::this_thread::sleep(boost::posix_time::milliseconds(300));
+        TS_ASSERT(lookup(a));
+        runPosted();
+        TS_ASSERT_EQUALS(mResults.size(), 2u);
+        TS_ASSERT_EQUALS(mOSeg->batches.size(), 2u);
+        mOSeg->complete(a, OSegEntry(REMOTE_SERVER, 1.f));
+        runPosted();
+        TS_ASSERT_EQUALS(mResults.size(), 3u);
+        TS_ASSERT_EQUALS(result(2).resolvedFrom, OSegLookupQueue::ResolvedFromServer);
+    }
+
+    void testNotFoundNotCachedByDefault() {
+        const char* argv[] = { "test", "--" OSEG_NEGATIVE_CACHE_LIFETIME "=0" };
+        ParseOptions(2, const_cast<char**>(argv));
+        createQueue(true);
+
+        UUID a = UUID::random();
+        TS_ASSERT(lookup(a));
+        runPosted();
+        mOSeg->complete(a, OSegEntry::null());
+        runPosted();
+
+        TS_ASSERT(lookup(a));
+        runPosted();
+        TS_ASSERT_EQUALS(mResults.size(), 1u);
+        TS_ASSERT_EQUALS(mOSeg->batches.size(), 2u);
+        mOSeg->complete(a, OSegEntry::null());
+        runPosted();
+        TS_ASSERT_EQUALS(mResults.size(), 2u);
+        TS_ASSERT_EQUALS(result(1).resolvedFrom, OSegLookupQueue::ResolvedFromServer);
+    }
+};
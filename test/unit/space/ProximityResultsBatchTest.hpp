@@ -0,0 +1,94 @@
+// Copyright (c) 2013 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include "../../../libspace/plugins/prox/ProximityResultsBatch.hpp"
+#include <sirikata/core/util/UUID.hpp>
+#include <sirikata/core/network/Message.hpp> // parse/serializePBJMessage
+#include "Protocol_Prox.pbj.hpp"
+
+using namespace Sirikata;
+
+class ProximityResultsBatchTest : public CxxTest::TestSuite {
+    static Time at(int64 ms) {
+        return Time::null() + Duration::milliseconds(ms);
+    }
+
+    // Encodes a ProximityResults with one update holding nobjs removals,
+    // numbered from first_seqno
+    static String encode(const Time& t, uint64 first_seqno, uint32 nobjs) {
+        Sirikata::Protocol::Prox::ProximityResults results;
+        results.set_t(t);
+        Sirikata::Protocol::Prox::IProximityUpdate update = results.add_update();
+        for(uint32 i = 0; i < nobjs; i++) {
+            Sirikata::Protocol::Prox::IObjectRemoval removal = update.add_removal();
+            removal.set_object(UUID((uint32)(first_seqno + i + 1)));
+            removal.set_seqno(first_seqno + i);
+        }
+        return serializePBJMessage(results);
+    }
+
+    static Sirikata::Protocol::Prox::ProximityResults decode(const String& data) {
+        Sirikata::Protocol::Prox::ProximityResults results;
+        TS_ASSERT(parsePBJMessage(&results, data));
+        return results;
+    }
+
+public:
+    void testSameTimeBatches() {
+        ProximityResultsBatch batch;
+        TS_ASSERT(batch.empty());
+        TS_ASSERT(batch.accepts(at(5)));
+
+        batch.append(encode(at(5), 0, 2), at(5));
+        TS_ASSERT(batch.accepts(at(5)));
+        batch.append(encode(at(5), 2, 3), at(5));
+        TS_ASSERT(!batch.empty());
+        TS_ASSERT_EQUALS(batch.time(), at(5));
+
+        // The batch decodes as one ProximityResults with the updates of both,
+        // in order
+        Sirikata::Protocol::Prox::ProximityResults results = decode(batch.data());
+        TS_ASSERT_EQUALS(results.t(), at(5));
+        TS_ASSERT_EQUALS(results.update_size(), 2);
+        uint64 expected_seqno = 0;
+        for(int32 u = 0; u < results.update_size(); u++) {
+            Sirikata::Protocol::Prox::ProximityUpdate update = results.update(u);
+            for(int32 r = 0; r < update.removal_size(); r++)
+                TS_ASSERT_EQUALS(update.removal(r).seqno(), expected_seqno++);
+        }
+        TS_ASSERT_EQUALS(expected_seqno, 5u);
+    }
+
+    void testDifferentTimesDontMix() {
+        // Merging would leave only the last t, so the batch refuses results
+        // from a different time until it's been sent
+        ProximityResultsBatch batch;
+        batch.append(encode(at(5), 0, 1), at(5));
+        TS_ASSERT(!batch.accepts(at(6)));
+        TS_ASSERT(!batch.accepts(at(4)));
+
+        Sirikata::Protocol::Prox::ProximityResults first = decode(batch.data());
+        TS_ASSERT_EQUALS(first.t(), at(5));
+
+        batch.clear();
+        TS_ASSERT(batch.empty());
+        TS_ASSERT(batch.accepts(at(6)));
+        batch.append(encode(at(6), 1, 1), at(6));
+        Sirikata::Protocol::Prox::ProximityResults second = decode(batch.data());
+        TS_ASSERT_EQUALS(second.t(), at(6));
+        TS_ASSERT_EQUALS(second.update_size(), 1);
+        TS_ASSERT_EQUALS(second.update(0).removal(0).seqno(), 1u);
+    }
+
+    void testConcatenatedTimesKeepLast() {
+        // Documents why the batch splits on t: appending results from two
+        // times loses the first one
+        String merged = encode(at(5), 0, 1) + encode(at(9), 1, 1);
+        Sirikata::Protocol::Prox::ProximityResults results = decode(merged);
+        TS_ASSERT_EQUALS(results.t(), at(9));
+        TS_ASSERT_EQUALS(results.update_size(), 2);
+    }
+};